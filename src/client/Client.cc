@@ -8113,6 +8113,7 @@ int Client::lookup_name(Inode *ino, Inode *parent, const UserPerm& perms)
     max_readahead = MIN(max_readahead, in->layout.get_period()*(uint64_t)conf->client_readahead_max_periods);
   }
   f->readahead.set_max_readahead_size(max_readahead);
+  f->readahead.set_max_streams(MAX(1, conf->client_readahead_max_streams));
   vector<uint64_t> alignments;
   alignments.push_back(in->layout.get_period());
   alignments.push_back(in->layout.stripe_unit);
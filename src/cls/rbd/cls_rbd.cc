@@ -1832,6 +1832,66 @@ int copyup(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
   return cls_cxx_write(hctx, 0, in->length(), in);
 }
 
+/**
+ * Sparse variant of copyup: only the extents of the parent data that are
+ * allocated are written to the clone's object.  The object is created
+ * even if no extent is provided in order to prevent future copyups.
+ *
+ * Input:
+ * @param extent_map map of object offsets to lengths
+ * @param data concatenated data of all extents
+ *
+ * Output:
+ * @returns 0 on success, or if block already exists in child
+ *  negative error code on other error
+ */
+int sparse_copyup(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  std::map<uint64_t, uint64_t> extent_map;
+  bufferlist data;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(extent_map, iter);
+    ::decode(data, iter);
+  } catch (const buffer::error &err) {
+    CLS_LOG(20, "sparse_copyup: invalid decode");
+    return -EINVAL;
+  }
+
+  // check for existence; if child object exists, just return success
+  if (cls_cxx_stat(hctx, NULL, NULL) == 0) {
+    return 0;
+  }
+
+  if (extent_map.empty()) {
+    CLS_LOG(20, "sparse_copyup: create empty object");
+    return cls_cxx_create(hctx, true);
+  }
+
+  uint64_t data_offset = 0;
+  for (auto &extent : extent_map) {
+    if (data_offset + extent.second > data.length()) {
+      CLS_ERR("sparse_copyup: extents exceed data length");
+      return -EINVAL;
+    }
+
+    CLS_LOG(20, "sparse_copyup: writing extent %" PRIu64 "~%" PRIu64 "\n",
+            extent.first, extent.second);
+    bufferlist extent_data;
+    extent_data.substr_of(data, data_offset, extent.second);
+    int r = cls_cxx_write2(hctx, extent.first, extent.second, &extent_data,
+                           CEPH_OSD_OP_FLAG_FADVISE_SEQUENTIAL |
+                           CEPH_OSD_OP_FLAG_FADVISE_NOCACHE);
+    if (r < 0) {
+      CLS_ERR("sparse_copyup: writing extent %" PRIu64 "~%" PRIu64 " failed: %s",
+              extent.first, extent.second, cpp_strerror(r).c_str());
+      return r;
+    }
+    data_offset += extent.second;
+  }
+  return 0;
+}
+
 
 /************************ rbd_id object methods **************************/
 
@@ -5102,6 +5162,7 @@ CLS_INIT(rbd)
   cls_method_handle_t h_snapshot_rename;
   cls_method_handle_t h_get_all_features;
   cls_method_handle_t h_copyup;
+  cls_method_handle_t h_sparse_copyup;
   cls_method_handle_t h_get_id;
   cls_method_handle_t h_set_id;
   cls_method_handle_t h_dir_get_id;
@@ -5212,6 +5273,9 @@ CLS_INIT(rbd)
   cls_register_cxx_method(h_class, "copyup",
 			  CLS_METHOD_RD | CLS_METHOD_WR,
 			  copyup, &h_copyup);
+  cls_register_cxx_method(h_class, "sparse_copyup",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  sparse_copyup, &h_sparse_copyup);
   cls_register_cxx_method(h_class, "get_parent",
 			  CLS_METHOD_RD,
 			  get_parent, &h_get_parent);
@@ -796,6 +796,24 @@ namespace librbd {
       return ioctx->exec(oid, "rbd", "copyup", data, out);
     }
 
+    void sparse_copyup(librados::ObjectWriteOperation *op,
+                       const std::map<uint64_t, uint64_t> &extent_map,
+                       bufferlist data) {
+      bufferlist bl;
+      ::encode(extent_map, bl);
+      ::encode(data, bl);
+      op->exec("rbd", "sparse_copyup", bl);
+    }
+
+    int sparse_copyup(librados::IoCtx *ioctx, const std::string &oid,
+                      const std::map<uint64_t, uint64_t> &extent_map,
+                      bufferlist data) {
+      librados::ObjectWriteOperation op;
+      sparse_copyup(&op, extent_map, data);
+
+      return ioctx->operate(oid, &op);
+    }
+
     int get_protection_status(librados::IoCtx *ioctx, const std::string &oid,
 			      snapid_t snap_id, uint8_t *protection_status)
     {
@@ -1268,26 +1286,41 @@ namespace librbd {
       return 0;
     }
 
-    int metadata_get(librados::IoCtx *ioctx, const std::string &oid,
-                     const std::string &key, string *s)
+    void metadata_get_start(librados::ObjectReadOperation* op,
+                            const std::string &key)
     {
-      assert(s);
-      bufferlist in, out;
-      ::encode(key, in);
-      int r = ioctx->exec(oid, "rbd", "metadata_get", in, out);
-      if (r < 0)
-        return r;
+      bufferlist bl;
+      ::encode(key, bl);
+      op->exec("rbd", "metadata_get", bl);
+    }
 
-      bufferlist::iterator iter = out.begin();
+    int metadata_get_finish(bufferlist::iterator *it, std::string* value)
+    {
       try {
-        ::decode(*s, iter);
+        ::decode(*value, *it);
       } catch (const buffer::error &err) {
         return -EBADMSG;
       }
-
       return 0;
     }
 
+    int metadata_get(librados::IoCtx *ioctx, const std::string &oid,
+                     const std::string &key, string *s)
+    {
+      assert(s);
+      librados::ObjectReadOperation op;
+      metadata_get_start(&op, key);
+
+      bufferlist out_bl;
+      int r = ioctx->operate(oid, &op, &out_bl);
+      if (r < 0) {
+        return r;
+      }
+
+      bufferlist::iterator it = out_bl.begin();
+      return metadata_get_finish(&it, s);
+    }
+
     void mirror_uuid_get_start(librados::ObjectReadOperation *op) {
       bufferlist bl;
       op->exec("rbd", "mirror_uuid_get", bl);
@@ -156,6 +156,12 @@ namespace librbd {
 
     int copyup(librados::IoCtx *ioctx, const std::string &oid,
 	       bufferlist data);
+    void sparse_copyup(librados::ObjectWriteOperation *op,
+                       const std::map<uint64_t, uint64_t> &extent_map,
+                       bufferlist data);
+    int sparse_copyup(librados::IoCtx *ioctx, const std::string &oid,
+                      const std::map<uint64_t, uint64_t> &extent_map,
+                      bufferlist data);
     int get_protection_status(librados::IoCtx *ioctx, const std::string &oid,
 			      snapid_t snap_id, uint8_t *protection_status);
     int set_protection_status(librados::IoCtx *ioctx, const std::string &oid,
@@ -193,6 +199,9 @@ namespace librbd {
                          const std::string &key);
     int metadata_remove(librados::IoCtx *ioctx, const std::string &oid,
                         const std::string &key);
+    void metadata_get_start(librados::ObjectReadOperation* op,
+                            const std::string &key);
+    int metadata_get_finish(bufferlist::iterator *it, std::string* value);
     int metadata_get(librados::IoCtx *ioctx, const std::string &oid,
                      const std::string &key, string *v);
 
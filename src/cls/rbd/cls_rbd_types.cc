@@ -76,39 +76,54 @@ std::ostream& operator<<(std::ostream& os, const MirrorPeer& peer) {
 }
 
 void MirrorImage::encode(bufferlist &bl) const {
-  ENCODE_START(1, 1, bl);
+  ENCODE_START(2, 1, bl);
   ::encode(global_image_id, bl);
   ::encode(static_cast<uint8_t>(state), bl);
+  ::encode(static_cast<uint8_t>(mode), bl);
   ENCODE_FINISH(bl);
 }
 
 void MirrorImage::decode(bufferlist::iterator &it) {
   uint8_t int_state;
-  DECODE_START(1, it);
+  DECODE_START(2, it);
   ::decode(global_image_id, it);
   ::decode(int_state, it);
   state = static_cast<MirrorImageState>(int_state);
+  if (struct_v >= 2) {
+    uint8_t int_mode;
+    ::decode(int_mode, it);
+    mode = static_cast<MirrorImageMode>(int_mode);
+  }
   DECODE_FINISH(it);
 }
 
 void MirrorImage::dump(Formatter *f) const {
   f->dump_string("global_image_id", global_image_id);
   f->dump_int("state", state);
+  f->dump_int("mode", mode);
 }
 
 void MirrorImage::generate_test_instances(std::list<MirrorImage*> &o) {
   o.push_back(new MirrorImage());
   o.push_back(new MirrorImage("uuid-123", MIRROR_IMAGE_STATE_ENABLED));
   o.push_back(new MirrorImage("uuid-abc", MIRROR_IMAGE_STATE_DISABLING));
+  o.push_back(new MirrorImage("uuid-def", MIRROR_IMAGE_STATE_ENABLED,
+                              MIRROR_IMAGE_MODE_SNAPSHOT));
 }
 
 bool MirrorImage::operator==(const MirrorImage &rhs) const {
-  return global_image_id == rhs.global_image_id && state == rhs.state;
+  return global_image_id == rhs.global_image_id && state == rhs.state &&
+         mode == rhs.mode;
 }
 
 bool MirrorImage::operator<(const MirrorImage &rhs) const {
-  return global_image_id < rhs.global_image_id ||
-	(global_image_id == rhs.global_image_id  && state < rhs.state);
+  if (global_image_id != rhs.global_image_id) {
+    return global_image_id < rhs.global_image_id;
+  }
+  if (state != rhs.state) {
+    return state < rhs.state;
+  }
+  return mode < rhs.mode;
 }
 
 std::ostream& operator<<(std::ostream& os, const MirrorImageState& mirror_state) {
@@ -126,10 +141,26 @@ std::ostream& operator<<(std::ostream& os, const MirrorImageState& mirror_state)
   return os;
 }
 
+std::ostream& operator<<(std::ostream& os, const MirrorImageMode& mirror_mode) {
+  switch (mirror_mode) {
+  case MIRROR_IMAGE_MODE_JOURNAL:
+    os << "journal";
+    break;
+  case MIRROR_IMAGE_MODE_SNAPSHOT:
+    os << "snapshot";
+    break;
+  default:
+    os << "unknown (" << static_cast<uint32_t>(mirror_mode) << ")";
+    break;
+  }
+  return os;
+}
+
 std::ostream& operator<<(std::ostream& os, const MirrorImage& mirror_image) {
   os << "["
      << "global_image_id=" << mirror_image.global_image_id << ", "
-     << "state=" << mirror_image.state << "]";
+     << "state=" << mirror_image.state << ", "
+     << "mode=" << mirror_image.mode << "]";
   return os;
 }
 
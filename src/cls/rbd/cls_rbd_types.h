@@ -85,13 +85,22 @@ enum MirrorImageState {
   MIRROR_IMAGE_STATE_DISABLED  = 2,
 };
 
+enum MirrorImageMode {
+  MIRROR_IMAGE_MODE_JOURNAL  = 0,
+  MIRROR_IMAGE_MODE_SNAPSHOT = 1,
+};
+
 struct MirrorImage {
   MirrorImage() {}
   MirrorImage(const std::string &global_image_id, MirrorImageState state)
     : global_image_id(global_image_id), state(state) {}
+  MirrorImage(const std::string &global_image_id, MirrorImageState state,
+              MirrorImageMode mode)
+    : global_image_id(global_image_id), state(state), mode(mode) {}
 
   std::string global_image_id;
   MirrorImageState state = MIRROR_IMAGE_STATE_DISABLING;
+  MirrorImageMode mode = MIRROR_IMAGE_MODE_JOURNAL;
 
   void encode(bufferlist &bl) const;
   void decode(bufferlist::iterator &it);
@@ -104,6 +113,7 @@ struct MirrorImage {
 };
 
 std::ostream& operator<<(std::ostream& os, const MirrorImageState& mirror_state);
+std::ostream& operator<<(std::ostream& os, const MirrorImageMode& mirror_mode);
 std::ostream& operator<<(std::ostream& os, const MirrorImage& mirror_image);
 
 WRITE_CLASS_ENCODER(MirrorImage);
@@ -473,6 +473,7 @@ static int check_index(cls_method_context_t hctx, struct rgw_bucket_dir_header *
 
   calc_header->tag_timeout = existing_header->tag_timeout;
   calc_header->ver = existing_header->ver;
+  calc_header->reshard_status = existing_header->reshard_status;
 
   map<string, bufferlist> keys;
   string start_obj;
@@ -581,6 +582,49 @@ int rgw_bucket_update_stats(cls_method_context_t hctx, bufferlist *in, bufferlis
   return write_bucket_header(hctx, &header);
 }
 
+int rgw_bucket_set_resharding(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  // decode request
+  rgw_cls_set_bucket_resharding_op op;
+  auto iter = in->begin();
+  try {
+    ::decode(op, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: %s(): failed to decode request\n", __func__);
+    return -EINVAL;
+  }
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header(hctx, &header);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: %s(): failed to read header\n", __func__);
+    return rc;
+  }
+
+  header.reshard_status = op.reshard_status;
+
+  return write_bucket_header(hctx, &header);
+}
+
+/*
+ * While a bucket index is copied to a new layout every change to it has to
+ * reach the bilog the resharder replays, whatever the client asked for.
+ * Once the final catch-up started (and from then on, since the old index
+ * is left in place) changes are refused; the client looks up the new
+ * layout and retries there.
+ */
+static int check_resharding(const struct rgw_bucket_dir_header& header, bool *log_op)
+{
+  if (header.reshard_blocked()) {
+    CLS_LOG(1, "NOTICE: bucket index is being resharded, rejecting update\n");
+    return -CLS_RGW_ERR_BUSY_RESHARDING;
+  }
+  if (header.reshard_log_record() && log_op) {
+    *log_op = true;
+  }
+  return 0;
+}
+
 int rgw_bucket_init_index(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 {
   bufferlist::iterator iter;
@@ -686,6 +730,9 @@ int rgw_bucket_prepare_op(cls_method_context_t hctx, bufferlist *in, bufferlist
     CLS_LOG(1, "ERROR: rgw_bucket_prepare_op(): failed to read header\n");
     return rc;
   }
+  rc = check_resharding(header, &op.log_op);
+  if (rc < 0)
+    return rc;
 
   if (op.log_op) {
     rc = log_index_operation(hctx, op.key, op.op, op.tag, entry.meta.mtime,
@@ -780,29 +827,22 @@ static int read_key_entry(cls_method_context_t hctx, cls_rgw_obj_key& key, strin
   return 0;
 }
 
-int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+/*
+ * Applies a complete op to the index and to the in-memory header.  Sets
+ * *update_header if the header has to be written back; a cancelled op
+ * leaves it alone.
+ */
+static int complete_op(cls_method_context_t hctx, rgw_cls_obj_complete_op& op,
+                       struct rgw_bucket_dir_header& header, bool *update_header)
 {
-  // decode request
-  rgw_cls_obj_complete_op op;
-  bufferlist::iterator iter = in->begin();
-  try {
-    ::decode(op, iter);
-  } catch (buffer::error& err) {
-    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to decode request\n");
-    return -EINVAL;
-  }
   CLS_LOG(1, "rgw_bucket_complete_op(): request: op=%d name=%s instance=%s ver=%lu:%llu tag=%s\n",
           op.op, op.key.name.c_str(), op.key.instance.c_str(),
           (unsigned long)op.ver.pool, (unsigned long long)op.ver.epoch,
           op.tag.c_str());
 
-  struct rgw_bucket_dir_header header;
-  int rc = read_bucket_header(hctx, &header);
-  if (rc < 0) {
-    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to read header\n");
-    return -EINVAL;
-  }
+  *update_header = false;
 
+  int rc;
   struct rgw_bucket_dir_entry entry;
   bool ondisk = true;
 
@@ -945,9 +985,106 @@ int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist
     }
   }
 
+  *update_header = true;
+  return 0;
+}
+
+int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  // decode request
+  rgw_cls_obj_complete_op op;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(op, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to decode request\n");
+    return -EINVAL;
+  }
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header(hctx, &header);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to read header\n");
+    return -EINVAL;
+  }
+  rc = check_resharding(header, &op.log_op);
+  if (rc < 0)
+    return rc;
+
+  bool update_header;
+  rc = complete_op(hctx, op, header, &update_header);
+  if (rc < 0 || !update_header)
+    return rc;
+
   return write_bucket_header(hctx, &header);
 }
 
+/*
+ * Applies several complete ops in one transaction.  Reads within a method
+ * don't see its own writes, so the ops must be on different keys; the
+ * header is kept in memory and written once.  An op that fails is skipped
+ * the same way a failed bucket_complete_op would be, the others still
+ * apply.
+ */
+int rgw_bucket_complete_ops(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  rgw_cls_obj_complete_batch_op batch;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(batch, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: rgw_bucket_complete_ops(): failed to decode request\n");
+    return -EINVAL;
+  }
+
+  set<cls_rgw_obj_key> keys;
+  for (auto& op : batch.ops) {
+    if (!op.remove_objs.empty() || !keys.insert(op.key).second) {
+      CLS_LOG(1, "ERROR: rgw_bucket_complete_ops(): ops must be on distinct keys and remove no objects\n");
+      return -EINVAL;
+    }
+  }
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header(hctx, &header);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: rgw_bucket_complete_ops(): failed to read header\n");
+    return -EINVAL;
+  }
+  for (auto& op : batch.ops) {
+    rc = check_resharding(header, &op.log_op);
+    if (rc < 0)
+      return rc;
+  }
+
+  bool dirty = false;
+  for (auto& op : batch.ops) {
+    struct rgw_bucket_dir_header orig_header = header;
+    bool update_header;
+    rc = complete_op(hctx, op, header, &update_header);
+    if (rc < 0) {
+      CLS_LOG(1, "rgw_bucket_complete_ops(): op on name=%s instance=%s failed, ret=%d\n",
+              op.key.name.c_str(), op.key.instance.c_str(), rc);
+      header = orig_header;
+      continue;
+    }
+    if (update_header) {
+      /* what write_bucket_header() does after a single op, so entries and
+       * bilog keys get the versions they would have had */
+      header.ver++;
+      dirty = true;
+    }
+  }
+
+  if (!dirty)
+    return 0;
+
+  /* the version was already bumped for each op */
+  bufferlist header_bl;
+  ::encode(header, header_bl);
+  return cls_cxx_map_write_header(hctx, &header_bl);
+}
+
 template <class T>
 static int write_entry(cls_method_context_t hctx, T& entry, const string& key)
 {
@@ -1517,6 +1654,10 @@ static int rgw_bucket_link_olh(cls_method_context_t hctx, bufferlist *in, buffer
     CLS_LOG(1, "ERROR: rgw_bucket_unlink_instance(): failed to read header\n");
     return ret;
   }
+  /* failing here also drops the entry updates made above */
+  ret = check_resharding(header, &op.log_op);
+  if (ret < 0)
+    return ret;
 
   if (op.log_op) {
     rgw_bucket_dir_entry& entry = obj.get_dir_entry();
@@ -1673,6 +1814,10 @@ static int rgw_bucket_unlink_instance(cls_method_context_t hctx, bufferlist *in,
     CLS_LOG(1, "ERROR: rgw_bucket_unlink_instance(): failed to read header\n");
     return ret;
   }
+  /* failing here also drops the entry updates made above */
+  ret = check_resharding(header, &op.log_op);
+  if (ret < 0)
+    return ret;
 
   if (op.log_op) {
     rgw_bucket_entry_ver ver;
@@ -1872,6 +2017,10 @@ int rgw_dir_suggest_changes(cls_method_context_t hctx, bufferlist *in, bufferlis
     CLS_LOG(1, "ERROR: rgw_dir_suggest_changes(): failed to read header\n");
     return rc;
   }
+  bool log_record = false;
+  rc = check_resharding(header, &log_record);
+  if (rc < 0)
+    return rc;
 
   timespan tag_timeout(header.tag_timeout ? header.tag_timeout : CEPH_RGW_TAG_TIMEOUT);
 
@@ -1932,7 +2081,7 @@ int rgw_dir_suggest_changes(cls_method_context_t hctx, bufferlist *in, bufferlis
       }
       struct rgw_bucket_category_stats& stats =
           header.stats[cur_change.meta.category];
-      bool log_op = (op & CEPH_RGW_DIR_SUGGEST_LOG_OP) != 0;
+      bool log_op = log_record || (op & CEPH_RGW_DIR_SUGGEST_LOG_OP) != 0;
       op &= CEPH_RGW_DIR_SUGGEST_OP_MASK;
       switch(op) {
       case CEPH_RGW_REMOVE:
@@ -3239,22 +3388,39 @@ static int gc_iterate_entries(cls_method_context_t hctx, const string& marker, b
   return 0;
 }
 
+struct gc_list_state {
+  list<cls_rgw_gc_obj_info> *entries;
+  string last_key;
+};
+
 static int gc_list_cb(cls_method_context_t hctx, const string& key, cls_rgw_gc_obj_info& info, void *param)
 {
-  list<cls_rgw_gc_obj_info> *l = (list<cls_rgw_gc_obj_info> *)param;
-  l->push_back(info);
+  gc_list_state *state = (gc_list_state *)param;
+  state->entries->push_back(info);
+  state->last_key = key;
   return 0;
 }
 
 static int gc_list_entries(cls_method_context_t hctx, const string& marker,
 			   uint32_t max, bool expired_only,
-                           list<cls_rgw_gc_obj_info>& entries, bool *truncated)
+                           list<cls_rgw_gc_obj_info>& entries, bool *truncated,
+                           string *next_marker)
 {
   string key_iter;
+  gc_list_state state;
+  state.entries = &entries;
   int ret = gc_iterate_entries(hctx, marker, expired_only,
                               key_iter, max, truncated,
-                              gc_list_cb, &entries);
-  return ret;
+                              gc_list_cb, &state);
+  if (ret < 0)
+    return ret;
+
+  /* the marker is a time index key without the index prefix */
+  const string& prefix = gc_index_prefixes[GC_OBJ_TIME_INDEX];
+  if (state.last_key.compare(0, prefix.size(), prefix) == 0) {
+    *next_marker = state.last_key.substr(prefix.size());
+  }
+  return 0;
 }
 
 static int rgw_cls_gc_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
@@ -3270,7 +3436,8 @@ static int rgw_cls_gc_list(cls_method_context_t hctx, bufferlist *in, bufferlist
   }
 
   cls_rgw_gc_list_ret op_ret;
-  int ret = gc_list_entries(hctx, op.marker, op.max, op.expired_only, op_ret.entries, &op_ret.truncated);
+  int ret = gc_list_entries(hctx, op.marker, op.max, op.expired_only, op_ret.entries, &op_ret.truncated,
+                            &op_ret.next_marker);
   if (ret < 0)
     return ret;
 
@@ -3487,8 +3654,10 @@ CLS_INIT(rgw)
   cls_method_handle_t h_rgw_bucket_check_index;
   cls_method_handle_t h_rgw_bucket_rebuild_index;
   cls_method_handle_t h_rgw_bucket_update_stats;
+  cls_method_handle_t h_rgw_bucket_set_resharding;
   cls_method_handle_t h_rgw_bucket_prepare_op;
   cls_method_handle_t h_rgw_bucket_complete_op;
+  cls_method_handle_t h_rgw_bucket_complete_ops;
   cls_method_handle_t h_rgw_bucket_link_olh;
   cls_method_handle_t h_rgw_bucket_unlink_instance_op;
   cls_method_handle_t h_rgw_bucket_read_olh_log;
@@ -3526,8 +3695,10 @@ CLS_INIT(rgw)
   cls_register_cxx_method(h_class, RGW_BUCKET_CHECK_INDEX, CLS_METHOD_RD, rgw_bucket_check_index, &h_rgw_bucket_check_index);
   cls_register_cxx_method(h_class, RGW_BUCKET_REBUILD_INDEX, CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_rebuild_index, &h_rgw_bucket_rebuild_index);
   cls_register_cxx_method(h_class, RGW_BUCKET_UPDATE_STATS, CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_update_stats, &h_rgw_bucket_update_stats);
+  cls_register_cxx_method(h_class, RGW_BUCKET_SET_RESHARDING, CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_set_resharding, &h_rgw_bucket_set_resharding);
   cls_register_cxx_method(h_class, RGW_BUCKET_PREPARE_OP, CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_prepare_op, &h_rgw_bucket_prepare_op);
   cls_register_cxx_method(h_class, RGW_BUCKET_COMPLETE_OP, CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_complete_op, &h_rgw_bucket_complete_op);
+  cls_register_cxx_method(h_class, RGW_BUCKET_COMPLETE_OPS, CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_complete_ops, &h_rgw_bucket_complete_ops);
   cls_register_cxx_method(h_class, RGW_BUCKET_LINK_OLH, CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_link_olh, &h_rgw_bucket_link_olh);
   cls_register_cxx_method(h_class, RGW_BUCKET_UNLINK_INSTANCE, CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_unlink_instance, &h_rgw_bucket_unlink_instance_op);
   cls_register_cxx_method(h_class, RGW_BUCKET_READ_OLH_LOG, CLS_METHOD_RD, rgw_bucket_read_olh_log, &h_rgw_bucket_read_olh_log);
@@ -150,6 +150,15 @@ void cls_rgw_bucket_update_stats(librados::ObjectWriteOperation& o, bool absolut
   o.exec(RGW_CLASS, RGW_BUCKET_UPDATE_STATS, in);
 }
 
+void cls_rgw_bucket_set_resharding(librados::ObjectWriteOperation& o, uint8_t reshard_status)
+{
+  struct rgw_cls_set_bucket_resharding_op call;
+  call.reshard_status = reshard_status;
+  bufferlist in;
+  ::encode(call, in);
+  o.exec(RGW_CLASS, RGW_BUCKET_SET_RESHARDING, in);
+}
+
 void cls_rgw_bucket_prepare_op(ObjectWriteOperation& o, RGWModifyOp op, string& tag,
                                const cls_rgw_obj_key& key, const string& locator, bool log_op,
                                uint16_t bilog_flags)
@@ -189,6 +198,16 @@ void cls_rgw_bucket_complete_op(ObjectWriteOperation& o, RGWModifyOp op, string&
   o.exec(RGW_CLASS, RGW_BUCKET_COMPLETE_OP, in);
 }
 
+void cls_rgw_bucket_complete_ops(ObjectWriteOperation& o,
+                                 const list<rgw_cls_obj_complete_op>& ops)
+{
+  bufferlist in;
+  struct rgw_cls_obj_complete_batch_op call;
+  call.ops = ops;
+  ::encode(call, in);
+  o.exec(RGW_CLASS, RGW_BUCKET_COMPLETE_OPS, in);
+}
+
 static bool issue_bucket_list_op(librados::IoCtx& io_ctx,
     const string& oid, const cls_rgw_obj_key& start_obj, const string& filter_prefix,
     uint32_t num_entries, bool list_versions, BucketIndexAioManager *manager,
@@ -635,7 +654,7 @@ void cls_rgw_gc_defer_entry(ObjectWriteOperation& op, uint32_t expiration_secs,
 }
 
 int cls_rgw_gc_list(IoCtx& io_ctx, string& oid, string& marker, uint32_t max, bool expired_only,
-                    list<cls_rgw_gc_obj_info>& entries, bool *truncated)
+                    list<cls_rgw_gc_obj_info>& entries, bool *truncated, string *next_marker)
 {
   bufferlist in, out;
   cls_rgw_gc_list_op call;
@@ -660,6 +679,9 @@ int cls_rgw_gc_list(IoCtx& io_ctx, string& oid, string& marker, uint32_t max, bo
   if (truncated)
     *truncated = ret.truncated;
 
+  if (next_marker)
+    *next_marker = std::move(ret.next_marker);
+
  return r;
 }
 
@@ -311,6 +311,10 @@ public:
 void cls_rgw_bucket_update_stats(librados::ObjectWriteOperation& o, bool absolute,
                                  const map<uint8_t, rgw_bucket_category_stats>& stats);
 
+/* index updates on a shard are logged (IN_LOGRECORD) or rejected with
+ * -CLS_RGW_ERR_BUSY_RESHARDING (IN_PROGRESS, DONE) according to this */
+void cls_rgw_bucket_set_resharding(librados::ObjectWriteOperation& o, uint8_t reshard_status);
+
 void cls_rgw_bucket_prepare_op(librados::ObjectWriteOperation& o, RGWModifyOp op, string& tag,
                                const cls_rgw_obj_key& key, const string& locator, bool log_op,
                                uint16_t bilog_op);
@@ -322,6 +326,10 @@ void cls_rgw_bucket_complete_op(librados::ObjectWriteOperation& o, RGWModifyOp o
 				list<cls_rgw_obj_key> *remove_objs, bool log_op,
                                 uint16_t bilog_op);
 
+/* ops must be on distinct keys and have no remove_objs */
+void cls_rgw_bucket_complete_ops(librados::ObjectWriteOperation& o,
+                                 const list<rgw_cls_obj_complete_op>& ops);
+
 void cls_rgw_remove_obj(librados::ObjectWriteOperation& o, list<string>& keep_attr_prefixes);
 void cls_rgw_obj_store_pg_ver(librados::ObjectWriteOperation& o, const string& attr);
 void cls_rgw_obj_check_attrs_prefix(librados::ObjectOperation& o, const string& prefix, bool fail_if_exist);
@@ -478,7 +486,8 @@ void cls_rgw_gc_set_entry(librados::ObjectWriteOperation& op, uint32_t expiratio
 void cls_rgw_gc_defer_entry(librados::ObjectWriteOperation& op, uint32_t expiration_secs, const string& tag);
 
 int cls_rgw_gc_list(librados::IoCtx& io_ctx, string& oid, string& marker, uint32_t max, bool expired_only,
-                    list<cls_rgw_gc_obj_info>& entries, bool *truncated);
+                    list<cls_rgw_gc_obj_info>& entries, bool *truncated,
+                    string *next_marker = NULL);
 
 void cls_rgw_gc_remove(librados::ObjectWriteOperation& op, const list<string>& tags);
 
@@ -64,6 +64,7 @@ void cls_rgw_gc_list_op::generate_test_instances(list<cls_rgw_gc_list_op*>& ls)
 void cls_rgw_gc_list_ret::dump(Formatter *f) const
 {
   encode_json("entries", entries, f);
+  f->dump_string("next_marker", next_marker);
   f->dump_int("truncated", (int)truncated);
 }
 
@@ -72,6 +73,7 @@ void cls_rgw_gc_list_ret::generate_test_instances(list<cls_rgw_gc_list_ret*>& ls
   ls.push_back(new cls_rgw_gc_list_ret);
   ls.push_back(new cls_rgw_gc_list_ret);
   ls.back()->entries.push_back(cls_rgw_gc_obj_info());
+  ls.back()->next_marker = "00000000012.000000001";
   ls.back()->truncated = true;
 }
 
@@ -147,6 +149,24 @@ void rgw_cls_obj_complete_op::dump(Formatter *f) const
   f->dump_int("bilog_flags", bilog_flags);
 }
 
+void rgw_cls_obj_complete_batch_op::generate_test_instances(list<rgw_cls_obj_complete_batch_op*>& o)
+{
+  rgw_cls_obj_complete_batch_op *op = new rgw_cls_obj_complete_batch_op;
+  list<rgw_cls_obj_complete_op *> l;
+  rgw_cls_obj_complete_op::generate_test_instances(l);
+  for (auto iter : l) {
+    op->ops.push_back(*iter);
+    delete iter;
+  }
+  o.push_back(op);
+  o.push_back(new rgw_cls_obj_complete_batch_op);
+}
+
+void rgw_cls_obj_complete_batch_op::dump(Formatter *f) const
+{
+  encode_json("ops", ops, f);
+}
+
 void rgw_cls_link_olh_op::generate_test_instances(list<rgw_cls_link_olh_op*>& o)
 {
   rgw_cls_link_olh_op *op = new rgw_cls_link_olh_op;
@@ -366,6 +386,20 @@ void rgw_cls_bucket_update_stats_op::dump(Formatter *f) const
   ::encode_json("stats", s, f);
 }
 
+void rgw_cls_set_bucket_resharding_op::generate_test_instances(list<rgw_cls_set_bucket_resharding_op*>& o)
+{
+  rgw_cls_set_bucket_resharding_op *r = new rgw_cls_set_bucket_resharding_op;
+  r->reshard_status = CLS_RGW_RESHARD_IN_PROGRESS;
+  o.push_back(r);
+
+  o.push_back(new rgw_cls_set_bucket_resharding_op);
+}
+
+void rgw_cls_set_bucket_resharding_op::dump(Formatter *f) const
+{
+  ::encode_json("reshard_status", (int)reshard_status, f);
+}
+
 void cls_rgw_bi_log_list_op::dump(Formatter *f) const
 {
   f->dump_string("marker", marker);
@@ -156,6 +156,26 @@ struct rgw_cls_obj_complete_op
 };
 WRITE_CLASS_ENCODER(rgw_cls_obj_complete_op)
 
+/* complete ops on different keys of one index shard, applied together */
+struct rgw_cls_obj_complete_batch_op
+{
+  list<rgw_cls_obj_complete_op> ops;
+
+  void encode(bufferlist &bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(ops, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator &bl) {
+    DECODE_START(1, bl);
+    ::decode(ops, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<rgw_cls_obj_complete_batch_op*>& o);
+};
+WRITE_CLASS_ENCODER(rgw_cls_obj_complete_batch_op)
+
 struct rgw_cls_link_olh_op {
   cls_rgw_obj_key key;
   string olh_tag;
@@ -467,6 +487,27 @@ struct rgw_cls_bucket_update_stats_op
 };
 WRITE_CLASS_ENCODER(rgw_cls_bucket_update_stats_op)
 
+struct rgw_cls_set_bucket_resharding_op
+{
+  uint8_t reshard_status{CLS_RGW_RESHARD_NONE};
+
+  rgw_cls_set_bucket_resharding_op() {}
+
+  void encode(bufferlist &bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(reshard_status, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator &bl) {
+    DECODE_START(1, bl);
+    ::decode(reshard_status, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<rgw_cls_set_bucket_resharding_op *>& o);
+};
+WRITE_CLASS_ENCODER(rgw_cls_set_bucket_resharding_op)
+
 struct rgw_cls_obj_remove_op {
   list<string> keep_attr_prefixes;
 
@@ -841,21 +882,26 @@ WRITE_CLASS_ENCODER(cls_rgw_gc_list_op)
 
 struct cls_rgw_gc_list_ret {
   list<cls_rgw_gc_obj_info> entries;
+  string next_marker;
   bool truncated;
 
   cls_rgw_gc_list_ret() : truncated(false) {}
 
   void encode(bufferlist& bl) const {
-    ENCODE_START(1, 1, bl);
+    ENCODE_START(2, 1, bl);
     ::encode(entries, bl);
     ::encode(truncated, bl);
+    ::encode(next_marker, bl);
     ENCODE_FINISH(bl);
   }
 
   void decode(bufferlist::iterator& bl) {
-    DECODE_START(1, bl);
+    DECODE_START(2, bl);
     ::decode(entries, bl);
     ::decode(truncated, bl);
+    if (struct_v >= 2) {
+      ::decode(next_marker, bl);
+    }
     DECODE_FINISH(bl);
   }
 
@@ -597,26 +597,38 @@ struct rgw_bucket_category_stats {
 };
 WRITE_CLASS_ENCODER(rgw_bucket_category_stats)
 
+enum cls_rgw_reshard_status {
+  CLS_RGW_RESHARD_NONE = 0,
+  CLS_RGW_RESHARD_IN_LOGRECORD = 1, /* index updates are logged to the bilog */
+  CLS_RGW_RESHARD_IN_PROGRESS = 2,  /* index updates are rejected */
+  CLS_RGW_RESHARD_DONE = 3,         /* index updates are rejected for good */
+};
+
+#define CLS_RGW_ERR_BUSY_RESHARDING 2300 /* also in rgw_common.h, don't change! */
+
 struct rgw_bucket_dir_header {
   map<uint8_t, rgw_bucket_category_stats> stats;
   uint64_t tag_timeout;
   uint64_t ver;
   uint64_t master_ver;
   string max_marker;
+  uint8_t reshard_status;
 
-  rgw_bucket_dir_header() : tag_timeout(0), ver(0), master_ver(0) {}
+  rgw_bucket_dir_header() : tag_timeout(0), ver(0), master_ver(0),
+                            reshard_status(CLS_RGW_RESHARD_NONE) {}
 
   void encode(bufferlist &bl) const {
-    ENCODE_START(5, 2, bl);
+    ENCODE_START(6, 2, bl);
     ::encode(stats, bl);
     ::encode(tag_timeout, bl);
     ::encode(ver, bl);
     ::encode(master_ver, bl);
     ::encode(max_marker, bl);
+    ::encode(reshard_status, bl);
     ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator &bl) {
-    DECODE_START_LEGACY_COMPAT_LEN(3, 2, 2, bl);
+    DECODE_START_LEGACY_COMPAT_LEN(6, 2, 2, bl);
     ::decode(stats, bl);
     if (struct_v > 2) {
       ::decode(tag_timeout, bl);
@@ -632,10 +644,22 @@ struct rgw_bucket_dir_header {
     if (struct_v >= 5) {
       ::decode(max_marker, bl);
     }
+    if (struct_v >= 6) {
+      ::decode(reshard_status, bl);
+    } else {
+      reshard_status = CLS_RGW_RESHARD_NONE;
+    }
     DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
   static void generate_test_instances(list<rgw_bucket_dir_header*>& o);
+
+  bool reshard_log_record() const {
+    return reshard_status == CLS_RGW_RESHARD_IN_LOGRECORD;
+  }
+  bool reshard_blocked() const {
+    return reshard_status >= CLS_RGW_RESHARD_IN_PROGRESS;
+  }
 };
 WRITE_CLASS_ENCODER(rgw_bucket_dir_header)
 
@@ -16,6 +16,7 @@
 #define ASYNC_RESERVER_H
 
 #include <map>
+#include <set>
 #include <utility>
 #include <list>
 
@@ -29,6 +30,10 @@
  * Memory usage is linear with the number of items queued and
  * linear with respect to the total number of priorities used
  * over all time.
+ *
+ * Reservations that were requested with a preemption callback may be
+ * revoked in favor of a queued request with a higher priority once all
+ * slots are in use.
  */
 template <typename T>
 class AsyncReserver {
@@ -37,24 +42,56 @@ class AsyncReserver {
   unsigned min_priority;
   Mutex lock;
 
-  map<unsigned, list<pair<T, Context*> > > queues;
-  map<T, pair<unsigned, typename list<pair<T, Context*> >::iterator > > queue_pointers;
-  set<T> in_progress;
+  struct Reservation {
+    T item;
+    unsigned prio = 0;
+    Context *grant = nullptr;
+    Context *preempt = nullptr;
+    Reservation() {}
+    Reservation(T i, unsigned pr, Context *g, Context *p = nullptr)
+      : item(i), prio(pr), grant(g), preempt(p) {}
+  };
+
+  map<unsigned, list<Reservation> > queues;
+  map<T, pair<unsigned, typename list<Reservation>::iterator > > queue_pointers;
+  map<T, Reservation> in_progress;
+  set<pair<unsigned, T> > preempt_by_prio;  ///< in_progress that can be preempted
+
+  /// revoke the lowest priority preemptible reservation below prio
+  bool preempt_one(unsigned prio) {
+    if (preempt_by_prio.empty() ||
+	preempt_by_prio.begin()->first >= prio) {
+      return false;
+    }
+    T item = preempt_by_prio.begin()->second;
+    preempt_by_prio.erase(preempt_by_prio.begin());
+    typename map<T, Reservation>::iterator p = in_progress.find(item);
+    assert(p != in_progress.end());
+    f->queue(p->second.preempt);
+    in_progress.erase(p);
+    return true;
+  }
 
   void do_queues() {
-    typename map<unsigned, list<pair<T, Context*> > >::reverse_iterator it;
+    typename map<unsigned, list<Reservation> >::reverse_iterator it;
     for (it = queues.rbegin();
          it != queues.rend() &&
-	   in_progress.size() < max_allowed &&
 	   it->first >= min_priority;
          ++it) {
-      while (in_progress.size() < max_allowed &&
-             !it->second.empty()) {
-        pair<T, Context*> p = it->second.front();
-        queue_pointers.erase(p.first);
+      while (!it->second.empty()) {
+	if (in_progress.size() >= max_allowed &&
+	    !preempt_one(it->first)) {
+	  return;
+	}
+        Reservation p = it->second.front();
+        queue_pointers.erase(p.item);
         it->second.pop_front();
-        f->queue(p.second);
-        in_progress.insert(p.first);
+        f->queue(p.grant);
+	p.grant = nullptr;
+	if (p.preempt) {
+	  preempt_by_prio.insert(make_pair(p.prio, p.item));
+	}
+        in_progress[p.item] = p;
       }
     }
   }
@@ -85,24 +122,35 @@ public:
     f->dump_unsigned("max_allowed", max_allowed);
     f->dump_unsigned("min_priority", min_priority);
     f->open_array_section("queues");
-    for (typename map<unsigned, list<pair<T, Context*> > > ::const_iterator p =
+    for (typename map<unsigned, list<Reservation> > ::const_iterator p =
 	   queues.begin(); p != queues.end(); ++p) {
       f->open_object_section("queue");
       f->dump_unsigned("priority", p->first);
       f->open_array_section("items");
-      for (typename list<pair<T, Context*> >::const_iterator q =
+      for (typename list<Reservation>::const_iterator q =
 	     p->second.begin(); q != p->second.end(); ++q) {
-	f->dump_stream("item") << q->first;
+	f->dump_stream("item") << q->item;
       }
       f->close_section();
       f->close_section();
     }
     f->close_section();
     f->open_array_section("in_progress");
-    for (typename set<T>::const_iterator p = in_progress.begin();
+    for (typename map<T, Reservation>::const_iterator p = in_progress.begin();
 	 p != in_progress.end();
 	 ++p) {
-      f->dump_stream("item") << *p;
+      f->dump_stream("item") << p->first;
+    }
+    f->close_section();
+    f->open_array_section("preemptible");
+    for (typename set<pair<unsigned, T> >::const_iterator p =
+	   preempt_by_prio.begin();
+	 p != preempt_by_prio.end();
+	 ++p) {
+      f->open_object_section("item");
+      f->dump_stream("item") << p->second;
+      f->dump_unsigned("priority", p->first);
+      f->close_section();
     }
     f->close_section();
   }
@@ -114,16 +162,21 @@ public:
    * the callback must be safe in that case.  Callback will be called
    * with no locks held.  cancel_reservation must be called to release the
    * reservation slot.
+   *
+   * If on_preempt is given, the reservation may be revoked once granted
+   * to make room for a higher priority request; on_preempt is then called
+   * (with no locks held) and the slot is already released.
    */
   void request_reservation(
     T item,                   ///< [in] reservation key
     Context *on_reserved,     ///< [in] callback to be called on reservation
-    unsigned prio
+    unsigned prio,            ///< [in] priority
+    Context *on_preempt = 0   ///< [in] callback to be called if we are preempted (optional)
     ) {
     Mutex::Locker l(lock);
     assert(!queue_pointers.count(item) &&
 	   !in_progress.count(item));
-    queues[prio].push_back(make_pair(item, on_reserved));
+    queues[prio].push_back(Reservation(item, prio, on_reserved, on_preempt));
     queue_pointers.insert(make_pair(item, make_pair(prio,--(queues[prio]).end())));
     do_queues();
   }
@@ -141,11 +194,19 @@ public:
     Mutex::Locker l(lock);
     if (queue_pointers.count(item)) {
       unsigned prio = queue_pointers[item].first;
-      delete queue_pointers[item].second->second;
+      delete queue_pointers[item].second->grant;
+      delete queue_pointers[item].second->preempt;
       queues[prio].erase(queue_pointers[item].second);
       queue_pointers.erase(item);
     } else {
-      in_progress.erase(item);
+      typename map<T, Reservation>::iterator p = in_progress.find(item);
+      if (p != in_progress.end()) {
+	if (p->second.preempt) {
+	  preempt_by_prio.erase(make_pair(p->second.prio, item));
+	  delete p->second.preempt;
+	}
+	in_progress.erase(p);
+      }
     }
     do_queues();
   }
@@ -5,18 +5,25 @@
 
 using namespace std;
 
+namespace {
+
+// the readahead window never shrinks below a page
+const uint64_t MIN_READAHEAD_WINDOW = 4096;
+
+} // anonymous namespace
+
 Readahead::Readahead()
   : m_trigger_requests(10),
     m_readahead_min_bytes(0),
     m_readahead_max_bytes(NO_LIMIT),
     m_alignments(),
+    m_max_streams(1),
     m_lock("Readahead::m_lock"),
-    m_nr_consec_read(0),
-    m_consec_read_bytes(0),
-    m_last_pos(0),
-    m_readahead_pos(0),
-    m_readahead_trigger_pos(0),
-    m_readahead_size(0),
+    m_streams(1),
+    m_seq(0),
+    m_readahead_window(NO_LIMIT),
+    m_hit_bytes(0),
+    m_wasted_bytes(0),
     m_pending(0),
     m_pending_lock("Readahead::m_pending_lock") {
 }
@@ -26,66 +33,105 @@ Readahead::~Readahead() {
 
 Readahead::extent_t Readahead::update(const vector<extent_t>& extents, uint64_t limit) {
   m_lock.Lock();
+  Stream *stream = nullptr;
   for (vector<extent_t>::const_iterator p = extents.begin(); p != extents.end(); ++p) {
-    _observe_read(p->first, p->second);
+    stream = _observe_read(p->first, p->second);
   }
-  if (m_readahead_pos >= limit|| m_last_pos >= limit) {
+  if (stream == nullptr || stream->readahead_pos >= limit ||
+      stream->last_pos >= limit) {
     m_lock.Unlock();
     return extent_t(0, 0);
   }
-  pair<uint64_t, uint64_t> extent = _compute_readahead(limit);
+  pair<uint64_t, uint64_t> extent = _compute_readahead(stream, limit);
   m_lock.Unlock();
   return extent;
 }
 
 Readahead::extent_t Readahead::update(uint64_t offset, uint64_t length, uint64_t limit) {
   m_lock.Lock();
-  _observe_read(offset, length);
-  if (m_readahead_pos >= limit || m_last_pos >= limit) {
+  Stream *stream = _observe_read(offset, length);
+  if (stream->readahead_pos >= limit || stream->last_pos >= limit) {
     m_lock.Unlock();
     return extent_t(0, 0);
   }
-  extent_t extent = _compute_readahead(limit);
+  extent_t extent = _compute_readahead(stream, limit);
   m_lock.Unlock();
   return extent;
 }
 
-void Readahead::_observe_read(uint64_t offset, uint64_t length) {
-  if (offset == m_last_pos) {
-    m_nr_consec_read++;
-    m_consec_read_bytes += length;
+Readahead::Stream *Readahead::_observe_read(uint64_t offset, uint64_t length) {
+  ++m_seq;
+
+  Stream *stream = nullptr;
+  for (vector<Stream>::iterator it = m_streams.begin(); it != m_streams.end(); ++it) {
+    if (offset == it->last_pos) {
+      stream = &(*it);
+      break;
+    }
+  }
+
+  if (stream != nullptr) {
+    if (stream->readahead_pos > offset) {
+      m_hit_bytes += MIN(length, stream->readahead_pos - offset);
+    }
+    stream->nr_consec_read++;
+    stream->consec_read_bytes += length;
+  } else if (m_streams.size() < m_max_streams) {
+    m_streams.push_back(Stream());
+    stream = &m_streams.back();
   } else {
-    m_nr_consec_read = 0;
-    m_consec_read_bytes = 0;
-    m_readahead_trigger_pos = 0;
-    m_readahead_size = 0;
-    m_readahead_pos = 0;
+    // replace the least recently used stream
+    stream = &m_streams.front();
+    for (vector<Stream>::iterator it = m_streams.begin(); it != m_streams.end(); ++it) {
+      if (it->last_seq < stream->last_seq) {
+	stream = &(*it);
+      }
+    }
+    _reset_stream(stream);
+  }
+  stream->last_pos = offset + length;
+  stream->last_seq = m_seq;
+  return stream;
+}
+
+void Readahead::_reset_stream(Stream *stream) {
+  if (stream->readahead_pos > stream->last_pos) {
+    // the stream moved on before consuming its readahead
+    m_wasted_bytes += stream->readahead_pos - stream->last_pos;
+    m_readahead_window = MAX(m_readahead_window / 2,
+			     MAX(m_readahead_min_bytes, MIN_READAHEAD_WINDOW));
   }
-  m_last_pos = offset + length;
+  *stream = Stream();
 }
 
-Readahead::extent_t Readahead::_compute_readahead(uint64_t limit) {
+Readahead::extent_t Readahead::_compute_readahead(Stream *stream, uint64_t limit) {
   uint64_t readahead_offset = 0;
   uint64_t readahead_length = 0;
-  if (m_nr_consec_read >= m_trigger_requests) {
+  if (stream->nr_consec_read >= m_trigger_requests) {
     // currently reading sequentially
-    if (m_last_pos >= m_readahead_trigger_pos) {
+    if (stream->last_pos >= stream->readahead_trigger_pos) {
       // need to read ahead
-      if (m_readahead_size == 0) {
+      if (stream->readahead_size == 0) {
 	// initial readahead trigger
-	m_readahead_size = m_consec_read_bytes;
-	m_readahead_pos = m_last_pos;
+	stream->readahead_size = stream->consec_read_bytes;
+	stream->readahead_pos = stream->last_pos;
       } else {
-	// continuing readahead trigger
-	m_readahead_size *= 2;
-	if (m_last_pos > m_readahead_pos) {
-	  m_readahead_pos = m_last_pos;
+	// continuing readahead trigger: the previous readahead is being
+	// consumed so grow the window back
+	stream->readahead_size *= 2;
+	if (stream->last_pos > stream->readahead_pos) {
+	  stream->readahead_pos = stream->last_pos;
+	}
+	if (m_readahead_window < m_readahead_max_bytes) {
+	  m_readahead_window = (m_readahead_window > m_readahead_max_bytes / 2 ?
+				m_readahead_max_bytes : m_readahead_window * 2);
 	}
       }
-      m_readahead_size = MAX(m_readahead_size, m_readahead_min_bytes);
-      m_readahead_size = MIN(m_readahead_size, m_readahead_max_bytes);
-      readahead_offset = m_readahead_pos;
-      readahead_length = m_readahead_size;
+      stream->readahead_size = MAX(stream->readahead_size, m_readahead_min_bytes);
+      stream->readahead_size = MIN(stream->readahead_size, m_readahead_max_bytes);
+      stream->readahead_size = MIN(stream->readahead_size, m_readahead_window);
+      readahead_offset = stream->readahead_pos;
+      readahead_length = stream->readahead_size;
 
       // Snap to the first alignment possible
       uint64_t readahead_end = readahead_offset + readahead_length;
@@ -107,15 +153,15 @@ Readahead::extent_t Readahead::_compute_readahead(uint64_t limit) {
 	  readahead_length = align_next - readahead_offset;
 	  break;
 	}
-	// Note that m_readahead_size should remain unadjusted.
+	// Note that the stream readahead size should remain unadjusted.
       }
 
-      if (m_readahead_pos + readahead_length > limit) {
-	readahead_length = limit - m_readahead_pos;
+      if (stream->readahead_pos + readahead_length > limit) {
+	readahead_length = limit - stream->readahead_pos;
       }
 
-      m_readahead_trigger_pos = m_readahead_pos + readahead_length / 2;
-      m_readahead_pos += readahead_length;
+      stream->readahead_trigger_pos = stream->readahead_pos + readahead_length / 2;
+      stream->readahead_pos += readahead_length;
     }
   }
   return extent_t(readahead_offset, readahead_length);
@@ -168,6 +214,26 @@ void Readahead::set_trigger_requests(int trigger_requests) {
   m_lock.Unlock();
 }
 
+void Readahead::set_max_streams(int max_streams) {
+  assert(max_streams > 0);
+  Mutex::Locker lock(m_lock);
+  m_max_streams = max_streams;
+  while (m_streams.size() > m_max_streams) {
+    _reset_stream(&m_streams.back());
+    m_streams.pop_back();
+  }
+}
+
+uint64_t Readahead::get_hit_bytes(void) {
+  Mutex::Locker lock(m_lock);
+  return m_hit_bytes;
+}
+
+uint64_t Readahead::get_wasted_bytes(void) {
+  Mutex::Locker lock(m_lock);
+  return m_wasted_bytes;
+}
+
 uint64_t Readahead::get_min_readahead_size(void) {
   Mutex::Locker lock(m_lock);
   return m_readahead_min_bytes;
@@ -187,6 +253,7 @@ void Readahead::set_min_readahead_size(uint64_t min_readahead_size) {
 void Readahead::set_max_readahead_size(uint64_t max_readahead_size) {
   m_lock.Lock();
   m_readahead_max_bytes = max_readahead_size;
+  m_readahead_window = max_readahead_size;
   m_lock.Unlock();
 }
 
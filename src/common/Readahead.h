@@ -7,6 +7,7 @@
 #include "Mutex.h"
 #include "Cond.h"
 #include <list>
+#include <vector>
 
 /**
    This class provides common state and logic for code that needs to perform readahead
@@ -15,6 +16,11 @@
 
    Minimum and maximum readahead sizes may be violated by up to 50\% if alignment is enabled.
    Minimum readahead size may be violated if the end of the readahead target is reached.
+
+   Up to a configurable number of concurrent sequential streams are tracked
+   independently.  The maximum readahead window shrinks whenever read ahead
+   data is discarded without being read and grows back as read ahead data
+   is consumed.
  */
 class Readahead {
 public:
@@ -78,6 +84,22 @@ public:
    */
   void set_trigger_requests(int trigger_requests);
 
+  /**
+     Sets the number of concurrent sequential streams to track.
+     The least recently used stream is replaced by a new stream.
+   */
+  void set_max_streams(int max_streams);
+
+  /**
+     Gets the number of read bytes that were previously read ahead.
+   */
+  uint64_t get_hit_bytes(void);
+
+  /**
+     Gets the number of read ahead bytes that were discarded without being read.
+   */
+  uint64_t get_wasted_bytes(void);
+
   /**
      Gets the minimum size of a readahead request, in bytes.
    */
@@ -107,17 +129,46 @@ public:
   void set_alignments(const std::vector<uint64_t> &alignments);
 
 private:
+  struct Stream {
+    /// Number of consecutive read requests in the sequential stream
+    int nr_consec_read = 0;
+
+    /// Number of bytes read in the sequential stream
+    uint64_t consec_read_bytes = 0;
+
+    /// Position of the read stream
+    uint64_t last_pos = 0;
+
+    /// Position of the readahead stream
+    uint64_t readahead_pos = 0;
+
+    /// When readahead is already triggered and the read stream crosses this point, readahead is continued
+    uint64_t readahead_trigger_pos = 0;
+
+    /// Size of the next readahead request (barring changes due to alignment, etc.)
+    uint64_t readahead_size = 0;
+
+    /// Sequence number of the last read, used to replace the least recently used stream
+    uint64_t last_seq = 0;
+  };
+
   /**
-     Records that a read request has been received.
+     Records that a read request has been received and returns the stream it belongs to.
      m_lock must be held while calling.
    */
-  void _observe_read(uint64_t offset, uint64_t length);
+  Stream *_observe_read(uint64_t offset, uint64_t length);
 
   /**
-     Computes the next readahead request.
+     Discards a stream, accounting its unread readahead as wasted.
+     m_lock must be held while calling.
+   */
+  void _reset_stream(Stream *stream);
+
+  /**
+     Computes the next readahead request for a stream.
      m_lock must be held while calling.
   */
-  extent_t _compute_readahead(uint64_t limit);
+  extent_t _compute_readahead(Stream *stream, uint64_t limit);
 
   /// Number of sequential requests necessary to trigger readahead
   int m_trigger_requests;
@@ -131,26 +182,26 @@ private:
   /// Alignment units, in bytes
   std::vector<uint64_t> m_alignments;
 
+  /// Maximum number of tracked sequential streams
+  size_t m_max_streams;
+
   /// Held while reading/modifying any state except m_pending
   Mutex m_lock;
 
-  /// Number of consecutive read requests in the current sequential stream
-  int m_nr_consec_read;
-
-  /// Number of bytes read in the current sequenial stream
-  uint64_t m_consec_read_bytes;
+  /// Tracked sequential streams
+  std::vector<Stream> m_streams;
 
-  /// Position of the read stream
-  uint64_t m_last_pos;
+  /// Sequence number of the last read
+  uint64_t m_seq;
 
-  /// Position of the readahead stream
-  uint64_t m_readahead_pos;
+  /// Current maximum size of a readahead request, adapted to the hit rate
+  uint64_t m_readahead_window;
 
-  /// When readahead is already triggered and the read stream crosses this point, readahead is continued
-  uint64_t m_readahead_trigger_pos;
+  /// Number of read bytes that were previously read ahead
+  uint64_t m_hit_bytes;
 
-  /// Size of the next readahead request (barring changes due to alignment, etc.)
-  uint64_t m_readahead_size;
+  /// Number of read ahead bytes that were discarded without being read
+  uint64_t m_wasted_bytes;
 
   /// Number of pending readahead requests, as determined by inc_pending() and dec_pending()
   int m_pending;
@@ -30,6 +30,7 @@ Throttle::Throttle(CephContext *cct, const std::string& n, int64_t m, bool _use_
   : cct(cct), name(n), logger(NULL),
     max(m),
     lock("Throttle::lock"),
+    waiters(0),
     use_perf(_use_perf)
 {
   assert(m >= 0);
@@ -87,11 +88,33 @@ void Throttle::_reset_max(int64_t m)
   max.set((size_t)m);
 }
 
+bool Throttle::_try_take(int64_t c)
+{
+  // check and take the slots at once: lockless get_or_fail() callers may
+  // race with us for the last slots below max
+  while (true) {
+    int64_t cur = count.read();
+    if (_should_wait(c, cur)) {
+      return false;
+    }
+    if (count.compare_and_swap(cur, cur + c)) {
+      return true;
+    }
+  }
+}
+
 bool Throttle::_wait(int64_t c)
 {
+  assert(lock.is_locked());
+
+  // advertise ourselves before sampling the count: a lockless put()
+  // releases its slots before checking for waiters, so one of the two
+  // sides is guaranteed to observe the other
+  waiters.fetch_add(1);
+
   utime_t start;
   bool waited = false;
-  if (_should_wait(c) || !cond.empty()) { // always wait behind other waiters.
+  if (!cond.empty() || !_try_take(c)) { // always wait behind other waiters.
     Cond *cv = new Cond;
     cond.push_back(cv);
     waited = true;
@@ -101,7 +124,7 @@ bool Throttle::_wait(int64_t c)
 
     do {
       cv->Wait(lock);
-    } while (_should_wait(c) || cv != cond.front());
+    } while (cv != cond.front() || !_try_take(c));
 
     ldout(cct, 2) << "_wait finished waiting" << dendl;
     if (logger) {
@@ -116,6 +139,7 @@ bool Throttle::_wait(int64_t c)
     if (!cond.empty())
       cond.front()->SignalOne();
   }
+  waiters.fetch_sub(1);
   return waited;
 }
 
@@ -141,10 +165,8 @@ int64_t Throttle::take(int64_t c)
   }
   assert(c >= 0);
   ldout(cct, 10) << "take " << c << dendl;
-  {
-    Mutex::Locker l(lock);
-    count.add(c);
-  }
+  // taking slots can only make waiters wait longer, no need to lock
+  count.add(c);
   if (logger) {
     logger->inc(l_throttle_take);
     logger->inc(l_throttle_take_sum, c);
@@ -172,7 +194,6 @@ bool Throttle::get(int64_t c, int64_t m)
       _reset_max(m);
     }
     waited = _wait(c);
-    count.add(c);
   }
   if (logger) {
     logger->inc(l_throttle_get);
@@ -192,16 +213,23 @@ bool Throttle::get_or_fail(int64_t c)
   }
 
   assert (c >= 0);
-  Mutex::Locker l(lock);
-  if (_should_wait(c) || !cond.empty()) {
+  bool taken;
+  if (waiters.load() == 0) {
+    // nobody is queued ahead of us: try to grab the slots without the lock
+    taken = _try_take(c);
+  } else {
+    Mutex::Locker l(lock);
+    taken = cond.empty() && _try_take(c);
+  }
+
+  if (!taken) {
     ldout(cct, 10) << "get_or_fail " << c << " failed" << dendl;
     if (logger) {
       logger->inc(l_throttle_get_or_fail_fail);
     }
     return false;
   } else {
-    ldout(cct, 10) << "get_or_fail " << c << " success (" << count.read() << " -> " << (count.read() + c) << ")" << dendl;
-    count.add(c);
+    ldout(cct, 10) << "get_or_fail " << c << " success (" << count.read() << ")" << dendl;
     if (logger) {
       logger->inc(l_throttle_get_or_fail_success);
       logger->inc(l_throttle_get);
@@ -220,10 +248,7 @@ int64_t Throttle::put(int64_t c)
 
   assert(c >= 0);
   ldout(cct, 10) << "put " << c << " (" << count.read() << " -> " << (count.read()-c) << ")" << dendl;
-  Mutex::Locker l(lock);
   if (c) {
-    if (!cond.empty())
-      cond.front()->SignalOne();
     assert(((int64_t)count.read()) >= c); //if count goes negative, we failed somewhere!
     count.sub(c);
     if (logger) {
@@ -231,6 +256,15 @@ int64_t Throttle::put(int64_t c)
       logger->inc(l_throttle_put_sum, c);
       logger->set(l_throttle_val, count.read());
     }
+
+    // pairs with the waiter registration in _wait(): release the slots
+    // before checking whether anybody needs a wakeup
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load() > 0) {
+      Mutex::Locker l(lock);
+      if (!cond.empty())
+        cond.front()->SignalOne();
+    }
   }
   return count.read();
 }
@@ -5,6 +5,7 @@
 #define CEPH_THROTTLE_H
 
 #include "Cond.h"
+#include <atomic>
 #include <condition_variable>
 
 class CephContext;
@@ -25,6 +26,9 @@ class Throttle {
   ceph::atomic_t count, max;
   Mutex lock;
   list<Cond*> cond;
+  // callers within _wait(); lets take(), get_or_fail() and put() skip
+  // the lock while nobody can be blocked on the throttle
+  std::atomic<unsigned> waiters;
   const bool use_perf;
 
 public:
@@ -34,14 +38,18 @@ public:
 private:
   void _reset_max(int64_t m);
   bool _should_wait(int64_t c) const {
+    return _should_wait(c, count.read());
+  }
+  bool _should_wait(int64_t c, int64_t cur) const {
     int64_t m = max.read();
-    int64_t cur = count.read();
     return
       m &&
       ((c <= m && cur + c > m) || // normally stay under max
        (c >= m && cur > m));     // except for large c
   }
 
+  bool _try_take(int64_t c);
+  // waits behind earlier waiters until c slots can be taken, and takes them
   bool _wait(int64_t c);
 
 public:
@@ -371,6 +371,9 @@ public:
     PointerWQ(string n, time_t ti, time_t sti, ThreadPool* p)
       : WorkQueue_(std::move(n), ti, sti), m_pool(p), m_processing(0) {
     }
+    void register_work_queue() {
+      m_pool->add_work_queue(this);
+    }
     void _clear() override {
       assert(m_pool->_lock.is_locked());
       m_items.clear();
@@ -421,6 +424,10 @@ public:
       Mutex::Locker pool_locker(m_pool->_lock);
       m_pool->_cond.SignalOne();
     }
+    void signal_all() {
+      Mutex::Locker pool_locker(m_pool->_lock);
+      m_pool->_cond.SignalAll();
+    }
     Mutex &get_pool_lock() {
       return m_pool->_lock;
     }
@@ -574,7 +581,7 @@ public:
   ContextWQ(const string &name, time_t ti, ThreadPool *tp)
     : ThreadPool::PointerWQ<Context>(name, ti, 0, tp),
       m_lock("ContextWQ::m_lock") {
-    tp->add_work_queue(this);
+    this->register_work_queue();
   }
 
   void queue(Context *ctx, int result = 0) {
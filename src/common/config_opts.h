@@ -431,6 +431,7 @@ OPTION(client_trace, OPT_STR, "")
 OPTION(client_readahead_min, OPT_LONGLONG, 128*1024)  // readahead at _least_ this much.
 OPTION(client_readahead_max_bytes, OPT_LONGLONG, 0)  // default unlimited
 OPTION(client_readahead_max_periods, OPT_LONGLONG, 4)  // as multiple of file layout period (object size * num stripes)
+OPTION(client_readahead_max_streams, OPT_INT, 4)  // concurrent sequential read streams tracked per open file
 OPTION(client_reconnect_stale, OPT_BOOL, false)  // automatically reconnect stale session
 OPTION(client_snapdir, OPT_STR, ".snap")
 OPTION(client_mountpoint, OPT_STR, "/")
@@ -636,6 +637,9 @@ OPTION(osd_min_recovery_priority, OPT_INT, 0)
 // Seconds to wait before retrying refused backfills
 OPTION(osd_backfill_retry_interval, OPT_DOUBLE, 30.0)
 
+// Let higher priority recovery/backfill preempt granted backfill reservations
+OPTION(osd_backfill_preemptible, OPT_BOOL, true)
+
 // Seconds to wait before retrying refused recovery
 OPTION(osd_recovery_retry_interval, OPT_DOUBLE, 30.0)
 
@@ -736,6 +740,9 @@ OPTION(osd_map_max_advance, OPT_INT, 150) // make this < cache_size!
 OPTION(osd_map_cache_size, OPT_INT, 200)
 OPTION(osd_map_message_max, OPT_INT, 100)  // max maps per MOSDMap message
 OPTION(osd_map_share_max_epochs, OPT_INT, 100)  // cap on # of inc maps we send to peers, clients
+OPTION(osd_map_full_interval, OPT_INT, 1)  // persist only every Nth full map; rebuild the rest from incrementals
+OPTION(osd_map_compression, OPT_STR, "none")  // compressor plugin for persisted full maps
+OPTION(osd_map_message_compression, OPT_STR, "none")  // compressor plugin for maps sent to OSDs
 OPTION(osd_inject_bad_map_crc_probability, OPT_FLOAT, 0)
 OPTION(osd_inject_failure_on_pg_removal, OPT_BOOL, false)
 // shutdown the OSD if stuatus flipping more than max_markdown_count times in recent max_markdown_period seconds
@@ -766,6 +773,14 @@ OPTION(osd_read_ec_check_for_errors, OPT_BOOL, false) // return error if any ec
 // osd_recover_clone_overlap_limit entries in the overlap set
 OPTION(osd_recover_clone_overlap_limit, OPT_INT, 10)
 
+// Push only the extents and omap keys a replica missed when the pg log
+// covers the gap, instead of the whole object
+OPTION(osd_recover_dirty_regions, OPT_BOOL, true)
+// Bounds on what each MODIFY log entry records; past these we fall back
+// to one extent spanning the changes and/or the whole omap
+OPTION(osd_pg_log_dirty_extents_max, OPT_U32, 16)
+OPTION(osd_pg_log_dirty_omap_keys_max, OPT_U32, 64)
+
 OPTION(osd_backfill_scan_min, OPT_INT, 64)
 OPTION(osd_backfill_scan_max, OPT_INT, 512)
 OPTION(osd_op_thread_timeout, OPT_INT, 15)
@@ -831,6 +846,8 @@ OPTION(osd_scrub_backoff_ratio, OPT_DOUBLE, .66)   // the probability to back of
 OPTION(osd_scrub_chunk_min, OPT_INT, 5)
 OPTION(osd_scrub_chunk_max, OPT_INT, 25)
 OPTION(osd_scrub_sleep, OPT_FLOAT, 0)   // sleep between [deep]scrub ops
+OPTION(osd_scrub_target_client_latency, OPT_FLOAT, 0)   // if > 0, stretch the scrub sleep while client op latency is above this (seconds)
+OPTION(osd_scrub_sleep_max, OPT_FLOAT, 1)   // upper bound for the stretched scrub sleep
 OPTION(osd_scrub_auto_repair, OPT_BOOL, false)   // whether auto-repair inconsistencies upon deep-scrubbing
 OPTION(osd_scrub_auto_repair_num_errors, OPT_U32, 5)   // only auto-repair when number of errors is below this threshold
 OPTION(osd_deep_scrub_interval, OPT_FLOAT, 60*60*24*7) // once a week
@@ -878,6 +895,7 @@ OPTION(osd_debug_verify_snaps_on_info, OPT_BOOL, false)
 OPTION(osd_debug_verify_stray_on_activate, OPT_BOOL, false)
 OPTION(osd_debug_skip_full_check_in_backfill_reservation, OPT_BOOL, false)
 OPTION(osd_debug_reject_backfill_probability, OPT_DOUBLE, 0)
+OPTION(osd_debug_backfill_preempt_delay, OPT_DOUBLE, 0)  // delay delivery of backfill preemptions (seconds)
 OPTION(osd_debug_inject_copyfrom_error, OPT_BOOL, false)  // inject failure during copyfrom completion
 OPTION(osd_debug_misdirected_ops, OPT_BOOL, false)
 OPTION(osd_debug_skip_full_check_in_recovery, OPT_BOOL, false)
@@ -1329,6 +1347,7 @@ OPTION(rados_tracing, OPT_BOOL, false) // true if LTTng-UST tracepoints should b
 
 OPTION(rbd_op_threads, OPT_INT, 1)
 OPTION(rbd_op_thread_timeout, OPT_INT, 60)
+OPTION(rbd_io_threads, OPT_INT, 1) // number of threads dispatching image IO requests
 OPTION(rbd_non_blocking_aio, OPT_BOOL, true) // process AIO ops from a worker thread to prevent blocking
 OPTION(rbd_cache, OPT_BOOL, true) // whether to enable caching (writeback unless rbd_cache_max_dirty is 0)
 OPTION(rbd_cache_writethrough_until_flush, OPT_BOOL, true) // whether to make writeback caching writethrough until flush is called, to be sure the user of librbd will send flushs so that writeback is safe
@@ -1338,6 +1357,10 @@ OPTION(rbd_cache_target_dirty, OPT_LONGLONG, 16<<20) // target dirty limit in by
 OPTION(rbd_cache_max_dirty_age, OPT_FLOAT, 1.0)      // seconds in cache before writeback starts
 OPTION(rbd_cache_max_dirty_object, OPT_INT, 0)       // dirty limit for objects - set to 0 for auto calculate from rbd_cache_size
 OPTION(rbd_cache_block_writes_upfront, OPT_BOOL, false) // whether to block writes to the cache before the aio_write call completes (true), or block before the aio completion is called (false)
+OPTION(rbd_persistent_cache, OPT_BOOL, false) // whether to log writes to a local, crash-consistent write-back cache file while the exclusive lock is held
+OPTION(rbd_persistent_cache_path, OPT_STR, "/var/lib/ceph/rbd-cache") // directory holding the persistent write-back cache files
+OPTION(rbd_persistent_cache_size, OPT_U64, 1ull<<30) // size in bytes of each image's persistent write-back cache file
+OPTION(rbd_persistent_cache_max_destage, OPT_INT, 16) // maximum number of logged writes concurrently flushed from the persistent cache to the cluster
 OPTION(rbd_concurrent_management_ops, OPT_INT, 10) // how many operations can be in flight for a management operation like deleting or resizing an image
 OPTION(rbd_balance_snap_reads, OPT_BOOL, false)
 OPTION(rbd_localize_snap_reads, OPT_BOOL, false)
@@ -1345,8 +1368,10 @@ OPTION(rbd_balance_parent_reads, OPT_BOOL, false)
 OPTION(rbd_localize_parent_reads, OPT_BOOL, true)
 OPTION(rbd_readahead_trigger_requests, OPT_INT, 10) // number of sequential requests necessary to trigger readahead
 OPTION(rbd_readahead_max_bytes, OPT_LONGLONG, 512 * 1024) // set to 0 to disable readahead
-OPTION(rbd_readahead_disable_after_bytes, OPT_LONGLONG, 50 * 1024 * 1024) // how many bytes are read in total before readahead is disabled
+OPTION(rbd_readahead_disable_after_bytes, OPT_LONGLONG, 0) // how many bytes are read in total before readahead is disabled (0 to never disable)
+OPTION(rbd_readahead_max_streams, OPT_INT, 4) // number of concurrent sequential read streams tracked per image
 OPTION(rbd_clone_copy_on_read, OPT_BOOL, false)
+OPTION(rbd_sparse_copyup, OPT_BOOL, false) // only copy up non-zero parent extents (falls back to a full copyup on OSDs without the sparse_copyup method)
 OPTION(rbd_blacklist_on_break_lock, OPT_BOOL, true) // whether to blacklist clients whose lock was broken
 OPTION(rbd_blacklist_expire_seconds, OPT_INT, 0) // number of seconds to blacklist - set to 0 for OSD default
 OPTION(rbd_request_timed_out_seconds, OPT_INT, 30) // number of seconds before maint request times out
@@ -1411,6 +1436,7 @@ OPTION(rbd_journal_commit_age, OPT_DOUBLE, 5) // commit time interval, seconds
 OPTION(rbd_journal_object_flush_interval, OPT_INT, 0) // maximum number of pending commits per journal object
 OPTION(rbd_journal_object_flush_bytes, OPT_INT, 0) // maximum number of pending bytes per journal object
 OPTION(rbd_journal_object_flush_age, OPT_DOUBLE, 0) // maximum age (in seconds) for pending commits
+OPTION(rbd_journal_object_max_in_flight_appends, OPT_INT, 1) // maximum number of in-flight appends per journal object (0 = unlimited)
 OPTION(rbd_journal_pool, OPT_STR, "") // pool for journal objects
 OPTION(rbd_journal_max_payload_bytes, OPT_U32, 16384) // maximum journal payload size before splitting
 OPTION(rbd_journal_max_concurrent_object_sets, OPT_INT, 0) // maximum number of object sets a journal client can be behind before it is automatically unregistered
@@ -1429,6 +1455,7 @@ OPTION(rbd_mirror_image_state_check_interval, OPT_INT, 30) // interval to get im
 OPTION(rbd_mirror_leader_heartbeat_interval, OPT_INT, 5) // interval (in seconds) between mirror leader heartbeats
 OPTION(rbd_mirror_leader_max_missed_heartbeats, OPT_INT, 2) // number of missed heartbeats for non-lock owner to attempt to acquire lock
 OPTION(rbd_mirror_leader_max_acquire_attempts_before_break, OPT_INT, 3) // number of failed attempts to acquire lock after missing heartbeats before breaking lock
+OPTION(rbd_mirror_snapshot_interval, OPT_INT, 30) // interval (in seconds) between syncs of snapshot-based mirrored images
 
 OPTION(nss_db_path, OPT_STR, "") // path to nss db
 
@@ -1454,6 +1481,8 @@ OPTION(rgw_override_bucket_index_max_shards, OPT_U32, 0)
  * Represents the maximum AIO pending requests for the bucket index object shards.
  */
 OPTION(rgw_bucket_index_max_aio, OPT_U32, 8)
+OPTION(rgw_bucket_index_complete_batch_ms, OPT_INT, 2) // max ms a bucket index complete op waits to be sent with others to the same shard, 0 disables batching
+OPTION(rgw_bucket_index_complete_batch_max, OPT_INT, 32) // max complete ops sent to a bucket index shard at once
 
 /**
  * whether or not the quota/gc threads should be started
@@ -1467,6 +1496,9 @@ OPTION(rgw_data, OPT_STR, "/var/lib/ceph/radosgw/$cluster-$id")
 OPTION(rgw_enable_apis, OPT_STR, "s3, s3website, swift, swift_auth, admin")
 OPTION(rgw_cache_enabled, OPT_BOOL, true)   // rgw cache enabled
 OPTION(rgw_cache_lru_size, OPT_INT, 10000)   // num of entries in rgw cache
+OPTION(rgw_obj_data_cache_size, OPT_U64, 0)   // bytes of small object data cached in memory, 0 disables the data cache
+OPTION(rgw_obj_data_cache_max_obj_size, OPT_U64, 64 << 10)   // only objects up to this size go into the data cache
+OPTION(rgw_obj_data_cache_ttl, OPT_INT, 30)   // seconds a data cache entry is used before it is revalidated against its etag
 OPTION(rgw_socket_path, OPT_STR, "")   // path to unix domain socket, if not specified, rgw will not run as external fcgi
 OPTION(rgw_host, OPT_STR, "")  // host for radosgw, can be an IP, default is 0.0.0.0
 OPTION(rgw_port, OPT_STR, "")  // port to listen, format as "8080" "5000", if not specified, rgw will not run external fcgi
@@ -1476,6 +1508,9 @@ OPTION(rgw_content_length_compat, OPT_BOOL, false) // Check both HTTP_CONTENT_LE
 OPTION(rgw_lifecycle_work_time, OPT_STR, "00:00-06:00") //job process lc  at 00:00-06:00s
 OPTION(rgw_lc_lock_max_time, OPT_INT, 60)  // total run time for a single lc processor work
 OPTION(rgw_lc_max_objs, OPT_INT, 32)
+OPTION(rgw_lc_max_worker, OPT_INT, 3) // lc shards, and so buckets, processed in parallel
+OPTION(rgw_lc_max_wp_worker, OPT_INT, 3) // index shards of a bucket expired in parallel
+OPTION(rgw_lc_delete_max_aio, OPT_INT, 16) // expired objects removed at once by each index shard worker
 OPTION(rgw_lc_debug_interval, OPT_INT, -1)  // Debug run interval, in seconds
 OPTION(rgw_script_uri, OPT_STR, "") // alternative value for SCRIPT_URI if not set in request
 OPTION(rgw_request_uri, OPT_STR,  "") // alternative value for REQUEST_URI if not set in request
@@ -1595,6 +1630,9 @@ OPTION(rgw_gc_max_objs, OPT_INT, 32)
 OPTION(rgw_gc_obj_min_wait, OPT_INT, 2 * 3600)    // wait time before object may be handled by gc
 OPTION(rgw_gc_processor_max_time, OPT_INT, 3600)  // total run time for a single gc processor work
 OPTION(rgw_gc_processor_period, OPT_INT, 3600)  // gc processor cycle time
+OPTION(rgw_gc_max_concurrent_shards, OPT_INT, 4) // gc shards processed in parallel by a gc processor
+OPTION(rgw_gc_max_concurrent_io, OPT_INT, 10) // tail object removals in flight per gc shard
+OPTION(rgw_gc_max_trim_chunk, OPT_INT, 16) // gc entries trimmed from a shard at once
 OPTION(rgw_s3_success_create_obj_status, OPT_INT, 0) // alternative success status response for create-obj (0 - default)
 OPTION(rgw_resolve_cname, OPT_BOOL, false)  // should rgw try to resolve hostname as a dns cname record
 OPTION(rgw_obj_stripe_size, OPT_INT, 4 << 20)
@@ -1602,6 +1640,7 @@ OPTION(rgw_extended_http_attrs, OPT_STR, "") // list of extended attrs that can
 OPTION(rgw_exit_timeout_secs, OPT_INT, 120) // how many seconds to wait for process to go down before exiting unconditionally
 OPTION(rgw_get_obj_window_size, OPT_INT, 16 << 20) // window size in bytes for single get obj request
 OPTION(rgw_get_obj_max_req_size, OPT_INT, 4 << 20) // max length of a single get obj rados op
+OPTION(rgw_select_max_record_size, OPT_U64, 1 << 20) // longest record an s3 select request goes through
 OPTION(rgw_relaxed_s3_bucket_names, OPT_BOOL, false) // enable relaxed bucket name rules for US region buckets
 OPTION(rgw_defer_to_bucket_acls, OPT_STR, "") // if the user has bucket perms, use those before key perms (recurse and full_control)
 OPTION(rgw_list_buckets_max_chunk, OPT_INT, 1000) // max buckets to retrieve in a single op when listing user buckets
@@ -1611,6 +1650,7 @@ OPTION(rgw_opstate_ratelimit_sec, OPT_INT, 30) // min time between opstate updat
 OPTION(rgw_curl_wait_timeout_ms, OPT_INT, 1000) // timeout for certain curl calls
 OPTION(rgw_copy_obj_progress, OPT_BOOL, true) // should dump progress during long copy operations?
 OPTION(rgw_copy_obj_progress_every_bytes, OPT_INT, 1024 * 1024) // min bytes between copy progress output
+OPTION(rgw_copy_obj_max_aio, OPT_INT, 16) // max tail objects copied by the OSDs at once when copying an object between pools, 0 streams the data through the gateway
 OPTION(rgw_obj_tombstone_cache_size, OPT_INT, 1000) // how many objects in tombstone cache, which is used in multi-zone sync to keep
                                                     // track of removed objects' mtime
 
@@ -1639,6 +1679,7 @@ OPTION(rgw_user_default_quota_max_size, OPT_LONGLONG, -1) // Max size of object
 
 OPTION(rgw_multipart_min_part_size, OPT_INT, 5 * 1024 * 1024) // min size for each part (except for last one) in multipart upload
 OPTION(rgw_multipart_part_upload_limit, OPT_INT, 10000) // parts limit in multipart upload
+OPTION(rgw_multipart_complete_max_aio, OPT_INT, 8) // max part info reads in flight when completing a multipart upload
 
 OPTION(rgw_max_slo_entries, OPT_INT, 1000) // default number of max entries in slo
 
@@ -1661,6 +1702,11 @@ OPTION(rgw_sync_log_trim_interval, OPT_INT, 1200) // time in seconds between att
 
 OPTION(rgw_sync_data_inject_err_probability, OPT_DOUBLE, 0) // range [0, 1]
 OPTION(rgw_sync_meta_inject_err_probability, OPT_DOUBLE, 0) // range [0, 1]
+OPTION(rgw_data_sync_spawn_window, OPT_INT, 20) // objects each bucket shard syncs at once, to start with
+OPTION(rgw_data_sync_max_spawn_window, OPT_INT, 128) // limit for the adaptive window above; set it to rgw_data_sync_spawn_window for a fixed one
+OPTION(rgw_data_sync_range_size, OPT_U64, 32 << 20) // sync objects larger than this in parallel ranged reads of this size; 0 disables
+OPTION(rgw_data_sync_range_max_aio, OPT_INT, 4) // ranged reads in flight per object
+OPTION(rgw_data_sync_range_max_buffer, OPT_U64, 256 << 20) // bytes ranged reads may buffer at once, across all objects
 
 
 OPTION(rgw_period_push_interval, OPT_DOUBLE, 2) // seconds to wait before retrying "period push"
@@ -1670,6 +1716,11 @@ OPTION(rgw_safe_max_objects_per_shard, OPT_INT, 100*1024) // safe max loading
 OPTION(rgw_shard_warning_threshold, OPT_DOUBLE, 90) // pct of safe max
 						    // at which to warn
 
+OPTION(rgw_dynamic_resharding, OPT_BOOL, false) // queue buckets whose index shards grow past rgw_max_objs_per_shard for resharding
+OPTION(rgw_max_objs_per_shard, OPT_INT, 100000) // objects per bucket index shard before a bucket is resharded
+OPTION(rgw_reshard_num_logs, OPT_INT, 16) // number of objects holding the reshard queue
+OPTION(rgw_reshard_thread_interval, OPT_U32, 10*60) // seconds between reshard queue processing cycles
+
 OPTION(rgw_swift_versioning_enabled, OPT_BOOL, false) // whether swift object versioning feature is enabled
 
 OPTION(mgr_module_path, OPT_STR, CEPH_PKGLIBDIR "/mgr") // where to load python modules from
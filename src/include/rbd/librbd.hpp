@@ -53,6 +53,7 @@ namespace librbd {
   } mirror_peer_t;
 
   typedef rbd_mirror_image_state_t mirror_image_state_t;
+  typedef rbd_mirror_image_mode_t mirror_image_mode_t;
 
   typedef struct {
     std::string global_id;
@@ -434,10 +435,12 @@ public:
 
   // RBD image mirroring support functions
   int mirror_image_enable();
+  int mirror_image_enable2(mirror_image_mode_t mode);
   int mirror_image_disable(bool force);
   int mirror_image_promote(bool force);
   int mirror_image_demote();
   int mirror_image_resync();
+  int mirror_image_get_mode(mirror_image_mode_t *mode);
   int mirror_image_get_info(mirror_image_info_t *mirror_image_info,
                             size_t info_size);
   int mirror_image_get_status(mirror_image_status_t *mirror_image_status,
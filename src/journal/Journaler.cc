@@ -386,14 +386,14 @@ void Journaler::committed(const Future &future) {
 }
 
 void Journaler::start_append(int flush_interval, uint64_t flush_bytes,
-			     double flush_age) {
+			     double flush_age, uint64_t max_in_flight_appends) {
   assert(m_recorder == NULL);
 
   // TODO verify active object set >= current replay object set
 
   m_recorder = new JournalRecorder(m_data_ioctx, m_object_oid_prefix,
 				   m_metadata, flush_interval, flush_bytes,
-				   flush_age);
+				   flush_age, max_in_flight_appends);
 }
 
 void Journaler::stop_append(Context *on_safe) {
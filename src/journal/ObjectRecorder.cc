@@ -22,12 +22,14 @@ ObjectRecorder::ObjectRecorder(librados::IoCtx &ioctx, const std::string &oid,
                                ContextWQ *work_queue, SafeTimer &timer,
                                Mutex &timer_lock, Handler *handler,
                                uint8_t order, uint32_t flush_interval,
-                               uint64_t flush_bytes, double flush_age)
+                               uint64_t flush_bytes, double flush_age,
+                               uint64_t max_in_flight_appends)
   : RefCountedObject(NULL, 0), m_oid(oid), m_object_number(object_number),
     m_cct(NULL), m_op_work_queue(work_queue), m_timer(timer),
     m_timer_lock(timer_lock), m_handler(handler), m_order(order),
     m_soft_max_size(1 << m_order), m_flush_interval(flush_interval),
-    m_flush_bytes(flush_bytes), m_flush_age(flush_age), m_flush_handler(this),
+    m_flush_bytes(flush_bytes), m_flush_age(flush_age),
+    m_max_in_flight_appends(max_in_flight_appends), m_flush_handler(this),
     m_append_task(NULL), m_lock(lock), m_append_tid(0), m_pending_bytes(0),
     m_size(0), m_overflowed(false), m_object_closed(false),
     m_in_flight_flushes(false), m_aio_scheduled(false) {
@@ -99,6 +101,8 @@ void ObjectRecorder::flush(Context *on_safe) {
       future = Future(m_append_buffers.rbegin()->first);
 
       flush_appends(true);
+    } else if (!m_pending_buffers.empty()) {
+      future = Future(m_pending_buffers.rbegin()->first);
     } else if (!m_in_flight_appends.empty()) {
       AppendBuffers &append_buffers = m_in_flight_appends.rbegin()->second;
       assert(!append_buffers.empty());
@@ -275,6 +279,14 @@ void ObjectRecorder::handle_append_flushed(uint64_t tid, int r) {
 
     m_in_flight_appends.erase(iter);
     m_in_flight_flushes = true;
+
+    // send all appends that were batched while waiting for in-flight appends
+    if (!m_pending_buffers.empty() && can_send_appends_aio()) {
+      m_op_work_queue->queue(new FunctionContext([this] (int r) {
+          send_appends_aio();
+      }));
+      m_aio_scheduled = true;
+    }
     m_lock->Unlock();
   }
 
@@ -318,6 +330,11 @@ void ObjectRecorder::append_overflowed() {
                                   it->second.begin(), it->second.end());
   }
 
+  restart_append_buffers.splice(restart_append_buffers.end(),
+                                m_pending_buffers,
+                                m_pending_buffers.begin(),
+                                m_pending_buffers.end());
+
   restart_append_buffers.splice(restart_append_buffers.end(),
                                 m_append_buffers,
                                 m_append_buffers.begin(),
@@ -346,7 +363,7 @@ void ObjectRecorder::send_appends(AppendBuffers *append_buffers) {
 
   m_pending_buffers.splice(m_pending_buffers.end(), *append_buffers,
                            append_buffers->begin(), append_buffers->end());
-  if (!m_aio_scheduled) {
+  if (can_send_appends_aio()) {
     m_op_work_queue->queue(new FunctionContext([this] (int r) {
         send_appends_aio();
     }));
@@ -354,6 +371,16 @@ void ObjectRecorder::send_appends(AppendBuffers *append_buffers) {
   }
 }
 
+bool ObjectRecorder::can_send_appends_aio() const {
+  assert(m_lock->is_locked());
+
+  // while the maximum number of appends are in-flight, pending appends are
+  // batched into a single append op that is sent once an append completes
+  return (!m_aio_scheduled &&
+          (m_max_in_flight_appends == 0 ||
+           m_in_flight_tids.size() < m_max_in_flight_appends));
+}
+
 void ObjectRecorder::send_appends_aio() {
   AppendBuffers *append_buffers;
   uint64_t append_tid;
@@ -391,8 +418,8 @@ void ObjectRecorder::send_appends_aio() {
 
   {
     m_lock->Lock();
-    if (m_pending_buffers.empty()) {
-      m_aio_scheduled = false;
+    m_aio_scheduled = false;
+    if (m_pending_buffers.empty() || !can_send_appends_aio()) {
       if (m_in_flight_appends.empty() && m_object_closed) {
         // all remaining unsent appends should be redirected to new object
         notify_handler_unlock();
@@ -404,6 +431,7 @@ void ObjectRecorder::send_appends_aio() {
       m_op_work_queue->queue(new FunctionContext([this] (int r) {
           send_appends_aio();
         }));
+      m_aio_scheduled = true;
       m_lock->Unlock();
     }
   }
@@ -25,6 +25,7 @@
 #include "librbd/operation/ResizeRequest.h"
 #include "librbd/Utils.h"
 #include "librbd/LibrbdWriteback.h"
+#include "librbd/cache/WriteLogImageCache.h"
 #include "librbd/exclusive_lock/AutomaticPolicy.h"
 #include "librbd/exclusive_lock/StandardPolicy.h"
 #include "librbd/io/AioCompletion.h"
@@ -72,6 +73,18 @@ public:
   }
 };
 
+class IOThreadPoolSingleton : public ThreadPool {
+public:
+  explicit IOThreadPoolSingleton(CephContext *cct)
+    : ThreadPool(cct, "librbd::io_thread_pool", "tp_librbd_io",
+                 cct->_conf->rbd_io_threads, "rbd_io_threads") {
+    start();
+  }
+  ~IOThreadPoolSingleton() override {
+    stop();
+  }
+};
+
 class SafeTimerSingleton : public SafeTimer {
 public:
   Mutex lock;
@@ -100,6 +113,19 @@ struct C_FlushCache : public Context {
   }
 };
 
+struct C_FlushImageCache : public Context {
+  ImageCtx *image_ctx;
+  Context *on_safe;
+
+  C_FlushImageCache(ImageCtx *_image_ctx, Context *_on_safe)
+    : image_ctx(_image_ctx), on_safe(_on_safe) {
+  }
+  void finish(int r) override {
+    // write back everything logged before the flush was issued
+    image_ctx->image_cache->flush(on_safe);
+  }
+};
+
 struct C_ShutDownCache : public Context {
   ImageCtx *image_ctx;
   Context *on_finish;
@@ -210,9 +236,15 @@ struct C_InvalidateCache : public Context {
 
     ThreadPool *thread_pool;
     get_thread_pool_instance(cct, &thread_pool, &op_work_queue);
-    io_work_queue = new io::ImageRequestWQ(
+
+    // a single dispatch thread does not need a pool of its own
+    ThreadPool *io_thread_pool = thread_pool;
+    if (cct->_conf->rbd_io_threads > 1) {
+      get_io_thread_pool_instance(cct, &io_thread_pool);
+    }
+    io_work_queue = new io::ImageRequestWQ<>(
       this, "librbd::io_work_queue", cct->_conf->rbd_op_thread_timeout,
-      thread_pool);
+      io_thread_pool);
 
     if (cct->_conf->rbd_auto_exclusive_lock_until_manual_request) {
       exclusive_lock_policy = new exclusive_lock::AutomaticPolicy(this);
@@ -229,6 +261,10 @@ struct C_InvalidateCache : public Context {
     assert(journal == NULL);
     assert(asok_hook == NULL);
 
+    if (image_cache) {
+      delete image_cache;
+      image_cache = nullptr;
+    }
     if (perfcounter) {
       perf_stop();
     }
@@ -312,8 +348,15 @@ struct C_InvalidateCache : public Context {
       object_cacher->start();
     }
 
+    if (persistent_cache && !read_only && snap_name.empty()) {
+      // the log is only opened once the exclusive lock is acquired
+      ldout(cct, 20) << "enabling persistent caching..." << dendl;
+      image_cache = new cache::WriteLogImageCache<ImageCtx>(*this);
+    }
+
     readahead.set_trigger_requests(readahead_trigger_requests);
     readahead.set_max_readahead_size(readahead_max_bytes);
+    readahead.set_max_streams(MAX(1U, readahead_max_streams));
   }
 
   void ImageCtx::shutdown() {
@@ -360,6 +403,25 @@ struct C_InvalidateCache : public Context {
 		   << dendl;
   }
 
+  void ImageCtx::publish_read_state()
+  {
+    assert(snap_lock.is_wlocked());
+    assert(parent_lock.is_locked());
+
+    io::ImageReadState state;
+    state.snap_id = snap_id;
+    state.snap_exists = snap_exists;
+    state.size = get_image_size(snap_id);
+    if (format_string != nullptr) {
+      state.format_string = format_string;
+    }
+    state.layout = layout;
+    state.object_map = test_features(RBD_FEATURE_OBJECT_MAP, snap_lock);
+    state.parent_overlap_r = get_parent_overlap(snap_id,
+                                                &state.parent_overlap);
+    read_state.publish(std::move(state));
+  }
+
   void ImageCtx::perf_start(string name) {
     PerfCountersBuilder plb(cct, name, l_librbd_first, l_librbd_last);
 
@@ -386,7 +448,15 @@ struct C_InvalidateCache : public Context {
     plb.add_u64_counter(l_librbd_resize, "resize", "Resizes");
     plb.add_u64_counter(l_librbd_readahead, "readahead", "Read ahead");
     plb.add_u64_counter(l_librbd_readahead_bytes, "readahead_bytes", "Data size in read ahead");
+    plb.add_u64(l_librbd_readahead_hit_bytes, "readahead_hit_bytes", "Data size in reads served by read ahead");
+    plb.add_u64(l_librbd_readahead_wasted_bytes, "readahead_wasted_bytes", "Data size in read ahead discarded without being read");
     plb.add_u64_counter(l_librbd_invalidate_cache, "invalidate_cache", "Cache invalidates");
+    plb.add_u64_counter(l_librbd_pcache_rd_hit_bytes, "pcache_rd_hit_bytes", "Data size in reads served from the persistent cache");
+    plb.add_u64_counter(l_librbd_pcache_rd_miss_bytes, "pcache_rd_miss_bytes", "Data size in reads missing the persistent cache");
+    plb.add_u64_counter(l_librbd_pcache_log_bytes, "pcache_log_bytes", "Data size in writes logged to the persistent cache");
+    plb.add_u64_counter(l_librbd_pcache_sync, "pcache_sync", "Persistent cache log syncs");
+    plb.add_u64(l_librbd_pcache_dirty_bytes, "pcache_dirty_bytes", "Data size not yet written back from the persistent cache");
+    plb.add_time_avg(l_librbd_pcache_destage_lag, "pcache_destage_lag", "Time from logging a write to writing it back");
 
     perfcounter = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perfcounter);
@@ -791,6 +861,14 @@ struct C_InvalidateCache : public Context {
 
   int ImageCtx::invalidate_cache(bool purge_on_error) {
     flush_async_operations();
+    if (image_cache != nullptr) {
+      C_SaferCond ctx;
+      image_cache->invalidate(&ctx);
+      int r = ctx.wait();
+      if (r < 0) {
+        return r;
+      }
+    }
     if (object_cacher == NULL) {
       return 0;
     }
@@ -892,6 +970,10 @@ struct C_InvalidateCache : public Context {
       // flush cache after completing all in-flight AIO ops
       on_safe = new C_FlushCache(this, on_safe);
     }
+    if (image_cache != NULL) {
+      // write back the persistent cache before flushing the object cache
+      on_safe = new C_FlushImageCache(this, on_safe);
+    }
     flush_async_operations(on_safe);
   }
 
@@ -961,6 +1043,10 @@ struct C_InvalidateCache : public Context {
         "rbd_cache_max_dirty_age", false)(
         "rbd_cache_max_dirty_object", false)(
         "rbd_cache_block_writes_upfront", false)(
+        "rbd_persistent_cache", false)(
+        "rbd_persistent_cache_path", false)(
+        "rbd_persistent_cache_size", false)(
+        "rbd_persistent_cache_max_destage", false)(
         "rbd_concurrent_management_ops", false)(
         "rbd_balance_snap_reads", false)(
         "rbd_localize_snap_reads", false)(
@@ -969,7 +1055,9 @@ struct C_InvalidateCache : public Context {
         "rbd_readahead_trigger_requests", false)(
         "rbd_readahead_max_bytes", false)(
         "rbd_readahead_disable_after_bytes", false)(
+        "rbd_readahead_max_streams", false)(
         "rbd_clone_copy_on_read", false)(
+        "rbd_sparse_copyup", false)(
         "rbd_blacklist_on_break_lock", false)(
         "rbd_blacklist_expire_seconds", false)(
         "rbd_request_timed_out_seconds", false)(
@@ -979,6 +1067,7 @@ struct C_InvalidateCache : public Context {
         "rbd_journal_object_flush_interval", false)(
         "rbd_journal_object_flush_bytes", false)(
         "rbd_journal_object_flush_age", false)(
+        "rbd_journal_object_max_in_flight_appends", false)(
         "rbd_journal_pool", false)(
         "rbd_journal_max_payload_bytes", false)(
         "rbd_journal_max_concurrent_object_sets", false)(
@@ -1019,6 +1108,10 @@ struct C_InvalidateCache : public Context {
     ASSIGN_OPTION(cache_max_dirty_age);
     ASSIGN_OPTION(cache_max_dirty_object);
     ASSIGN_OPTION(cache_block_writes_upfront);
+    ASSIGN_OPTION(persistent_cache);
+    ASSIGN_OPTION(persistent_cache_path);
+    ASSIGN_OPTION(persistent_cache_size);
+    ASSIGN_OPTION(persistent_cache_max_destage);
     ASSIGN_OPTION(concurrent_management_ops);
     ASSIGN_OPTION(balance_snap_reads);
     ASSIGN_OPTION(localize_snap_reads);
@@ -1027,7 +1120,9 @@ struct C_InvalidateCache : public Context {
     ASSIGN_OPTION(readahead_trigger_requests);
     ASSIGN_OPTION(readahead_max_bytes);
     ASSIGN_OPTION(readahead_disable_after_bytes);
+    ASSIGN_OPTION(readahead_max_streams);
     ASSIGN_OPTION(clone_copy_on_read);
+    ASSIGN_OPTION(sparse_copyup);
     ASSIGN_OPTION(blacklist_on_break_lock);
     ASSIGN_OPTION(blacklist_expire_seconds);
     ASSIGN_OPTION(request_timed_out_seconds);
@@ -1038,6 +1133,7 @@ struct C_InvalidateCache : public Context {
     ASSIGN_OPTION(journal_object_flush_interval);
     ASSIGN_OPTION(journal_object_flush_bytes);
     ASSIGN_OPTION(journal_object_flush_age);
+    ASSIGN_OPTION(journal_object_max_in_flight_appends);
     ASSIGN_OPTION(journal_pool);
     ASSIGN_OPTION(journal_max_payload_bytes);
     ASSIGN_OPTION(journal_max_concurrent_object_sets);
@@ -1114,6 +1210,14 @@ struct C_InvalidateCache : public Context {
     *op_work_queue = thread_pool_singleton->op_work_queue;
   }
 
+  void ImageCtx::get_io_thread_pool_instance(CephContext *cct,
+                                             ThreadPool **thread_pool) {
+    IOThreadPoolSingleton *thread_pool_singleton;
+    cct->lookup_or_create_singleton_object<IOThreadPoolSingleton>(
+      thread_pool_singleton, "librbd::io_thread_pool");
+    *thread_pool = thread_pool_singleton;
+  }
+
   void ImageCtx::get_timer_instance(CephContext *cct, SafeTimer **timer,
                                     Mutex **timer_lock) {
     SafeTimerSingleton *safe_timer_singleton;
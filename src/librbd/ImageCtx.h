@@ -27,7 +27,9 @@
 #include "cls/rbd/cls_rbd_types.h"
 #include "cls/rbd/cls_rbd_client.h"
 #include "librbd/AsyncRequest.h"
+#include "librbd/PublishedState.h"
 #include "librbd/Types.h"
+#include "librbd/io/Types.h"
 
 class CephContext;
 class ContextWQ;
@@ -52,7 +54,7 @@ namespace librbd {
   namespace exclusive_lock { struct Policy; }
   namespace io {
   class AioCompletion;
-  class ImageRequestWQ;
+  template <typename> class ImageRequestWQ;
   class CopyupRequest;
   }
   namespace journal { struct Policy; }
@@ -131,6 +133,9 @@ namespace librbd {
 
     file_layout_t layout;
 
+    // lock-free view of the state above for dispatching reads
+    PublishedState<io::ImageReadState> read_state;
+
     cache::ImageCache *image_cache = nullptr;
     ObjectCacher *object_cacher;
     LibrbdWriteback *writeback_handler;
@@ -153,7 +158,7 @@ namespace librbd {
 
     xlist<operation::ResizeRequest<ImageCtx>*> resize_reqs;
 
-    io::ImageRequestWQ *io_work_queue;
+    io::ImageRequestWQ<ImageCtx> *io_work_queue;
     xlist<io::AioCompletion*> completed_reqs;
     EventSocket event_socket;
 
@@ -170,6 +175,10 @@ namespace librbd {
     double cache_max_dirty_age;
     uint32_t cache_max_dirty_object;
     bool cache_block_writes_upfront;
+    bool persistent_cache;
+    std::string persistent_cache_path;
+    uint64_t persistent_cache_size;
+    int persistent_cache_max_destage;
     uint32_t concurrent_management_ops;
     bool balance_snap_reads;
     bool localize_snap_reads;
@@ -178,7 +187,9 @@ namespace librbd {
     uint32_t readahead_trigger_requests;
     uint64_t readahead_max_bytes;
     uint64_t readahead_disable_after_bytes;
+    uint32_t readahead_max_streams;
     bool clone_copy_on_read;
+    bool sparse_copyup;
     bool blacklist_on_break_lock;
     uint32_t blacklist_expire_seconds;
     uint32_t request_timed_out_seconds;
@@ -189,6 +200,7 @@ namespace librbd {
     int journal_object_flush_interval;
     uint64_t journal_object_flush_bytes;
     double journal_object_flush_age;
+    uint64_t journal_object_max_in_flight_appends;
     std::string journal_pool;
     uint32_t journal_max_payload_bytes;
     int journal_max_concurrent_object_sets;
@@ -227,6 +239,7 @@ namespace librbd {
     void init();
     void shutdown();
     void init_layout();
+    void publish_read_state();
     void perf_start(std::string name);
     void perf_stop();
     void set_read_flag(unsigned flag);
@@ -327,6 +340,8 @@ namespace librbd {
     static void get_thread_pool_instance(CephContext *cct,
                                          ThreadPool **thread_pool,
                                          ContextWQ **op_work_queue);
+    static void get_io_thread_pool_instance(CephContext *cct,
+                                            ThreadPool **thread_pool);
     static void get_timer_instance(CephContext *cct, SafeTimer **timer,
                                    Mutex **timer_lock);
   };
@@ -0,0 +1,177 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_PUBLISHED_STATE_H
+#define CEPH_LIBRBD_PUBLISHED_STATE_H
+
+#include "include/int_types.h"
+#include <atomic>
+#include <list>
+#include "include/assert.h"
+
+namespace librbd {
+
+/**
+ * Helper class to share immutable state with lock-free readers. Readers pin
+ * the most recently published state for as long as they use it. Publishing a
+ * new state retires the previous one, which is only freed once every reader
+ * that might have pinned it has released it.
+ *
+ * Readers are tracked with per-epoch pin counts that are spread over
+ * per-thread slots so that concurrent readers do not contend on the same
+ * cache line. A retired state is freed once the epoch has advanced twice
+ * past the epoch it was retired in. Publishing must be serialized by the
+ * caller.
+ */
+template <typename T>
+class PublishedState {
+private:
+  struct Node;
+
+public:
+  class Ref {
+  public:
+    Ref() {
+    }
+    ~Ref() {
+      reset();
+    }
+
+    Ref(const Ref&) = delete;
+    Ref &operator=(const Ref&) = delete;
+
+    explicit operator bool() const {
+      return (m_node != nullptr);
+    }
+    const T *operator->() const {
+      assert(m_node != nullptr);
+      return &m_node->state;
+    }
+    const T &operator*() const {
+      assert(m_node != nullptr);
+      return m_node->state;
+    }
+
+    void reset() {
+      if (m_pins != nullptr) {
+        m_pins->fetch_sub(1, std::memory_order_release);
+        m_pins = nullptr;
+        m_node = nullptr;
+      }
+    }
+
+  private:
+    friend class PublishedState;
+
+    std::atomic<uint32_t> *m_pins = nullptr;
+    Node *m_node = nullptr;
+  };
+
+  PublishedState() {
+  }
+  ~PublishedState() {
+    delete m_current.load();
+    for (auto &retired : m_retired) {
+      delete retired.second;
+    }
+  }
+
+  PublishedState(const PublishedState&) = delete;
+  PublishedState &operator=(const PublishedState&) = delete;
+
+  /**
+   * Pin the most recently published state. The reference is left empty
+   * if no state has been published yet.
+   */
+  void pin(Ref *ref) const {
+    ref->reset();
+
+    uint64_t epoch = m_epoch.load();
+    std::atomic<uint32_t> *pins = &m_slots[get_slot()].pins[epoch & 1];
+    pins->fetch_add(1);
+
+    // any state loaded after pinning the epoch cannot be freed until the
+    // pin is released
+    Node *node = m_current.load();
+    if (node == nullptr) {
+      pins->fetch_sub(1, std::memory_order_release);
+      return;
+    }
+
+    ref->m_pins = pins;
+    ref->m_node = node;
+  }
+
+  /**
+   * Publish a new state and free any retired states that can no longer
+   * be pinned.
+   */
+  void publish(T &&state) {
+    Node *node = new Node(std::move(state));
+    Node *retired = m_current.exchange(node);
+    if (retired != nullptr) {
+      m_retired.emplace_back(m_epoch.load(), retired);
+    }
+
+    // advance the epoch once all readers pinned under the epoch parity
+    // about to be reused have released their pins
+    for (int i = 0; i < 2 && !m_retired.empty(); ++i) {
+      uint64_t epoch = m_epoch.load();
+      if (is_pinned((epoch + 1) & 1)) {
+        break;
+      }
+      m_epoch.store(epoch + 1);
+    }
+
+    uint64_t epoch = m_epoch.load();
+    while (!m_retired.empty() && m_retired.front().first + 2 <= epoch) {
+      delete m_retired.front().second;
+      m_retired.pop_front();
+    }
+  }
+
+private:
+  static const uint32_t PIN_SLOTS = 16;
+  static const uint32_t CACHE_LINE_SIZE = 64;
+
+  struct PinSlot {
+    std::atomic<uint32_t> pins[2];
+    char pad[CACHE_LINE_SIZE - 2 * sizeof(std::atomic<uint32_t>)];
+
+    PinSlot() {
+      pins[0] = 0;
+      pins[1] = 0;
+    }
+  };
+
+  struct Node {
+    T state;
+
+    explicit Node(T &&state) : state(std::move(state)) {
+    }
+  };
+
+  std::atomic<Node*> m_current { nullptr };
+  std::atomic<uint64_t> m_epoch { 0 };
+  mutable PinSlot m_slots[PIN_SLOTS];
+  std::list<std::pair<uint64_t, Node*> > m_retired;
+
+  bool is_pinned(uint64_t parity) const {
+    for (auto &slot : m_slots) {
+      if (slot.pins[parity].load() > 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static uint32_t get_slot() {
+    static std::atomic<uint32_t> s_next_slot { 0 };
+    static thread_local uint32_t t_slot = s_next_slot++ % PIN_SLOTS;
+    return t_slot;
+  }
+};
+
+} // namespace librbd
+
+#endif // CEPH_LIBRBD_PUBLISHED_STATE_H
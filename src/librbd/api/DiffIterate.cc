@@ -285,22 +285,6 @@ int DiffIterate<I>::execute() {
     return -EINVAL;
   }
 
-  int r;
-  bool fast_diff_enabled = false;
-  BitVector<2> object_diff_state;
-  {
-    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
-    if (m_whole_object && (m_image_ctx.features & RBD_FEATURE_FAST_DIFF) != 0) {
-      r = diff_object_map(from_snap_id, end_snap_id, &object_diff_state);
-      if (r < 0) {
-        ldout(cct, 5) << "fast diff disabled" << dendl;
-      } else {
-        ldout(cct, 5) << "fast diff enabled" << dendl;
-        fast_diff_enabled = true;
-      }
-    }
-  }
-
   // we must list snaps via the head, not end snap
   head_ctx.snap_set_read(CEPH_SNAPDIR);
 
@@ -311,6 +295,7 @@ int DiffIterate<I>::execute() {
   // check parent overlap only if we are comparing to the beginning of time
   DiffContext diff_context(m_image_ctx, m_callback, m_callback_arg,
                            m_whole_object, from_snap_id, end_snap_id);
+  int r;
   if (m_include_parent && from_snap_id == 0) {
     RWLock::RLocker l(m_image_ctx.snap_lock);
     RWLock::RLocker l2(m_image_ctx.parent_lock);
@@ -331,6 +316,26 @@ int DiffIterate<I>::execute() {
     }
   }
 
+  // the fast diff object map can only be used to skip objects when reporting
+  // intra-object deltas if no parent overlap needs to be reported for objects
+  // that do not exist within the clone
+  bool fast_diff_enabled = false;
+  BitVector<2> object_diff_state;
+  if (m_whole_object || diff_context.parent_diff.empty()) {
+    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+    if ((m_image_ctx.features & RBD_FEATURE_FAST_DIFF) != 0) {
+      r = diff_object_map(from_snap_id, end_snap_id, &object_diff_state);
+      if (r < 0) {
+        ldout(cct, 5) << "fast diff disabled" << dendl;
+      } else {
+        ldout(cct, 5) << "fast diff enabled" << dendl;
+        fast_diff_enabled = true;
+      }
+    }
+  }
+
+  uint64_t objects_skipped = 0;
+  uint64_t objects_listed = 0;
   uint64_t period = m_image_ctx.get_stripe_period();
   uint64_t off = m_offset;
   uint64_t left = m_length;
@@ -339,6 +344,15 @@ int DiffIterate<I>::execute() {
     uint64_t period_off = off - (off % period);
     uint64_t read_len = min(period_off + period - off, left);
 
+    if (fast_diff_enabled && m_image_ctx.layout.stripe_count == 1 &&
+        object_diff_state[off / period] == OBJECT_DIFF_STATE_NONE) {
+      // unstriped period maps to a single unchanged object
+      ++objects_skipped;
+      left -= read_len;
+      off += read_len;
+      continue;
+    }
+
     // map to extents
     map<object_t,vector<ObjectExtent> > object_extents;
     Striper::file_to_extents(cct, m_image_ctx.format_string,
@@ -353,7 +367,10 @@ int DiffIterate<I>::execute() {
 
       if (fast_diff_enabled) {
         const uint64_t object_no = p->second.front().objectno;
-        if (object_diff_state[object_no] != OBJECT_DIFF_STATE_NONE) {
+        if (object_diff_state[object_no] == OBJECT_DIFF_STATE_NONE) {
+          ++objects_skipped;
+          continue;
+        } else if (m_whole_object) {
           bool updated = (object_diff_state[object_no] ==
                             OBJECT_DIFF_STATE_UPDATED);
           for (std::vector<ObjectExtent>::iterator q = p->second.begin();
@@ -363,18 +380,22 @@ int DiffIterate<I>::execute() {
               return r;
             }
           }
+          continue;
         }
-      } else {
-        C_DiffObject *diff_object = new C_DiffObject(m_image_ctx, head_ctx,
-                                                     diff_context,
-                                                     p->first.name, off,
-                                                     p->second);
-        diff_object->send();
-
-        if (diff_context.throttle.pending_error()) {
-          r = diff_context.throttle.wait_for_ret();
-          return r;
-        }
+      }
+
+      // list the snapshots of objects that might have changed to compute
+      // their intra-object deltas
+      ++objects_listed;
+      C_DiffObject *diff_object = new C_DiffObject(m_image_ctx, head_ctx,
+                                                   diff_context,
+                                                   p->first.name, off,
+                                                   p->second);
+      diff_object->send();
+
+      if (diff_context.throttle.pending_error()) {
+        r = diff_context.throttle.wait_for_ret();
+        return r;
       }
     }
 
@@ -386,6 +407,9 @@ int DiffIterate<I>::execute() {
   if (r < 0) {
     return r;
   }
+
+  ldout(cct, 5) << "diff_iterate complete: objects listed=" << objects_listed
+                << ", skipped=" << objects_skipped << dendl;
   return 0;
 }
 
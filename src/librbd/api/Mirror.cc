@@ -10,6 +10,7 @@
 #include "librbd/ImageCtx.h"
 #include "librbd/ImageState.h"
 #include "librbd/Journal.h"
+#include "librbd/Operations.h"
 #include "librbd/Utils.h"
 #include "librbd/api/Image.h"
 #include "librbd/mirror/DemoteRequest.h"
@@ -18,6 +19,7 @@
 #include "librbd/mirror/GetInfoRequest.h"
 #include "librbd/mirror/GetStatusRequest.h"
 #include "librbd/mirror/PromoteRequest.h"
+#include "librbd/mirror/SnapshotUtils.h"
 #include "librbd/mirror/Types.h"
 #include "librbd/MirroringWatcher.h"
 #include <boost/scope_exit.hpp>
@@ -49,6 +51,53 @@ int validate_mirroring_enabled(I *ictx) {
   return 0;
 }
 
+template <typename I>
+int create_primary_mirror_snapshot(I *ictx) {
+  CephContext *cct = ictx->cct;
+  {
+    // the first mirror snapshot marks the image as primary and provides
+    // the initial point-in-time for peers to sync
+    RWLock::RLocker snap_locker(ictx->snap_lock);
+    mirror::snapshot::MirrorSnapshots mirror_snapshots;
+    mirror::snapshot::list_snaps(ictx, &mirror_snapshots);
+    if (!mirror_snapshots.empty()) {
+      return 0;
+    }
+  }
+
+  std::string snap_name = mirror::snapshot::get_snap_name(
+    mirror::snapshot::STATE_PRIMARY, "",
+    mirror::snapshot::generate_snap_uuid());
+  int r = ictx->operations->snap_create(cls::rbd::UserSnapshotNamespace(),
+                                        snap_name.c_str());
+  if (r < 0) {
+    lderr(cct) << "failed to create primary mirror snapshot: "
+               << cpp_strerror(r) << dendl;
+    return r;
+  }
+  return 0;
+}
+
+template <typename I>
+void remove_mirror_snapshots(I *ictx) {
+  CephContext *cct = ictx->cct;
+  mirror::snapshot::MirrorSnapshots mirror_snapshots;
+  {
+    RWLock::RLocker snap_locker(ictx->snap_lock);
+    mirror::snapshot::list_snaps(ictx, &mirror_snapshots);
+  }
+
+  for (auto &mirror_snapshot : mirror_snapshots) {
+    int r = ictx->operations->snap_remove(cls::rbd::UserSnapshotNamespace(),
+                                          mirror_snapshot.snap_name.c_str());
+    if (r < 0 && r != -ENOENT) {
+      lderr(cct) << "failed to remove mirror snapshot "
+                 << mirror_snapshot.snap_name << ": " << cpp_strerror(r)
+                 << dendl;
+    }
+  }
+}
+
 int list_mirror_images(librados::IoCtx& io_ctx,
                        std::set<std::string>& mirror_image_ids) {
   CephContext *cct = reinterpret_cast<CephContext *>(io_ctx.cct());
@@ -136,9 +185,16 @@ struct C_ImageGetStatus : public C_ImageGetInfo {
 } // anonymous namespace
 
 template <typename I>
-int Mirror<I>::image_enable(I *ictx, bool relax_same_pool_parent_check) {
+int Mirror<I>::image_enable(I *ictx, mirror_image_mode_t mode,
+                            bool relax_same_pool_parent_check) {
   CephContext *cct = ictx->cct;
-  ldout(cct, 20) << "ictx=" << ictx << dendl;
+  ldout(cct, 20) << "ictx=" << ictx << ", mode=" << mode << dendl;
+
+  if (mode != RBD_MIRROR_IMAGE_MODE_JOURNAL &&
+      mode != RBD_MIRROR_IMAGE_MODE_SNAPSHOT) {
+    lderr(cct) << "invalid mirror image mode" << dendl;
+    return -EINVAL;
+  }
 
   int r = ictx->state->refresh_if_required();
   if (r < 0) {
@@ -182,13 +238,26 @@ int Mirror<I>::image_enable(I *ictx, bool relax_same_pool_parent_check) {
     }
   }
 
-  if ((ictx->features & RBD_FEATURE_JOURNALING) == 0) {
+  if (mode == RBD_MIRROR_IMAGE_MODE_JOURNAL &&
+      (ictx->features & RBD_FEATURE_JOURNALING) == 0) {
     lderr(cct) << "cannot enable mirroring: journaling is not enabled" << dendl;
     return -EINVAL;
+  } else if (mode == RBD_MIRROR_IMAGE_MODE_SNAPSHOT) {
+    if ((ictx->features & RBD_FEATURE_JOURNALING) != 0) {
+      lderr(cct) << "cannot enable snapshot mirroring: journaling is enabled"
+                 << dendl;
+      return -EINVAL;
+    } else if ((ictx->features & RBD_FEATURE_EXCLUSIVE_LOCK) == 0) {
+      lderr(cct) << "cannot enable snapshot mirroring: exclusive lock is not "
+                 << "enabled" << dendl;
+      return -EINVAL;
+    }
   }
 
   C_SaferCond ctx;
-  auto req = mirror::EnableRequest<ImageCtx>::create(ictx, &ctx);
+  auto req = mirror::EnableRequest<ImageCtx>::create(
+    ictx->md_ctx, ictx->id, static_cast<cls::rbd::MirrorImageMode>(mode), "",
+    ictx->op_work_queue, &ctx);
   req->send();
 
   r = ctx.wait();
@@ -197,6 +266,13 @@ int Mirror<I>::image_enable(I *ictx, bool relax_same_pool_parent_check) {
     return r;
   }
 
+  if (mode == RBD_MIRROR_IMAGE_MODE_SNAPSHOT) {
+    r = create_primary_mirror_snapshot(ictx);
+    if (r < 0) {
+      return r;
+    }
+  }
+
   return 0;
 }
 
@@ -314,6 +390,10 @@ int Mirror<I>::image_disable(I *ictx, bool force) {
       rollback = true;
       return r;
     }
+
+    if (mirror_image_internal.mode == cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT) {
+      remove_mirror_snapshots(ictx);
+    }
   }
 
   return 0;
@@ -383,6 +463,15 @@ int Mirror<I>::image_resync(I *ictx) {
     return r;
   }
 
+  mirror_image_mode_t mode;
+  r = image_get_mode(ictx, &mode);
+  if (r < 0) {
+    return r;
+  } else if (mode == RBD_MIRROR_IMAGE_MODE_SNAPSHOT) {
+    lderr(cct) << "resync is not supported for snapshot mirroring" << dendl;
+    return -EOPNOTSUPP;
+  }
+
   C_SaferCond tag_owner_ctx;
   bool is_tag_owner;
   Journal<I>::is_tag_owner(ictx, &is_tag_owner, &tag_owner_ctx);
@@ -406,6 +495,26 @@ int Mirror<I>::image_resync(I *ictx) {
   return 0;
 }
 
+template <typename I>
+int Mirror<I>::image_get_mode(I *ictx, mirror_image_mode_t *mode) {
+  CephContext *cct = ictx->cct;
+  ldout(cct, 20) << "ictx=" << ictx << dendl;
+
+  cls::rbd::MirrorImage mirror_image_internal;
+  int r = cls_client::mirror_image_get(&ictx->md_ctx, ictx->id,
+                                       &mirror_image_internal);
+  if (r < 0) {
+    if (r != -ENOENT) {
+      lderr(cct) << "failed to retrieve mirroring state: " << cpp_strerror(r)
+                 << dendl;
+    }
+    return r;
+  }
+
+  *mode = static_cast<mirror_image_mode_t>(mirror_image_internal.mode);
+  return 0;
+}
+
 template <typename I>
 void Mirror<I>::image_get_info(I *ictx, mirror_image_info_t *mirror_image_info,
                                size_t info_size, Context *on_finish) {
@@ -597,7 +706,7 @@ int Mirror<I>::mode_set(librados::IoCtx& io_ctx,
           return r;
         }
 
-        r = image_enable(img_ctx, true);
+        r = image_enable(img_ctx, RBD_MIRROR_IMAGE_MODE_JOURNAL, true);
         int close_r = img_ctx->state->close();
         if (r < 0) {
           lderr(cct) << "error enabling mirroring for image "
@@ -42,13 +42,15 @@ struct Mirror {
   static int image_status_summary(librados::IoCtx& io_ctx,
                                   MirrorImageStatusStates *states);
 
-  static int image_enable(ImageCtxT *ictx, bool relax_same_pool_parent_check);
+  static int image_enable(ImageCtxT *ictx, mirror_image_mode_t mode,
+                          bool relax_same_pool_parent_check);
   static int image_disable(ImageCtxT *ictx, bool force);
   static int image_promote(ImageCtxT *ictx, bool force);
   static void image_promote(ImageCtxT *ictx, bool force, Context *on_finish);
   static int image_demote(ImageCtxT *ictx);
   static void image_demote(ImageCtxT *ictx, Context *on_finish);
   static int image_resync(ImageCtxT *ictx);
+  static int image_get_mode(ImageCtxT *ictx, mirror_image_mode_t *mode);
   static int image_get_info(ImageCtxT *ictx,
                             mirror_image_info_t *mirror_image_info,
                             size_t info_size);
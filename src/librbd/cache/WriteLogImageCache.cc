@@ -0,0 +1,1630 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "WriteLogImageCache.h"
+#include "include/buffer.h"
+#include "include/Context.h"
+#include "include/encoding.h"
+#include "include/stringify.h"
+#include "cls/rbd/cls_rbd_client.h"
+#include "common/ceph_json.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/Finisher.h"
+#include "common/Formatter.h"
+#include "common/hostname.h"
+#include "common/perf_counters.h"
+#include "common/safe_io.h"
+#include "common/WorkQueue.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/Utils.h"
+#include "librbd/internal.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::cache::WriteLogImageCache: " << this \
+                           << " " <<  __func__ << ": "
+
+namespace librbd {
+namespace cache {
+
+namespace {
+
+const uint64_t SUPERBLOCK_MAGIC = 0x726264776c6f6731ULL; // "rbdwlog1"
+const uint64_t RECORD_MAGIC = 0x726264776c726563ULL;     // "rbdwlrec"
+const uint8_t SUPERBLOCK_VERSION = 2;
+
+const std::string STATE_KEY(".rbd_persistent_cache_state");
+
+uint64_t round_up(uint64_t value, uint64_t align) {
+  return (value + align - 1) / align * align;
+}
+
+uint64_t get_extents_length(const ImageCache::Extents &image_extents) {
+  uint64_t length = 0;
+  for (auto &image_extent : image_extents) {
+    length += image_extent.second;
+  }
+  return length;
+}
+
+void get_extents_set(const ImageCache::Extents &image_extents,
+                     interval_set<uint64_t> *extents) {
+  for (auto &image_extent : image_extents) {
+    if (image_extent.second > 0) {
+      extents->union_insert(image_extent.first, image_extent.second);
+    }
+  }
+}
+
+struct RecordHeader {
+  uint32_t type = 0;
+  uint64_t seq = 0;
+  uint64_t payload_length = 0;
+  uint32_t payload_crc = 0;
+
+  void encode(bufferlist &bl, uint64_t header_size) const {
+    bufferlist header;
+    ::encode(RECORD_MAGIC, header);
+    ::encode(type, header);
+    ::encode(seq, header);
+    ::encode(payload_length, header);
+    ::encode(payload_crc, header);
+    uint32_t header_crc = header.crc32c(0);
+    ::encode(header_crc, header);
+    header.append_zero(header_size - header.length());
+    bl.claim_append(header);
+  }
+
+  bool decode(bufferlist &bl) {
+    try {
+      bufferlist::iterator it = bl.begin();
+      uint64_t magic;
+      ::decode(magic, it);
+      ::decode(type, it);
+      ::decode(seq, it);
+      ::decode(payload_length, it);
+      ::decode(payload_crc, it);
+
+      bufferlist header;
+      header.substr_of(bl, 0, it.get_off());
+      uint32_t header_crc;
+      ::decode(header_crc, it);
+      return (magic == RECORD_MAGIC && header.crc32c(0) == header_crc);
+    } catch (const buffer::error &err) {
+      return false;
+    }
+  }
+};
+
+struct C_ReadRequest : public Context {
+  bufferlist *out_bl;
+  Context *on_finish;
+
+  /// requested pieces in order -- empty buffers are read from the image
+  std::vector<std::pair<uint64_t, bufferlist> > segments;
+  ImageCache::Extents miss_extents;
+  bufferlist miss_bl;
+
+  C_ReadRequest(bufferlist *out_bl, Context *on_finish)
+    : out_bl(out_bl), on_finish(on_finish) {
+  }
+
+  void finish(int r) override {
+    if (r < 0) {
+      on_finish->complete(r);
+      return;
+    }
+
+    uint64_t miss_offset = 0;
+    out_bl->clear();
+    for (auto &segment : segments) {
+      if (segment.second.length() > 0) {
+        out_bl->claim_append(segment.second);
+      } else {
+        bufferlist bl;
+        bl.substr_of(miss_bl, miss_offset, segment.first);
+        out_bl->claim_append(bl);
+        miss_offset += segment.first;
+      }
+    }
+    on_finish->complete(0);
+  }
+};
+
+} // anonymous namespace
+
+template <typename I>
+WriteLogImageCache<I>::WriteLogImageCache(I &image_ctx)
+  : m_image_ctx(image_ctx), m_image_writeback(image_ctx),
+    m_lock(util::unique_lock_name("librbd::cache::WriteLogImageCache::m_lock",
+                                  this)) {
+}
+
+template <typename I>
+WriteLogImageCache<I>::~WriteLogImageCache() {
+  if (m_open) {
+    // unclean shut down -- keep the log so that it is replayed when the
+    // lock is next acquired
+    close_log();
+  }
+  assert(m_deferred_writes.empty());
+}
+
+template <typename I>
+void WriteLogImageCache<I>::aio_read(Extents &&image_extents, bufferlist *bl,
+                                     int fadvise_flags, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  bool snap_read;
+  {
+    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+    snap_read = (m_image_ctx.snap_id != CEPH_NOSNAP);
+  }
+
+  // log payloads to read once the lock is dropped
+  struct Hit {
+    LogEntry *entry;
+    uint64_t offset;
+    uint64_t length;
+    size_t segment;
+  };
+  std::list<Hit> hits;
+
+  C_ReadRequest *req = nullptr;
+  uint64_t hit_bytes = 0;
+  uint64_t miss_bytes = 0;
+  {
+    Mutex::Locker locker(m_lock);
+    if (m_open && !snap_read && !m_extent_map.empty()) {
+      // split the request into pieces served from the log and pieces
+      // read from the image
+      req = new C_ReadRequest(bl, on_finish);
+      for (auto &image_extent : image_extents) {
+        uint64_t offset = image_extent.first;
+        uint64_t end = image_extent.first + image_extent.second;
+
+        auto it = m_extent_map.lower_bound(offset);
+        if (it != m_extent_map.begin()) {
+          auto prev = std::prev(it);
+          if (prev->first + prev->second.length > offset) {
+            it = prev;
+          }
+        }
+
+        while (offset < end) {
+          if (it == m_extent_map.end() || it->first > offset) {
+            uint64_t length = end - offset;
+            if (it != m_extent_map.end() && it->first < end) {
+              length = it->first - offset;
+            }
+            req->segments.push_back({length, bufferlist()});
+            req->miss_extents.push_back({offset, length});
+            miss_bytes += length;
+            offset += length;
+            continue;
+          }
+
+          // the entry keeps its log space until the payload is read
+          uint64_t length = std::min(it->first + it->second.length, end) -
+                            offset;
+          ++it->second.entry->readers;
+          hits.push_back({it->second.entry,
+                          it->second.data_offset + offset - it->first,
+                          length, req->segments.size()});
+          req->segments.push_back({length, bufferlist()});
+          hit_bytes += length;
+          offset += length;
+          ++it;
+        }
+      }
+    }
+  }
+
+  int r = 0;
+  for (auto &hit : hits) {
+    bufferptr bp(buffer::create(hit.length));
+    r = safe_pread_exact(m_fd, bp.c_str(), hit.length, hit.offset);
+    if (r < 0) {
+      lderr(cct) << "failed to read log " << m_log_path << ": "
+                 << cpp_strerror(r) << dendl;
+      break;
+    }
+    req->segments[hit.segment].second.push_back(std::move(bp));
+  }
+  if (!hits.empty()) {
+    {
+      Mutex::Locker locker(m_lock);
+      for (auto &hit : hits) {
+        assert(hit.entry->readers > 0);
+        --hit.entry->readers;
+      }
+    }
+    maybe_commit();
+  }
+
+  if (req == nullptr) {
+    m_image_ctx.perfcounter->inc(l_librbd_pcache_rd_miss_bytes,
+                                 get_extents_length(image_extents));
+    m_image_writeback.aio_read(std::move(image_extents), bl, fadvise_flags,
+                               on_finish);
+    return;
+  } else if (r < 0) {
+    delete req;
+    m_image_ctx.op_work_queue->queue(on_finish, r);
+    return;
+  }
+
+  m_image_ctx.perfcounter->inc(l_librbd_pcache_rd_hit_bytes, hit_bytes);
+  m_image_ctx.perfcounter->inc(l_librbd_pcache_rd_miss_bytes, miss_bytes);
+  if (req->miss_extents.empty()) {
+    m_image_ctx.op_work_queue->queue(req, 0);
+    return;
+  }
+
+  Extents miss_extents;
+  std::swap(miss_extents, req->miss_extents);
+  m_image_writeback.aio_read(std::move(miss_extents), &req->miss_bl,
+                             fadvise_flags, req);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::aio_write(Extents &&image_extents,
+                                      bufferlist&& bl,
+                                      int fadvise_flags,
+                                      Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  enum {
+    ACTION_WRITEBACK,
+    ACTION_BARRIER,
+    ACTION_DEFER,
+    ACTION_LOG
+  } action;
+
+  uint64_t length = bl.length();
+  LogEntry *entry = nullptr;
+  bufferlist record;
+  {
+    Mutex::Locker locker(m_lock);
+    if (!m_open || length == 0) {
+      action = ACTION_WRITEBACK;
+    } else if (round_up(RECORD_HEADER_SIZE + length, RECORD_ALIGN) +
+                 RECORD_ALIGN > m_log_end - 2 * SUPERBLOCK_SIZE) {
+      action = ACTION_BARRIER;
+    } else if (m_barriers > 0 || !m_deferred_writes.empty()) {
+      action = ACTION_DEFER;
+    } else {
+      entry = reserve(image_extents, bl, on_finish, &record);
+      action = (entry == nullptr ? ACTION_DEFER : ACTION_LOG);
+    }
+
+    if (action == ACTION_DEFER) {
+      ldout(cct, 10) << "deferring write: barriers=" << m_barriers << ", "
+                     << "deferred=" << m_deferred_writes.size() << dendl;
+      m_deferred_writes.push_back(new DeferredWrite{
+        std::move(image_extents), std::move(bl), fadvise_flags, on_finish});
+    }
+  }
+
+  switch (action) {
+  case ACTION_WRITEBACK:
+    m_image_writeback.aio_write(std::move(image_extents), std::move(bl),
+                                fadvise_flags, on_finish);
+    break;
+  case ACTION_BARRIER:
+    // too large to ever fit within the log
+    ldout(cct, 5) << "writing back oversized write: length=" << length
+                  << dendl;
+    barrier([this, image_extents, bl, fadvise_flags](Context *ctx) {
+        Extents extents(image_extents);
+        bufferlist data(bl);
+        m_image_writeback.aio_write(std::move(extents), std::move(data),
+                                    fadvise_flags, ctx);
+      }, on_finish);
+    break;
+  case ACTION_DEFER:
+    // free up log space
+    dispatch_destage();
+    break;
+  case ACTION_LOG:
+    write_entry(entry, record);
+    dispatch_destage();
+    break;
+  }
+}
+
+template <typename I>
+void WriteLogImageCache<I>::aio_discard(uint64_t offset, uint64_t length,
+                                        bool skip_partial_discard,
+                                        Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  bool open;
+  {
+    Mutex::Locker locker(m_lock);
+    open = m_open;
+  }
+
+  if (!open) {
+    m_image_writeback.aio_discard(offset, length, skip_partial_discard,
+                                  on_finish);
+    return;
+  }
+
+  // the discard must be applied after all previously logged writes
+  barrier([this, offset, length, skip_partial_discard](Context *ctx) {
+      m_image_writeback.aio_discard(offset, length, skip_partial_discard,
+                                    ctx);
+    }, on_finish);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::aio_flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "on_finish=" << on_finish << dendl;
+
+  bool open;
+  bool writeback_dirty;
+  {
+    Mutex::Locker locker(m_lock);
+    open = m_open;
+    writeback_dirty = m_writeback_dirty;
+    m_writeback_dirty = false;
+  }
+
+  if (!open) {
+    m_image_writeback.aio_flush(on_finish);
+    return;
+  }
+
+  if (writeback_dirty && m_image_ctx.object_cacher != nullptr) {
+    // requests passed through to the image might still be sitting within
+    // the object cache
+    on_finish = util::create_async_context_callback(m_image_ctx, on_finish);
+    on_finish = new FunctionContext([this, on_finish](int r) {
+        if (r < 0) {
+          on_finish->complete(r);
+          return;
+        }
+        m_image_ctx.flush_cache(on_finish);
+      });
+  }
+  queue_sync(on_finish);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::aio_writesame(uint64_t offset, uint64_t length,
+                                          bufferlist&& bl, int fadvise_flags,
+                                          Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "data_len=" << bl.length() << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  bool open;
+  {
+    Mutex::Locker locker(m_lock);
+    open = m_open;
+  }
+
+  if (!open) {
+    m_image_writeback.aio_writesame(offset, length, std::move(bl),
+                                    fadvise_flags, on_finish);
+    return;
+  }
+
+  barrier([this, offset, length, bl, fadvise_flags](Context *ctx) {
+      bufferlist data(bl);
+      m_image_writeback.aio_writesame(offset, length, std::move(data),
+                                      fadvise_flags, ctx);
+    }, on_finish);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::init(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << dendl;
+
+  bool journaling;
+  {
+    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+    journaling = m_image_ctx.test_features(RBD_FEATURE_JOURNALING,
+                                           m_image_ctx.snap_lock);
+  }
+  if (journaling || m_image_ctx.old_format) {
+    // journal replay and mirroring expect writes to reach the image in
+    // the same order as the journal events
+    ldout(cct, 5) << "persistent cache not supported with "
+                  << (journaling ? "journaling" : "old format images")
+                  << dendl;
+    on_finish->complete(0);
+    return;
+  }
+
+  // the log may only be replayed if the image still records it as the
+  // dirty cache
+  librados::ObjectReadOperation op;
+  cls_client::metadata_get_start(&op, STATE_KEY);
+
+  Context *ctx = new FunctionContext([this, on_finish](int r) {
+      handle_get_state(r, on_finish);
+    });
+  librados::AioCompletion *comp = util::create_rados_callback(ctx);
+  m_state_bl.clear();
+  int r = m_image_ctx.md_ctx.aio_operate(m_image_ctx.header_oid, comp, &op,
+                                         &m_state_bl);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void WriteLogImageCache<I>::handle_get_state(int r, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << "r=" << r << dendl;
+
+  CacheState state;
+  if (r == 0) {
+    bufferlist::iterator it = m_state_bl.begin();
+    std::string value;
+    r = cls_client::metadata_get_finish(&it, &value);
+    if (r == 0 && !state.decode(value)) {
+      r = -EBADMSG;
+    }
+  }
+  if (r == -ENOENT) {
+    r = 0;
+  } else if (r < 0) {
+    lderr(cct) << "failed to read persistent cache state: "
+               << cpp_strerror(r) << dendl;
+    on_finish->complete(r);
+    return;
+  }
+
+  std::string host = ceph_get_hostname();
+  {
+    Mutex::Locker locker(m_lock);
+    assert(!m_open);
+    m_log_path = m_image_ctx.persistent_cache_path + "/rbd-wlog." +
+                 stringify(m_image_ctx.data_ctx.get_id()) + "." +
+                 m_image_ctx.id;
+    if (state.dirty && (state.host != host || state.path != m_log_path)) {
+      // the writes logged there have not reached the image yet
+      lderr(cct) << "persistent cache is dirty on host " << state.host
+                 << ": " << state.path << dendl;
+      r = -EBUSY;
+    } else {
+      r = open_log(state);
+    }
+    if (r == 0) {
+      m_sync_finisher = new Finisher(cct, "librbd::cache::WriteLogImageCache",
+                                     "fn_rbd_wlog");
+      m_sync_finisher->start();
+      m_open = true;
+      m_state = state;
+      m_state_dirty = state.dirty;
+
+      ldout(cct, 5) << "opened log " << m_log_path << ": "
+                    << "generation=" << m_cache_generation << ", "
+                    << "entries=" << m_entries.size() << ", "
+                    << "dirty=" << m_dirty_bytes << dendl;
+    }
+  }
+
+  if (r < 0) {
+    lderr(cct) << "failed to open persistent cache: " << cpp_strerror(r)
+               << dendl;
+    on_finish->complete(r);
+    return;
+  }
+
+  if (state.dirty) {
+    // write back any replayed entries
+    dispatch_destage();
+    on_finish->complete(0);
+    return;
+  }
+
+  // nothing may be logged before this host owns the cache
+  Context *ctx = new FunctionContext([this, on_finish](int r) {
+      if (r < 0) {
+        close_log();
+      }
+      on_finish->complete(r);
+    });
+  set_state(true, ctx);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::set_state(bool dirty, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+
+  bufferlist bl;
+  {
+    Mutex::Locker locker(m_lock);
+    m_state.host = ceph_get_hostname();
+    m_state.path = m_log_path;
+    m_state.generation = m_cache_generation;
+    m_state.dirty = dirty;
+    m_state.encode(bl);
+  }
+  ldout(cct, 10) << "dirty=" << dirty << ", state=" << bl.to_str() << dendl;
+
+  std::map<std::string, bufferlist> data;
+  data[STATE_KEY].claim(bl);
+
+  librados::ObjectWriteOperation op;
+  cls_client::metadata_set(&op, data);
+
+  Context *ctx = new FunctionContext([this, dirty, on_finish](int r) {
+      handle_set_state(r, dirty, on_finish);
+    });
+  librados::AioCompletion *comp = util::create_rados_callback(ctx);
+  int r = m_image_ctx.md_ctx.aio_operate(m_image_ctx.header_oid, comp, &op);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void WriteLogImageCache<I>::handle_set_state(int r, bool dirty,
+                                             Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << "r=" << r << dendl;
+
+  if (r < 0) {
+    lderr(cct) << "failed to record persistent cache state: "
+               << cpp_strerror(r) << dendl;
+  } else {
+    Mutex::Locker locker(m_lock);
+    m_state_dirty = dirty;
+  }
+  on_finish->complete(r);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::shut_down(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << dendl;
+
+  bool open;
+  bool state_dirty;
+  {
+    Mutex::Locker locker(m_lock);
+    open = m_open;
+    state_dirty = m_state_dirty;
+  }
+
+  if (!open) {
+    if (state_dirty) {
+      // a previous shut down wrote the log back but failed to record it
+      set_state(false, on_finish);
+      return;
+    }
+    on_finish->complete(0);
+    return;
+  }
+
+  // the log cannot be closed from the sync thread
+  Context *ctx = new FunctionContext([this, on_finish](int r) {
+      CephContext *cct = m_image_ctx.cct;
+      if (r == -EBLACKLISTED) {
+        // another client owns the image now, but the logged writes can
+        // still be written back once the lock is acquired here again
+        lderr(cct) << "blacklisted during write back, keeping persistent "
+                   << "cache " << m_log_path << dendl;
+        close_log();
+        on_finish->complete(r);
+        return;
+      } else if (r < 0) {
+        lderr(cct) << "failed to write back persistent cache: "
+                   << cpp_strerror(r) << dendl;
+        on_finish->complete(r);
+        return;
+      }
+
+      close_log();
+      set_state(false, on_finish);
+    });
+  flush(util::create_async_context_callback(m_image_ctx, ctx));
+}
+
+template <typename I>
+void WriteLogImageCache<I>::invalidate(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  // the log only holds dirty data -- nothing to drop once written back
+  flush(on_finish);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "on_finish=" << on_finish << dendl;
+
+  {
+    Mutex::Locker locker(m_lock);
+    if (m_open) {
+      // retry any failed write backs
+      m_destage_error = 0;
+      m_destage_waiters.push_back({m_next_seq, on_finish});
+      on_finish = nullptr;
+    }
+  }
+
+  if (on_finish != nullptr) {
+    on_finish->complete(0);
+    return;
+  }
+
+  dispatch_destage();
+  maybe_commit();
+  complete_destage_waiters();
+}
+
+template <typename I>
+int WriteLogImageCache<I>::open_log(const CacheState &state) {
+  CephContext *cct = m_image_ctx.cct;
+  assert(m_lock.is_locked());
+
+  m_fd = ::open(m_log_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (m_fd < 0) {
+    int r = -errno;
+    lderr(cct) << "failed to open log " << m_log_path << ": "
+               << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  int r = read_superblock();
+  if (r < 0 && r != -ENOENT && r != -EINVAL) {
+    lderr(cct) << "failed to read log " << m_log_path << ": "
+               << cpp_strerror(r) << dendl;
+  } else if (state.dirty) {
+    if (r == 0 && m_cache_generation == state.generation) {
+      r = replay_log();
+    } else {
+      lderr(cct) << "log " << m_log_path << " is not the persistent cache "
+                 << "generation " << state.generation << " recorded in the "
+                 << "image" << dendl;
+      r = -ESTALE;
+    }
+  } else {
+    if (r == 0) {
+      // written back and closed clean, or superseded by a later cache
+      ldout(cct, 5) << "discarding stale log " << m_log_path << ": "
+                    << "generation=" << m_cache_generation << dendl;
+    }
+    r = create_log(state.generation + 1);
+  }
+
+  if (r < 0) {
+    VOID_TEMP_FAILURE_RETRY(::close(m_fd));
+    m_fd = -1;
+  }
+  return r;
+}
+
+template <typename I>
+int WriteLogImageCache<I>::create_log(uint64_t cache_generation) {
+  CephContext *cct = m_image_ctx.cct;
+  assert(m_lock.is_locked());
+
+  uint64_t log_size = m_image_ctx.persistent_cache_size / RECORD_ALIGN *
+                      RECORD_ALIGN;
+  if (log_size < 2 * SUPERBLOCK_SIZE + (1 << 20)) {
+    lderr(cct) << "persistent cache size too small: " << log_size << dendl;
+    return -EINVAL;
+  }
+
+  ldout(cct, 5) << "creating log " << m_log_path << ": "
+                << "size=" << log_size << ", "
+                << "generation=" << cache_generation << dendl;
+
+  // truncating discards any stale records
+  if (::ftruncate(m_fd, 0) < 0 || ::ftruncate(m_fd, log_size) < 0 ||
+      ::fsync(m_fd) < 0) {
+    int r = -errno;
+    lderr(cct) << "failed to size log " << m_log_path << ": "
+               << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  m_log_end = log_size;
+  m_generation = 0;
+  m_cache_generation = cache_generation;
+  m_head = m_tail = 2 * SUPERBLOCK_SIZE;
+  m_used = 0;
+  m_next_seq = 1;
+  return write_superblock(m_head, m_next_seq);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::close_log() {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << dendl;
+
+  Finisher *sync_finisher;
+  {
+    Mutex::Locker locker(m_lock);
+    m_open = false;
+    sync_finisher = m_sync_finisher;
+    m_sync_finisher = nullptr;
+  }
+
+  if (sync_finisher != nullptr) {
+    sync_finisher->wait_for_empty();
+    sync_finisher->stop();
+    delete sync_finisher;
+  }
+
+  Mutex::Locker locker(m_lock);
+  assert(m_destages_in_flight == 0);
+  assert(!m_committing);
+  assert(m_pending_entries.empty());
+  for (auto entry : m_entries) {
+    delete entry;
+  }
+  m_entries.clear();
+  m_extent_map.clear();
+  m_dirty_bytes = 0;
+  m_image_ctx.perfcounter->set(l_librbd_pcache_dirty_bytes, 0);
+
+  VOID_TEMP_FAILURE_RETRY(::close(m_fd));
+  m_fd = -1;
+}
+
+template <typename I>
+int WriteLogImageCache<I>::read_superblock() {
+  CephContext *cct = m_image_ctx.cct;
+
+  bool found = false;
+  for (uint64_t slot = 0; slot < 2; ++slot) {
+    bufferptr bp(buffer::create(SUPERBLOCK_SIZE));
+    int r = safe_pread_exact(m_fd, bp.c_str(), SUPERBLOCK_SIZE,
+                             slot * SUPERBLOCK_SIZE);
+    if (r < 0) {
+      // a freshly created log is empty
+      continue;
+    }
+
+    bufferlist bl;
+    bl.push_back(std::move(bp));
+    try {
+      bufferlist::iterator it = bl.begin();
+      bufferlist payload;
+      uint32_t crc;
+      ::decode(payload, it);
+      ::decode(crc, it);
+      if (payload.crc32c(0) != crc) {
+        continue;
+      }
+
+      uint64_t magic;
+      uint8_t version;
+      uint64_t generation;
+      std::string image_id;
+      uint64_t cache_generation;
+      uint64_t log_end;
+      uint64_t head;
+      uint64_t head_seq;
+
+      it = payload.begin();
+      ::decode(magic, it);
+      ::decode(version, it);
+      ::decode(generation, it);
+      ::decode(image_id, it);
+      ::decode(cache_generation, it);
+      ::decode(log_end, it);
+      ::decode(head, it);
+      ::decode(head_seq, it);
+      if (magic != SUPERBLOCK_MAGIC || version != SUPERBLOCK_VERSION ||
+          (found && generation <= m_generation)) {
+        continue;
+      }
+
+      if (image_id != m_image_ctx.id) {
+        lderr(cct) << "log " << m_log_path << " belongs to image "
+                   << image_id << dendl;
+        return -EINVAL;
+      }
+      if (log_end <= 2 * SUPERBLOCK_SIZE || head < 2 * SUPERBLOCK_SIZE ||
+          head > log_end || head % RECORD_ALIGN != 0) {
+        lderr(cct) << "log " << m_log_path << " has invalid superblock"
+                   << dendl;
+        return -EINVAL;
+      }
+
+      found = true;
+      m_generation = generation;
+      m_cache_generation = cache_generation;
+      m_log_end = log_end;
+      m_head = head;
+      m_next_seq = head_seq;
+    } catch (const buffer::error &err) {
+      continue;
+    }
+  }
+
+  if (!found) {
+    return -ENOENT;
+  }
+
+  struct stat st;
+  if (::fstat(m_fd, &st) < 0) {
+    return -errno;
+  } else if (static_cast<uint64_t>(st.st_size) < m_log_end) {
+    lderr(cct) << "log " << m_log_path << " truncated" << dendl;
+    return -EINVAL;
+  }
+  return 0;
+}
+
+template <typename I>
+int WriteLogImageCache<I>::write_superblock(uint64_t head, uint64_t head_seq) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "head=" << head << ", head_seq=" << head_seq << dendl;
+
+  // alternate between the two slots so that a torn write cannot lose both
+  ++m_generation;
+
+  bufferlist payload;
+  ::encode(SUPERBLOCK_MAGIC, payload);
+  ::encode(SUPERBLOCK_VERSION, payload);
+  ::encode(m_generation, payload);
+  ::encode(m_image_ctx.id, payload);
+  ::encode(m_cache_generation, payload);
+  ::encode(m_log_end, payload);
+  ::encode(head, payload);
+  ::encode(head_seq, payload);
+
+  bufferlist bl;
+  ::encode(payload, bl);
+  ::encode(payload.crc32c(0), bl);
+  assert(bl.length() <= SUPERBLOCK_SIZE);
+
+  int r = bl.write_fd(m_fd, (m_generation % 2) * SUPERBLOCK_SIZE);
+  if (r == 0 && ::fdatasync(m_fd) < 0) {
+    r = -errno;
+  }
+  if (r < 0) {
+    lderr(cct) << "failed to write superblock: " << cpp_strerror(r) << dendl;
+  }
+  return r;
+}
+
+template <typename I>
+int WriteLogImageCache<I>::replay_log() {
+  CephContext *cct = m_image_ctx.cct;
+  assert(m_lock.is_locked());
+
+  uint64_t data_start = 2 * SUPERBLOCK_SIZE;
+  uint64_t capacity = m_log_end - data_start;
+  uint64_t alloc_offset = m_head;
+  uint64_t pos = m_head;
+  uint64_t seq = m_next_seq;
+  uint64_t skipped = 0;
+
+  m_used = 0;
+  while (m_used < capacity) {
+    if (pos == m_log_end) {
+      pos = data_start;
+    }
+
+    bufferptr header_bp(buffer::create(RECORD_HEADER_SIZE));
+    int r = safe_pread_exact(m_fd, header_bp.c_str(), RECORD_HEADER_SIZE, pos);
+    if (r < 0) {
+      break;
+    }
+
+    bufferlist header_bl;
+    header_bl.push_back(std::move(header_bp));
+    RecordHeader header;
+    if (!header.decode(header_bl) || header.seq != seq) {
+      break;
+    }
+
+    if (header.type == RECORD_TYPE_WRAP) {
+      if (skipped > 0 || pos == data_start) {
+        break;
+      }
+      skipped = m_log_end - pos;
+      pos = data_start;
+      continue;
+    } else if (header.type != RECORD_TYPE_WRITE ||
+               pos + RECORD_HEADER_SIZE + header.payload_length > m_log_end) {
+      break;
+    }
+
+    bufferptr payload_bp(buffer::create(header.payload_length));
+    r = safe_pread_exact(m_fd, payload_bp.c_str(), header.payload_length,
+                         pos + RECORD_HEADER_SIZE);
+    if (r < 0) {
+      break;
+    }
+
+    bufferlist payload;
+    payload.push_back(std::move(payload_bp));
+    if (payload.crc32c(0) != header.payload_crc) {
+      ldout(cct, 5) << "torn record at " << pos << dendl;
+      break;
+    }
+
+    LogEntry *entry = new LogEntry();
+    try {
+      bufferlist::iterator it = payload.begin();
+      ::decode(entry->image_extents, it);
+      entry->data_offset = pos + RECORD_HEADER_SIZE + it.get_off();
+      entry->length = header.payload_length - it.get_off();
+    } catch (const buffer::error &err) {
+      delete entry;
+      break;
+    }
+    if (entry->length != get_extents_length(entry->image_extents)) {
+      delete entry;
+      break;
+    }
+
+    uint64_t record_length = round_up(
+      RECORD_HEADER_SIZE + header.payload_length, RECORD_ALIGN);
+    entry->seq = seq;
+    entry->log_offset = alloc_offset;
+    entry->alloc_length = skipped + record_length;
+    entry->record_offset = pos;
+    entry->logged = ceph::mono_clock::now();
+    entry->written = true;
+
+    uint64_t data_offset = entry->data_offset;
+    for (auto &image_extent : entry->image_extents) {
+      map_insert(image_extent.first, image_extent.second, entry, data_offset);
+      data_offset += image_extent.second;
+    }
+
+    m_entries.push_back(entry);
+    m_used += entry->alloc_length;
+    m_dirty_bytes += entry->length;
+
+    pos += record_length;
+    alloc_offset = pos;
+    skipped = 0;
+    ++seq;
+  }
+
+  m_tail = alloc_offset;
+  m_next_seq = seq;
+  m_image_ctx.perfcounter->set(l_librbd_pcache_dirty_bytes, m_dirty_bytes);
+
+  ldout(cct, 10) << "replayed " << m_entries.size() << " entries: "
+                 << "head=" << m_head << ", tail=" << m_tail << ", "
+                 << "next_seq=" << m_next_seq << dendl;
+  return 0;
+}
+
+template <typename I>
+bool WriteLogImageCache<I>::allocate(uint64_t length, uint64_t *log_offset,
+                                     uint64_t *record_offset,
+                                     uint64_t *alloc_length) {
+  assert(m_lock.is_locked());
+
+  uint64_t data_start = 2 * SUPERBLOCK_SIZE;
+  uint64_t pos = m_tail;
+  uint64_t skipped = 0;
+  if (pos + length > m_log_end) {
+    // records never straddle the end of the log
+    skipped = m_log_end - pos;
+    pos = data_start;
+  }
+
+  if (m_used + skipped + length > m_log_end - data_start) {
+    return false;
+  }
+
+  *log_offset = m_tail;
+  *record_offset = pos;
+  *alloc_length = skipped + length;
+  return true;
+}
+
+template <typename I>
+typename WriteLogImageCache<I>::LogEntry *WriteLogImageCache<I>::reserve(
+    Extents &image_extents, bufferlist &bl, Context *on_finish,
+    bufferlist *record) {
+  CephContext *cct = m_image_ctx.cct;
+  assert(m_lock.is_locked());
+
+  bufferlist payload;
+  ::encode(image_extents, payload);
+  uint64_t data_offset = payload.length();
+  payload.append(bl);
+
+  uint64_t record_length = round_up(RECORD_HEADER_SIZE + payload.length(),
+                                    RECORD_ALIGN);
+  uint64_t log_offset;
+  uint64_t record_offset;
+  uint64_t alloc_length;
+  if (!allocate(record_length, &log_offset, &record_offset, &alloc_length)) {
+    return nullptr;
+  }
+
+  LogEntry *entry = new LogEntry();
+  entry->seq = m_next_seq++;
+  entry->log_offset = log_offset;
+  entry->alloc_length = alloc_length;
+  entry->record_offset = record_offset;
+  entry->data_offset = record_offset + RECORD_HEADER_SIZE + data_offset;
+  entry->image_extents = image_extents;
+  entry->length = bl.length();
+  entry->on_logged = on_finish;
+
+  RecordHeader header;
+  header.type = RECORD_TYPE_WRITE;
+  header.seq = entry->seq;
+  header.payload_length = payload.length();
+  header.payload_crc = payload.crc32c(0);
+  header.encode(*record, RECORD_HEADER_SIZE);
+  record->claim_append(payload);
+
+  // the space is taken now, the record is written without the lock
+  m_pending_entries.push_back(entry);
+  m_tail = record_offset + record_length;
+  m_used += alloc_length;
+
+  ldout(cct, 20) << "seq=" << entry->seq << ", "
+                 << "record_offset=" << record_offset << ", "
+                 << "used=" << m_used << dendl;
+  return entry;
+}
+
+template <typename I>
+void WriteLogImageCache<I>::write_entry(LogEntry *entry, bufferlist &record) {
+  CephContext *cct = m_image_ctx.cct;
+
+  int r = 0;
+  if (entry->record_offset != entry->log_offset &&
+      entry->log_offset < m_log_end) {
+    // tell replay to continue from the start of the log
+    RecordHeader wrap_header;
+    wrap_header.type = RECORD_TYPE_WRAP;
+    wrap_header.seq = entry->seq;
+
+    bufferlist wrap_bl;
+    wrap_header.encode(wrap_bl, RECORD_HEADER_SIZE);
+    r = wrap_bl.write_fd(m_fd, entry->log_offset);
+  }
+  if (r == 0) {
+    r = record.write_fd(m_fd, entry->record_offset);
+  }
+  if (r < 0) {
+    lderr(cct) << "failed to append to log " << m_log_path << ": "
+               << cpp_strerror(r) << dendl;
+  }
+
+  std::list<std::pair<Context*, int> > completions;
+  bool hole = false;
+  {
+    Mutex::Locker locker(m_lock);
+    entry->written = true;
+    entry->write_result = r;
+
+    // later writes must win in the map, so entries are published in log
+    // order no matter which record made it to the log first
+    while (!m_pending_entries.empty() && m_pending_entries.front()->written) {
+      LogEntry *pending = m_pending_entries.front();
+      m_pending_entries.pop_front();
+      m_entries.push_back(pending);
+      pending->logged = ceph::mono_clock::now();
+
+      if (pending->write_result < 0) {
+        // nothing to write back; replay stops here until it is committed
+        pending->destaged = true;
+        m_hole_seq = pending->seq;
+        completions.push_back({pending->on_logged, pending->write_result});
+        pending->on_logged = nullptr;
+        continue;
+      }
+
+      uint64_t data_offset = pending->data_offset;
+      for (auto &image_extent : pending->image_extents) {
+        map_insert(image_extent.first, image_extent.second, pending,
+                   data_offset);
+        data_offset += image_extent.second;
+      }
+      m_dirty_bytes += pending->length;
+      m_image_ctx.perfcounter->inc(l_librbd_pcache_log_bytes,
+                                   pending->length);
+
+      if (m_hole_seq != 0) {
+        // would not be replayed past the hole -- complete once written back
+        m_destage_waiters.push_back({pending->seq + 1, pending->on_logged});
+        hole = true;
+      } else {
+        completions.push_back({pending->on_logged, 0});
+      }
+      pending->on_logged = nullptr;
+    }
+    m_image_ctx.perfcounter->set(l_librbd_pcache_dirty_bytes, m_dirty_bytes);
+  }
+
+  for (auto &completion : completions) {
+    m_image_ctx.op_work_queue->queue(completion.first, completion.second);
+  }
+  if (hole) {
+    dispatch_destage();
+    maybe_commit();
+    complete_destage_waiters();
+  }
+}
+
+template <typename I>
+void WriteLogImageCache<I>::map_insert(uint64_t offset, uint64_t length,
+                                       LogEntry *entry,
+                                       uint64_t data_offset) {
+  assert(m_lock.is_locked());
+  if (length == 0) {
+    return;
+  }
+
+  uint64_t end = offset + length;
+  auto it = m_extent_map.lower_bound(offset);
+  if (it != m_extent_map.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second.length > offset) {
+      it = prev;
+    }
+  }
+
+  // trim or drop older copies of the overwritten range
+  while (it != m_extent_map.end() && it->first < end) {
+    uint64_t extent_offset = it->first;
+    MapExtent extent = it->second;
+    uint64_t extent_end = extent_offset + extent.length;
+
+    it = m_extent_map.erase(it);
+    if (extent_offset < offset) {
+      m_extent_map[extent_offset] = {offset - extent_offset, extent.entry,
+                                     extent.data_offset};
+    }
+    if (extent_end > end) {
+      m_extent_map[end] = {extent_end - end, extent.entry,
+                           extent.data_offset + (end - extent_offset)};
+    }
+  }
+
+  m_extent_map[offset] = {length, entry, data_offset};
+}
+
+template <typename I>
+void WriteLogImageCache<I>::map_remove(const LogEntry &entry) {
+  assert(m_lock.is_locked());
+
+  for (auto &image_extent : entry.image_extents) {
+    uint64_t end = image_extent.first + image_extent.second;
+    auto it = m_extent_map.lower_bound(image_extent.first);
+    if (it != m_extent_map.begin()) {
+      auto prev = std::prev(it);
+      if (prev->first + prev->second.length > image_extent.first) {
+        it = prev;
+      }
+    }
+
+    // pieces overwritten by later writes remain mapped
+    while (it != m_extent_map.end() && it->first < end) {
+      if (it->second.entry == &entry) {
+        it = m_extent_map.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+}
+
+template <typename I>
+uint64_t WriteLogImageCache<I>::get_first_seq() const {
+  assert(m_lock.is_locked());
+  if (!m_entries.empty()) {
+    return m_entries.front()->seq;
+  } else if (!m_pending_entries.empty()) {
+    return m_pending_entries.front()->seq;
+  }
+  return m_next_seq;
+}
+
+template <typename I>
+void WriteLogImageCache<I>::dispatch_deferred_writes() {
+  CephContext *cct = m_image_ctx.cct;
+
+  std::list<std::pair<LogEntry*, bufferlist> > writes;
+  {
+    Mutex::Locker locker(m_lock);
+    while (m_open && m_barriers == 0 && !m_deferred_writes.empty()) {
+      DeferredWrite *write = m_deferred_writes.front();
+      bufferlist record;
+      LogEntry *entry = reserve(write->image_extents, write->bl,
+                                write->on_finish, &record);
+      if (entry == nullptr) {
+        break;
+      }
+
+      m_deferred_writes.pop_front();
+      writes.push_back({entry, std::move(record)});
+      delete write;
+    }
+  }
+
+  if (writes.empty()) {
+    return;
+  }
+
+  ldout(cct, 20) << "dispatching " << writes.size() << " deferred writes"
+                 << dendl;
+  for (auto &write : writes) {
+    write_entry(write.first, write.second);
+  }
+  dispatch_destage();
+}
+
+template <typename I>
+void WriteLogImageCache<I>::dispatch_destage() {
+  CephContext *cct = m_image_ctx.cct;
+
+  std::list<LogEntry*> destages;
+  {
+    Mutex::Locker locker(m_lock);
+    if (!m_open) {
+      return;
+    }
+
+    uint32_t max_destage = std::max(
+      1, m_image_ctx.persistent_cache_max_destage);
+    for (auto entry : m_entries) {
+      if (m_destage_error < 0 || m_destages_in_flight >= max_destage) {
+        break;
+      } else if (entry->destaging || entry->destaged) {
+        continue;
+      }
+
+      // overlapping writes must reach the image in log order
+      interval_set<uint64_t> extents;
+      get_extents_set(entry->image_extents, &extents);
+      bool overlaps = false;
+      for (auto it = extents.begin(); it != extents.end(); ++it) {
+        if (m_destaging_extents.intersects(it.get_start(), it.get_len())) {
+          overlaps = true;
+          break;
+        }
+      }
+      if (overlaps) {
+        break;
+      }
+
+      // the payload stays in the log until the entry is destaged
+      entry->destaging = true;
+      m_destaging_extents.union_of(extents);
+      ++m_destages_in_flight;
+      destages.push_back(entry);
+    }
+  }
+
+  for (auto entry : destages) {
+    ldout(cct, 20) << "seq=" << entry->seq << ", "
+                   << "image_extents=" << entry->image_extents << dendl;
+
+    Context *ctx = new FunctionContext([this, entry](int r) {
+        handle_destage(entry, r);
+      });
+
+    bufferptr bp(buffer::create(entry->length));
+    int r = safe_pread_exact(m_fd, bp.c_str(), entry->length,
+                             entry->data_offset);
+    if (r < 0) {
+      lderr(cct) << "failed to read log " << m_log_path << ": "
+                 << cpp_strerror(r) << dendl;
+      ctx->complete(r);
+      continue;
+    }
+
+    bufferlist bl;
+    bl.push_back(std::move(bp));
+    Extents image_extents(entry->image_extents);
+    m_image_writeback.aio_write(std::move(image_extents), std::move(bl), 0,
+                                ctx);
+  }
+}
+
+template <typename I>
+void WriteLogImageCache<I>::handle_destage(LogEntry *entry, int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "seq=" << entry->seq << ", r=" << r << dendl;
+
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_destages_in_flight > 0);
+    --m_destages_in_flight;
+
+    interval_set<uint64_t> extents;
+    get_extents_set(entry->image_extents, &extents);
+    m_destaging_extents.subtract(extents);
+    entry->destaging = false;
+
+    if (r < 0) {
+      lderr(cct) << "failed to write back seq " << entry->seq << ": "
+                 << cpp_strerror(r) << dendl;
+      if (m_destage_error == 0) {
+        m_destage_error = r;
+      }
+    } else {
+      entry->destaged = true;
+      map_remove(*entry);
+      m_dirty_bytes -= entry->length;
+      m_image_ctx.perfcounter->set(l_librbd_pcache_dirty_bytes,
+                                   m_dirty_bytes);
+      m_image_ctx.perfcounter->tinc(l_librbd_pcache_destage_lag,
+                                    ceph::mono_clock::now() - entry->logged);
+    }
+  }
+
+  // avoid re-entering the object cache from its own completion
+  m_image_ctx.op_work_queue->queue(new FunctionContext([this](int r) {
+      maybe_commit();
+      dispatch_destage();
+      complete_destage_waiters();
+    }), 0);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::maybe_commit() {
+  CephContext *cct = m_image_ctx.cct;
+
+  uint64_t head;
+  uint64_t head_seq;
+  {
+    Mutex::Locker locker(m_lock);
+    if (!m_open || m_committing) {
+      return;
+    }
+
+    // log space that is still being read from cannot be reused
+    auto it = m_entries.begin();
+    while (it != m_entries.end() && (*it)->destaged && (*it)->readers == 0) {
+      ++it;
+    }
+    if (it == m_entries.begin()) {
+      return;
+    }
+
+    if (it == m_entries.end()) {
+      if (m_pending_entries.empty()) {
+        head = m_tail;
+        head_seq = m_next_seq;
+      } else {
+        head = m_pending_entries.front()->log_offset;
+        head_seq = m_pending_entries.front()->seq;
+      }
+    } else {
+      head = (*it)->log_offset;
+      head_seq = (*it)->seq;
+    }
+    m_committing = true;
+  }
+
+  ldout(cct, 20) << "head=" << head << ", head_seq=" << head_seq << dendl;
+  Context *ctx = new FunctionContext([this, head, head_seq](int r) {
+      handle_commit_flush(head, head_seq, r);
+    });
+  if (m_image_ctx.object_cacher != nullptr) {
+    // written back data must be safe before its log space is reused
+    m_image_ctx.flush_cache(ctx);
+    return;
+  }
+  ctx->complete(0);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::handle_commit_flush(uint64_t head,
+                                                uint64_t head_seq, int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "r=" << r << dendl;
+
+  if (r < 0) {
+    lderr(cct) << "failed to flush written back data: " << cpp_strerror(r)
+               << dendl;
+    handle_commit(head, head_seq, r);
+    return;
+  }
+
+  Mutex::Locker locker(m_lock);
+  assert(m_sync_finisher != nullptr);
+  m_sync_finisher->queue(new FunctionContext([this, head, head_seq](int r) {
+      r = write_superblock(head, head_seq);
+      handle_commit(head, head_seq, r);
+    }));
+}
+
+template <typename I>
+void WriteLogImageCache<I>::handle_commit(uint64_t head, uint64_t head_seq,
+                                          int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "r=" << r << dendl;
+
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_committing);
+    m_committing = false;
+
+    if (r < 0) {
+      if (m_destage_error == 0) {
+        m_destage_error = r;
+      }
+    } else {
+      while (!m_entries.empty() && m_entries.front()->seq < head_seq) {
+        LogEntry *entry = m_entries.front();
+        assert(entry->destaged);
+        m_used -= entry->alloc_length;
+        m_entries.pop_front();
+        delete entry;
+      }
+      m_head = head;
+      if (m_hole_seq != 0 && head_seq > m_hole_seq) {
+        // the failed record is no longer in the replayed part of the log
+        m_hole_seq = 0;
+      }
+    }
+  }
+
+  maybe_commit();
+  dispatch_deferred_writes();
+  complete_destage_waiters();
+}
+
+template <typename I>
+void WriteLogImageCache<I>::complete_destage_waiters() {
+  std::list<std::pair<Context*, int> > completions;
+  {
+    Mutex::Locker locker(m_lock);
+    bool idle = (m_destages_in_flight == 0 && !m_committing);
+    for (auto it = m_destage_waiters.begin();
+         it != m_destage_waiters.end(); ) {
+      if (get_first_seq() >= it->first) {
+        completions.push_back({it->second, 0});
+      } else if (m_destage_error < 0 && idle) {
+        completions.push_back({it->second, m_destage_error});
+      } else {
+        ++it;
+        continue;
+      }
+      it = m_destage_waiters.erase(it);
+    }
+  }
+
+  for (auto &completion : completions) {
+    completion.first->complete(completion.second);
+  }
+}
+
+template <typename I>
+void WriteLogImageCache<I>::barrier(std::function<void(Context*)> &&issue,
+                                    Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+
+  Context *ctx = new FunctionContext([this, issue, on_finish](int r) {
+      Context *ctx = new FunctionContext([this, on_finish](int r) {
+          finish_barrier();
+          on_finish->complete(r);
+        });
+      if (r < 0) {
+        ctx->complete(r);
+        return;
+      }
+      issue(ctx);
+    });
+
+  {
+    Mutex::Locker locker(m_lock);
+    ++m_barriers;
+    m_destage_error = 0;
+    m_destage_waiters.push_back({m_next_seq, ctx});
+    ldout(cct, 20) << "barriers=" << m_barriers << dendl;
+  }
+
+  dispatch_destage();
+  maybe_commit();
+  complete_destage_waiters();
+}
+
+template <typename I>
+void WriteLogImageCache<I>::finish_barrier() {
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_barriers > 0);
+    --m_barriers;
+    m_writeback_dirty = true;
+  }
+
+  dispatch_deferred_writes();
+}
+
+template <typename I>
+void WriteLogImageCache<I>::queue_sync(Context *on_finish) {
+  Mutex::Locker locker(m_lock);
+  m_sync_waiters.push_back(on_finish);
+  if (!m_sync_queued) {
+    // all flushes arriving while a sync is queued share it
+    m_sync_queued = true;
+    m_sync_finisher->queue(new FunctionContext([this](int r) {
+        handle_sync();
+      }));
+  }
+}
+
+template <typename I>
+void WriteLogImageCache<I>::handle_sync() {
+  CephContext *cct = m_image_ctx.cct;
+
+  std::list<Context*> waiters;
+  int fd;
+  {
+    Mutex::Locker locker(m_lock);
+    m_sync_queued = false;
+    std::swap(waiters, m_sync_waiters);
+    fd = m_fd;
+  }
+
+  int r = 0;
+  if (::fdatasync(fd) < 0) {
+    r = -errno;
+    lderr(cct) << "failed to sync log " << m_log_path << ": "
+               << cpp_strerror(r) << dendl;
+  }
+  m_image_ctx.perfcounter->inc(l_librbd_pcache_sync);
+
+  ldout(cct, 20) << "synced " << waiters.size() << " flushes" << dendl;
+  for (auto ctx : waiters) {
+    ctx->complete(r);
+  }
+}
+
+template <typename I>
+void WriteLogImageCache<I>::CacheState::encode(bufferlist &bl) const {
+  // kept readable for "rbd image-meta get"
+  JSONFormatter f;
+  f.open_object_section("state");
+  f.dump_string("host", host);
+  f.dump_string("path", path);
+  f.dump_unsigned("generation", generation);
+  f.dump_bool("dirty", dirty);
+  f.close_section();
+  f.flush(bl);
+}
+
+template <typename I>
+bool WriteLogImageCache<I>::CacheState::decode(const std::string &value) {
+  JSONParser p;
+  if (!p.parse(value.c_str(), value.length())) {
+    return false;
+  }
+  try {
+    JSONDecoder::decode_json("host", host, &p);
+    JSONDecoder::decode_json("path", path, &p);
+    JSONDecoder::decode_json("generation", generation, &p);
+    JSONDecoder::decode_json("dirty", dirty, &p);
+  } catch (const JSONDecoder::err &err) {
+    return false;
+  }
+  return true;
+}
+
+} // namespace cache
+} // namespace librbd
+
+template class librbd::cache::WriteLogImageCache<librbd::ImageCtx>;
@@ -0,0 +1,225 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_CACHE_WRITE_LOG_IMAGE_CACHE
+#define CEPH_LIBRBD_CACHE_WRITE_LOG_IMAGE_CACHE
+
+#include "ImageCache.h"
+#include "ImageWriteback.h"
+#include "include/buffer.h"
+#include "include/interval_set.h"
+#include "include/rados/librados.hpp"
+#include "common/ceph_time.h"
+#include "common/Mutex.h"
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+
+class Finisher;
+
+namespace librbd {
+
+struct ImageCtx;
+
+namespace cache {
+
+/**
+ * Persistent, crash-consistent write-back image extent cache
+ *
+ * While the exclusive lock is held, writes are appended to a log file
+ * on local storage and completed as soon as they are written to it.
+ * Client flushes only sync the log, while the logged writes are written
+ * back to the image in log order in the background.  The log is replayed
+ * when the lock is next acquired on the same host, so acknowledged writes
+ * survive a client crash.
+ *
+ * The image metadata records the host and log that own the cache, and
+ * the generation of that log, from the time the log is opened until it
+ * is closed clean.  While it is recorded as dirty, the lock cannot be
+ * acquired with the cache enabled anywhere else, and a log that does not
+ * carry the recorded generation is stale and never replayed.
+ *
+ * When the lock is not held (or the image is journaled), all IO passes
+ * straight through to the image.
+ *
+ * Log file layout:
+ *
+ * @verbatim
+ *
+ * | superblock 0 | superblock 1 | record | record | ... | wrap | record |
+ *
+ * @endverbatim
+ *
+ * The two superblock slots are written alternately and hold the offset
+ * and sequence number of the oldest record that is not yet known to be
+ * written back.  Records are aligned to RECORD_ALIGN bytes and carry a
+ * header with their sequence number and crcs; replay stops at the first
+ * record that is invalid or out of sequence.
+ */
+template <typename ImageCtxT = librbd::ImageCtx>
+class WriteLogImageCache : public ImageCache {
+public:
+  WriteLogImageCache(ImageCtxT &image_ctx);
+  ~WriteLogImageCache() override;
+
+  /// client AIO methods
+  void aio_read(Extents&& image_extents, ceph::bufferlist *bl,
+                int fadvise_flags, Context *on_finish) override;
+  void aio_write(Extents&& image_extents, ceph::bufferlist&& bl,
+                 int fadvise_flags, Context *on_finish) override;
+  void aio_discard(uint64_t offset, uint64_t length,
+                   bool skip_partial_discard, Context *on_finish) override;
+  void aio_flush(Context *on_finish) override;
+  void aio_writesame(uint64_t offset, uint64_t length,
+                     ceph::bufferlist&& bl,
+                     int fadvise_flags, Context *on_finish) override;
+
+  /// internal state methods
+  void init(Context *on_finish) override;
+  void shut_down(Context *on_finish) override;
+
+  void invalidate(Context *on_finish) override;
+  void flush(Context *on_finish) override;
+
+private:
+  static const uint64_t SUPERBLOCK_SIZE = 4096;
+  static const uint64_t RECORD_ALIGN = 512;
+  static const uint64_t RECORD_HEADER_SIZE = 40;
+
+  enum RecordType {
+    RECORD_TYPE_WRITE = 1,
+    RECORD_TYPE_WRAP  = 2
+  };
+
+  struct LogEntry {
+    uint64_t seq;
+    uint64_t log_offset;     ///< start of the allocation within the log
+    uint64_t alloc_length;   ///< record length plus any skipped log tail
+    uint64_t record_offset;  ///< offset of the record header
+    uint64_t data_offset;    ///< offset of the write payload
+    Extents image_extents;
+    uint64_t length = 0;
+    ceph::mono_time logged;
+    Context *on_logged = nullptr;
+
+    bool written = false;    ///< record is in the log file
+    int write_result = 0;
+    uint32_t readers = 0;    ///< reads of the payload in progress
+    bool destaging = false;
+    bool destaged = false;
+  };
+  typedef std::list<LogEntry*> LogEntries;
+
+  /// dirty image extent mapped to its most recent copy in the log
+  struct MapExtent {
+    uint64_t length;
+    LogEntry *entry;
+    uint64_t data_offset;
+  };
+  typedef std::map<uint64_t, MapExtent> ExtentMap;
+
+  struct DeferredWrite {
+    Extents image_extents;
+    ceph::bufferlist bl;
+    int fadvise_flags;
+    Context *on_finish;
+  };
+  typedef std::deque<DeferredWrite*> DeferredWrites;
+
+  typedef std::list<std::pair<uint64_t, Context*> > FlushWaiters;
+
+  /// owner of the cache, kept in the image metadata
+  struct CacheState {
+    std::string host;
+    std::string path;
+    uint64_t generation = 0;
+    bool dirty = false;
+
+    void encode(ceph::bufferlist &bl) const;
+    bool decode(const std::string &value);
+  };
+
+  ImageCtxT &m_image_ctx;
+  ImageWriteback<ImageCtxT> m_image_writeback;
+
+  Finisher *m_sync_finisher = nullptr;
+
+  mutable Mutex m_lock;
+  bool m_open = false;
+  int m_fd = -1;
+  std::string m_log_path;
+
+  ceph::bufferlist m_state_bl;
+  CacheState m_state;
+  bool m_state_dirty = false;
+
+  uint64_t m_log_end = 0;
+  uint64_t m_generation = 0;
+  uint64_t m_cache_generation = 0;
+  uint64_t m_head = 0;
+  uint64_t m_tail = 0;
+  uint64_t m_used = 0;
+  uint64_t m_next_seq = 1;
+
+  LogEntries m_entries;
+  LogEntries m_pending_entries;  ///< reserved, in log order, not yet written
+  uint64_t m_hole_seq = 0;       ///< last record that failed to be written
+  ExtentMap m_extent_map;
+  interval_set<uint64_t> m_destaging_extents;
+  uint64_t m_dirty_bytes = 0;
+  uint32_t m_destages_in_flight = 0;
+  int m_destage_error = 0;
+
+  bool m_writeback_dirty = false;
+  bool m_committing = false;
+  bool m_sync_queued = false;
+  std::list<Context*> m_sync_waiters;
+
+  uint32_t m_barriers = 0;
+  DeferredWrites m_deferred_writes;
+  FlushWaiters m_destage_waiters;
+
+  void handle_get_state(int r, Context *on_finish);
+  void set_state(bool dirty, Context *on_finish);
+  void handle_set_state(int r, bool dirty, Context *on_finish);
+
+  int open_log(const CacheState &state);
+  int create_log(uint64_t cache_generation);
+  void close_log();
+  int read_superblock();
+  int write_superblock(uint64_t head, uint64_t head_seq);
+  int replay_log();
+
+  bool allocate(uint64_t length, uint64_t *log_offset,
+                uint64_t *record_offset, uint64_t *alloc_length);
+  LogEntry *reserve(Extents &image_extents, ceph::bufferlist &bl,
+                    Context *on_finish, ceph::bufferlist *record);
+  void write_entry(LogEntry *entry, ceph::bufferlist &record);
+  void map_insert(uint64_t offset, uint64_t length, LogEntry *entry,
+                  uint64_t data_offset);
+  void map_remove(const LogEntry &entry);
+  uint64_t get_first_seq() const;
+  void dispatch_deferred_writes();
+
+  void dispatch_destage();
+  void handle_destage(LogEntry *entry, int r);
+  void maybe_commit();
+  void handle_commit_flush(uint64_t head, uint64_t head_seq, int r);
+  void handle_commit(uint64_t head, uint64_t head_seq, int r);
+  void complete_destage_waiters();
+
+  void barrier(std::function<void(Context*)> &&issue, Context *on_finish);
+  void finish_barrier();
+
+  void queue_sync(Context *on_finish);
+  void handle_sync();
+};
+
+} // namespace cache
+} // namespace librbd
+
+extern template class librbd::cache::WriteLogImageCache<librbd::ImageCtx>;
+
+#endif // CEPH_LIBRBD_CACHE_WRITE_LOG_IMAGE_CACHE
@@ -15,6 +15,7 @@
 #include "librbd/Journal.h"
 #include "librbd/ObjectMap.h"
 #include "librbd/Utils.h"
+#include "librbd/cache/ImageCache.h"
 #include "librbd/image/RefreshRequest.h"
 #include "librbd/journal/Policy.h"
 
@@ -115,7 +116,7 @@ void PostAcquireRequest<I>::send_open_journal() {
   }
   if (!journal_enabled) {
     apply();
-    finish();
+    send_init_image_cache();
     return;
   }
 
@@ -200,6 +201,38 @@ void PostAcquireRequest<I>::handle_close_journal(int r) {
   send_close_object_map();
 }
 
+template <typename I>
+void PostAcquireRequest<I>::send_init_image_cache() {
+  if (m_image_ctx.image_cache == nullptr) {
+    finish();
+    return;
+  }
+
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << dendl;
+
+  // replays any writes logged while the lock was last held
+  using klass = PostAcquireRequest<I>;
+  Context *ctx = create_context_callback<
+    klass, &klass::handle_init_image_cache>(this);
+  m_image_ctx.image_cache->init(ctx);
+}
+
+template <typename I>
+void PostAcquireRequest<I>::handle_init_image_cache(int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << "r=" << r << dendl;
+
+  save_result(r);
+  if (r < 0) {
+    lderr(cct) << "failed to init image cache: " << cpp_strerror(r) << dendl;
+    send_close_object_map();
+    return;
+  }
+
+  finish();
+}
+
 template <typename I>
 void PostAcquireRequest<I>::send_open_object_map() {
   if (!m_image_ctx.test_features(RBD_FEATURE_OBJECT_MAP)) {
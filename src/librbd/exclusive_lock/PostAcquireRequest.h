@@ -57,6 +57,17 @@ private:
    *      v               |
    *  <finish> <----------/
    *
+   * (journal disabled)
+   * OPEN_JOURNAL
+   *      |
+   *      v
+   *  INIT_IMAGE_CACHE (skip if
+   *      |   *         disabled)
+   *      |   *
+   *      |   * * * * > CLOSE_OBJECT_MAP
+   *      v                   |
+   *  <finish> <--------------/
+   *
    * @endverbatim
    */
 
@@ -82,6 +93,9 @@ private:
   void send_allocate_journal_tag();
   void handle_allocate_journal_tag(int r);
 
+  void send_init_image_cache();
+  void handle_init_image_cache(int r);
+
   void send_open_object_map();
   void handle_open_object_map(int r);
 
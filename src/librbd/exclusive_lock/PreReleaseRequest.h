@@ -40,6 +40,9 @@ private:
    * BLOCK_WRITES
    *    |
    *    v
+   * SHUT_DOWN_IMAGE_CACHE (skip if
+   *    |                   disabled)
+   *    v
    * INVALIDATE_CACHE
    *    |
    *    v
@@ -78,6 +81,9 @@ private:
   void send_block_writes();
   void handle_block_writes(int r);
 
+  void send_shut_down_image_cache();
+  void handle_shut_down_image_cache(int r);
+
   void send_invalidate_cache(bool purge_on_error);
   void handle_invalidate_cache(int r);
 
@@ -400,6 +400,11 @@ void CloneRequest<I>::get_mirror_mode() {
   ldout(m_cct, 20) << this << " " << __func__ << dendl;
 
   if (!m_imctx->test_features(RBD_FEATURE_JOURNALING)) {
+    if (!m_non_primary_global_image_id.empty()) {
+      // non-journaled non-primary images are mirrored using snapshots
+      send_enable_mirror();
+      return;
+    }
     send_close();
     return;
   }
@@ -447,8 +452,10 @@ void CloneRequest<I>::send_enable_mirror() {
   using klass = CloneRequest<I>;
   Context *ctx = create_context_callback<klass, &klass::handle_enable_mirror>(this);
 
+  auto mode = (m_imctx->test_features(RBD_FEATURE_JOURNALING) ?
+    cls::rbd::MIRROR_IMAGE_MODE_JOURNAL : cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT);
   mirror::EnableRequest<I> *req = mirror::EnableRequest<I>::create(
-    m_imctx->md_ctx, m_id, m_non_primary_global_image_id,
+    m_imctx->md_ctx, m_id, mode, m_non_primary_global_image_id,
     m_imctx->op_work_queue, ctx);
   req->send();
 }
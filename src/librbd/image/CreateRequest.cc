@@ -50,8 +50,11 @@ int validate_features(CephContext *cct, uint64_t features,
       lderr(cct) << "cannot use journaling without exclusive lock" << dendl;
       return -EINVAL;
     }
-  } else if (force_non_primary) {
-    assert(false);
+  } else if (force_non_primary &&
+             (features & RBD_FEATURE_EXCLUSIVE_LOCK) == 0) {
+    // non-journaled non-primary images are mirrored using snapshots
+    lderr(cct) << "cannot mirror image without exclusive lock" << dendl;
+    return -EINVAL;
   }
 
   return 0;
@@ -621,7 +624,7 @@ void CreateRequest<I>::handle_object_map_resize(int r) {
 
 template<typename I>
 void CreateRequest<I>::fetch_mirror_mode() {
-  if ((m_features & RBD_FEATURE_JOURNALING) == 0) {
+  if ((m_features & RBD_FEATURE_JOURNALING) == 0 && !m_force_non_primary) {
     complete(0);
     return;
   }
@@ -681,6 +684,11 @@ void CreateRequest<I>::handle_fetch_mirror_mode(int r) {
     return;
   }
 
+  if ((m_features & RBD_FEATURE_JOURNALING) == 0) {
+    mirror_image_enable();
+    return;
+  }
+
   journal_create();
 }
 
@@ -731,7 +739,9 @@ void CreateRequest<I>::mirror_image_enable() {
   ldout(m_cct, 20) << dendl;
   auto ctx = create_context_callback<
     CreateRequest<I>, &CreateRequest<I>::handle_mirror_image_enable>(this);
-  auto req = mirror::EnableRequest<I>::create(m_ioctx, m_image_id,
+  auto mode = ((m_features & RBD_FEATURE_JOURNALING) != 0 ?
+    cls::rbd::MIRROR_IMAGE_MODE_JOURNAL : cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT);
+  auto req = mirror::EnableRequest<I>::create(m_ioctx, m_image_id, mode,
                                               m_non_primary_global_image_id,
                                               m_op_work_queue, ctx);
   req->send();
@@ -1102,6 +1102,8 @@ void RefreshRequest<I>::apply() {
         m_image_ctx.io_work_queue->set_require_lock_on_read();
       }
     }
+
+    m_image_ctx.publish_read_state();
   }
 }
 
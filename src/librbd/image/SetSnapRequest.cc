@@ -343,6 +343,8 @@ int SetSnapRequest<I>::apply() {
     m_refresh_parent->apply();
   }
 
+  m_image_ctx.publish_read_state();
+
   std::swap(m_object_map, m_image_ctx.object_map);
   return 0;
 }
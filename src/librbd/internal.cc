@@ -109,6 +109,27 @@ int validate_pool(IoCtx &io_ctx, CephContext *cct) {
   return 0;
 }
 
+bool copy_object_may_exist(ImageCtx *src, uint64_t offset, uint64_t period) {
+  // a stripe period maps to a single object only without fancy striping
+  if (period != (1ULL << src->order)) {
+    return true;
+  }
+
+  RWLock::RLocker snap_locker(src->snap_lock);
+  RWLock::RLocker parent_locker(src->parent_lock);
+  if (src->object_map == nullptr) {
+    return true;
+  }
+
+  if (src->parent != nullptr) {
+    uint64_t overlap;
+    int r = src->get_parent_overlap(src->snap_id, &overlap);
+    if (r < 0 || offset < overlap) {
+      return true;
+    }
+  }
+  return src->object_map->object_may_exist(offset >> src->order);
+}
 
 } // anonymous namespace
 
@@ -1921,6 +1942,12 @@ int validate_pool(IoCtx &io_ctx, CephContext *cct) {
         return throttle.wait_for_ret();
       }
 
+      if (!copy_object_may_exist(src, offset, period)) {
+	// nothing to read from the object nor from the parent image
+	prog_ctx.update_progress(offset, src_size);
+	continue;
+      }
+
       uint64_t len = min(period, src_size - offset);
       bufferlist *bl = new bufferlist();
       auto ctx = new C_CopyRead(&throttle, dest, offset, bl, sparse_size);
@@ -2336,6 +2363,11 @@ int validate_pool(IoCtx &io_ctx, CephContext *cct) {
     uint64_t readahead_offset = readahead_extent.first;
     uint64_t readahead_length = readahead_extent.second;
 
+    ictx->perfcounter->set(l_librbd_readahead_hit_bytes,
+                           ictx->readahead.get_hit_bytes());
+    ictx->perfcounter->set(l_librbd_readahead_wasted_bytes,
+                           ictx->readahead.get_wasted_bytes());
+
     if (readahead_length > 0) {
       ldout(ictx->cct, 20) << "(readahead logical) " << readahead_offset << "~" << readahead_length << dendl;
       map<object_t,vector<ObjectExtent> > readahead_object_extents;
@@ -47,9 +47,18 @@ enum {
 
   l_librbd_readahead,
   l_librbd_readahead_bytes,
+  l_librbd_readahead_hit_bytes,
+  l_librbd_readahead_wasted_bytes,
 
   l_librbd_invalidate_cache,
 
+  l_librbd_pcache_rd_hit_bytes,
+  l_librbd_pcache_rd_miss_bytes,
+  l_librbd_pcache_log_bytes,
+  l_librbd_pcache_sync,
+  l_librbd_pcache_dirty_bytes,
+  l_librbd_pcache_destage_lag,
+
   l_librbd_last,
 };
 
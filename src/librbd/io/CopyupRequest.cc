@@ -7,6 +7,7 @@
 #include "common/errno.h"
 #include "common/Mutex.h"
 
+#include "cls/rbd/cls_rbd_client.h"
 #include "librbd/AsyncObjectThrottle.h"
 #include "librbd/ExclusiveLock.h"
 #include "librbd/ImageCtx.h"
@@ -31,6 +32,9 @@ namespace io {
 
 namespace {
 
+// granularity of the zeroed extents skipped by sparse copyups
+const uint64_t SPARSE_COPYUP_CHUNK_SIZE = 4096;
+
 class UpdateObjectMap : public C_AsyncObjectThrottle<> {
 public:
   UpdateObjectMap(AsyncObjectThrottle<> &throttle, ImageCtx *image_ctx,
@@ -87,7 +91,7 @@ CopyupRequest::CopyupRequest(ImageCtx *ictx, const std::string &oid,
   : m_ictx(ictx), m_oid(oid), m_object_no(objectno),
     m_image_extents(image_extents),
     m_trace(util::create_trace(*m_ictx, "copy-up", parent_trace)),
-    m_state(STATE_READ_FROM_PARENT)
+    m_state(STATE_READ_FROM_PARENT), m_sparse_copyup(ictx->sparse_copyup)
 {
   m_async_op.start_op(*m_ictx);
 }
@@ -123,6 +127,7 @@ bool CopyupRequest::send_copyup() {
 
   ldout(m_ictx->cct, 20) << "oid " << m_oid << dendl;
   m_state = STATE_COPYUP;
+  m_sparse_copyup_sent = false;
 
   m_ictx->snap_lock.get_read();
   ::SnapContext snapc = m_ictx->snapc;
@@ -139,8 +144,10 @@ bool CopyupRequest::send_copyup() {
     assert(add_copyup_op);
     add_copyup_op = false;
 
+    // CoW write ops are sent separately below, so the copyup can only be
+    // resent if sparse copyup is unsupported when there are no writes
     librados::ObjectWriteOperation copyup_op;
-    copyup_op.exec("rbd", "copyup", m_copyup_data);
+    add_copyup_data_op(&copyup_op, m_sparse_copyup && copy_on_read);
 
     // send only the copyup request with a blank snapshot context so that
     // all snapshots are detected from the parent for this object.  If
@@ -166,7 +173,7 @@ bool CopyupRequest::send_copyup() {
     librados::ObjectWriteOperation write_op;
     if (add_copyup_op) {
       // CoW did not need to handle existing snapshots
-      write_op.exec("rbd", "copyup", m_copyup_data);
+      add_copyup_data_op(&write_op, m_sparse_copyup);
     }
 
     // merge all pending write ops into this single RADOS op
@@ -189,6 +196,42 @@ bool CopyupRequest::send_copyup() {
   return false;
 }
 
+void CopyupRequest::add_copyup_data_op(librados::ObjectWriteOperation *op,
+                                       bool sparse) {
+  if (!sparse) {
+    op->exec("rbd", "copyup", m_copyup_data);
+    return;
+  }
+  m_sparse_copyup_sent = true;
+
+  // avoid allocating the zeroed extents of the parent data in the child
+  std::map<uint64_t, uint64_t> extent_map;
+  bufferlist data;
+  uint64_t length = m_copyup_data.length();
+  for (uint64_t offset = 0; offset < length;
+       offset += SPARSE_COPYUP_CHUNK_SIZE) {
+    uint64_t chunk_length = MIN(SPARSE_COPYUP_CHUNK_SIZE, length - offset);
+    bufferlist chunk;
+    chunk.substr_of(m_copyup_data, offset, chunk_length);
+    if (chunk.is_zero()) {
+      continue;
+    }
+
+    if (!extent_map.empty() &&
+        extent_map.rbegin()->first + extent_map.rbegin()->second == offset) {
+      extent_map.rbegin()->second += chunk_length;
+    } else {
+      extent_map[offset] = chunk_length;
+    }
+    data.claim_append(chunk);
+  }
+
+  ldout(m_ictx->cct, 20) << "sparse copyup " << data.length() << "/" << length
+                         << " bytes in " << extent_map.size() << " extents"
+                         << dendl;
+  cls_client::sparse_copyup(op, extent_map, data);
+}
+
 bool CopyupRequest::is_copyup_required() {
   bool noop = true;
   for (const ObjectRequest<> *req : m_pending_requests) {
@@ -259,7 +302,15 @@ bool CopyupRequest::should_complete(int r)
     pending_copyups = --m_pending_copyups;
     ldout(cct, 20) << "COPYUP (" << pending_copyups << " pending)"
                    << dendl;
-    if (r == -ENOENT) {
+    if (r == -EOPNOTSUPP && m_sparse_copyup_sent) {
+      // the sparse copyup was the only op sent to the object and the
+      // failed op was not applied, so it is safe to resend it
+      ldout(cct, 5) << "sparse copyup not supported by OSD, "
+                    << "retrying with copyup" << dendl;
+      assert(pending_copyups == 0);
+      m_sparse_copyup = false;
+      return send_copyup();
+    } else if (r == -ENOENT) {
       // hide the -ENOENT error if this is the last op
       if (pending_copyups == 0) {
         complete_requests(0);
@@ -68,6 +68,9 @@ private:
    * The _OBJECT_MAP state is skipped if the object map isn't enabled or if
    * an object map update isn't required. The _COPYUP state is skipped if
    * no data was read from the parent *and* there are no additional ops.
+   * Only the non-zero extents of the parent data are copied up if sparse
+   * copyup is enabled. The _COPYUP state is retried with a dense copyup if
+   * the OSD does not support the sparse_copyup method.
    */
   enum State {
     STATE_READ_FROM_PARENT,
@@ -86,6 +89,8 @@ private:
   ceph::bufferlist m_copyup_data;
   std::vector<ObjectRequest<ImageCtx> *> m_pending_requests;
   std::atomic<unsigned> m_pending_copyups { 0 };
+  bool m_sparse_copyup;
+  bool m_sparse_copyup_sent = false;
 
   AsyncOperation m_async_op;
 
@@ -101,6 +106,7 @@ private:
   bool send_object_map_head();
   bool send_object_map();
   bool send_copyup();
+  void add_copyup_data_op(librados::ObjectWriteOperation *op, bool sparse);
   bool is_copyup_required();
 };
 
@@ -106,8 +106,71 @@ private:
   bool m_enqueued;
 };
 
+int clip_read_extents(const ImageReadState &read_state, Extents *extents) {
+  // equivalent of clip_io() against a pinned image read state
+  if (!read_state.snap_exists) {
+    return -ENOENT;
+  }
+
+  for (auto &extent : *extents) {
+    if (extent.second == 0) {
+      continue;
+    }
+    if (extent.first >= read_state.size) {
+      return -EINVAL;
+    }
+    if (extent.first + extent.second > read_state.size) {
+      extent.second = read_state.size - extent.first;
+    }
+  }
+  return 0;
+}
+
 } // anonymous namespace
 
+template <typename I>
+ImageRequest<I>* ImageRequest<I>::create_read_request(
+    I &image_ctx, AioCompletion *aio_comp, Extents &&image_extents,
+    ReadResult &&read_result, int op_flags,
+    const ZTracer::Trace &parent_trace) {
+  return new ImageReadRequest<I>(image_ctx, aio_comp,
+                                 std::move(image_extents),
+                                 std::move(read_result), op_flags,
+                                 parent_trace);
+}
+
+template <typename I>
+ImageRequest<I>* ImageRequest<I>::create_write_request(
+    I &image_ctx, AioCompletion *aio_comp, Extents &&image_extents,
+    bufferlist &&bl, int op_flags, const ZTracer::Trace &parent_trace) {
+  return new ImageWriteRequest<I>(image_ctx, aio_comp,
+                                  std::move(image_extents), std::move(bl),
+                                  op_flags, parent_trace);
+}
+
+template <typename I>
+ImageRequest<I>* ImageRequest<I>::create_discard_request(
+    I &image_ctx, AioCompletion *aio_comp, uint64_t off, uint64_t len,
+    bool skip_partial_discard, const ZTracer::Trace &parent_trace) {
+  return new ImageDiscardRequest<I>(image_ctx, aio_comp, off, len,
+                                    skip_partial_discard, parent_trace);
+}
+
+template <typename I>
+ImageRequest<I>* ImageRequest<I>::create_flush_request(
+    I &image_ctx, AioCompletion *aio_comp,
+    const ZTracer::Trace &parent_trace) {
+  return new ImageFlushRequest<I>(image_ctx, aio_comp, parent_trace);
+}
+
+template <typename I>
+ImageRequest<I>* ImageRequest<I>::create_writesame_request(
+    I &image_ctx, AioCompletion *aio_comp, uint64_t off, uint64_t len,
+    bufferlist &&bl, int op_flags, const ZTracer::Trace &parent_trace) {
+  return new ImageWriteSameRequest<I>(image_ctx, aio_comp, off, len,
+                                      std::move(bl), op_flags, parent_trace);
+}
+
 template <typename I>
 void ImageRequest<I>::aio_read(I *ictx, AioCompletion *c,
                                Extents &&image_extents,
@@ -220,7 +283,15 @@ ImageReadRequest<I>::ImageReadRequest(I &image_ctx, AioCompletion *aio_comp,
 
 template <typename I>
 int ImageReadRequest<I>::clip_request() {
-  int r = ImageRequest<I>::clip_request();
+  I &image_ctx = this->m_image_ctx;
+  image_ctx.read_state.pin(&m_read_state);
+
+  int r;
+  if (m_read_state) {
+    r = clip_read_extents(*m_read_state, &this->m_image_extents);
+  } else {
+    r = ImageRequest<I>::clip_request();
+  }
   if (r < 0) {
     return r;
   }
@@ -249,7 +320,20 @@ void ImageReadRequest<I>::send_request() {
   librados::snap_t snap_id;
   map<object_t,vector<ObjectExtent> > object_extents;
   uint64_t buffer_ofs = 0;
-  {
+  if (m_read_state) {
+    // the pinned state was used to clip the request
+    snap_id = m_read_state->snap_id;
+    for (auto &extent : image_extents) {
+      if (extent.second == 0) {
+        continue;
+      }
+
+      Striper::file_to_extents(cct, m_read_state->format_string.c_str(),
+                               &m_read_state->layout, extent.first,
+                               extent.second, 0, object_extents, buffer_ofs);
+      buffer_ofs += extent.second;
+    }
+  } else {
     // prevent image size from changing between computing clip and recording
     // pending async operation
     RWLock::RLocker snap_locker(image_ctx.snap_lock);
@@ -287,7 +371,7 @@ void ImageReadRequest<I>::send_request() {
       ObjectReadRequest<I> *req = ObjectReadRequest<I>::create(
         &image_ctx, extent.oid.name, extent.objectno, extent.offset,
         extent.length, extent.buffer_extents, snap_id, true, m_op_flags,
-	this->m_trace, req_comp);
+	this->m_trace, req_comp, m_read_state ? &*m_read_state : nullptr);
       req_comp->request = req;
 
       if (image_ctx.object_cacher) {
@@ -303,6 +387,7 @@ void ImageReadRequest<I>::send_request() {
     }
   }
 
+  m_read_state.reset();
   aio_comp->put();
 
   image_ctx.perfcounter->inc(l_librbd_rd);
@@ -313,6 +398,7 @@ template <typename I>
 void ImageReadRequest<I>::send_image_cache_request() {
   I &image_ctx = this->m_image_ctx;
   assert(image_ctx.image_cache != nullptr);
+  m_read_state.reset();
 
   AioCompletion *aio_comp = this->m_aio_comp;
   aio_comp->set_request_count(1);
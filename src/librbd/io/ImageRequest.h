@@ -9,6 +9,7 @@
 #include "common/snap_types.h"
 #include "common/zipkin_trace.h"
 #include "osd/osd_types.h"
+#include "librbd/PublishedState.h"
 #include "librbd/Utils.h"
 #include "librbd/io/Types.h"
 #include <list>
@@ -33,6 +34,31 @@ public:
     m_trace.event("finish");
   }
 
+  static ImageRequest* create_read_request(ImageCtxT &image_ctx,
+                                           AioCompletion *aio_comp,
+                                           Extents &&image_extents,
+                                           ReadResult &&read_result,
+                                           int op_flags,
+                                           const ZTracer::Trace &parent_trace);
+  static ImageRequest* create_write_request(ImageCtxT &image_ctx,
+                                            AioCompletion *aio_comp,
+                                            Extents &&image_extents,
+                                            bufferlist &&bl, int op_flags,
+                                            const ZTracer::Trace &parent_trace);
+  static ImageRequest* create_discard_request(ImageCtxT &image_ctx,
+                                              AioCompletion *aio_comp,
+                                              uint64_t off, uint64_t len,
+                                              bool skip_partial_discard,
+                                              const ZTracer::Trace &parent_trace);
+  static ImageRequest* create_flush_request(ImageCtxT &image_ctx,
+                                            AioCompletion *aio_comp,
+                                            const ZTracer::Trace &parent_trace);
+  static ImageRequest* create_writesame_request(ImageCtxT &image_ctx,
+                                                AioCompletion *aio_comp,
+                                                uint64_t off, uint64_t len,
+                                                bufferlist &&bl, int op_flags,
+                                                const ZTracer::Trace &parent_trace);
+
   static void aio_read(ImageCtxT *ictx, AioCompletion *c,
                        Extents &&image_extents, ReadResult &&read_result,
                        int op_flags, const ZTracer::Trace &parent_trace);
@@ -65,6 +91,10 @@ public:
     return m_trace;
   }
 
+  inline const Extents &get_image_extents() const {
+    return m_image_extents;
+  }
+
 protected:
   typedef std::list<ObjectRequestHandle *> ObjectRequests;
 
@@ -117,6 +147,9 @@ private:
   char *m_buf;
   bufferlist *m_pbl;
   int m_op_flags;
+
+  // pinned while the request is mapped and dispatched to the objects
+  PublishedState<ImageReadState>::Ref m_read_state;
 };
 
 template <typename ImageCtxT = ImageCtx>
@@ -4,6 +4,7 @@
 #include "librbd/io/ImageRequestWQ.h"
 #include "common/errno.h"
 #include "common/zipkin_trace.h"
+#include "librbd/BlockGuard.h"
 #include "librbd/ExclusiveLock.h"
 #include "librbd/ImageCtx.h"
 #include "librbd/ImageState.h"
@@ -21,21 +22,57 @@
 namespace librbd {
 namespace io {
 
-ImageRequestWQ::ImageRequestWQ(ImageCtx *image_ctx, const string &name,
-                               time_t ti, ThreadPool *tp)
-  : ThreadPool::PointerWQ<ImageRequest<> >(name, ti, 0, tp),
+namespace {
+
+template <typename I>
+BlockExtent get_block_extent(const ImageRequest<I> &req) {
+  auto &image_extents = req.get_image_extents();
+  if (image_extents.empty()) {
+    // flushes are ordered against all IO
+    return BlockExtent(0, std::numeric_limits<uint64_t>::max());
+  }
+
+  BlockExtent block_extent(std::numeric_limits<uint64_t>::max(), 0);
+  for (auto &extent : image_extents) {
+    block_extent.block_start = std::min(block_extent.block_start,
+                                        extent.first);
+    block_extent.block_end = std::max(block_extent.block_end,
+                                      extent.first + extent.second);
+  }
+
+  // zero-length extents would never overlap the extent of another request
+  block_extent.block_end = std::max(block_extent.block_end,
+                                    block_extent.block_start + 1);
+  return block_extent;
+}
+
+} // anonymous namespace
+
+template <typename I>
+ImageRequestWQ<I>::ImageRequestWQ(I *image_ctx, const string &name,
+                                  time_t ti, ThreadPool *tp)
+  : ThreadPool::PointerWQ<ImageRequest<I> >(name, ti, 0, tp),
     m_image_ctx(*image_ctx),
     m_lock(util::unique_lock_name("ImageRequestWQ::m_lock", this)),
     m_write_blockers(0), m_in_progress_writes(0), m_queued_reads(0),
-    m_queued_writes(0), m_in_flight_ops(0), m_refresh_in_progress(false),
+    m_queued_writes(0), m_in_flight_ops(0),
+    m_io_guard(new IOGuard(image_ctx->cct)), m_refresh_in_progress(false),
     m_shutdown(false), m_on_shutdown(nullptr) {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 5) << "ictx=" << image_ctx << dendl;
-  tp->add_work_queue(this);
+  this->register_work_queue();
 }
 
-ssize_t ImageRequestWQ::read(uint64_t off, uint64_t len,
-                             ReadResult &&read_result, int op_flags) {
+template <typename I>
+ImageRequestWQ<I>::~ImageRequestWQ() {
+  assert(m_io_cells.empty());
+  assert(m_blocked_ios == 0);
+  delete m_io_guard;
+}
+
+template <typename I>
+ssize_t ImageRequestWQ<I>::read(uint64_t off, uint64_t len,
+                                ReadResult &&read_result, int op_flags) {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 20) << "ictx=" << &m_image_ctx << ", off=" << off << ", "
                  << "len = " << len << dendl;
@@ -46,8 +83,9 @@ ssize_t ImageRequestWQ::read(uint64_t off, uint64_t len,
   return cond.wait();
 }
 
-ssize_t ImageRequestWQ::write(uint64_t off, uint64_t len,
-                              bufferlist &&bl, int op_flags) {
+template <typename I>
+ssize_t ImageRequestWQ<I>::write(uint64_t off, uint64_t len,
+                                 bufferlist &&bl, int op_flags) {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 20) << "ictx=" << &m_image_ctx << ", off=" << off << ", "
                  << "len = " << len << dendl;
@@ -71,7 +109,8 @@ ssize_t ImageRequestWQ::write(uint64_t off, uint64_t len,
   return len;
 }
 
-ssize_t ImageRequestWQ::discard(uint64_t off, uint64_t len, bool skip_partial_discard) {
+template <typename I>
+ssize_t ImageRequestWQ<I>::discard(uint64_t off, uint64_t len, bool skip_partial_discard) {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 20) << "ictx=" << &m_image_ctx << ", off=" << off << ", "
                  << "len = " << len << dendl;
@@ -95,8 +134,9 @@ ssize_t ImageRequestWQ::discard(uint64_t off, uint64_t len, bool skip_partial_di
   return len;
 }
 
-ssize_t ImageRequestWQ::writesame(uint64_t off, uint64_t len, bufferlist &&bl,
-                                  int op_flags) {
+template <typename I>
+ssize_t ImageRequestWQ<I>::writesame(uint64_t off, uint64_t len, bufferlist &&bl,
+                                     int op_flags) {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 20) << "ictx=" << &m_image_ctx << ", off=" << off << ", "
                  << "len = " << len << ", data_len " << bl.length() << dendl;
@@ -120,9 +160,10 @@ ssize_t ImageRequestWQ::writesame(uint64_t off, uint64_t len, bufferlist &&bl,
   return len;
 }
 
-void ImageRequestWQ::aio_read(AioCompletion *c, uint64_t off, uint64_t len,
-                              ReadResult &&read_result, int op_flags,
-                              bool native_async) {
+template <typename I>
+void ImageRequestWQ<I>::aio_read(AioCompletion *c, uint64_t off, uint64_t len,
+                                 ReadResult &&read_result, int op_flags,
+                                 bool native_async) {
   CephContext *cct = m_image_ctx.cct;
   ZTracer::Trace trace;
   if (cct->_conf->rbd_blkin_trace_all) {
@@ -130,7 +171,7 @@ void ImageRequestWQ::aio_read(AioCompletion *c, uint64_t off, uint64_t len,
     trace.event("start");
   }
 
-  c->init_time(&m_image_ctx, AIO_TYPE_READ);
+  c->init_time(util::get_image_ctx(&m_image_ctx), AIO_TYPE_READ);
   ldout(cct, 20) << "ictx=" << &m_image_ctx << ", "
                  << "completion=" << c << ", off=" << off << ", "
                  << "len=" << len << ", " << "flags=" << op_flags << dendl;
@@ -155,20 +196,22 @@ void ImageRequestWQ::aio_read(AioCompletion *c, uint64_t off, uint64_t len,
 
   if (m_image_ctx.non_blocking_aio || writes_blocked() || !writes_empty() ||
       lock_required) {
-    queue(new ImageReadRequest<>(m_image_ctx, c, {{off, len}},
-                                 std::move(read_result), op_flags, trace));
+    queue(ImageRequest<I>::create_read_request(
+            m_image_ctx, c, {{off, len}}, std::move(read_result), op_flags,
+            trace));
   } else {
     c->start_op();
-    ImageRequest<>::aio_read(&m_image_ctx, c, {{off, len}},
-                             std::move(read_result), op_flags, trace);
+    ImageRequest<I>::aio_read(&m_image_ctx, c, {{off, len}},
+                              std::move(read_result), op_flags, trace);
     finish_in_flight_op();
   }
   trace.event("finish");
 }
 
-void ImageRequestWQ::aio_write(AioCompletion *c, uint64_t off, uint64_t len,
-                               bufferlist &&bl, int op_flags,
-                               bool native_async) {
+template <typename I>
+void ImageRequestWQ<I>::aio_write(AioCompletion *c, uint64_t off, uint64_t len,
+                                  bufferlist &&bl, int op_flags,
+                                  bool native_async) {
   CephContext *cct = m_image_ctx.cct;
   ZTracer::Trace trace;
   if (cct->_conf->rbd_blkin_trace_all) {
@@ -176,7 +219,7 @@ void ImageRequestWQ::aio_write(AioCompletion *c, uint64_t off, uint64_t len,
     trace.event("init");
   }
 
-  c->init_time(&m_image_ctx, AIO_TYPE_WRITE);
+  c->init_time(util::get_image_ctx(&m_image_ctx), AIO_TYPE_WRITE);
   ldout(cct, 20) << "ictx=" << &m_image_ctx << ", "
                  << "completion=" << c << ", off=" << off << ", "
                  << "len=" << len << ", flags=" << op_flags << dendl;
@@ -191,20 +234,21 @@ void ImageRequestWQ::aio_write(AioCompletion *c, uint64_t off, uint64_t len,
 
   RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
   if (m_image_ctx.non_blocking_aio || writes_blocked()) {
-    queue(new ImageWriteRequest<>(m_image_ctx, c, {{off, len}},
-                                  std::move(bl), op_flags, trace));
+    queue(ImageRequest<I>::create_write_request(
+            m_image_ctx, c, {{off, len}}, std::move(bl), op_flags, trace));
   } else {
     c->start_op();
-    ImageRequest<>::aio_write(&m_image_ctx, c, {{off, len}},
-                              std::move(bl), op_flags, trace);
+    ImageRequest<I>::aio_write(&m_image_ctx, c, {{off, len}},
+                               std::move(bl), op_flags, trace);
     finish_in_flight_op();
   }
   trace.event("finish");
 }
 
-void ImageRequestWQ::aio_discard(AioCompletion *c, uint64_t off,
-                                 uint64_t len, bool skip_partial_discard,
-                                 bool native_async) {
+template <typename I>
+void ImageRequestWQ<I>::aio_discard(AioCompletion *c, uint64_t off,
+                                    uint64_t len, bool skip_partial_discard,
+                                    bool native_async) {
   CephContext *cct = m_image_ctx.cct;
   ZTracer::Trace trace;
   if (cct->_conf->rbd_blkin_trace_all) {
@@ -212,7 +256,7 @@ void ImageRequestWQ::aio_discard(AioCompletion *c, uint64_t off,
     trace.event("init");
   }
 
-  c->init_time(&m_image_ctx, AIO_TYPE_DISCARD);
+  c->init_time(util::get_image_ctx(&m_image_ctx), AIO_TYPE_DISCARD);
   ldout(cct, 20) << "ictx=" << &m_image_ctx << ", "
                  << "completion=" << c << ", off=" << off << ", len=" << len
                  << dendl;
@@ -227,18 +271,19 @@ void ImageRequestWQ::aio_discard(AioCompletion *c, uint64_t off,
 
   RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
   if (m_image_ctx.non_blocking_aio || writes_blocked()) {
-    queue(new ImageDiscardRequest<>(m_image_ctx, c, off, len,
-				    skip_partial_discard, trace));
+    queue(ImageRequest<I>::create_discard_request(
+            m_image_ctx, c, off, len, skip_partial_discard, trace));
   } else {
     c->start_op();
-    ImageRequest<>::aio_discard(&m_image_ctx, c, off, len,
-				skip_partial_discard, trace);
+    ImageRequest<I>::aio_discard(&m_image_ctx, c, off, len,
+				 skip_partial_discard, trace);
     finish_in_flight_op();
   }
   trace.event("finish");
 }
 
-void ImageRequestWQ::aio_flush(AioCompletion *c, bool native_async) {
+template <typename I>
+void ImageRequestWQ<I>::aio_flush(AioCompletion *c, bool native_async) {
   CephContext *cct = m_image_ctx.cct;
   ZTracer::Trace trace;
   if (cct->_conf->rbd_blkin_trace_all) {
@@ -246,7 +291,7 @@ void ImageRequestWQ::aio_flush(AioCompletion *c, bool native_async) {
     trace.event("init");
   }
 
-  c->init_time(&m_image_ctx, AIO_TYPE_FLUSH);
+  c->init_time(util::get_image_ctx(&m_image_ctx), AIO_TYPE_FLUSH);
   ldout(cct, 20) << "ictx=" << &m_image_ctx << ", "
                  << "completion=" << c << dendl;
 
@@ -260,17 +305,18 @@ void ImageRequestWQ::aio_flush(AioCompletion *c, bool native_async) {
 
   RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
   if (m_image_ctx.non_blocking_aio || writes_blocked() || !writes_empty()) {
-    queue(new ImageFlushRequest<>(m_image_ctx, c, trace));
+    queue(ImageRequest<I>::create_flush_request(m_image_ctx, c, trace));
   } else {
-    ImageRequest<>::aio_flush(&m_image_ctx, c, trace);
+    ImageRequest<I>::aio_flush(&m_image_ctx, c, trace);
     finish_in_flight_op();
   }
   trace.event("finish");
 }
 
-void ImageRequestWQ::aio_writesame(AioCompletion *c, uint64_t off, uint64_t len,
-                                   bufferlist &&bl, int op_flags,
-                                   bool native_async) {
+template <typename I>
+void ImageRequestWQ<I>::aio_writesame(AioCompletion *c, uint64_t off, uint64_t len,
+                                      bufferlist &&bl, int op_flags,
+                                      bool native_async) {
   CephContext *cct = m_image_ctx.cct;
   ZTracer::Trace trace;
   if (cct->_conf->rbd_blkin_trace_all) {
@@ -278,7 +324,7 @@ void ImageRequestWQ::aio_writesame(AioCompletion *c, uint64_t off, uint64_t len,
     trace.event("init");
   }
 
-  c->init_time(&m_image_ctx, AIO_TYPE_WRITESAME);
+  c->init_time(util::get_image_ctx(&m_image_ctx), AIO_TYPE_WRITESAME);
   ldout(cct, 20) << "ictx=" << &m_image_ctx << ", "
                  << "completion=" << c << ", off=" << off << ", "
                  << "len=" << len << ", data_len = " << bl.length() << ", "
@@ -294,18 +340,19 @@ void ImageRequestWQ::aio_writesame(AioCompletion *c, uint64_t off, uint64_t len,
 
   RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
   if (m_image_ctx.non_blocking_aio || writes_blocked()) {
-    queue(new ImageWriteSameRequest<>(m_image_ctx, c, off, len, std::move(bl),
-                                      op_flags, trace));
+    queue(ImageRequest<I>::create_writesame_request(
+            m_image_ctx, c, off, len, std::move(bl), op_flags, trace));
   } else {
     c->start_op();
-    ImageRequest<>::aio_writesame(&m_image_ctx, c, off, len, std::move(bl),
-                                  op_flags, trace);
+    ImageRequest<I>::aio_writesame(&m_image_ctx, c, off, len, std::move(bl),
+                                   op_flags, trace);
     finish_in_flight_op();
   }
   trace.event("finish");
 }
 
-void ImageRequestWQ::shut_down(Context *on_shutdown) {
+template <typename I>
+void ImageRequestWQ<I>::shut_down(Context *on_shutdown) {
   assert(m_image_ctx.owner_lock.is_locked());
 
   {
@@ -326,19 +373,22 @@ void ImageRequestWQ::shut_down(Context *on_shutdown) {
   m_image_ctx.flush(on_shutdown);
 }
 
-bool ImageRequestWQ::is_lock_request_needed() const {
+template <typename I>
+bool ImageRequestWQ<I>::is_lock_request_needed() const {
   RWLock::RLocker locker(m_lock);
   return (m_queued_writes > 0 ||
           (m_require_lock_on_read && m_queued_reads > 0));
 }
 
-int ImageRequestWQ::block_writes() {
+template <typename I>
+int ImageRequestWQ<I>::block_writes() {
   C_SaferCond cond_ctx;
   block_writes(&cond_ctx);
   return cond_ctx.wait();
 }
 
-void ImageRequestWQ::block_writes(Context *on_blocked) {
+template <typename I>
+void ImageRequestWQ<I>::block_writes(Context *on_blocked) {
   assert(m_image_ctx.owner_lock.is_locked());
   CephContext *cct = m_image_ctx.cct;
 
@@ -357,7 +407,8 @@ void ImageRequestWQ::block_writes(Context *on_blocked) {
   m_image_ctx.flush(on_blocked);
 }
 
-void ImageRequestWQ::unblock_writes() {
+template <typename I>
+void ImageRequestWQ<I>::unblock_writes() {
   CephContext *cct = m_image_ctx.cct;
 
   bool wake_up = false;
@@ -374,11 +425,12 @@ void ImageRequestWQ::unblock_writes() {
   }
 
   if (wake_up) {
-    signal();
+    this->signal();
   }
 }
 
-void ImageRequestWQ::set_require_lock_on_read() {
+template <typename I>
+void ImageRequestWQ<I>::set_require_lock_on_read() {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 20) << dendl;
 
@@ -386,7 +438,8 @@ void ImageRequestWQ::set_require_lock_on_read() {
   m_require_lock_on_read = true;
 }
 
-void ImageRequestWQ::clear_require_lock_on_read() {
+template <typename I>
+void ImageRequestWQ<I>::clear_require_lock_on_read() {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 20) << dendl;
 
@@ -398,14 +451,16 @@ void ImageRequestWQ::clear_require_lock_on_read() {
 
     m_require_lock_on_read = false;
   }
-  signal();
+  this->signal();
 }
 
-void *ImageRequestWQ::_void_dequeue() {
-  ImageRequest<> *peek_item = front();
+template <typename I>
+void *ImageRequestWQ<I>::_void_dequeue() {
+  ImageRequest<I> *peek_item = this->front();
 
-  // no IO ops available or refresh in-progress (IO stalled)
-  if (peek_item == nullptr || m_refresh_in_progress) {
+  // no IO ops available, refresh in-progress or an earlier op detained
+  // behind an overlapping op (IO stalled)
+  if (peek_item == nullptr || m_refresh_in_progress || m_blocked_ios > 0) {
     return nullptr;
   }
 
@@ -426,8 +481,8 @@ void *ImageRequestWQ::_void_dequeue() {
     }
   }
 
-  ImageRequest<> *item = reinterpret_cast<ImageRequest<> *>(
-    ThreadPool::PointerWQ<ImageRequest<> >::_void_dequeue());
+  ImageRequest<I> *item = reinterpret_cast<ImageRequest<I> *>(
+    ThreadPool::PointerWQ<ImageRequest<I> >::_void_dequeue());
   assert(peek_item == item);
 
   if (refresh_required) {
@@ -437,33 +492,110 @@ void *ImageRequestWQ::_void_dequeue() {
     // stall IO until the refresh completes
     m_refresh_in_progress = true;
 
-    get_pool_lock().Unlock();
+    this->get_pool_lock().Unlock();
     m_image_ctx.state->refresh(new C_RefreshFinish(this, item));
-    get_pool_lock().Lock();
+    this->get_pool_lock().Lock();
     return nullptr;
   }
 
   item->start_op();
+
+  // count the op as blocked before detaining it since the overlapping op
+  // might be concurrently released by another thread
+  m_blocked_ios++;
+
+  BlockGuardCell *cell;
+  int r = detain_request(item, &cell);
+  if (r > 0) {
+    // the op will be dispatched when the overlapping op is released
+    ldout(m_image_ctx.cct, 20) << "delaying overlapping IO " << item << dendl;
+    return nullptr;
+  }
+  m_blocked_ios--;
+
+  RWLock::WLocker locker(m_lock);
+  m_io_cells[item] = cell;
   return item;
 }
 
-void ImageRequestWQ::process(ImageRequest<> *req) {
+template <typename I>
+void ImageRequestWQ<I>::process(ImageRequest<I> *req) {
+  BlockGuardCell *cell;
+  {
+    RWLock::WLocker locker(m_lock);
+    auto it = m_io_cells.find(req);
+    assert(it != m_io_cells.end());
+    cell = it->second;
+    m_io_cells.erase(it);
+  }
+
+  process_request(req, cell);
+}
+
+template <typename I>
+int ImageRequestWQ<I>::detain_request(ImageRequest<I> *req,
+                                      BlockGuardCell **cell) {
+  int r = m_io_guard->detain(get_block_extent(*req), &req, cell);
+  assert(r >= 0);
+  return r;
+}
+
+template <typename I>
+void ImageRequestWQ<I>::process_request(ImageRequest<I> *req,
+                                        BlockGuardCell *cell) {
   CephContext *cct = m_image_ctx.cct;
-  ldout(cct, 20) << "ictx=" << &m_image_ctx << ", "
-                 << "req=" << req << dendl;
+  bool dequeued = true;
+  bool resume_dequeue = false;
+
+  std::list<std::pair<ImageRequest<I> *, BlockGuardCell *> > reqs;
+  reqs.emplace_back(req, cell);
+  while (!reqs.empty()) {
+    req = reqs.front().first;
+    cell = reqs.front().second;
+    reqs.pop_front();
+
+    ldout(cct, 20) << "ictx=" << &m_image_ctx << ", "
+                   << "req=" << req << dendl;
+
+    req->send();
+
+    // dispatch any ops that were waiting for this op -- in their original
+    // order, since the remaining ops might still overlap one another
+    typename IOGuard::BlockOperations detained_reqs;
+    m_io_guard->release(cell, &detained_reqs);
+    for (auto detained : detained_reqs) {
+      BlockGuardCell *detained_cell;
+      if (detain_request(detained, &detained_cell) == 0) {
+        reqs.emplace_back(detained, detained_cell);
+        assert(m_blocked_ios > 0);
+        if (--m_blocked_ios == 0) {
+          resume_dequeue = true;
+        }
+      }
+    }
+
+    finish_queued_op(req);
+    if (req->is_write_op()) {
+      finish_in_progress_write();
+    }
+    delete req;
 
-  req->send();
+    if (!dequeued) {
+      // detained ops were dequeued without being processed by the pool
+      this->process_finish();
+    }
+    dequeued = false;
 
-  finish_queued_op(req);
-  if (req->is_write_op()) {
-    finish_in_progress_write();
+    finish_in_flight_op();
   }
-  delete req;
 
-  finish_in_flight_op();
+  if (resume_dequeue) {
+    this->signal_all();
+  }
 }
 
-void ImageRequestWQ::finish_queued_op(ImageRequest<> *req) {
+template <typename I>
+void ImageRequestWQ<I>::finish_queued_op(ImageRequest<I> *req) {
   RWLock::RLocker locker(m_lock);
   if (req->is_write_op()) {
     assert(m_queued_writes > 0);
@@ -474,7 +606,8 @@ void ImageRequestWQ::finish_queued_op(ImageRequest<> *req) {
   }
 }
 
-void ImageRequestWQ::finish_in_progress_write() {
+template <typename I>
+void ImageRequestWQ<I>::finish_in_progress_write() {
   bool writes_blocked = false;
   {
     RWLock::RLocker locker(m_lock);
@@ -490,7 +623,8 @@ void ImageRequestWQ::finish_in_progress_write() {
   }
 }
 
-int ImageRequestWQ::start_in_flight_op(AioCompletion *c) {
+template <typename I>
+int ImageRequestWQ<I>::start_in_flight_op(AioCompletion *c) {
   RWLock::RLocker locker(m_lock);
 
   if (m_shutdown) {
@@ -505,7 +639,8 @@ int ImageRequestWQ::start_in_flight_op(AioCompletion *c) {
   return true;
 }
 
-void ImageRequestWQ::finish_in_flight_op() {
+template <typename I>
+void ImageRequestWQ<I>::finish_in_flight_op() {
   Context *on_shutdown;
   {
     RWLock::RLocker locker(m_lock);
@@ -522,7 +657,8 @@ void ImageRequestWQ::finish_in_flight_op() {
   m_image_ctx.flush(on_shutdown);
 }
 
-bool ImageRequestWQ::is_lock_required() const {
+template <typename I>
+bool ImageRequestWQ<I>::is_lock_required() const {
   assert(m_image_ctx.owner_lock.is_locked());
   if (m_image_ctx.exclusive_lock == NULL) {
     return false;
@@ -531,7 +667,8 @@ bool ImageRequestWQ::is_lock_required() const {
   return (!m_image_ctx.exclusive_lock->is_lock_owner());
 }
 
-void ImageRequestWQ::queue(ImageRequest<> *req) {
+template <typename I>
+void ImageRequestWQ<I>::queue(ImageRequest<I> *req) {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 20) << "ictx=" << &m_image_ctx << ", "
                  << "req=" << req << dendl;
@@ -556,19 +693,20 @@ void ImageRequestWQ::queue(ImageRequest<> *req) {
     m_queued_reads++;
   }
 
-  ThreadPool::PointerWQ<ImageRequest<> >::queue(req);
+  ThreadPool::PointerWQ<ImageRequest<I> >::queue(req);
 
   if (lock_required) {
     m_image_ctx.exclusive_lock->acquire_lock(nullptr);
   }
 }
 
-void ImageRequestWQ::handle_refreshed(int r, ImageRequest<> *req) {
+template <typename I>
+void ImageRequestWQ<I>::handle_refreshed(int r, ImageRequest<I> *req) {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 15) << "resuming IO after image refresh: r=" << r << ", "
                  << "req=" << req << dendl;
   if (r < 0) {
-    process_finish();
+    this->process_finish();
     req->fail(r);
     finish_queued_op(req);
     delete req;
@@ -576,11 +714,14 @@ void ImageRequestWQ::handle_refreshed(int r, ImageRequest<> *req) {
   } else {
     // since IO was stalled for refresh -- original IO order is preserved
     // if we requeue this op for work queue processing
-    requeue(req);
+    this->requeue(req);
   }
 
-  m_refresh_in_progress = false;
-  signal();
+  {
+    Mutex::Locker pool_locker(this->get_pool_lock());
+    m_refresh_in_progress = false;
+  }
+  this->signal();
 
   // refresh might have enabled exclusive lock -- IO stalled until
   // we acquire the lock
@@ -590,7 +731,8 @@ void ImageRequestWQ::handle_refreshed(int r, ImageRequest<> *req) {
   }
 }
 
-void ImageRequestWQ::handle_blocked_writes(int r) {
+template <typename I>
+void ImageRequestWQ<I>::handle_blocked_writes(int r) {
   Contexts contexts;
   {
     RWLock::WLocker locker(m_lock);
@@ -604,3 +746,5 @@ void ImageRequestWQ::handle_blocked_writes(int r) {
 
 } // namespace io
 } // namespace librbd
+
+template class librbd::io::ImageRequestWQ<librbd::ImageCtx>;
@@ -98,7 +98,8 @@ ObjectRequest<I>::ObjectRequest(ImageCtx *ictx, const std::string &oid,
                                 uint64_t len, librados::snap_t snap_id,
                                 bool hide_enoent, const char *trace_name,
 				const ZTracer::Trace &trace,
-				Context *completion)
+				Context *completion,
+				const ImageReadState *read_state)
   : m_ictx(ictx), m_oid(oid), m_object_no(objectno), m_object_off(off),
     m_object_len(len), m_snap_id(snap_id), m_completion(completion),
     m_hide_enoent(hide_enoent),
@@ -111,6 +112,12 @@ ObjectRequest<I>::ObjectRequest(ImageCtx *ictx, const std::string &oid,
   Striper::extent_to_file(m_ictx->cct, &m_ictx->layout, m_object_no,
                           0, m_ictx->layout.object_size, m_parent_extents);
 
+  if (read_state != nullptr) {
+    compute_parent_extents(read_state->parent_overlap_r,
+                           read_state->parent_overlap);
+    return;
+  }
+
   RWLock::RLocker snap_locker(m_ictx->snap_lock);
   RWLock::RLocker parent_locker(m_ictx->parent_lock);
   compute_parent_extents();
@@ -136,6 +143,11 @@ bool ObjectRequest<I>::compute_parent_extents() {
 
   uint64_t parent_overlap;
   int r = m_ictx->get_parent_overlap(m_snap_id, &parent_overlap);
+  return compute_parent_extents(r, parent_overlap);
+}
+
+template <typename I>
+bool ObjectRequest<I>::compute_parent_extents(int r, uint64_t parent_overlap) {
   if (r < 0) {
     // NOTE: it's possible for a snapshot to be deleted while we are
     // still reading from it
@@ -175,21 +187,24 @@ ObjectReadRequest<I>::ObjectReadRequest(I *ictx, const std::string &oid,
                                         librados::snap_t snap_id, bool sparse,
 					int op_flags,
 					const ZTracer::Trace &parent_trace,
-                                        Context *completion)
+                                        Context *completion,
+                                        const ImageReadState *read_state)
   : ObjectRequest<I>(util::get_image_ctx(ictx), oid, objectno, offset, len,
-                     snap_id, false, "read", parent_trace, completion),
+                     snap_id, false, "read", parent_trace, completion,
+                     read_state),
     m_buffer_extents(be), m_tried_parent(false), m_sparse(sparse),
     m_op_flags(op_flags), m_state(LIBRBD_AIO_READ_FLAT) {
+  if (read_state != nullptr) {
+    m_object_map_enabled = read_state->object_map;
+  }
   guard_read();
 }
 
 template <typename I>
 void ObjectReadRequest<I>::guard_read()
 {
+  // the parent extents were computed when the request was constructed
   ImageCtx *image_ctx = this->m_ictx;
-  RWLock::RLocker snap_locker(image_ctx->snap_lock);
-  RWLock::RLocker parent_locker(image_ctx->parent_lock);
-
   if (this->has_parent()) {
     ldout(image_ctx->cct, 20) << "guarding read" << dendl;
     m_state = LIBRBD_AIO_READ_GUARD;
@@ -281,7 +296,7 @@ void ObjectReadRequest<I>::send() {
                             << "~" << this->m_object_len
                             << dendl;
 
-  {
+  if (m_object_map_enabled) {
     RWLock::RLocker snap_locker(image_ctx->snap_lock);
 
     // send read request to parent if the object doesn't exist locally
@@ -10,6 +10,7 @@
 #include "common/snap_types.h"
 #include "common/zipkin_trace.h"
 #include "librbd/ObjectMap.h"
+#include "librbd/io/Types.h"
 #include <map>
 
 class Context;
@@ -86,7 +87,8 @@ public:
                 uint64_t objectno, uint64_t off, uint64_t len,
                 librados::snap_t snap_id, bool hide_enoent,
 		const char *trace_name, const ZTracer::Trace &parent_trace,
-		Context *completion);
+		Context *completion,
+		const ImageReadState *read_state = nullptr);
   ~ObjectRequest() override {
     m_trace.event("finish");
   }
@@ -113,6 +115,7 @@ public:
 
 protected:
   bool compute_parent_extents();
+  bool compute_parent_extents(int r, uint64_t parent_overlap);
 
   ImageCtx *m_ictx;
   std::string m_oid;
@@ -139,17 +142,23 @@ public:
                                    librados::snap_t snap_id, bool sparse,
 				   int op_flags,
 				   const ZTracer::Trace &parent_trace,
-                                   Context *completion) {
+                                   Context *completion,
+                                   const ImageReadState *read_state = nullptr) {
     return new ObjectReadRequest(ictx, oid, objectno, offset, len,
                                  buffer_extents, snap_id, sparse, op_flags,
-				 parent_trace, completion);
+				 parent_trace, completion, read_state);
   }
 
+  /**
+   * If the image read state is provided, the request is initialized from
+   * it instead of the image context (without acquiring the image locks).
+   */
   ObjectReadRequest(ImageCtxT *ictx, const std::string &oid,
                     uint64_t objectno, uint64_t offset, uint64_t len,
                     Extents& buffer_extents, librados::snap_t snap_id,
                     bool sparse, int op_flags,
-		    const ZTracer::Trace &parent_trace, Context *completion);
+		    const ZTracer::Trace &parent_trace, Context *completion,
+		    const ImageReadState *read_state = nullptr);
 
   bool should_complete(int r) override;
   void send() override;
@@ -184,6 +193,7 @@ private:
   bool m_tried_parent;
   bool m_sparse;
   int m_op_flags;
+  bool m_object_map_enabled = true;
   ceph::bufferlist m_read_data;
   ExtentMap m_ext_map;
 
@@ -5,7 +5,9 @@
 #define CEPH_LIBRBD_IO_TYPES_H
 
 #include "include/int_types.h"
+#include "include/fs_types.h"
 #include <map>
+#include <string>
 #include <vector>
 
 namespace librbd {
@@ -26,6 +28,25 @@ typedef enum {
 typedef std::vector<std::pair<uint64_t, uint64_t> > Extents;
 typedef std::map<uint64_t, uint64_t> ExtentMap;
 
+/**
+ * Immutable copy of the image state needed to dispatch a read, published
+ * whenever the snapshot, size, layout, features or parent of the image
+ * change so that reads can be mapped without acquiring the image locks.
+ */
+struct ImageReadState {
+  uint64_t snap_id = 0;
+  bool snap_exists = false;
+  uint64_t size = 0;
+
+  std::string format_string;
+  file_layout_t layout;
+
+  bool object_map = false;     ///< object map feature enabled
+
+  int parent_overlap_r = 0;    ///< result of ImageCtx::get_parent_overlap
+  uint64_t parent_overlap = 0;
+};
+
 } // namespace io
 } // namespace librbd
 
@@ -9,8 +9,10 @@
 #include "librbd/ImageCtx.h"
 #include "librbd/ImageState.h"
 #include "librbd/Journal.h"
+#include "librbd/Operations.h"
 #include "librbd/Utils.h"
 #include "librbd/mirror/GetInfoRequest.h"
+#include "librbd/mirror/SnapshotUtils.h"
 
 #define dout_subsys ceph_subsys_rbd
 #undef dout_prefix
@@ -124,6 +126,16 @@ void DemoteRequest<I>::demote() {
 
   auto ctx = create_context_callback<
     DemoteRequest<I>, &DemoteRequest<I>::handle_demote>(this);
+  if (m_mirror_image.mode == cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT) {
+    // record the demotion point so that peers can sync up to it
+    std::string snap_name = snapshot::get_snap_name(
+      snapshot::STATE_DEMOTED, "", snapshot::generate_snap_uuid());
+    RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+    m_image_ctx.operations->execute_snap_create(
+      cls::rbd::UserSnapshotNamespace(), snap_name, ctx, 0, false);
+    return;
+  }
+
   Journal<I>::demote(&m_image_ctx, ctx);
 }
 
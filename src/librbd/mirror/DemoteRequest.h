@@ -42,7 +42,8 @@ private:
    *    |               *
    *    v               *
    * DEMOTE             *
-   *    |               *
+   *    | (journal tag  *
+   *    |  or snapshot) *
    *    v               *
    * RELEASE_LOCK       *
    *    |               *
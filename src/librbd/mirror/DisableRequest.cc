@@ -14,6 +14,7 @@
 #include "librbd/Operations.h"
 #include "librbd/Utils.h"
 #include "librbd/journal/PromoteRequest.h"
+#include "librbd/mirror/SnapshotUtils.h"
 
 #define dout_subsys ceph_subsys_rbd
 #undef dout_prefix
@@ -78,6 +79,15 @@ Context *DisableRequest<I>::handle_get_mirror_image(int *result) {
     return m_on_finish;
   }
 
+  if (m_mirror_image.mode == cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT) {
+    {
+      RWLock::RLocker snap_locker(m_image_ctx->snap_lock);
+      m_is_primary = (snapshot::get_promotion_state(m_image_ctx) ==
+                        PROMOTION_STATE_PRIMARY);
+    }
+    return handle_get_tag_owner(result);
+  }
+
   send_get_tag_owner();
   return nullptr;
 }
@@ -175,13 +185,22 @@ Context *DisableRequest<I>::handle_notify_mirroring_watcher(int *result) {
     *result = 0;
   }
 
+  if (m_mirror_image.mode == cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT &&
+      !m_remove) {
+    return m_on_finish;
+  }
+
   send_promote_image();
   return nullptr;
 }
 
 template <typename I>
 void DisableRequest<I>::send_promote_image() {
-  if (m_is_primary) {
+  if (m_mirror_image.mode == cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT) {
+    // no journal to promote or peer clients to unregister
+    send_remove_mirror_image();
+    return;
+  } else if (m_is_primary) {
     send_get_clients();
     return;
   }
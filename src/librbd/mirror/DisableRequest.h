@@ -42,7 +42,7 @@ private:
    * GET_MIRROR_IMAGE * * * * * * * * * * * * * * * * * * * * * * *
    *    |                                                         *
    *    v                                                         *
-   * GET_TAG_OWNER  * * * * * * * * * * * * * * * * * * * * * * * *
+   * GET_TAG_OWNER (skip if snapshot mode)  * * * * * * * * * * * *
    *    |                                                         *
    *    v                                                         *
    * SET_MIRROR_IMAGE * * * * * * * * * * * * * * * * * * * * * * *
@@ -52,7 +52,7 @@ private:
    *    |                                                         *
    *    v                                                         *
    * PROMOTE_IMAGE (skip if primary)                              *
-   *    |                                                         *
+   *    |     (snapshot mode skips to REMOVE_MIRROR_IMAGE)        *
    *    v                                                         *
    * GET_CLIENTS <----------------------------------------\ * * * *
    *    |     | (unregister clients)                      |       *  (on error)
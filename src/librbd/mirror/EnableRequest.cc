@@ -23,9 +23,10 @@ using util::create_rados_callback;
 template <typename I>
 EnableRequest<I>::EnableRequest(librados::IoCtx &io_ctx,
                                 const std::string &image_id,
+                                cls::rbd::MirrorImageMode mode,
                                 const std::string &non_primary_global_image_id,
                                 ContextWQ *op_work_queue, Context *on_finish)
-  : m_io_ctx(io_ctx), m_image_id(image_id),
+  : m_io_ctx(io_ctx), m_image_id(image_id), m_mode(mode),
     m_non_primary_global_image_id(non_primary_global_image_id),
     m_op_work_queue(op_work_queue), m_on_finish(on_finish),
     m_cct(reinterpret_cast<CephContext*>(io_ctx.cct())) {
@@ -38,7 +39,9 @@ void EnableRequest<I>::send() {
 
 template <typename I>
 void EnableRequest<I>::send_get_tag_owner() {
-  if (!m_non_primary_global_image_id.empty()) {
+  if (!m_non_primary_global_image_id.empty() ||
+      m_mode == cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT) {
+    // snapshot mode images track their promotion state within snapshots
     return
     send_get_mirror_image();
   }
@@ -97,7 +100,12 @@ Context *EnableRequest<I>::handle_get_mirror_image(int *result) {
   }
 
   if (*result == 0) {
-    if (m_mirror_image.state == cls::rbd::MIRROR_IMAGE_STATE_ENABLED) {
+    if (m_mirror_image.state == cls::rbd::MIRROR_IMAGE_STATE_ENABLED &&
+        m_mirror_image.mode != m_mode) {
+      lderr(m_cct) << "mirroring is already enabled in " << m_mirror_image.mode
+                   << " mode" << dendl;
+      *result = -EINVAL;
+    } else if (m_mirror_image.state == cls::rbd::MIRROR_IMAGE_STATE_ENABLED) {
       ldout(m_cct, 10) << this << " " << __func__
                        << ": mirroring is already enabled" << dendl;
     } else {
@@ -115,6 +123,7 @@ Context *EnableRequest<I>::handle_get_mirror_image(int *result) {
 
   *result = 0;
   m_mirror_image.state = cls::rbd::MIRROR_IMAGE_STATE_ENABLED;
+  m_mirror_image.mode = m_mode;
   if (m_non_primary_global_image_id.empty()) {
     uuid_d uuid_gen;
     uuid_gen.generate_random();
@@ -24,15 +24,18 @@ template <typename ImageCtxT = ImageCtx>
 class EnableRequest {
 public:
   static EnableRequest *create(ImageCtxT *image_ctx, Context *on_finish) {
-    return create(image_ctx->md_ctx, image_ctx->id, "",
+    return create(image_ctx->md_ctx, image_ctx->id,
+                  cls::rbd::MIRROR_IMAGE_MODE_JOURNAL, "",
                   image_ctx->op_work_queue, on_finish);
   }
   static EnableRequest *create(librados::IoCtx &io_ctx,
                                const std::string &image_id,
+                               cls::rbd::MirrorImageMode mode,
                                const std::string &non_primary_global_image_id,
                                ContextWQ *op_work_queue, Context *on_finish) {
-    return new EnableRequest(io_ctx, image_id, non_primary_global_image_id,
-                             op_work_queue, on_finish);
+    return new EnableRequest(io_ctx, image_id, mode,
+                             non_primary_global_image_id, op_work_queue,
+                             on_finish);
   }
 
   void send();
@@ -48,7 +51,7 @@ private:
    *    |                         *
    *    v                         *
    * GET_TAG_OWNER  * * * * * * * *
-   *    |                         *
+   *    |   (journal mode only)   *
    *    v                         *
    * GET_MIRROR_IMAGE * * * * * * *
    *    |                         * (on error)
@@ -65,11 +68,13 @@ private:
    */
 
   EnableRequest(librados::IoCtx &io_ctx, const std::string &image_id,
+                cls::rbd::MirrorImageMode mode,
                 const std::string &non_primary_global_image_id,
                 ContextWQ *op_work_queue, Context *on_finish);
 
   librados::IoCtx &m_io_ctx;
   std::string m_image_id;
+  cls::rbd::MirrorImageMode m_mode;
   std::string m_non_primary_global_image_id;
   ContextWQ *m_op_work_queue;
   Context *m_on_finish;
@@ -9,6 +9,7 @@
 #include "librbd/ImageState.h"
 #include "librbd/Journal.h"
 #include "librbd/Utils.h"
+#include "librbd/mirror/SnapshotUtils.h"
 
 #define dout_subsys ceph_subsys_rbd
 #undef dout_prefix
@@ -94,6 +95,13 @@ void GetInfoRequest<I>::handle_get_mirror_image(int r) {
     return;
   }
 
+  if (m_mirror_image->mode == cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT) {
+    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+    *m_promotion_state = snapshot::get_promotion_state(&m_image_ctx);
+    finish(0);
+    return;
+  }
+
   get_tag_owner();
 }
 
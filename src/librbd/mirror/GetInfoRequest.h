@@ -49,7 +49,7 @@ private:
    * GET_MIRROR_IMAGE
    *    |
    *    v
-   * GET_TAG_OWNER
+   * GET_TAG_OWNER (skip if snapshot mode)
    *    |
    *    v
    * <finish>
@@ -5,11 +5,14 @@
 #include "common/dout.h"
 #include "common/errno.h"
 #include "cls/rbd/cls_rbd_client.h"
+#include "librbd/ExclusiveLock.h"
 #include "librbd/ImageCtx.h"
 #include "librbd/ImageState.h"
 #include "librbd/Journal.h"
+#include "librbd/Operations.h"
 #include "librbd/Utils.h"
 #include "librbd/mirror/GetInfoRequest.h"
+#include "librbd/mirror/SnapshotUtils.h"
 
 #define dout_subsys ceph_subsys_rbd
 #undef dout_prefix
@@ -62,6 +65,11 @@ void PromoteRequest<I>::handle_get_info(int r) {
     return;
   }
 
+  if (m_mirror_image.mode == cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT) {
+    acquire_lock();
+    return;
+  }
+
   promote();
 }
 
@@ -88,8 +96,146 @@ void PromoteRequest<I>::handle_promote(int r) {
   finish(r);
 }
 
+template <typename I>
+void PromoteRequest<I>::acquire_lock() {
+  CephContext *cct = m_image_ctx.cct;
+
+  m_image_ctx.owner_lock.get_read();
+  if (m_image_ctx.exclusive_lock == nullptr) {
+    m_image_ctx.owner_lock.put_read();
+    lderr(cct) << "exclusive lock is not active" << dendl;
+    finish(-EINVAL);
+    return;
+  }
+
+  // the image must not be updated by peers between the rollback
+  // and the creation of the primary mirror snapshot
+  m_image_ctx.exclusive_lock->block_requests(0);
+  m_blocked_requests = true;
+
+  if (m_image_ctx.exclusive_lock->is_lock_owner()) {
+    m_image_ctx.owner_lock.put_read();
+    rollback();
+    return;
+  }
+
+  ldout(cct, 20) << dendl;
+
+  auto ctx = create_context_callback<
+    PromoteRequest<I>, &PromoteRequest<I>::handle_acquire_lock>(this);
+  m_image_ctx.exclusive_lock->acquire_lock(ctx);
+  m_image_ctx.owner_lock.put_read();
+}
+
+template <typename I>
+void PromoteRequest<I>::handle_acquire_lock(int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "r=" << r << dendl;
+
+  if (r < 0) {
+    lderr(cct) << "failed to lock image: " << cpp_strerror(r) << dendl;
+    finish(r);
+    return;
+  }
+
+  m_image_ctx.owner_lock.get_read();
+  if (m_image_ctx.exclusive_lock == nullptr ||
+      !m_image_ctx.exclusive_lock->is_lock_owner()) {
+    m_image_ctx.owner_lock.put_read();
+    lderr(cct) << "failed to acquire exclusive lock" << dendl;
+    finish(-EROFS);
+    return;
+  }
+  m_image_ctx.owner_lock.put_read();
+
+  rollback();
+}
+
+template <typename I>
+void PromoteRequest<I>::rollback() {
+  CephContext *cct = m_image_ctx.cct;
+
+  snapshot::MirrorSnapshots mirror_snaps;
+  {
+    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+    snapshot::list_snaps(&m_image_ctx, &mirror_snaps);
+  }
+
+  if (mirror_snaps.empty()) {
+    lderr(cct) << "image has not completed its initial sync" << dendl;
+    finish(-EINVAL);
+    return;
+  } else if (mirror_snaps.back().state != snapshot::STATE_NON_PRIMARY) {
+    // a synced demotion is the last update rbd-mirror applies to
+    // the image
+    create_snapshot();
+    return;
+  }
+
+  // rbd-mirror writes the changes of the next mirror snapshot to the
+  // image before recording it: only the content of the last synced
+  // mirror snapshot is consistent
+  auto &snap_name = mirror_snaps.back().snap_name;
+  ldout(cct, 20) << "snap_name=" << snap_name << dendl;
+
+  auto ctx = create_context_callback<
+    PromoteRequest<I>, &PromoteRequest<I>::handle_rollback>(this);
+  RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+  m_image_ctx.operations->execute_snap_rollback(
+    cls::rbd::UserSnapshotNamespace(), snap_name, m_prog_ctx, ctx);
+}
+
+template <typename I>
+void PromoteRequest<I>::handle_rollback(int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "r=" << r << dendl;
+
+  if (r < 0) {
+    lderr(cct) << "failed to roll back to the last synced mirror snapshot: "
+               << cpp_strerror(r) << dendl;
+    finish(r);
+    return;
+  }
+
+  create_snapshot();
+}
+
+template <typename I>
+void PromoteRequest<I>::create_snapshot() {
+  CephContext *cct = m_image_ctx.cct;
+  m_snap_name = snapshot::get_snap_name(snapshot::STATE_PRIMARY, "",
+                                        snapshot::generate_snap_uuid());
+  ldout(cct, 20) << "snap_name=" << m_snap_name << dendl;
+
+  auto ctx = create_context_callback<
+    PromoteRequest<I>, &PromoteRequest<I>::handle_create_snapshot>(this);
+  RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+  m_image_ctx.operations->execute_snap_create(
+    cls::rbd::UserSnapshotNamespace(), m_snap_name, ctx, 0, false);
+}
+
+template <typename I>
+void PromoteRequest<I>::handle_create_snapshot(int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "r=" << r << dendl;
+
+  if (r < 0) {
+    lderr(cct) << "failed to create primary mirror snapshot: "
+               << cpp_strerror(r) << dendl;
+  }
+
+  finish(r);
+}
+
 template <typename I>
 void PromoteRequest<I>::finish(int r) {
+  {
+    RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+    if (m_blocked_requests && m_image_ctx.exclusive_lock != nullptr) {
+      m_image_ctx.exclusive_lock->unblock_requests();
+    }
+  }
+
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 20) << "r=" << r << dendl;
 
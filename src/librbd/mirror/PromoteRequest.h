@@ -5,7 +5,9 @@
 #define CEPH_LIBRBD_MIRROR_PROMOTE_REQUEST_H
 
 #include "cls/rbd/cls_rbd_types.h"
+#include "librbd/internal.h"
 #include "librbd/mirror/Types.h"
+#include <string>
 
 struct Context;
 
@@ -41,11 +43,21 @@ private:
    *    v
    * GET_TAG_OWNER
    *    |
-   *    v
-   * PROMOTE
-   *    |
-   *    v
-   * <finish>
+   *    | (journal mode)
+   *    |\--------------------> PROMOTE
+   *    |                          |
+   *    v (snapshot mode)          |
+   * ACQUIRE_LOCK * * * * * *      |
+   *    |                   *      |
+   *    v                   *      |
+   * ROLLBACK (skip if last *      |
+   *    |      mirror snap  *      |
+   *    |      not synced)  *      |
+   *    v                   *      |
+   * CREATE_SNAPSHOT        *      |
+   *    |                   *      |
+   *    v                   *      |
+   * <finish> < * * * * * * * < ---/
    *
    * @endverbatim
    */
@@ -56,6 +68,9 @@ private:
 
   cls::rbd::MirrorImage m_mirror_image;
   PromotionState m_promotion_state;
+  bool m_blocked_requests = false;
+  std::string m_snap_name;
+  NoOpProgressContext m_prog_ctx;
 
   void get_info();
   void handle_get_info(int r);
@@ -63,6 +78,15 @@ private:
   void promote();
   void handle_promote(int r);
 
+  void acquire_lock();
+  void handle_acquire_lock(int r);
+
+  void rollback();
+  void handle_rollback(int r);
+
+  void create_snapshot();
+  void handle_create_snapshot(int r);
+
   void finish(int r);
 
 };
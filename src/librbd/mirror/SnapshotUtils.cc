@@ -0,0 +1,91 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "librbd/mirror/SnapshotUtils.h"
+#include "include/uuid.h"
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace librbd {
+namespace mirror {
+namespace snapshot {
+
+namespace {
+
+const std::string SNAP_NAME_PREFIX(".mirror.");
+const std::string PRIMARY("primary");
+const std::string NON_PRIMARY("non_primary");
+const std::string DEMOTED("demoted");
+
+} // anonymous namespace
+
+std::string generate_snap_uuid() {
+  uuid_d uuid_gen;
+  uuid_gen.generate_random();
+  return uuid_gen.to_string();
+}
+
+std::string get_snap_name(State state, const std::string &peer_mirror_uuid,
+                          const std::string &snap_uuid) {
+  std::string snap_name(SNAP_NAME_PREFIX);
+  switch (state) {
+  case STATE_PRIMARY:
+    snap_name += PRIMARY + ".";
+    if (!peer_mirror_uuid.empty()) {
+      snap_name += peer_mirror_uuid + ".";
+    }
+    break;
+  case STATE_NON_PRIMARY:
+    snap_name += NON_PRIMARY + ".";
+    break;
+  case STATE_DEMOTED:
+    snap_name += DEMOTED + ".";
+    break;
+  }
+  return snap_name + snap_uuid;
+}
+
+bool decode_snap_name(const std::string &snap_name,
+                      MirrorSnapshot *mirror_snapshot) {
+  if (!boost::starts_with(snap_name, SNAP_NAME_PREFIX)) {
+    return false;
+  }
+
+  // uuids never contain a '.'
+  std::vector<std::string> parts;
+  size_t pos = SNAP_NAME_PREFIX.size();
+  while (true) {
+    size_t next = snap_name.find('.', pos);
+    parts.push_back(snap_name.substr(pos, next - pos));
+    if (next == std::string::npos) {
+      break;
+    }
+    pos = next + 1;
+  }
+
+  for (auto &part : parts) {
+    if (part.empty()) {
+      return false;
+    }
+  }
+
+  if (parts[0] == PRIMARY && (parts.size() == 2 || parts.size() == 3)) {
+    mirror_snapshot->state = STATE_PRIMARY;
+    mirror_snapshot->peer_mirror_uuid = (parts.size() == 3 ? parts[1] : "");
+  } else if (parts[0] == NON_PRIMARY && parts.size() == 2) {
+    mirror_snapshot->state = STATE_NON_PRIMARY;
+    mirror_snapshot->peer_mirror_uuid.clear();
+  } else if (parts[0] == DEMOTED && parts.size() == 2) {
+    mirror_snapshot->state = STATE_DEMOTED;
+    mirror_snapshot->peer_mirror_uuid.clear();
+  } else {
+    return false;
+  }
+
+  mirror_snapshot->snap_name = snap_name;
+  mirror_snapshot->snap_uuid = parts.back();
+  return true;
+}
+
+} // namespace snapshot
+} // namespace mirror
+} // namespace librbd
@@ -0,0 +1,106 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_MIRROR_SNAPSHOT_UTILS_H
+#define CEPH_LIBRBD_MIRROR_SNAPSHOT_UTILS_H
+
+#include "include/int_types.h"
+#include "include/types.h"
+#include "include/assert.h"
+#include "cls/rbd/cls_rbd_types.h"
+#include "librbd/mirror/Types.h"
+#include <string>
+#include <vector>
+
+namespace librbd {
+namespace mirror {
+namespace snapshot {
+
+/**
+ * Images mirrored in snapshot mode record their promotion state within
+ * specially named user snapshots:
+ *
+ * @verbatim
+ *
+ * .mirror.primary.<snap uuid>                     (enabled / promoted)
+ * .mirror.primary.<peer mirror uuid>.<snap uuid>  (created for a peer)
+ * .mirror.non_primary.<snap uuid>                 (synced from a peer)
+ * .mirror.demoted.<snap uuid>                     (demoted / synced demotion)
+ *
+ * @endverbatim
+ *
+ * The snap uuid identifies the same point-in-time image content on every
+ * peer and the most recent mirror snapshot defines the promotion state of
+ * the image.
+ */
+enum State {
+  STATE_PRIMARY,
+  STATE_NON_PRIMARY,
+  STATE_DEMOTED
+};
+
+struct MirrorSnapshot {
+  uint64_t snap_id = CEPH_NOSNAP;
+  std::string snap_name;
+  State state = STATE_PRIMARY;
+  std::string peer_mirror_uuid;
+  std::string snap_uuid;
+};
+
+typedef std::vector<MirrorSnapshot> MirrorSnapshots;
+
+std::string generate_snap_uuid();
+std::string get_snap_name(State state, const std::string &peer_mirror_uuid,
+                          const std::string &snap_uuid);
+bool decode_snap_name(const std::string &snap_name,
+                      MirrorSnapshot *mirror_snapshot);
+
+/// list the mirror snapshots from oldest to newest (requires snap_lock)
+template <typename ImageCtxT>
+void list_snaps(ImageCtxT *image_ctx, MirrorSnapshots *mirror_snapshots) {
+  assert(image_ctx->snap_lock.is_locked());
+
+  mirror_snapshots->clear();
+  for (auto &it : image_ctx->snap_info) {
+    if (boost::get<cls::rbd::UserSnapshotNamespace>(
+          &it.second.snap_namespace) == nullptr) {
+      continue;
+    }
+
+    MirrorSnapshot mirror_snapshot;
+    if (!decode_snap_name(it.second.name, &mirror_snapshot)) {
+      continue;
+    }
+    mirror_snapshot.snap_id = it.first;
+    mirror_snapshots->push_back(mirror_snapshot);
+  }
+}
+
+/**
+ * Images without any mirror snapshot were created by rbd-mirror and have
+ * not completed their first sync yet (requires snap_lock).
+ */
+template <typename ImageCtxT>
+PromotionState get_promotion_state(ImageCtxT *image_ctx) {
+  MirrorSnapshots mirror_snapshots;
+  list_snaps(image_ctx, &mirror_snapshots);
+  if (mirror_snapshots.empty()) {
+    return PROMOTION_STATE_NON_PRIMARY;
+  }
+
+  switch (mirror_snapshots.back().state) {
+  case STATE_PRIMARY:
+    return PROMOTION_STATE_PRIMARY;
+  case STATE_DEMOTED:
+    return PROMOTION_STATE_ORPHAN;
+  default:
+    break;
+  }
+  return PROMOTION_STATE_NON_PRIMARY;
+}
+
+} // namespace snapshot
+} // namespace mirror
+} // namespace librbd
+
+#endif // CEPH_LIBRBD_MIRROR_SNAPSHOT_UTILS_H
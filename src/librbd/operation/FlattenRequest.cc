@@ -5,6 +5,7 @@
 #include "librbd/AsyncObjectThrottle.h"
 #include "librbd/ExclusiveLock.h"
 #include "librbd/ImageCtx.h"
+#include "librbd/ObjectMap.h"
 #include "librbd/io/ObjectRequest.h"
 #include "common/dout.h"
 #include "common/errno.h"
@@ -39,6 +40,13 @@ public:
       return -ERESTART;
     }
 
+    if (!parent_object_may_exist()) {
+      // nothing to copy up from the parent
+      ldout(cct, 20) << "skipping non-existent parent object "
+                     << m_object_no << dendl;
+      return 1;
+    }
+
     bufferlist bl;
     string oid = image_ctx.get_object_name(m_object_no);
     auto req = new io::ObjectWriteRequest(&image_ctx, oid, m_object_no, 0,
@@ -58,6 +66,29 @@ private:
   uint64_t m_object_size;
   ::SnapContext m_snapc;
   uint64_t m_object_no;
+
+  bool parent_object_may_exist() {
+    I &image_ctx = this->m_image_ctx;
+    RWLock::RLocker parent_locker(image_ctx.parent_lock);
+    auto parent = image_ctx.parent;
+    if (parent == nullptr) {
+      return true;
+    }
+
+    // the parent object can only be checked if it covers the same image
+    // extent as the child object
+    if (parent->order != image_ctx.order || parent->stripe_count != 1 ||
+        image_ctx.stripe_count != 1) {
+      return true;
+    }
+
+    RWLock::RLocker parent_snap_locker(parent->snap_lock);
+    RWLock::RLocker parent_parent_locker(parent->parent_lock);
+    if (parent->parent != nullptr || parent->object_map == nullptr) {
+      return true;
+    }
+    return parent->object_map->object_may_exist(m_object_no);
+  }
 };
 
 template <typename I>
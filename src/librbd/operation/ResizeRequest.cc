@@ -44,6 +44,12 @@ ResizeRequest<I>::~ResizeRequest() {
     if (!image_ctx.resize_reqs.empty()) {
       next_req = image_ctx.resize_reqs.front();
     }
+
+    if (shrinking()) {
+      // the image size no longer reflects this request
+      RWLock::RLocker parent_locker(image_ctx.parent_lock);
+      image_ctx.publish_read_state();
+    }
   }
 
   if (next_req != NULL) {
@@ -251,6 +257,9 @@ Context *ResizeRequest<I>::send_grow_object_map() {
   {
     RWLock::WLocker snap_locker(image_ctx.snap_lock);
     m_shrink_size_visible = true;
+
+    RWLock::RLocker parent_locker(image_ctx.parent_lock);
+    image_ctx.publish_read_state();
   }
   image_ctx.io_work_queue->unblock_writes();
 
@@ -437,6 +446,7 @@ void ResizeRequest<I>::update_size_and_overlap() {
     if (image_ctx.parent != NULL && m_new_size < m_original_size) {
       image_ctx.parent_md.overlap = m_new_parent_overlap;
     }
+    image_ctx.publish_read_state();
   }
 
   // blocked by POST_BLOCK_WRITES state
@@ -17,12 +17,15 @@
 #define CEPH_MOSDMAP_H
 
 #include "msg/Message.h"
+#include "msg/Messenger.h"
 #include "osd/OSDMap.h"
 #include "include/ceph_features.h"
+#include "common/config.h"
+#include "compressor/Compressor.h"
 
 class MOSDMap : public Message {
 
-  static const int HEAD_VERSION = 3;
+  static const int HEAD_VERSION = 4;
 
  public:
   uuid_d fsid;
@@ -30,6 +33,25 @@ class MOSDMap : public Message {
   map<epoch_t, bufferlist> incremental_maps;
   epoch_t oldest_map, newest_map;
 
+  // compresses the maps on the wire, if set (see set_compression())
+  CompressorRef compressor;
+
+  /**
+   * compress the maps sent over @p con with osd_map_message_compression
+   *
+   * Only OSD peers that understand the compressed encoding get it; the
+   * maps are sent as is to anybody else.
+   */
+  void set_compression(CephContext *cct, const ConnectionRef& con) {
+    const std::string& alg = cct->_conf->osd_map_message_compression;
+    if (alg.empty() || alg == "none" || !con ||
+	con->get_peer_type() != CEPH_ENTITY_TYPE_OSD ||
+	!con->has_features(CEPH_FEATUREMASK_SERVER_LUMINOUS)) {
+      return;
+    }
+    compressor = Compressor::create(cct, alg);
+  }
+
   epoch_t get_first() const {
     epoch_t e = 0;
     map<epoch_t, bufferlist>::const_iterator i = maps.begin();
@@ -78,6 +100,29 @@ public:
       oldest_map = 0;
       newest_map = 0;
     }
+    if (header.version >= 4) {
+      uint8_t alg;
+      ::decode(alg, p);
+      if (alg != Compressor::COMP_ALG_NONE) {
+	bufferlist cbl;
+	::decode(cbl, p);
+	decompress_maps(alg, cbl);
+      }
+    }
+  }
+  void decompress_maps(uint8_t alg, bufferlist& cbl) {
+    ConnectionRef con = get_connection();
+    if (!con) {
+      throw buffer::malformed_input("no context to decompress osdmaps");
+    }
+    CompressorRef c = Compressor::create(con->get_messenger()->cct, alg);
+    bufferlist bl;
+    if (!c || c->decompress(cbl, bl) < 0) {
+      throw buffer::malformed_input("unable to decompress osdmaps");
+    }
+    bufferlist::iterator q = bl.begin();
+    ::decode(incremental_maps, q);
+    ::decode(maps, q);
   }
   void encode_payload(uint64_t features) override {
     header.version = HEAD_VERSION;
@@ -123,12 +168,35 @@ public:
 	m.encode(p->second, features | CEPH_FEATURE_RESERVED);
       }
     }
-    ::encode(incremental_maps, payload);
-    ::encode(maps, payload);
+    bufferlist cbl;
+    if (compressor && header.version >= 4 &&
+	HAVE_FEATURE(features, SERVER_LUMINOUS)) {
+      bufferlist bl;
+      ::encode(incremental_maps, bl);
+      ::encode(maps, bl);
+      if (compressor->compress(bl, cbl) < 0 || cbl.length() >= bl.length()) {
+	cbl.clear();
+      }
+    }
+    if (cbl.length()) {
+      ::encode(map<epoch_t, bufferlist>(), payload);
+      ::encode(map<epoch_t, bufferlist>(), payload);
+    } else {
+      ::encode(incremental_maps, payload);
+      ::encode(maps, payload);
+    }
     if (header.version >= 2) {
       ::encode(oldest_map, payload);
       ::encode(newest_map, payload);
     }
+    if (header.version >= 4) {
+      if (cbl.length()) {
+	::encode((uint8_t)compressor->get_type(), payload);
+	::encode(cbl, payload);
+      } else {
+	::encode((uint8_t)Compressor::COMP_ALG_NONE, payload);
+      }
+    }
   }
 
   const char *get_type_name() const override { return "osdmap"; }
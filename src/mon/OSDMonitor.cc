@@ -307,6 +307,7 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
     assert(latest_bl.length() != 0);
     dout(7) << __func__ << " loading latest full map e" << latest_full << dendl;
     osdmap.decode(latest_bl);
+    mapping.invalidate();
   }
 
   if (mon->monmap->get_required_features().contains_all(
@@ -339,6 +340,7 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
     OSDMap::Incremental inc(inc_bl);
     err = osdmap.apply_incremental(inc);
     assert(err == 0);
+    mapping.note_incremental(osdmap, inc);
 
     if (!t)
       t.reset(new MonitorDBStore::Transaction);
@@ -372,6 +374,7 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
 	     << dendl;
 	osdmap = OSDMap();
 	osdmap.decode(orig_full_bl);
+	mapping.invalidate();
       }
     } else {
       assert(!inc.have_crc);
@@ -461,8 +464,8 @@ void OSDMonitor::start_mapping()
     mapping_job->abort();
   }
   auto fin = new C_UpdateCreatingPGs(this, osdmap.get_epoch());
-  mapping_job = mapping.start_update(osdmap, mapper,
-				     g_conf->mon_osd_mapping_pgs_per_chunk);
+  mapping_job = mapping.start_update_incremental(
+    osdmap, mapper, g_conf->mon_osd_mapping_pgs_per_chunk);
   dout(10) << __func__ << " started mapping job " << mapping_job.get()
 	   << " at " << fin->start << dendl;
   mapping_job->set_finish_event(fin);
@@ -3026,6 +3029,9 @@ void OSDMonitor::send_incremental(epoch_t first,
     m->oldest_map = get_first_committed();
     m->newest_map = osdmap.get_epoch();
     m->maps[first] = bl;
+    if (!session->proxy_con) {
+      m->set_compression(g_ceph_context, session->con);
+    }
 
     if (req) {
       mon->send_reply(req, m);
@@ -3042,6 +3048,9 @@ void OSDMonitor::send_incremental(epoch_t first,
     epoch_t last = MIN(first + g_conf->osd_map_message_max - 1,
 		       osdmap.get_epoch());
     MOSDMap *m = build_incremental(first, last);
+    if (!session->proxy_con) {
+      m->set_compression(g_ceph_context, session->con);
+    }
 
     if (req) {
       // send some maps.  it may not be all of them, but it will get them
@@ -1248,6 +1248,17 @@ void OSDService::inc_scrubs_active(bool reserved)
   sched_scrub_lock.Unlock();
 }
 
+double OSDService::get_scrub_sleep()
+{
+  utime_t now = ceph_clock_now();
+  double sleep = scrub_sleep.get_sleep(
+    now, cct->_conf->osd_scrub_sleep, cct->_conf->osd_scrub_sleep_max,
+    cct->_conf->osd_scrub_target_client_latency);
+  dout(20) << __func__ << " client op latency "
+	   << scrub_sleep.get_latency(now) << " -> sleep " << sleep << dendl;
+  return sleep;
+}
+
 void OSDService::dec_scrubs_active()
 {
   sched_scrub_lock.Lock();
@@ -1356,6 +1367,7 @@ MOSDMap *OSDService::build_incremental_map_msg(epoch_t since, epoch_t to,
 
 void OSDService::send_map(MOSDMap *m, Connection *con)
 {
+  m->set_compression(cct, con);
   con->send_message(m);
 }
 
@@ -1392,16 +1404,28 @@ void OSDService::send_incremental_map(epoch_t since, Connection *con,
   send_map(m, con);
 }
 
-bool OSDService::_get_map_bl(epoch_t e, bufferlist& bl)
+bool OSDService::get_map_bl(epoch_t e, bufferlist& bl)
 {
-  bool found = map_bl_cache.lookup(e, &bl);
-  if (found)
-    return true;
-  found = store->read(coll_t::meta(),
-		      OSD::get_osdmap_pobject_name(e), 0, 0, bl) >= 0;
-  if (found)
-    _add_map_bl(e, bl);
-  return found;
+  {
+    Mutex::Locker l(map_cache_lock);
+    if (map_bl_cache.lookup(e, &bl))
+      return true;
+  }
+
+  // rebuilding a sparse full map may replay a run of incrementals, so
+  // don't hold map_cache_lock across the read
+  int r = OSD::read_stored_osdmap(
+    cct, store, e, bl,
+    [this](epoch_t base, bufferlist& base_bl) {
+      Mutex::Locker l(map_cache_lock);
+      return map_bl_cache.lookup(base, &base_bl);
+    });
+  if (r < 0)
+    return false;
+
+  Mutex::Locker l(map_cache_lock);
+  _add_map_bl(e, bl);
+  return true;
 }
 
 bool OSDService::get_inc_map_bl(epoch_t e, bufferlist& bl)
@@ -1469,30 +1493,34 @@ OSDMapRef OSDService::_add_map(OSDMap *o)
 
 OSDMapRef OSDService::try_get_map(epoch_t epoch)
 {
-  Mutex::Locker l(map_cache_lock);
-  OSDMapRef retval = map_cache.lookup(epoch);
-  if (retval) {
-    dout(30) << "get_map " << epoch << " -cached" << dendl;
-    if (logger) {
-      logger->inc(l_osd_map_cache_hit);
+  {
+    Mutex::Locker l(map_cache_lock);
+    OSDMapRef retval = map_cache.lookup(epoch);
+    if (retval) {
+      dout(30) << "get_map " << epoch << " -cached" << dendl;
+      if (logger) {
+	logger->inc(l_osd_map_cache_hit);
+      }
+      return retval;
     }
-    return retval;
-  }
-  if (logger) {
-    logger->inc(l_osd_map_cache_miss);
-    epoch_t lb = map_cache.cached_key_lower_bound();
-    if (epoch < lb) {
-      dout(30) << "get_map " << epoch << " - miss, below lower bound" << dendl;
-      logger->inc(l_osd_map_cache_miss_low);
-      logger->inc(l_osd_map_cache_miss_low_avg, lb - epoch);
+    if (logger) {
+      logger->inc(l_osd_map_cache_miss);
+      epoch_t lb = map_cache.cached_key_lower_bound();
+      if (epoch < lb) {
+	dout(30) << "get_map " << epoch << " - miss, below lower bound" << dendl;
+	logger->inc(l_osd_map_cache_miss_low);
+	logger->inc(l_osd_map_cache_miss_low_avg, lb - epoch);
+      }
     }
   }
 
+  // load and decode without map_cache_lock; if we race with another
+  // loader, _add_map() keeps the first copy
   OSDMap *map = new OSDMap;
   if (epoch > 0) {
     dout(20) << "get_map " << epoch << " - loading and decoding " << map << dendl;
     bufferlist bl;
-    if (!_get_map_bl(epoch, bl) || bl.length() == 0) {
+    if (!get_map_bl(epoch, bl) || bl.length() == 0) {
       derr << "failed to load OSD map for epoch " << epoch << ", got " << bl.length() << " bytes" << dendl;
       delete map;
       return OSDMapRef();
@@ -1501,7 +1529,7 @@ OSDMapRef OSDService::try_get_map(epoch_t epoch)
   } else {
     dout(20) << "get_map " << epoch << " - return initial " << map << dendl;
   }
-  return _add_map(map);
+  return add_map(map);
 }
 
 // ops
@@ -1772,6 +1800,125 @@ int OSD::peek_meta(ObjectStore *store, std::string& magic,
 }
 
 
+// a persisted full map is either a plain OSDMap encoding or, if
+// osd_map_compression is set, this marker (which is never a valid first
+// byte of an OSDMap encoding) followed by the compressor type and the
+// compressed encoding.
+static const uint8_t STORED_OSDMAP_COMPRESSED = 0xff;
+
+void OSD::encode_stored_osdmap(CephContext *cct, const bufferlist& full,
+			       bufferlist& out)
+{
+  const string& alg = cct->_conf->osd_map_compression;
+  if (!alg.empty() && alg != "none") {
+    CompressorRef compressor = Compressor::create(cct, alg);
+    bufferlist cbl;
+    if (compressor &&
+	compressor->compress(full, cbl) == 0 &&
+	cbl.length() < full.length()) {
+      ::encode(STORED_OSDMAP_COMPRESSED, out);
+      ::encode((uint8_t)compressor->get_type(), out);
+      ::encode(cbl, out);
+      return;
+    }
+  }
+  out = full;
+}
+
+static int decode_stored_osdmap(CephContext *cct, bufferlist& in,
+				bufferlist& out)
+{
+  if (in.length() == 0 || (uint8_t)in[0] != STORED_OSDMAP_COMPRESSED) {
+    out.claim(in);
+    return 0;
+  }
+  uint8_t marker, alg;
+  bufferlist cbl;
+  try {
+    bufferlist::iterator p = in.begin();
+    ::decode(marker, p);
+    ::decode(alg, p);
+    ::decode(cbl, p);
+  } catch (buffer::error& e) {
+    return -EIO;
+  }
+  CompressorRef compressor = Compressor::create(cct, alg);
+  if (!compressor) {
+    lderr(cct) << __func__ << " no compressor for type " << (int)alg << dendl;
+    return -EIO;
+  }
+  out.clear();
+  return compressor->decompress(cbl, out) < 0 ? -EIO : 0;
+}
+
+epoch_t OSD::get_osdmap_trim_bound(ObjectStore *store, epoch_t oldest,
+				   epoch_t min)
+{
+  while (min > oldest && !have_stored_full_osdmap(store, min)) {
+    --min;
+  }
+  return std::max(min, oldest);
+}
+
+int OSD::read_stored_osdmap(
+  CephContext *cct, ObjectStore *store, epoch_t epoch, bufferlist& bl,
+  std::function<bool(epoch_t, bufferlist&)> lookup)
+{
+  // find the nearest full map at or before epoch
+  epoch_t base = epoch;
+  bufferlist base_bl;
+  while (true) {
+    if (base < epoch && lookup && lookup(base, base_bl)) {
+      break;
+    }
+    bufferlist stored;
+    if (store->read(coll_t::meta(), get_osdmap_pobject_name(base),
+		    0, 0, stored) >= 0) {
+      int r = decode_stored_osdmap(cct, stored, base_bl);
+      if (r < 0) {
+	return r;
+      }
+      break;
+    }
+    if (base <= 1 ||
+	!store->exists(coll_t::meta(), get_inc_osdmap_pobject_name(base))) {
+      return -ENOENT;
+    }
+    --base;
+  }
+  if (base == epoch) {
+    bl.claim(base_bl);
+    return 0;
+  }
+
+  // and roll it forward
+  OSDMap osdmap;
+  osdmap.decode(base_bl);
+  for (epoch_t e = base + 1; e <= epoch; ++e) {
+    bufferlist ibl;
+    if (store->read(coll_t::meta(), get_inc_osdmap_pobject_name(e),
+		    0, 0, ibl) < 0) {
+      return -ENOENT;
+    }
+    OSDMap::Incremental inc(ibl);
+    if (osdmap.apply_incremental(inc) < 0) {
+      return -EINVAL;
+    }
+    if (e == epoch) {
+      bl.clear();
+      osdmap.encode(bl, inc.encode_features | CEPH_FEATURE_RESERVED);
+      if (inc.have_crc && osdmap.get_crc() != inc.full_crc) {
+	lderr(cct) << __func__ << " rebuilt e" << epoch << " from e" << base
+		   << " with bad crc" << dendl;
+	return -EIO;
+      }
+    }
+  }
+  ldout(cct, 20) << __func__ << " rebuilt e" << epoch << " from e" << base
+		 << dendl;
+  return 0;
+}
+
 #undef dout_prefix
 #define dout_prefix _prefix(_dout, whoami, get_osdmap_epoch())
 
@@ -2986,6 +3133,13 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(
     l_osd_pg_biginfo, "osd_pg_biginfo", "PG updated its biginfo attr");
 
+  osd_plb.add_u64_counter(
+    l_osd_scrub_objects, "scrub_objects", "Objects scanned by scrub");
+  osd_plb.add_u64_counter(
+    l_osd_scrub_bytes, "scrub_bytes", "Bytes read by deep scrub");
+  osd_plb.add_time_avg(
+    l_osd_scrub_sleep, "scrub_sleep", "Sleep between scrub chunks");
+
   logger = osd_plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -7163,7 +7317,9 @@ void OSD::osdmap_subscribe(version_t epoch, bool force_request)
 
 void OSD::trim_maps(epoch_t oldest, int nreceived, bool skip_maps)
 {
-  epoch_t min = std::min(oldest, service.map_cache.cached_key_lower_bound());
+  epoch_t min = get_osdmap_trim_bound(
+    store, superblock.oldest_map,
+    std::min(oldest, service.map_cache.cached_key_lower_bound()));
   if (min <= superblock.oldest_map)
     return;
 
@@ -7175,7 +7331,8 @@ void OSD::trim_maps(epoch_t oldest, int nreceived, bool skip_maps)
     t.remove(coll_t::meta(), get_inc_osdmap_pobject_name(e));
     superblock.oldest_map = e + 1;
     num++;
-    if (num >= cct->_conf->osd_target_transaction_size && num >= nreceived) {
+    if (num >= cct->_conf->osd_target_transaction_size && num >= nreceived &&
+	have_stored_full_osdmap(store, e + 1)) {
       service.publish_superblock(superblock);
       write_superblock(t);
       int tr = store->queue_transaction(service.meta_osr.get(), std::move(t), nullptr);
@@ -7306,7 +7463,9 @@ void OSD::handle_osd_map(MOSDMap *m)
       o->decode(bl);
 
       ghobject_t fulloid = get_osdmap_pobject_name(e);
-      t.write(coll_t::meta(), fulloid, 0, bl.length(), bl);
+      bufferlist sbl;
+      encode_stored_osdmap(cct, bl, sbl);
+      t.write(coll_t::meta(), fulloid, 0, sbl.length(), sbl);
       pin_map_bl(e, bl);
       pinned_maps.push_back(add_map(o));
 
@@ -7323,7 +7482,12 @@ void OSD::handle_osd_map(MOSDMap *m)
       pin_map_inc_bl(e, bl);
 
       OSDMap *o = new OSDMap;
-      if (e > 1) {
+      if (!pinned_maps.empty() &&
+	  pinned_maps.back()->get_epoch() == e - 1) {
+	// apply contiguous incrementals to the map we just built instead of
+	// fetching and decoding it again
+	o->deepish_copy_from(*pinned_maps.back());
+      } else if (e > 1) {
 	bufferlist obl;
         bool got = get_map_bl(e - 1, obl);
         assert(got);
@@ -7363,8 +7527,12 @@ void OSD::handle_osd_map(MOSDMap *m)
       }
       got_full_map(e);
 
-      ghobject_t fulloid = get_osdmap_pobject_name(e);
-      t.write(coll_t::meta(), fulloid, 0, fbl.length(), fbl);
+      if (should_store_full_osdmap(cct, e)) {
+	ghobject_t fulloid = get_osdmap_pobject_name(e);
+	bufferlist sbl;
+	encode_stored_osdmap(cct, fbl, sbl);
+	t.write(coll_t::meta(), fulloid, 0, sbl.length(), sbl);
+      }
       pin_map_bl(e, fbl);
       pinned_maps.push_back(add_map(o));
       continue;
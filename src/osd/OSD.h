@@ -39,8 +39,10 @@
 
 #include "OpRequest.h"
 #include "Session.h"
+#include "ScrubSleep.h"
 
 #include <atomic>
+#include <functional>
 #include <map>
 #include <memory>
 #include "include/memory.h"
@@ -168,6 +170,10 @@ enum {
   l_osd_pg_fastinfo,
   l_osd_pg_biginfo,
 
+  l_osd_scrub_objects,
+  l_osd_scrub_bytes,
+  l_osd_scrub_sleep,
+
   l_osd_last,
 };
 
@@ -750,6 +756,18 @@ public:
   void dec_scrubs_pending();
   void dec_scrubs_active();
 
+private:
+  // -- scrub throttling --
+  ScrubSleep scrub_sleep;
+
+public:
+  /// feed the client op latency the scrub sleep adapts to
+  void note_client_op_latency(const utime_t& lat, const utime_t& now) {
+    scrub_sleep.note_latency(lat, now);
+  }
+  /// @returns the sleep between scrub chunks, adapted to client latency
+  double get_scrub_sleep();
+
   void reply_op_error(OpRequestRef op, int err);
   void reply_op_error(OpRequestRef op, int err, eversion_t v, version_t uv);
   void handle_misdirected_op(PG *pg, OpRequestRef op);
@@ -1076,11 +1094,7 @@ public:
   }
   void pin_map_bl(epoch_t e, bufferlist &bl);
   void _add_map_bl(epoch_t e, bufferlist& bl);
-  bool get_map_bl(epoch_t e, bufferlist& bl) {
-    Mutex::Locker l(map_cache_lock);
-    return _get_map_bl(e, bl);
-  }
-  bool _get_map_bl(epoch_t e, bufferlist& bl);
+  bool get_map_bl(epoch_t e, bufferlist& bl);
 
   void add_map_inc_bl(epoch_t e, bufferlist& bl) {
     Mutex::Locker l(map_cache_lock);
@@ -1352,6 +1366,43 @@ public:
     return ghobject_t(hobject_t(sobject_t(object_t(foo), 0)));
   }
 
+  /// true if the full map for @p epoch should be persisted (see
+  /// osd_map_full_interval); the others are rebuilt from incrementals
+  static bool should_store_full_osdmap(CephContext *cct, epoch_t epoch) {
+    return cct->_conf->osd_map_full_interval <= 1 ||
+      epoch % cct->_conf->osd_map_full_interval == 0;
+  }
+  /// true if the full map for @p epoch was persisted in the meta collection
+  static bool have_stored_full_osdmap(ObjectStore *store, epoch_t epoch) {
+    return store->exists(coll_t::meta(), get_osdmap_pobject_name(epoch));
+  }
+  /**
+   * the newest epoch in (@p oldest, @p min] that oldest_map may be trimmed
+   * to, or @p oldest if there is none
+   *
+   * The oldest map kept must have a persisted full map for the ones after
+   * it to be rebuilt.  This is checked against the store rather than
+   * osd_map_full_interval, which may have changed since the maps were
+   * written.
+   */
+  static epoch_t get_osdmap_trim_bound(ObjectStore *store, epoch_t oldest,
+				       epoch_t min);
+  /// encode a full map for the meta collection, compressing it if configured
+  static void encode_stored_osdmap(CephContext *cct, const bufferlist& full,
+				   bufferlist& out);
+  /**
+   * read the full map for @p epoch from the meta collection
+   *
+   * If it was not persisted, rebuild it from the nearest prior full map
+   * and the incrementals in between.  @p lookup may supply (raw) full
+   * maps from a cache.
+   *
+   * @returns 0 on success, or a negative error code
+   */
+  static int read_stored_osdmap(
+    CephContext *cct, ObjectStore *store, epoch_t epoch, bufferlist& bl,
+    std::function<bool(epoch_t, bufferlist&)> lookup = nullptr);
+
   static ghobject_t make_snapmapper_oid() {
     return ghobject_t(hobject_t(
       sobject_t(
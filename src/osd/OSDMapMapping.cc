@@ -12,7 +12,9 @@ MEMPOOL_DEFINE_OBJECT_FACTORY(OSDMapMapping, osdmapmapping,
 			      osdmap_mapping);
 
 // ensure that we have a PoolMappings for each pool and that
-// the dimensions (pg_num and size) match up.
+// the dimensions (pg_num and size) match up.  pools we (re)create
+// here are added to the in-flight set so that an incremental
+// update will fill them in.
 void OSDMapMapping::_init_mappings(const OSDMap& osdmap)
 {
   num_pgs = 0;
@@ -22,6 +24,7 @@ void OSDMapMapping::_init_mappings(const OSDMap& osdmap)
     // drop unneeded pools
     while (q != pools.end() && q->first < p.first) {
       q = pools.erase(q);
+      rmap_stale = true;
     }
     if (q != pools.end() && q->first == p.first) {
       if (q->second.pg_num != p.second.get_pg_num() ||
@@ -36,13 +39,166 @@ void OSDMapMapping::_init_mappings(const OSDMap& osdmap)
     }
     pools.emplace(p.first, PoolMapping(p.second.get_size(),
 				       p.second.get_pg_num()));
+    inflight_pools.insert(p.first);
+    rmap_stale = true;
+  }
+  if (q != pools.end()) {
+    pools.erase(q, pools.end());
+    rmap_stale = true;
   }
-  pools.erase(q, pools.end());
   assert(pools.size() == osdmap.get_pools().size());
 }
 
+void OSDMapMapping::_start_full(const OSDMap& osdmap)
+{
+  dirty_all = false;
+  dirty_epoch = osdmap.get_epoch();
+  dirty_pools.clear();
+  dirty_pgs.clear();
+  inflight_all = true;
+  inflight_epoch = osdmap.get_epoch();
+  inflight_pools.clear();
+  inflight_pgs.clear();
+  rmap_stale = true;
+}
+
+bool OSDMapMapping::_start_incremental(const OSDMap& osdmap)
+{
+  if (inflight_epoch != epoch) {
+    // the last update never completed; it still needs doing
+    if (inflight_all) {
+      dirty_all = true;
+    } else {
+      dirty_pools.insert(inflight_pools.begin(), inflight_pools.end());
+      dirty_pgs.insert(inflight_pgs.begin(), inflight_pgs.end());
+    }
+  }
+  if (dirty_all || dirty_epoch != osdmap.get_epoch() ||
+      epoch == 0 || pools.empty()) {
+    _start_full(osdmap);
+    return false;
+  }
+  inflight_all = false;
+  inflight_epoch = osdmap.get_epoch();
+  inflight_pools.clear();
+  inflight_pools.swap(dirty_pools);
+  inflight_pgs.clear();
+  inflight_pgs.swap(dirty_pgs);
+  return true;
+}
+
+void OSDMapMapping::_note_osds(const OSDMap& osdmap, const std::set<int>& osds)
+{
+  // a changed osd can only move pgs in pools whose crush rule can reach it
+  std::map<int,bool> rule_reaches;
+  for (auto& p : osdmap.get_pools()) {
+    if (dirty_pools.count(p.first)) {
+      continue;
+    }
+    int ruleno = osdmap.crush->find_rule(p.second.get_crush_ruleset(),
+					 p.second.get_type(),
+					 p.second.get_size());
+    auto r = rule_reaches.find(ruleno);
+    if (r == rule_reaches.end()) {
+      bool reaches = true;
+      std::map<int,float> wm;
+      if (ruleno >= 0 &&
+	  osdmap.crush->get_rule_weight_osd_map(ruleno, &wm) >= 0) {
+	reaches = false;
+	for (auto osd : osds) {
+	  if (wm.count(osd)) {
+	    reaches = true;
+	    break;
+	  }
+	}
+      }
+      r = rule_reaches.emplace(ruleno, reaches).first;
+    }
+    if (r->second) {
+      dirty_pools.insert(p.first);
+    }
+  }
+
+  // explicit mappings skip down or out osds, so any pg that has one may
+  // move regardless of its crush rule.
+  for (auto& p : *osdmap.pg_temp) {
+    dirty_pgs.insert(p.first);
+  }
+  for (auto& p : *osdmap.primary_temp) {
+    dirty_pgs.insert(p.first);
+  }
+  for (auto& p : osdmap.pg_upmap) {
+    dirty_pgs.insert(p.first);
+  }
+  for (auto& p : osdmap.pg_upmap_items) {
+    dirty_pgs.insert(p.first);
+  }
+}
+
+void OSDMapMapping::note_incremental(const OSDMap& osdmap,
+				     const OSDMap::Incremental& inc)
+{
+  assert(inc.epoch == osdmap.get_epoch());
+  if (inc.epoch != dirty_epoch + 1) {
+    dirty_all = true;
+  }
+  dirty_epoch = inc.epoch;
+  if (dirty_all) {
+    return;
+  }
+  if (inc.fullmap.length() ||
+      inc.crush.length() ||
+      inc.new_max_osd >= 0) {
+    dirty_all = true;
+    dirty_pools.clear();
+    dirty_pgs.clear();
+    return;
+  }
+
+  for (auto& p : inc.new_pools) {
+    dirty_pools.insert(p.first);
+  }
+
+  for (auto& p : inc.new_pg_temp) {
+    dirty_pgs.insert(p.first);
+  }
+  for (auto& p : inc.new_primary_temp) {
+    dirty_pgs.insert(p.first);
+  }
+  for (auto& p : inc.new_pg_upmap) {
+    dirty_pgs.insert(p.first);
+  }
+  for (auto& pg : inc.old_pg_upmap) {
+    dirty_pgs.insert(pg);
+  }
+  for (auto& p : inc.new_pg_upmap_items) {
+    dirty_pgs.insert(p.first);
+  }
+  for (auto& pg : inc.old_pg_upmap_items) {
+    dirty_pgs.insert(pg);
+  }
+
+  std::set<int> osds;
+  for (auto& p : inc.new_state) {
+    osds.insert(p.first);
+  }
+  for (auto& p : inc.new_up_client) {
+    osds.insert(p.first);
+  }
+  for (auto& p : inc.new_weight) {
+    osds.insert(p.first);
+  }
+  for (auto& p : inc.new_primary_affinity) {
+    osds.insert(p.first);
+  }
+  if (!osds.empty()) {
+    _note_osds(osdmap, osds);
+  }
+}
+
 void OSDMapMapping::update(const OSDMap& osdmap)
 {
+  _start_full(osdmap);
   _start(osdmap);
   for (auto& p : osdmap.get_pools()) {
     _update_range(osdmap, p.first, 0, p.second.get_pg_num());
@@ -56,8 +212,33 @@ void OSDMapMapping::update(const OSDMap& osdmap, pg_t pgid)
   _update_range(osdmap, pgid.pool(), pgid.ps(), pgid.ps() + 1);
 }
 
+void OSDMapMapping::update_incremental(const OSDMap& osdmap)
+{
+  if (!_start_incremental(osdmap)) {
+    update(osdmap);
+    return;
+  }
+  _start(osdmap);
+  for (auto pool : inflight_pools) {
+    auto p = osdmap.get_pools().find(pool);
+    if (p != osdmap.get_pools().end()) {
+      _update_range(osdmap, pool, 0, p->second.get_pg_num());
+    }
+  }
+  for (auto& pgid : inflight_pgs) {
+    auto p = osdmap.get_pools().find(pgid.pool());
+    if (p != osdmap.get_pools().end() &&
+	!inflight_pools.count(pgid.pool()) &&
+	pgid.ps() < p->second.get_pg_num()) {
+      _update_range(osdmap, pgid.pool(), pgid.ps(), pgid.ps() + 1);
+    }
+  }
+  _finish(osdmap);
+}
+
 void OSDMapMapping::_build_rmap(const OSDMap& osdmap)
 {
+  rmap_stale = false;
   acting_rmap.resize(osdmap.get_max_osd());
   //up_rmap.resize(osdmap.get_max_osd());
   for (auto& v : acting_rmap) {
@@ -85,7 +266,11 @@ void OSDMapMapping::_build_rmap(const OSDMap& osdmap)
 
 void OSDMapMapping::_finish(const OSDMap& osdmap)
 {
-  _build_rmap(osdmap);
+  // an incremental update that moved no acting sets can keep the rmap
+  if (rmap_stale ||
+      acting_rmap.size() != (unsigned)osdmap.get_max_osd()) {
+    _build_rmap(osdmap);
+  }
   epoch = osdmap.get_epoch();
 }
 
@@ -117,8 +302,10 @@ void OSDMapMapping::_update_range(
     osdmap.pg_to_up_acting_osds(
       pg_t(ps, pool),
       &up, &up_primary, &acting, &acting_primary);
-    i->second.set(ps, std::move(up), up_primary,
-		  std::move(acting), acting_primary);
+    if (i->second.set(ps, std::move(up), up_primary,
+		      std::move(acting), acting_primary)) {
+      rmap_stale = true;
+    }
   }
 }
 
@@ -167,3 +354,53 @@ void ParallelPGMapper::queue(
     }
   }
 }
+
+void ParallelPGMapper::queue(
+  Job *job,
+  unsigned pgs_per_item,
+  const std::set<int64_t>& only_pools,
+  const std::set<pg_t>& only_pgs)
+{
+  // hold a shard while queueing so that the job cannot complete before
+  // we are done, and still completes if there turns out to be no work.
+  job->start_one();
+  for (auto pool : only_pools) {
+    const pg_pool_t *pi = job->osdmap->get_pg_pool(pool);
+    if (!pi) {
+      continue;
+    }
+    for (unsigned ps = 0; ps < pi->get_pg_num(); ps += pgs_per_item) {
+      unsigned ps_end = MIN(ps + pgs_per_item, pi->get_pg_num());
+      job->start_one();
+      wq.queue(new Item(job, pool, ps, ps_end));
+      ldout(cct, 20) << __func__ << " " << job << " " << pool << " [" << ps
+		     << "," << ps_end << ")" << dendl;
+    }
+  }
+  // batch runs of adjacent pgs (only_pgs is sorted by pool, then ps)
+  auto p = only_pgs.begin();
+  while (p != only_pgs.end()) {
+    int64_t pool = p->pool();
+    const pg_pool_t *pi = job->osdmap->get_pg_pool(pool);
+    if (!pi || only_pools.count(pool) || p->ps() >= pi->get_pg_num()) {
+      ++p;
+      continue;
+    }
+    unsigned ps = p->ps();
+    unsigned ps_end = ps + 1;
+    for (++p;
+	 p != only_pgs.end() &&
+	   p->pool() == pool &&
+	   p->ps() == ps_end &&
+	   ps_end < pi->get_pg_num() &&
+	   ps_end - ps < pgs_per_item;
+	 ++p) {
+      ++ps_end;
+    }
+    job->start_one();
+    wq.queue(new Item(job, pool, ps, ps_end));
+    ldout(cct, 20) << __func__ << " " << job << " " << pool << " [" << ps
+		   << "," << ps_end << ")" << dendl;
+  }
+  job->finish_one();
+}
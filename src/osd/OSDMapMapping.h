@@ -7,11 +7,12 @@
 
 #include <vector>
 #include <map>
+#include <set>
+#include <atomic>
 
 #include "osd/osd_types.h"
 #include "common/WorkQueue.h"
-
-class OSDMap;
+#include "osd/OSDMap.h"
 
 /// work queue to perform work on batches of pgids on multiple CPUs
 class ParallelPGMapper {
@@ -159,6 +160,13 @@ public:
     Job *job,
     unsigned pgs_per_item);
 
+  /// queue only the given pools (in full) and the given individual pgs
+  void queue(
+    Job *job,
+    unsigned pgs_per_item,
+    const std::set<int64_t>& only_pools,
+    const std::set<pg_t>& only_pgs);
+
   void drain() {
     wq.drain();
   }
@@ -220,12 +228,17 @@ private:
       }
     }
 
-    void set(size_t ps,
+    /// @return true if the acting set for this pg changed
+    bool set(size_t ps,
 	     const std::vector<int>& up,
 	     int up_primary,
 	     const std::vector<int>& acting,
 	     int acting_primary) {
       int32_t *row = &table[row_size() * ps];
+      bool changed = row[2] != (int32_t)acting.size();
+      for (int i = 0; !changed && i < row[2]; ++i) {
+	changed = row[4 + i] != acting[i];
+      }
       row[0] = acting_primary;
       row[1] = up_primary;
       row[2] = acting.size();
@@ -236,6 +249,7 @@ private:
       for (int i = 0; i < row[3]; ++i) {
 	row[4 + size + i] = up[i];
       }
+      return changed;
     }
   };
 
@@ -243,9 +257,26 @@ private:
   mempool::osdmap_mapping::vector<
     mempool::osdmap_mapping::vector<pg_t>> acting_rmap;  // osd -> pg
   //unused: mempool::osdmap_mapping::vector<std::vector<pg_t>> up_rmap;  // osd -> pg
-  epoch_t epoch;
+  epoch_t epoch = 0;
   uint64_t num_pgs = 0;
 
+  // pools and pgs that may map differently than in the last completed
+  // update.  these are accumulated by note_incremental() and consumed
+  // by the incremental update variants below.
+  bool dirty_all = true;            ///< dirty set is unknown; remap it all
+  epoch_t dirty_epoch = 0;          ///< last epoch noted
+  std::set<int64_t> dirty_pools;
+  std::set<pg_t> dirty_pgs;
+
+  // what the most recently started update covers.  if that update never
+  // completes (e.g., it was aborted) the next one must cover it too.
+  bool inflight_all = true;
+  epoch_t inflight_epoch = 0;
+  std::set<int64_t> inflight_pools;
+  std::set<pg_t> inflight_pgs;
+
+  std::atomic<bool> rmap_stale = {true};  ///< acting_rmap needs a rebuild
+
   void _init_mappings(const OSDMap& osdmap);
   void _update_range(
     const OSDMap& map,
@@ -259,6 +290,11 @@ private:
   }
   void _finish(const OSDMap& osdmap);
 
+  /// move the dirty set in flight; @return false if we must remap everything
+  bool _start_incremental(const OSDMap& osdmap);
+  void _start_full(const OSDMap& osdmap);
+  void _note_osds(const OSDMap& osdmap, const std::set<int>& osds);
+
   void _dump();
 
   friend class ParallelPGMapper;
@@ -307,11 +343,40 @@ public:
     const OSDMap& map,
     ParallelPGMapper& mapper,
     unsigned pgs_per_item) {
+    _start_full(map);
     std::unique_ptr<MappingJob> job(new MappingJob(&map, this));
     mapper.queue(job.get(), pgs_per_item);
     return job;
   }
 
+  /**
+   * note an incremental that has just been applied to produce @p map
+   *
+   * Incrementals must be noted in order.  A gap, a full map or a crush
+   * change mean we have to remap everything on the next update.
+   */
+  void note_incremental(const OSDMap& map, const OSDMap::Incremental& inc);
+
+  /// forget the noted incrementals; the next update remaps everything
+  void invalidate() {
+    dirty_all = true;
+  }
+
+  /// remap only the pools and pgs the noted incrementals may have touched
+  void update_incremental(const OSDMap& map);
+
+  std::unique_ptr<MappingJob> start_update_incremental(
+    const OSDMap& map,
+    ParallelPGMapper& mapper,
+    unsigned pgs_per_item) {
+    if (!_start_incremental(map)) {
+      return start_update(map, mapper, pgs_per_item);
+    }
+    std::unique_ptr<MappingJob> job(new MappingJob(&map, this));
+    mapper.queue(job.get(), pgs_per_item, inflight_pools, inflight_pgs);
+    return job;
+  }
+
   epoch_t get_epoch() const {
     return epoch;
   }
@@ -313,6 +313,7 @@ PG::PG(OSDService *o, OSDMapRef curmap,
   heartbeat_peer_lock("PG::heartbeat_peer_lock"),
   backfill_reserved(false),
   backfill_reserving(false),
+  backfill_reservation_seq(0),
   flushes_in_progress(0),
   pg_stats_publish_lock("PG::pg_stats_publish_lock"),
   pg_stats_publish_valid(false),
@@ -2030,14 +2031,60 @@ void PG::mark_clean()
   dirty_info = true;
 }
 
+unsigned PG::get_num_complete_shards() const
+{
+  unsigned n = 0;
+  for (set<pg_shard_t>::const_iterator i = actingset.begin();
+       i != actingset.end();
+       ++i) {
+    if (*i == pg_whoami) {
+      if (pg_log.get_missing().num_missing() == 0)
+	++n;
+      continue;
+    }
+    map<pg_shard_t, pg_missing_t>::const_iterator m = peer_missing.find(*i);
+    if (m == peer_missing.end() || m->second.num_missing() == 0)
+      ++n;
+  }
+  return n;
+}
+
+int PG::get_degraded_priority_bonus() const
+{
+  // +1 for every 8 bits of degraded objects, so a pg with millions of
+  // degraded objects sorts ahead of one with a handful, but never
+  // enough to jump to the next redundancy step
+  int64_t degraded = info.stats.stats.sum.num_objects_degraded;
+  int bits = 0;
+  while (degraded > 0) {
+    ++bits;
+    degraded >>= 1;
+  }
+  return MIN((bits + 7) / 8, OSD_RECOVERY_PRIORITY_REDUNDANCY_STEP - 1);
+}
+
 unsigned PG::get_recovery_priority()
 {
   // a higher value -> a higher priority
 
+  int ret = OSD_RECOVERY_PRIORITY_BASE;
+  unsigned complete = get_num_complete_shards();
+  if (complete < pool.info.min_size) {
+    // some objects have fewer than min_size good copies; they block IO
+    // and are one failure closer to loss than anything else we recover
+    ret = OSD_BACKFILL_INACTIVE_PRIORITY_BASE + (pool.info.min_size - complete);
+  } else {
+    // rank by how many copies are short of pool size
+    if (pool.info.size > complete)
+      ret += OSD_RECOVERY_PRIORITY_REDUNDANCY_STEP * (pool.info.size - complete);
+    ret += get_degraded_priority_bonus();
+    if (ret >= OSD_BACKFILL_INACTIVE_PRIORITY_BASE)
+      ret = OSD_BACKFILL_INACTIVE_PRIORITY_BASE - 1;
+  }
+
   int pool_recovery_priority = 0;
   pool.info.opts.get(pool_opts_t::RECOVERY_PRIORITY, &pool_recovery_priority);
-
-  int ret = OSD_RECOVERY_PRIORITY_BASE + pool_recovery_priority;
+  ret += pool_recovery_priority;
 
   // Clamp to valid range
   if (ret > OSD_RECOVERY_PRIORITY_MAX) {
@@ -2062,13 +2109,18 @@ unsigned PG::get_backfill_priority()
     ret = OSD_BACKFILL_INACTIVE_PRIORITY_BASE + (pool.info.min_size - acting.size());
 
   } else if (is_undersized()) {
-    // undersized: OSD_BACKFILL_DEGRADED_PRIORITY_BASE + num missing replicas
+    // undersized: OSD_BACKFILL_DEGRADED_PRIORITY_BASE + step per missing replica
     assert(pool.info.size > actingset.size());
-    ret = OSD_BACKFILL_DEGRADED_PRIORITY_BASE + (pool.info.size - actingset.size());
+    ret = OSD_BACKFILL_DEGRADED_PRIORITY_BASE +
+      OSD_RECOVERY_PRIORITY_REDUNDANCY_STEP * (pool.info.size - actingset.size()) +
+      get_degraded_priority_bonus();
+    // stay below log-based recovery of the same redundancy class
+    if (ret >= OSD_RECOVERY_PRIORITY_BASE)
+      ret = OSD_RECOVERY_PRIORITY_BASE - 1;
 
   } else if (is_degraded()) {
     // degraded: baseline degraded
-    ret = OSD_BACKFILL_DEGRADED_PRIORITY_BASE;
+    ret = OSD_BACKFILL_DEGRADED_PRIORITY_BASE + get_degraded_priority_bonus();
   }
 
   // Adjust with pool's recovery priority
@@ -3820,6 +3872,35 @@ void PG::schedule_backfill_full_retry()
       RequestBackfill()));
 }
 
+namespace {
+// hold a preemption callback back for osd_debug_backfill_preempt_delay
+// seconds once it fires; owns the callback until then
+struct C_DelayBackfillPreempt : public Context {
+  OSDService *osd;
+  double delay;
+  Context *c;
+  C_DelayBackfillPreempt(OSDService *osd, double delay, Context *c)
+    : osd(osd), delay(delay), c(c) {}
+  ~C_DelayBackfillPreempt() override {
+    delete c;
+  }
+  void finish(int r) override {
+    Mutex::Locker lock(osd->recovery_request_lock);
+    osd->recovery_request_timer.add_event_after(delay, c);
+    c = nullptr;
+  }
+};
+} // anonymous namespace
+
+Context *PG::wrap_backfill_preempt(Context *c)
+{
+  double delay = cct->_conf->osd_debug_backfill_preempt_delay;
+  if (delay <= 0) {
+    return c;
+  }
+  return new C_DelayBackfillPreempt(osd, delay, c);
+}
+
 void PG::schedule_recovery_full_retry()
 {
   Mutex::Locker lock(osd->recovery_request_lock);
@@ -4062,6 +4143,22 @@ int PG::build_scrub_map_chunk(
   _scan_rollback_obs(rollback_obs, handle);
   _scan_snaps(map);
 
+  uint64_t bytes = 0;
+  if (deep) {
+    for (auto& p : ls) {
+      auto i = map.objects.find(p);
+      if (i != map.objects.end()) {
+	bytes += i->second.size;
+      }
+    }
+  }
+  osd->logger->inc(l_osd_scrub_objects, ls.size());
+  osd->logger->inc(l_osd_scrub_bytes, bytes);
+  if (scrubber.active) {
+    scrubber.objects_scanned += ls.size();
+    scrubber.bytes_scanned += bytes;
+  }
+
   dout(20) << __func__ << " done" << dendl;
   return 0;
 }
@@ -4205,9 +4302,12 @@ void PG::replica_scrub(
  */
 void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
 {
-  if (cct->_conf->osd_scrub_sleep > 0 &&
-      (scrubber.state == PG::Scrubber::NEW_CHUNK ||
+  double scrub_sleep = 0;
+  if ((scrubber.state == PG::Scrubber::NEW_CHUNK ||
        scrubber.state == PG::Scrubber::INACTIVE) && scrubber.needs_sleep) {
+    scrub_sleep = osd->get_scrub_sleep();
+  }
+  if (scrub_sleep > 0) {
     ceph_assert(!scrubber.sleeping);
     dout(20) << __func__ << " state is INACTIVE|NEW_CHUNK, sleeping" << dendl;
     // Do an async sleep so we don't block the op queue
@@ -4215,16 +4315,17 @@ void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
       lock();
       scrubber.sleeping = false;
       scrubber.needs_sleep = false;
-      dout(20) << __func__ << " slept for "
-               << ceph_clock_now() - scrubber.sleep_start
+      utime_t slept = ceph_clock_now() - scrubber.sleep_start;
+      dout(20) << __func__ << " slept for " << slept
                << ", re-queuing scrub" << dendl;
+      osd->logger->tinc(l_osd_scrub_sleep, slept);
       scrub_queued = false;
       requeue_scrub();
       scrubber.sleep_start = utime_t();
       unlock();
     });
     Mutex::Locker l(scrub_sleep_lock);
-    scrub_sleep_timer.add_event_after(cct->_conf->osd_scrub_sleep, scrub_requeue_callback);
+    scrub_sleep_timer.add_event_after(scrub_sleep, scrub_requeue_callback);
     scrubber.sleeping = true;
     scrubber.sleep_start = ceph_clock_now();
     return;
@@ -4360,6 +4461,7 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
         publish_stats_to_osd();
         scrubber.epoch_start = info.history.same_interval_since;
         scrubber.active = true;
+        scrubber.stamp_start = ceph_clock_now();
 
 	osd->inc_scrubs_active(scrubber.reserved);
 	if (scrubber.reserved) {
@@ -4826,6 +4928,14 @@ void PG::scrub_finish()
   // finish up
   unreg_next_scrub();
   utime_t now = ceph_clock_now();
+  {
+    double elapsed = now - scrubber.stamp_start;
+    dout(10) << __func__ << " " << mode << " scanned "
+	     << scrubber.objects_scanned << " objects, "
+	     << scrubber.bytes_scanned << " bytes in " << elapsed << "s ("
+	     << (elapsed > 0 ? scrubber.bytes_scanned / elapsed : 0)
+	     << " bytes/sec)" << dendl;
+  }
   info.history.last_scrub = info.last_update;
   info.history.last_scrub_stamp = now;
   if (scrubber.deep) {
@@ -6272,6 +6382,44 @@ PG::RecoveryState::Backfilling::react(const RemoteReservationRejected &)
   return transit<NotBackfilling>();
 }
 
+boost::statechart::result
+PG::RecoveryState::Backfilling::react(const DeferBackfill &evt)
+{
+  PG *pg = context< RecoveryMachine >().pg;
+  if (evt.reservation != pg->backfill_reservation_seq) {
+    ldout(pg->cct, 10) << "ignoring stale backfill preemption of reservation "
+		       << evt.reservation << dendl;
+    return discard_event();
+  }
+  ldout(pg->cct, 10) << "backfill preempted by higher priority reservation"
+		     << dendl;
+  pg->osd->local_reserver.cancel_reservation(pg->info.pgid);
+  pg->state_set(PG_STATE_BACKFILL_WAIT);
+
+  // release the remote slots so the higher priority work can use them
+  for (set<pg_shard_t>::iterator it = pg->backfill_targets.begin();
+       it != pg->backfill_targets.end();
+       ++it) {
+    assert(*it != pg->pg_whoami);
+    ConnectionRef con = pg->osd->get_con_osd_cluster(
+      it->osd, pg->get_osdmap()->get_epoch());
+    if (con) {
+      pg->osd->send_message_osd_cluster(
+        new MBackfillReserve(
+	  MBackfillReserve::REJECT,
+	  spg_t(pg->info.pgid.pgid, it->shard),
+	  pg->get_osdmap()->get_epoch()),
+	con.get());
+    }
+  }
+
+  pg->waiting_on_backfill.clear();
+  pg->finish_recovery_op(hobject_t::get_max());
+
+  pg->schedule_backfill_full_retry();
+  return transit<NotBackfilling>();
+}
+
 void PG::RecoveryState::Backfilling::exit()
 {
   context< RecoveryMachine >().log_exit(state_name, enter_time);
@@ -6366,6 +6514,43 @@ PG::RecoveryState::WaitRemoteBackfillReserved::react(const RemoteReservationReje
   return transit<NotBackfilling>();
 }
 
+boost::statechart::result
+PG::RecoveryState::WaitRemoteBackfillReserved::react(const DeferBackfill &evt)
+{
+  PG *pg = context< RecoveryMachine >().pg;
+  if (evt.reservation != pg->backfill_reservation_seq) {
+    ldout(pg->cct, 10) << "ignoring stale backfill preemption of reservation "
+		       << evt.reservation << dendl;
+    return discard_event();
+  }
+  ldout(pg->cct, 10) << "backfill preempted by higher priority reservation"
+		     << dendl;
+  pg->osd->local_reserver.cancel_reservation(pg->info.pgid);
+
+  // Send REJECT to every shard we have asked so far, granted or not
+  set<pg_shard_t>::const_iterator it =
+    context< Active >().remote_shards_to_reserve_backfill.begin();
+  for (; it != backfill_osd_it; ++it) {
+    //The primary never backfills itself
+    assert(*it != pg->pg_whoami);
+    ConnectionRef con = pg->osd->get_con_osd_cluster(
+      it->osd, pg->get_osdmap()->get_epoch());
+    if (con) {
+      pg->osd->send_message_osd_cluster(
+        new MBackfillReserve(
+	MBackfillReserve::REJECT,
+	spg_t(pg->info.pgid.pgid, it->shard),
+	pg->get_osdmap()->get_epoch()),
+      con.get());
+    }
+  }
+
+  pg->publish_stats_to_osd();
+  pg->schedule_backfill_full_retry();
+
+  return transit<NotBackfilling>();
+}
+
 /*--WaitLocalBackfillReserved--*/
 PG::RecoveryState::WaitLocalBackfillReserved::WaitLocalBackfillReserved(my_context ctx)
   : my_base(ctx),
@@ -6374,12 +6559,17 @@ PG::RecoveryState::WaitLocalBackfillReserved::WaitLocalBackfillReserved(my_conte
   context< RecoveryMachine >().log_enter(state_name);
   PG *pg = context< RecoveryMachine >().pg;
   pg->state_set(PG_STATE_BACKFILL_WAIT);
+  ++pg->backfill_reservation_seq;
   pg->osd->local_reserver.request_reservation(
     pg->info.pgid,
     new QueuePeeringEvt<LocalBackfillReserved>(
       pg, pg->get_osdmap()->get_epoch(),
       LocalBackfillReserved()),
-    pg->get_backfill_priority());
+    pg->get_backfill_priority(),
+    pg->cct->_conf->osd_backfill_preemptible ?
+      pg->wrap_backfill_preempt(new QueuePeeringEvt<DeferBackfill>(
+	pg, pg->get_osdmap()->get_epoch(),
+	DeferBackfill(pg->backfill_reservation_seq))) : nullptr);
   pg->publish_stats_to_osd();
 }
 
@@ -6518,11 +6708,16 @@ PG::RecoveryState::RepNotRecovering::react(const RequestBackfillPrio &evt)
 		       << ss.str() << dendl;
     post_event(RemoteReservationRejected());
   } else {
+    ++pg->backfill_reservation_seq;
     pg->osd->remote_reserver.request_reservation(
       pg->info.pgid,
       new QueuePeeringEvt<RemoteBackfillReserved>(
         pg, pg->get_osdmap()->get_epoch(),
-        RemoteBackfillReserved()), evt.priority);
+        RemoteBackfillReserved()), evt.priority,
+      pg->cct->_conf->osd_backfill_preemptible ?
+        pg->wrap_backfill_preempt(new QueuePeeringEvt<RemoteBackfillPreempted>(
+	  pg, pg->get_osdmap()->get_epoch(),
+	  RemoteBackfillPreempted(pg->backfill_reservation_seq))) : nullptr);
   }
   return transit<RepWaitBackfillReserved>();
 }
@@ -6571,6 +6766,7 @@ boost::statechart::result
 PG::RecoveryState::RepWaitBackfillReserved::react(const RemoteReservationRejected &evt)
 {
   PG *pg = context< RecoveryMachine >().pg;
+  pg->osd->remote_reserver.cancel_reservation(pg->info.pgid);
   pg->reject_reservation();
   return transit<RepNotRecovering>();
 }
@@ -6591,6 +6787,21 @@ PG::RecoveryState::RepRecovering::react(const BackfillTooFull &)
   return discard_event();
 }
 
+boost::statechart::result
+PG::RecoveryState::RepRecovering::react(const RemoteBackfillPreempted &evt)
+{
+  PG *pg = context< RecoveryMachine >().pg;
+  if (evt.reservation != pg->backfill_reservation_seq) {
+    ldout(pg->cct, 10) << "ignoring stale backfill preemption of reservation "
+		       << evt.reservation << dendl;
+    return discard_event();
+  }
+  // our slot went to a higher priority pg; tell the primary to back off
+  // and retry later (it sees this as an ordinary reject)
+  pg->reject_reservation();
+  return transit<RepNotRecovering>();
+}
+
 void PG::RecoveryState::RepRecovering::exit()
 {
   context< RecoveryMachine >().log_exit(state_name, enter_time);
@@ -7093,6 +7304,16 @@ boost::statechart::result PG::RecoveryState::Active::react(const QueryState& q)
     q.f->dump_stream("scrubber.end") << pg->scrubber.end;
     q.f->dump_stream("scrubber.subset_last_update") << pg->scrubber.subset_last_update;
     q.f->dump_bool("scrubber.deep", pg->scrubber.deep);
+    q.f->dump_stream("scrubber.stamp_start") << pg->scrubber.stamp_start;
+    q.f->dump_unsigned("scrubber.objects_scanned",
+		       pg->scrubber.objects_scanned);
+    q.f->dump_unsigned("scrubber.bytes_scanned", pg->scrubber.bytes_scanned);
+    {
+      double elapsed = pg->scrubber.stamp_start == utime_t() ? 0 :
+	(double)(ceph_clock_now() - pg->scrubber.stamp_start);
+      q.f->dump_float("scrubber.bytes_per_sec", elapsed > 0 ?
+		      pg->scrubber.bytes_scanned / elapsed : 0);
+    }
     q.f->dump_unsigned("scrubber.seed", pg->scrubber.seed);
     q.f->dump_int("scrubber.waiting_on", pg->scrubber.waiting_on);
     {
@@ -7144,6 +7365,15 @@ boost::statechart::result PG::RecoveryState::Active::react(const AllReplicasActi
   return discard_event();
 }
 
+boost::statechart::result PG::RecoveryState::Active::react(const DeferBackfill&)
+{
+  // the preemption was queued while we still held the reservation, but we
+  // have since finished or given up on backfill and released it
+  PG *pg = context< RecoveryMachine >().pg;
+  ldout(pg->cct, 10) << "ignoring stale backfill preemption" << dendl;
+  return discard_event();
+}
+
 void PG::RecoveryState::Active::exit()
 {
   context< RecoveryMachine >().log_exit(state_name, enter_time);
@@ -7248,6 +7478,16 @@ boost::statechart::result PG::RecoveryState::ReplicaActive::react(const QuerySta
   return forward_event();
 }
 
+boost::statechart::result PG::RecoveryState::ReplicaActive::react(
+  const RemoteBackfillPreempted&)
+{
+  // the preemption was queued while we still held the reservation, but
+  // backfill has since completed or been rejected and released it
+  PG *pg = context< RecoveryMachine >().pg;
+  ldout(pg->cct, 10) << "ignoring stale backfill preemption" << dendl;
+  return discard_event();
+}
+
 void PG::RecoveryState::ReplicaActive::exit()
 {
   context< RecoveryMachine >().log_exit(state_name, enter_time);
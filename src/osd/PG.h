@@ -825,6 +825,9 @@ protected:
   map<pg_shard_t, BackfillInterval> peer_backfill_info;
   bool backfill_reserved;
   bool backfill_reserving;
+  /// bumped for every backfill reservation request, so that preemptions
+  /// of an earlier reservation can be told apart from the current one
+  uint64_t backfill_reservation_seq;
 
   friend class OSD;
 
@@ -963,6 +966,10 @@ public:
   bool needs_recovery() const;
   bool needs_backfill() const;
 
+  /// number of acting shards not missing any objects
+  unsigned get_num_complete_shards() const;
+  /// small priority boost scaled by the number of degraded objects
+  int get_degraded_priority_bonus() const;
   /// get log recovery reservation priority
   unsigned get_recovery_priority();
   /// get backfill reservation priority
@@ -1207,6 +1214,11 @@ public:
     bool needs_sleep = true;
     utime_t sleep_start;
 
+    // throughput of the current scrub
+    utime_t stamp_start;
+    uint64_t objects_scanned = 0;
+    uint64_t bytes_scanned = 0;
+
     // flags to indicate explicitly requested scrubs (by admin)
     bool must_scrub, must_deep_scrub, must_repair;
 
@@ -1324,6 +1336,9 @@ public:
       sleeping = false;
       needs_sleep = true;
       sleep_start = utime_t();
+      stamp_start = utime_t();
+      objects_scanned = 0;
+      bytes_scanned = 0;
     }
 
     void create_results(const hobject_t& obj);
@@ -1397,6 +1412,8 @@ public:
 
   void reject_reservation();
   void schedule_backfill_full_retry();
+  /// wrap a backfill preemption callback (see osd_debug_backfill_preempt_delay)
+  Context *wrap_backfill_preempt(Context *c);
   void schedule_recovery_full_retry();
 
   // -- recovery state --
@@ -1543,6 +1560,27 @@ public:
       *out << "RequestBackfillPrio: priority " << priority;
     }
   };
+  // preemption of the backfill reservation tagged @reservation (see
+  // backfill_reservation_seq)
+  struct DeferBackfill : boost::statechart::event< DeferBackfill > {
+    uint64_t reservation;
+    explicit DeferBackfill(uint64_t r) :
+      boost::statechart::event< DeferBackfill >(),
+      reservation(r) {}
+    void print(std::ostream *out) const {
+      *out << "DeferBackfill: reservation " << reservation;
+    }
+  };
+  struct RemoteBackfillPreempted :
+    boost::statechart::event< RemoteBackfillPreempted > {
+    uint64_t reservation;
+    explicit RemoteBackfillPreempted(uint64_t r) :
+      boost::statechart::event< RemoteBackfillPreempted >(),
+      reservation(r) {}
+    void print(std::ostream *out) const {
+      *out << "RemoteBackfillPreempted: reservation " << reservation;
+    }
+  };
 #define TrivialEvent(T) struct T : boost::statechart::event< T > { \
     T() : boost::statechart::event< T >() {}			   \
     void print(std::ostream *out) const {			   \
@@ -1831,7 +1869,8 @@ public:
 	boost::statechart::custom_reaction< MNotifyRec >,
 	boost::statechart::custom_reaction< MLogRec >,
 	boost::statechart::custom_reaction< Backfilled >,
-	boost::statechart::custom_reaction< AllReplicasActivated >
+	boost::statechart::custom_reaction< AllReplicasActivated >,
+	boost::statechart::custom_reaction< DeferBackfill >
 	> reactions;
       boost::statechart::result react(const QueryState& q);
       boost::statechart::result react(const ActMap&);
@@ -1843,6 +1882,7 @@ public:
 	return discard_event();
       }
       boost::statechart::result react(const AllReplicasActivated&);
+      boost::statechart::result react(const DeferBackfill&);
     };
 
     struct Clean : boost::statechart::state< Clean, Active >, NamedState {
@@ -1869,10 +1909,12 @@ public:
     struct Backfilling : boost::statechart::state< Backfilling, Active >, NamedState {
       typedef boost::mpl::list<
 	boost::statechart::transition< Backfilled, Recovered >,
-	boost::statechart::custom_reaction< RemoteReservationRejected >
+	boost::statechart::custom_reaction< RemoteReservationRejected >,
+	boost::statechart::custom_reaction< DeferBackfill >
 	> reactions;
       explicit Backfilling(my_context ctx);
       boost::statechart::result react(const RemoteReservationRejected& evt);
+      boost::statechart::result react(const DeferBackfill& evt);
       void exit();
     };
 
@@ -1880,6 +1922,7 @@ public:
       typedef boost::mpl::list<
 	boost::statechart::custom_reaction< RemoteBackfillReserved >,
 	boost::statechart::custom_reaction< RemoteReservationRejected >,
+	boost::statechart::custom_reaction< DeferBackfill >,
 	boost::statechart::transition< AllBackfillsReserved, Backfilling >
 	> reactions;
       set<pg_shard_t>::const_iterator backfill_osd_it;
@@ -1887,6 +1930,7 @@ public:
       void exit();
       boost::statechart::result react(const RemoteBackfillReserved& evt);
       boost::statechart::result react(const RemoteReservationRejected& evt);
+      boost::statechart::result react(const DeferBackfill& evt);
     };
 
     struct WaitLocalBackfillReserved : boost::statechart::state< WaitLocalBackfillReserved, Active >, NamedState {
@@ -1928,7 +1972,8 @@ public:
 	boost::statechart::custom_reaction< MQuery >,
 	boost::statechart::custom_reaction< MInfoRec >,
 	boost::statechart::custom_reaction< MLogRec >,
-	boost::statechart::custom_reaction< Activate >
+	boost::statechart::custom_reaction< Activate >,
+	boost::statechart::custom_reaction< RemoteBackfillPreempted >
 	> reactions;
       boost::statechart::result react(const QueryState& q);
       boost::statechart::result react(const MInfoRec& infoevt);
@@ -1936,16 +1981,19 @@ public:
       boost::statechart::result react(const ActMap&);
       boost::statechart::result react(const MQuery&);
       boost::statechart::result react(const Activate&);
+      boost::statechart::result react(const RemoteBackfillPreempted&);
     };
 
     struct RepRecovering : boost::statechart::state< RepRecovering, ReplicaActive >, NamedState {
       typedef boost::mpl::list<
 	boost::statechart::transition< RecoveryDone, RepNotRecovering >,
 	boost::statechart::transition< RemoteReservationRejected, RepNotRecovering >,
-	boost::statechart::custom_reaction< BackfillTooFull >
+	boost::statechart::custom_reaction< BackfillTooFull >,
+	boost::statechart::custom_reaction< RemoteBackfillPreempted >
 	> reactions;
       explicit RepRecovering(my_context ctx);
       boost::statechart::result react(const BackfillTooFull &evt);
+      boost::statechart::result react(const RemoteBackfillPreempted &evt);
       void exit();
     };
 
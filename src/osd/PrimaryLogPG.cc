@@ -3289,6 +3289,7 @@ void PrimaryLogPG::log_op_stats(OpContext *ctx)
   osd->logger->inc(l_osd_op_inb, inb);
   osd->logger->tinc(l_osd_op_lat, latency);
   osd->logger->tinc(l_osd_op_process_lat, process_latency);
+  osd->note_client_op_latency(latency, now);
 
   if (op->may_read() && op->may_write()) {
     osd->logger->inc(l_osd_op_rw);
@@ -7106,6 +7107,53 @@ int PrimaryLogPG::prepare_transaction(OpContext *ctx)
   return result;
 }
 
+void PrimaryLogPG::calc_dirty_regions(OpContext *ctx, const hobject_t& soid,
+					object_dirty_regions_t *out)
+{
+  out->mark_all();
+  if (!ctx->obs->exists)
+    return;
+  auto p = ctx->op_t->op_map.find(soid);
+  out->start_tracking();
+  if (p == ctx->op_t->op_map.end())
+    return;  // xattrs only; those are always pushed in full
+  const PGTransaction::ObjectOperation &op = p->second;
+  if (op.is_fresh_object() || op.deletes_first()) {
+    out->mark_all();
+    return;
+  }
+  uint64_t old_size = ctx->obs->oi.size;
+  if (op.truncate && op.truncate->first < old_size)
+    out->mark_data(op.truncate->first, old_size - op.truncate->first);
+  for (auto i = op.buffer_updates.begin();
+       i != op.buffer_updates.end();
+       ++i) {
+    out->mark_data(i.get_off(), i.get_len());
+  }
+  if (op.clear_omap)
+    out->mark_omap_all();
+  for (auto &u : op.omap_updates) {
+    if (out->omap_all)
+      break;
+    bufferlist bl = u.second;
+    bufferlist::iterator bp = bl.begin();
+    if (u.first == PGTransaction::ObjectOperation::OmapUpdateType::Insert) {
+      map<string, bufferlist> keys;
+      ::decode(keys, bp);
+      for (auto &k : keys)
+	out->mark_omap_key(k.first);
+    } else {
+      set<string> keys;
+      ::decode(keys, bp);
+      for (auto &k : keys)
+	out->mark_omap_key(k);
+    }
+  }
+  out->limit(cct->_conf->osd_pg_log_dirty_extents_max,
+	     cct->_conf->osd_pg_log_dirty_omap_keys_max);
+  dout(20) << __func__ << " " << soid << " " << *out << dendl;
+}
+
 void PrimaryLogPG::finish_ctx(OpContext *ctx, int log_op_type, bool maintain_ssc)
 {
   const hobject_t& soid = ctx->obs->oi.soid;
@@ -7242,6 +7290,11 @@ void PrimaryLogPG::finish_ctx(OpContext *ctx, int log_op_type, bool maintain_ssc
 				    ctx->obs->oi.version,
 				    ctx->user_at_version, ctx->reqid,
 				    ctx->mtime, 0));
+  if (log_op_type == pg_log_entry_t::MODIFY &&
+      !pool.info.require_rollback() &&
+      cct->_conf->osd_recover_dirty_regions) {
+    calc_dirty_regions(ctx, soid, &ctx->log.back().dirty_regions);
+  }
   if (soid.snap < CEPH_NOSNAP) {
     switch (log_op_type) {
     case pg_log_entry_t::MODIFY:
@@ -1091,6 +1091,9 @@ protected:
     const hobject_t& head, const hobject_t& coid,
     object_info_t *poi);
   void execute_ctx(OpContext *ctx);
+  /// record what ctx changed in soid for incremental recovery
+  void calc_dirty_regions(OpContext *ctx, const hobject_t& soid,
+			  object_dirty_regions_t *out);
   void finish_ctx(OpContext *ctx, int log_op_type, bool maintain_ssc=true);
   void reply_ctx(OpContext *ctx, int err);
   void reply_ctx(OpContext *ctx, int err, eversion_t v, version_t uv);
@@ -1277,6 +1277,54 @@ void ReplicatedBackend::calc_head_subsets(
 	   << "  clone_subsets " << clone_subsets << dendl;
 }
 
+/**
+ * figure out what changed in soid between have and need
+ *
+ * Only possible if every update in between is in our log and recorded
+ * its dirty regions; otherwise the whole object has to be sent.
+ */
+bool ReplicatedBackend::calc_dirty_regions(
+  const hobject_t &soid,
+  eversion_t have,
+  eversion_t need,
+  object_dirty_regions_t *regions)
+{
+  if (!cct->_conf->osd_recover_dirty_regions ||
+      !HAVE_FEATURE(get_parent()->min_peer_features(), OSD_RECOVERY_DELTAS) ||
+      soid.snap != CEPH_NOSNAP ||
+      have == eversion_t())
+    return false;
+
+  const pg_log_t &log = get_parent()->get_log().get_log();
+  if (have < log.tail)
+    return false;
+
+  regions->start_tracking();
+  eversion_t expect = need;
+  for (list<pg_log_entry_t>::const_reverse_iterator p = log.log.rbegin();
+       p != log.log.rend() && p->version > have;
+       ++p) {
+    if (p->soid != soid || p->version > need || !p->object_is_indexed())
+      continue;
+    if (p->version != expect ||
+	!p->is_modify() ||
+	p->dirty_regions.is_all()) {
+      dout(20) << __func__ << " " << soid << " can't use " << *p << dendl;
+      return false;
+    }
+    regions->merge(p->dirty_regions);
+    expect = p->prior_version;
+  }
+  if (expect != have) {
+    dout(20) << __func__ << " " << soid << " log does not cover "
+	     << have << " -> " << need << dendl;
+    return false;
+  }
+  dout(10) << __func__ << " " << soid << " " << have << " -> " << need
+	   << " " << *regions << dendl;
+  return true;
+}
+
 void ReplicatedBackend::calc_clone_subsets(
   SnapSet& snapset, const hobject_t& soid,
   const pg_missing_t& missing,
@@ -1440,8 +1488,18 @@ void ReplicatedBackend::prepare_pull(
     recovery_info.size = ssc->snapset.clone_size[soid.snap];
   } else {
     // pulling head or unversioned object.
-    // always pull the whole thing.
-    recovery_info.copy_subset.insert(0, (uint64_t)-1);
+    // pull just what changed if our log says what that is, otherwise
+    // the whole thing.
+    eversion_t have = get_parent()->get_local_missing().get_items().find(
+      soid)->second.have;
+    object_dirty_regions_t regions;
+    if (v == _v && calc_dirty_regions(soid, have, v, &regions)) {
+      recovery_info.object_exist = true;
+      recovery_info.copy_subset = regions.data;
+      recovery_info.dirty_regions = regions;
+    } else {
+      recovery_info.copy_subset.insert(0, (uint64_t)-1);
+    }
     recovery_info.size = ((uint64_t)-1);
   }
 
@@ -1528,12 +1586,28 @@ void ReplicatedBackend::prep_push_to_replica(
     SnapSetContext *ssc = obc->ssc;
     assert(ssc);
     dout(15) << "push_to_replica snapset is " << ssc->snapset << dendl;
-    calc_head_subsets(
-      obc,
-      ssc->snapset, soid, get_parent()->get_shard_missing().find(peer)->second,
-      get_parent()->get_shard_info().find(peer)->second.last_backfill,
-      data_subset, clone_subsets,
-      lock_manager);
+    const pg_missing_t &pmissing =
+      get_parent()->get_shard_missing().find(peer)->second;
+    pg_missing_item item;
+    object_dirty_regions_t regions;
+    if (pmissing.is_missing(soid, &item) &&
+	item.need == oi.version &&
+	calc_dirty_regions(soid, item.have, item.need, &regions)) {
+      // the replica has an older copy; send only what changed since
+      interval_set<uint64_t> object_range;
+      if (size)
+	object_range.insert(0, size);
+      data_subset.intersection_of(regions.data, object_range);
+      pop->recovery_info.object_exist = true;
+      pop->recovery_info.dirty_regions = regions;
+    } else {
+      calc_head_subsets(
+	obc,
+	ssc->snapset, soid, pmissing,
+	get_parent()->get_shard_info().find(peer)->second.last_backfill,
+	data_subset, clone_subsets,
+	lock_manager);
+    }
   }
 
   prep_push(
@@ -1582,6 +1656,8 @@ void ReplicatedBackend::prep_push(
   pi.recovery_info.soid = soid;
   pi.recovery_info.oi = obc->obs.oi;
   pi.recovery_info.ss = pop->recovery_info.ss;
+  pi.recovery_info.object_exist = pop->recovery_info.object_exist;
+  pi.recovery_info.dirty_regions = pop->recovery_info.dirty_regions;
   pi.recovery_info.version = version;
   pi.lock_manager = std::move(lock_manager);
 
@@ -1620,7 +1696,22 @@ void ReplicatedBackend::submit_push_data(
     }
   }
 
-  if (first) {
+  if (first && recovery_info.object_exist) {
+    // patch our existing copy (or a clone of it, if this takes more
+    // than one push) with the regions that changed
+    if (target_oid != recovery_info.soid) {
+      t->remove(coll, ghobject_t(target_oid));
+      t->clone(coll, ghobject_t(recovery_info.soid), ghobject_t(target_oid));
+    }
+    t->truncate(coll, ghobject_t(target_oid), recovery_info.size);
+    if (recovery_info.dirty_regions.omap_all)
+      t->omap_clear(coll, ghobject_t(target_oid));
+    else if (!recovery_info.dirty_regions.omap_keys.empty())
+      t->omap_rmkeys(coll, ghobject_t(target_oid),
+		     recovery_info.dirty_regions.omap_keys);
+    t->omap_setheader(coll, ghobject_t(target_oid), omap_header);
+    t->rmattrs(coll, ghobject_t(target_oid));
+  } else if (first) {
     t->remove(coll, ghobject_t(target_oid));
     t->touch(coll, ghobject_t(target_oid));
     t->truncate(coll, ghobject_t(target_oid), recovery_info.size);
@@ -1951,7 +2042,38 @@ int ReplicatedBackend::build_push_op(const ObjectRecoveryInfo &recovery_info,
   }
 
   uint64_t available = cct->_conf->osd_recovery_max_chunk;
-  if (!progress.omap_complete) {
+  if (!progress.omap_complete &&
+      recovery_info.object_exist &&
+      !recovery_info.dirty_regions.omap_all) {
+    // just the keys that changed; the target has the rest
+    set<string> keys;
+    const set<string> &dirty = recovery_info.dirty_regions.omap_keys;
+    set<string>::const_iterator k = dirty.lower_bound(progress.omap_recovered_to);
+    for (; k != dirty.end(); ++k) {
+      if (!keys.empty() &&
+	  cct->_conf->osd_recovery_max_omap_entries_per_chunk > 0 &&
+	  keys.size() >= cct->_conf->osd_recovery_max_omap_entries_per_chunk)
+	break;
+      keys.insert(*k);
+    }
+    if (!keys.empty()) {
+      int r = store->omap_get_values(ch, ghobject_t(recovery_info.soid),
+				     keys, &out_op->omap_entries);
+      if (r < 0) {
+	dout(1) << __func__ << " omap_get_values failed: "
+		<< cpp_strerror(-r) << dendl;
+	return r;
+      }
+    }
+    for (auto& e : out_op->omap_entries) {
+      uint64_t len = e.first.size() + e.second.length();
+      available = len < available ? available - len : 0;
+    }
+    if (k == dirty.end())
+      new_progress.omap_complete = true;
+    else
+      new_progress.omap_recovered_to = *k;
+  } else if (!progress.omap_complete) {
     ObjectMap::ObjectMapIterator iter =
       store->get_omap_iterator(coll,
 			       ghobject_t(recovery_info.soid));
@@ -1981,8 +2103,14 @@ int ReplicatedBackend::build_push_op(const ObjectRecoveryInfo &recovery_info,
     if (!recovery_info.copy_subset.empty()) {
       interval_set<uint64_t> copy_subset = recovery_info.copy_subset;
       map<uint64_t, uint64_t> m;
-      int r = store->fiemap(ch, ghobject_t(recovery_info.soid), 0,
-                            copy_subset.range_end(), m);
+      int r = 0;
+      if (recovery_info.object_exist) {
+	// holes must be sent as zeros; the target may have data there
+	m[0] = copy_subset.range_end();
+      } else {
+	r = store->fiemap(ch, ghobject_t(recovery_info.soid), 0,
+			  copy_subset.range_end(), m);
+      }
       if (r >= 0)  {
         interval_set<uint64_t> fiemap_included(m);
         copy_subset.intersection_of(fiemap_included);
@@ -2126,9 +2254,15 @@ void ReplicatedBackend::handle_pull(pg_shard_t peer, PullOp &op, PushOp *reply)
     if (progress.first && recovery_info.size == ((uint64_t)-1)) {
       // Adjust size and copy_subset
       recovery_info.size = st.st_size;
-      recovery_info.copy_subset.clear();
+      interval_set<uint64_t> object_range;
       if (st.st_size)
-        recovery_info.copy_subset.insert(0, st.st_size);
+        object_range.insert(0, st.st_size);
+      if (recovery_info.object_exist) {
+	// puller only wants what changed
+	recovery_info.copy_subset.intersection_of(object_range);
+      } else {
+	recovery_info.copy_subset.swap(object_range);
+      }
       assert(recovery_info.clone_subset.empty());
     }
 
@@ -321,6 +321,11 @@ private:
     interval_set<uint64_t>& data_subset,
     map<hobject_t, interval_set<uint64_t>>& clone_subsets,
     ObcLockManager &lock_manager);
+  bool calc_dirty_regions(
+    const hobject_t &soid,
+    eversion_t have,
+    eversion_t need,
+    object_dirty_regions_t *regions);
   ObjectRecoveryInfo recalc_subsets(
     const ObjectRecoveryInfo& recovery_info,
     SnapSetContext *ssc,
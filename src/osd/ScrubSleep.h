@@ -0,0 +1,82 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_OSD_SCRUBSLEEP_H
+#define CEPH_OSD_SCRUBSLEEP_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+/**
+ * Adapts the sleep between scrub chunks to client op latency.
+ *
+ * Client latency is tracked as an average weighted by the time between
+ * samples, and it decays while no samples arrive.  An OSD that goes idle
+ * after a load spike therefore returns to the base sleep instead of
+ * keeping the last average until the next client op.
+ *
+ * All state is lock-free; concurrent callers update it with CAS loops.
+ * Times are in seconds.
+ */
+class ScrubSleep {
+  std::atomic<double> lat_avg = {0};  ///< average client op latency
+  std::atomic<double> lat_stamp = {0};  ///< time of the last sample
+  std::atomic<double> sleep = {0};    ///< current sleep between chunks
+
+public:
+  /// time constant of the client latency average
+  static constexpr double LATENCY_DECAY = 1.0;
+
+  void note_latency(double lat, double now) {
+    // every caller accounts for the time since the previous sample, so
+    // concurrent callers split the elapsed time between them
+    double last = lat_stamp.exchange(now);
+    double w = 1;
+    if (last > 0) {
+      w = now > last ? 1 - std::exp(-(now - last) / LATENCY_DECAY) : 0;
+    }
+    double avg = lat_avg.load();
+    while (!lat_avg.compare_exchange_weak(avg, avg + (lat - avg) * w)) ;
+  }
+
+  /// @returns the client latency average as of @p now
+  double get_latency(double now) const {
+    double avg = lat_avg.load();
+    double last = lat_stamp.load();
+    if (now > last) {
+      avg *= std::exp(-(now - last) / LATENCY_DECAY);
+    }
+    return avg;
+  }
+
+  /**
+   * Back off multiplicatively (up to @p max) while the client latency is
+   * above @p target, and recover the same way (down to @p base) once it
+   * is not.  A non-positive @p target disables the adaptation.
+   *
+   * @returns the sleep before the next chunk
+   */
+  double get_sleep(double now, double base, double max, double target) {
+    if (target <= 0) {
+      return base;
+    }
+    bool backoff = get_latency(now) > target;
+    double cur = sleep.load();
+    double next;
+    do {
+      if (backoff) {
+	next = std::min(std::max(cur * 2, std::max(base, .001)),
+			std::max(base, max));
+      } else {
+	next = std::max(cur / 2, base);
+	if (next < .001) {
+	  next = base;
+	}
+      }
+    } while (!sleep.compare_exchange_weak(cur, next));
+    return next;
+  }
+};
+
+#endif
@@ -3873,6 +3873,65 @@ void ObjectModDesc::decode(bufferlist::iterator &_bl)
   DECODE_FINISH(_bl);
 }
 
+// -- object_dirty_regions_t --
+
+void object_dirty_regions_t::encode(bufferlist &bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(tracked, bl);
+  ::encode(omap_all, bl);
+  ::encode(data, bl);
+  ::encode(omap_keys, bl);
+  ENCODE_FINISH(bl);
+}
+
+void object_dirty_regions_t::decode(bufferlist::iterator &bl)
+{
+  DECODE_START(1, bl);
+  ::decode(tracked, bl);
+  ::decode(omap_all, bl);
+  ::decode(data, bl);
+  ::decode(omap_keys, bl);
+  DECODE_FINISH(bl);
+}
+
+void object_dirty_regions_t::dump(Formatter *f) const
+{
+  f->dump_bool("tracked", tracked);
+  f->dump_bool("omap_all", omap_all);
+  f->dump_stream("data") << data;
+  f->open_array_section("omap_keys");
+  for (auto& k : omap_keys)
+    f->dump_string("key", k);
+  f->close_section();
+}
+
+void object_dirty_regions_t::generate_test_instances(
+  list<object_dirty_regions_t*>& o)
+{
+  o.push_back(new object_dirty_regions_t());
+  o.push_back(new object_dirty_regions_t());
+  o.back()->start_tracking();
+  o.back()->mark_data(0, 4096);
+  o.back()->mark_data(65536, 100);
+  o.back()->mark_omap_key("foo");
+  o.push_back(new object_dirty_regions_t());
+  o.back()->start_tracking();
+  o.back()->mark_omap_all();
+}
+
+ostream& operator<<(ostream& out, const object_dirty_regions_t &r)
+{
+  if (!r.tracked)
+    return out << "dirty(all)";
+  out << "dirty(data " << r.data;
+  if (r.omap_all)
+    out << " omap all";
+  else if (!r.omap_keys.empty())
+    out << " omap " << r.omap_keys.size() << " keys";
+  return out << ")";
+}
+
 // -- pg_log_entry_t --
 
 string pg_log_entry_t::get_key_name() const
@@ -3903,7 +3962,7 @@ void pg_log_entry_t::decode_with_checksum(bufferlist::iterator& p)
 
 void pg_log_entry_t::encode(bufferlist &bl) const
 {
-  ENCODE_START(11, 4, bl);
+  ENCODE_START(12, 4, bl);
   ::encode(op, bl);
   ::encode(soid, bl);
   ::encode(version, bl);
@@ -3930,12 +3989,14 @@ void pg_log_entry_t::encode(bufferlist &bl) const
   ::encode(extra_reqids, bl);
   if (op == ERROR)
     ::encode(return_code, bl);
+  if (op == MODIFY)
+    ::encode(dirty_regions, bl);
   ENCODE_FINISH(bl);
 }
 
 void pg_log_entry_t::decode(bufferlist::iterator &bl)
 {
-  DECODE_START_LEGACY_COMPAT_LEN(11, 4, 4, bl);
+  DECODE_START_LEGACY_COMPAT_LEN(12, 4, 4, bl);
   ::decode(op, bl);
   if (struct_v < 2) {
     sobject_t old_soid;
@@ -3988,6 +4049,8 @@ void pg_log_entry_t::decode(bufferlist::iterator &bl)
     ::decode(extra_reqids, bl);
   if (struct_v >= 11 && op == ERROR)
     ::decode(return_code, bl);
+  if (struct_v >= 12 && op == MODIFY)
+    ::decode(dirty_regions, bl);
   DECODE_FINISH(bl);
 }
 
@@ -4030,6 +4093,11 @@ void pg_log_entry_t::dump(Formatter *f) const
     mod_desc.dump(f);
     f->close_section();
   }
+  if (op == MODIFY) {
+    f->open_object_section("dirty_regions");
+    dirty_regions.dump(f);
+    f->close_section();
+  }
 }
 
 void pg_log_entry_t::generate_test_instances(list<pg_log_entry_t*>& o)
@@ -4039,6 +4107,9 @@ void pg_log_entry_t::generate_test_instances(list<pg_log_entry_t*>& o)
   o.push_back(new pg_log_entry_t(MODIFY, oid, eversion_t(1,2), eversion_t(3,4),
 				 1, osd_reqid_t(entity_name_t::CLIENT(777), 8, 999),
 				 utime_t(8,9), 0));
+  o.back()->dirty_regions.start_tracking();
+  o.back()->dirty_regions.mark_data(0, 4096);
+  o.back()->dirty_regions.mark_omap_key("foo");
   o.push_back(new pg_log_entry_t(ERROR, oid, eversion_t(1,2), eversion_t(3,4),
 				 1, osd_reqid_t(entity_name_t::CLIENT(777), 8, 999),
 				 utime_t(8,9), -ENOENT));
@@ -5223,7 +5294,7 @@ void ObjectRecoveryProgress::dump(Formatter *f) const
 
 void ObjectRecoveryInfo::encode(bufferlist &bl, uint64_t features) const
 {
-  ENCODE_START(2, 1, bl);
+  ENCODE_START(3, 1, bl);
   ::encode(soid, bl);
   ::encode(version, bl);
   ::encode(size, bl);
@@ -5231,13 +5302,15 @@ void ObjectRecoveryInfo::encode(bufferlist &bl, uint64_t features) const
   ::encode(ss, bl);
   ::encode(copy_subset, bl);
   ::encode(clone_subset, bl);
+  ::encode(object_exist, bl);
+  ::encode(dirty_regions, bl);
   ENCODE_FINISH(bl);
 }
 
 void ObjectRecoveryInfo::decode(bufferlist::iterator &bl,
 				int64_t pool)
 {
-  DECODE_START(2, bl);
+  DECODE_START(3, bl);
   ::decode(soid, bl);
   ::decode(version, bl);
   ::decode(size, bl);
@@ -5245,6 +5318,10 @@ void ObjectRecoveryInfo::decode(bufferlist::iterator &bl,
   ::decode(ss, bl);
   ::decode(copy_subset, bl);
   ::decode(clone_subset, bl);
+  if (struct_v >= 3) {
+    ::decode(object_exist, bl);
+    ::decode(dirty_regions, bl);
+  }
   DECODE_FINISH(bl);
 
   if (struct_v < 2) {
@@ -5290,6 +5367,12 @@ void ObjectRecoveryInfo::dump(Formatter *f) const
   }
   f->dump_stream("copy_subset") << copy_subset;
   f->dump_stream("clone_subset") << clone_subset;
+  f->dump_bool("object_exist", object_exist);
+  if (object_exist) {
+    f->open_object_section("dirty_regions");
+    dirty_regions.dump(f);
+    f->close_section();
+  }
 }
 
 ostream& operator<<(ostream& out, const ObjectRecoveryInfo &inf)
@@ -5299,13 +5382,15 @@ ostream& operator<<(ostream& out, const ObjectRecoveryInfo &inf)
 
 ostream &ObjectRecoveryInfo::print(ostream &out) const
 {
-  return out << "ObjectRecoveryInfo("
-	     << soid << "@" << version
-	     << ", size: " << size
-	     << ", copy_subset: " << copy_subset
-	     << ", clone_subset: " << clone_subset
-	     << ", snapset: " << ss
-	     << ")";
+  out << "ObjectRecoveryInfo("
+      << soid << "@" << version
+      << ", size: " << size
+      << ", copy_subset: " << copy_subset
+      << ", clone_subset: " << clone_subset
+      << ", snapset: " << ss;
+  if (object_exist)
+    out << ", object_exist " << dirty_regions;
+  return out << ")";
 }
 
 // -- PushReplyOp --
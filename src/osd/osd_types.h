@@ -80,6 +80,9 @@
 /// base backfill priority for MBackfillReserve (inactive PG)
 #define OSD_BACKFILL_INACTIVE_PRIORITY_BASE 220
 
+/// priority boost per copy a degraded/undersized PG is short of pool size
+#define OSD_RECOVERY_PRIORITY_REDUNDANCY_STEP 8
+
 /// max recovery priority for MBackfillReserve
 #define OSD_RECOVERY_PRIORITY_MAX 255
 
@@ -3249,6 +3252,85 @@ public:
 };
 WRITE_CLASS_ENCODER(ObjectModDesc)
 
+/**
+ * object_dirty_regions_t - extents and omap keys touched by an update
+ *
+ * Recorded in MODIFY log entries so that recovery of a peer whose copy
+ * is only a few entries behind can push what actually changed rather
+ * than the whole object.  An untracked instance (the default, and what
+ * older entries decode to) means anything may have changed.
+ */
+struct object_dirty_regions_t {
+  bool tracked = false;
+  bool omap_all = false;        ///< omap cleared or too many keys to list
+  interval_set<uint64_t> data;  ///< modified extents
+  set<string> omap_keys;        ///< set or removed omap keys
+
+  bool is_all() const {
+    return !tracked;
+  }
+  void start_tracking() {
+    tracked = true;
+    omap_all = false;
+    data.clear();
+    omap_keys.clear();
+  }
+  void mark_all() {
+    tracked = false;
+    omap_all = false;
+    data.clear();
+    omap_keys.clear();
+  }
+  void mark_data(uint64_t off, uint64_t len) {
+    if (len)
+      data.union_insert(off, len);
+  }
+  void mark_omap_all() {
+    omap_all = true;
+    omap_keys.clear();
+  }
+  void mark_omap_key(const string &key) {
+    if (!omap_all)
+      omap_keys.insert(key);
+  }
+
+  /// accumulate the regions of a later update
+  void merge(const object_dirty_regions_t &o) {
+    if (!tracked)
+      return;
+    if (!o.tracked) {
+      mark_all();
+      return;
+    }
+    data.union_of(o.data);
+    if (o.omap_all)
+      mark_omap_all();
+    else if (!omap_all)
+      omap_keys.insert(o.omap_keys.begin(), o.omap_keys.end());
+  }
+
+  /// bound the encoded size, giving up precision rather than correctness
+  void limit(unsigned max_extents, unsigned max_keys) {
+    if (!tracked)
+      return;
+    if (data.num_intervals() > max_extents) {
+      uint64_t start = data.range_start();
+      uint64_t end = data.range_end();
+      data.clear();
+      data.insert(start, end - start);
+    }
+    if (omap_keys.size() > max_keys)
+      mark_omap_all();
+  }
+
+  void encode(bufferlist &bl) const;
+  void decode(bufferlist::iterator &bl);
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<object_dirty_regions_t*>& o);
+};
+WRITE_CLASS_ENCODER(object_dirty_regions_t)
+ostream& operator<<(ostream& out, const object_dirty_regions_t &r);
+
 
 /**
  * pg_log_entry_t - single entry/event in pg log
@@ -3299,6 +3381,8 @@ struct pg_log_entry_t {
 
   // describes state for a locally-rollbackable entry
   ObjectModDesc mod_desc;
+  // what a MODIFY touched, for incremental recovery
+  object_dirty_regions_t dirty_regions;
   bufferlist snaps;   // only for clone entries
   hobject_t  soid;
   osd_reqid_t reqid;  // caller+tid to uniquely identify request
@@ -4582,6 +4666,10 @@ struct ObjectRecoveryInfo {
   SnapSet ss;   // only populated if soid is_snap()
   interval_set<uint64_t> copy_subset;
   map<hobject_t, interval_set<uint64_t>> clone_subset;
+  /// target already has a prior version; apply copy_subset and
+  /// dirty_regions' omap keys to it in place
+  bool object_exist = false;
+  object_dirty_regions_t dirty_regions;  ///< only if object_exist
 
   ObjectRecoveryInfo() : size(0) { }
 
@@ -395,11 +395,13 @@ void Objecter::init()
  */
 void Objecter::start(const OSDMap* o)
 {
-  shared_lock rl(rwlock);
+  unique_lock wl(rwlock);
 
   start_tick();
   if (o) {
-    osdmap->deepish_copy_from(*o);
+    OSDMap *next = new OSDMap;
+    next->deepish_copy_from(*o);
+    _set_osdmap(next);
   } else if (osdmap->get_epoch() == 0) {
     _maybe_request_map();
   }
@@ -1181,12 +1183,17 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	  ldout(cct, 3) << "handle_osd_map decoding incremental epoch " << e
 			<< dendl;
 	  OSDMap::Incremental inc(m->incremental_maps[e]);
-	  osdmap->apply_incremental(inc);
+	  OSDMap *next = new OSDMap;
+	  next->deepish_copy_from(*osdmap);
+	  next->apply_incremental(inc);
+	  _set_osdmap(next);
 	  logger->inc(l_osdc_map_inc);
 	}
 	else if (m->maps.count(e)) {
 	  ldout(cct, 3) << "handle_osd_map decoding full epoch " << e << dendl;
-	  osdmap->decode(m->maps[e]);
+	  OSDMap *next = new OSDMap;
+	  next->decode(m->maps[e]);
+	  _set_osdmap(next);
 	  logger->inc(l_osdc_map_full);
 	}
 	else {
@@ -1241,7 +1248,9 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	}
 	ldout(cct, 3) << "handle_osd_map decoding full epoch "
 		      << m->get_last() << dendl;
-	osdmap->decode(m->maps[m->get_last()]);
+	OSDMap *next = new OSDMap;
+	next->decode(m->maps[m->get_last()]);
+	_set_osdmap(next);
 
 	_scan_requests(homeless_session, false, false, NULL,
 		       need_resend, need_resend_linger,
@@ -2191,17 +2200,44 @@ void Objecter::resend_mon_ops()
 
 void Objecter::op_submit(Op *op, ceph_tid_t *ptid, int *ctx_budget)
 {
-  shunique_lock rl(rwlock, ceph::acquire_shared);
   ceph_tid_t tid = 0;
   if (!ptid)
     ptid = &tid;
   op->trace.event("op submit");
-  _op_submit_with_budget(op, rl, ptid, ctx_budget);
+
+  // throttle before taking the rwlock so that the budget accounting
+  // doesn't add to the time the lock is held, and blocking on the budget
+  // doesn't need to drop and retake it.
+  if (!op->ctx_budgeted || (ctx_budget && (*ctx_budget == -1))) {
+    int op_budget = take_op_budget(op);
+    if (ctx_budget && (*ctx_budget == -1)) {
+      *ctx_budget = op_budget;
+    }
+  }
+
+  // map the op against a snapshot of the current osdmap before taking
+  // the rwlock too: the crush calculation is most of the cost of
+  // submitting an op.  _op_submit() only redoes it if a new map got in
+  // before we took the lock.  localized reads need crush_location, which
+  // is protected by the rwlock.
+  epoch_t target_epoch = 0;
+  if (!(op->target.flags & CEPH_OSD_FLAG_LOCALIZE_READS)) {
+    OSDMapRef map = std::atomic_load(&osdmap);
+    if (map->get_epoch() &&
+	_calc_target(*map, &op->target, nullptr) !=
+	  RECALC_OP_TARGET_POOL_DNE) {
+      target_epoch = map->get_epoch();
+    }
+  }
+
+  shunique_lock rl(rwlock, ceph::acquire_shared);
+  _op_submit_with_budget(op, rl, ptid, ctx_budget, target_epoch);
 }
 
 void Objecter::_op_submit_with_budget(Op *op, shunique_lock& sul,
 				      ceph_tid_t *ptid,
-				      int *ctx_budget)
+				      int *ctx_budget,
+				      epoch_t target_epoch)
 {
   assert(initialized.read());
 
@@ -2211,7 +2247,8 @@ void Objecter::_op_submit_with_budget(Op *op, shunique_lock& sul,
 
   // throttle.  before we look at any state, because
   // _take_op_budget() may drop our lock while it blocks.
-  if (!op->ctx_budgeted || (ctx_budget && (*ctx_budget == -1))) {
+  if (!op->budgeted &&
+      (!op->ctx_budgeted || (ctx_budget && (*ctx_budget == -1)))) {
     int op_budget = _take_op_budget(op, sul);
     // take and pass out the budget for the first OP
     // in the context session
@@ -2229,7 +2266,7 @@ void Objecter::_op_submit_with_budget(Op *op, shunique_lock& sul,
 				      op_cancel(tid, -ETIMEDOUT); });
   }
 
-  _op_submit(op, sul, ptid);
+  _op_submit(op, sul, ptid, target_epoch);
 }
 
 void Objecter::_send_op_account(Op *op)
@@ -2305,18 +2342,22 @@ void Objecter::_send_op_account(Op *op)
   }
 }
 
-void Objecter::_op_submit(Op *op, shunique_lock& sul, ceph_tid_t *ptid)
+void Objecter::_op_submit(Op *op, shunique_lock& sul, ceph_tid_t *ptid,
+			  epoch_t target_epoch)
 {
   // rwlock is locked
 
   ldout(cct, 10) << __func__ << " op " << op << dendl;
 
-  // pick target
+  // pick target, unless the caller already did with this very map
   assert(op->session == NULL);
   OSDSession *s = NULL;
 
-  bool check_for_latest_map = _calc_target(&op->target, nullptr)
-    == RECALC_OP_TARGET_POOL_DNE;
+  bool check_for_latest_map = false;
+  if (!target_epoch || target_epoch != osdmap->get_epoch()) {
+    check_for_latest_map = _calc_target(&op->target, nullptr)
+      == RECALC_OP_TARGET_POOL_DNE;
+  }
 
   // Try to get a session, including a retry if we need to take write lock
   int r = _get_session(op->target.osd, &s, sul);
@@ -2582,16 +2623,17 @@ bool Objecter::is_pg_changed(
   return false;      // same primary (tho replicas may have changed)
 }
 
-bool Objecter::target_should_be_paused(op_target_t *t)
+bool Objecter::target_should_be_paused(const OSDMap& map, op_target_t *t)
 {
-  const pg_pool_t *pi = osdmap->get_pg_pool(t->base_oloc.pool);
-  bool pauserd = osdmap->test_flag(CEPH_OSDMAP_PAUSERD);
-  bool pausewr = osdmap->test_flag(CEPH_OSDMAP_PAUSEWR) ||
-    _osdmap_full_flag() || _osdmap_pool_full(*pi);
+  const pg_pool_t *pi = map.get_pg_pool(t->base_oloc.pool);
+  bool pauserd = map.test_flag(CEPH_OSDMAP_PAUSERD);
+  bool pausewr = map.test_flag(CEPH_OSDMAP_PAUSEWR) ||
+    (map.test_flag(CEPH_OSDMAP_FULL) && honor_osdmap_full) ||
+    _osdmap_pool_full(*pi);
 
   return (t->flags & CEPH_OSD_FLAG_READ && pauserd) ||
     (t->flags & CEPH_OSD_FLAG_WRITE && pausewr) ||
-    (osdmap->get_epoch() < epoch_barrier);
+    (map.get_epoch() < epoch_barrier);
 }
 
 /**
@@ -2685,12 +2727,13 @@ int64_t Objecter::get_object_pg_hash_position(int64_t pool, const string& key,
   return p->raw_hash_to_pg(p->hash_key(key, ns));
 }
 
-int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
+int Objecter::_calc_target(const OSDMap& map, op_target_t *t, Connection *con,
+			   bool any_change)
 {
-  // rwlock is locked
+  // rwlock is locked, or map is a snapshot and t is not shared yet
   bool is_read = t->flags & CEPH_OSD_FLAG_READ;
   bool is_write = t->flags & CEPH_OSD_FLAG_WRITE;
-  t->epoch = osdmap->get_epoch();
+  t->epoch = map.get_epoch();
   ldout(cct,20) << __func__ << " epoch " << t->epoch
 		<< " base " << t->base_oid << " " << t->base_oloc
 		<< " precalc_pgid " << (int)t->precalc_pgid
@@ -2699,7 +2742,7 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
 		<< (is_write ? " is_write" : "")
 		<< dendl;
 
-  const pg_pool_t *pi = osdmap->get_pg_pool(t->base_oloc.pool);
+  const pg_pool_t *pi = map.get_pg_pool(t->base_oloc.pool);
   if (!pi) {
     t->osd = -1;
     return RECALC_OP_TARGET_POOL_DNE;
@@ -2708,7 +2751,7 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
 		<< " pg_num " << pi->get_pg_num() << dendl;
 
   bool force_resend = false;
-  if (osdmap->get_epoch() == pi->last_force_op_resend) {
+  if (map.get_epoch() == pi->last_force_op_resend) {
     if (t->last_force_resend < pi->last_force_op_resend) {
       t->last_force_resend = pi->last_force_op_resend;
       force_resend = true;
@@ -2725,7 +2768,7 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
       t->target_oloc.pool = pi->read_tier;
     if (is_write && pi->has_write_tier())
       t->target_oloc.pool = pi->write_tier;
-    pi = osdmap->get_pg_pool(t->target_oloc.pool);
+    pi = map.get_pg_pool(t->target_oloc.pool);
     if (!pi) {
       t->osd = -1;
       return RECALC_OP_TARGET_POOL_DNE;
@@ -2739,7 +2782,7 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
     assert(t->base_oloc.pool == (int64_t)t->base_pgid.pool());
     pgid = t->base_pgid;
   } else {
-    int ret = osdmap->object_locator_to_pg(t->target_oid, t->target_oloc,
+    int ret = map.object_locator_to_pg(t->target_oid, t->target_oloc,
 					   pgid);
     if (ret == -ENOENT) {
       t->osd = -1;
@@ -2757,9 +2800,9 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
   unsigned pg_num = pi->get_pg_num();
   int up_primary, acting_primary;
   vector<int> up, acting;
-  osdmap->pg_to_up_acting_osds(pgid, &up, &up_primary,
+  map.pg_to_up_acting_osds(pgid, &up, &up_primary,
 			       &acting, &acting_primary);
-  bool sort_bitwise = osdmap->test_flag(CEPH_OSDMAP_SORTBITWISE);
+  bool sort_bitwise = map.test_flag(CEPH_OSDMAP_SORTBITWISE);
   unsigned prev_seed = ceph_stable_mod(pgid.ps(), t->pg_num, t->pg_num_mask);
   pg_t prev_pgid(prev_seed, pgid.pool());
   if (any_change && PastIntervals::is_new_interval(
@@ -2784,7 +2827,7 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
   }
 
   bool unpaused = false;
-  if (t->paused && !target_should_be_paused(t)) {
+  if (t->paused && !target_should_be_paused(map, t)) {
     t->paused = false;
     unpaused = true;
   }
@@ -2809,7 +2852,7 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
     t->min_size = min_size;
     t->pg_num = pg_num;
     t->pg_num_mask = pi->get_pg_num_mask();
-    osdmap->get_primary_shard(
+    map.get_primary_shard(
       pg_t(ceph_stable_mod(pgid.ps(), t->pg_num, t->pg_num_mask), pgid.pool()),
       &t->actual_pgid);
     t->sort_bitwise = sort_bitwise;
@@ -2837,7 +2880,7 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
 	int best = -1;
 	int best_locality = 0;
 	for (unsigned i = 0; i < acting.size(); ++i) {
-	  int locality = osdmap->crush->get_common_ancestor_distance(
+	  int locality = map.crush->get_common_ancestor_distance(
 		 cct, acting[i], crush_location);
 	  ldout(cct, 20) << __func__ << " localize: rank " << i
 			 << " osd." << acting[i]
@@ -4871,8 +4914,6 @@ Objecter::OSDSession::~OSDSession()
 
 Objecter::~Objecter()
 {
-  delete osdmap;
-
   assert(homeless_session->get_nref() == 1);
   assert(num_homeless_ops.read() == 0);
   homeless_session->put();
@@ -1175,7 +1175,10 @@ public:
   Finisher *finisher;
   ZTracer::Endpoint trace_endpoint;
 private:
-  OSDMap    *osdmap;
+  // each epoch is a new map, never modified once published: ops look up
+  // their target in a snapshot loaded with std::atomic_load() without the
+  // rwlock, see op_submit().  replaced under the write lock.
+  OSDMapRef osdmap;
 public:
   using Dispatcher::cct;
   std::multimap<string,string> crush_location;
@@ -1878,9 +1881,16 @@ public:
   bool _osdmap_full_flag() const;
   bool _osdmap_has_pool_full() const;
 
-  bool target_should_be_paused(op_target_t *op);
-  int _calc_target(op_target_t *t, Connection *con,
+  bool target_should_be_paused(const OSDMap& map, op_target_t *op);
+  int _calc_target(const OSDMap& map, op_target_t *t, Connection *con,
 		   bool any_change = false);
+  int _calc_target(op_target_t *t, Connection *con,
+		   bool any_change = false) {
+    return _calc_target(*osdmap, t, con, any_change);
+  }
+  void _set_osdmap(OSDMap *o) {
+    std::atomic_store(&osdmap, OSDMapRef(o));
+  }
   int _map_session(op_target_t *op, OSDSession **s,
 		   shunique_lock& lc);
 
@@ -1957,6 +1967,19 @@ private:
     op->budgeted = true;
     return op_budget;
   }
+  int take_op_budget(Op *op) {
+    // rwlock is not held, so blocking on the throttles is fine
+    int op_budget = calc_op_budget(op);
+    if (keep_balanced_budget) {
+      op_throttle_bytes.get(op_budget);
+      op_throttle_ops.get(1);
+    } else {
+      op_throttle_bytes.take(op_budget);
+      op_throttle_ops.take(1);
+    }
+    op->budgeted = true;
+    return op_budget;
+  }
   void put_op_budget_bytes(int op_budget) {
     assert(op_budget >= 0);
     op_throttle_bytes.put(op_budget);
@@ -2082,10 +2105,12 @@ private:
 private:
 
   // low-level
-  void _op_submit(Op *op, shunique_lock& lc, ceph_tid_t *ptid);
+  void _op_submit(Op *op, shunique_lock& lc, ceph_tid_t *ptid,
+		  epoch_t target_epoch = 0);
   void _op_submit_with_budget(Op *op, shunique_lock& lc,
 			      ceph_tid_t *ptid,
-			      int *ctx_budget = NULL);
+			      int *ctx_budget = NULL,
+			      epoch_t target_epoch = 0);
   inline void unregister_op(Op *op);
 
   // public interface
@@ -301,3 +301,108 @@ void ObjectCache::chain_cache(RGWChainedCache *cache) {
   chained_cache.push_back(cache);
 }
 
+uint64_t ObjectDataCache::get_gen()
+{
+  Mutex::Locker l(lock);
+  return gen;
+}
+
+int ObjectDataCache::get(const string& name, ObjectDataCacheEntry& entry)
+{
+  Mutex::Locker l(lock);
+
+  auto iter = cache_map.find(name);
+  if (iter == cache_map.end()) {
+    ldout(cct, 20) << "data cache get: name=" << name << " : miss" << dendl;
+    return -ENOENT;
+  }
+
+  ObjectDataCacheEntry& e = iter->second;
+  lru.splice(lru.end(), lru, e.lru_iter);
+
+  entry = e;
+  ldout(cct, 20) << "data cache get: name=" << name << " : hit" << dendl;
+  return 0;
+}
+
+void ObjectDataCache::put(const string& name, ObjectDataCacheEntry& entry, uint64_t read_gen)
+{
+  Mutex::Locker l(lock);
+
+  if (read_gen != gen) {
+    /* something was invalidated since the caller read this, it may be us */
+    ldout(cct, 20) << "data cache put: name=" << name << " : raced with invalidation" << dendl;
+    return;
+  }
+
+  const uint64_t max_bytes = cct->_conf->rgw_obj_data_cache_size;
+  const uint64_t charge = entry.charge();
+  if (charge > max_bytes) {
+    return;
+  }
+
+  auto iter = cache_map.find(name);
+  if (iter != cache_map.end()) {
+    evict(iter);
+  }
+
+  while (total_bytes + charge > max_bytes && !lru.empty()) {
+    evict(cache_map.find(lru.front()));
+  }
+
+  ldout(cct, 20) << "data cache put: name=" << name << " size=" << entry.size << dendl;
+  auto& e = cache_map[name];
+  e = entry;
+  lru.push_back(name);
+  e.lru_iter = --lru.end();
+  total_bytes += charge;
+}
+
+bool ObjectDataCache::revalidate(const string& name, ObjectDataCacheEntry& entry,
+                                 uint64_t size, const real_time& mtime, uint64_t epoch,
+                                 map<string, bufferlist>& attrs, uint64_t read_gen)
+{
+  auto iter = attrs.find(RGW_ATTR_ETAG);
+  string etag = (iter != attrs.end() ? iter->second.to_str() : string());
+  if (size != entry.size || mtime != entry.mtime || etag != entry.etag) {
+    ldout(cct, 10) << "data cache: " << name << " changed, dropping" << dendl;
+    remove(name);
+    return false;
+  }
+
+  entry.epoch = epoch;
+  entry.attrs = std::move(attrs);
+  entry.validated = ceph::coarse_mono_clock::now();
+  put(name, entry, read_gen);
+  return true;
+}
+
+void ObjectDataCache::remove(const string& name)
+{
+  Mutex::Locker l(lock);
+
+  ++gen;
+  auto iter = cache_map.find(name);
+  if (iter == cache_map.end()) {
+    return;
+  }
+  ldout(cct, 10) << "removing " << name << " from data cache" << dendl;
+  evict(iter);
+}
+
+void ObjectDataCache::invalidate_all()
+{
+  Mutex::Locker l(lock);
+
+  ++gen;
+  cache_map.clear();
+  lru.clear();
+  total_bytes = 0;
+}
+
+void ObjectDataCache::evict(std::map<string, ObjectDataCacheEntry>::iterator iter)
+{
+  total_bytes -= iter->second.charge();
+  lru.erase(iter->second.lru_iter);
+  cache_map.erase(iter);
+}
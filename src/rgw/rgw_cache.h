@@ -10,11 +10,13 @@
 #include "include/types.h"
 #include "include/utime.h"
 #include "include/assert.h"
+#include "common/ceph_time.h"
 #include "common/RWLock.h"
 
 enum {
   UPDATE_OBJ,
   REMOVE_OBJ,
+  REMOVE_OBJ_DATA,
 };
 
 #define CACHE_FLAG_DATA           0x01
@@ -168,10 +170,76 @@ public:
   void invalidate_all();
 };
 
+struct ObjectDataCacheEntry {
+  uint64_t size{0};
+  real_time mtime;
+  uint64_t epoch{0};
+  string etag;
+  map<string, bufferlist> attrs;
+  bufferlist data;
+  ceph::coarse_mono_time validated;
+  std::list<string>::iterator lru_iter;
+
+  uint64_t charge() const {
+    uint64_t total = data.length();
+    for (auto& a : attrs) {
+      total += a.first.size() + a.second.length();
+    }
+    return total;
+  }
+};
+
+/*
+ * Heads of small objects, so that GETs of hot objects don't have to go to
+ * rados at all.  Bounded by rgw_obj_data_cache_size bytes.  Entries older
+ * than rgw_obj_data_cache_ttl are checked against the object's size, mtime
+ * and etag before they are used again.  Writes drop entries here and, via
+ * REMOVE_OBJ_DATA notifications, on the other gateways.
+ */
+class ObjectDataCache {
+  std::map<string, ObjectDataCacheEntry> cache_map;
+  std::list<string> lru;
+  uint64_t total_bytes{0};
+  uint64_t gen{0}; // bumped by every removal
+  Mutex lock;
+  CephContext *cct{nullptr};
+
+  void evict(std::map<string, ObjectDataCacheEntry>::iterator iter);
+
+public:
+  ObjectDataCache() : lock("ObjectDataCache") {}
+
+  void set_ctx(CephContext *_cct) {
+    cct = _cct;
+  }
+  bool enabled() const {
+    return cct && cct->_conf->rgw_obj_data_cache_size > 0;
+  }
+  bool is_expired(const ObjectDataCacheEntry& entry) const {
+    auto ttl = std::chrono::seconds(cct->_conf->rgw_obj_data_cache_ttl);
+    return ceph::coarse_mono_clock::now() - entry.validated > ttl;
+  }
+
+  /* read before looking up rados, and pass to put(), so that a head read
+   * before a concurrent write is not cached after the write dropped it */
+  uint64_t get_gen();
+
+  int get(const string& name, ObjectDataCacheEntry& entry);
+  void put(const string& name, ObjectDataCacheEntry& entry, uint64_t read_gen);
+  /* for an expired entry: keep it if the object still has the same size,
+   * mtime and etag, drop it otherwise.  @returns whether it is still valid */
+  bool revalidate(const string& name, ObjectDataCacheEntry& entry,
+                  uint64_t size, const real_time& mtime, uint64_t epoch,
+                  map<string, bufferlist>& attrs, uint64_t read_gen);
+  void remove(const string& name);
+  void invalidate_all();
+};
+
 template <class T>
 class RGWCache  : public T
 {
   ObjectCache cache;
+  ObjectDataCache data_cache;
 
   int list_objects_raw_init(rgw_pool& pool, RGWAccessHandle *handle) {
     return T::list_objects_raw_init(pool, handle);
@@ -195,6 +263,7 @@ class RGWCache  : public T
   int init_rados() override {
     int ret;
     cache.set_ctx(T::cct);
+    data_cache.set_ctx(T::cct);
     ret = T::init_rados();
     if (ret < 0)
       return ret;
@@ -214,7 +283,12 @@ class RGWCache  : public T
 
   void set_cache_enabled(bool state) override {
     cache.set_enabled(state);
+    if (!state) {
+      data_cache.invalidate_all();
+    }
   }
+
+  bool data_cacheable(RGWObjState *s);
 public:
   RGWCache() {}
 
@@ -241,10 +315,14 @@ public:
                      rgw_cache_entry_info *cache_info) override;
 
   int raw_obj_stat(rgw_raw_obj& obj, uint64_t *psize, real_time *pmtime, uint64_t *epoch, map<string, bufferlist> *attrs,
-                   bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker) override;
+                   bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker,
+                   optional_yield y = optional_yield()) override;
 
   int delete_system_obj(rgw_raw_obj& obj, RGWObjVersionTracker *objv_tracker) override;
 
+  int get_obj_head(rgw_raw_obj& obj, RGWObjState *s, optional_yield y) override;
+  void obj_head_changed(rgw_raw_obj& obj) override;
+
   bool chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_entries, RGWChainedCache::Entry *chained_entry) override {
     return cache.chain_cache_entry(cache_info_entries, chained_entry);
   }
@@ -461,7 +539,8 @@ int RGWCache<T>::put_system_obj_data(void *ctx, rgw_raw_obj& obj, bufferlist& da
 template <class T>
 int RGWCache<T>::raw_obj_stat(rgw_raw_obj& obj, uint64_t *psize, real_time *pmtime,
                           uint64_t *pepoch, map<string, bufferlist> *attrs,
-                          bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker)
+                          bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker,
+                          optional_yield y)
 {
   rgw_pool pool;
   string oid;
@@ -489,7 +568,7 @@ int RGWCache<T>::raw_obj_stat(rgw_raw_obj& obj, uint64_t *psize, real_time *pmti
       objv_tracker->read_version = info.version;
     goto done;
   }
-  r = T::raw_obj_stat(obj, &size, &mtime, &epoch, &info.xattrs, first_chunk, objv_tracker);
+  r = T::raw_obj_stat(obj, &size, &mtime, &epoch, &info.xattrs, first_chunk, objv_tracker, y);
   if (r < 0) {
     if (r == -ENOENT) {
       info.status = r;
@@ -519,6 +598,116 @@ done:
   return 0;
 }
 
+/*
+ * Only objects whose data lies entirely within the head we just read.  Olh
+ * heads are left out, they change through the bucket index rather than by
+ * being rewritten.
+ */
+template <class T>
+bool RGWCache<T>::data_cacheable(RGWObjState *s)
+{
+  if (s->size > T::cct->_conf->rgw_obj_data_cache_max_obj_size ||
+      s->data.length() != s->size ||
+      s->attrset.find(RGW_ATTR_OLH_INFO) != s->attrset.end()) {
+    return false;
+  }
+  auto iter = s->attrset.find(RGW_ATTR_MANIFEST);
+  if (iter == s->attrset.end()) {
+    return true;
+  }
+  RGWObjManifest manifest;
+  try {
+    auto p = iter->second.begin();
+    ::decode(manifest, p);
+  } catch (buffer::error& err) {
+    return false;
+  }
+  return manifest.get_obj_size() == s->size;
+}
+
+template <class T>
+int RGWCache<T>::get_obj_head(rgw_raw_obj& obj, RGWObjState *s, optional_yield y)
+{
+  if (!s->prefetch_data || !data_cache.enabled()) {
+    return T::get_obj_head(obj, s, y);
+  }
+
+  string name = normal_name(obj);
+  uint64_t gen = data_cache.get_gen();
+
+  ObjectDataCacheEntry entry;
+  if (data_cache.get(name, entry) == 0) {
+    bool valid = !data_cache.is_expired(entry);
+    if (!valid) {
+      /* revalidate without rereading the data */
+      uint64_t size;
+      real_time mtime;
+      uint64_t epoch;
+      map<string, bufferlist> attrs;
+      int r = T::raw_obj_stat(obj, &size, &mtime, &epoch, &attrs, nullptr, nullptr, y);
+      if (r >= 0) {
+        valid = data_cache.revalidate(name, entry, size, mtime, epoch, attrs, gen);
+      } else {
+        data_cache.remove(name);
+      }
+    }
+    if (valid) {
+      s->size = entry.size;
+      s->mtime = entry.mtime;
+      s->epoch = entry.epoch;
+      s->attrset = std::move(entry.attrs);
+      s->data = std::move(entry.data);
+      if (perfcounter) {
+        perfcounter->inc(l_rgw_data_cache_hit);
+        perfcounter->inc(l_rgw_data_cache_hit_b, s->data.length());
+      }
+      return 0;
+    }
+  }
+  if (perfcounter) {
+    perfcounter->inc(l_rgw_data_cache_miss);
+  }
+
+  int r = T::get_obj_head(obj, s, y);
+  if (r < 0) {
+    return r;
+  }
+
+  if (data_cacheable(s)) {
+    entry.size = s->size;
+    entry.mtime = s->mtime;
+    entry.epoch = s->epoch;
+    auto iter = s->attrset.find(RGW_ATTR_ETAG);
+    entry.etag = (iter != s->attrset.end() ? iter->second.to_str() : string());
+    entry.attrs = s->attrset;
+    entry.data = s->data;
+    entry.validated = ceph::coarse_mono_clock::now();
+    data_cache.put(name, entry, gen);
+  }
+  return 0;
+}
+
+/*
+ * What the writer knew about the previous version may be stale (another
+ * gateway may have rewritten it since), so every change is announced.
+ */
+template <class T>
+void RGWCache<T>::obj_head_changed(rgw_raw_obj& obj)
+{
+  if (!data_cache.enabled()) {
+    return;
+  }
+
+  string name = normal_name(obj);
+  data_cache.remove(name);
+
+  ObjectCacheInfo info;
+  int r = distribute_cache(name, obj, info, REMOVE_OBJ_DATA);
+  if (r < 0) {
+    mydout(0) << "ERROR: failed to distribute data cache invalidation for " << obj << dendl;
+  }
+}
+
 template <class T>
 int RGWCache<T>::distribute_cache(const string& normal_name, rgw_raw_obj& obj, ObjectCacheInfo& obj_info, int op)
 {
@@ -564,6 +753,9 @@ int RGWCache<T>::watch_cb(uint64_t notify_id,
   case REMOVE_OBJ:
     cache.remove(name);
     break;
+  case REMOVE_OBJ_DATA:
+    data_cache.remove(name);
+    break;
   default:
     mydout(0) << "WARNING: got unknown notification op: " << info.op << dendl;
     return -EINVAL;
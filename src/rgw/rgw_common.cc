@@ -71,6 +71,7 @@ rgw_http_errors rgw_http_s3_errors({
     { ERR_TOO_MANY_BUCKETS, {400, "TooManyBuckets" }},
     { ERR_MALFORMED_XML, {400, "MalformedXML" }},
     { ERR_AMZ_CONTENT_SHA256_MISMATCH, {400, "XAmzContentSHA256Mismatch" }},
+    { ERR_OVER_MAX_RECORD_SIZE, {400, "OverMaxRecordSize" }},
     { ERR_LENGTH_REQUIRED, {411, "MissingContentLength" }},
     { EACCES, {403, "AccessDenied" }},
     { EPERM, {403, "AccessDenied" }},
@@ -103,6 +104,7 @@ rgw_http_errors rgw_http_s3_errors({
     { ERR_INTERNAL_ERROR, {500, "InternalError" }},
     { ERR_NOT_IMPLEMENTED, {501, "NotImplemented" }},
     { ERR_SERVICE_UNAVAILABLE, {503, "ServiceUnavailable"}},
+    { ERR_BUSY_RESHARDING, {503, "SlowDown"}},
 });
 
 rgw_http_errors rgw_http_swift_errors({
@@ -135,9 +137,17 @@ int rgw_perf_start(CephContext *cct)
   plb.add_u64_counter(l_rgw_cache_hit, "cache_hit", "Cache hits");
   plb.add_u64_counter(l_rgw_cache_miss, "cache_miss", "Cache miss");
 
+  plb.add_u64_counter(l_rgw_data_cache_hit, "data_cache_hit", "Object data cache hits");
+  plb.add_u64_counter(l_rgw_data_cache_miss, "data_cache_miss", "Object data cache miss");
+  plb.add_u64_counter(l_rgw_data_cache_hit_b, "data_cache_hit_b", "Size of object data served from cache");
+
   plb.add_u64_counter(l_rgw_keystone_token_cache_hit, "keystone_token_cache_hit", "Keystone token cache hits");
   plb.add_u64_counter(l_rgw_keystone_token_cache_miss, "keystone_token_cache_miss", "Keystone token cache miss");
 
+  plb.add_u64_counter(l_rgw_gc_retire_obj, "gc_retire_object", "GC object removals");
+  plb.add_u64_counter(l_rgw_gc_retire_entry, "gc_retire_entry", "GC entries trimmed");
+  plb.add_u64(l_rgw_gc_backlog, "gc_backlog", "Expired GC entries left by the last pass over each shard, up to 1000 per shard");
+
   perfcounter = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(perfcounter);
   return 0;
@@ -25,6 +25,7 @@
 #include "rgw_quota.h"
 #include "rgw_string.h"
 #include "rgw_website.h"
+#include "rgw_yield.h"
 #include "cls/version/cls_version_types.h"
 #include "cls/user/cls_user_types.h"
 #include "cls/rgw/cls_rgw_types.h"
@@ -192,6 +193,7 @@ using ceph::crypto::MD5;
 #define ERR_NO_SUCH_WEBSITE_CONFIGURATION 2039
 #define ERR_AMZ_CONTENT_SHA256_MISMATCH 2040
 #define ERR_NO_SUCH_LC           2041
+#define ERR_OVER_MAX_RECORD_SIZE 2042
 #define ERR_USER_SUSPENDED       2100
 #define ERR_INTERNAL_ERROR       2200
 #define ERR_NOT_IMPLEMENTED      2201
@@ -200,6 +202,7 @@ using ceph::crypto::MD5;
 #define ERR_MALFORMED_DOC        2204
 #define ERR_NO_ROLE_FOUND        2205
 #define ERR_DELETE_CONFLICT      2206
+#define ERR_BUSY_RESHARDING      2300 // also in cls_rgw_types.h, don't change!
 
 #ifndef UINT32_MAX
 #define UINT32_MAX (0xffffffffu)
@@ -236,9 +239,17 @@ enum {
   l_rgw_cache_hit,
   l_rgw_cache_miss,
 
+  l_rgw_data_cache_hit,
+  l_rgw_data_cache_miss,
+  l_rgw_data_cache_hit_b,
+
   l_rgw_keystone_token_cache_hit,
   l_rgw_keystone_token_cache_miss,
 
+  l_rgw_gc_retire_obj,
+  l_rgw_gc_retire_entry,
+  l_rgw_gc_backlog,
+
   l_rgw_last,
 };
 
@@ -1129,6 +1140,14 @@ inline ostream& operator<<(ostream& out, const RGWBucketIndexType &index_type)
   }
 }
 
+/* the index shards of the bucket carry the same status, see cls_rgw */
+enum RGWBucketReshardStatus {
+  RGW_BUCKET_RESHARD_NONE = CLS_RGW_RESHARD_NONE,
+  RGW_BUCKET_RESHARD_IN_LOGRECORD = CLS_RGW_RESHARD_IN_LOGRECORD, /* index copy running, updates go to the bilog */
+  RGW_BUCKET_RESHARD_IN_PROGRESS = CLS_RGW_RESHARD_IN_PROGRESS,   /* final catch-up, updates are refused */
+  RGW_BUCKET_RESHARD_DONE = CLS_RGW_RESHARD_DONE,                 /* replaced by new_bucket_instance_id */
+};
+
 struct RGWBucketInfo
 {
   enum BIShardsHashType {
@@ -1168,9 +1187,13 @@ struct RGWBucketInfo
   bool swift_versioning;
   string swift_ver_location;
 
+  // Dynamic resharding state of this bucket instance; once DONE,
+  // new_bucket_instance_id names the instance that replaced it.
+  uint8_t reshard_status;
+  string new_bucket_instance_id;
 
   void encode(bufferlist& bl) const {
-     ENCODE_START(17, 4, bl);
+     ENCODE_START(18, 4, bl);
      ::encode(bucket, bl);
      ::encode(owner.id, bl);
      ::encode(flags, bl);
@@ -1194,10 +1217,12 @@ struct RGWBucketInfo
        ::encode(swift_ver_location, bl);
      }
      ::encode(creation_time, bl);
+     ::encode(reshard_status, bl);
+     ::encode(new_bucket_instance_id, bl);
      ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator& bl) {
-    DECODE_START_LEGACY_COMPAT_LEN_32(17, 4, 4, bl);
+    DECODE_START_LEGACY_COMPAT_LEN_32(18, 4, 4, bl);
      ::decode(bucket, bl);
      if (struct_v >= 2) {
        string s;
@@ -1254,6 +1279,12 @@ struct RGWBucketInfo
      if (struct_v >= 17) {
        ::decode(creation_time, bl);
      }
+     reshard_status = RGW_BUCKET_RESHARD_NONE;
+     new_bucket_instance_id.clear();
+     if (struct_v >= 18) {
+       ::decode(reshard_status, bl);
+       ::decode(new_bucket_instance_id, bl);
+     }
      DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
@@ -1270,8 +1301,13 @@ struct RGWBucketInfo
     return swift_versioning && !versioned();
   }
 
+  bool reshard_log_record() const { return reshard_status == RGW_BUCKET_RESHARD_IN_LOGRECORD; }
+  bool resharding() const { return reshard_status == RGW_BUCKET_RESHARD_IN_PROGRESS; }
+  bool reshard_done() const { return reshard_status == RGW_BUCKET_RESHARD_DONE; }
+
   RGWBucketInfo() : flags(0), has_instance_obj(false), num_shards(0), bucket_index_shard_hash_type(MOD), requester_pays(false),
-                    has_website(false), swift_versioning(false) {}
+                    has_website(false), swift_versioning(false),
+                    reshard_status(RGW_BUCKET_RESHARD_NONE) {}
 };
 WRITE_CLASS_ENCODER(RGWBucketInfo)
 
@@ -1811,6 +1847,7 @@ struct req_state {
 
   utime_t time;
   void *obj_ctx;
+  optional_yield y; // coroutine the request runs in, if any
   string dialect;
   string req_id;
   string trans_id;
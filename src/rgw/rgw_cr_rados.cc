@@ -2,6 +2,7 @@
 #include "rgw_coroutine.h"
 #include "rgw_boost_asio_yield.h"
 #include "rgw_cr_rados.h"
+#include "rgw_data_sync.h"
 
 #include "cls/lock/cls_lock_client.h"
 
@@ -514,6 +515,9 @@ int RGWAsyncFetchRemoteObj::_send_request()
 
   rgw_obj dest_obj(src_obj);
 
+  uint64_t bytes = 0;
+  ceph::mono_time start = ceph::mono_clock::now();
+
   int r = store->fetch_remote_obj(obj_ctx,
                        user_id,
                        client_id,
@@ -542,8 +546,12 @@ int RGWAsyncFetchRemoteObj::_send_request()
                        NULL, /* string *ptag, */
                        NULL, /* string *petag, */
                        NULL, /* void (*progress_cb)(off_t, void *), */
-                       NULL); /* void *progress_data*); */
+                       NULL, /* void *progress_data*); */
+                       &bytes);
 
+  if (transfer && r != -ERR_NOT_MODIFIED) {
+    transfer->fetch_done(bytes, ceph::mono_clock::now() - start, r);
+  }
   if (r < 0) {
     ldout(store->ctx(), 0) << "store->fetch_remote_obj() returned r=" << r << dendl;
   }
@@ -32,6 +32,113 @@ static string datalog_sync_status_shard_prefix = "datalog.sync-status.shard";
 static string datalog_sync_full_sync_index_prefix = "data.full-sync.index";
 static string bucket_status_oid_prefix = "bucket.sync-status";
 
+RGWDataSyncTransfer::RGWDataSyncTransfer(CephContext *_cct, const string& zone_name)
+  : cct(_cct), counters(NULL), lock("RGWDataSyncTransfer::lock"),
+    period_bytes(0), period_fetches(0), period_lat(ceph::timespan::zero()),
+    period_start(ceph::mono_clock::now()), last_bandwidth(0),
+    min_lat(ceph::timespan::max())
+{
+  window = std::max(cct->_conf->rgw_data_sync_spawn_window, 1);
+  min_window = std::max(window / 4, 1);
+  max_window = std::max(cct->_conf->rgw_data_sync_max_spawn_window, window);
+
+  PerfCountersBuilder plb(cct, "data-sync-from-" + zone_name,
+                          l_rgw_data_sync_first, l_rgw_data_sync_last);
+  plb.add_u64_counter(l_rgw_data_sync_fetch, "fetch", "Objects fetched");
+  plb.add_u64_counter(l_rgw_data_sync_fetch_b, "fetch_b", "Size of objects fetched");
+  plb.add_u64_counter(l_rgw_data_sync_fetch_err, "fetch_errors", "Failed object fetches");
+  plb.add_time_avg(l_rgw_data_sync_fetch_lat, "fetch_lat", "Object fetch latency");
+  plb.add_u64(l_rgw_data_sync_bandwidth, "bandwidth", "Bytes per second fetched over the last window period");
+  plb.add_u64(l_rgw_data_sync_window, "window", "Objects each bucket shard fetches at once");
+  plb.add_time(l_rgw_data_sync_lag, "lag", "Age of the last change applied from the bucket index logs");
+  counters = plb.create_perf_counters();
+  cct->get_perfcounters_collection()->add(counters);
+
+  counters->set(l_rgw_data_sync_window, window);
+}
+
+RGWDataSyncTransfer::~RGWDataSyncTransfer()
+{
+  cct->get_perfcounters_collection()->remove(counters);
+  delete counters;
+}
+
+int RGWDataSyncTransfer::get_window()
+{
+  Mutex::Locker l(lock);
+  return window;
+}
+
+void RGWDataSyncTransfer::adjust_window(ceph::mono_time now)
+{
+  double secs = std::chrono::duration<double>(now - period_start).count();
+  double bandwidth = (secs > 0 ? period_bytes / secs : 0);
+  ceph::timespan lat = period_lat / period_fetches;
+  if (lat < min_lat) {
+    min_lat = lat;
+  }
+
+  int step = std::max(window / 8, 1);
+  int old_window = window;
+  if (lat > min_lat * 2 || bandwidth < last_bandwidth * 0.9) {
+    /* queueing, or more fetches than the link takes */
+    window = std::max(window - step, min_window);
+  } else if (bandwidth > last_bandwidth * 1.05) {
+    window = std::min(window + step, max_window);
+  }
+  if (window != old_window) {
+    ldout(cct, 10) << "data sync window " << old_window << " -> " << window
+        << " (bandwidth=" << (uint64_t)bandwidth << "B/s lat=" << lat
+        << " min_lat=" << min_lat << ")" << dendl;
+  }
+
+  last_bandwidth = bandwidth;
+  period_bytes = 0;
+  period_fetches = 0;
+  period_lat = ceph::timespan::zero();
+  period_start = now;
+
+  counters->set(l_rgw_data_sync_bandwidth, (uint64_t)bandwidth);
+  counters->set(l_rgw_data_sync_window, window);
+}
+
+void RGWDataSyncTransfer::fetch_done(uint64_t bytes, ceph::timespan lat, int ret,
+                                     ceph::mono_time now)
+{
+  if (ret < 0) {
+    counters->inc(l_rgw_data_sync_fetch_err);
+    return;
+  }
+  counters->inc(l_rgw_data_sync_fetch);
+  counters->inc(l_rgw_data_sync_fetch_b, bytes);
+  counters->tinc(l_rgw_data_sync_fetch_lat, lat);
+
+  Mutex::Locker l(lock);
+  period_bytes += bytes;
+  period_lat += lat;
+  if (++period_fetches >= window) {
+    adjust_window(now);
+  }
+}
+
+void RGWDataSyncTransfer::update_lag(const real_time& timestamp)
+{
+  if (real_clock::is_zero(timestamp)) {
+    return;
+  }
+  utime_t now = ceph_clock_now();
+  utime_t ts(timestamp);
+  counters->tset(l_rgw_data_sync_lag, (now > ts ? now - ts : utime_t()));
+}
+
+int RGWDataSyncEnv::get_spawn_window()
+{
+  if (transfer) {
+    return transfer->get_window();
+  }
+  return std::max(cct->_conf->rgw_data_sync_spawn_window, 1);
+}
+
 class RGWSyncDebugLogger {
   CephContext *cct;
   string prefix;
@@ -609,6 +716,16 @@ int RGWRemoteDataLog::init(const string& _source_zone, RGWRESTConn *_conn, RGWSy
 {
   sync_env.init(store->ctx(), store, _conn, async_rados, &http_manager, _error_logger, _source_zone, _sync_module);
 
+  if (!transfer) {
+    string zone_name = _source_zone;
+    auto ziter = store->zone_by_id.find(_source_zone);
+    if (ziter != store->zone_by_id.end()) {
+      zone_name = ziter->second.name;
+    }
+    transfer.reset(new RGWDataSyncTransfer(store->ctx(), zone_name));
+  }
+  sync_env.transfer = transfer.get();
+
   if (initialized) {
     return 0;
   }
@@ -1560,7 +1677,7 @@ RGWCoroutine *RGWDefaultDataSyncModule::sync_object(RGWDataSyncEnv *sync_env, RG
 {
   return new RGWFetchRemoteObjCR(sync_env->async_rados, sync_env->store, sync_env->source_zone, bucket_info,
                                  key, versioned_epoch,
-                                 true);
+                                 true, sync_env->transfer);
 }
 
 RGWCoroutine *RGWDefaultDataSyncModule::remove_object(RGWDataSyncEnv *sync_env, RGWBucketInfo& bucket_info, rgw_obj_key& key,
@@ -2121,6 +2238,10 @@ public:
 
     RGWRados *store = sync_env->store;
 
+    if (sync_env->transfer) {
+      sync_env->transfer->update_lag(timestamp);
+    }
+
     ldout(sync_env->cct, 20) << __func__ << "(): updating marker marker_oid=" << marker_oid << " marker=" << new_marker << dendl;
     return new RGWSimpleRadosWriteAttrsCR(sync_env->async_rados,
                                           store,
@@ -2293,8 +2414,6 @@ done:
   }
 };
 
-#define BUCKET_SYNC_SPAWN_WINDOW 20
-
 class RGWBucketShardFullSyncCR : public RGWCoroutine {
   RGWDataSyncEnv *sync_env;
   const rgw_bucket_shard& bs;
@@ -2376,7 +2495,7 @@ int RGWBucketShardFullSyncCR::operate()
                                  entry->key, &marker_tracker),
                       false);
         }
-        while (num_spawned() > BUCKET_SYNC_SPAWN_WINDOW) {
+        while (num_spawned() > sync_env->get_spawn_window()) {
           yield wait_for_child();
           bool again = true;
           while (again) {
@@ -2603,7 +2722,7 @@ int RGWBucketShardIncrementalSyncCR::operate()
                   false);
           }
         // }
-        while (num_spawned() > BUCKET_SYNC_SPAWN_WINDOW) {
+        while (num_spawned() > sync_env->get_spawn_window()) {
           set_status() << "num_spawned() > spawn_window";
           yield wait_for_child();
           bool again = true;
@@ -197,6 +197,60 @@ struct rgw_bucket_entry_owner {
   void decode_json(JSONObj *obj);
 };
 
+enum {
+  l_rgw_data_sync_first = 15500,
+
+  l_rgw_data_sync_fetch,
+  l_rgw_data_sync_fetch_b,
+  l_rgw_data_sync_fetch_err,
+  l_rgw_data_sync_fetch_lat,
+  l_rgw_data_sync_bandwidth,
+  l_rgw_data_sync_window,
+  l_rgw_data_sync_lag,
+
+  l_rgw_data_sync_last,
+};
+
+/*
+ * Object transfers from one source zone: keeps the "data-sync-from-<zone>"
+ * perf counters and sizes the number of objects each bucket shard fetches
+ * at once.  The window is measured in periods of window fetches; it grows
+ * while the bandwidth of the zone grows with it, and shrinks again when
+ * the bandwidth drops or fetches slow down well beyond the fastest period
+ * seen, i.e. when requests start to queue up somewhere on the way.
+ */
+class RGWDataSyncTransfer {
+  CephContext *cct;
+  PerfCounters *counters;
+
+  Mutex lock;
+  int window;
+  int min_window;
+  int max_window;
+
+  uint64_t period_bytes;
+  int period_fetches;
+  ceph::timespan period_lat;
+  ceph::mono_time period_start;
+  double last_bandwidth;
+  ceph::timespan min_lat;
+
+  void adjust_window(ceph::mono_time now);
+
+public:
+  RGWDataSyncTransfer(CephContext *_cct, const string& zone_name);
+  ~RGWDataSyncTransfer();
+
+  int get_window();
+
+  void fetch_done(uint64_t bytes, ceph::timespan lat, int ret) {
+    fetch_done(bytes, lat, ret, ceph::mono_clock::now());
+  }
+  void fetch_done(uint64_t bytes, ceph::timespan lat, int ret, ceph::mono_time now);
+  /* changes up to timestamp have been applied here */
+  void update_lag(const real_time& timestamp);
+};
+
 class RGWSyncErrorLogger;
 
 struct RGWDataSyncEnv {
@@ -208,8 +262,9 @@ struct RGWDataSyncEnv {
   RGWSyncErrorLogger *error_logger;
   string source_zone;
   RGWSyncModuleInstanceRef sync_module;
+  RGWDataSyncTransfer *transfer;
 
-  RGWDataSyncEnv() : cct(NULL), store(NULL), conn(NULL), async_rados(NULL), http_manager(NULL), error_logger(NULL), sync_module(NULL) {}
+  RGWDataSyncEnv() : cct(NULL), store(NULL), conn(NULL), async_rados(NULL), http_manager(NULL), error_logger(NULL), sync_module(NULL), transfer(NULL) {}
 
   void init(CephContext *_cct, RGWRados *_store, RGWRESTConn *_conn,
             RGWAsyncRadosProcessor *_async_rados, RGWHTTPManager *_http_manager,
@@ -227,6 +282,9 @@ struct RGWDataSyncEnv {
 
   string shard_obj_name(int shard_id);
   string status_oid();
+
+  /* max number of objects a bucket shard syncs at once */
+  int get_spawn_window();
 };
 
 class RGWRemoteDataLog : public RGWCoroutinesManager {
@@ -235,6 +293,7 @@ class RGWRemoteDataLog : public RGWCoroutinesManager {
   RGWHTTPManager http_manager;
 
   RGWDataSyncEnv sync_env;
+  std::unique_ptr<RGWDataSyncTransfer> transfer;
 
   RWLock lock;
   RGWDataSyncControlCR *data_sync_cr;
@@ -8,7 +8,11 @@
 #include "cls/lock/cls_lock_client.h"
 #include "auth/Crypto.h"
 
+#include <algorithm>
+#include <deque>
 #include <list>
+#include <thread>
+#include <vector>
 
 #define dout_context g_ceph_context
 #define dout_subsys ceph_subsys_rgw
@@ -21,6 +25,7 @@ static string gc_index_lock_name = "gc_process";
 
 
 #define HASH_PRIME 7877
+#define GC_BACKLOG_SAMPLE 1000
 
 void RGWGC::initialize(CephContext *_cct, RGWRados *_store) {
   cct = _cct;
@@ -31,6 +36,7 @@ void RGWGC::initialize(CephContext *_cct, RGWRados *_store) {
     max_objs = HASH_PRIME;
 
   obj_names = new string[max_objs];
+  shard_backlog.assign(max_objs, 0);
 
   for (int i = 0; i < max_objs; i++) {
     obj_names[i] = gc_oid_prefix;
@@ -129,11 +135,170 @@ int RGWGC::list(int *index, string& marker, uint32_t max, bool expired_only, std
   return 0;
 }
 
+/*
+ * Removes the tail objects of one gc shard's entries with up to
+ * rgw_gc_max_concurrent_io deletes in flight, and trims entries from the
+ * shard in batches of rgw_gc_max_trim_chunk once all of their objects are
+ * gone.
+ */
+class RGWGCIOManager {
+  CephContext *cct;
+  RGWGC *gc;
+  int index;
+  size_t max_aio;
+  size_t max_trim_chunk;
+
+  struct IO {
+    AioCompletion *c;
+    string tag;
+  };
+  std::deque<IO> ios;
+
+  struct TagState {
+    int pending = 0;
+    bool scheduled = false;
+    bool failed = false;
+  };
+  map<string, TagState> tags;
+  std::list<string> remove_tags;
+  uint64_t num_failed = 0;
+
+  void check_tag(map<string, TagState>::iterator iter) {
+    TagState& state = iter->second;
+    if (!state.scheduled || state.pending > 0) {
+      return;
+    }
+    if (state.failed) {
+      ++num_failed;
+    } else {
+      remove_tags.push_back(iter->first);
+    }
+    tags.erase(iter);
+    if (remove_tags.size() >= max_trim_chunk) {
+      flush_remove_tags();
+    }
+  }
+
+  void handle_next_completion() {
+    IO io = std::move(ios.front());
+    ios.pop_front();
+
+    io.c->wait_for_safe();
+    int ret = io.c->get_return_value();
+    io.c->release();
+
+    if (ret == -ENOENT)
+      ret = 0;
+
+    auto iter = tags.find(io.tag);
+    assert(iter != tags.end());
+    --iter->second.pending;
+    if (ret < 0) {
+      iter->second.failed = true;
+    } else if (perfcounter) {
+      perfcounter->inc(l_rgw_gc_retire_obj);
+    }
+    check_tag(iter);
+  }
+
+  void flush_remove_tags() {
+    if (remove_tags.empty()) {
+      return;
+    }
+    int ret = gc->remove(index, remove_tags);
+    if (ret < 0) {
+      dout(0) << "WARNING: failed to remove tags on gc shard " << index
+              << " ret=" << ret << dendl;
+    } else if (perfcounter) {
+      perfcounter->inc(l_rgw_gc_retire_entry, remove_tags.size());
+    }
+    remove_tags.clear();
+  }
+
+public:
+  RGWGCIOManager(CephContext *_cct, RGWGC *_gc, int _index)
+    : cct(_cct), gc(_gc), index(_index) {
+    max_aio = std::max(cct->_conf->rgw_gc_max_concurrent_io, 1);
+    max_trim_chunk = std::max(cct->_conf->rgw_gc_max_trim_chunk, 1);
+  }
+  ~RGWGCIOManager() {
+    drain();
+  }
+
+  int schedule_io(IoCtx& ioctx, const string& oid, const string& tag) {
+    while (ios.size() >= max_aio) {
+      handle_next_completion();
+    }
+
+    TagState& state = tags[tag];
+
+    ObjectWriteOperation op;
+    cls_refcount_put(op, tag, true);
+
+    AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    int ret = ioctx.aio_operate(oid, c, &op);
+    if (ret < 0) {
+      c->release();
+      state.failed = true;
+      return ret;
+    }
+    ++state.pending;
+    ios.push_back(IO{c, tag});
+    return 0;
+  }
+
+  /* all of the tag's objects were scheduled, trim it once they are gone */
+  void tag_scheduled(const string& tag) {
+    auto iter = tags.emplace(tag, TagState()).first;
+    iter->second.scheduled = true;
+    check_tag(iter);
+  }
+
+  void drain() {
+    while (!ios.empty()) {
+      handle_next_completion();
+    }
+    flush_remove_tags();
+  }
+
+  /* entries left in the shard because some of their objects weren't removed */
+  uint64_t get_num_failed() const {
+    return num_failed;
+  }
+};
+
+/*
+ * Expired entries past marker, up to GC_BACKLOG_SAMPLE: a single bounded
+ * listing, so that a large backlog doesn't cost a walk of the whole shard
+ * just to be reported.
+ */
+uint64_t RGWGC::count_expired(int index, string marker)
+{
+  std::list<cls_rgw_gc_obj_info> entries;
+  bool truncated;
+  string next_marker;
+  int ret = cls_rgw_gc_list(store->gc_pool_ctx, obj_names[index], marker, GC_BACKLOG_SAMPLE, true,
+                            entries, &truncated, &next_marker);
+  if (ret < 0)
+    return 0;
+  return entries.size();
+}
+
+void RGWGC::set_backlog(int index, uint64_t count)
+{
+  Mutex::Locker l(backlog_lock);
+  uint64_t& backlog = shard_backlog[index];
+  if (perfcounter) {
+    perfcounter->dec(l_rgw_gc_backlog, backlog);
+    perfcounter->inc(l_rgw_gc_backlog, count);
+  }
+  backlog = count;
+}
+
 int RGWGC::process(int index, int max_secs)
 {
   rados::cls::lock::Lock l(gc_index_lock_name);
   utime_t end = ceph_clock_now();
-  std::list<string> remove_tags;
 
   /* max_secs should be greater than zero. We don't want a zero max_secs
    * to be translated as no timeout, since we'd then need to break the
@@ -154,13 +319,17 @@ int RGWGC::process(int index, int max_secs)
   if (ret < 0)
     return ret;
 
+  RGWGCIOManager io_manager(cct, this, index);
+  map<string, IoCtx> ioctxs;
+  uint64_t left = 0; /* expired entries we didn't get to */
   string marker;
-  bool truncated;
-  IoCtx *ctx = new IoCtx;
+  string next_marker;
+  bool truncated = false;
   do {
     int max = 100;
     std::list<cls_rgw_gc_obj_info> entries;
-    ret = cls_rgw_gc_list(store->gc_pool_ctx, obj_names[index], marker, max, true, entries, &truncated);
+    ret = cls_rgw_gc_list(store->gc_pool_ctx, obj_names[index], marker, max, true, entries,
+                          &truncated, &next_marker);
     if (ret == -ENOENT) {
       ret = 0;
       goto done;
@@ -168,67 +337,65 @@ int RGWGC::process(int index, int max_secs)
     if (ret < 0)
       goto done;
 
-    string last_pool;
     std::list<cls_rgw_gc_obj_info>::iterator iter;
     for (iter = entries.begin(); iter != entries.end(); ++iter) {
-      bool remove_tag;
       cls_rgw_gc_obj_info& info = *iter;
       std::list<cls_rgw_obj>::iterator liter;
       cls_rgw_obj_chain& chain = info.chain;
 
       utime_t now = ceph_clock_now();
-      if (now >= end)
+      if (now >= end) {
+        left += std::distance(iter, entries.end());
         goto done;
+      }
 
-      remove_tag = true;
       for (liter = chain.objs.begin(); liter != chain.objs.end(); ++liter) {
         cls_rgw_obj& obj = *liter;
 
-        if (obj.pool != last_pool) {
-          delete ctx;
-          ctx = new IoCtx;
-	  ret = rgw_init_ioctx(store->get_rados_handle(), obj.pool, *ctx);
+        auto ctx = ioctxs.find(obj.pool);
+        if (ctx == ioctxs.end()) {
+          IoCtx ioctx;
+	  ret = rgw_init_ioctx(store->get_rados_handle(), obj.pool, ioctx);
 	  if (ret < 0) {
 	    dout(0) << "ERROR: failed to create ioctx pool=" << obj.pool << dendl;
 	    continue;
 	  }
-          last_pool = obj.pool;
+          ctx = ioctxs.emplace(obj.pool, std::move(ioctx)).first;
         }
 
-        ctx->locator_set_key(obj.loc);
+        ctx->second.locator_set_key(obj.loc);
 
         const string& oid = obj.key.name; /* just stored raw oid there */
 
-	dout(0) << "gc::process: removing " << obj.pool << ":" << obj.key.name << dendl;
-	ObjectWriteOperation op;
-	cls_refcount_put(op, info.tag, true);
-        ret = ctx->operate(oid, &op);
-	if (ret == -ENOENT)
-	  ret = 0;
+	dout(5) << "gc::process: removing " << obj.pool << ":" << obj.key.name << dendl;
+        ret = io_manager.schedule_io(ctx->second, oid, info.tag);
         if (ret < 0) {
-          remove_tag = false;
           dout(0) << "failed to remove " << obj.pool << ":" << oid << "@" << obj.loc << dendl;
         }
 
         if (going_down()) // leave early, even if tag isn't removed, it's ok
           goto done;
       }
-      if (remove_tag) {
-        remove_tags.push_back(info.tag);
-#define MAX_REMOVE_CHUNK 16
-        if (remove_tags.size() > MAX_REMOVE_CHUNK) {
-          RGWGC::remove(index, remove_tags);
-          remove_tags.clear();
-        }
-      }
+      io_manager.tag_scheduled(info.tag);
+    }
+
+    if (next_marker.empty()) {
+      /* an older osd that doesn't return a marker: the next page starts
+       * from the same place, so trim what we have first */
+      io_manager.drain();
+    } else {
+      marker = next_marker;
     }
   } while (truncated);
 
 done:
-  if (!remove_tags.empty())
-    RGWGC::remove(index, remove_tags);
+  io_manager.drain();
   l.unlock(&store->gc_pool_ctx, obj_names[index]);
-  delete ctx;
+
+  if (truncated && !next_marker.empty() && !going_down()) {
+    left += count_expired(index, next_marker);
+  }
+  set_backlog(index, left + io_manager.get_num_failed());
   return 0;
 }
 
@@ -241,14 +408,34 @@ int RGWGC::process()
   if (ret < 0)
     return ret;
 
-  for (int i = 0; i < max_objs; i++) {
-    int index = (i + start) % max_objs;
-    ret = process(index, max_secs);
-    if (ret < 0)
-      return ret;
+  /* hand the shards out to the workers one at a time; a shard stays locked
+   * while it is processed, so gc processors in other gateways skip it */
+  int num_workers = std::min(std::max(cct->_conf->rgw_gc_max_concurrent_shards, 1),
+                             max_objs);
+  std::atomic<int> next = { 0 };
+  std::atomic<int> error = { 0 };
+
+  auto work = [&] {
+    for (int i = next++; i < max_objs; i = next++) {
+      int index = (i + start) % max_objs;
+      int r = process(index, max_secs);
+      if (r < 0) {
+        error = r;
+        next = max_objs;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 1; i < num_workers; i++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto& t : workers) {
+    t.join();
   }
 
-  return 0;
+  return error;
 }
 
 bool RGWGC::going_down()
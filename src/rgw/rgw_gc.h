@@ -15,6 +15,7 @@
 #include "cls/rgw/cls_rgw_types.h"
 
 #include <atomic>
+#include <vector>
 
 class RGWGC {
   CephContext *cct;
@@ -23,7 +24,12 @@ class RGWGC {
   string *obj_names;
   std::atomic<bool> down_flag = { false };
 
+  Mutex backlog_lock;
+  vector<uint64_t> shard_backlog; /* expired entries each shard's last pass left behind, sampled */
+
   int tag_index(const string& tag);
+  uint64_t count_expired(int index, string marker);
+  void set_backlog(int index, uint64_t count);
 
   class GCWorker : public Thread {
     CephContext *cct;
@@ -39,7 +45,8 @@ class RGWGC {
 
   GCWorker *worker;
 public:
-  RGWGC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL), worker(NULL) {}
+  RGWGC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL),
+            backlog_lock("RGWGC::backlog_lock"), worker(NULL) {}
   ~RGWGC() {
     stop_processor();
     finalize();
@@ -0,0 +1,169 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "rgw_index_batcher.h"
+
+#define dout_context g_ceph_context
+#define dout_subsys ceph_subsys_rgw
+
+using namespace std;
+
+void RGWIndexCompleteBatcher::handle_sent(Sent *sent, int r)
+{
+  Mutex::Locker l(lock);
+  --num_inflight;
+  if (r == -EOPNOTSUPP) {
+    if (!unsupported) {
+      ldout(cct, 1) << "bucket_complete_ops not supported by " << sent->oid
+                    << ", sending complete ops one by one" << dendl;
+      unsupported = true;
+      /* these were queued after the batches in flight to their shard, they
+       * have to wait for them to be resent */
+      for (auto& i : batches) {
+        Batch& batch = i.second;
+        held.push_back(new Sent{this, batch.ioctx, i.first.second, batch.bucket,
+                                std::move(batch.ops)});
+      }
+      batches.clear();
+    }
+    resends.push_back(sent);
+  } else if (r == -ERR_BUSY_RESHARDING) {
+    for (auto& op : sent->ops) {
+      retry(sent->bucket, op);
+    }
+    delete sent;
+  } else {
+    if (r < 0) {
+      ldout(cct, 0) << "WARNING: bucket_complete_ops on " << sent->oid
+                    << " returned " << r << dendl;
+    }
+    delete sent;
+  }
+  cond.Signal();
+}
+
+void RGWIndexCompleteBatcher::send(map<pair<int64_t, string>, Batch>::iterator iter)
+{
+  Batch& batch = iter->second;
+  Sent *sent = new Sent{this, batch.ioctx, iter->first.second, batch.bucket, std::move(batch.ops)};
+  batches.erase(iter);
+
+  int r = send_batch(sent);
+  if (r < 0) {
+    ldout(cct, 0) << "WARNING: failed to send bucket_complete_ops on " << sent->oid
+                  << " r=" << r << dendl;
+    delete sent;
+    return;
+  }
+  ++num_inflight;
+}
+
+void RGWIndexCompleteBatcher::send_resends()
+{
+  for (auto sent : resends) {
+    for (auto& op : sent->ops) {
+      send_single(sent->ioctx, sent->oid, sent->bucket, op);
+    }
+    delete sent;
+  }
+  resends.clear();
+
+  /* a batch still in flight may be turned down too, and would then have to
+   * be resent ahead of these */
+  if (num_inflight > 0) {
+    return;
+  }
+  for (auto sent : held) {
+    for (auto& op : sent->ops) {
+      send_single(sent->ioctx, sent->oid, sent->bucket, op);
+    }
+    delete sent;
+  }
+  held.clear();
+}
+
+void RGWIndexCompleteBatcher::queue(librados::IoCtx& ioctx, const string& oid,
+                                    const rgw_bucket& bucket, rgw_cls_obj_complete_op& op)
+{
+  Mutex::Locker l(lock);
+  if (unsupported) {
+    if (num_inflight > 0 || !resends.empty() || !held.empty()) {
+      Sent *sent = new Sent{this, ioctx, oid, bucket, {}};
+      sent->ops.push_back(std::move(op));
+      held.push_back(sent);
+      cond.Signal();
+    } else {
+      send_single(ioctx, oid, bucket, op);
+    }
+    return;
+  }
+
+  auto key = make_pair(get_pool_id(ioctx), oid);
+  auto iter = batches.find(key);
+  if (iter != batches.end() && iter->second.keys.count(op.key)) {
+    send(iter);
+    iter = batches.end();
+  }
+  if (iter == batches.end()) {
+    auto deadline = ceph::mono_clock::now() +
+      std::chrono::milliseconds(cct->_conf->rgw_bucket_index_complete_batch_ms);
+    iter = batches.emplace(key, Batch{ioctx, bucket, {}, {}, deadline}).first;
+    cond.Signal();
+  }
+
+  Batch& batch = iter->second;
+  batch.keys.insert(op.key);
+  batch.ops.push_back(std::move(op));
+  if (batch.ops.size() >= (size_t)cct->_conf->rgw_bucket_index_complete_batch_max) {
+    send(iter);
+  }
+}
+
+void *RGWIndexCompleteBatcher::entry()
+{
+  Mutex::Locker l(lock);
+  while (!stopping) {
+    send_resends();
+
+    auto now = ceph::mono_clock::now();
+    auto next = ceph::mono_time::max();
+    for (auto iter = batches.begin(); iter != batches.end(); ) {
+      auto cur = iter++;
+      if (cur->second.deadline <= now) {
+        send(cur);
+      } else if (cur->second.deadline < next) {
+        next = cur->second.deadline;
+      }
+    }
+
+    if (next == ceph::mono_time::max()) {
+      cond.Wait(lock);
+    } else {
+      utime_t wait;
+      wait.set_from_double(std::chrono::duration<double>(next - now).count());
+      cond.WaitInterval(lock, wait);
+    }
+  }
+  return NULL;
+}
+
+void RGWIndexCompleteBatcher::stop()
+{
+  lock.Lock();
+  stopping = true;
+  cond.Signal();
+  lock.Unlock();
+  join();
+
+  /* ops may still be queued while we wait */
+  Mutex::Locker l(lock);
+  while (!batches.empty() || num_inflight > 0 || !resends.empty() || !held.empty()) {
+    while (!batches.empty()) {
+      send(batches.begin());
+    }
+    send_resends();
+    if (num_inflight > 0) {
+      cond.Wait(lock);
+    }
+  }
+}
@@ -0,0 +1,102 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_INDEX_BATCHER_H
+#define CEPH_RGW_INDEX_BATCHER_H
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+
+#include "include/rados/librados.hpp"
+#include "common/ceph_time.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "cls/rgw/cls_rgw_ops.h"
+#include "rgw_common.h"
+
+/*
+ * Coalesces the complete ops sent to one bucket index shard within
+ * rgw_bucket_index_complete_batch_ms into a single bucket_complete_ops
+ * call.  Complete ops are fire and forget anyway, holding them back only
+ * delays when the index shows the change.  A batch never holds two ops on
+ * the same key: the osd applies a batch in one transaction whose reads
+ * don't see its own writes.
+ *
+ * Once an osd turns bucket_complete_ops down the batcher sends every op
+ * on its own, but keeps the order in which they were queued: ops queued
+ * after a batch that is still in flight, or that has been turned down and
+ * not resent yet, are held back until it has been resent.
+ *
+ * The rados calls are left to a subclass.
+ */
+class RGWIndexCompleteBatcher : public Thread {
+protected:
+  struct Sent {
+    RGWIndexCompleteBatcher *batcher;
+    librados::IoCtx ioctx;
+    std::string oid;
+    rgw_bucket bucket;
+    std::list<rgw_cls_obj_complete_op> ops;
+  };
+
+  CephContext *cct;
+
+private:
+  Mutex lock;
+  Cond cond;
+  bool stopping = false;
+  bool unsupported = false; /* the osds don't have bucket_complete_ops */
+  int num_inflight = 0;
+
+  struct Batch {
+    librados::IoCtx ioctx;
+    rgw_bucket bucket;
+    std::list<rgw_cls_obj_complete_op> ops;
+    std::set<cls_rgw_obj_key> keys;
+    ceph::mono_time deadline;
+  };
+  /* keyed by index pool and shard object */
+  std::map<std::pair<int64_t, std::string>, Batch> batches;
+
+  /* batches the osd didn't understand, to be sent op by op */
+  std::list<Sent *> resends;
+  /* ops to be sent op by op once no batch is in flight or to be resent */
+  std::list<Sent *> held;
+
+  void send(std::map<std::pair<int64_t, std::string>, Batch>::iterator iter);
+  void send_resends();
+
+protected:
+  /* sends sent->ops as one bucket_complete_ops, and calls handle_sent()
+   * once the osd answered */
+  virtual int send_batch(Sent *sent) = 0;
+  /* sends a single complete op, fire and forget */
+  virtual void send_single(librados::IoCtx& ioctx, const std::string& oid,
+                           const rgw_bucket& bucket, rgw_cls_obj_complete_op& op) = 0;
+  /* sends an op again once the bucket reshard is done */
+  virtual void retry(const rgw_bucket& bucket, rgw_cls_obj_complete_op& op) = 0;
+  virtual int64_t get_pool_id(librados::IoCtx& ioctx) {
+    return ioctx.get_id();
+  }
+
+  /* takes ownership of sent */
+  void handle_sent(Sent *sent, int r);
+
+public:
+  explicit RGWIndexCompleteBatcher(CephContext *_cct)
+    : cct(_cct), lock("RGWIndexCompleteBatcher") {}
+  ~RGWIndexCompleteBatcher() override {}
+
+  void queue(librados::IoCtx& ioctx, const std::string& oid, const rgw_bucket& bucket,
+             rgw_cls_obj_complete_op& op);
+
+  void *entry() override;
+
+  /* sends whatever is queued and waits for it */
+  void stop();
+};
+
+#endif
@@ -730,6 +730,8 @@ void RGWBucketInfo::dump(Formatter *f) const
   encode_json("swift_versioning", swift_versioning, f);
   encode_json("swift_ver_location", swift_ver_location, f);
   encode_json("index_type", (uint32_t)index_type, f);
+  encode_json("reshard_status", (uint32_t)reshard_status, f);
+  encode_json("new_bucket_instance_id", new_bucket_instance_id, f);
 }
 
 void RGWBucketInfo::decode_json(JSONObj *obj) {
@@ -761,6 +763,10 @@ void RGWBucketInfo::decode_json(JSONObj *obj) {
   uint32_t it;
   JSONDecoder::decode_json("index_type", it, obj);
   index_type = (RGWBucketIndexType)it;
+  uint32_t rs = RGW_BUCKET_RESHARD_NONE;
+  JSONDecoder::decode_json("reshard_status", rs, obj);
+  reshard_status = (uint8_t)rs;
+  JSONDecoder::decode_json("new_bucket_instance_id", new_bucket_instance_id, obj);
 }
 
 void rgw_obj_key::dump(Formatter *f) const
@@ -1,6 +1,9 @@
 #include <string.h>
+#include <algorithm>
 #include <iostream>
 #include <map>
+#include <thread>
+#include <vector>
 
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string.hpp>
@@ -12,6 +15,8 @@
 #include "cls/lock/cls_lock_client.h"
 #include "rgw_common.h"
 #include "rgw_bucket.h"
+#include "rgw_coroutine.h"
+#include "rgw_cr_rados.h"
 #include "rgw_lc.h"
 
 #define dout_context g_ceph_context
@@ -253,6 +258,86 @@ int RGWLC::remove_expired_obj(RGWBucketInfo& bucket_info, rgw_obj_key obj_key, b
   }
 }
 
+/*
+ * Removes expired objects on the async rados threads, with at most
+ * rgw_lc_delete_max_aio removals in flight.  An object that was written
+ * again since it was listed is left alone.
+ */
+class LCObjDeleter {
+  struct Op {
+    rgw_obj_key key;
+    RGWAsyncRemoveObj *req = nullptr;
+  };
+
+  RGWRados *store;
+  RGWBucketInfo& bucket_info;
+  RGWCompletionManager *completion_mgr;
+  size_t max_aio;
+  size_t pending = 0;
+
+  void wait_one() {
+    void *user_info;
+    int r = completion_mgr->get_next(&user_info);
+    assert(r == 0); /* the manager never goes down */
+    Op *op = static_cast<Op *>(user_info);
+    r = op->req->get_ret_status();
+    if (r == -ENOENT || r == -ERR_PRECONDITION_FAILED) {
+      ldout(store->ctx(), 10) << "lc: skipped " << bucket_info.bucket.name << ":" << op->key
+                              << ", removed or written again since listed" << dendl;
+    } else if (r < 0) {
+      ldout(store->ctx(), 0) << "ERROR: lc: failed to remove " << bucket_info.bucket.name << ":"
+                             << op->key << " ret=" << r << dendl;
+    } else {
+      ldout(store->ctx(), 10) << "DELETED:" << bucket_info.bucket.name << ":" << op->key << dendl;
+    }
+    op->req->finish();
+    delete op;
+    --pending;
+  }
+
+public:
+  LCObjDeleter(RGWRados *_store, RGWBucketInfo& _bucket_info)
+    : store(_store), bucket_info(_bucket_info),
+      completion_mgr(new RGWCompletionManager(_store->ctx())),
+      max_aio(std::max(_store->ctx()->_conf->rgw_lc_delete_max_aio, 1)) {}
+  ~LCObjDeleter() {
+    drain();
+    completion_mgr->put();
+  }
+
+  /* removes the object unless it was modified after @mtime */
+  void remove(const rgw_obj_key& key, ceph::real_time mtime) {
+    while (pending >= max_aio) {
+      wait_one();
+    }
+    Op *op = new Op;
+    op->key = key;
+    if (op->key.instance.empty()) {
+      op->key.instance = "null";
+    }
+    RGWAioCompletionNotifier *cn = new RGWAioCompletionNotifier(completion_mgr, op);
+    completion_mgr->register_completion_notifier(cn);
+    op->req = new RGWAsyncRemoveObj(nullptr, cn, store, string(), bucket_info, key,
+                                    bucket_info.owner.to_str(), string(),
+                                    bucket_info.versioned(), 0, false,
+                                    true /* del_if_older */, mtime);
+    ++pending;
+    store->get_async_rados()->queue(op->req);
+  }
+
+  void drain() {
+    while (pending > 0) {
+      wait_one();
+    }
+  }
+};
+
+bool RGWLC::should_stop()
+{
+  utime_t now = ceph_clock_now();
+  return going_down() || !should_work(now);
+}
+
 int RGWLC::handle_multipart_expiration(RGWRados::Bucket *target, const map<string, lc_op>& prefix_map)
 {
   MultipartMetaFilter mp_filter;
@@ -271,6 +356,9 @@ int RGWLC::handle_multipart_expiration(RGWRados::Bucket *target, const map<strin
     }
     list_op.params.prefix = prefix_iter->first;
     do {
+      if (should_stop()) {
+        return -ECANCELED;
+      }
       objs.clear();
       list_op.params.marker = list_op.get_next_marker();
       ret = list_op.list_objects(1000, &objs, NULL, &is_truncated);
@@ -301,7 +389,216 @@ int RGWLC::handle_multipart_expiration(RGWRados::Bucket *target, const map<strin
   return 0;
 }
 
-int RGWLC::bucket_lc_process(string& shard_id)
+void RGWLC::get_progress_oid(int index, string *oid)
+{
+  *oid = obj_names[index];
+  oid->append(".progress");
+}
+
+int RGWLC::read_progress(int index, const string& bucket_key, rgw_lc_bucket_progress *progress)
+{
+  string oid;
+  get_progress_oid(index, &oid);
+
+  set<string> keys;
+  keys.insert(bucket_key);
+  map<string, bufferlist> vals;
+  int ret = store->lc_pool_ctx.omap_get_vals_by_keys(oid, keys, &vals);
+  if (ret < 0)
+    return ret;
+
+  auto iter = vals.find(bucket_key);
+  if (iter == vals.end())
+    return -ENOENT;
+
+  try {
+    bufferlist::iterator bl = iter->second.begin();
+    ::decode(*progress, bl);
+  } catch (buffer::error& err) {
+    ldout(cct, 0) << "ERROR: failed to decode lc progress of " << bucket_key << dendl;
+    return -EIO;
+  }
+  return 0;
+}
+
+int RGWLC::write_progress(int index, const string& bucket_key, const rgw_lc_bucket_progress& progress)
+{
+  string oid;
+  get_progress_oid(index, &oid);
+
+  map<string, bufferlist> vals;
+  ::encode(progress, vals[bucket_key]);
+
+  ObjectWriteOperation op;
+  op.omap_set(vals);
+  return store->lc_pool_ctx.operate(oid, &op);
+}
+
+void RGWLC::remove_progress(int index, const string& bucket_key)
+{
+  string oid;
+  get_progress_oid(index, &oid);
+
+  set<string> keys;
+  keys.insert(bucket_key);
+
+  ObjectWriteOperation op;
+  op.omap_rm_keys(keys);
+  int ret = store->lc_pool_ctx.operate(oid, &op);
+  if (ret < 0 && ret != -ENOENT) {
+    ldout(cct, 0) << "WARNING: failed to remove lc progress of " << bucket_key
+                  << " ret=" << ret << dendl;
+  }
+}
+
+int RGWLC::expire_shard(int index, const string& bucket_key, RGWBucketInfo& bucket_info,
+                        const string& prefix, int expiration, int shard_id,
+                        rgw_lc_bucket_progress& progress, Mutex& progress_lock)
+{
+  rgw_obj_index_key marker;
+  {
+    Mutex::Locker l(progress_lock);
+    if (progress.complete.count(shard_id)) {
+      return 0;
+    }
+    auto iter = progress.markers.find(shard_id);
+    if (iter != progress.markers.end()) {
+      marker.name = iter->second;
+    }
+  }
+
+  LCObjDeleter deleter(store, bucket_info);
+  bool is_truncated;
+  do {
+    if (should_stop()) {
+      /* the pass resumes from the last saved marker */
+      return -ECANCELED;
+    }
+
+    map<string, rgw_bucket_dir_entry> ent_map;
+    int ret = store->cls_bucket_list(bucket_info, shard_id, marker, prefix, 1000, false,
+                                     ent_map, &is_truncated, &marker);
+    if (ret == -ENOENT)
+      return 0;
+    if (ret < 0) {
+      ldout(cct, 0) << "ERROR: cls_bucket_list() shard " << shard_id << " of "
+                    << bucket_info.bucket << " returned " << ret << dendl;
+      return ret;
+    }
+
+    utime_t now = ceph_clock_now();
+
+    for (auto& iter : ent_map) {
+      rgw_bucket_dir_entry& entry = iter.second;
+      rgw_obj_key key;
+      string ns; /* objects in the default namespace only */
+
+      if (!rgw_obj_key::oid_to_key_in_ns(entry.key.name, &key, ns)) {
+        continue;
+      }
+      key.instance = entry.key.instance;
+
+      if (!obj_has_expired(now - ceph::real_clock::to_time_t(entry.meta.mtime), expiration)) {
+        continue;
+      }
+
+      deleter.remove(key, entry.meta.mtime);
+    }
+    /* the marker is saved once the whole page is gone */
+    deleter.drain();
+
+    Mutex::Locker l(progress_lock);
+    if (is_truncated) {
+      progress.markers[shard_id] = marker.name;
+    } else {
+      progress.markers.erase(shard_id);
+      progress.complete.insert(shard_id);
+    }
+    ret = write_progress(index, bucket_key, progress);
+    if (ret < 0) {
+      ldout(cct, 0) << "WARNING: failed to save lc progress of " << bucket_key
+                    << " ret=" << ret << dendl;
+    }
+  } while (is_truncated);
+
+  return 0;
+}
+
+int RGWLC::expire_bucket_shards(int index, const string& bucket_key, RGWBucketInfo& bucket_info,
+                                map<string, lc_op>& prefix_map)
+{
+  rgw_lc_bucket_progress progress;
+  int ret = read_progress(index, bucket_key, &progress);
+  if (ret < 0 && ret != -ENOENT) {
+    return ret;
+  }
+  const bool resuming = (ret == 0);
+  if (resuming) {
+    ldout(cct, 5) << "resuming lifecycle of " << bucket_key << " at prefix "
+                  << progress.prefix << dendl;
+  }
+
+  vector<int> shards;
+  if (bucket_info.num_shards == 0) {
+    shards.push_back(RGW_NO_SHARD);
+  } else {
+    for (uint32_t i = 0; i < bucket_info.num_shards; i++) {
+      shards.push_back(i);
+    }
+  }
+  const size_t num_workers = std::min(shards.size(),
+                                      (size_t)std::max(cct->_conf->rgw_lc_max_wp_worker, 1));
+
+  Mutex progress_lock("RGWLC::progress_lock");
+
+  for (auto prefix_iter = prefix_map.begin(); prefix_iter != prefix_map.end(); ++prefix_iter) {
+    if (!prefix_iter->second.status || prefix_iter->second.expiration <= 0) {
+      continue;
+    }
+    if (resuming && prefix_iter->first < progress.prefix) {
+      continue; /* done by the pass we resume */
+    }
+    if (prefix_iter->first != progress.prefix) {
+      progress.prefix = prefix_iter->first;
+      progress.markers.clear();
+      progress.complete.clear();
+    }
+
+    /* the bucket index shards are listed and expired in parallel */
+    std::atomic<size_t> next = { 0 };
+    std::atomic<int> error = { 0 };
+    auto work = [&] {
+      for (size_t i = next++; i < shards.size() && !should_stop(); i = next++) {
+        int r = expire_shard(index, bucket_key, bucket_info, prefix_iter->first,
+                             prefix_iter->second.expiration, shards[i],
+                             progress, progress_lock);
+        if (r < 0) {
+          error = r;
+        }
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < num_workers; i++) {
+      workers.emplace_back(work);
+    }
+    work();
+    for (auto& t : workers) {
+      t.join();
+    }
+
+    if (error < 0) {
+      return error;
+    }
+    if (should_stop()) {
+      return -ECANCELED;
+    }
+  }
+
+  return 0;
+}
+
+int RGWLC::bucket_lc_process(int index, string& shard_id)
 {
   RGWLifecycleConfiguration  config(cct);
   RGWBucketInfo bucket_info;
@@ -345,54 +642,13 @@ int RGWLC::bucket_lc_process(string& shard_id)
   map<string, lc_op>& prefix_map = config.get_prefix_map();
   list_op.params.list_versions = bucket_info.versioned();
   if (!bucket_info.versioned()) {
-    for(auto prefix_iter = prefix_map.begin(); prefix_iter != prefix_map.end(); ++prefix_iter) {
-      if (!prefix_iter->second.status || prefix_iter->second.expiration <=0) {
-        continue;
-      }
-      list_op.params.prefix = prefix_iter->first;
-      do {
-        objs.clear();
-        list_op.params.marker = list_op.get_next_marker();
-        ret = list_op.list_objects(1000, &objs, NULL, &is_truncated);
-
-        if (ret < 0) {
-          if (ret == (-ENOENT))
-            return 0;
-          ldout(cct, 0) << "ERROR: store->list_objects():" <<dendl;
-          return ret;
-        }
-
-        utime_t now = ceph_clock_now();
-
-        for (auto obj_iter = objs.begin(); obj_iter != objs.end(); ++obj_iter) {
-          rgw_obj_key key(obj_iter->key);
-
-          if (!key.ns.empty()) {
-            continue;
-          }
-
-          if (obj_has_expired(now - ceph::real_clock::to_time_t(obj_iter->meta.mtime), prefix_iter->second.expiration)) {
-            RGWObjectCtx rctx(store);
-            rgw_obj obj(bucket_info.bucket, key);
-            RGWObjState *state;
-            int ret = store->get_obj_state(&rctx, bucket_info, obj, &state, false);
-            if (ret < 0) {
-              return ret;
-            }
-            if (state->mtime != obj_iter->meta.mtime)//Check mtime again to avoid delete a recently update object as much as possible
-              continue;
-            ret = remove_expired_obj(bucket_info, obj_iter->key, true);
-            if (ret < 0) {
-              ldout(cct, 0) << "ERROR: remove_expired_obj " << dendl;
-            } else {
-              ldout(cct, 10) << "DELETED:" << bucket_name << ":" << key << dendl;
-            }
-          }
-        }
-      } while (is_truncated);
+    ret = expire_bucket_shards(index, shard_id, bucket_info, prefix_map);
+    if (ret < 0) {
+      return ret;
     }
   } else {
   //bucket versioning is enabled or suspended
+    LCObjDeleter deleter(store, bucket_info);
     rgw_obj_key pre_marker;
     for(auto prefix_iter = prefix_map.begin(); prefix_iter != prefix_map.end(); ++prefix_iter) {
       if (!prefix_iter->second.status || (prefix_iter->second.expiration <= 0 && prefix_iter->second.noncur_expiration <= 0)) {
@@ -407,6 +663,9 @@ int RGWLC::bucket_lc_process(string& shard_id)
       list_op.params.prefix = prefix_iter->first;
       rgw_bucket_dir_entry pre_obj;
       do {
+        if (should_stop()) {
+          return -ECANCELED;
+        }
         if (!objs.empty()) {
           pre_obj = objs.back();
         }
@@ -455,6 +714,10 @@ int RGWLC::bucket_lc_process(string& shard_id)
             expiration = prefix_iter->second.noncur_expiration;
           }
           if (obj_has_expired(now - ceph::real_clock::to_time_t(mtime), expiration)) {
+            if (remove_indeed) {
+              deleter.remove(obj_iter->key, obj_iter->meta.mtime);
+              continue;
+            }
             if (obj_iter->is_visible()) {
               RGWObjectCtx rctx(store);
               rgw_obj obj(bucket_info.bucket, obj_iter->key);
@@ -479,11 +742,16 @@ int RGWLC::bucket_lc_process(string& shard_id)
   }
 
   ret = handle_multipart_expiration(&target, prefix_map);
+  if (ret < 0) {
+    return ret;
+  }
 
-  return ret;
+  remove_progress(index, shard_id);
+  return 0;
 }
 
-int RGWLC::bucket_lc_post(int index, int max_lock_sec, pair<string, int >& entry, int& result)
+int RGWLC::bucket_lc_post(int index, int max_lock_sec, pair<string, int >& entry, int& result,
+                          const string& prev_marker)
 {
   utime_t lock_duration(cct->_conf->rgw_lc_lock_max_time, 0);
 
@@ -507,6 +775,19 @@ int RGWLC::bucket_lc_post(int index, int max_lock_sec, pair<string, int >& entry
         dout(0) << "RGWLC::bucket_lc_post() failed to remove entry " << obj_names[index] << dendl;
         goto clean;
       }
+    } else if (result == -ECANCELED) {
+      /* interrupted: hand the bucket out again, the next pass of the day
+       * resumes it from its saved progress */
+      entry.second = lc_uninitial;
+      cls_rgw_lc_obj_head head;
+      ret = cls_rgw_lc_get_head(store->lc_pool_ctx, obj_names[index], head);
+      if (ret == 0 && head.marker == entry.first) {
+        head.marker = prev_marker;
+        ret = cls_rgw_lc_put_head(store->lc_pool_ctx, obj_names[index], head);
+      }
+      if (ret < 0) {
+        dout(0) << "RGWLC::bucket_lc_post() failed to rewind head " << obj_names[index] << dendl;
+      }
     } else if (result < 0) {
       entry.second = lc_failed;
     } else {
@@ -557,14 +838,33 @@ int RGWLC::process()
   if (ret < 0)
     return ret;
 
-  for (int i = 0; i < max_objs; i++) {
-    int index = (i + start) % max_objs;
-    ret = process(index, max_secs);
-    if (ret < 0)
-      return ret;
+  /* the lc shards, and so their buckets, are handed out to the workers
+   * one at a time */
+  int num_workers = std::min(std::max(cct->_conf->rgw_lc_max_worker, 1), max_objs);
+  std::atomic<int> next = { 0 };
+  std::atomic<int> error = { 0 };
+
+  auto work = [&] {
+    for (int i = next++; i < max_objs && !should_stop(); i = next++) {
+      int index = (i + start) % max_objs;
+      int r = process(index, max_secs);
+      if (r < 0) {
+        error = r;
+        next = max_objs;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 1; i < num_workers; i++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto& t : workers) {
+    t.join();
   }
 
-  return 0;
+  return error;
 }
 
 int RGWLC::process(int index, int max_lock_secs)
@@ -575,6 +875,8 @@ int RGWLC::process(int index, int max_lock_secs)
     pair<string, int > entry;//string = bucket_name:bucket_id ,int = LC_BUCKET_STATUS
     if (max_lock_secs <= 0)
       return -EAGAIN;
+    if (should_stop())
+      return 0;
 
     utime_t time(max_lock_secs, 0);
     l.set_duration(time);
@@ -588,7 +890,7 @@ int RGWLC::process(int index, int max_lock_secs)
     if (ret < 0)
       return 0;
 
-    string marker;
+    string prev_marker;
     cls_rgw_lc_obj_head head;
     ret = cls_rgw_lc_get_head(store->lc_pool_ctx, obj_names[index], head);
     if (ret < 0) {
@@ -622,6 +924,7 @@ int RGWLC::process(int index, int max_lock_secs)
       goto exit;
     }
 
+    prev_marker = head.marker;
     head.marker = entry.first;
     ret = cls_rgw_lc_put_head(store->lc_pool_ctx, obj_names[index],  head);
     if (ret < 0) {
@@ -629,9 +932,9 @@ int RGWLC::process(int index, int max_lock_secs)
       goto exit;
     }
     l.unlock(&store->lc_pool_ctx, obj_names[index]);
-    ret = bucket_lc_process(entry.first);
-    bucket_lc_post(index, max_lock_secs, entry, ret);
-    return 0;
+    ret = bucket_lc_process(index, entry.first);
+    bucket_lc_post(index, max_lock_secs, entry, ret, prev_marker);
+    continue; /* on to the next bucket of this shard */
 exit:
     l.unlock(&store->lc_pool_ctx, obj_names[index]);
     return 0;
@@ -669,6 +972,11 @@ bool RGWLC::going_down()
 }
 
 bool RGWLC::LCWorker::should_work(utime_t& now)
+{
+  return lc->should_work(now);
+}
+
+bool RGWLC::should_work(utime_t& now)
 {
   int start_hour;
   int start_minute;
@@ -2,6 +2,7 @@
 #define CEPH_RGW_LC_H
 
 #include <map>
+#include <set>
 #include <string>
 #include <iostream>
 #include <include/types.h>
@@ -222,6 +223,33 @@ public:
 };
 WRITE_CLASS_ENCODER(RGWLifecycleConfiguration)
 
+/*
+ * How far a lifecycle pass over a bucket got, so that an interrupted pass
+ * resumes where it stopped: the rule prefix it was working on and, for each
+ * bucket index shard, the last key it went through or whether it is done.
+ */
+struct rgw_lc_bucket_progress {
+  string prefix;
+  map<int32_t, string> markers;
+  set<int32_t> complete;
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(prefix, bl);
+    ::encode(markers, bl);
+    ::encode(complete, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator& bl) {
+    DECODE_START(1, bl);
+    ::decode(prefix, bl);
+    ::decode(markers, bl);
+    ::decode(complete, bl);
+    DECODE_FINISH(bl);
+  }
+};
+WRITE_CLASS_ENCODER(rgw_lc_bucket_progress)
+
 class RGWLC {
   CephContext *cct;
   RGWRados *store;
@@ -260,9 +288,12 @@ class RGWLC {
   bool if_already_run_today(time_t& start_date);
   int list_lc_progress(const string& marker, uint32_t max_entries, map<string, int> *progress_map);
   int bucket_lc_prepare(int index);
-  int bucket_lc_process(string& shard_id);
-  int bucket_lc_post(int index, int max_lock_sec, pair<string, int >& entry, int& result);
+  int bucket_lc_process(int index, string& shard_id);
+  int bucket_lc_post(int index, int max_lock_sec, pair<string, int >& entry, int& result,
+                     const string& prev_marker);
   bool going_down();
+  bool should_work(utime_t& now);
+  bool should_stop();
   void start_processor();
   void stop_processor();
 
@@ -270,6 +301,16 @@ class RGWLC {
   int remove_expired_obj(RGWBucketInfo& bucket_info, rgw_obj_key obj_key, bool remove_indeed = true);
   bool obj_has_expired(double timediff, int days);
   int handle_multipart_expiration(RGWRados::Bucket *target, const map<string, lc_op>& prefix_map);
+
+  void get_progress_oid(int index, string *oid);
+  int read_progress(int index, const string& bucket_key, rgw_lc_bucket_progress *progress);
+  int write_progress(int index, const string& bucket_key, const rgw_lc_bucket_progress& progress);
+  void remove_progress(int index, const string& bucket_key);
+  int expire_bucket_shards(int index, const string& bucket_key, RGWBucketInfo& bucket_info,
+                           map<string, lc_op>& prefix_map);
+  int expire_shard(int index, const string& bucket_key, RGWBucketInfo& bucket_info,
+                   const string& prefix, int expiration, int shard_id,
+                   rgw_lc_bucket_progress& progress, Mutex& progress_lock);
 };
 
 
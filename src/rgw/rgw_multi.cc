@@ -182,6 +182,155 @@ int list_multipart_parts(RGWRados *store, struct req_state *s,
   return list_multipart_parts(store, s->bucket_info, s->cct, upload_id, meta_oid, num_parts, marker, parts, next_marker, truncated, assume_unsorted);
 }
 
+static string part_key(int num)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "part.%08d", num);
+  return buf;
+}
+
+int fetch_multipart_parts(RGWRados *store, RGWBucketInfo& bucket_info, CephContext *cct,
+                          const string& upload_id, string& meta_oid,
+                          const map<int, string>& req_parts,
+                          map<uint32_t, RGWUploadPartInfo>& parts)
+{
+  const int max_aio = cct->_conf->rgw_multipart_complete_max_aio;
+  const int page_size = 1000;
+
+  if (max_aio <= 0 || !is_v2_upload_id(upload_id) || req_parts.empty()) {
+    return -EAGAIN;
+  }
+
+  rgw_obj obj;
+  obj.init_ns(bucket_info.bucket, meta_oid, RGW_OBJ_NS_MULTIPART);
+  obj.set_in_extra_data(true);
+
+  rgw_raw_obj raw_obj;
+  store->obj_to_raw(bucket_info.placement_rule, obj, &raw_obj);
+
+  rgw_rados_ref ref;
+  int ret = store->get_raw_obj_ref(raw_obj, &ref);
+  if (ret < 0) {
+    return ret;
+  }
+
+  /*
+   * The keys are sorted, so the requested part numbers tell us where every
+   * page starts: page i lists the entries after the last part of page i-1.
+   * The last page asks for one more entry so that parts uploaded beyond the
+   * requested ones show up as a mismatch.
+   */
+  struct Page {
+    vector<int> nums;
+    string start_after;
+    map<string, bufferlist> vals;
+    int rval = 0;
+    librados::AioCompletion *c = nullptr;
+  };
+  vector<Page> pages((req_parts.size() + page_size - 1) / page_size);
+  int last_num = 0;
+  auto riter = req_parts.begin();
+  for (auto& page : pages) {
+    page.start_after = part_key(last_num);
+    for (int i = 0; i < page_size && riter != req_parts.end(); ++i, ++riter) {
+      page.nums.push_back(riter->first);
+      last_num = riter->first;
+    }
+  }
+
+  size_t next = 0; /* next page to issue */
+  size_t done = 0; /* next page to wait for */
+  bool mismatch = false;
+
+  while (done < pages.size()) {
+    while (ret >= 0 && !mismatch && next < pages.size() &&
+           next - done < (size_t)max_aio) {
+      Page& page = pages[next];
+      uint64_t max_return = page.nums.size();
+      if (next == pages.size() - 1) {
+        ++max_return;
+      }
+      librados::ObjectReadOperation op;
+      op.omap_get_vals(page.start_after, max_return, &page.vals, &page.rval);
+      page.c = librados::Rados::aio_create_completion(nullptr, nullptr, nullptr);
+      int r = ref.ioctx.aio_operate(ref.oid, page.c, &op, nullptr);
+      if (r < 0) {
+        page.c->release();
+        page.c = nullptr;
+        ret = r;
+        break;
+      }
+      ++next;
+    }
+    if (done == next) {
+      break;
+    }
+
+    Page& page = pages[done++];
+    page.c->wait_for_complete();
+    int r = page.c->get_return_value();
+    page.c->release();
+    page.c = nullptr;
+    if (r >= 0) {
+      r = page.rval;
+    }
+    if (r < 0) {
+      ret = r;
+    }
+    if (ret < 0 || mismatch) {
+      continue; /* just drain the rest */
+    }
+
+    if (page.vals.size() != page.nums.size()) {
+      mismatch = true;
+      continue;
+    }
+    auto num = page.nums.begin();
+    for (auto& val : page.vals) {
+      if (val.first != part_key(*num)) {
+        mismatch = true;
+        break;
+      }
+      RGWUploadPartInfo info;
+      try {
+        bufferlist::iterator bli = val.second.begin();
+        ::decode(info, bli);
+      } catch (buffer::error& err) {
+        ldout(cct, 0) << "ERROR: could not part info, caught buffer::error" << dendl;
+        ret = -EIO;
+        break;
+      }
+      if ((int)info.num != *num) {
+        mismatch = true;
+        break;
+      }
+      parts[info.num] = std::move(info);
+      ++num;
+    }
+    page.vals.clear();
+  }
+
+  if (ret < 0) {
+    return ret;
+  }
+  if (mismatch) {
+    ldout(cct, 10) << "uploaded parts of " << meta_oid
+                   << " don't match the requested ones" << dendl;
+    parts.clear();
+    return -EAGAIN;
+  }
+  return 0;
+}
+
+int fetch_multipart_parts(RGWRados *store, struct req_state *s,
+                          const string& upload_id, string& meta_oid,
+                          const map<int, string>& req_parts,
+                          map<uint32_t, RGWUploadPartInfo>& parts)
+{
+  return fetch_multipart_parts(store, s->bucket_info, s->cct, upload_id, meta_oid,
+                               req_parts, parts);
+}
+
 int abort_multipart_upload(RGWRados *store, CephContext *cct, RGWObjectCtx *obj_ctx, RGWBucketInfo& bucket_info, RGWMPObj& mp_obj)
 {
   rgw_obj meta_obj;
@@ -95,6 +95,21 @@ extern int list_multipart_parts(RGWRados *store, struct req_state *s,
                                 int *next_marker, bool *truncated,
                                 bool assume_unsorted = false);
 
+/*
+ * Reads the part info of exactly the parts in req_parts, with up to
+ * rgw_multipart_complete_max_aio omap reads in flight.  Returns -EAGAIN if
+ * that can't be done (legacy upload id) or if the uploaded parts don't
+ * match the requested ones; callers should then walk the parts with
+ * list_multipart_parts(), which also sorts out why they differ.
+ */
+extern int fetch_multipart_parts(RGWRados *store, RGWBucketInfo& bucket_info, CephContext *cct,
+                                 const string& upload_id, string& meta_oid,
+                                 const std::map<int, string>& req_parts,
+                                 map<uint32_t, RGWUploadPartInfo>& parts);
+extern int fetch_multipart_parts(RGWRados *store, struct req_state *s,
+                                 const string& upload_id, string& meta_oid,
+                                 const std::map<int, string>& req_parts,
+                                 map<uint32_t, RGWUploadPartInfo>& parts);
 extern int abort_multipart_upload(RGWRados *store, CephContext *cct, RGWObjectCtx *obj_ctx,
                                 RGWBucketInfo& bucket_info, RGWMPObj& mp_obj);
 
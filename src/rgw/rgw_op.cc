@@ -1487,6 +1487,7 @@ void RGWGetObj::execute()
   RGWGetDataCB* filter = (RGWGetDataCB*)&cb;
   boost::optional<RGWGetObj_Decompress> decompress;
   std::unique_ptr<RGWGetDataCB> decrypt;
+  std::unique_ptr<RGWGetDataCB> select;
   map<string, bufferlist>::iterator attr_iter;
 
   perfcounter->inc(l_rgw_get);
@@ -1544,6 +1545,14 @@ void RGWGetObj::execute()
   }
   /* end gettorrent */
 
+  op_ret = get_select_filter(&select, filter);
+  if (op_ret < 0) {
+    goto done_err;
+  }
+  if (select) {
+    filter = select.get();
+  }
+
   op_ret = rgw_compression_info_from_attrset(attrs, need_decompress, cs_info);
   if (op_ret < 0) {
     lderr(s->cct) << "ERROR: failed to decode compression info, cannot decompress" << dendl;
@@ -1556,9 +1565,19 @@ void RGWGetObj::execute()
   }
   // for range requests with obj size 0
   if (range_str && !(s->obj_size)) {
-    total_len = 0;
-    op_ret = -ERANGE;
-    goto done_err;
+    if (s->system_request &&
+        s->info.args.exists(RGW_SYS_PARAM_PREFIX "prepend-metadata")) {
+      /* sync reads objects in ranges without knowing their size, send
+       * empty ones whole rather than failing them */
+      range_str = NULL;
+      partial_content = false;
+      ofs = 0;
+      end = -1;
+    } else {
+      total_len = 0;
+      op_ret = -ERANGE;
+      goto done_err;
+    }
   }
 
   op_ret = read_op.range_to_ofs(s->obj_size, ofs, end);
@@ -1624,6 +1643,9 @@ void RGWGetObj::execute()
   end_x = end;
   filter->fixup_range(ofs_x, end_x);
   op_ret = read_op.iterate(ofs_x, end_x, filter);
+  if (op_ret == -ECANCELED && select_done()) {
+    op_ret = 0;
+  }
 
   if (op_ret >= 0)
     op_ret = filter->flush();
@@ -2112,9 +2134,10 @@ void RGWListBucket::execute()
   list_op.params.marker = marker;
   list_op.params.end_marker = end_marker;
   list_op.params.list_versions = list_versions;
+  list_op.params.allow_unordered = allow_unordered;
 
   op_ret = list_op.list_objects(max, &objs, &common_prefixes, &is_truncated);
-  if (op_ret >= 0 && !delimiter.empty()) {
+  if (op_ret >= 0 && (!delimiter.empty() || allow_unordered)) {
     next_marker = list_op.get_next_marker();
   }
 }
@@ -3119,6 +3142,11 @@ void RGWPutObj::execute()
     }
   }
 
+  /* only queues the bucket for resharding, never fails the upload */
+  if (store->check_bucket_shards(s->bucket_info, s->bucket, bucket_quota) < 0) {
+    ldout(s->cct, 20) << "check_bucket_shards() failed for bucket " << s->bucket << dendl;
+  }
+
   if (supplied_etag) {
     strncpy(supplied_md5, supplied_etag, sizeof(supplied_md5) - 1);
     supplied_md5[sizeof(supplied_md5) - 1] = '\0';
@@ -5067,14 +5095,30 @@ void RGWCompleteMultipart::execute()
     return;
   }
 
+  /* read all the part infos at once if we can, else walk them page by page */
+  map<uint32_t, RGWUploadPartInfo> fetched_parts;
+  op_ret = fetch_multipart_parts(store, s, upload_id, meta_oid, parts->parts,
+                                 fetched_parts);
+  bool fetched = (op_ret == 0);
+  if (op_ret == -ENOENT) {
+    op_ret = -ERR_NO_SUCH_UPLOAD;
+  }
+  if (op_ret < 0 && op_ret != -EAGAIN)
+    return;
+
   do {
-    op_ret = list_multipart_parts(store, s, upload_id, meta_oid, max_parts,
-				  marker, obj_parts, &marker, &truncated);
-    if (op_ret == -ENOENT) {
-      op_ret = -ERR_NO_SUCH_UPLOAD;
+    if (fetched) {
+      obj_parts.swap(fetched_parts);
+      truncated = false;
+    } else {
+      op_ret = list_multipart_parts(store, s, upload_id, meta_oid, max_parts,
+				    marker, obj_parts, &marker, &truncated);
+      if (op_ret == -ENOENT) {
+        op_ret = -ERR_NO_SUCH_UPLOAD;
+      }
+      if (op_ret < 0)
+        return;
     }
-    if (op_ret < 0)
-      return;
 
     total_parts += obj_parts.size();
     if (!truncated && total_parts != (int)parts->parts.size()) {
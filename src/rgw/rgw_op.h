@@ -278,6 +278,19 @@ public:
     *filter = nullptr;
     return 0;
   }
+  /**
+   * calculates filter used to pick records out of the (plain) object data
+   */
+  virtual int get_select_filter(std::unique_ptr<RGWGetDataCB>* filter, RGWGetDataCB* cb) {
+    *filter = nullptr;
+    return 0;
+  }
+  /**
+   * whether the select filter stopped the read because it has all it needs
+   */
+  virtual bool select_done() {
+    return false;
+  }
 };
 
 class RGWGetObj_CB : public RGWGetDataCB
@@ -650,12 +663,14 @@ protected:
   bool is_truncated;
 
   int shard_id;
+  bool allow_unordered;
 
   int parse_max_keys();
 
 public:
   RGWListBucket() : list_versions(false), max(0),
-                    default_max(0), is_truncated(false), shard_id(-1) {}
+                    default_max(0), is_truncated(false), shard_id(-1),
+                    allow_unordered(false) {}
   int verify_permission() override;
   void pre_exec() override;
   void execute() override;
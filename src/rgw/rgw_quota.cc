@@ -935,6 +935,31 @@ public:
     return 0;
   }
 
+  int check_bucket_shards(uint64_t max_objs_per_shard, uint64_t num_shards,
+                          const rgw_user& user, rgw_bucket& bucket,
+                          RGWQuotaInfo& bucket_quota, uint64_t num_objs,
+                          bool& need_resharding, uint32_t *suggested_num_shards) override {
+    RGWStorageStats bucket_stats;
+    int ret = bucket_stats_cache.get_stats(user, bucket, bucket_stats,
+                                           bucket_quota);
+    if (ret < 0) {
+      return ret;
+    }
+
+    need_resharding = false;
+    if (bucket_stats.num_objects + num_objs > num_shards * max_objs_per_shard) {
+      ldout(store->ctx(), 5) << __func__ << ": resharding needed: stats.num_objects=" << bucket_stats.num_objects
+                             << " shard max_objects=" <<  max_objs_per_shard * num_shards << dendl;
+      need_resharding = true;
+      if (suggested_num_shards) {
+        /* leave room for the bucket to double before the next reshard */
+        *suggested_num_shards = (bucket_stats.num_objects + num_objs) * 2 / max_objs_per_shard;
+      }
+    }
+
+    return 0;
+  }
+
   void update_stats(const rgw_user& user, rgw_bucket& bucket, int obj_delta, uint64_t added_bytes, uint64_t removed_bytes) override {
     bucket_stats_cache.adjust_stats(user, bucket, obj_delta, added_bytes, removed_bytes);
     user_stats_cache.adjust_stats(user, bucket, obj_delta, added_bytes, removed_bytes);
@@ -58,12 +58,15 @@ using namespace librados;
 #include <atomic>
 #include <list>
 #include <map>
+#include <queue>
 #include "auth/Crypto.h" // get_random_bytes()
 
 #include "rgw_log.h"
 
 #include "rgw_gc.h"
 #include "rgw_lc.h"
+#include "rgw_reshard.h"
+#include "rgw_index_batcher.h"
 
 #include "rgw_object_expirer_core.h"
 #include "rgw_sync.h"
@@ -2461,7 +2464,8 @@ int RGWPutObjProcessor_Aio::handle_obj_data(rgw_raw_obj& obj, bufferlist& bl, of
 
   // For the first call pass -1 as the offset to
   // do a write_full.
-  return store->aio_put_obj_data(NULL, obj, bl, ((ofs != 0) ? ofs : -1), exclusive, phandle);
+  return store->aio_put_obj_data(NULL, obj, bl, ((ofs != 0) ? ofs : -1), exclusive, phandle,
+                                 (obj_ctx.y ? &aio_waiter : nullptr));
 }
 
 struct put_obj_aio_info RGWPutObjProcessor_Aio::pop_pending()
@@ -2479,6 +2483,11 @@ int RGWPutObjProcessor_Aio::wait_pending_front()
     return 0;
   }
   struct put_obj_aio_info info = pop_pending();
+  if (obj_ctx.y) {
+    while (!store->aio_completed(info.handle)) {
+      aio_waiter.wait(obj_ctx.y);
+    }
+  }
   int ret = store->aio_wait(info.handle);
 
   if (ret >= 0) {
@@ -3362,6 +3371,214 @@ int RGWRados::get_max_chunk_size(const string& placement_rule, const rgw_obj& ob
   return get_max_chunk_size(pool, max_chunk_size);
 }
 
+/* how often an index op follows its bucket through a reshard */
+#define RGW_RESHARD_INDEX_OP_RETRIES 3
+
+/*
+ * Complete ops are fire and forget.  cls_rgw refuses the ones that reach a
+ * bucket index shard after its reshard started the final catch-up; those
+ * are queued here and, once the reshard is over, resent to the index of
+ * the new bucket instance, which carries the pending entries of the old
+ * one.  Ops still queued at shutdown are dropped: as after a crash, their
+ * pending entries are fixed up the next time the bucket is listed.
+ */
+class RGWIndexCompletionRetrier : public Thread {
+  RGWRados *store;
+  CephContext *cct;
+  Mutex lock;
+  Cond cond;
+  bool stopping = false;
+  int num_inflight = 0;
+
+  struct Entry {
+    RGWIndexCompletionRetrier *retrier;
+    rgw_bucket bucket; /* the bucket instance the op was sent to */
+    rgw_cls_obj_complete_op op;
+  };
+  list<Entry *> pending;
+
+  static void complete_cb(librados::completion_t c, void *arg) {
+    Entry *e = static_cast<Entry *>(arg);
+    RGWIndexCompletionRetrier *retrier = e->retrier;
+    int r = rados_aio_get_return_value(c);
+
+    Mutex::Locker l(retrier->lock);
+    --retrier->num_inflight;
+    if (r == -ERR_BUSY_RESHARDING) {
+      retrier->pending.push_back(e);
+    } else {
+      delete e;
+    }
+    retrier->cond.Signal();
+  }
+
+  static void encode_op(librados::ObjectWriteOperation& o, rgw_cls_obj_complete_op& op) {
+    cls_rgw_bucket_complete_op(o, op.op, op.tag, op.ver, op.key, op.meta,
+                               op.remove_objs.empty() ? NULL : &op.remove_objs,
+                               op.log_op, op.bilog_flags);
+  }
+
+  /* @returns -EAGAIN if the reshard is still running */
+  int resend(Entry *e) {
+    RGWBucketInfo bucket_info;
+    bucket_info.bucket = e->bucket;
+    int r = store->follow_bucket_reshard(bucket_info);
+    if (r == -ERR_BUSY_RESHARDING) {
+      return -EAGAIN;
+    }
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: failed to follow bucket " << e->bucket << " through its reshard, dropping complete op on "
+                    << e->op.key.name << ": r=" << r << dendl;
+      return r;
+    }
+    e->bucket = bucket_info.bucket;
+
+    RGWRados::BucketShard bs(store);
+    r = bs.init(bucket_info.bucket, rgw_obj(bucket_info.bucket, rgw_obj_key(e->op.key)));
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: failed to open index shard of " << bucket_info.bucket << " for "
+                    << e->op.key.name << ": r=" << r << dendl;
+      return r;
+    }
+
+    librados::ObjectWriteOperation o;
+    encode_op(o, e->op);
+    r = bs.index_ctx.operate(bs.bucket_obj, &o);
+    if (r == -ERR_BUSY_RESHARDING) {
+      return -EAGAIN;
+    }
+    if (r < 0) {
+      ldout(cct, 0) << "WARNING: complete op on " << e->op.key.name << " in " << bs.bucket_obj
+                    << " returned " << r << dendl;
+      return r;
+    }
+    ldout(cct, 10) << "resent complete op on " << e->op.key.name << " to resharded bucket instance "
+                   << bucket_info.bucket.bucket_id << dendl;
+
+    r = store->data_log->add_entry(bs.bucket, bs.shard_id);
+    if (r < 0) {
+      lderr(cct) << "ERROR: failed writing data log" << dendl;
+    }
+    return 0;
+  }
+
+public:
+  explicit RGWIndexCompletionRetrier(RGWRados *_store)
+    : store(_store), cct(_store->ctx()), lock("RGWIndexCompletionRetrier") {}
+
+  /* sends op to oid, and queues it for a retry if a reshard refuses it */
+  int send(librados::IoCtx& ioctx, const string& oid, const rgw_bucket& bucket,
+           rgw_cls_obj_complete_op& op) {
+    Entry *e = new Entry{this, bucket, std::move(op)};
+    librados::ObjectWriteOperation o;
+    encode_op(o, e->op);
+
+    Mutex::Locker l(lock);
+    AioCompletion *c = librados::Rados::aio_create_completion(e, NULL, complete_cb);
+    int r = ioctx.aio_operate(oid, c, &o);
+    c->release();
+    if (r < 0) {
+      delete e;
+      return r;
+    }
+    ++num_inflight;
+    return 0;
+  }
+
+  /* for ops the caller already saw refused */
+  void retry(const rgw_bucket& bucket, rgw_cls_obj_complete_op& op) {
+    Mutex::Locker l(lock);
+    pending.push_back(new Entry{this, bucket, std::move(op)});
+    cond.Signal();
+  }
+
+  void *entry() override {
+    Mutex::Locker l(lock);
+    while (!stopping) {
+      if (pending.empty()) {
+        cond.Wait(lock);
+        continue;
+      }
+
+      list<Entry *> cur;
+      cur.swap(pending);
+      lock.Unlock();
+      for (auto iter = cur.begin(); iter != cur.end(); ) {
+        if (resend(*iter) == -EAGAIN) {
+          ++iter;
+        } else {
+          delete *iter;
+          iter = cur.erase(iter);
+        }
+      }
+      lock.Lock();
+
+      /* the reshard is still running, check back later */
+      pending.splice(pending.begin(), cur);
+      if (!pending.empty() && !stopping) {
+        cond.WaitInterval(lock, utime_t(1, 0));
+      }
+    }
+    return NULL;
+  }
+
+  /* waits for the ops in flight, drops the ones that would need a retry */
+  void stop() {
+    lock.Lock();
+    stopping = true;
+    cond.Signal();
+    lock.Unlock();
+    join();
+
+    Mutex::Locker l(lock);
+    while (num_inflight > 0) {
+      cond.Wait(lock);
+    }
+    if (!pending.empty()) {
+      ldout(cct, 0) << "WARNING: dropping " << pending.size()
+                    << " bucket index complete ops held back by a reshard" << dendl;
+    }
+    for (auto e : pending) {
+      delete e;
+    }
+    pending.clear();
+  }
+};
+
+/* sends the batched complete ops through rados and the retrier */
+class RGWRadosIndexCompleteBatcher : public RGWIndexCompleteBatcher {
+  RGWIndexCompletionRetrier *retrier;
+
+  static void sent_cb(librados::completion_t c, void *arg) {
+    Sent *sent = static_cast<Sent *>(arg);
+    auto batcher = static_cast<RGWRadosIndexCompleteBatcher *>(sent->batcher);
+    batcher->handle_sent(sent, rados_aio_get_return_value(c));
+  }
+
+protected:
+  int send_batch(Sent *sent) override {
+    ObjectWriteOperation o;
+    cls_rgw_bucket_complete_ops(o, sent->ops);
+    AioCompletion *c = librados::Rados::aio_create_completion(sent, NULL, sent_cb);
+    int r = sent->ioctx.aio_operate(sent->oid, c, &o);
+    c->release();
+    return r;
+  }
+
+  void send_single(librados::IoCtx& ioctx, const string& oid, const rgw_bucket& bucket,
+                   rgw_cls_obj_complete_op& op) override {
+    retrier->send(ioctx, oid, bucket, op);
+  }
+
+  void retry(const rgw_bucket& bucket, rgw_cls_obj_complete_op& op) override {
+    retrier->retry(bucket, op);
+  }
+
+public:
+  RGWRadosIndexCompleteBatcher(CephContext *_cct, RGWIndexCompletionRetrier *_retrier)
+    : RGWIndexCompleteBatcher(_cct), retrier(_retrier) {}
+};
+
 void RGWRados::finalize()
 {
   if (run_sync_thread) {
@@ -3377,6 +3594,10 @@ void RGWRados::finalize()
       sync_log_trimmer->stop();
     }
   }
+  if (use_lc_thread && lc) {
+    /* lifecycle removes objects through async_rados */
+    lc->stop_processor();
+  }
   if (async_rados) {
     async_rados->stop();
   }
@@ -3417,6 +3638,17 @@ void RGWRados::finalize()
   if (async_rados) {
     delete async_rados;
   }
+  delete fetch_range_budget;
+  if (index_batcher) {
+    index_batcher->stop();
+    delete index_batcher;
+    index_batcher = NULL;
+  }
+  if (index_retrier) {
+    index_retrier->stop();
+    delete index_retrier;
+    index_retrier = NULL;
+  }
   if (use_gc_thread) {
     gc->stop_processor();
     obj_expirer->stop_processor();
@@ -3424,12 +3656,15 @@ void RGWRados::finalize()
   delete gc;
   gc = NULL;
 
-  if (use_lc_thread) {
-    lc->stop_processor();
-  }
   delete lc;
   lc = NULL;
 
+  if (reshard) {
+    reshard->stop_processor();
+  }
+  delete reshard;
+  reshard = NULL;
+
   delete obj_expirer;
   obj_expirer = NULL;
 
@@ -4161,6 +4396,14 @@ int RGWRados::init_complete()
   gc = new RGWGC();
   gc->initialize(cct, this);
 
+  index_retrier = new RGWIndexCompletionRetrier(this);
+  index_retrier->create("rgw_idx_retry");
+
+  if (cct->_conf->rgw_bucket_index_complete_batch_ms > 0) {
+    index_batcher = new RGWRadosIndexCompleteBatcher(cct, index_retrier);
+    index_batcher->create("rgw_idx_batch");
+  }
+
   obj_expirer = new RGWObjectExpirer(this);
 
   if (use_gc_thread) {
@@ -4185,6 +4428,9 @@ int RGWRados::init_complete()
   async_rados = new RGWAsyncRadosProcessor(this, cct->_conf->rgw_num_async_rados_threads);
   async_rados->start();
 
+  fetch_range_budget = new Throttle(cct, "rgw_data_sync_range",
+                                    cct->_conf->rgw_data_sync_range_max_buffer);
+
   ret = meta_mgr->init(current_period.get_id());
   if (ret < 0) {
     lderr(cct) << "ERROR: failed to initialize metadata log: "
@@ -4239,7 +4485,12 @@ int RGWRados::init_complete()
   
   if (use_lc_thread)
     lc->start_processor();
-  
+
+  reshard = new RGWReshard(this);
+  if (use_gc_thread && cct->_conf->rgw_dynamic_resharding && !need_to_log_data()) {
+    reshard->start_processor();
+  }
+
   quota_handler = RGWQuotaHandler::generate_handler(this, quota_threads);
 
   bucket_index_max_shards = (cct->_conf->rgw_override_bucket_index_max_shards ? cct->_conf->rgw_override_bucket_index_max_shards :
@@ -5183,6 +5434,98 @@ int rgw_policy_from_attrset(CephContext *cct, map<string, bufferlist>& attrset,
 int RGWRados::Bucket::List::list_objects(int max, vector<rgw_bucket_dir_entry> *result,
                                          map<string, bool> *common_prefixes,
                                          bool *is_truncated)
+{
+  /* an unordered listing can't fold keys into common prefixes */
+  if (params.allow_unordered && params.delim.empty()) {
+    return list_objects_unordered(max, result, is_truncated);
+  }
+  return list_objects_ordered(max, result, common_prefixes, is_truncated);
+}
+
+/*
+ * Hand out entries shard by shard instead of merging every shard into key
+ * order.  Each page only touches the shards it actually reads from, so the
+ * cost no longer grows with the number of shards.
+ */
+int RGWRados::Bucket::List::list_objects_unordered(int max, vector<rgw_bucket_dir_entry> *result,
+                                                   bool *is_truncated)
+{
+  RGWRados *store = target->get_store();
+  CephContext *cct = store->ctx();
+  int shard_id = target->get_shard_id();
+
+  int count = 0;
+  bool truncated = true;
+
+  result->clear();
+
+  rgw_obj_key marker_obj(params.marker.name, params.marker.instance, params.ns);
+  rgw_obj_index_key cur_marker;
+  marker_obj.get_index_key(&cur_marker);
+
+  rgw_obj_key end_marker_obj(params.end_marker.name, params.end_marker.instance, params.ns);
+  rgw_obj_index_key cur_end_marker;
+  end_marker_obj.get_index_key(&cur_end_marker);
+  const bool cur_end_marker_valid = !params.end_marker.empty();
+
+  rgw_obj_key prefix_obj(params.prefix);
+  prefix_obj.ns = params.ns;
+  string cur_prefix = prefix_obj.get_index_key_name();
+
+  while (truncated && count < max) {
+    std::vector<rgw_bucket_dir_entry> ent_list;
+    int r = store->cls_bucket_list_unordered(target->get_bucket_info(), shard_id, cur_marker, cur_prefix,
+                                             max - count, params.list_versions, ent_list,
+                                             &truncated, &cur_marker);
+    if (r < 0)
+      return r;
+
+    for (auto& entry : ent_list) {
+      rgw_obj_index_key index_key = entry.key;
+      rgw_obj_key obj(index_key);
+
+      bool valid = rgw_obj_key::parse_raw_oid(index_key.name, &obj);
+      if (!valid) {
+        ldout(cct, 0) << "ERROR: could not parse object name: " << obj.name << dendl;
+        continue;
+      }
+
+      if (!params.list_versions && !entry.is_visible()) {
+        continue;
+      }
+
+      if (params.enforce_ns && obj.ns != params.ns) {
+        continue;
+      }
+
+      /* entries come out of key order, so the end marker only filters */
+      if (cur_end_marker_valid && cur_end_marker <= index_key) {
+        continue;
+      }
+
+      params.marker = index_key;
+      next_marker = index_key;
+
+      if (params.filter && !params.filter->filter(obj.name, index_key.name))
+        continue;
+
+      if (params.prefix.size() && (obj.name.compare(0, params.prefix.size(), params.prefix) != 0))
+        continue;
+
+      result->emplace_back(std::move(entry));
+      count++;
+    }
+  }
+
+  if (is_truncated)
+    *is_truncated = truncated;
+
+  return 0;
+}
+
+int RGWRados::Bucket::List::list_objects_ordered(int max, vector<rgw_bucket_dir_entry> *result,
+                                                 map<string, bool> *common_prefixes,
+                                                 bool *is_truncated)
 {
   RGWRados *store = target->get_store();
   CephContext *cct = store->ctx();
@@ -6530,7 +6873,7 @@ int RGWRados::Object::Write::_do_write_meta(uint64_t size, uint64_t accounted_si
       return r;
   }
 
-  r = ref.ioctx.operate(ref.oid, &op);
+  r = rgw_rados_operate(ref.ioctx, ref.oid, &op, target->get_ctx().y);
   if (r < 0) { /* we can expect to get -ECANCELED if object was replaced under,
                 or -ENOENT if was removed, or -EEXIST if it did not exist
                 before and now it does */
@@ -6544,6 +6887,14 @@ int RGWRados::Object::Write::_do_write_meta(uint64_t size, uint64_t accounted_si
   epoch = ref.ioctx.get_last_version();
   poolid = ref.ioctx.get_id();
 
+  /* drop cached copies of the old head; even a write that expected to
+   * create the object may have replaced one */
+  {
+    rgw_raw_obj raw_head;
+    store->obj_to_raw(target->get_bucket_info().placement_rule, obj, &raw_head);
+    store->obj_head_changed(raw_head);
+  }
+
   r = target->complete_atomic_modification();
   if (r < 0) {
     ldout(store->ctx(), 0) << "ERROR: complete_atomic_modification returned r=" << r << dendl;
@@ -6640,6 +6991,7 @@ int RGWRados::Object::Write::write_meta(uint64_t size, uint64_t accounted_size,
 
   RGWRados::Bucket bop(target->get_store(), bucket_info);
   RGWRados::Bucket::UpdateIndex index_op(&bop, target->get_obj());
+  index_op.set_yield(target->get_ctx().y);
 
   bool assume_noent = (meta.if_match == NULL && meta.if_nomatch == NULL);
   int r;
@@ -6768,7 +7120,7 @@ int RGWRados::put_system_obj_data(void *ctx, rgw_raw_obj& obj, bufferlist& bl,
 
 int RGWRados::aio_put_obj_data(void *ctx, rgw_raw_obj& obj, bufferlist& bl,
 			       off_t ofs, bool exclusive,
-                               void **handle)
+                               void **handle, RGWYieldWaiter *waiter)
 {
   rgw_rados_ref ref;
   int r = get_raw_obj_ref(obj, &ref);
@@ -6776,7 +7128,8 @@ int RGWRados::aio_put_obj_data(void *ctx, rgw_raw_obj& obj, bufferlist& bl,
     return r;
   }
 
-  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+  AioCompletion *c = librados::Rados::aio_create_completion(waiter, NULL,
+                                                            (waiter ? RGWYieldWaiter::aio_cb : NULL));
   *handle = c;
   
   ObjectWriteOperation op;
@@ -6799,7 +7152,7 @@ int RGWRados::aio_put_obj_data(void *ctx, rgw_raw_obj& obj, bufferlist& bl,
 int RGWRados::aio_wait(void *handle)
 {
   AioCompletion *c = (AioCompletion *)handle;
-  c->wait_for_safe();
+  c->wait_for_safe_and_cb();
   int ret = c->get_return_value();
   c->release();
   return ret;
@@ -6890,6 +7243,8 @@ public:
         return 0;
       }
     }
+    /* ofs counts the prepended metadata, and ranged reads start past it */
+    off_t data_ofs = data_len;
     data_len += bl.length();
     bool again = false;
 
@@ -6899,7 +7254,7 @@ public:
       void *handle = NULL;
       rgw_raw_obj obj;
       uint64_t size = bl.length();
-      int ret = filter->handle_data(bl, ofs, &handle, &obj, &again);
+      int ret = filter->handle_data(bl, data_ofs, &handle, &obj, &again);
       if (ret < 0)
         return ret;
 
@@ -7198,6 +7553,105 @@ int RGWRados::stat_remote_obj(RGWObjectCtx& obj_ctx,
   return 0;
 }
 
+/* one ranged read of the rest of a remote object */
+struct RGWFetchRange {
+  bufferlist bl;
+  RGWStreamIntoBufferlist cb;
+  RGWRESTStreamRWRequest *req;
+  uint64_t len;
+  Throttle *budget;
+  int64_t cost;
+
+  RGWFetchRange(Throttle *_budget, int64_t _cost)
+    : cb(bl), req(NULL), len(0), budget(_budget), cost(_cost) {}
+  ~RGWFetchRange() {
+    delete req; /* still in flight if we bailed out early */
+    budget->put(cost);
+  }
+};
+
+/*
+ * Reads [ofs, size) of a remote object in ranges of range_size, keeping up
+ * to rgw_data_sync_range_max_aio of them in flight, and hands the data to
+ * cb in order.  All ranges must come from the object version the head
+ * range came from (etag, mtime), otherwise the fetch fails and is retried
+ * by whoever asked for it.
+ *
+ * Ranges are buffered until they can be written, so every range takes its
+ * size from budget, which all fetches share.  A fetch only blocks on the
+ * budget while it holds none of it; otherwise it writes what it has first.
+ */
+static int fetch_remote_ranges(CephContext *cct, RGWRESTConn *conn,
+                               const rgw_user& user_id, req_info *info,
+                               rgw_obj& src_obj, uint64_t ofs, uint64_t size,
+                               uint64_t range_size, const string& etag,
+                               const real_time& mtime, Throttle *budget,
+                               RGWGetDataCB *cb)
+{
+  RGWHTTPManager http_manager(cct);
+  int ret = http_manager.set_threaded();
+  if (ret < 0) {
+    return ret;
+  }
+
+  size_t max_aio = std::max(cct->_conf->rgw_data_sync_range_max_aio, 1);
+  std::deque<std::unique_ptr<RGWFetchRange> > pending;
+  off_t data_ofs = ofs;
+
+  while (ofs < size || !pending.empty()) {
+    while (ofs < size && pending.size() < max_aio) {
+      uint64_t end = std::min(ofs + range_size, size) - 1;
+      int64_t cost = end + 1 - ofs;
+      if (pending.empty()) {
+        budget->get(cost);
+      } else if (!budget->get_or_fail(cost)) {
+        break;
+      }
+      std::unique_ptr<RGWFetchRange> range(new RGWFetchRange(budget, cost));
+      ret = conn->get_obj(user_id, info, src_obj, NULL, NULL, 0, 0,
+                          false /* prepend_meta */, true /* GET */,
+                          false /* rgwx-stat */, false /* sync manifest */,
+                          &range->cb, &range->req, ofs, end, &etag,
+                          &http_manager);
+      if (ret < 0) {
+        return ret;
+      }
+      range->len = end + 1 - ofs;
+      pending.push_back(std::move(range));
+      ofs = end + 1;
+    }
+
+    RGWFetchRange *range = pending.front().get();
+    ret = range->req->wait();
+    if (ret < 0) {
+      return ret;
+    }
+    string range_etag;
+    real_time range_mtime;
+    map<string, string> headers;
+    ret = conn->complete_request(range->req, range_etag, &range_mtime, NULL, headers);
+    range->req = NULL;
+    if (ret < 0) {
+      ldout(cct, 0) << "ERROR: failed to read " << src_obj << " range at "
+          << data_ofs << ": ret=" << ret << dendl;
+      return ret;
+    }
+    if (range_etag != etag || range_mtime != mtime ||
+        range->bl.length() != range->len) {
+      ldout(cct, 0) << "ERROR: " << src_obj << " changed while it was fetched" << dendl;
+      return -ECANCELED;
+    }
+    ret = cb->handle_data(range->bl, data_ofs, range->len);
+    if (ret < 0) {
+      return ret;
+    }
+    data_ofs += range->len;
+    pending.pop_front();
+  }
+
+  return 0;
+}
+
 int RGWRados::fetch_remote_obj(RGWObjectCtx& obj_ctx,
                const rgw_user& user_id,
                const string& client_id,
@@ -7226,7 +7680,8 @@ int RGWRados::fetch_remote_obj(RGWObjectCtx& obj_ctx,
                string *ptag,
                ceph::buffer::list *petag,
                void (*progress_cb)(off_t, void *),
-               void *progress_data)
+               void *progress_data,
+               uint64_t *pbytes)
 {
   /* source is in a different zonegroup, copy from there */
 
@@ -7311,6 +7766,11 @@ int RGWRados::fetch_remote_obj(RGWObjectCtx& obj_ctx,
 
   obj_time_weight dest_mtime_weight;
 
+  /* sync reads large objects in ranges, several at a time */
+  uint64_t range_size = (source_zone.empty() || !fetch_range_budget ? 0 : cct->_conf->rgw_data_sync_range_size);
+  uint64_t obj_size = 0;
+  RGWFetchHeadRangeCB head_cb(&cb, &in_stream_req);
+
   if (copy_if_newer) {
     /* need to get mtime for destination */
     ret = get_obj_state(&obj_ctx, dest_bucket_info, dest_obj, &dest_state, false);
@@ -7326,15 +7786,53 @@ int RGWRados::fetch_remote_obj(RGWObjectCtx& obj_ctx,
   ret = conn->get_obj(user_id, info, src_obj, pmod, unmod_ptr,
                       dest_mtime_weight.zone_short_id, dest_mtime_weight.pg_ver,
                       true /* prepend_meta */, true /* GET */, false /* rgwx-stat */,
-                      true /* sync manifest */, &cb, &in_stream_req);
+                      true /* sync manifest */,
+                      (range_size ? (RGWGetDataCB *)&head_cb : &cb), &in_stream_req,
+                      0, (range_size ? (off_t)range_size - 1 : -1));
   if (ret < 0) {
     goto set_err_state;
   }
 
+  if (range_size && in_stream_req->get_http_status() == 416) {
+    /* an empty object, read it whole */
+    conn->complete_request(in_stream_req, etag, &set_mtime, nullptr, req_headers);
+    range_size = 0;
+    ret = conn->get_obj(user_id, info, src_obj, pmod, unmod_ptr,
+                        dest_mtime_weight.zone_short_id, dest_mtime_weight.pg_ver,
+                        true /* prepend_meta */, true /* GET */, false /* rgwx-stat */,
+                        true /* sync manifest */, &cb, &in_stream_req);
+    if (ret < 0) {
+      goto set_err_state;
+    }
+  }
+
+  if (range_size) {
+    /* Content-Range: bytes <ofs>-<end>/<size>; no header, whole object */
+    auto iter = in_stream_req->get_out_headers().find("CONTENT_RANGE");
+    if (iter != in_stream_req->get_out_headers().end()) {
+      size_t pos = iter->second.rfind('/');
+      if (pos != string::npos) {
+        obj_size = strtoull(iter->second.c_str() + pos + 1, NULL, 10);
+      }
+    }
+  }
+
   ret = conn->complete_request(in_stream_req, etag, &set_mtime, nullptr, req_headers);
   if (ret < 0) {
     goto set_err_state;
   }
+
+  if (obj_size > range_size) {
+    ret = fetch_remote_ranges(cct, conn, user_id, info, src_obj, range_size,
+                              obj_size, range_size, etag, set_mtime,
+                              fetch_range_budget, &cb);
+    if (ret < 0) {
+      goto set_err_state;
+    }
+  }
+  if (pbytes) {
+    *pbytes = cb.get_data_len();
+  }
   if (compressor && compressor->is_compressed()) {
     bufferlist tmp;
     RGWCompressionInfo cs_info;
@@ -7592,6 +8090,7 @@ int RGWRados::copy_obj(RGWObjectCtx& obj_ctx,
   }
 
   vector<rgw_raw_obj> ref_objs;
+  vector<rgw_raw_obj> tail_objs;
 
   if (remote_dest) {
     /* dest is in a different zonegroup, copy it there */
@@ -7635,6 +8134,18 @@ int RGWRados::copy_obj(RGWObjectCtx& obj_ctx,
     }
   }
 
+  /* the tail can't be shared with another pool, but rather than streaming
+   * it through the gateway the OSDs can copy the tail objects themselves */
+  bool copy_tail = false;
+  if (copy_data && src_pool != dest_pool &&
+      cct->_conf->rgw_copy_obj_max_aio > 0 &&
+      astate->has_manifest && astate->manifest.has_tail() &&
+      !astate->manifest.has_explicit_objs() &&
+      astate->manifest.get_head_size() <= max_chunk_size) {
+    copy_data = false;
+    copy_tail = true;
+  }
+
   if (petag) {
     const auto iter = attrs.find(RGW_ATTR_ETAG);
     if (iter != attrs.end()) {
@@ -7688,7 +8199,22 @@ int RGWRados::copy_obj(RGWObjectCtx& obj_ctx,
     append_rand_alpha(cct, tag, tag, 32);
   }
 
-  if (!copy_itself) {
+  if (copy_tail) {
+    manifest = astate->manifest;
+    manifest.set_tail_placement(dest_bucket_info.placement_rule, dest_obj.bucket);
+    string tail_prefix;
+    append_rand_alpha(cct, tail_prefix, tail_prefix, 16);
+    tail_prefix.append("_");
+    manifest.prepend_tail_prefix(tail_prefix);
+
+    ret = copy_obj_tail(astate->manifest, manifest, tag, &tail_objs);
+    if (ret < 0) {
+      ldout(cct, 0) << "ERROR: failed to copy tail of " << src_obj << " ret=" << ret << dendl;
+      goto done_ret;
+    }
+
+    pmanifest = &manifest;
+  } else if (!copy_itself) {
     manifest = astate->manifest;
     const rgw_bucket_placement& tail_placement = manifest.get_tail_placement();
     if (tail_placement.bucket.name.empty()) {
@@ -7745,6 +8271,13 @@ int RGWRados::copy_obj(RGWObjectCtx& obj_ctx,
   return 0;
 
 done_ret:
+  for (auto& obj : tail_objs) {
+    int r = delete_raw_obj(obj);
+    if (r < 0 && r != -ENOENT) {
+      ldout(cct, 0) << "ERROR: cleanup after error failed to remove obj=" << obj << dendl;
+    }
+  }
+
   if (!copy_itself) {
     vector<rgw_raw_obj>::iterator riter;
 
@@ -7851,6 +8384,96 @@ int RGWRados::copy_obj_data(RGWObjectCtx& obj_ctx,
   return processor.complete(accounted_size, etag, mtime, set_mtime, attrs, delete_at);
 }
 
+int RGWRados::copy_obj_tail(RGWObjManifest& src_manifest,
+                            RGWObjManifest& dest_manifest,
+                            const string& tag, vector<rgw_raw_obj> *copied)
+{
+  const size_t max_aio = cct->_conf->rgw_copy_obj_max_aio;
+  const uint64_t head_size = src_manifest.get_head_size();
+
+  rgw_rados_ref src_ref;
+  rgw_rados_ref dest_ref;
+  bool have_refs = false;
+
+  list<librados::AioCompletion *> pending;
+  int ret = 0;
+
+  auto wait_next = [&] {
+    librados::AioCompletion *c = pending.front();
+    pending.pop_front();
+    c->wait_for_safe();
+    int r = c->get_return_value();
+    c->release();
+    if (r < 0 && ret >= 0) {
+      ret = r;
+    }
+  };
+
+  RGWObjManifest::obj_iterator siter = src_manifest.obj_begin();
+  RGWObjManifest::obj_iterator diter = dest_manifest.obj_begin();
+  for (; siter != src_manifest.obj_end() && diter != dest_manifest.obj_end();
+       ++siter, ++diter) {
+    if (siter.get_ofs() < head_size) {
+      continue; /* the head is written by the caller */
+    }
+    const rgw_raw_obj& src_loc = siter.get_location().get_raw_obj(this);
+    const rgw_raw_obj& dest_loc = diter.get_location().get_raw_obj(this);
+
+    if (!have_refs) {
+      ret = get_raw_obj_ref(src_loc, &src_ref);
+      if (ret < 0) {
+        break;
+      }
+      ret = get_raw_obj_ref(dest_loc, &dest_ref);
+      if (ret < 0) {
+        break;
+      }
+      have_refs = true;
+    }
+    src_ref.ioctx.locator_set_key(src_loc.loc);
+    dest_ref.ioctx.locator_set_key(dest_loc.loc);
+
+    ObjectWriteOperation op;
+    op.copy_from(src_loc.oid, src_ref.ioctx, 0);
+    /* the copy gets the source's refcount xattr, replace it with our own */
+    list<string> refs;
+    refs.push_back(tag);
+    cls_refcount_set(op, refs);
+
+    librados::AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    ret = dest_ref.ioctx.aio_operate(dest_loc.oid, c, &op);
+    if (ret < 0) {
+      c->release();
+      break;
+    }
+    pending.push_back(c);
+    copied->push_back(dest_loc);
+
+    while (pending.size() >= max_aio) {
+      wait_next();
+    }
+    if (ret < 0) {
+      break;
+    }
+  }
+
+  while (!pending.empty()) {
+    wait_next();
+  }
+
+  if (ret < 0) {
+    /* don't leak the copies that did go through */
+    for (auto& obj : *copied) {
+      int r = delete_raw_obj(obj);
+      if (r < 0 && r != -ENOENT) {
+        ldout(cct, 0) << "ERROR: cleanup after error failed to remove obj=" << obj << dendl;
+      }
+    }
+    copied->clear();
+  }
+  return ret;
+}
+
 bool RGWRados::is_meta_master()
 {
   if (!get_zonegroup().is_master) {
@@ -8422,6 +9045,7 @@ int RGWRados::Object::Delete::delete_obj()
   RGWRados::Bucket::UpdateIndex index_op(&bop, obj);
 
   index_op.set_bilog_flags(params.bilog_flags);
+  index_op.set_yield(target->get_ctx().y);
 
 
   r = index_op.prepare(CLS_RGW_OP_DEL, &state->write_tag);
@@ -8429,7 +9053,7 @@ int RGWRados::Object::Delete::delete_obj()
     return r;
 
   store->remove_rgw_head_obj(op);
-  r = ref.ioctx.operate(ref.oid, &op);
+  r = rgw_rados_operate(ref.ioctx, ref.oid, &op, target->get_ctx().y);
   bool need_invalidate = false;
   if (r == -ECANCELED) {
     /* raced with another operation, we can regard it as removed */
@@ -8437,6 +9061,11 @@ int RGWRados::Object::Delete::delete_obj()
     r = 0;
   }
   bool removed = (r >= 0);
+  if (removed) {
+    rgw_raw_obj raw_head;
+    store->obj_to_raw(bucket_info.placement_rule, obj, &raw_head);
+    store->obj_head_changed(raw_head);
+  }
 
   int64_t poolid = ref.ioctx.get_id();
   if (r >= 0) {
@@ -8672,6 +9301,12 @@ int RGWRados::get_system_obj_state(RGWObjectCtx *rctx, rgw_raw_obj& obj, RGWRawO
   return ret;
 }
 
+int RGWRados::get_obj_head(rgw_raw_obj& obj, RGWObjState *s, optional_yield y)
+{
+  return RGWRados::raw_obj_stat(obj, &s->size, &s->mtime, &s->epoch, &s->attrset,
+                                (s->prefetch_data ? &s->data : NULL), NULL, y);
+}
+
 int RGWRados::get_obj_state_impl(RGWObjectCtx *rctx, const RGWBucketInfo& bucket_info, const rgw_obj& obj,
                                  RGWObjState **state, bool follow_olh, bool assume_noent)
 {
@@ -8699,7 +9334,7 @@ int RGWRados::get_obj_state_impl(RGWObjectCtx *rctx, const RGWBucketInfo& bucket
   int r = -ENOENT;
 
   if (!assume_noent) {
-    r = RGWRados::raw_obj_stat(raw_obj, &s->size, &s->mtime, &s->epoch, &s->attrset, (s->prefetch_data ? &s->data : NULL), NULL);
+    r = get_obj_head(raw_obj, s, rctx->y);
   }
 
   if (r == -ENOENT) {
@@ -9252,6 +9887,11 @@ int RGWRados::set_attrs(void *ctx, const RGWBucketInfo& bucket_info, rgw_obj& ob
   }
 
   r = ref.ioctx.operate(ref.oid, &op);
+  if (r >= 0) {
+    rgw_raw_obj raw_head;
+    obj_to_raw(bucket_info.placement_rule, obj, &raw_head);
+    obj_head_changed(raw_head);
+  }
   if (state) {
     if (r >= 0) {
       bufferlist acl_bl = attrs[RGW_ATTR_ACL];
@@ -9475,18 +10115,48 @@ int RGWRados::SystemObject::Read::stat(RGWObjVersionTracker *objv_tracker)
                                 stat_params.lastmod, stat_params.obj_size, objv_tracker);
 }
 
+/*
+ * cls_rgw refuses index updates once a reshard of the bucket started its
+ * final catch-up.  Look up where the bucket went and retry there; while
+ * the reshard is still running the caller gets -ERR_BUSY_RESHARDING (503
+ * SlowDown) right away instead of holding the request.
+ */
+int RGWRados::Bucket::UpdateIndex::guard_reshard(BucketShard **pbs, std::function<int(BucketShard *)> call)
+{
+  RGWRados *store = target->get_store();
+  BucketShard *bs;
+  int r;
+
+  for (int i = 0; ; ++i) {
+    r = get_bucket_shard(&bs);
+    if (r < 0) {
+      ldout(store->ctx(), 5) << "failed to get BucketShard object: ret=" << r << dendl;
+      return r;
+    }
+    r = call(bs);
+    if (r != -ERR_BUSY_RESHARDING || i == RGW_RESHARD_INDEX_OP_RETRIES) {
+      break;
+    }
+    ldout(store->ctx(), 10) << "bucket index of " << bs->bucket << " is being resharded" << dendl;
+    r = store->follow_bucket_reshard(target->get_bucket_info());
+    if (r < 0) {
+      return r;
+    }
+    bs_initialized = false;
+  }
+
+  if (pbs) {
+    *pbs = bs;
+  }
+  return r;
+}
+
 int RGWRados::Bucket::UpdateIndex::prepare(RGWModifyOp op, const string *write_tag)
 {
   if (blind) {
     return 0;
   }
   RGWRados *store = target->get_store();
-  BucketShard *bs;
-  int ret = get_bucket_shard(&bs);
-  if (ret < 0) {
-    ldout(store->ctx(), 5) << "failed to get BucketShard object: ret=" << ret << dendl;
-    return ret;
-  }
 
   if (write_tag && write_tag->length()) {
     optag = string(write_tag->c_str(), write_tag->length());
@@ -9496,7 +10166,9 @@ int RGWRados::Bucket::UpdateIndex::prepare(RGWModifyOp op, const string *write_t
     }
   }
 
-  int r = store->cls_obj_prepare_op(*bs, op, optag, obj, bilog_flags);
+  int r = guard_reshard(nullptr, [&](BucketShard *bs) -> int {
+    return store->cls_obj_prepare_op(*bs, op, optag, obj, bilog_flags, y);
+  });
   if (r < 0) {
     return r;
   }
@@ -9690,7 +10362,7 @@ int RGWRados::Object::Read::read(int64_t ofs, int64_t end, bufferlist& bl)
   ldout(cct, 20) << "rados->read obj-ofs=" << ofs << " read_ofs=" << read_ofs << " read_len=" << read_len << dendl;
   op.read(read_ofs, read_len, pbl, NULL);
 
-  r = state.io_ctx.operate(read_obj.oid, &op, NULL);
+  r = rgw_rados_operate(state.io_ctx, read_obj.oid, &op, NULL, source->get_ctx().y);
   ldout(cct, 20) << "rados->read r=" << r << " bl.length=" << bl.length() << dendl;
 
   if (r < 0) {
@@ -9817,6 +10489,8 @@ struct get_obj_data : public RefCountedObject {
   std::atomic<int64_t> err_code = { 0 };
   Throttle throttle;
   list<bufferlist> read_list;
+  optional_yield y;
+  RGWYieldWaiter io_waiter; // notified by io completions when yielding
 
   explicit get_obj_data(CephContext *_cct)
     : cct(_cct),
@@ -9850,6 +10524,13 @@ struct get_obj_data : public RefCountedObject {
     librados::AioCompletion *c = iter->second;
     lock.Unlock();
 
+    if (y) {
+      /* suspend the request rather than the frontend thread; what is left
+       * after that is the completion callback itself */
+      while (!c->is_safe()) {
+        io_waiter.wait(y);
+      }
+    }
     c->wait_for_safe_and_cb();
     int r = c->get_return_value();
 
@@ -10023,6 +10704,9 @@ void RGWRados::get_obj_aio_completion_cb(completion_t c, void *arg)
 done_unlock:
   d->data_lock.Unlock();
 done:
+  if (d->y) {
+    d->io_waiter.notify();
+  }
   d->put();
   return;
 }
@@ -10103,7 +10787,14 @@ int RGWRados::get_obj_iterate_cb(RGWObjectCtx *ctx, RGWObjState *astate,
     }
   }
 
-  d->throttle.get(len);
+  if (d->y) {
+    /* wait for the read window to open without holding the thread */
+    while (!d->throttle.get_or_fail(len)) {
+      d->io_waiter.wait(d->y);
+    }
+  } else {
+    d->throttle.get(len);
+  }
   if (d->is_cancelled()) {
     return d->get_err_code();
   }
@@ -10153,6 +10844,7 @@ int RGWRados::Object::Read::iterate(int64_t ofs, int64_t end, RGWGetDataCB *cb)
   data->rados = store;
   data->io_ctx.dup(state.io_ctx);
   data->client_cb = cb;
+  data->y = obj_ctx.y;
 
   int r = store->iterate_obj(obj_ctx, source->get_bucket_info(), state.obj, ofs, end, cct->_conf->rgw_get_obj_max_req_size, _get_obj_iterate_cb, (void *)data);
   if (r < 0) {
@@ -10403,22 +11095,29 @@ int RGWRados::bucket_index_link_olh(const RGWBucketInfo& bucket_info, RGWObjStat
     return r;
   }
 
-  BucketShard bs(this);
-  int ret = bs.init(obj_instance.bucket, obj_instance);
-  if (ret < 0) {
-    ldout(cct, 5) << "bs.init() returned ret=" << ret << dendl;
-    return ret;
-  }
-
+  RGWBucketInfo cur_info = bucket_info;
+  rgw_bucket bucket = obj_instance.bucket;
   cls_rgw_obj_key key(obj_instance.key.get_index_key_name(), obj_instance.key.instance);
-  ret = cls_rgw_bucket_link_olh(bs.index_ctx, bs.bucket_obj, key, olh_state.olh_tag, delete_marker, op_tag, meta, olh_epoch,
-                                unmod_since, high_precision_time,
-                                get_zone().log_data);
-  if (ret < 0) {
-    return ret;
-  }
+  for (int i = 0; ; ++i) {
+    BucketShard bs(this);
+    int ret = bs.init(bucket, obj_instance);
+    if (ret < 0) {
+      ldout(cct, 5) << "bs.init() returned ret=" << ret << dendl;
+      return ret;
+    }
 
-  return 0;
+    ret = cls_rgw_bucket_link_olh(bs.index_ctx, bs.bucket_obj, key, olh_state.olh_tag, delete_marker, op_tag, meta, olh_epoch,
+                                  unmod_since, high_precision_time,
+                                  get_zone().log_data);
+    if (ret != -ERR_BUSY_RESHARDING || i == RGW_RESHARD_INDEX_OP_RETRIES) {
+      return ret;
+    }
+    ret = follow_bucket_reshard(cur_info);
+    if (ret < 0) {
+      return ret;
+    }
+    bucket = cur_info.bucket;
+  }
 }
 
 void RGWRados::bucket_index_guard_olh_op(RGWObjState& olh_state, ObjectOperation& op)
@@ -10436,20 +11135,28 @@ int RGWRados::bucket_index_unlink_instance(const RGWBucketInfo& bucket_info, con
     return r;
   }
 
-  BucketShard bs(this);
-  int ret = bs.init(obj_instance.bucket, obj_instance);
-  if (ret < 0) {
-    ldout(cct, 5) << "bs.init() returned ret=" << ret << dendl;
-    return ret;
-  }
-
+  RGWBucketInfo cur_info = bucket_info;
+  rgw_bucket bucket = obj_instance.bucket;
   cls_rgw_obj_key key(obj_instance.key.get_index_key_name(), obj_instance.key.instance);
-  ret = cls_rgw_bucket_unlink_instance(bs.index_ctx, bs.bucket_obj, key, op_tag, olh_tag, olh_epoch, get_zone().log_data);
-  if (ret < 0) {
-    return ret;
-  }
+  for (int i = 0; ; ++i) {
+    BucketShard bs(this);
+    int ret = bs.init(bucket, obj_instance);
+    if (ret < 0) {
+      ldout(cct, 5) << "bs.init() returned ret=" << ret << dendl;
+      return ret;
+    }
 
-  return 0;
+    ret = cls_rgw_bucket_unlink_instance(bs.index_ctx, bs.bucket_obj, key, op_tag, olh_tag, olh_epoch,
+                                         get_zone().log_data);
+    if (ret != -ERR_BUSY_RESHARDING || i == RGW_RESHARD_INDEX_OP_RETRIES) {
+      return ret;
+    }
+    ret = follow_bucket_reshard(cur_info);
+    if (ret < 0) {
+      return ret;
+    }
+    bucket = cur_info.bucket;
+  }
 }
 
 int RGWRados::bucket_index_read_olh_log(const RGWBucketInfo& bucket_info, RGWObjState& state,
@@ -10977,7 +11684,7 @@ int RGWRados::follow_olh(const RGWBucketInfo& bucket_info, RGWObjectCtx& obj_ctx
 
 int RGWRados::raw_obj_stat(rgw_raw_obj& obj, uint64_t *psize, real_time *pmtime, uint64_t *epoch,
                            map<string, bufferlist> *attrs, bufferlist *first_chunk,
-                           RGWObjVersionTracker *objv_tracker)
+                           RGWObjVersionTracker *objv_tracker, optional_yield y)
 {
   rgw_rados_ref ref;
   int r = get_raw_obj_ref(obj, &ref);
@@ -11003,7 +11710,7 @@ int RGWRados::raw_obj_stat(rgw_raw_obj& obj, uint64_t *psize, real_time *pmtime,
     op.read(0, cct->_conf->rgw_max_chunk_size, first_chunk, NULL);
   }
   bufferlist outbl;
-  r = ref.ioctx.operate(ref.oid, &op, &outbl);
+  r = rgw_rados_operate(ref.ioctx, ref.oid, &op, &outbl, y);
 
   if (epoch) {
     *epoch = ref.ioctx.get_last_version();
@@ -12023,12 +12730,13 @@ int RGWRados::cls_rgw_init_index(librados::IoCtx& index_ctx, librados::ObjectWri
 }
 
 int RGWRados::cls_obj_prepare_op(BucketShard& bs, RGWModifyOp op, string& tag,
-                                 rgw_obj& obj, uint16_t bilog_flags)
+                                 rgw_obj& obj, uint16_t bilog_flags,
+                                 optional_yield y)
 {
   ObjectWriteOperation o;
   cls_rgw_obj_key key(obj.key.get_index_key_name(), obj.key.instance);
   cls_rgw_bucket_prepare_op(o, op, tag, key, obj.key.get_loc(), get_zone().log_data, bilog_flags);
-  return bs.index_ctx.operate(bs.bucket_obj, &o);
+  return rgw_rados_operate(bs.index_ctx, bs.bucket_obj, &o, y);
 }
 
 int RGWRados::cls_obj_complete_op(BucketShard& bs, RGWModifyOp op, string& tag,
@@ -12036,32 +12744,29 @@ int RGWRados::cls_obj_complete_op(BucketShard& bs, RGWModifyOp op, string& tag,
                                   rgw_bucket_dir_entry& ent, RGWObjCategory category,
 				  list<rgw_obj_index_key> *remove_objs, uint16_t bilog_flags)
 {
-  list<cls_rgw_obj_key> *pro = NULL;
-  list<cls_rgw_obj_key> ro;
+  rgw_cls_obj_complete_op call;
+  call.op = op;
+  call.tag = tag;
+  call.key = cls_rgw_obj_key(ent.key.name, ent.key.instance);
+  call.ver.pool = pool;
+  call.ver.epoch = epoch;
+  call.meta = ent.meta;
+  call.meta.category = category;
+  call.log_op = get_zone().log_data;
+  call.bilog_flags = bilog_flags;
 
   if (remove_objs) {
     for (auto iter = remove_objs->begin(); iter != remove_objs->end(); ++iter) {
-      ro.push_back(*iter);
+      call.remove_objs.push_back(*iter);
     }
-    pro = &ro;
   }
 
-  ObjectWriteOperation o;
-  rgw_bucket_dir_entry_meta dir_meta;
-  dir_meta = ent.meta;
-  dir_meta.category = category;
-
-  rgw_bucket_entry_ver ver;
-  ver.pool = pool;
-  ver.epoch = epoch;
-  cls_rgw_obj_key key(ent.key.name, ent.key.instance);
-  cls_rgw_bucket_complete_op(o, op, tag, ver, key, dir_meta, pro,
-                             get_zone().log_data, bilog_flags);
+  if (index_batcher && call.remove_objs.empty()) {
+    index_batcher->queue(bs.index_ctx, bs.bucket_obj, bs.bucket, call);
+    return 0;
+  }
 
-  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
-  int ret = bs.index_ctx.aio_operate(bs.bucket_obj, c, &o);
-  c->release();
-  return ret;
+  return index_retrier->send(bs.index_ctx, bs.bucket_obj, bs.bucket, call);
 }
 
 int RGWRados::cls_obj_complete_add(BucketShard& bs, string& tag,
@@ -12103,6 +12808,25 @@ int RGWRados::cls_obj_set_bucket_tag_timeout(RGWBucketInfo& bucket_info, uint64_
   return CLSRGWIssueSetTagTimeout(index_ctx, bucket_objs, cct->_conf->rgw_bucket_index_max_aio, timeout)();
 }
 
+/*
+ * Number of entries to ask each shard for when merging a page of num_entries
+ * across num_shards.  Keys hash uniformly over the shards, so every shard
+ * holds about num_entries / num_shards of the page; ask for a bit more than
+ * that to absorb the skew and refill the few shards that still run dry.
+ */
+static uint32_t calc_ordered_bucket_list_per_shard(uint32_t num_entries,
+                                                   uint32_t num_shards)
+{
+  if (num_shards <= 1) {
+    return num_entries;
+  }
+
+  const uint32_t min_read = 8;
+  uint32_t per_shard = (num_entries + num_shards - 1) / num_shards;
+  per_shard = per_shard * 2 + 1;
+  return std::min(num_entries, std::max(per_shard, min_read));
+}
+
 int RGWRados::cls_bucket_list(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_index_key& start, const string& prefix,
 		              uint32_t num_entries, bool list_versions, map<string, rgw_bucket_dir_entry>& m,
 			      bool *is_truncated, rgw_obj_index_key *last_entry,
@@ -12119,32 +12843,58 @@ int RGWRados::cls_bucket_list(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_
   if (r < 0)
     return r;
 
+  const uint32_t num_entries_per_shard = calc_ordered_bucket_list_per_shard(num_entries, oids.size());
+
   cls_rgw_obj_key start_key(start.name, start.instance);
-  r = CLSRGWIssueBucketList(index_ctx, start_key, prefix, num_entries, list_versions,
+  r = CLSRGWIssueBucketList(index_ctx, start_key, prefix, num_entries_per_shard, list_versions,
                             oids, list_results, cct->_conf->rgw_bucket_index_max_aio)();
   if (r < 0)
     return r;
 
-  // Create a list of iterators that are used to iterate each shard
-  vector<map<string, struct rgw_bucket_dir_entry>::iterator> vcurrents(list_results.size());
-  vector<map<string, struct rgw_bucket_dir_entry>::iterator> vends(list_results.size());
-  vector<string> vnames(list_results.size());
-  map<int, struct rgw_cls_list_ret>::iterator iter = list_results.begin();
-  *is_truncated = false;
-  for (; iter != list_results.end(); ++iter) {
-    vcurrents.push_back(iter->second.dir.m.begin());
-    vends.push_back(iter->second.dir.m.end());
-    vnames.push_back(oids[iter->first]);
-    *is_truncated = (*is_truncated || iter->second.is_truncated);
-  }
+  // Track where we are in each shard's batch
+  struct ShardCursor {
+    int shard;
+    map<string, struct rgw_bucket_dir_entry>::iterator cur;
+    map<string, struct rgw_bucket_dir_entry>::iterator end;
+    string last_key;
+  };
+  vector<ShardCursor> cursors;
+  cursors.reserve(list_results.size());
+  for (auto& iter : list_results) {
+    auto& entries = iter.second.dir.m;
+    cursors.push_back({iter.first, entries.begin(), entries.end(),
+                       entries.empty() ? string() : entries.rbegin()->first});
+  }
+
+  // Refetch a shard whose batch was consumed but which has more entries,
+  // so that the merge never runs past keys it hasn't seen yet
+  auto refill = [&](ShardCursor& c) -> int {
+    map<int, string> shard_oid;
+    shard_oid[c.shard] = oids[c.shard];
+    map<int, struct rgw_cls_list_ret> shard_result;
+    cls_rgw_obj_key shard_start(c.last_key);
+    int ret = CLSRGWIssueBucketList(index_ctx, shard_start, prefix, num_entries_per_shard, list_versions,
+                                    shard_oid, shard_result, 1)();
+    if (ret < 0)
+      return ret;
+    list_results[c.shard] = std::move(shard_result[c.shard]);
+    auto& entries = list_results[c.shard].dir.m;
+    c.cur = entries.begin();
+    c.end = entries.end();
+    if (!entries.empty()) {
+      c.last_key = entries.rbegin()->first;
+    }
+    return 0;
+  };
 
-  // Create a map to track the next candidate entry from each shard, if the entry
-  // from a specified shard is selected/erased, the next entry from that shard will
-  // be inserted for next round selection
-  map<string, size_t> candidates;
-  for (size_t i = 0; i < vcurrents.size(); ++i) {
-    if (vcurrents[i] != vends[i]) {
-      candidates[vcurrents[i]->first] = i;
+  // Merge the shards through a min-heap keyed on each shard's next entry
+  auto greater = [&cursors](size_t a, size_t b) {
+    return cursors[a].cur->first > cursors[b].cur->first;
+  };
+  std::priority_queue<size_t, vector<size_t>, decltype(greater)> candidates(greater);
+  for (size_t i = 0; i < cursors.size(); ++i) {
+    if (cursors[i].cur != cursors[i].end) {
+      candidates.push(i);
     }
   }
 
@@ -12153,9 +12903,11 @@ int RGWRados::cls_bucket_list(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_
   while (count < num_entries && !candidates.empty()) {
     r = 0;
     // Select the next one
-    int pos = candidates.begin()->second;
-    const string& name = vcurrents[pos]->first;
-    struct rgw_bucket_dir_entry& dirent = vcurrents[pos]->second;
+    size_t pos = candidates.top();
+    candidates.pop();
+    ShardCursor& cursor = cursors[pos];
+    const string& name = cursor.cur->first;
+    struct rgw_bucket_dir_entry& dirent = cursor.cur->second;
 
     bool force_check = force_check_filter && force_check_filter(dirent.key.name);
     if ((!dirent.exists && !dirent.is_delete_marker()) || !dirent.pending_map.empty() || force_check) {
@@ -12163,7 +12915,7 @@ int RGWRados::cls_bucket_list(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_
        * and if the tags are old we need to do cleanup as well. */
       librados::IoCtx sub_ctx;
       sub_ctx.dup(index_ctx);
-      r = check_disk_state(sub_ctx, bucket_info, dirent, dirent, updates[vnames[pos]]);
+      r = check_disk_state(sub_ctx, bucket_info, dirent, dirent, updates[oids[cursor.shard]]);
       if (r < 0 && r != -ENOENT) {
           return r;
       }
@@ -12174,11 +12926,17 @@ int RGWRados::cls_bucket_list(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_
       ++count;
     }
 
-    // Refresh the candidates map
-    candidates.erase(candidates.begin());
-    ++vcurrents[pos];
-    if (vcurrents[pos] != vends[pos]) {
-      candidates[vcurrents[pos]->first] = pos;
+    // Advance this shard and put it back in the running
+    ++cursor.cur;
+    if (cursor.cur == cursor.end && list_results[cursor.shard].is_truncated &&
+        count < num_entries) {
+      r = refill(cursor);
+      if (r < 0) {
+        return r;
+      }
+    }
+    if (cursor.cur != cursor.end) {
+      candidates.push(pos);
     }
   }
 
@@ -12196,9 +12954,11 @@ int RGWRados::cls_bucket_list(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_
   }
 
   // Check if all the returned entries are consumed or not
-  for (size_t i = 0; i < vcurrents.size(); ++i) {
-    if (vcurrents[i] != vends[i])
+  *is_truncated = false;
+  for (auto& cursor : cursors) {
+    if (cursor.cur != cursor.end || list_results[cursor.shard].is_truncated) {
       *is_truncated = true;
+    }
   }
   if (!m.empty())
     *last_entry = m.rbegin()->first;
@@ -12206,6 +12966,128 @@ int RGWRados::cls_bucket_list(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_
   return 0;
 }
 
+string rgw_index_hash_source(const rgw_obj_key& key)
+{
+  if (key.ns == RGW_OBJ_NS_MULTIPART) {
+    /* <object>.<upload id>.meta or <object>.<upload id>.<part> */
+    string name = key.name;
+    RGWMPObj mp;
+    if (mp.from_meta(name)) {
+      return mp.get_key();
+    }
+  }
+  return key.name;
+}
+
+int RGWRados::cls_bucket_list_unordered(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_index_key& start,
+                                        const string& prefix, uint32_t num_entries, bool list_versions,
+                                        std::vector<rgw_bucket_dir_entry>& ent_list,
+                                        bool *is_truncated, rgw_obj_index_key *last_entry,
+                                        bool (*force_check_filter)(const string&  name))
+{
+  ldout(cct, 10) << "cls_bucket_list_unordered " << bucket_info.bucket << " start " << start.name << "[" << start.instance << "] num_entries " << num_entries << dendl;
+
+  *is_truncated = false;
+
+  librados::IoCtx index_ctx;
+  map<int, string> oids;
+  int r = open_bucket_index(bucket_info, index_ctx, oids, shard_id);
+  if (r < 0)
+    return r;
+
+  /* the marker is the last key handed out; the shard it hashes to is the
+   * one the previous page stopped in, earlier shards are done */
+  int current_shard = 0;
+  if (shard_id >= 0) {
+    current_shard = shard_id;
+  } else if (!start.empty()) {
+    rgw_obj_key obj_key;
+    bool parsed = rgw_obj_key::parse_raw_oid(start.name, &obj_key);
+    if (!parsed) {
+      ldout(cct, 0) << "ERROR: could not parse marker " << start.name << dendl;
+      return -EINVAL;
+    }
+    r = get_target_shard_id(bucket_info, rgw_index_hash_source(obj_key), &current_shard);
+    if (r < 0)
+      return r;
+    if (current_shard < 0) {
+      current_shard = 0;
+    }
+  }
+
+  cls_rgw_obj_key marker(start.name, start.instance);
+  map<string, bufferlist> updates;
+  uint32_t count = 0;
+  auto iter = oids.lower_bound(current_shard);
+  while (iter != oids.end() && count < num_entries) {
+    map<int, string> shard_oid;
+    shard_oid[iter->first] = iter->second;
+    map<int, struct rgw_cls_list_ret> list_results;
+    r = CLSRGWIssueBucketList(index_ctx, marker, prefix, num_entries - count, list_versions,
+                              shard_oid, list_results, 1)();
+    if (r < 0)
+      return r;
+
+    struct rgw_cls_list_ret& result = list_results[iter->first];
+    for (auto& e : result.dir.m) {
+      r = 0;
+      struct rgw_bucket_dir_entry& dirent = e.second;
+
+      bool force_check = force_check_filter && force_check_filter(dirent.key.name);
+      if ((!dirent.exists && !dirent.is_delete_marker()) || !dirent.pending_map.empty() || force_check) {
+        /* there are uncommitted ops. We need to check the current state,
+         * and if the tags are old we need to do cleanup as well. */
+        librados::IoCtx sub_ctx;
+        sub_ctx.dup(index_ctx);
+        r = check_disk_state(sub_ctx, bucket_info, dirent, dirent, updates[iter->second]);
+        if (r < 0 && r != -ENOENT) {
+          return r;
+        }
+      }
+
+      marker = cls_rgw_obj_key(dirent.key.name, dirent.key.instance);
+      *last_entry = dirent.key;
+
+      if (r >= 0) {
+        ldout(cct, 10) << "RGWRados::cls_bucket_list_unordered: got " << dirent.key.name << "[" << dirent.key.instance << "]" << dendl;
+        ent_list.emplace_back(std::move(dirent));
+        ++count;
+      }
+    }
+
+    if (result.is_truncated) {
+      /* more left in this shard, continue from marker next time */
+      *is_truncated = true;
+      if (result.dir.m.empty()) {
+        break;
+      }
+      continue;
+    }
+
+    /* this shard is done, the next one starts from its beginning */
+    marker = cls_rgw_obj_key();
+    ++iter;
+  }
+
+  if (iter != oids.end()) {
+    *is_truncated = true;
+  }
+
+  // Suggest updates if there is any
+  for (auto& u : updates) {
+    if (u.second.length()) {
+      ObjectWriteOperation o;
+      cls_rgw_suggest_changes(o, u.second);
+      // we don't care if we lose suggested updates, send them off blindly
+      AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+      index_ctx.aio_operate(u.first, c, &o);
+      c->release();
+    }
+  }
+
+  return 0;
+}
+
 int RGWRados::cls_obj_usage_log_add(const string& oid, rgw_usage_log_info& info)
 {
   rgw_raw_obj obj(get_zone_params().usage_log_pool, oid);
@@ -12629,6 +13511,102 @@ int RGWRados::check_quota(const rgw_user& bucket_owner, rgw_bucket& bucket,
   return quota_handler->check_quota(bucket_owner, bucket, user_quota, bucket_quota, 1, obj_size);
 }
 
+int RGWRados::check_bucket_shards(const RGWBucketInfo& bucket_info, rgw_bucket& bucket,
+                                  RGWQuotaInfo& bucket_quota)
+{
+  /* a reshard creates a new bucket instance, which multisite sync can't follow */
+  if (!cct->_conf->rgw_dynamic_resharding || need_to_log_data()) {
+    return 0;
+  }
+  if (bucket_info.index_type != RGWBIType_Normal ||
+      bucket_info.reshard_status != RGW_BUCKET_RESHARD_NONE) {
+    return 0;
+  }
+
+  uint32_t num_source_shards = (bucket_info.num_shards > 0 ? bucket_info.num_shards : 1);
+  bool need_resharding = false;
+  uint32_t suggested_num_shards = 0;
+  int ret = quota_handler->check_bucket_shards((uint64_t)cct->_conf->rgw_max_objs_per_shard,
+                                               num_source_shards, bucket_info.owner, bucket,
+                                               bucket_quota, 1, need_resharding,
+                                               &suggested_num_shards);
+  if (ret < 0) {
+    return ret;
+  }
+
+  if (need_resharding) {
+    ldout(cct, 20) << __func__ << " bucket " << bucket.name << " needs resharding to "
+                   << suggested_num_shards << " shards" << dendl;
+    return add_bucket_to_reshard(bucket_info, suggested_num_shards);
+  }
+
+  return 0;
+}
+
+int RGWRados::add_bucket_to_reshard(const RGWBucketInfo& bucket_info, uint32_t new_num_shards)
+{
+  uint32_t num_source_shards = (bucket_info.num_shards > 0 ? bucket_info.num_shards : 1);
+
+  new_num_shards = std::min(new_num_shards, get_max_bucket_shards());
+  if (new_num_shards <= num_source_shards) {
+    ldout(cct, 20) << "not resharding bucket " << bucket_info.bucket.name
+                   << ", already at " << num_source_shards << " shards" << dendl;
+    return 0;
+  }
+
+  rgw_reshard_entry entry;
+  entry.time = real_clock::now();
+  entry.tenant = bucket_info.bucket.tenant;
+  entry.bucket_name = bucket_info.bucket.name;
+  entry.bucket_id = bucket_info.bucket.bucket_id;
+  entry.old_num_shards = num_source_shards;
+  entry.new_num_shards = new_num_shards;
+
+  return reshard->queue(entry);
+}
+
+/*
+ * Refresh bucket_info after an index op was refused with
+ * -ERR_BUSY_RESHARDING: once the reshard is done it's replaced by the
+ * instance the bucket moved to.  Returns -ERR_BUSY_RESHARDING while the
+ * reshard is still running.
+ */
+int RGWRados::follow_bucket_reshard(RGWBucketInfo& bucket_info)
+{
+  RGWObjectCtx obj_ctx(this);
+  RGWBucketInfo info;
+  int r = get_bucket_instance_info(obj_ctx, bucket_info.bucket, info, nullptr, nullptr);
+  if (r < 0) {
+    ldout(cct, 0) << "ERROR: failed to read bucket instance info for " << bucket_info.bucket
+                  << ": r=" << r << dendl;
+    return r;
+  }
+
+  /* it may have been resharded more than once */
+  for (int i = 0; info.reshard_done(); ++i) {
+    if (i == RGW_RESHARD_INDEX_OP_RETRIES) {
+      return -ERR_BUSY_RESHARDING;
+    }
+    rgw_bucket new_bucket = info.bucket;
+    new_bucket.bucket_id = info.new_bucket_instance_id;
+    new_bucket.oid.clear();
+    r = get_bucket_instance_info(obj_ctx, new_bucket, info, nullptr, nullptr);
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: failed to read resharded bucket instance " << new_bucket
+                    << ": r=" << r << dendl;
+      return r;
+    }
+    ldout(cct, 10) << "bucket " << bucket_info.bucket << " was resharded, using instance "
+                   << info.bucket.bucket_id << dendl;
+  }
+  if (info.resharding()) {
+    return -ERR_BUSY_RESHARDING;
+  }
+
+  bucket_info = info;
+  return 0;
+}
+
 void RGWRados::get_bucket_index_objects(const string& bucket_oid_base,
     uint32_t num_shards, map<int, string>& bucket_objects, int shard_id)
 {
@@ -28,10 +28,13 @@ class RGWWatcher;
 class SafeTimer;
 class ACLOwner;
 class RGWGC;
+class RGWIndexCompleteBatcher;
+class RGWIndexCompletionRetrier;
 class RGWMetaNotifier;
 class RGWDataNotifier;
 class RGWLC;
 class RGWObjectExpirer;
+class RGWReshard;
 class RGWMetaSyncProcessorThread;
 class RGWDataSyncProcessorThread;
 class RGWSyncLogTrimThread;
@@ -618,6 +621,17 @@ public:
     return prefix;
   }
 
+  /* gives every tail object a new name, for copies of the tail */
+  void prepend_tail_prefix(const string& p) {
+    prefix = p + prefix;
+    for (auto& r : rules) {
+      if (!r.second.override_prefix.empty()) {
+        r.second.override_prefix = p + r.second.override_prefix;
+      }
+    }
+    update_iterators();
+  }
+
   void set_tail_instance(const string& _ti) {
     tail_instance = _ti;
   }
@@ -2130,6 +2144,7 @@ void RGWObjectCtxImpl<rgw_raw_obj, RGWRawObjState>::invalidate(rgw_raw_obj& obj)
 struct RGWObjectCtx {
   RGWRados *store;
   void *user_ctx;
+  optional_yield y; // coroutine of the request this context belongs to
 
   RGWObjectCtxImpl<rgw_obj, RGWObjState> obj;
   RGWObjectCtxImpl<rgw_raw_obj, RGWRawObjState> raw;
@@ -2140,6 +2155,7 @@ struct RGWObjectCtx {
 
 class Finisher;
 class RGWAsyncRadosProcessor;
+class Throttle;
 
 template <class T>
 class RGWChainedCacheImpl;
@@ -2167,6 +2183,9 @@ class RGWRados
   friend class RGWMetaNotifier;
   friend class RGWDataNotifier;
   friend class RGWLC;
+  friend class RGWReshard;
+  friend class RGWBucketReshard;
+  friend class RGWIndexCompletionRetrier;
   friend class RGWObjectExpirer;
   friend class RGWMetaSyncProcessorThread;
   friend class RGWDataSyncProcessorThread;
@@ -2206,13 +2225,18 @@ class RGWRados
 
   RGWGC *gc;
   RGWLC *lc;
+  RGWIndexCompleteBatcher *index_batcher;
+  RGWIndexCompletionRetrier *index_retrier;
   RGWObjectExpirer *obj_expirer;
+  RGWReshard *reshard;
   bool use_gc_thread;
   bool use_lc_thread;
   bool quota_threads;
   bool run_sync_thread;
 
   RGWAsyncRadosProcessor* async_rados;
+  /* bytes ranged sync reads may buffer, across all fetches */
+  Throttle *fetch_range_budget;
 
   RGWMetaNotifier *meta_notifier;
   RGWDataNotifier *data_notifier;
@@ -2299,8 +2323,8 @@ protected:
   RGWPeriod current_period;
 public:
   RGWRados() : lock("rados_timer_lock"), watchers_lock("watchers_lock"), timer(NULL),
-               gc(NULL), lc(NULL), obj_expirer(NULL), use_gc_thread(false), use_lc_thread(false), quota_threads(false),
-               run_sync_thread(false), async_rados(nullptr), meta_notifier(NULL),
+               gc(NULL), lc(NULL), index_batcher(NULL), index_retrier(NULL), obj_expirer(NULL), reshard(NULL), use_gc_thread(false), use_lc_thread(false), quota_threads(false),
+               run_sync_thread(false), async_rados(nullptr), fetch_range_budget(nullptr), meta_notifier(NULL),
                data_notifier(NULL), meta_sync_processor_thread(NULL),
                meta_sync_thread_lock("meta_sync_thread_lock"), data_sync_thread_lock("data_sync_thread_lock"),
                num_watchers(0), watchers(NULL),
@@ -2848,6 +2872,9 @@ public:
       bool bs_initialized{false};
       bool blind;
       bool prepared{false};
+      optional_yield y;
+
+      int guard_reshard(BucketShard **pbs, std::function<int(BucketShard *)> call);
     public:
 
       UpdateIndex(RGWRados::Bucket *_target, const rgw_obj& _obj) : target(_target), obj(_obj),
@@ -2871,6 +2898,10 @@ public:
         bilog_flags = flags;
       }
 
+      void set_yield(optional_yield _y) {
+        y = _y;
+      }
+
       int prepare(RGWModifyOp, const string *write_tag);
       int complete(int64_t poolid, uint64_t epoch, uint64_t size,
                    uint64_t accounted_size, ceph::real_time& ut,
@@ -2900,10 +2931,15 @@ public:
         bool enforce_ns;
         RGWAccessListFilter *filter;
         bool list_versions;
+        bool allow_unordered;
 
-        Params() : enforce_ns(true), filter(NULL), list_versions(false) {}
+        Params() : enforce_ns(true), filter(NULL), list_versions(false), allow_unordered(false) {}
       } params;
 
+    private:
+      int list_objects_ordered(int max, vector<rgw_bucket_dir_entry> *result, map<string, bool> *common_prefixes, bool *is_truncated);
+      int list_objects_unordered(int max, vector<rgw_bucket_dir_entry> *result, bool *is_truncated);
+
     public:
       explicit List(RGWRados::Bucket *_target) : target(_target) {}
 
@@ -2925,7 +2961,8 @@ public:
               off_t ofs, bool exclusive,
               RGWObjVersionTracker *objv_tracker = nullptr);
   int aio_put_obj_data(void *ctx, rgw_raw_obj& obj, bufferlist& bl,
-                        off_t ofs, bool exclusive, void **handle);
+                        off_t ofs, bool exclusive, void **handle,
+                        RGWYieldWaiter *waiter = nullptr);
 
   int put_system_obj(void *ctx, rgw_raw_obj& obj, const char *data, size_t len, bool exclusive,
               ceph::real_time *mtime, map<std::string, bufferlist>& attrs, RGWObjVersionTracker *objv_tracker,
@@ -3022,7 +3059,8 @@ public:
                        string *ptag,
                        ceph::buffer::list *petag,
                        void (*progress_cb)(off_t, void *),
-                       void *progress_data);
+                       void *progress_data,
+                       uint64_t *pbytes = NULL /* object bytes received */);
   /**
    * Copy an object.
    * dest_obj: the object to copy into
@@ -3081,6 +3119,10 @@ public:
                string *version_id,
                string *ptag,
                ceph::buffer::list *petag);
+  /* has the OSDs copy the tail objects of src_manifest to dest_manifest;
+   * on error the copies made so far are removed again */
+  int copy_obj_tail(RGWObjManifest& src_manifest, RGWObjManifest& dest_manifest,
+                    const string& tag, vector<rgw_raw_obj> *copied);
   
   int check_bucket_empty(RGWBucketInfo& bucket_info);
 
@@ -3202,7 +3244,14 @@ public:
 
   virtual int raw_obj_stat(rgw_raw_obj& obj, uint64_t *psize, ceph::real_time *pmtime, uint64_t *epoch,
                        map<string, bufferlist> *attrs, bufferlist *first_chunk,
-                       RGWObjVersionTracker *objv_tracker);
+                       RGWObjVersionTracker *objv_tracker,
+                       optional_yield y = optional_yield());
+
+  /* reads the head of an object for get_obj_state(), along with its first
+   * chunk of data if s->prefetch_data is set */
+  virtual int get_obj_head(rgw_raw_obj& obj, RGWObjState *s, optional_yield y);
+  /* an object's head was rewritten or removed */
+  virtual void obj_head_changed(rgw_raw_obj& obj) {}
 
   int obj_operate(const RGWBucketInfo& bucket_info, const rgw_obj& obj, librados::ObjectWriteOperation *op);
   int obj_operate(const RGWBucketInfo& bucket_info, const rgw_obj& obj, librados::ObjectReadOperation *op);
@@ -3304,7 +3353,8 @@ public:
                                      map<string, bufferlist> *pattrs, bool create_entry_point);
 
   int cls_rgw_init_index(librados::IoCtx& io_ctx, librados::ObjectWriteOperation& op, string& oid);
-  int cls_obj_prepare_op(BucketShard& bs, RGWModifyOp op, string& tag, rgw_obj& obj, uint16_t bilog_flags);
+  int cls_obj_prepare_op(BucketShard& bs, RGWModifyOp op, string& tag, rgw_obj& obj, uint16_t bilog_flags,
+                         optional_yield y = optional_yield());
   int cls_obj_complete_op(BucketShard& bs, RGWModifyOp op, string& tag, int64_t pool, uint64_t epoch,
                           rgw_bucket_dir_entry& ent, RGWObjCategory category, list<rgw_obj_index_key> *remove_objs, uint16_t bilog_flags);
   int cls_obj_complete_add(BucketShard& bs, string& tag, int64_t pool, uint64_t epoch, rgw_bucket_dir_entry& ent,
@@ -3317,6 +3367,10 @@ public:
                       uint32_t num_entries, bool list_versions, map<string, rgw_bucket_dir_entry>& m,
                       bool *is_truncated, rgw_obj_index_key *last_entry,
                       bool (*force_check_filter)(const string&  name) = NULL);
+  int cls_bucket_list_unordered(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_index_key& start, const string& prefix,
+                                uint32_t num_entries, bool list_versions, vector<rgw_bucket_dir_entry>& ent_list,
+                                bool *is_truncated, rgw_obj_index_key *last_entry,
+                                bool (*force_check_filter)(const string&  name) = NULL);
   int cls_bucket_head(const RGWBucketInfo& bucket_info, int shard_id, map<string, struct rgw_bucket_dir_header>& headers, map<int, string> *bucket_instance_ids = NULL);
   int cls_bucket_head_async(const RGWBucketInfo& bucket_info, int shard_id, RGWGetDirHeader_CB *ctx, int *num_aio);
   int list_bi_log_entries(RGWBucketInfo& bucket_info, int shard_id, string& marker, uint32_t max, std::list<rgw_bi_log_entry>& result, bool *truncated);
@@ -3432,6 +3486,12 @@ public:
   int check_quota(const rgw_user& bucket_owner, rgw_bucket& bucket,
                   RGWQuotaInfo& user_quota, RGWQuotaInfo& bucket_quota, uint64_t obj_size);
 
+  int check_bucket_shards(const RGWBucketInfo& bucket_info, rgw_bucket& bucket,
+                          RGWQuotaInfo& bucket_quota);
+  int add_bucket_to_reshard(const RGWBucketInfo& bucket_info, uint32_t new_num_shards);
+  int follow_bucket_reshard(RGWBucketInfo& bucket_info);
+  RGWReshard *get_reshard() { return reshard; }
+
   uint64_t instance_id();
   const string& zone_id() {
     return get_zone_params().get_id();
@@ -3689,6 +3749,7 @@ class RGWPutObjProcessor_Aio : public RGWPutObjProcessor
   list<struct put_obj_aio_info> pending;
   uint64_t window_size{RGW_PUT_OBJ_MIN_WINDOW_SIZE_DEFAULT};
   uint64_t pending_size{0};
+  RGWYieldWaiter aio_waiter; // notified by write completions when yielding
 
   struct put_obj_aio_info pop_pending();
   int wait_pending_front();
@@ -3850,6 +3911,13 @@ public:
   }
 };
 
+/*
+ * The name that picked the bucket index shard of an index entry, see
+ * rgw_obj::index_hash_source: multipart meta and part entries live in the
+ * shard of the object being uploaded.
+ */
+extern string rgw_index_hash_source(const rgw_obj_key& key);
+
 class RGWPutObjProcessor_Multipart : public RGWPutObjProcessor_Atomic
 {
   string part_num;
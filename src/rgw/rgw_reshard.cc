@@ -0,0 +1,1126 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <deque>
+#include <set>
+
+#include "rgw_reshard.h"
+#include "rgw_bucket.h"
+#include "cls/rgw/cls_rgw_client.h"
+#include "common/ceph_json.h"
+#include "common/errno.h"
+#include "common/Formatter.h"
+
+#define dout_context g_ceph_context
+#define dout_subsys ceph_subsys_rgw
+
+using namespace std;
+
+static string reshard_oid_prefix = "reshard";
+static string reshard_lock_name = "reshard_process";
+static string bucket_reshard_lock_prefix = "reshard_bucket.";
+
+#define RESHARD_SHARD_WINDOW 64
+#define RESHARD_MAX_AIO 128
+#define RESHARD_BILOG_BATCH 1000
+#define RESHARD_MAX_LOGRECORD_PASSES 5
+#define RESHARD_MAX_FINAL_PASSES 10
+#define RESHARD_STATUS_RETRIES 10
+
+void rgw_reshard_entry::get_key(const string& tenant, const string& bucket_name, string *key)
+{
+  if (tenant.empty()) {
+    *key = bucket_name;
+  } else {
+    *key = tenant + ":" + bucket_name;
+  }
+}
+
+void rgw_reshard_entry::dump(Formatter *f) const
+{
+  utime_t ut(time);
+  encode_json("time", ut, f);
+  encode_json("tenant", tenant, f);
+  encode_json("bucket_name", bucket_name, f);
+  encode_json("bucket_id", bucket_id, f);
+  encode_json("old_num_shards", old_num_shards, f);
+  encode_json("new_num_shards", new_num_shards, f);
+}
+
+void rgw_reshard_entry::generate_test_instances(list<rgw_reshard_entry*>& o)
+{
+  rgw_reshard_entry *e = new rgw_reshard_entry;
+  e->tenant = "tenant";
+  e->bucket_name = "bucket";
+  e->bucket_id = "zone.1234.5";
+  e->old_num_shards = 8;
+  e->new_num_shards = 64;
+  o.push_back(e);
+  o.push_back(new rgw_reshard_entry);
+}
+
+class BucketReshardShard {
+  RGWRados *store;
+  RGWBucketInfo& bucket_info;
+  int num_shard;
+  RGWRados::BucketShard bs;
+  vector<rgw_cls_bi_entry> entries;
+  map<uint8_t, rgw_bucket_category_stats> stats;
+  deque<librados::AioCompletion *>& aio_completions;
+
+  int wait_next_completion() {
+    librados::AioCompletion *c = aio_completions.front();
+    aio_completions.pop_front();
+
+    c->wait_for_safe();
+
+    int ret = c->get_return_value();
+    c->release();
+
+    if (ret < 0) {
+      ldout(store->ctx(), 0) << "ERROR: reshard rados operation failed: " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+
+    return 0;
+  }
+
+  int get_completion(librados::AioCompletion **c) {
+    if (aio_completions.size() >= RESHARD_MAX_AIO) {
+      int ret = wait_next_completion();
+      if (ret < 0) {
+        return ret;
+      }
+    }
+
+    *c = librados::Rados::aio_create_completion(nullptr, nullptr, nullptr);
+    aio_completions.push_back(*c);
+
+    return 0;
+  }
+
+public:
+  BucketReshardShard(RGWRados *_store, RGWBucketInfo& _bucket_info,
+                     int _num_shard,
+                     deque<librados::AioCompletion *>& _completions) : store(_store), bucket_info(_bucket_info), bs(store),
+                                                                       aio_completions(_completions) {
+    num_shard = (bucket_info.num_shards > 0 ? _num_shard : -1);
+    bs.init(bucket_info.bucket, num_shard);
+  }
+
+  int get_num_shard() {
+    return num_shard;
+  }
+
+  int add_entry(rgw_cls_bi_entry& entry, bool account, uint8_t category,
+                const rgw_bucket_category_stats& entry_stats) {
+    entries.push_back(entry);
+    if (account) {
+      rgw_bucket_category_stats& target = stats[category];
+      target.num_entries += entry_stats.num_entries;
+      target.total_size += entry_stats.total_size;
+      target.total_size_rounded += entry_stats.total_size_rounded;
+    }
+    if (entries.size() >= RESHARD_SHARD_WINDOW) {
+      int ret = flush();
+      if (ret < 0) {
+        return ret;
+      }
+    }
+    return 0;
+  }
+
+  int flush() {
+    if (entries.size() == 0) {
+      return 0;
+    }
+
+    librados::ObjectWriteOperation op;
+    for (auto& entry : entries) {
+      store->bi_put(op, bs, entry);
+    }
+    cls_rgw_bucket_update_stats(op, false, stats);
+
+    librados::AioCompletion *c;
+    int ret = get_completion(&c);
+    if (ret < 0) {
+      return ret;
+    }
+    ret = bs.index_ctx.aio_operate(bs.bucket_obj, c, &op);
+    if (ret < 0) {
+      ldout(store->ctx(), 0) << "ERROR: failed to store entries in target bucket shard (bs=" << bs.bucket << "/" << bs.shard_id << ") error=" << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+    entries.clear();
+    stats.clear();
+    return 0;
+  }
+
+  int wait_all_aio() {
+    int ret = 0;
+    while (!aio_completions.empty()) {
+      int r = wait_next_completion();
+      if (r < 0) {
+        ret = r;
+      }
+    }
+    return ret;
+  }
+};
+
+class BucketReshardManager {
+  RGWRados *store;
+  RGWBucketInfo& target_bucket_info;
+  deque<librados::AioCompletion *> completions;
+  int num_target_shards;
+  vector<BucketReshardShard *> target_shards;
+
+public:
+  BucketReshardManager(RGWRados *_store, RGWBucketInfo& _target_bucket_info, int _num_target_shards) : store(_store), target_bucket_info(_target_bucket_info),
+                                                                                                       num_target_shards(_num_target_shards) {
+    target_shards.resize(num_target_shards);
+    for (int i = 0; i < num_target_shards; ++i) {
+      target_shards[i] = new BucketReshardShard(store, target_bucket_info, i, completions);
+    }
+  }
+
+  ~BucketReshardManager() {
+    for (auto& shard : target_shards) {
+      int ret = shard->wait_all_aio();
+      if (ret < 0) {
+        ldout(store->ctx(), 20) << __func__ << ": shard->wait_all_aio() returned ret=" << ret << dendl;
+      }
+      delete shard;
+    }
+  }
+
+  int add_entry(int shard_index,
+                rgw_cls_bi_entry& entry, bool account, uint8_t category,
+                const rgw_bucket_category_stats& entry_stats) {
+    int ret = target_shards[shard_index]->add_entry(entry, account, category, entry_stats);
+    if (ret < 0) {
+      ldout(store->ctx(), 0) << "ERROR: target_shards.add_entry(" << entry.idx << ") returned error: " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+    return 0;
+  }
+
+  int finish() {
+    int ret = 0;
+    for (auto& shard : target_shards) {
+      int r = shard->flush();
+      if (r < 0) {
+        ldout(store->ctx(), 0) << "ERROR: target_shards[" << shard->get_num_shard() << "].flush() returned error: " << cpp_strerror(-r) << dendl;
+        ret = r;
+      }
+    }
+    for (auto& shard : target_shards) {
+      int r = shard->wait_all_aio();
+      if (r < 0) {
+        ldout(store->ctx(), 0) << "ERROR: target_shards[" << shard->get_num_shard() << "].wait_all_aio() returned error: " << cpp_strerror(-r) << dendl;
+        ret = r;
+      }
+      delete shard;
+    }
+    target_shards.clear();
+    return ret;
+  }
+};
+
+static string get_bucket_key(const RGWBucketInfo& bucket_info)
+{
+  string key;
+  rgw_reshard_entry::get_key(bucket_info.bucket.tenant, bucket_info.bucket.name, &key);
+  return key;
+}
+
+RGWBucketReshard::RGWBucketReshard(RGWRados *_store, const RGWBucketInfo& _bucket_info,
+                                   const map<string, bufferlist>& _bucket_attrs)
+  : store(_store), bucket_info(_bucket_info), bucket_attrs(_bucket_attrs),
+    reshard_lock(bucket_reshard_lock_prefix + get_bucket_key(_bucket_info))
+{
+  /* the per bucket lock lives on the reshard log shard the bucket hashes to */
+  string key = get_bucket_key(bucket_info);
+  int index = ceph_str_hash_linux(key.c_str(), key.size()) %
+    max(store->ctx()->_conf->rgw_reshard_num_logs, 1);
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s.%010d", reshard_oid_prefix.c_str(), index);
+  lock_oid = buf;
+}
+
+int RGWBucketReshard::lock_bucket()
+{
+  int ret = rgw_init_ioctx(store->get_rados_handle(), store->get_zone_params().log_pool,
+                           lock_ioctx, true);
+  if (ret < 0) {
+    return ret;
+  }
+
+  reshard_lock.set_duration(utime_t(store->ctx()->_conf->rgw_reshard_thread_interval, 0));
+  ret = reshard_lock.lock_exclusive(&lock_ioctx, lock_oid);
+  if (ret == -EBUSY) {
+    ldout(store->ctx(), 0) << "RGWBucketReshard::" << __func__ << " bucket " << bucket_info.bucket.name
+                           << " is already being resharded" << dendl;
+    return ret;
+  }
+  if (ret < 0) {
+    ldout(store->ctx(), 0) << "RGWBucketReshard::" << __func__ << " failed to take lock on "
+                           << lock_oid << ": " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  return 0;
+}
+
+int RGWBucketReshard::renew_lock_bucket()
+{
+  reshard_lock.set_renew(true);
+  int ret = reshard_lock.lock_exclusive(&lock_ioctx, lock_oid);
+  reshard_lock.set_renew(false);
+  if (ret < 0) {
+    ldout(store->ctx(), 0) << "RGWBucketReshard::" << __func__ << " lost lock on "
+                           << lock_oid << ": " << cpp_strerror(-ret) << dendl;
+  }
+  return ret;
+}
+
+void RGWBucketReshard::unlock_bucket()
+{
+  int ret = reshard_lock.unlock(&lock_ioctx, lock_oid);
+  if (ret < 0) {
+    ldout(store->ctx(), 0) << "WARNING: RGWBucketReshard::" << __func__ << " failed to drop lock on "
+                           << lock_oid << ": " << cpp_strerror(-ret) << dendl;
+  }
+}
+
+/*
+ * Flag the bucket instance.  Other metadata updates (acls, quota, ...) may
+ * race with us, so the write is conditional on the version we read and is
+ * redone on top of theirs.
+ */
+int RGWBucketReshard::set_reshard_status(uint8_t status, const string& new_instance_id)
+{
+  int ret;
+  for (int i = 0; i < RESHARD_STATUS_RETRIES; ++i) {
+    RGWObjectCtx obj_ctx(store);
+    ret = store->get_bucket_instance_info(obj_ctx, bucket_info.bucket, bucket_info, nullptr, &bucket_attrs);
+    if (ret < 0) {
+      ldout(store->ctx(), 0) << "ERROR: failed to read bucket instance info for " << bucket_info.bucket
+                             << ": " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+
+    bucket_info.reshard_status = status;
+    bucket_info.new_bucket_instance_id = new_instance_id;
+    ret = store->put_bucket_instance_info(bucket_info, false, real_time(), &bucket_attrs);
+    if (ret != -ECANCELED) {
+      break;
+    }
+    ldout(store->ctx(), 10) << "bucket instance info of " << bucket_info.bucket
+                            << " changed under us, retrying" << dendl;
+  }
+  if (ret < 0) {
+    ldout(store->ctx(), 0) << "ERROR: failed to write bucket instance info for " << bucket_info.bucket
+                           << " (reshard_status=" << (int)status << "): " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  return 0;
+}
+
+/*
+ * Flag every shard of the old index.  cls_rgw makes the index ops on a
+ * shard log to its bilog (IN_LOGRECORD) or refuses them (IN_PROGRESS) from
+ * the moment the shard is flagged, so nothing slips by that the bucket
+ * instance info alone would only announce to writers that reread it.
+ */
+int RGWBucketReshard::set_index_resharding(uint8_t status)
+{
+  librados::IoCtx index_ctx;
+  map<int, string> bucket_objs;
+  int ret = store->open_bucket_index(bucket_info, index_ctx, bucket_objs);
+  if (ret < 0) {
+    ldout(store->ctx(), 0) << "ERROR: failed to open bucket index of " << bucket_info.bucket
+                           << ": " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+
+  for (auto& b : bucket_objs) {
+    librados::ObjectWriteOperation op;
+    cls_rgw_bucket_set_resharding(op, status);
+    ret = index_ctx.operate(b.second, &op);
+    if (ret < 0) {
+      ldout(store->ctx(), 0) << "ERROR: failed to set reshard status " << (int)status << " on "
+                             << b.second << ": " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+  }
+  return 0;
+}
+
+/* undo the flags of a reshard that didn't complete */
+void RGWBucketReshard::clear_resharding()
+{
+  int ret = set_index_resharding(RGW_BUCKET_RESHARD_NONE);
+  if (ret < 0) {
+    ldout(store->ctx(), 0) << "ERROR: bucket " << bucket_info.bucket
+                           << " index may still refuse writes, rerun 'reshard cancel'" << dendl;
+  }
+  if (bucket_info.reshard_status != RGW_BUCKET_RESHARD_NONE) {
+    set_reshard_status(RGW_BUCKET_RESHARD_NONE, string());
+  }
+}
+
+int RGWBucketReshard::create_new_bucket_instance(int new_num_shards, RGWBucketInfo& new_bucket_info)
+{
+  new_bucket_info = bucket_info;
+  store->create_bucket_id(&new_bucket_info.bucket.bucket_id);
+  new_bucket_info.bucket.oid.clear();
+
+  new_bucket_info.num_shards = new_num_shards;
+  new_bucket_info.objv_tracker.clear();
+  new_bucket_info.reshard_status = RGW_BUCKET_RESHARD_NONE;
+  new_bucket_info.new_bucket_instance_id.clear();
+
+  int ret = store->init_bucket_index(new_bucket_info, new_bucket_info.num_shards);
+  if (ret < 0) {
+    ldout(store->ctx(), 0) << "ERROR: failed to init new bucket indexes: " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+
+  ret = store->put_bucket_instance_info(new_bucket_info, true, real_time(), &bucket_attrs);
+  if (ret < 0) {
+    ldout(store->ctx(), 0) << "ERROR: failed to store new bucket instance info: " << cpp_strerror(-ret) << dendl;
+    remove_new_bucket_index(new_bucket_info);
+    return ret;
+  }
+
+  return 0;
+}
+
+void RGWBucketReshard::remove_new_bucket_index(RGWBucketInfo& new_bucket_info)
+{
+  int num_shards = (new_bucket_info.num_shards > 0 ? new_bucket_info.num_shards : 1);
+  for (int i = 0; i < num_shards; ++i) {
+    RGWRados::BucketShard bs(store);
+    int ret = bs.init(new_bucket_info.bucket, new_bucket_info.num_shards > 0 ? i : -1);
+    if (ret < 0) {
+      continue;
+    }
+    ret = store->bi_remove(bs);
+    if (ret < 0) {
+      ldout(store->ctx(), 0) << "WARNING: failed to remove new bucket index shard " << bs.bucket_obj
+                             << ": " << cpp_strerror(-ret) << dendl;
+    }
+  }
+}
+
+int RGWBucketReshard::copy_index(RGWBucketInfo& new_bucket_info, int max_entries,
+                                 bool verbose, ostream *out, Formatter *formatter)
+{
+  int num_source_shards = (bucket_info.num_shards > 0 ? bucket_info.num_shards : 1);
+  int num_target_shards = (new_bucket_info.num_shards > 0 ? new_bucket_info.num_shards : 1);
+
+  BucketReshardManager target_shards_mgr(store, new_bucket_info, num_target_shards);
+
+  if (verbose) {
+    formatter->open_array_section("entries");
+  }
+
+  uint64_t total_entries = 0;
+
+  if (out && !verbose) {
+    (*out) << "total entries:";
+  }
+
+  list<rgw_cls_bi_entry> entries;
+  for (int i = 0; i < num_source_shards; ++i) {
+    bool is_truncated = true;
+    string marker;
+    while (is_truncated) {
+      entries.clear();
+      int ret = store->bi_list(bucket_info.bucket, i, string(), marker, max_entries, &entries, &is_truncated);
+      if (ret < 0 && ret != -ENOENT) {
+        ldout(store->ctx(), 0) << "ERROR: bi_list(): " << cpp_strerror(-ret) << dendl;
+        return ret;
+      }
+
+      for (auto& entry : entries) {
+        if (verbose) {
+          formatter->open_object_section("entry");
+
+          encode_json("shard_id", i, formatter);
+          encode_json("num_entry", total_entries, formatter);
+          encode_json("entry", entry, formatter);
+        }
+        total_entries++;
+
+        marker = entry.idx;
+
+        int target_shard_id;
+        cls_rgw_obj_key cls_key;
+        uint8_t category;
+        rgw_bucket_category_stats stats;
+        bool account = entry.get_info(&cls_key, &category, &stats);
+        rgw_obj_key key(cls_key);
+        rgw_obj obj(new_bucket_info.bucket, key);
+        ret = store->get_target_shard_id(new_bucket_info, obj.get_hash_object(), &target_shard_id);
+        if (ret < 0) {
+          ldout(store->ctx(), 0) << "ERROR: get_target_shard_id() returned ret=" << ret << dendl;
+          return ret;
+        }
+
+        int shard_index = (target_shard_id > 0 ? target_shard_id : 0);
+
+        ret = target_shards_mgr.add_entry(shard_index, entry, account, category, stats);
+        if (ret < 0) {
+          return ret;
+        }
+        if (verbose) {
+          formatter->close_section();
+          formatter->flush(*out);
+        } else if (out && !(total_entries % 1000)) {
+          (*out) << " " << total_entries;
+        }
+      }
+
+      ret = renew_lock_bucket();
+      if (ret < 0) {
+        return ret;
+      }
+    }
+  }
+
+  if (verbose) {
+    formatter->close_section();
+    formatter->flush(*out);
+  } else if (out) {
+    (*out) << " " << total_entries << std::endl;
+  }
+
+  int ret = target_shards_mgr.finish();
+  if (ret < 0) {
+    ldout(store->ctx(), 0) << "ERROR: failed to reshard" << dendl;
+    return -EIO;
+  }
+  return 0;
+}
+
+/*
+ * Make the new index hold exactly what the old index holds for one object
+ * name (plain, instance and olh entries alike).
+ */
+int RGWBucketReshard::sync_index_entry(RGWBucketInfo& new_bucket_info, const string& name)
+{
+  cls_rgw_obj_key cls_key(name);
+  rgw_obj_key key(cls_key);
+  rgw_obj old_obj(bucket_info.bucket, key);
+  rgw_obj new_obj(new_bucket_info.bucket, key);
+
+  int old_shard_id;
+  int new_shard_id;
+  int ret = store->get_target_shard_id(bucket_info, old_obj.get_hash_object(), &old_shard_id);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = store->get_target_shard_id(new_bucket_info, new_obj.get_hash_object(), &new_shard_id);
+  if (ret < 0) {
+    return ret;
+  }
+
+  list<rgw_cls_bi_entry> old_entries;
+  list<rgw_cls_bi_entry> new_entries;
+  bool is_truncated = true;
+  string marker;
+  while (is_truncated) {
+    list<rgw_cls_bi_entry> entries;
+    ret = store->bi_list(bucket_info.bucket, old_shard_id, name, marker, RESHARD_BILOG_BATCH,
+                         &entries, &is_truncated);
+    if (ret < 0 && ret != -ENOENT) {
+      return ret;
+    }
+    if (entries.empty()) {
+      break;
+    }
+    marker = entries.back().idx;
+    old_entries.splice(old_entries.end(), entries);
+  }
+
+  is_truncated = true;
+  marker.clear();
+  while (is_truncated) {
+    list<rgw_cls_bi_entry> entries;
+    ret = store->bi_list(new_bucket_info.bucket, new_shard_id, name, marker, RESHARD_BILOG_BATCH,
+                         &entries, &is_truncated);
+    if (ret < 0 && ret != -ENOENT) {
+      return ret;
+    }
+    if (entries.empty()) {
+      break;
+    }
+    marker = entries.back().idx;
+    new_entries.splice(new_entries.end(), entries);
+  }
+
+  RGWRados::BucketShard bs(store);
+  ret = bs.init(new_bucket_info.bucket, new_shard_id);
+  if (ret < 0) {
+    return ret;
+  }
+
+  set<string> old_keys;
+  librados::ObjectWriteOperation op;
+  for (auto& entry : old_entries) {
+    old_keys.insert(entry.idx);
+    store->bi_put(op, bs, entry);
+  }
+  set<string> stale_keys;
+  for (auto& entry : new_entries) {
+    if (old_keys.find(entry.idx) == old_keys.end()) {
+      stale_keys.insert(entry.idx);
+    }
+  }
+  if (!stale_keys.empty()) {
+    op.omap_rm_keys(stale_keys);
+  }
+  if (old_entries.empty() && stale_keys.empty()) {
+    return 0;
+  }
+
+  return bs.index_ctx.operate(bs.bucket_obj, &op);
+}
+
+/*
+ * Bring the new index up to date with every change logged to the old index
+ * since marker, and advance marker past them.
+ */
+int RGWBucketReshard::replay_bilog(RGWBucketInfo& new_bucket_info, string& marker, uint64_t *num_replayed)
+{
+  *num_replayed = 0;
+  bool truncated = true;
+  while (truncated) {
+    list<rgw_bi_log_entry> entries;
+    int ret = store->list_bi_log_entries(bucket_info, -1, marker, RESHARD_BILOG_BATCH, entries, &truncated);
+    if (ret < 0) {
+      ldout(store->ctx(), 0) << "ERROR: list_bi_log_entries(): " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+
+    set<string> names;
+    for (auto& entry : entries) {
+      names.insert(entry.object);
+    }
+    for (auto& name : names) {
+      ret = sync_index_entry(new_bucket_info, name);
+      if (ret < 0) {
+        ldout(store->ctx(), 0) << "ERROR: failed to sync index entries for " << name << ": "
+                               << cpp_strerror(-ret) << dendl;
+        return ret;
+      }
+    }
+    *num_replayed += entries.size();
+
+    ret = renew_lock_bucket();
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+int RGWBucketReshard::do_reshard(RGWBucketInfo& new_bucket_info, int max_entries,
+                                 bool verbose, ostream *out, Formatter *formatter)
+{
+  CephContext *cct = store->ctx();
+
+  /* from here on every index update is logged to the bilog; updates that
+   * were prepared earlier left pending entries that the copy carries over */
+  int ret = set_index_resharding(RGW_BUCKET_RESHARD_IN_LOGRECORD);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = set_reshard_status(RGW_BUCKET_RESHARD_IN_LOGRECORD, string());
+  if (ret < 0) {
+    return ret;
+  }
+
+  map<int, string> markers;
+  ret = store->get_bi_log_status(bucket_info, -1, markers);
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: get_bi_log_status(): " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  BucketIndexShardsManager marker_mgr;
+  for (auto& m : markers) {
+    marker_mgr.add(m.first, m.second);
+  }
+  string marker;
+  marker_mgr.to_string(&marker);
+
+  ret = copy_index(new_bucket_info, max_entries, verbose, out, formatter);
+  if (ret < 0) {
+    return ret;
+  }
+
+  /* catch up while writes keep flowing, until the backlog is small */
+  uint64_t num_replayed = 0;
+  for (int i = 0; i < RESHARD_MAX_LOGRECORD_PASSES; ++i) {
+    ret = replay_bilog(new_bucket_info, marker, &num_replayed);
+    if (ret < 0) {
+      return ret;
+    }
+    ldout(cct, 10) << "reshard " << bucket_info.bucket << ": replayed " << num_replayed
+                   << " bilog entries" << dendl;
+    if (num_replayed < RESHARD_BILOG_BATCH) {
+      break;
+    }
+  }
+
+  /* refuse index updates for the last pass; writers see 503 SlowDown and
+   * completions are retried on the new instance once we're done */
+  ret = set_index_resharding(RGW_BUCKET_RESHARD_IN_PROGRESS);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = set_reshard_status(RGW_BUCKET_RESHARD_IN_PROGRESS, string());
+  if (ret < 0) {
+    return ret;
+  }
+
+  int pass = 0;
+  do {
+    ret = replay_bilog(new_bucket_info, marker, &num_replayed);
+    if (ret < 0) {
+      return ret;
+    }
+  } while (num_replayed > 0 && ++pass < RESHARD_MAX_FINAL_PASSES);
+  if (num_replayed > 0) {
+    ldout(cct, 0) << "ERROR: bucket " << bucket_info.bucket << " index kept changing while writes were blocked" << dendl;
+    return -EBUSY;
+  }
+
+  /* the catch-up passes didn't account stats, recalculate them */
+  ret = store->bucket_rebuild_index(new_bucket_info);
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to rebuild new bucket index stats: " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+
+  ret = rgw_link_bucket(store, new_bucket_info.owner, new_bucket_info.bucket,
+                        new_bucket_info.creation_time);
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to link new bucket instance (bucket_id=" << new_bucket_info.bucket.bucket_id
+                  << "): " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+
+  return set_reshard_status(RGW_BUCKET_RESHARD_DONE, new_bucket_info.bucket.bucket_id);
+}
+
+int RGWBucketReshard::execute(int num_shards, int max_entries,
+                              bool verbose, ostream *out, Formatter *formatter)
+{
+  int ret = lock_bucket();
+  if (ret < 0) {
+    return ret;
+  }
+
+  /* work from the current instance info so the status updates below don't
+   * race with other bucket metadata changes */
+  RGWObjectCtx obj_ctx(store);
+  ret = store->get_bucket_instance_info(obj_ctx, bucket_info.bucket, bucket_info, nullptr, &bucket_attrs);
+  if (ret < 0) {
+    unlock_bucket();
+    return ret;
+  }
+  if (bucket_info.reshard_done()) {
+    ldout(store->ctx(), 0) << "bucket " << bucket_info.bucket << " was already resharded into instance "
+                           << bucket_info.new_bucket_instance_id << dendl;
+    unlock_bucket();
+    return -EALREADY;
+  }
+
+  RGWBucketInfo new_bucket_info;
+  ret = create_new_bucket_instance(num_shards, new_bucket_info);
+  if (ret < 0) {
+    unlock_bucket();
+    return ret;
+  }
+
+  if (out) {
+    (*out) << "old bucket instance id: " << bucket_info.bucket.bucket_id << std::endl;
+    (*out) << "new bucket instance id: " << new_bucket_info.bucket.bucket_id << std::endl;
+  }
+
+  ret = do_reshard(new_bucket_info, max_entries, verbose, out, formatter);
+  if (ret < 0) {
+    /* let writers back onto the old index and drop the partial copy */
+    if (!bucket_info.reshard_done()) {
+      clear_resharding();
+    }
+    remove_new_bucket_index(new_bucket_info);
+    unlock_bucket();
+    return ret;
+  }
+
+  unlock_bucket();
+
+  ldout(store->ctx(), 1) << "resharded bucket " << bucket_info.bucket << " into instance "
+                         << new_bucket_info.bucket.bucket_id << " with " << num_shards
+                         << " shards, old index objects were left in place" << dendl;
+  return 0;
+}
+
+int RGWBucketReshard::get_status(RGWBucketInfo *info)
+{
+  RGWObjectCtx obj_ctx(store);
+  return store->get_bucket_instance_info(obj_ctx, bucket_info.bucket, *info, nullptr, nullptr);
+}
+
+int RGWBucketReshard::cancel()
+{
+  /* only possible while nobody is working on the bucket */
+  int ret = lock_bucket();
+  if (ret < 0) {
+    return ret;
+  }
+
+  RGWObjectCtx obj_ctx(store);
+  ret = store->get_bucket_instance_info(obj_ctx, bucket_info.bucket, bucket_info, nullptr, &bucket_attrs);
+  if (ret >= 0 && !bucket_info.reshard_done()) {
+    /* the index shards may be flagged even if the instance info isn't */
+    ret = set_index_resharding(RGW_BUCKET_RESHARD_NONE);
+    if (ret >= 0 && bucket_info.reshard_status != RGW_BUCKET_RESHARD_NONE) {
+      ret = set_reshard_status(RGW_BUCKET_RESHARD_NONE, string());
+    }
+  }
+
+  unlock_bucket();
+  return ret;
+}
+
+RGWReshard::RGWReshard(RGWRados *_store)
+  : store(_store), cct(_store->ctx()),
+    num_logshards(max(_store->ctx()->_conf->rgw_reshard_num_logs, 1)),
+    queued_lock("RGWReshard::queued_lock"), worker(nullptr)
+{
+}
+
+int RGWReshard::get_logshard_index(const string& key)
+{
+  return ceph_str_hash_linux(key.c_str(), key.size()) % num_logshards;
+}
+
+void RGWReshard::get_logshard_oid(int shard_num, string *oid)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s.%010d", reshard_oid_prefix.c_str(), shard_num);
+  *oid = buf;
+}
+
+int RGWReshard::open_log_ioctx(librados::IoCtx& ioctx)
+{
+  return rgw_init_ioctx(store->get_rados_handle(), store->get_zone_params().log_pool, ioctx, true);
+}
+
+int RGWReshard::add(rgw_reshard_entry& entry)
+{
+  librados::IoCtx ioctx;
+  int ret = open_log_ioctx(ioctx);
+  if (ret < 0) {
+    return ret;
+  }
+
+  string key;
+  entry.get_key(&key);
+  string oid;
+  get_logshard_oid(get_logshard_index(key), &oid);
+
+  map<string, bufferlist> vals;
+  ::encode(entry, vals[key]);
+  ret = ioctx.omap_set(oid, vals);
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to add " << key << " to reshard log " << oid << ": "
+                  << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  return 0;
+}
+
+/*
+ * Like add(), but only hits rados once per bucket and rgw_reshard_thread_interval:
+ * it's called from the write path for every upload into an oversized bucket.
+ */
+int RGWReshard::queue(rgw_reshard_entry& entry)
+{
+  string key;
+  entry.get_key(&key);
+
+  auto now = ceph::coarse_mono_clock::now();
+  auto period = ceph::make_timespan(cct->_conf->rgw_reshard_thread_interval);
+  {
+    Mutex::Locker l(queued_lock);
+    auto iter = recently_queued.find(key);
+    if (iter != recently_queued.end() && now < iter->second + period) {
+      return 0;
+    }
+    if (recently_queued.size() > 1024) {
+      for (auto i = recently_queued.begin(); i != recently_queued.end();) {
+        if (now >= i->second + period) {
+          recently_queued.erase(i++);
+        } else {
+          ++i;
+        }
+      }
+    }
+    recently_queued[key] = now;
+  }
+
+  return add(entry);
+}
+
+int RGWReshard::get(rgw_reshard_entry& entry)
+{
+  librados::IoCtx ioctx;
+  int ret = open_log_ioctx(ioctx);
+  if (ret < 0) {
+    return ret;
+  }
+
+  string key;
+  entry.get_key(&key);
+  string oid;
+  get_logshard_oid(get_logshard_index(key), &oid);
+
+  set<string> keys;
+  keys.insert(key);
+  map<string, bufferlist> vals;
+  ret = ioctx.omap_get_vals_by_keys(oid, keys, &vals);
+  if (ret < 0) {
+    return ret;
+  }
+  auto iter = vals.find(key);
+  if (iter == vals.end()) {
+    return -ENOENT;
+  }
+  try {
+    bufferlist::iterator biter = iter->second.begin();
+    ::decode(entry, biter);
+  } catch (buffer::error& err) {
+    ldout(cct, 0) << "ERROR: failed to decode reshard entry " << key << dendl;
+    return -EIO;
+  }
+  return 0;
+}
+
+int RGWReshard::remove(rgw_reshard_entry& entry)
+{
+  librados::IoCtx ioctx;
+  int ret = open_log_ioctx(ioctx);
+  if (ret < 0) {
+    return ret;
+  }
+
+  string key;
+  entry.get_key(&key);
+  string oid;
+  get_logshard_oid(get_logshard_index(key), &oid);
+
+  set<string> keys;
+  keys.insert(key);
+  librados::ObjectWriteOperation op;
+  op.omap_rm_keys(keys);
+  ret = ioctx.operate(oid, &op);
+  if (ret == -ENOENT) {
+    ret = 0;
+  }
+  return ret;
+}
+
+int RGWReshard::list(int logshard_num, string& marker, uint32_t max,
+                     std::list<rgw_reshard_entry>& entries, bool *is_truncated)
+{
+  librados::IoCtx ioctx;
+  int ret = open_log_ioctx(ioctx);
+  if (ret < 0) {
+    return ret;
+  }
+
+  string oid;
+  get_logshard_oid(logshard_num, &oid);
+
+  map<string, bufferlist> vals;
+  ret = ioctx.omap_get_vals2(oid, marker, max, &vals, is_truncated);
+  if (ret == -ENOENT) {
+    *is_truncated = false;
+    return 0;
+  }
+  if (ret < 0) {
+    return ret;
+  }
+
+  for (auto& v : vals) {
+    rgw_reshard_entry entry;
+    try {
+      bufferlist::iterator biter = v.second.begin();
+      ::decode(entry, biter);
+    } catch (buffer::error& err) {
+      ldout(cct, 0) << "ERROR: failed to decode reshard entry " << v.first << dendl;
+      continue;
+    }
+    entries.push_back(entry);
+    marker = v.first;
+  }
+  return 0;
+}
+
+int RGWReshard::process_entry(rgw_reshard_entry& entry)
+{
+  RGWObjectCtx obj_ctx(store);
+  RGWBucketInfo bucket_info;
+  map<string, bufferlist> attrs;
+  int ret = store->get_bucket_info(obj_ctx, entry.tenant, entry.bucket_name, bucket_info, nullptr, &attrs);
+  if (ret == -ENOENT) {
+    ldout(cct, 5) << "reshard: bucket " << entry.bucket_name << " no longer exists" << dendl;
+    return remove(entry);
+  }
+  if (ret < 0) {
+    return ret;
+  }
+
+  /* the bucket was recreated or resharded since it was queued */
+  if (bucket_info.bucket.bucket_id != entry.bucket_id) {
+    ldout(cct, 5) << "reshard: bucket " << entry.bucket_name << " instance changed from "
+                  << entry.bucket_id << " to " << bucket_info.bucket.bucket_id << dendl;
+    return remove(entry);
+  }
+
+  RGWBucketReshard br(store, bucket_info, attrs);
+  ret = br.execute(entry.new_num_shards, RESHARD_BILOG_BATCH);
+  if (ret == -EBUSY) {
+    /* someone else is resharding it, leave the entry for the next round */
+    return 0;
+  }
+  if (ret < 0 && ret != -EALREADY) {
+    ldout(cct, 0) << "ERROR: failed to reshard bucket " << entry.bucket_name << ": "
+                  << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+
+  return remove(entry);
+}
+
+int RGWReshard::process_single_logshard(int logshard_num)
+{
+  string oid;
+  get_logshard_oid(logshard_num, &oid);
+
+  librados::IoCtx ioctx;
+  int ret = open_log_ioctx(ioctx);
+  if (ret < 0) {
+    return ret;
+  }
+
+  rados::cls::lock::Lock l(reshard_lock_name);
+  l.set_duration(utime_t(cct->_conf->rgw_reshard_thread_interval, 0));
+  ret = l.lock_exclusive(&ioctx, oid);
+  if (ret == -EBUSY) { /* already locked by another reshard processor */
+    ldout(cct, 5) << "RGWReshard::" << __func__ << " failed to acquire lock on " << oid << dendl;
+    return 0;
+  }
+  if (ret < 0) {
+    return ret;
+  }
+
+  string marker;
+  bool truncated = true;
+  while (truncated && !going_down()) {
+    std::list<rgw_reshard_entry> entries;
+    ret = list(logshard_num, marker, RESHARD_SHARD_WINDOW, entries, &truncated);
+    if (ret < 0) {
+      break;
+    }
+
+    for (auto& entry : entries) {
+      if (going_down()) {
+        break;
+      }
+      int r = process_entry(entry);
+      if (r < 0) {
+        ldout(cct, 0) << "ERROR: reshard of " << entry.bucket_name << " failed: r=" << r << dendl;
+      }
+    }
+  }
+
+  l.unlock(&ioctx, oid);
+  return ret;
+}
+
+int RGWReshard::process_all_logshards()
+{
+  int ret = 0;
+  for (int i = 0; i < num_logshards && !going_down(); ++i) {
+    int r = process_single_logshard(i);
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: processing reshard log shard " << i << " returned r=" << r << dendl;
+      ret = r;
+    }
+  }
+  return ret;
+}
+
+bool RGWReshard::going_down()
+{
+  return down_flag;
+}
+
+void RGWReshard::start_processor()
+{
+  worker = new ReshardWorker(cct, this);
+  worker->create("rgw_reshard");
+}
+
+void RGWReshard::stop_processor()
+{
+  down_flag = true;
+  if (worker) {
+    worker->stop();
+    worker->join();
+  }
+  delete worker;
+  worker = nullptr;
+}
+
+void *RGWReshard::ReshardWorker::entry() {
+  do {
+    utime_t start = ceph_clock_now();
+    ldout(cct, 2) << "dynamic resharding: start" << dendl;
+    int r = reshard->process_all_logshards();
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: reshard process_all_logshards() returned error r=" << r << dendl;
+    }
+    ldout(cct, 2) << "dynamic resharding: stop" << dendl;
+
+    if (reshard->going_down())
+      break;
+
+    utime_t end = ceph_clock_now();
+    end -= start;
+    int secs = cct->_conf->rgw_reshard_thread_interval;
+
+    if (secs <= end.sec())
+      continue; // next round
+
+    secs -= end.sec();
+
+    lock.Lock();
+    cond.WaitInterval(lock, utime_t(secs, 0));
+    lock.Unlock();
+  } while (!reshard->going_down());
+
+  return NULL;
+}
+
+void RGWReshard::ReshardWorker::stop()
+{
+  Mutex::Locker l(lock);
+  cond.Signal();
+}
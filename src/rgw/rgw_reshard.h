@@ -0,0 +1,175 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_RESHARD_H
+#define CEPH_RGW_RESHARD_H
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <string>
+
+#include "include/types.h"
+#include "include/rados/librados.hpp"
+#include "common/ceph_time.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "cls/lock/cls_lock_client.h"
+#include "rgw_common.h"
+#include "rgw_rados.h"
+
+/*
+ * A bucket waiting in the reshard queue.  Entries are keyed by
+ * tenant:bucket_name, so queueing the same bucket twice just updates the
+ * requested shard count.
+ */
+struct rgw_reshard_entry
+{
+  ceph::real_time time;
+  string tenant;
+  string bucket_name;
+  string bucket_id;
+  uint32_t old_num_shards{0};
+  uint32_t new_num_shards{0};
+
+  rgw_reshard_entry() {}
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(time, bl);
+    ::encode(tenant, bl);
+    ::encode(bucket_name, bl);
+    ::encode(bucket_id, bl);
+    ::encode(old_num_shards, bl);
+    ::encode(new_num_shards, bl);
+    ENCODE_FINISH(bl);
+  }
+
+  void decode(bufferlist::iterator& bl) {
+    DECODE_START(1, bl);
+    ::decode(time, bl);
+    ::decode(tenant, bl);
+    ::decode(bucket_name, bl);
+    ::decode(bucket_id, bl);
+    ::decode(old_num_shards, bl);
+    ::decode(new_num_shards, bl);
+    DECODE_FINISH(bl);
+  }
+
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<rgw_reshard_entry*>& o);
+
+  static void get_key(const string& tenant, const string& bucket_name, string *key);
+  void get_key(string *key) const {
+    get_key(tenant, bucket_name, key);
+  }
+};
+WRITE_CLASS_ENCODER(rgw_reshard_entry)
+
+/*
+ * Moves a bucket index to a new bucket instance with a different number of
+ * shards while the bucket stays writable.
+ *
+ * The old index is copied with bi_list/bi_put while writers keep going and,
+ * because its shards are flagged RGW_BUCKET_RESHARD_IN_LOGRECORD, cls_rgw
+ * records every index change in the old index's bilog.  Those bilog entries
+ * are then replayed onto the new index.  For the last replay pass the shards
+ * are flagged RGW_BUCKET_RESHARD_IN_PROGRESS and refuse index updates with
+ * ERR_BUSY_RESHARDING; afterwards the bucket entrypoint is switched to the
+ * new instance and the old one is marked done, which tells refused writers
+ * where to retry.
+ */
+class RGWBucketReshard {
+  RGWRados *store;
+  RGWBucketInfo bucket_info;
+  map<string, bufferlist> bucket_attrs;
+
+  rados::cls::lock::Lock reshard_lock;
+  librados::IoCtx lock_ioctx;
+  string lock_oid;
+
+  int lock_bucket();
+  int renew_lock_bucket();
+  void unlock_bucket();
+
+  int set_reshard_status(uint8_t status, const string& new_instance_id);
+  int set_index_resharding(uint8_t status);
+  void clear_resharding();
+  int create_new_bucket_instance(int new_num_shards, RGWBucketInfo& new_bucket_info);
+  void remove_new_bucket_index(RGWBucketInfo& new_bucket_info);
+  int copy_index(RGWBucketInfo& new_bucket_info, int max_entries,
+                 bool verbose, ostream *out, Formatter *formatter);
+  int sync_index_entry(RGWBucketInfo& new_bucket_info, const string& name);
+  int replay_bilog(RGWBucketInfo& new_bucket_info, string& marker, uint64_t *num_replayed);
+  int do_reshard(RGWBucketInfo& new_bucket_info, int max_entries,
+                 bool verbose, ostream *out, Formatter *formatter);
+
+public:
+  RGWBucketReshard(RGWRados *_store, const RGWBucketInfo& _bucket_info,
+                   const map<string, bufferlist>& _bucket_attrs);
+
+  int execute(int num_shards, int max_entries,
+              bool verbose = false, ostream *out = nullptr,
+              Formatter *formatter = nullptr);
+  int get_status(RGWBucketInfo *info);
+  int cancel();
+};
+
+/*
+ * The queue of buckets to reshard, kept as omap entries on
+ * rgw_reshard_num_logs objects in the zone's log pool, and the thread that
+ * works through it.
+ */
+class RGWReshard {
+  RGWRados *store;
+  CephContext *cct;
+  int num_logshards;
+  std::atomic<bool> down_flag = { false };
+
+  Mutex queued_lock;
+  map<string, ceph::coarse_mono_time> recently_queued;
+
+  int get_logshard_index(const string& key);
+  void get_logshard_oid(int shard_num, string *oid);
+  int open_log_ioctx(librados::IoCtx& ioctx);
+  int process_entry(rgw_reshard_entry& entry);
+
+  class ReshardWorker : public Thread {
+    CephContext *cct;
+    RGWReshard *reshard;
+    Mutex lock;
+    Cond cond;
+
+  public:
+    ReshardWorker(CephContext *_cct, RGWReshard *_reshard)
+      : cct(_cct), reshard(_reshard), lock("ReshardWorker") {}
+    void *entry() override;
+    void stop();
+  };
+
+  ReshardWorker *worker;
+
+public:
+  explicit RGWReshard(RGWRados *_store);
+  ~RGWReshard() {
+    stop_processor();
+  }
+
+  int add(rgw_reshard_entry& entry);
+  int queue(rgw_reshard_entry& entry);
+  int get(rgw_reshard_entry& entry);
+  int remove(rgw_reshard_entry& entry);
+  int list(int logshard_num, string& marker, uint32_t max,
+           std::list<rgw_reshard_entry>& entries, bool *is_truncated);
+  int get_num_logshards() { return num_logshards; }
+
+  int process_single_logshard(int logshard_num);
+  int process_all_logshards();
+
+  bool going_down();
+  void start_processor();
+  void stop_processor();
+};
+
+#endif
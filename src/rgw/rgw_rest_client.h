@@ -104,7 +104,7 @@ public:
                 chunk_ofs(0), ofs(0), http_manager(_cct), method(_method), write_ofs(0) {
   }
   ~RGWRESTStreamRWRequest() override {}
-  int get_obj(RGWAccessKey& key, map<string, string>& extra_headers, rgw_obj& obj);
+  int get_obj(RGWAccessKey& key, map<string, string>& extra_headers, rgw_obj& obj, RGWHTTPManager *mgr = NULL);
   int get_resource(RGWAccessKey& key, map<string, string>& extra_headers, const string& resource, RGWHTTPManager *mgr = NULL);
   int complete(string& etag, real_time *mtime, uint64_t *psize, map<string, string>& attrs);
 
@@ -151,7 +151,9 @@ int RGWRESTConn::get_obj(const rgw_user& uid, req_info *info /* optional */, rgw
                          uint32_t mod_zone_id, uint64_t mod_pg_ver,
                          bool prepend_metadata, bool get_op, bool rgwx_stat,
                          bool sync_manifest, RGWGetDataCB *cb,
-                         RGWRESTStreamRWRequest **req)
+                         RGWRESTStreamRWRequest **req,
+                         off_t ofs, off_t end, const string *if_match,
+                         RGWHTTPManager *mgr)
 {
   string url;
   int ret = get_url(url);
@@ -202,8 +204,16 @@ int RGWRESTConn::get_obj(const rgw_user& uid, req_info *info /* optional */, rgw
   if (mod_pg_ver != 0) {
     set_header(mod_pg_ver, extra_headers, "HTTP_DEST_PG_VER");
   }
+  if (end >= 0) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "bytes=%lld-%lld", (long long)ofs, (long long)end);
+    extra_headers["HTTP_RANGE"] = buf;
+  }
+  if (if_match) {
+    extra_headers["HTTP_IF_MATCH"] = *if_match;
+  }
 
-  int r = (*req)->get_obj(key, extra_headers, obj);
+  int r = (*req)->get_obj(key, extra_headers, obj, mgr);
   if (r < 0) {
     delete *req;
     *req = nullptr;
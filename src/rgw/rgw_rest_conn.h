@@ -94,7 +94,10 @@ public:
               const ceph::real_time *mod_ptr, const ceph::real_time *unmod_ptr,
               uint32_t mod_zone_id, uint64_t mod_pg_ver,
               bool prepend_metadata, bool get_op, bool rgwx_stat, bool sync_manifest,
-              RGWGetDataCB *cb, RGWRESTStreamRWRequest **req);
+              RGWGetDataCB *cb, RGWRESTStreamRWRequest **req,
+              off_t ofs = 0, off_t end = -1, /* byte range, if end >= 0 */
+              const string *if_match = NULL,
+              RGWHTTPManager *mgr = NULL); /* don't wait for completion */
   int complete_request(RGWRESTStreamRWRequest *req, string& etag, ceph::real_time *mtime, uint64_t *psize, map<string, string>& attrs);
 
   int get_resource(const string& resource,
@@ -143,6 +146,31 @@ public:
   }
 };
 
+/*
+ * The head range of a ranged fetch.  An empty object has no satisfiable
+ * range, and gateways that don't send those in full answer 416; keep the
+ * error body out of the object data, so the object can be read again in
+ * one piece.
+ */
+class RGWFetchHeadRangeCB : public RGWGetDataCB {
+  RGWGetDataCB *next;
+  RGWRESTStreamRWRequest **req;
+public:
+  RGWFetchHeadRangeCB(RGWGetDataCB *_next, RGWRESTStreamRWRequest **_req)
+    : next(_next), req(_req) {}
+
+  int handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len) override {
+    if ((*req)->get_http_status() == 416) {
+      return 0;
+    }
+    return next->handle_data(bl, bl_ofs, bl_len);
+  }
+
+  void set_extra_data_len(uint64_t len) override {
+    next->set_extra_data_len(len);
+  }
+};
+
 class RGWRESTReadResource : public RefCountedObject {
   CephContext *cct;
   RGWRESTConn *conn;
@@ -12,6 +12,7 @@
 #include "common/safe_io.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/crc.hpp>
 
 #include "rgw_rest.h"
 #include "rgw_rest_s3.h"
@@ -516,6 +517,11 @@ int RGWListBucket_ObjStore_S3::get_params()
   }
   delimiter = s->info.args.get("delimiter");
   encoding_type = s->info.args.get("encoding-type");
+  s->info.args.get_bool("allow-unordered", &allow_unordered, false);
+  if (allow_unordered && !delimiter.empty()) {
+    ldout(s->cct, 5) << "allow-unordered can't be combined with a delimiter" << dendl;
+    return -EINVAL;
+  }
   if (s->system_request) {
     s->info.args.get_bool("objs-container", &objs_container, false);
     const char *shard_id_str = s->info.env->get("HTTP_RGWX_SHARD_ID");
@@ -824,6 +830,263 @@ void RGWSetBucketVersioning_ObjStore_S3::send_response()
   end_header(s);
 }
 
+static int decode_select_char(XMLObj *obj, const char *name, char *c)
+{
+  XMLObj *o = obj->find_first(name);
+  if (!o) {
+    return 0;
+  }
+  const string& val = o->get_data();
+  if (val.size() != 1) {
+    return -EINVAL;
+  }
+  *c = val[0];
+  return 0;
+}
+
+static int decode_select_format(XMLObj *obj, bool input, RGWSelectFormat& fmt)
+{
+  XMLObj *o;
+  if ((o = obj->find_first("CSV"))) {
+    fmt.type = RGWSelectFormat::CSV;
+    XMLObj *h = o->find_first("FileHeaderInfo");
+    if (input && h) {
+      const string& info = h->get_data();
+      if (info == "USE") {
+        fmt.header_info = RGWSelectFormat::HEADER_USE;
+      } else if (info == "IGNORE") {
+        fmt.header_info = RGWSelectFormat::HEADER_IGNORE;
+      } else if (info != "NONE") {
+        return -EINVAL;
+      }
+    }
+    int r = decode_select_char(o, "FieldDelimiter", &fmt.field_delim);
+    if (r == 0) {
+      r = decode_select_char(o, "QuoteCharacter", &fmt.quote);
+    }
+    if (r == 0) {
+      r = decode_select_char(o, "RecordDelimiter", &fmt.record_delim);
+    }
+    return r;
+  }
+
+  if ((o = obj->find_first("JSON"))) {
+    fmt.type = RGWSelectFormat::JSON;
+    XMLObj *t = o->find_first("Type");
+    if (input && t && t->get_data() != "LINES") {
+      /* whole json documents would have to be parsed in one piece */
+      return -ERR_NOT_IMPLEMENTED;
+    }
+    return decode_select_char(o, "RecordDelimiter", &fmt.record_delim);
+  }
+
+  return -EINVAL;
+}
+
+int RGWSelectObj_ObjStore_S3::get_params()
+{
+  int r = RGWGetObj_ObjStore_S3::get_params();
+  if (r < 0) {
+    return r;
+  }
+  range_str = nullptr;
+
+  if (s->info.args.get("select-type") != "2") {
+    return -EINVAL;
+  }
+
+  char *data = nullptr;
+  int len = 0;
+  const auto max_size = s->cct->_conf->rgw_max_put_param_size;
+  r = rgw_rest_read_all_input(s, &data, &len, max_size, false);
+  if (r < 0) {
+    return r;
+  }
+
+  auto data_deleter = std::unique_ptr<char, decltype(free)*>{data, free};
+
+  if (s->aws4_auth_needs_complete) {
+    int ret_auth = do_aws4_auth_completion();
+    if (ret_auth < 0) {
+      return ret_auth;
+    }
+  }
+
+  RGWXMLDecoder::XMLParser parser;
+  if (!parser.init()) {
+    ldout(s->cct, 0) << "ERROR: failed to initialize parser" << dendl;
+    return -EIO;
+  }
+
+  if (!parser.parse(data, len, 1)) {
+    ldout(s->cct, 5) << "failed to parse xml: " << string(data, len) << dendl;
+    return -ERR_MALFORMED_XML;
+  }
+
+  XMLObj *req = parser.find_first("SelectObjectContentRequest");
+  XMLObj *expr = (req ? req->find_first("Expression") : nullptr);
+  XMLObj *expr_type = (req ? req->find_first("ExpressionType") : nullptr);
+  XMLObj *input = (req ? req->find_first("InputSerialization") : nullptr);
+  XMLObj *output = (req ? req->find_first("OutputSerialization") : nullptr);
+  if (!expr || !expr_type || !input || !output) {
+    return -ERR_MALFORMED_XML;
+  }
+  if (expr_type->get_data() != "SQL") {
+    return -EINVAL;
+  }
+
+  XMLObj *compression = input->find_first("CompressionType");
+  if (compression && compression->get_data() != "NONE") {
+    return -ERR_NOT_IMPLEMENTED;
+  }
+
+  r = decode_select_format(input, true, in_fmt);
+  if (r < 0) {
+    return r;
+  }
+  r = decode_select_format(output, false, out_fmt);
+  if (r < 0) {
+    return r;
+  }
+
+  string err;
+  r = query.parse(expr->get_data(), &err);
+  if (r < 0) {
+    ldout(s->cct, 5) << "failed to parse select expression: " << err << dendl;
+    s->err.message = "bad select expression: " + err;
+    return r;
+  }
+
+  return 0;
+}
+
+int RGWSelectObj_ObjStore_S3::get_select_filter(std::unique_ptr<RGWGetDataCB> *filter,
+                                                RGWGetDataCB* cb)
+{
+  if (attrs.count(RGW_ATTR_USER_MANIFEST) || attrs.count(RGW_ATTR_SLO_MANIFEST)) {
+    /* the parts of swift large objects are read around the filters */
+    return -ERR_NOT_IMPLEMENTED;
+  }
+  select = new RGWGetObj_Select(s->cct, query, in_fmt, out_fmt, cb);
+  filter->reset(select);
+  return 0;
+}
+
+static void append_be32(bufferlist& bl, uint32_t v)
+{
+  char buf[4] = { (char)(v >> 24), (char)(v >> 16), (char)(v >> 8), (char)v };
+  bl.append(buf, sizeof(buf));
+}
+
+static void append_event_header(bufferlist& bl, const char *name, const string& val)
+{
+  bl.append((char)strlen(name));
+  bl.append(name);
+  bl.append((char)7); /* string value */
+  bl.append((char)(val.size() >> 8));
+  bl.append((char)(val.size() & 0xff));
+  bl.append(val);
+}
+
+/*
+ * an event stream message is
+ *   total length, headers length, crc32 of the two, headers, payload,
+ *   crc32 of everything before
+ * with all integers in big endian
+ */
+void RGWSelectObj_ObjStore_S3::send_event(bufferlist& headers, bufferlist& payload)
+{
+  bufferlist msg;
+  append_be32(msg, 12 + headers.length() + payload.length() + 4);
+  append_be32(msg, headers.length());
+
+  boost::crc_32_type crc;
+  crc.process_bytes(msg.c_str(), msg.length());
+  append_be32(msg, crc.checksum());
+
+  msg.append(headers);
+  msg.append(payload);
+
+  crc.reset();
+  crc.process_bytes(msg.c_str(), msg.length());
+  append_be32(msg, crc.checksum());
+
+  dump_body(s, msg);
+}
+
+int RGWSelectObj_ObjStore_S3::send_response_data(bufferlist& bl, off_t bl_ofs,
+                                                 off_t bl_len)
+{
+  if (!sent_header) {
+    if (op_ret < 0) {
+      set_req_state_err(s, op_ret);
+      dump_errno(s);
+      end_header(s, this);
+      sent_header = true;
+      return 0;
+    }
+    dump_errno(s);
+    end_header(s, this, "application/octet-stream", CHUNKED_TRANSFER_ENCODING);
+    sent_header = true;
+  }
+
+  if (op_ret < 0) {
+    return 0;
+  }
+
+  if (bl_len > 0) {
+    bufferlist headers;
+    append_event_header(headers, ":event-type", "Records");
+    append_event_header(headers, ":content-type", "application/octet-stream");
+    append_event_header(headers, ":message-type", "event");
+    bufferlist payload;
+    payload.substr_of(bl, bl_ofs, bl_len);
+    send_event(headers, payload);
+    return 0;
+  }
+
+  /* end of the object */
+  uint64_t scanned = (select ? select->get_bytes_scanned() : 0);
+  uint64_t returned = (select ? select->get_bytes_returned() : 0);
+
+  bufferlist headers;
+  append_event_header(headers, ":event-type", "Stats");
+  append_event_header(headers, ":content-type", "text/xml");
+  append_event_header(headers, ":message-type", "event");
+  bufferlist payload;
+  payload.append("<Stats><BytesScanned>" + std::to_string(scanned) +
+                 "</BytesScanned><BytesProcessed>" + std::to_string(scanned) +
+                 "</BytesProcessed><BytesReturned>" + std::to_string(returned) +
+                 "</BytesReturned></Stats>");
+  send_event(headers, payload);
+
+  headers.clear();
+  payload.clear();
+  append_event_header(headers, ":event-type", "End");
+  append_event_header(headers, ":message-type", "event");
+  send_event(headers, payload);
+  return 0;
+}
+
+int RGWSelectObj_ObjStore_S3::send_response_data_error()
+{
+  bufferlist bl;
+  if (!sent_header) {
+    return send_response_data(bl, 0, 0);
+  }
+
+  /* records went out already, the error can only be reported in the stream */
+  rgw_err err;
+  set_req_state_err(err, op_ret, s->prot_flags);
+  bufferlist headers;
+  append_event_header(headers, ":error-code", err.err_code);
+  append_event_header(headers, ":error-message",
+                      err.message.empty() ? err.err_code : err.message);
+  append_event_header(headers, ":message-type", "error");
+  send_event(headers, bl);
+  return 0;
+}
+
 int RGWSetBucketWebsite_ObjStore_S3::get_params()
 {
   char *data = nullptr;
@@ -2927,6 +3190,12 @@ RGWOp *RGWHandler_REST_Obj_S3::op_post()
   if (s->info.args.exists("uploads"))
     return new RGWInitMultipart_ObjStore_S3;
 
+  if (s->info.args.exists("select")) {
+    RGWSelectObj_ObjStore_S3 *select_op = new RGWSelectObj_ObjStore_S3;
+    select_op->set_get_data(true);
+    return select_op;
+  }
+
   return NULL;
 }
 
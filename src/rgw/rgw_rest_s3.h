@@ -14,6 +14,7 @@
 #include "rgw_acl_s3.h"
 #include "rgw_policy_s3.h"
 #include "rgw_lc_s3.h"
+#include "rgw_select.h"
 #include "rgw_keystone.h"
 #include "rgw_rest_conn.h"
 #include "rgw_ldap.h"
@@ -54,6 +55,33 @@ public:
                          bufferlist* manifest_bl) override;
 };
 
+/*
+ * POST /obj?select&select-type=2: the object's records that match the
+ * request's query, sent as an aws event stream.
+ */
+class RGWSelectObj_ObjStore_S3 : public RGWGetObj_ObjStore_S3
+{
+  RGWSelectQuery query;
+  RGWSelectFormat in_fmt;
+  RGWSelectFormat out_fmt;
+  RGWGetObj_Select *select = nullptr; /* owned by execute() */
+
+  void send_event(bufferlist& headers, bufferlist& payload);
+public:
+  RGWSelectObj_ObjStore_S3() {}
+  ~RGWSelectObj_ObjStore_S3() override {}
+
+  /* the request's range (if any) doesn't apply, the query picks the data */
+  bool prefetch_data() override { return get_data; }
+  int get_params() override;
+  int send_response_data_error() override;
+  int send_response_data(bufferlist& bl, off_t ofs, off_t len) override;
+  int get_select_filter(std::unique_ptr<RGWGetDataCB>* filter,
+                        RGWGetDataCB* cb) override;
+  bool select_done() override { return select && select->done(); }
+  const string name() override { return "select_obj"; }
+};
+
 class RGWListBuckets_ObjStore_S3 : public RGWListBuckets_ObjStore {
 public:
   RGWListBuckets_ObjStore_S3() {}
@@ -0,0 +1,926 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <string.h>
+
+#include "common/ceph_json.h"
+#include "common/strtol.h"
+
+#include "rgw_select.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+using std::string;
+using std::vector;
+using std::unique_ptr;
+
+struct RGWSelectQuery::Node {
+  enum Type {
+    OR,
+    AND,
+    NOT,
+    CMP,
+    LIKE,
+    IS_NULL,
+  } type;
+  enum Cmp {
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE,
+  } cmp = EQ;
+  bool negate = false; /* NOT LIKE, IS NOT NULL */
+  unique_ptr<Node> left;
+  unique_ptr<Node> right;
+  Operand a;
+  Operand b;
+
+  explicit Node(Type t) : type(t) {}
+};
+
+namespace {
+
+enum TokenType {
+  T_END,
+  T_IDENT,
+  T_STRING,
+  T_NUMBER,
+  T_OP,
+  T_STAR,
+  T_COMMA,
+  T_LPAREN,
+  T_RPAREN,
+};
+
+struct Token {
+  TokenType type;
+  string text;
+  vector<string> parts; /* T_IDENT: the dot separated components */
+  bool quoted = false;  /* T_IDENT: some component was double quoted */
+
+  explicit Token(TokenType t) : type(t) {}
+};
+
+bool is_ident_char(char c)
+{
+  return isalnum(c) || c == '_';
+}
+
+int read_ident_part(const string& sql, size_t& i, Token& tok, string *err)
+{
+  string part;
+  if (sql[i] == '"') {
+    tok.quoted = true;
+    for (++i; ; ++i) {
+      if (i == sql.size()) {
+        *err = "unterminated quoted identifier";
+        return -EINVAL;
+      }
+      if (sql[i] == '"') {
+        if (i + 1 < sql.size() && sql[i + 1] == '"') {
+          part.push_back('"');
+          ++i;
+          continue;
+        }
+        ++i;
+        break;
+      }
+      part.push_back(sql[i]);
+    }
+  } else if (i < sql.size() && (isalpha(sql[i]) || sql[i] == '_')) {
+    while (i < sql.size() && is_ident_char(sql[i])) {
+      part.push_back(sql[i++]);
+    }
+  } else {
+    *err = "bad identifier";
+    return -EINVAL;
+  }
+  if (!tok.text.empty()) {
+    tok.text.push_back('.');
+  }
+  tok.text.append(part);
+  tok.parts.push_back(part);
+  return 0;
+}
+
+int tokenize(const string& sql, vector<Token>& tokens, string *err)
+{
+  size_t i = 0;
+  while (i < sql.size()) {
+    char c = sql[i];
+    if (isspace(c)) {
+      ++i;
+      continue;
+    }
+
+    bool after_value = !tokens.empty() &&
+      (tokens.back().type == T_IDENT || tokens.back().type == T_STRING ||
+       tokens.back().type == T_NUMBER || tokens.back().type == T_RPAREN);
+
+    if (isalpha(c) || c == '_' || c == '"') {
+      Token tok(T_IDENT);
+      int r = read_ident_part(sql, i, tok, err);
+      while (r == 0 && i + 1 < sql.size() && sql[i] == '.') {
+        ++i;
+        r = read_ident_part(sql, i, tok, err);
+      }
+      if (r < 0) {
+        return r;
+      }
+      tokens.push_back(std::move(tok));
+    } else if (c == '\'') {
+      Token tok(T_STRING);
+      for (++i; ; ++i) {
+        if (i == sql.size()) {
+          *err = "unterminated string literal";
+          return -EINVAL;
+        }
+        if (sql[i] == '\'') {
+          if (i + 1 < sql.size() && sql[i + 1] == '\'') {
+            tok.text.push_back('\'');
+            ++i;
+            continue;
+          }
+          ++i;
+          break;
+        }
+        tok.text.push_back(sql[i]);
+      }
+      tokens.push_back(std::move(tok));
+    } else if (isdigit(c) ||
+               ((c == '-' || c == '.') && !after_value &&
+                i + 1 < sql.size() && (isdigit(sql[i + 1]) || sql[i + 1] == '.'))) {
+      Token tok(T_NUMBER);
+      tok.text.push_back(c);
+      for (++i; i < sql.size(); ++i) {
+        char d = sql[i];
+        if (isdigit(d) || d == '.' || d == 'e' || d == 'E' ||
+            ((d == '-' || d == '+') && (sql[i - 1] == 'e' || sql[i - 1] == 'E'))) {
+          tok.text.push_back(d);
+        } else {
+          break;
+        }
+      }
+      tokens.push_back(std::move(tok));
+    } else if (c == '=' || c == '<' || c == '>' || c == '!') {
+      Token tok(T_OP);
+      tok.text.push_back(c);
+      ++i;
+      if (i < sql.size() && (sql[i] == '=' || (c == '<' && sql[i] == '>'))) {
+        tok.text.push_back(sql[i++]);
+      }
+      if (tok.text == "!") {
+        *err = "bad operator '!'";
+        return -EINVAL;
+      }
+      tokens.push_back(std::move(tok));
+    } else if (c == '*') {
+      tokens.push_back(Token(T_STAR));
+      ++i;
+    } else if (c == ',') {
+      tokens.push_back(Token(T_COMMA));
+      ++i;
+    } else if (c == '(') {
+      tokens.push_back(Token(T_LPAREN));
+      ++i;
+    } else if (c == ')') {
+      tokens.push_back(Token(T_RPAREN));
+      ++i;
+    } else {
+      *err = string("unexpected character '") + c + "'";
+      return -EINVAL;
+    }
+  }
+  tokens.push_back(Token(T_END));
+  return 0;
+}
+
+typedef RGWSelectQuery::Node Node;
+typedef RGWSelectQuery::Operand Operand;
+
+class Parser {
+  vector<Token>& toks;
+  size_t pos = 0;
+  string *err;
+
+public:
+  Parser(vector<Token>& toks, string *err) : toks(toks), err(err) {}
+
+  const Token& peek() const { return toks[pos]; }
+  void next() {
+    if (toks[pos].type != T_END) {
+      ++pos;
+    }
+  }
+
+  int fail(const string& what) {
+    *err = what;
+    return -EINVAL;
+  }
+
+  bool is_kw(const char *kw) const {
+    const Token& t = peek();
+    return t.type == T_IDENT && !t.quoted && t.parts.size() == 1 &&
+      strcasecmp(t.text.c_str(), kw) == 0;
+  }
+
+  bool accept_kw(const char *kw) {
+    if (!is_kw(kw)) {
+      return false;
+    }
+    next();
+    return true;
+  }
+
+  bool accept(TokenType type) {
+    if (peek().type != type) {
+      return false;
+    }
+    next();
+    return true;
+  }
+
+  int parse_operand(Operand& op) {
+    const Token& t = peek();
+    switch (t.type) {
+    case T_IDENT:
+      op.is_column = true;
+      op.value = t.text;
+      op.path = t.parts;
+      break;
+    case T_STRING:
+    case T_NUMBER:
+      op.value = t.text;
+      break;
+    default:
+      return fail("expected a column or a literal");
+    }
+    next();
+    return 0;
+  }
+
+  int parse_predicate(unique_ptr<Node>& n) {
+    if (accept(T_LPAREN)) {
+      int r = parse_or(n);
+      if (r < 0) {
+        return r;
+      }
+      if (!accept(T_RPAREN)) {
+        return fail("expected ')'");
+      }
+      return 0;
+    }
+
+    Operand a;
+    int r = parse_operand(a);
+    if (r < 0) {
+      return r;
+    }
+
+    if (accept_kw("IS")) {
+      n.reset(new Node(Node::IS_NULL));
+      n->negate = accept_kw("NOT");
+      if (!accept_kw("NULL")) {
+        return fail("expected NULL");
+      }
+      n->a = a;
+      return 0;
+    }
+
+    bool negate = accept_kw("NOT");
+    if (accept_kw("LIKE")) {
+      n.reset(new Node(Node::LIKE));
+      n->negate = negate;
+      n->a = a;
+      if (peek().type != T_STRING) {
+        return fail("LIKE expects a string pattern");
+      }
+      return parse_operand(n->b);
+    }
+    if (negate) {
+      return fail("expected LIKE after NOT");
+    }
+
+    const Token& t = peek();
+    if (t.type != T_OP) {
+      return fail("expected a comparison");
+    }
+    n.reset(new Node(Node::CMP));
+    if (t.text == "=") {
+      n->cmp = Node::EQ;
+    } else if (t.text == "!=" || t.text == "<>") {
+      n->cmp = Node::NE;
+    } else if (t.text == "<") {
+      n->cmp = Node::LT;
+    } else if (t.text == "<=") {
+      n->cmp = Node::LE;
+    } else if (t.text == ">") {
+      n->cmp = Node::GT;
+    } else if (t.text == ">=") {
+      n->cmp = Node::GE;
+    } else {
+      return fail("bad operator '" + t.text + "'");
+    }
+    next();
+    n->a = a;
+    return parse_operand(n->b);
+  }
+
+  int parse_not(unique_ptr<Node>& n) {
+    if (accept_kw("NOT")) {
+      n.reset(new Node(Node::NOT));
+      return parse_not(n->left);
+    }
+    return parse_predicate(n);
+  }
+
+  int parse_and(unique_ptr<Node>& n) {
+    int r = parse_not(n);
+    while (r == 0 && accept_kw("AND")) {
+      unique_ptr<Node> node(new Node(Node::AND));
+      node->left = std::move(n);
+      r = parse_not(node->right);
+      n = std::move(node);
+    }
+    return r;
+  }
+
+  int parse_or(unique_ptr<Node>& n) {
+    int r = parse_and(n);
+    while (r == 0 && accept_kw("OR")) {
+      unique_ptr<Node> node(new Node(Node::OR));
+      node->left = std::move(n);
+      r = parse_and(node->right);
+      n = std::move(node);
+    }
+    return r;
+  }
+};
+
+void collect_columns(Node *n, vector<Operand *>& columns)
+{
+  if (!n) {
+    return;
+  }
+  collect_columns(n->left.get(), columns);
+  collect_columns(n->right.get(), columns);
+  if (n->a.is_column) {
+    columns.push_back(&n->a);
+  }
+  if (n->b.is_column) {
+    columns.push_back(&n->b);
+  }
+}
+
+/* _1, _2, ... */
+int positional_index(const string& name)
+{
+  if (name.size() < 2 || name[0] != '_') {
+    return -1;
+  }
+  string err;
+  long long i = strict_strtoll(name.c_str() + 1, 10, &err);
+  if (!err.empty() || i < 1 || i > INT_MAX) {
+    return -1;
+  }
+  return i - 1;
+}
+
+bool to_number(const string& s, double *d)
+{
+  if (s.empty()) {
+    return false;
+  }
+  char *end;
+  errno = 0;
+  *d = strtod(s.c_str(), &end);
+  while (isspace(*end)) {
+    ++end;
+  }
+  return errno == 0 && *end == '\0' && !isspace(s[0]);
+}
+
+int compare(const string& a, const string& b)
+{
+  double x, y;
+  if (to_number(a, &x) && to_number(b, &y)) {
+    return (x < y ? -1 : (x > y ? 1 : 0));
+  }
+  return a.compare(b);
+}
+
+bool like(const char *s, const char *p)
+{
+  const char *star = nullptr;
+  const char *retry = nullptr;
+  while (*s) {
+    if (*p == '%') {
+      star = p++;
+      retry = s;
+    } else if (*p == '_' || *p == *s) {
+      ++s;
+      ++p;
+    } else if (star) {
+      p = star + 1;
+      s = ++retry;
+    } else {
+      return false;
+    }
+  }
+  while (*p == '%') {
+    ++p;
+  }
+  return *p == '\0';
+}
+
+bool get_value(const Operand& op, const RGWSelectQuery::Record& rec, string *val)
+{
+  if (!op.is_column) {
+    *val = op.value;
+    return true;
+  }
+  return rec.get(op, val);
+}
+
+bool eval(const Node *n, const RGWSelectQuery::Record& rec)
+{
+  string a, b;
+  switch (n->type) {
+  case Node::OR:
+    return eval(n->left.get(), rec) || eval(n->right.get(), rec);
+  case Node::AND:
+    return eval(n->left.get(), rec) && eval(n->right.get(), rec);
+  case Node::NOT:
+    return !eval(n->left.get(), rec);
+  case Node::IS_NULL:
+    return get_value(n->a, rec, &a) == n->negate;
+  case Node::LIKE:
+    if (!get_value(n->a, rec, &a)) {
+      return false;
+    }
+    return like(a.c_str(), n->b.value.c_str()) != n->negate;
+  case Node::CMP:
+    break;
+  }
+
+  /* comparisons with NULL are never true */
+  if (!get_value(n->a, rec, &a) || !get_value(n->b, rec, &b)) {
+    return false;
+  }
+  int c = compare(a, b);
+  switch (n->cmp) {
+  case Node::EQ: return c == 0;
+  case Node::NE: return c != 0;
+  case Node::LT: return c < 0;
+  case Node::LE: return c <= 0;
+  case Node::GT: return c > 0;
+  case Node::GE: return c >= 0;
+  }
+  return false;
+}
+
+class CSVRecord : public RGWSelectQuery::Record {
+  const vector<string>& fields;
+public:
+  explicit CSVRecord(const vector<string>& fields) : fields(fields) {}
+
+  bool get(const Operand& col, string *val) const override {
+    if (col.index < 0 || col.index >= (int)fields.size()) {
+      return false;
+    }
+    *val = fields[col.index];
+    return true;
+  }
+};
+
+class JSONRecord : public RGWSelectQuery::Record {
+  JSONObj *root;
+public:
+  explicit JSONRecord(JSONObj *root) : root(root) {}
+
+  bool get(const Operand& col, string *val) const override {
+    JSONObj *o = root;
+    for (auto& name : col.path) {
+      if (!o->is_object()) {
+        return false;
+      }
+      o = o->find_obj(name);
+      if (!o) {
+        return false;
+      }
+    }
+    *val = o->get_data();
+    return true;
+  }
+};
+
+void split_csv(const char *p, size_t len, const RGWSelectFormat& fmt,
+               vector<string>& fields)
+{
+  fields.clear();
+  string cur;
+  bool in_quote = false;
+  bool field_start = true;
+  for (size_t i = 0; i < len; ++i) {
+    char c = p[i];
+    if (in_quote) {
+      if (c != fmt.quote) {
+        cur.push_back(c);
+      } else if (i + 1 < len && p[i + 1] == fmt.quote) {
+        cur.push_back(c);
+        ++i;
+      } else {
+        in_quote = false;
+      }
+    } else if (c == fmt.quote && field_start) {
+      in_quote = true;
+    } else if (c == fmt.field_delim) {
+      fields.push_back(std::move(cur));
+      cur.clear();
+      field_start = true;
+      continue;
+    } else {
+      cur.push_back(c);
+    }
+    field_start = false;
+  }
+  fields.push_back(std::move(cur));
+}
+
+void append_json_string(bufferlist& out, const string& s)
+{
+  static const char hex[] = "0123456789abcdef";
+  out.append('"');
+  for (char c : s) {
+    switch (c) {
+    case '"': out.append("\\\"", 2); break;
+    case '\\': out.append("\\\\", 2); break;
+    case '\n': out.append("\\n", 2); break;
+    case '\r': out.append("\\r", 2); break;
+    case '\t': out.append("\\t", 2); break;
+    default:
+      if ((unsigned char)c < 0x20) {
+        char buf[6] = { '\\', 'u', '0', '0', hex[(c >> 4) & 0xf], hex[c & 0xf] };
+        out.append(buf, sizeof(buf));
+      } else {
+        out.append(c);
+      }
+    }
+  }
+  out.append('"');
+}
+
+string positional_name(size_t i)
+{
+  return "_" + std::to_string(i + 1);
+}
+
+} // anonymous namespace
+
+RGWSelectQuery::RGWSelectQuery() {}
+RGWSelectQuery::~RGWSelectQuery() {}
+
+int RGWSelectQuery::parse(const string& sql, string *err)
+{
+  vector<Token> tokens;
+  int r = tokenize(sql, tokens, err);
+  if (r < 0) {
+    return r;
+  }
+
+  Parser p(tokens, err);
+  if (!p.accept_kw("SELECT")) {
+    return p.fail("expected SELECT");
+  }
+  if (p.accept(T_STAR)) {
+    all_columns = true;
+  } else {
+    do {
+      Operand op;
+      r = p.parse_operand(op);
+      if (r < 0) {
+        return r;
+      }
+      projection.push_back(op);
+    } while (p.accept(T_COMMA));
+  }
+
+  if (!p.accept_kw("FROM")) {
+    return p.fail("expected FROM");
+  }
+  if (!p.accept_kw("S3Object")) {
+    return p.fail("expected S3Object");
+  }
+  string alias;
+  bool need_alias = p.accept_kw("AS");
+  if (p.peek().type == T_IDENT && p.peek().parts.size() == 1 &&
+      !p.is_kw("WHERE") && !p.is_kw("LIMIT")) {
+    alias = p.peek().text;
+    p.next();
+  } else if (need_alias) {
+    return p.fail("expected an alias after AS");
+  }
+
+  if (p.accept_kw("WHERE")) {
+    r = p.parse_or(where);
+    if (r < 0) {
+      return r;
+    }
+  }
+
+  if (p.accept_kw("LIMIT")) {
+    if (p.peek().type != T_NUMBER) {
+      return p.fail("LIMIT expects a number");
+    }
+    string serr;
+    limit = strict_strtoll(p.peek().text.c_str(), 10, &serr);
+    if (!serr.empty() || limit < 0) {
+      return p.fail("bad LIMIT");
+    }
+    p.next();
+  }
+
+  if (p.peek().type != T_END) {
+    return p.fail("unexpected trailing input");
+  }
+
+  columns.clear();
+  collect_columns(where.get(), columns);
+  for (auto& op : projection) {
+    if (op.is_column) {
+      columns.push_back(&op);
+    }
+  }
+  for (auto col : columns) {
+    auto& path = col->path;
+    if (path.size() > 1 &&
+        ((!alias.empty() && path[0] == alias) ||
+         strcasecmp(path[0].c_str(), "S3Object") == 0)) {
+      path.erase(path.begin());
+    }
+    if (path.size() == 1) {
+      col->index = positional_index(path[0]);
+    }
+    col->value = path.back();
+  }
+  return 0;
+}
+
+void RGWSelectQuery::bind_header(const vector<string>& names)
+{
+  for (auto col : columns) {
+    if (col->path.size() != 1 || positional_index(col->path[0]) >= 0) {
+      continue;
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (names[i] == col->path[0]) {
+        col->index = i;
+        break;
+      }
+    }
+  }
+}
+
+bool RGWSelectQuery::matches(const Record& rec) const
+{
+  return !where || eval(where.get(), rec);
+}
+
+void RGWGetObj_Select::write_record(const vector<string>& names,
+                                    const vector<string>& values,
+                                    bufferlist& out)
+{
+  if (out_fmt.type == RGWSelectFormat::JSON) {
+    out.append('{');
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (i > 0) {
+        out.append(',');
+      }
+      append_json_string(out, i < names.size() ? names[i] : positional_name(i));
+      out.append(':');
+      append_json_string(out, values[i]);
+    }
+    out.append('}');
+    out.append(out_fmt.record_delim);
+    return;
+  }
+
+  for (size_t i = 0; i < values.size(); ++i) {
+    const string& v = values[i];
+    if (i > 0) {
+      out.append(out_fmt.field_delim);
+    }
+    bool need_quote = false;
+    for (char c : v) {
+      if (c == out_fmt.field_delim || c == out_fmt.quote ||
+          c == out_fmt.record_delim || c == '\r' || c == '\n') {
+        need_quote = true;
+        break;
+      }
+    }
+    if (!need_quote) {
+      out.append(v);
+      continue;
+    }
+    out.append(out_fmt.quote);
+    for (char c : v) {
+      if (c == out_fmt.quote) {
+        out.append(c);
+      }
+      out.append(c);
+    }
+    out.append(out_fmt.quote);
+  }
+  out.append(out_fmt.record_delim);
+}
+
+int RGWGetObj_Select::process_record(const char *p, size_t len, bufferlist& out)
+{
+  if (len > 0 && in_fmt.record_delim == '\n' && p[len - 1] == '\r') {
+    --len;
+  }
+  if (len == 0) {
+    return 0;
+  }
+
+  vector<string> names;
+  vector<string> values;
+
+  if (in_fmt.type == RGWSelectFormat::CSV) {
+    vector<string> fields;
+    split_csv(p, len, in_fmt, fields);
+    if (!header_done) {
+      header_done = true;
+      if (in_fmt.header_info == RGWSelectFormat::HEADER_USE) {
+        query.bind_header(fields);
+        header_names.swap(fields);
+        return 0;
+      }
+      if (in_fmt.header_info == RGWSelectFormat::HEADER_IGNORE) {
+        return 0;
+      }
+    }
+
+    CSVRecord rec(fields);
+    if (!query.matches(rec)) {
+      return 0;
+    }
+    if (query.selects_all()) {
+      names = header_names;
+      values.swap(fields);
+    } else {
+      for (auto& col : query.get_projection()) {
+        string v;
+        get_value(col, rec, &v);
+        names.push_back(col.is_column ? col.value : positional_name(names.size()));
+        values.push_back(v);
+      }
+    }
+  } else {
+    JSONParser parser;
+    if (!parser.parse(p, len)) {
+      ldout(cct, 5) << "select: failed to parse json record: "
+                    << string(p, len) << dendl;
+      return -EINVAL;
+    }
+
+    JSONRecord rec(&parser);
+    if (!query.matches(rec)) {
+      return 0;
+    }
+    if (query.selects_all()) {
+      if (out_fmt.type == RGWSelectFormat::JSON) {
+        out.append(p, len);
+        out.append(out_fmt.record_delim);
+        ++num_returned;
+        return 0;
+      }
+      for (auto iter = parser.find_first(); !iter.end(); ++iter) {
+        names.push_back((*iter)->get_name());
+        values.push_back((*iter)->get_data());
+      }
+    } else {
+      for (auto& col : query.get_projection()) {
+        string v;
+        get_value(col, rec, &v);
+        names.push_back(col.is_column ? col.value : positional_name(names.size()));
+        values.push_back(v);
+      }
+    }
+  }
+
+  write_record(names, values, out);
+  ++num_returned;
+  return 0;
+}
+
+int RGWGetObj_Select::send(bufferlist& out)
+{
+  if (out.length() == 0) {
+    return 0;
+  }
+  bytes_returned += out.length();
+  return next->handle_data(out, 0, out.length());
+}
+
+const char *RGWGetObj_Select::find_record_end(const char *p, const char *end)
+{
+  if (in_fmt.type != RGWSelectFormat::CSV) {
+    return static_cast<const char *>(memchr(p, in_fmt.record_delim, end - p));
+  }
+
+  /* a record delimiter in a quoted field is part of the field */
+  for (; p < end; ++p) {
+    char c = *p;
+    if (in_quote) {
+      if (!quote_pending) {
+        quote_pending = (c == in_fmt.quote);
+        continue;
+      }
+      quote_pending = false;
+      if (c == in_fmt.quote) {
+        continue; /* an escaped quote */
+      }
+      in_quote = false;
+    }
+    if (c == in_fmt.record_delim) {
+      field_start = true;
+      return p;
+    }
+    if (c == in_fmt.field_delim) {
+      field_start = true;
+    } else {
+      in_quote = (c == in_fmt.quote && field_start);
+      field_start = false;
+    }
+  }
+  return nullptr;
+}
+
+int RGWGetObj_Select::handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len)
+{
+  if (done()) {
+    return -ECANCELED;
+  }
+  bytes_scanned += bl_len;
+
+  const char *data = bl.c_str() + bl_ofs;
+  const char *end = data + bl_len;
+  bufferlist out;
+
+  while (data < end && !done()) {
+    const char *delim = find_record_end(data, end);
+    if (!delim) {
+      break;
+    }
+    if (partial.size() + (delim - data) > max_record_size) {
+      ldout(cct, 5) << "select: record exceeds " << max_record_size << " bytes" << dendl;
+      return -ERR_OVER_MAX_RECORD_SIZE;
+    }
+    int r;
+    if (!partial.empty()) {
+      partial.append(data, delim - data);
+      r = process_record(partial.data(), partial.size(), out);
+      partial.clear();
+    } else {
+      r = process_record(data, delim - data, out);
+    }
+    if (r < 0) {
+      return r;
+    }
+    data = delim + 1;
+  }
+  if (!done()) {
+    if (partial.size() + (end - data) > max_record_size) {
+      ldout(cct, 5) << "select: record exceeds " << max_record_size << " bytes" << dendl;
+      return -ERR_OVER_MAX_RECORD_SIZE;
+    }
+    partial.append(data, end - data);
+  }
+
+  int r = send(out);
+  if (r < 0) {
+    return r;
+  }
+  /* stop the read, the rest of the object isn't needed */
+  return done() ? -ECANCELED : 0;
+}
+
+int RGWGetObj_Select::flush()
+{
+  if (!partial.empty() && !done()) {
+    bufferlist out;
+    int r = process_record(partial.data(), partial.size(), out);
+    partial.clear();
+    if (r < 0) {
+      return r;
+    }
+    r = send(out);
+    if (r < 0) {
+      return r;
+    }
+  }
+  return next->flush();
+}
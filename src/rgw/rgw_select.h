@@ -0,0 +1,142 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_SELECT_H
+#define CEPH_RGW_SELECT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rgw_op.h"
+
+/*
+ * A subset of the S3 Select SQL dialect, evaluated one record at a time:
+ *
+ *   SELECT * | column [, column ...] FROM S3Object [[AS] alias]
+ *     [WHERE condition] [LIMIT n]
+ *
+ * Columns are _1, _2, ... or, for csv with a header line and for json,
+ * field names; json fields may be nested (s.a.b).  Conditions combine
+ * =, !=, <>, <, <=, >, >=, LIKE, IS [NOT] NULL with AND, OR, NOT and
+ * parentheses.  Values compare as numbers when both sides are numbers,
+ * as strings otherwise.
+ */
+
+struct RGWSelectFormat {
+  enum Type {
+    CSV,
+    JSON,
+  } type = CSV;
+
+  /* csv only */
+  enum FileHeaderInfo {
+    HEADER_NONE,
+    HEADER_USE,
+    HEADER_IGNORE,
+  } header_info = HEADER_NONE;
+  char field_delim = ',';
+  char quote = '"';
+
+  char record_delim = '\n';
+};
+
+class RGWSelectQuery
+{
+public:
+  struct Operand {
+    bool is_column = false;
+    std::string value;            /* literal, or column name as written */
+    std::vector<std::string> path; /* json field path */
+    int index = -1;               /* csv field index */
+  };
+  struct Node;
+
+  /* the fields of one input record */
+  class Record {
+  public:
+    virtual ~Record() {}
+    /* returns false if the column is not in the record (NULL) */
+    virtual bool get(const Operand& col, std::string *val) const = 0;
+  };
+
+private:
+  bool all_columns = false;
+  std::vector<Operand> projection;
+  std::unique_ptr<Node> where;
+  int64_t limit = -1;
+  std::vector<Operand *> columns; /* every column reference in the query */
+
+public:
+  RGWSelectQuery();
+  ~RGWSelectQuery();
+
+  /* returns -EINVAL and a description of the problem in *err */
+  int parse(const std::string& sql, std::string *err);
+
+  /* resolves column names against a csv header line */
+  void bind_header(const std::vector<std::string>& names);
+
+  bool selects_all() const { return all_columns; }
+  const std::vector<Operand>& get_projection() const { return projection; }
+  int64_t get_limit() const { return limit; }
+
+  bool matches(const Record& rec) const;
+};
+
+/*
+ * Sits on the object data path and passes on only the selected records,
+ * in the output format.  Record boundaries don't follow the chunks the
+ * data arrives in, a trailing partial record is held until the next chunk
+ * or the flush.  A record longer than rgw_select_max_record_size fails the
+ * request.  Once LIMIT records went out, handle_data() returns -ECANCELED
+ * to stop the read and done() tells it from a failure.
+ */
+class RGWGetObj_Select : public RGWGetObj_Filter
+{
+  CephContext *cct;
+  RGWSelectQuery& query;
+  RGWSelectFormat in_fmt;
+  RGWSelectFormat out_fmt;
+  uint64_t max_record_size;
+  std::string partial;
+  bool header_done = false;
+  std::vector<std::string> header_names;
+  int64_t num_returned = 0;
+  uint64_t bytes_scanned = 0;
+  uint64_t bytes_returned = 0;
+
+  /* csv quoting state at the end of the data seen so far */
+  bool field_start = true;
+  bool in_quote = false;
+  bool quote_pending = false; /* a quote in a quoted field, or its end */
+
+  const char *find_record_end(const char *p, const char *end);
+  int process_record(const char *p, size_t len, bufferlist& out);
+  void write_record(const std::vector<std::string>& names,
+                    const std::vector<std::string>& values,
+                    bufferlist& out);
+  int send(bufferlist& out);
+public:
+  RGWGetObj_Select(CephContext *cct, RGWSelectQuery& query,
+                   const RGWSelectFormat& in_fmt,
+                   const RGWSelectFormat& out_fmt,
+                   RGWGetDataCB *next)
+    : RGWGetObj_Filter(next), cct(cct), query(query),
+      in_fmt(in_fmt), out_fmt(out_fmt),
+      max_record_size(cct->_conf->rgw_select_max_record_size) {}
+  ~RGWGetObj_Select() override {}
+
+  int handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len) override;
+  int flush() override;
+
+  /* all the records the query returns went out */
+  bool done() const {
+    return query.get_limit() >= 0 && num_returned >= query.get_limit();
+  }
+
+  uint64_t get_bytes_scanned() const { return bytes_scanned; }
+  uint64_t get_bytes_returned() const { return bytes_returned; }
+};
+
+#endif /* CEPH_RGW_SELECT_H */
@@ -0,0 +1,215 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <memory>
+
+#include "rgw_yield.h"
+
+namespace {
+
+void rados_yield_cb(librados::completion_t c, void *arg)
+{
+  std::unique_ptr<rgw_yield_cb_t> cb(static_cast<rgw_yield_cb_t*>(arg));
+  (*cb)(rados_aio_get_return_value(c));
+}
+
+template <typename Issue>
+int rados_yield_call(optional_yield y, Issue&& issue)
+{
+  return rgw_yield_call(y, [&] (rgw_yield_cb_t cb) {
+      auto arg = new rgw_yield_cb_t(std::move(cb));
+      librados::AioCompletion *c =
+        librados::Rados::aio_create_completion(arg, nullptr, rados_yield_cb);
+      int r = issue(c);
+      c->release();
+      if (r < 0) {
+        delete arg;
+      }
+      return r;
+    });
+}
+
+int sync_yield_call(const std::function<int(rgw_yield_cb_t)>& issue)
+{
+  C_SaferCond ctx;
+  int r = issue([&ctx] (int r) { ctx.complete(r); });
+  if (r < 0) {
+    return r;
+  }
+  return ctx.wait();
+}
+
+} // anonymous namespace
+
+#ifdef WITH_RADOSGW_BEAST_FRONTEND
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/handler_type.hpp>
+#include <boost/asio/detail/bind_handler.hpp>
+
+namespace {
+
+using op_handler_t = boost::asio::handler_type<boost::asio::yield_context,
+      void(boost::system::error_code, int)>::type;
+
+// Shared by the copies of the callback until the operation completes.  The
+// work object keeps the frontend's io_service from running out of work
+// while the op is in flight.
+struct AsyncOp {
+  op_handler_t handler;
+  boost::asio::io_service::work work;
+
+  AsyncOp(op_handler_t&& handler, boost::asio::io_service& service)
+    : handler(std::move(handler)), work(service) {}
+};
+
+} // anonymous namespace
+
+int rgw_yield_call(optional_yield y,
+                   const std::function<int(rgw_yield_cb_t)>& issue)
+{
+  if (!y) {
+    return sync_yield_call(issue);
+  }
+
+  op_handler_t handler(y.get_yield_context());
+  boost::asio::async_result<op_handler_t> result(handler);
+
+  auto op = std::make_shared<AsyncOp>(std::move(handler), y.get_io_service());
+  int r = issue([op] (int r) {
+      // resume the coroutine on one of the frontend threads; bind_handler
+      // keeps the coroutine's strand
+      op->work.get_io_service().post(
+          boost::asio::detail::bind_handler(std::move(op->handler),
+                                            boost::system::error_code(), r));
+    });
+  if (r < 0) {
+    return r;
+  }
+  return result.get();
+}
+
+int rgw_rados_operate(librados::IoCtx& ioctx, const std::string& oid,
+                      librados::ObjectReadOperation *op, bufferlist *pbl,
+                      optional_yield y)
+{
+  if (!y) {
+    return ioctx.operate(oid, op, pbl);
+  }
+  return rados_yield_call(y, [&] (librados::AioCompletion *c) {
+      return ioctx.aio_operate(oid, c, op, pbl);
+    });
+}
+
+int rgw_rados_operate(librados::IoCtx& ioctx, const std::string& oid,
+                      librados::ObjectWriteOperation *op, optional_yield y)
+{
+  if (!y) {
+    return ioctx.operate(oid, op);
+  }
+  return rados_yield_call(y, [&] (librados::AioCompletion *c) {
+      return ioctx.aio_operate(oid, c, op);
+    });
+}
+
+using resume_handler_t = boost::asio::handler_type<boost::asio::yield_context,
+      void(boost::system::error_code)>::type;
+
+struct RGWYieldWaiter::Resume {
+  resume_handler_t handler;
+  boost::asio::io_service::work work;
+
+  Resume(resume_handler_t&& handler, boost::asio::io_service& service)
+    : handler(std::move(handler)), work(service) {}
+};
+
+void RGWYieldWaiter::wait(optional_yield y)
+{
+  lock.Lock();
+  if (notified) {
+    notified = false;
+    lock.Unlock();
+    return;
+  }
+  if (!y) {
+    while (!notified) {
+      cond.Wait(lock);
+    }
+    notified = false;
+    lock.Unlock();
+    return;
+  }
+
+  resume_handler_t handler(y.get_yield_context());
+  boost::asio::async_result<resume_handler_t> result(handler);
+  assert(!resume);
+  resume = new Resume(std::move(handler), y.get_io_service());
+  lock.Unlock();
+
+  result.get();
+}
+
+void RGWYieldWaiter::notify()
+{
+  Mutex::Locker l(lock);
+  if (resume) {
+    std::unique_ptr<Resume> r(resume);
+    resume = nullptr;
+    r->work.get_io_service().post(
+        boost::asio::detail::bind_handler(std::move(r->handler),
+                                          boost::system::error_code()));
+    return;
+  }
+  notified = true;
+  cond.Signal();
+}
+
+#else
+
+int rgw_yield_call(optional_yield y,
+                   const std::function<int(rgw_yield_cb_t)>& issue)
+{
+  return sync_yield_call(issue);
+}
+
+int rgw_rados_operate(librados::IoCtx& ioctx, const std::string& oid,
+                      librados::ObjectReadOperation *op, bufferlist *pbl,
+                      optional_yield y)
+{
+  return ioctx.operate(oid, op, pbl);
+}
+
+int rgw_rados_operate(librados::IoCtx& ioctx, const std::string& oid,
+                      librados::ObjectWriteOperation *op, optional_yield y)
+{
+  return ioctx.operate(oid, op);
+}
+
+struct RGWYieldWaiter::Resume {};
+
+void RGWYieldWaiter::wait(optional_yield y)
+{
+  Mutex::Locker l(lock);
+  while (!notified) {
+    cond.Wait(lock);
+  }
+  notified = false;
+}
+
+void RGWYieldWaiter::notify()
+{
+  Mutex::Locker l(lock);
+  notified = true;
+  cond.Signal();
+}
+
+#endif
+
+RGWYieldWaiter::~RGWYieldWaiter()
+{
+  assert(!resume);
+}
+
+void RGWYieldWaiter::aio_cb(librados::completion_t c, void *arg)
+{
+  static_cast<RGWYieldWaiter*>(arg)->notify();
+}
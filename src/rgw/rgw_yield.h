@@ -0,0 +1,100 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_YIELD_H
+#define CEPH_RGW_YIELD_H
+
+#include <functional>
+#include <string>
+
+#include "acconfig.h"
+#include "include/rados/librados.hpp"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+
+#ifdef WITH_RADOSGW_BEAST_FRONTEND
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/spawn.hpp>
+
+/*
+ * The coroutine a request is running in, if any.  The beast frontend runs
+ * each connection as a boost::asio coroutine; rados calls made on behalf of
+ * its requests suspend the coroutine and give the frontend thread back to
+ * other connections instead of blocking it.  Requests from every other
+ * frontend carry an empty optional_yield and keep the blocking calls.
+ *
+ * Variables of this type are named 'y': rgw_boost_asio_yield.h defines
+ * 'yield' as a macro.
+ */
+class optional_yield {
+  boost::asio::io_service *io = nullptr;
+  boost::asio::yield_context *yc = nullptr;
+ public:
+  optional_yield() = default;
+  optional_yield(boost::asio::io_service& _io,
+                 boost::asio::yield_context& _yc)
+    : io(&_io), yc(&_yc) {}
+
+  explicit operator bool() const { return yc != nullptr; }
+
+  boost::asio::io_service& get_io_service() const { return *io; }
+  boost::asio::yield_context& get_yield_context() const { return *yc; }
+};
+
+#else
+
+class optional_yield {
+ public:
+  explicit operator bool() const { return false; }
+};
+
+#endif
+
+/*
+ * Starts an asynchronous operation with issue(), which is passed the
+ * callback to invoke once with the operation's result, and returns that
+ * result.  The calling coroutine is suspended until then if y is set;
+ * otherwise the calling thread blocks.  If issue() fails, it must not
+ * invoke the callback, and its error is returned right away.
+ */
+typedef std::function<void(int)> rgw_yield_cb_t;
+int rgw_yield_call(optional_yield y,
+                   const std::function<int(rgw_yield_cb_t)>& issue);
+
+/*
+ * IoCtx::operate() that suspends the calling coroutine rather than the
+ * thread when y is set.
+ */
+int rgw_rados_operate(librados::IoCtx& ioctx, const std::string& oid,
+                      librados::ObjectReadOperation *op, bufferlist *pbl,
+                      optional_yield y);
+int rgw_rados_operate(librados::IoCtx& ioctx, const std::string& oid,
+                      librados::ObjectWriteOperation *op, optional_yield y);
+
+/*
+ * Waits for a notify() from another thread, typically a librados completion
+ * callback.  A notify() with nobody waiting is remembered, so the waiter
+ * should check its condition first and then wait, in a loop.  Coroutines
+ * are suspended while they wait; other callers block on a condition
+ * variable.
+ */
+class RGWYieldWaiter {
+  Mutex lock;
+  Cond cond;
+  bool notified = false;
+
+  struct Resume;
+  Resume *resume = nullptr;
+
+public:
+  RGWYieldWaiter() : lock("RGWYieldWaiter") {}
+  ~RGWYieldWaiter();
+
+  void wait(optional_yield y);
+  void notify();
+
+  /* completion callback for aio issued on behalf of a waiter */
+  static void aio_cb(librados::completion_t c, void *arg);
+};
+
+#endif
@@ -25,6 +25,11 @@
     bucket rm                  remove bucket
     bucket check               check bucket index
     bucket reshard             reshard bucket
+    reshard add                schedule a bucket for resharding
+    reshard list               list buckets scheduled for resharding
+    reshard status             show the reshard state of a bucket
+    reshard process            process the reshard queue
+    reshard cancel             cancel resharding a bucket
     bi get                     retrieve bucket index object entries
     bi put                     store bucket index object entries
     bi list                    list raw bucket index entries
@@ -109,23 +109,26 @@
   rbd help bench
   usage: rbd bench [--pool <pool>] [--image <image>] [--io-size <io-size>] 
                    [--io-threads <io-threads>] [--io-total <io-total>] 
-                   [--io-pattern <io-pattern>] --io-type <io-type> 
+                   [--io-pattern <io-pattern>] 
+                   [--dispatch-threads <dispatch-threads>] --io-type <io-type> 
                    <image-spec> 
   
   Simple benchmark.
   
   Positional arguments
-    <image-spec>         image specification
-                         (example: [<pool-name>/]<image-name>)
+    <image-spec>            image specification
+                            (example: [<pool-name>/]<image-name>)
   
   Optional arguments
-    -p [ --pool ] arg    pool name
-    --image arg          image name
-    --io-size arg        IO size (in B/K/M/G/T) [default: 4K]
-    --io-threads arg     ios in flight [default: 16]
-    --io-total arg       total size for IO (in B/K/M/G/T) [default: 1G]
-    --io-pattern arg     IO pattern (rand or seq) [default: seq]
-    --io-type arg        IO type (read or write)
+    -p [ --pool ] arg       pool name
+    --image arg             image name
+    --io-size arg           IO size (in B/K/M/G/T) [default: 4K]
+    --io-threads arg        ios in flight [default: 16]
+    --io-total arg          total size for IO (in B/K/M/G/T) [default: 1G]
+    --io-pattern arg        IO pattern (rand or seq) [default: seq]
+    --dispatch-threads arg  comma-separated librbd IO dispatch thread counts to
+                            compare (e.g. 1,2,4)
+    --io-type arg           IO type (read or write)
   
   rbd help children
   usage: rbd children [--pool <pool>] [--image <image>] [--snap <snap>] 
@@ -937,13 +940,14 @@
   
   rbd help mirror image enable
   usage: rbd mirror image enable [--pool <pool>] [--image <image>] 
-                                 <image-spec> 
+                                 <image-spec> <mode> 
   
   Enable RBD mirroring for an image.
   
   Positional arguments
     <image-spec>         image specification
                          (example: [<pool-name>/]<image-name>)
+    <mode>               mirror image mode [journal or snapshot]
   
   Optional arguments
     -p [ --pool ] arg    pool name
@@ -153,6 +153,55 @@ TEST_F(TestClsRbd, copyup)
   ioctx.close();
 }
 
+TEST_F(TestClsRbd, sparse_copyup)
+{
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, _rados.ioctx_create(_pool_name.c_str(), ioctx));
+
+  string oid = get_temp_image_name();
+  ioctx.remove(oid);
+
+  // sparse copyup of no extents to nonexistent object should create new
+  // 0-len object
+  std::map<uint64_t, uint64_t> extent_map;
+  bufferlist inbl, outbl;
+  ASSERT_EQ(0, sparse_copyup(&ioctx, oid, extent_map, inbl));
+  uint64_t size;
+  ASSERT_EQ(0, ioctx.stat(oid, &size, NULL));
+  ASSERT_EQ(0U, size);
+
+  // create some data to write
+  inbl.append(std::string(4096, '1'));
+  inbl.append(std::string(4096, '2'));
+  extent_map = {{0, 4096}, {8192, 4096}};
+
+  // sparse copyup to nonexistent object should create new object
+  ASSERT_EQ(0, ioctx.remove(oid));
+  ASSERT_EQ(0, sparse_copyup(&ioctx, oid, extent_map, inbl));
+
+  // and its contents should match with zeroed holes
+  bufferlist expected_bl;
+  expected_bl.append(std::string(4096, '1'));
+  expected_bl.append_zero(4096);
+  expected_bl.append(std::string(4096, '2'));
+  ASSERT_EQ(12288, ioctx.read(oid, outbl, 12288, 0));
+  ASSERT_TRUE(outbl.contents_equal(expected_bl));
+
+  // sparse copyup with a preexisting object should not change it
+  bufferlist inbl2;
+  inbl2.append(std::string(4096, '3'));
+  ASSERT_EQ(0, sparse_copyup(&ioctx, oid, {{4096, 4096}}, inbl2));
+  outbl.clear();
+  ASSERT_EQ(12288, ioctx.read(oid, outbl, 12288, 0));
+  ASSERT_TRUE(outbl.contents_equal(expected_bl));
+
+  // extents exceeding the provided data are rejected
+  ASSERT_EQ(0, ioctx.remove(oid));
+  ASSERT_EQ(-EINVAL, sparse_copyup(&ioctx, oid, {{0, 8192}}, inbl2));
+
+  ioctx.close();
+}
+
 TEST_F(TestClsRbd, get_and_set_id)
 {
   librados::IoCtx ioctx;
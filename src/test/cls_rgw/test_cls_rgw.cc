@@ -373,6 +373,121 @@ TEST(cls_rgw, index_suggest)
   test_stats(ioctx, bucket_oid, 0, num_objs / 2, total_size);
 }
 
+TEST(cls_rgw, index_complete_batch)
+{
+  string bucket_oid = str_int("bucket", 4);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  uint64_t obj_size = 1024;
+
+  list<rgw_cls_obj_complete_op> ops;
+  for (int i = 0; i < NUM_OBJS; i++) {
+    string obj = str_int("obj", i);
+    string tag = str_int("tag", i);
+    string loc = str_int("loc", i);
+
+    index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, obj, loc);
+
+    rgw_cls_obj_complete_op call;
+    call.op = CLS_RGW_OP_ADD;
+    call.key = cls_rgw_obj_key(obj, string());
+    call.tag = tag;
+    call.ver.pool = ioctx.get_id();
+    call.ver.epoch = 1;
+    call.meta.category = 0;
+    call.meta.size = obj_size;
+    call.meta.accounted_size = obj_size;
+    call.log_op = true;
+    ops.push_back(call);
+  }
+
+  /* an op on a tag that was never prepared is skipped, the rest apply */
+  rgw_cls_obj_complete_op bad = ops.back();
+  bad.key = cls_rgw_obj_key("obj-unprepared", string());
+  bad.tag = "tag-unprepared";
+  ops.push_back(bad);
+
+  op = mgr.write_op();
+  cls_rgw_bucket_complete_ops(*op, ops);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  test_stats(ioctx, bucket_oid, 0, NUM_OBJS, obj_size * NUM_OBJS);
+
+  /* two ops on the same key can't go in one batch */
+  list<rgw_cls_obj_complete_op> dup_ops;
+  dup_ops.push_back(ops.front());
+  dup_ops.push_back(ops.front());
+  op = mgr.write_op();
+  cls_rgw_bucket_complete_ops(*op, dup_ops);
+  ASSERT_EQ(-EINVAL, ioctx.operate(bucket_oid, op));
+}
+
+TEST(cls_rgw, index_resharding)
+{
+  string bucket_oid = str_int("bucket", 5);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  /* while the index is copied every update is logged, even unrequested */
+  op = mgr.write_op();
+  cls_rgw_bucket_set_resharding(*op, CLS_RGW_RESHARD_IN_LOGRECORD);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  string obj = "obj";
+  string tag = "tag";
+  cls_rgw_obj_key key(obj, string());
+  op = mgr.write_op();
+  cls_rgw_bucket_prepare_op(*op, CLS_RGW_OP_ADD, tag, key, string(), false, 0);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  map<int, string> oids;
+  oids[0] = bucket_oid;
+  BucketIndexShardsManager marker_mgr;
+  map<int, struct cls_rgw_bi_log_list_ret> logs;
+  ASSERT_EQ(0, CLSRGWIssueBILogList(ioctx, marker_mgr, 100, oids, logs, 8)());
+  ASSERT_EQ(1u, logs[0].entries.size());
+
+  /* the final catch-up refuses updates, including pending completions */
+  op = mgr.write_op();
+  cls_rgw_bucket_set_resharding(*op, CLS_RGW_RESHARD_IN_PROGRESS);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  rgw_bucket_entry_ver ver;
+  ver.pool = ioctx.get_id();
+  ver.epoch = 1;
+  rgw_bucket_dir_entry_meta meta;
+  op = mgr.write_op();
+  cls_rgw_bucket_complete_op(*op, CLS_RGW_OP_ADD, tag, ver, key, meta, NULL, false, 0);
+  ASSERT_EQ(-CLS_RGW_ERR_BUSY_RESHARDING, ioctx.operate(bucket_oid, op));
+
+  op = mgr.write_op();
+  cls_rgw_bucket_prepare_op(*op, CLS_RGW_OP_ADD, tag, key, string(), false, 0);
+  ASSERT_EQ(-CLS_RGW_ERR_BUSY_RESHARDING, ioctx.operate(bucket_oid, op));
+
+  logs.clear();
+  ASSERT_EQ(0, CLSRGWIssueBILogList(ioctx, marker_mgr, 100, oids, logs, 8)());
+  ASSERT_EQ(1u, logs[0].entries.size());
+
+  /* a cancelled reshard lets them through again */
+  op = mgr.write_op();
+  cls_rgw_bucket_set_resharding(*op, CLS_RGW_RESHARD_NONE);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  op = mgr.write_op();
+  cls_rgw_bucket_complete_op(*op, CLS_RGW_OP_ADD, tag, ver, key, meta, NULL, false, 0);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+  test_stats(ioctx, bucket_oid, 0, 1, 0);
+}
+
 /* test garbage collection */
 static void create_obj(cls_rgw_obj& obj, int i, int j)
 {
@@ -468,6 +583,44 @@ TEST(cls_rgw, gc_set)
   }
 }
 
+TEST(cls_rgw, gc_list_next_marker)
+{
+  string oid = "gc_marker_obj";
+  for (int i = 0; i < 10; i++) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "chain-%d", i);
+    librados::ObjectWriteOperation op;
+    cls_rgw_gc_obj_info info;
+
+    op.create(false);
+
+    info.tag = buf;
+    cls_rgw_gc_set_entry(op, 0, info);
+
+    ASSERT_EQ(0, ioctx.operate(oid, &op));
+  }
+
+  /* page through the chains without removing them */
+  bool truncated;
+  string marker;
+  int i = 0;
+  do {
+    list<cls_rgw_gc_obj_info> entries;
+    string next_marker;
+    ASSERT_EQ(0, cls_rgw_gc_list(ioctx, oid, marker, 3, true, entries, &truncated,
+                                 &next_marker));
+    ASSERT_FALSE(next_marker.empty());
+    for (auto& entry : entries) {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "chain-%d", i++);
+      ASSERT_EQ(string(buf), entry.tag);
+    }
+    marker = next_marker;
+  } while (truncated);
+
+  ASSERT_EQ(10, i);
+}
+
 TEST(cls_rgw, gc_defer)
 {
   librados::IoCtx ioctx;
@@ -128,3 +128,57 @@ TEST(Readahead, alignment) {
   ASSERT_RA(1400, 300, r.update(1290, 10, Readahead::NO_LIMIT)); // internal readahead size 320
   ASSERT_RA(0, 0, r.update(1300, 10, Readahead::NO_LIMIT));
 }
+
+TEST(Readahead, multiple_streams) {
+  Readahead r;
+  r.set_trigger_requests(2);
+  r.set_max_streams(2);
+  ASSERT_RA(0, 0, r.update(1000, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(5000, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(1010, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(5010, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(1030, 20, r.update(1020, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(5030, 20, r.update(5020, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(1050, 40, r.update(1030, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(5050, 40, r.update(5030, 10, Readahead::NO_LIMIT));
+  ASSERT_EQ(20u, r.get_hit_bytes());
+  ASSERT_EQ(0u, r.get_wasted_bytes());
+}
+
+TEST(Readahead, single_stream) {
+  Readahead r;
+  r.set_trigger_requests(2);
+  ASSERT_RA(0, 0, r.update(1000, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(5000, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(1010, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(5010, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(1020, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(5020, 10, Readahead::NO_LIMIT));
+}
+
+TEST(Readahead, wasted_readahead_shrinks_window) {
+  Readahead r;
+  r.set_trigger_requests(2);
+  r.set_max_readahead_size(32768);
+
+  uint64_t offset = 1 << 20;
+  ASSERT_RA(0, 0, r.update(offset, 16384, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(offset + 16384, 16384, Readahead::NO_LIMIT));
+  ASSERT_RA(offset + 49152, 32768,
+            r.update(offset + 32768, 16384, Readahead::NO_LIMIT));
+
+  // the stream is abandoned before its readahead was consumed
+  ASSERT_RA(0, 0, r.update(0, 4096, Readahead::NO_LIMIT));
+  ASSERT_EQ(32768u, r.get_wasted_bytes());
+
+  offset = 2 << 20;
+  ASSERT_RA(0, 0, r.update(offset, 16384, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(offset + 16384, 16384, Readahead::NO_LIMIT));
+  ASSERT_RA(offset + 49152, 16384,
+            r.update(offset + 32768, 16384, Readahead::NO_LIMIT));
+
+  // consuming the readahead grows the window back
+  ASSERT_RA(offset + 65536, 32768,
+            r.update(offset + 49152, 16384, Readahead::NO_LIMIT));
+  ASSERT_EQ(16384u, r.get_hit_bytes());
+}
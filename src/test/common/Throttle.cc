@@ -169,6 +169,42 @@ TEST_F(ThrottleTest, get_or_fail) {
   }
 }
 
+TEST_F(ThrottleTest, concurrent) {
+  // mix lockless (get_or_fail/put) and blocking (get) callers: the
+  // count must stay balanced, never exceed max and no blocked getter may
+  // miss its wakeup.  a single slot makes getters race for the last slot
+  int64_t throttle_max = 1;
+  Throttle throttle(g_ceph_context, "throttle", throttle_max);
+
+  std::atomic<int64_t> in_flight(0);
+  std::atomic<bool> over_max(false);
+  std::list<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&throttle, &in_flight, &over_max, throttle_max, i]() {
+        for (int j = 0; j < 10000; ++j) {
+          if (i % 2 == 0) {
+            if (!throttle.get_or_fail(1)) {
+              continue;
+            }
+          } else {
+            throttle.get(1);
+          }
+          if (++in_flight > throttle_max) {
+            over_max = true;
+          }
+          --in_flight;
+          throttle.put(1);
+        }
+      });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  ASSERT_FALSE(over_max);
+  ASSERT_EQ(throttle.get_current(), 0);
+}
+
 TEST_F(ThrottleTest, wait) {
   int64_t throttle_max = 10;
   Throttle throttle(g_ceph_context, "throttle");
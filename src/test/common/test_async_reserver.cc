@@ -0,0 +1,86 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "gtest/gtest.h"
+#include "common/AsyncReserver.h"
+#include "global/global_context.h"
+
+struct C_Note : public Context {
+  int *count;
+  explicit C_Note(int *c) : count(c) {}
+  void finish(int r) override {
+    ++*count;
+  }
+};
+
+class AsyncReserverTest : public ::testing::Test {
+public:
+  Finisher finisher;
+  AsyncReserver<int> reserver;
+
+  AsyncReserverTest()
+    : finisher(g_ceph_context),
+      reserver(&finisher, 1) {}
+
+  void SetUp() override {
+    finisher.start();
+  }
+  void TearDown() override {
+    finisher.wait_for_empty();
+    finisher.stop();
+  }
+};
+
+TEST_F(AsyncReserverTest, GrantInPriorityOrder) {
+  int granted[3] = {0, 0, 0};
+  reserver.request_reservation(0, new C_Note(&granted[0]), 10);
+  reserver.request_reservation(1, new C_Note(&granted[1]), 10);
+  reserver.request_reservation(2, new C_Note(&granted[2]), 20);
+  finisher.wait_for_empty();
+  ASSERT_EQ(1, granted[0]);
+  ASSERT_EQ(0, granted[1]);
+  ASSERT_EQ(0, granted[2]);
+
+  // not preemptible, so the higher priority request waits its turn
+  reserver.cancel_reservation(0);
+  finisher.wait_for_empty();
+  ASSERT_EQ(0, granted[1]);
+  ASSERT_EQ(1, granted[2]);
+
+  reserver.cancel_reservation(2);
+  finisher.wait_for_empty();
+  ASSERT_EQ(1, granted[1]);
+  reserver.cancel_reservation(1);
+}
+
+TEST_F(AsyncReserverTest, Preempt) {
+  int granted[3] = {0, 0, 0};
+  int preempted[3] = {0, 0, 0};
+  reserver.request_reservation(0, new C_Note(&granted[0]), 10,
+			       new C_Note(&preempted[0]));
+  finisher.wait_for_empty();
+  ASSERT_EQ(1, granted[0]);
+
+  // same priority does not preempt
+  reserver.request_reservation(1, new C_Note(&granted[1]), 10,
+			       new C_Note(&preempted[1]));
+  finisher.wait_for_empty();
+  ASSERT_EQ(0, granted[1]);
+  ASSERT_EQ(0, preempted[0]);
+
+  // higher priority does
+  reserver.request_reservation(2, new C_Note(&granted[2]), 20);
+  finisher.wait_for_empty();
+  ASSERT_EQ(1, preempted[0]);
+  ASSERT_EQ(1, granted[2]);
+  ASSERT_EQ(0, granted[1]);
+
+  // the preempted item no longer holds a slot
+  reserver.cancel_reservation(0);
+  reserver.cancel_reservation(2);
+  finisher.wait_for_empty();
+  ASSERT_EQ(1, granted[1]);
+  reserver.cancel_reservation(1);
+  finisher.wait_for_empty();
+  ASSERT_EQ(0, preempted[1]);
+}
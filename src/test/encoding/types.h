@@ -68,6 +68,7 @@ TYPE_FEATUREFUL(pool_stat_t)
 TYPE(pg_history_t)
 TYPE(pg_info_t)
 TYPE_FEATUREFUL(pg_query_t)
+TYPE(object_dirty_regions_t)
 TYPE(pg_log_entry_t)
 TYPE(pg_log_t)
 TYPE(pg_missing_item)
@@ -312,6 +313,7 @@ TYPE(rgw_bucket_olh_log_entry)
 #include "cls/rgw/cls_rgw_ops.h"
 TYPE(rgw_cls_obj_prepare_op)
 TYPE(rgw_cls_obj_complete_op)
+TYPE(rgw_cls_obj_complete_batch_op)
 TYPE(rgw_cls_list_op)
 TYPE(rgw_cls_list_ret)
 TYPE(cls_rgw_gc_defer_entry_op)
@@ -323,6 +325,7 @@ TYPE(cls_rgw_gc_set_entry_op)
 TYPE(cls_rgw_obj)
 TYPE(cls_rgw_obj_chain)
 TYPE(rgw_cls_tag_timeout_op)
+TYPE(rgw_cls_set_bucket_resharding_op)
 TYPE(cls_rgw_bi_log_list_op)
 TYPE(cls_rgw_bi_log_trim_op)
 TYPE(cls_rgw_bi_log_list_ret)
@@ -370,6 +373,9 @@ TYPE(rgw_obj)
 #include "rgw/rgw_log.h"
 TYPE(rgw_log_entry)
 
+#include "rgw/rgw_reshard.h"
+TYPE(rgw_reshard_entry)
+
 #ifdef WITH_RBD
 #include "cls/rbd/cls_rbd.h"
 TYPE(cls_rbd_parent)
@@ -122,8 +122,9 @@ struct MockJournaler {
   MOCK_METHOD0(stop_replay, void());
   MOCK_METHOD1(stop_replay, void(Context *on_finish));
 
-  MOCK_METHOD3(start_append, void(int flush_interval, uint64_t flush_bytes,
-                                  double flush_age));
+  MOCK_METHOD4(start_append, void(int flush_interval, uint64_t flush_bytes,
+                                  double flush_age,
+                                  uint64_t max_in_flight_appends));
   MOCK_CONST_METHOD0(get_max_append_size, uint64_t());
   MOCK_METHOD2(append, MockFutureProxy(uint64_t tag_id,
                                        const bufferlist &bl));
@@ -254,9 +255,11 @@ struct MockJournalerProxy {
     MockJournaler::get_instance().stop_replay(on_finish);
   }
 
-  void start_append(int flush_interval, uint64_t flush_bytes, double flush_age) {
+  void start_append(int flush_interval, uint64_t flush_bytes, double flush_age,
+                    uint64_t max_in_flight_appends) {
     MockJournaler::get_instance().start_append(flush_interval, flush_bytes,
-                                               flush_age);
+                                               flush_age,
+                                               max_in_flight_appends);
   }
 
   uint64_t get_max_append_size() const {
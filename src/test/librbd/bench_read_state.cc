@@ -0,0 +1,149 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Compares the synchronization cost of dispatching a single-object read
+ * using the image locks against using the lock-free image read state.
+ *
+ * usage: ceph_bench_librbd_read_state <threads> <ops per thread>
+ */
+
+#include "include/types.h"
+#include "common/ceph_argparse.h"
+#include "common/RWLock.h"
+#include "common/Thread.h"
+#include "global/global_init.h"
+#include "librbd/PublishedState.h"
+#include "librbd/io/Types.h"
+#include <time.h>
+#include <iostream>
+
+namespace {
+
+RWLock owner_lock("owner_lock");
+RWLock snap_lock("snap_lock");
+RWLock parent_lock("parent_lock");
+librbd::PublishedState<librbd::io::ImageReadState> read_state;
+
+uint64_t sink = 0;
+
+struct LockedReader : public Thread {
+  uint64_t ops;
+  explicit LockedReader(uint64_t ops) : ops(ops) {
+  }
+
+  void *entry() override {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < ops; ++i) {
+      RWLock::RLocker owner_locker(owner_lock);
+      {
+        // clip request
+        RWLock::RLocker snap_locker(snap_lock);
+        sum += i;
+      }
+      {
+        // map image extents to object extents
+        RWLock::RLocker snap_locker(snap_lock);
+        sum += i;
+      }
+      {
+        // object request parent extents
+        RWLock::RLocker snap_locker(snap_lock);
+        RWLock::RLocker parent_locker(parent_lock);
+        sum += i;
+      }
+      {
+        // object read guard
+        RWLock::RLocker snap_locker(snap_lock);
+        RWLock::RLocker parent_locker(parent_lock);
+        sum += i;
+      }
+      {
+        // object map check
+        RWLock::RLocker snap_locker(snap_lock);
+        sum += i;
+      }
+    }
+    __sync_fetch_and_add(&sink, sum);
+    return nullptr;
+  }
+};
+
+struct LockFreeReader : public Thread {
+  uint64_t ops;
+  explicit LockFreeReader(uint64_t ops) : ops(ops) {
+  }
+
+  void *entry() override {
+    uint64_t sum = 0;
+    librbd::PublishedState<librbd::io::ImageReadState>::Ref ref;
+    for (uint64_t i = 0; i < ops; ++i) {
+      RWLock::RLocker owner_locker(owner_lock);
+      read_state.pin(&ref);
+      sum += ref->size + i;
+      ref.reset();
+    }
+    __sync_fetch_and_add(&sink, sum);
+    return nullptr;
+  }
+};
+
+double get_time(clockid_t clock_id) {
+  struct timespec ts;
+  clock_gettime(clock_id, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+template <typename ReaderT>
+void run(const char *name, int threads, uint64_t ops) {
+  double start = get_time(CLOCK_MONOTONIC);
+  double cpu_start = get_time(CLOCK_PROCESS_CPUTIME_ID);
+
+  std::list<ReaderT*> readers;
+  for (int i = 0; i < threads; ++i) {
+    ReaderT *reader = new ReaderT(ops);
+    reader->create("reader");
+    readers.push_back(reader);
+  }
+  for (auto reader : readers) {
+    reader->join();
+    delete reader;
+  }
+
+  double elapsed = get_time(CLOCK_MONOTONIC) - start;
+  double cpu = get_time(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+  double total_ops = static_cast<double>(threads) * ops;
+  printf("%-10s  %12.0lf  %10.1lf  %10.1lf\n", name, total_ops / elapsed,
+         elapsed * 1000000000.0 / total_ops, cpu * 1000000000.0 / total_ops);
+}
+
+} // anonymous namespace
+
+int main(int argc, const char **argv)
+{
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " <threads> <ops per thread>"
+              << std::endl;
+    return 1;
+  }
+  int threads = atoi(argv[1]);
+  uint64_t ops = strtoull(argv[2], nullptr, 10);
+
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY, 0);
+
+  librbd::io::ImageReadState state;
+  state.size = 1ULL << 30;
+  read_state.publish(std::move(state));
+
+  std::cout << threads << " threads, " << ops << " ops per thread"
+            << std::endl;
+  printf("%-10s  %12s  %10s  %10s\n", "MODE", "OPS/SEC", "NS/OP", "CPU NS/OP");
+  run<LockedReader>("locked", threads, ops);
+  run<LockFreeReader>("lock-free", threads, ops);
+  return 0;
+}
@@ -0,0 +1,480 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "test/librbd/test_mock_fixture.h"
+#include "test/librbd/test_support.h"
+#include "test/librbd/mock/MockImageCtx.h"
+#include "include/stringify.h"
+#include "cls/rbd/cls_rbd_client.h"
+#include "common/ceph_json.h"
+#include "common/hostname.h"
+#include "common/Mutex.h"
+#include "librbd/cache/WriteLogImageCache.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <list>
+#include <unistd.h>
+
+namespace librbd {
+namespace {
+
+struct MockTestImageCtx : public MockImageCtx {
+  MockTestImageCtx(ImageCtx &image_ctx) : MockImageCtx(image_ctx) {
+  }
+};
+
+} // anonymous namespace
+
+namespace cache {
+
+/// image contents behind the cache, kept across cache instances
+struct MockImage {
+  typedef std::vector<std::pair<uint64_t,uint64_t> > Extents;
+
+  struct Write {
+    Extents image_extents;
+    bufferlist bl;
+    Context *on_finish;
+  };
+
+  Mutex lock;
+  std::string data;
+  std::list<Extents> written;  ///< written back, in order of completion
+  bool hold = false;
+  std::list<Write> held;
+
+  MockImage() : lock("MockImage::lock"), data(8 << 20, '\0') {
+  }
+
+  void apply(const Extents &image_extents, bufferlist &bl) {
+    uint64_t offset = 0;
+    for (auto &image_extent : image_extents) {
+      data.replace(image_extent.first, image_extent.second,
+                   bl.c_str() + offset, image_extent.second);
+      offset += image_extent.second;
+    }
+    written.push_back(image_extents);
+  }
+
+  /// complete the held write backs, applying them unless they fail
+  void release(int r) {
+    std::list<Write> writes;
+    {
+      Mutex::Locker locker(lock);
+      hold = false;
+      std::swap(writes, held);
+      if (r == 0) {
+        for (auto &write : writes) {
+          apply(write.image_extents, write.bl);
+        }
+      }
+    }
+    for (auto &write : writes) {
+      write.on_finish->complete(r);
+    }
+  }
+};
+
+template <>
+struct ImageWriteback<librbd::MockTestImageCtx> {
+  typedef MockImage::Extents Extents;
+
+  static MockImage *s_image;
+
+  ImageWriteback(librbd::MockTestImageCtx &image_ctx) {
+  }
+
+  void aio_read(Extents &&image_extents, bufferlist *bl, int fadvise_flags,
+                Context *on_finish) {
+    {
+      Mutex::Locker locker(s_image->lock);
+      bl->clear();
+      for (auto &image_extent : image_extents) {
+        bl->append(s_image->data.substr(image_extent.first,
+                                        image_extent.second));
+      }
+    }
+    on_finish->complete(0);
+  }
+
+  void aio_write(Extents &&image_extents, bufferlist &&bl, int fadvise_flags,
+                 Context *on_finish) {
+    {
+      Mutex::Locker locker(s_image->lock);
+      if (s_image->hold) {
+        s_image->held.push_back({image_extents, bl, on_finish});
+        return;
+      }
+      s_image->apply(image_extents, bl);
+    }
+    on_finish->complete(0);
+  }
+
+  void aio_discard(uint64_t offset, uint64_t length,
+                   bool skip_partial_discard, Context *on_finish) {
+    {
+      Mutex::Locker locker(s_image->lock);
+      s_image->data.replace(offset, length, length, '\0');
+    }
+    on_finish->complete(0);
+  }
+
+  void aio_flush(Context *on_finish) {
+    on_finish->complete(0);
+  }
+
+  void aio_writesame(uint64_t offset, uint64_t length, bufferlist &&bl,
+                     int fadvise_flags, Context *on_finish) {
+    on_finish->complete(0);
+  }
+};
+
+MockImage *ImageWriteback<librbd::MockTestImageCtx>::s_image = nullptr;
+
+} // namespace cache
+} // namespace librbd
+
+// template definitions
+#include "librbd/cache/WriteLogImageCache.cc"
+template class librbd::cache::WriteLogImageCache<librbd::MockTestImageCtx>;
+
+namespace librbd {
+namespace cache {
+
+using ::testing::_;
+using ::testing::Return;
+
+class TestMockCacheWriteLogImageCache : public TestMockFixture {
+public:
+  typedef WriteLogImageCache<librbd::MockTestImageCtx> MockWriteLogImageCache;
+
+  // the smallest log: room for three 300K writes before it wraps
+  static const uint64_t LOG_SIZE = 2 * 4096 + (1 << 20);
+  static const uint64_t WRITE_SIZE = 300 << 10;
+
+  MockImage mock_image;
+
+  void SetUp() override {
+    TestMockFixture::SetUp();
+    ImageWriteback<librbd::MockTestImageCtx>::s_image = &mock_image;
+  }
+
+  void TearDown() override {
+    for (auto &path : m_log_paths) {
+      ::unlink(path.c_str());
+    }
+    ImageWriteback<librbd::MockTestImageCtx>::s_image = nullptr;
+    TestMockFixture::TearDown();
+  }
+
+  void init_image_ctx(librbd::ImageCtx *ictx,
+                      MockTestImageCtx &mock_image_ctx) {
+    mock_image_ctx.persistent_cache_path = ".";
+    mock_image_ctx.persistent_cache_size = LOG_SIZE;
+    mock_image_ctx.persistent_cache_max_destage = 16;
+    mock_image_ctx.object_cacher = nullptr;
+    m_log_paths.push_back("./rbd-wlog." + stringify(ictx->data_ctx.get_id()) +
+                          "." + ictx->id);
+
+    expect_op_work_queue(mock_image_ctx);
+    EXPECT_CALL(mock_image_ctx, test_features(RBD_FEATURE_JOURNALING, _))
+      .WillRepeatedly(Return(false));
+  }
+
+  int init(MockWriteLogImageCache &cache) {
+    C_SaferCond ctx;
+    cache.init(&ctx);
+    return ctx.wait();
+  }
+
+  int shut_down(MockWriteLogImageCache &cache) {
+    C_SaferCond ctx;
+    cache.shut_down(&ctx);
+    return ctx.wait();
+  }
+
+  int flush(MockWriteLogImageCache &cache) {
+    C_SaferCond ctx;
+    cache.flush(&ctx);
+    return ctx.wait();
+  }
+
+  int write(MockWriteLogImageCache &cache, uint64_t offset,
+            const std::string &data) {
+    bufferlist bl;
+    bl.append(data);
+    C_SaferCond ctx;
+    cache.aio_write({{offset, data.size()}}, std::move(bl), 0, &ctx);
+    return ctx.wait();
+  }
+
+  std::string read(MockWriteLogImageCache &cache, uint64_t offset,
+                   uint64_t length) {
+    bufferlist bl;
+    C_SaferCond ctx;
+    cache.aio_read({{offset, length}}, &bl, 0, &ctx);
+    EXPECT_EQ(0, ctx.wait());
+    return bl.to_str();
+  }
+
+  /// drop the cache without writing it back, as a crashed client would
+  void crash(librbd::ImageCtx *ictx, MockWriteLogImageCache *cache) {
+    mock_image.release(-EIO);
+    ictx->op_work_queue->drain();
+    delete cache;
+  }
+
+  int get_state(librbd::ImageCtx *ictx, std::string *host, bool *dirty) {
+    std::string value;
+    int r = cls_client::metadata_get(&ictx->md_ctx, ictx->header_oid,
+                                     ".rbd_persistent_cache_state", &value);
+    if (r < 0) {
+      return r;
+    }
+
+    JSONParser p;
+    if (!p.parse(value.c_str(), value.length())) {
+      return -EBADMSG;
+    }
+    JSONDecoder::decode_json("host", *host, &p);
+    JSONDecoder::decode_json("dirty", *dirty, &p);
+    return 0;
+  }
+
+  int set_state(librbd::ImageCtx *ictx, const std::string &host) {
+    std::map<std::string, bufferlist> data;
+    data[".rbd_persistent_cache_state"].append(
+      "{\"host\":\"" + host + "\",\"path\":\"" + m_log_paths.back() + "\","
+      "\"generation\":1,\"dirty\":true}");
+    return cls_client::metadata_set(&ictx->md_ctx, ictx->header_oid, data);
+  }
+
+  std::list<MockImage::Extents> get_written() {
+    Mutex::Locker locker(mock_image.lock);
+    return mock_image.written;
+  }
+
+  std::string get_data(uint64_t offset, uint64_t length) {
+    Mutex::Locker locker(mock_image.lock);
+    return mock_image.data.substr(offset, length);
+  }
+
+private:
+  std::list<std::string> m_log_paths;
+};
+
+TEST_F(TestMockCacheWriteLogImageCache, InitShutDown) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(ictx, mock_image_ctx);
+
+  MockWriteLogImageCache cache(mock_image_ctx);
+  ASSERT_EQ(0, init(cache));
+
+  std::string host;
+  bool dirty = false;
+  ASSERT_EQ(0, get_state(ictx, &host, &dirty));
+  ASSERT_EQ(ceph_get_hostname(), host);
+  ASSERT_TRUE(dirty);
+
+  ASSERT_EQ(0, write(cache, 0, std::string(4096, '1')));
+  ASSERT_EQ(0, shut_down(cache));
+  ASSERT_EQ(std::string(4096, '1'), get_data(0, 4096));
+
+  ASSERT_EQ(0, get_state(ictx, &host, &dirty));
+  ASSERT_FALSE(dirty);
+}
+
+TEST_F(TestMockCacheWriteLogImageCache, DestageOrder) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(ictx, mock_image_ctx);
+
+  MockWriteLogImageCache cache(mock_image_ctx);
+  ASSERT_EQ(0, init(cache));
+
+  mock_image.hold = true;
+  ASSERT_EQ(0, write(cache, 0, std::string(8192, '1')));
+  ASSERT_EQ(0, write(cache, 4096, std::string(8192, '2')));
+  ASSERT_EQ(0, write(cache, 65536, std::string(4096, '3')));
+
+  // logged writes are read back before they reach the image
+  ASSERT_EQ(std::string(4096, '1') + std::string(8192, '2'),
+            read(cache, 0, 12288));
+  ASSERT_EQ(std::string(4096, '\0') + std::string(4096, '3'),
+            read(cache, 61440, 8192));
+  ASSERT_EQ(std::string(12288, '\0'), get_data(0, 12288));
+
+  // the overlapping write and everything logged after it wait for the
+  // first write back
+  {
+    Mutex::Locker locker(mock_image.lock);
+    ASSERT_EQ(1U, mock_image.held.size());
+  }
+
+  C_SaferCond flush_ctx;
+  cache.flush(&flush_ctx);
+  mock_image.release(0);
+  ASSERT_EQ(0, flush_ctx.wait());
+
+  std::list<MockImage::Extents> expected = {
+    {{0, 8192}}, {{4096, 8192}}, {{65536, 4096}}};
+  ASSERT_EQ(expected, get_written());
+  ASSERT_EQ(std::string(4096, '1') + std::string(8192, '2'),
+            get_data(0, 12288));
+  ASSERT_EQ(std::string(4096, '3'), get_data(65536, 4096));
+
+  ASSERT_EQ(0, shut_down(cache));
+}
+
+TEST_F(TestMockCacheWriteLogImageCache, Replay) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(ictx, mock_image_ctx);
+
+  auto cache = new MockWriteLogImageCache(mock_image_ctx);
+  ASSERT_EQ(0, init(*cache));
+
+  mock_image.hold = true;
+  ASSERT_EQ(0, write(*cache, 0, std::string(4096, '1')));
+  ASSERT_EQ(0, write(*cache, 0, std::string(2048, '2')));
+  ASSERT_EQ(0, write(*cache, 8192, std::string(4096, '3')));
+  crash(ictx, cache);
+  ASSERT_EQ(std::string(12288, '\0'), get_data(0, 12288));
+
+  std::string host;
+  bool dirty = false;
+  ASSERT_EQ(0, get_state(ictx, &host, &dirty));
+  ASSERT_TRUE(dirty);
+
+  // the replayed writes are served from the log until written back
+  mock_image.hold = true;
+  MockWriteLogImageCache replay_cache(mock_image_ctx);
+  ASSERT_EQ(0, init(replay_cache));
+  ASSERT_EQ(std::string(2048, '2') + std::string(2048, '1') +
+              std::string(4096, '\0') + std::string(4096, '3'),
+            read(replay_cache, 0, 12288));
+
+  C_SaferCond flush_ctx;
+  replay_cache.flush(&flush_ctx);
+  mock_image.release(0);
+  ASSERT_EQ(0, flush_ctx.wait());
+
+  std::list<MockImage::Extents> expected = {
+    {{0, 4096}}, {{0, 2048}}, {{8192, 4096}}};
+  ASSERT_EQ(expected, get_written());
+  ASSERT_EQ(std::string(2048, '2') + std::string(2048, '1') +
+              std::string(4096, '\0') + std::string(4096, '3'),
+            get_data(0, 12288));
+
+  ASSERT_EQ(0, shut_down(replay_cache));
+  ASSERT_EQ(0, get_state(ictx, &host, &dirty));
+  ASSERT_FALSE(dirty);
+}
+
+TEST_F(TestMockCacheWriteLogImageCache, ReplayWrap) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(ictx, mock_image_ctx);
+
+  auto cache = new MockWriteLogImageCache(mock_image_ctx);
+  ASSERT_EQ(0, init(*cache));
+
+  // fill most of the log and write it back
+  for (uint64_t i = 0; i < 3; ++i) {
+    ASSERT_EQ(0, write(*cache, i * WRITE_SIZE, std::string(WRITE_SIZE, 'a')));
+  }
+  ASSERT_EQ(0, flush(*cache));
+  ASSERT_EQ(3U, get_written().size());
+
+  // the next records no longer fit before the end of the log
+  mock_image.hold = true;
+  ASSERT_EQ(0, write(*cache, 0, std::string(WRITE_SIZE, 'b')));
+  ASSERT_EQ(0, write(*cache, WRITE_SIZE, std::string(WRITE_SIZE, 'c')));
+  crash(ictx, cache);
+
+  MockWriteLogImageCache replay_cache(mock_image_ctx);
+  ASSERT_EQ(0, init(replay_cache));
+  ASSERT_EQ(0, flush(replay_cache));
+
+  auto written = get_written();
+  ASSERT_EQ(5U, written.size());
+  MockImage::Extents extents = {{0, WRITE_SIZE}};
+  ASSERT_EQ(extents, *std::next(written.begin(), 3));
+  ASSERT_EQ(std::string(WRITE_SIZE, 'b') + std::string(WRITE_SIZE, 'c') +
+              std::string(WRITE_SIZE, 'a'),
+            get_data(0, 3 * WRITE_SIZE));
+
+  ASSERT_EQ(0, shut_down(replay_cache));
+}
+
+TEST_F(TestMockCacheWriteLogImageCache, DirtyElsewhere) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(ictx, mock_image_ctx);
+  ASSERT_EQ(0, set_state(ictx, "otherhost"));
+
+  MockWriteLogImageCache cache(mock_image_ctx);
+  ASSERT_EQ(-EBUSY, init(cache));
+
+  // nothing is logged here -- writes go straight to the image
+  ASSERT_EQ(0, write(cache, 0, std::string(4096, '1')));
+  ASSERT_EQ(std::string(4096, '1'), get_data(0, 4096));
+  ASSERT_EQ(0, shut_down(cache));
+
+  std::string host;
+  bool dirty = false;
+  ASSERT_EQ(0, get_state(ictx, &host, &dirty));
+  ASSERT_EQ("otherhost", host);
+  ASSERT_TRUE(dirty);
+}
+
+TEST_F(TestMockCacheWriteLogImageCache, StaleLog) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(ictx, mock_image_ctx);
+
+  auto cache = new MockWriteLogImageCache(mock_image_ctx);
+  ASSERT_EQ(0, init(*cache));
+
+  mock_image.hold = true;
+  ASSERT_EQ(0, write(*cache, 0, std::string(4096, '1')));
+  crash(ictx, cache);
+
+  // the cached writes were discarded by the administrator
+  ASSERT_EQ(0, cls_client::metadata_remove(&ictx->md_ctx, ictx->header_oid,
+                                           ".rbd_persistent_cache_state"));
+
+  MockWriteLogImageCache new_cache(mock_image_ctx);
+  ASSERT_EQ(0, init(new_cache));
+  ASSERT_EQ(std::string(4096, '\0'), read(new_cache, 0, 4096));
+  ASSERT_EQ(0, flush(new_cache));
+  ASSERT_TRUE(get_written().empty());
+  ASSERT_EQ(0, shut_down(new_cache));
+
+  // a log from an earlier generation is never replayed
+  cache = new MockWriteLogImageCache(mock_image_ctx);
+  ASSERT_EQ(0, init(*cache));
+  mock_image.hold = true;
+  ASSERT_EQ(0, write(*cache, 0, std::string(4096, '2')));
+  crash(ictx, cache);
+  ASSERT_EQ(0, set_state(ictx, ceph_get_hostname()));
+
+  MockWriteLogImageCache stale_cache(mock_image_ctx);
+  ASSERT_EQ(-ESTALE, init(stale_cache));
+}
+
+} // namespace cache
+} // namespace librbd
@@ -123,7 +123,8 @@ struct ObjectReadRequest<librbd::MockTestImageCtx> : public ObjectRequest<librbd
                                    librados::snap_t snap_id, bool sparse,
                                    int op_flags,
                                    const ZTracer::Trace &parent_trace,
-                                   Context *completion) {
+                                   Context *completion,
+                                   const ImageReadState *read_state = nullptr) {
     assert(s_instance != nullptr);
     s_instance->on_finish = completion;
     return s_instance;
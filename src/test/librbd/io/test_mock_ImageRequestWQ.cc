@@ -0,0 +1,416 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "test/librbd/test_mock_fixture.h"
+#include "test/librbd/test_support.h"
+#include "test/librbd/mock/MockImageCtx.h"
+#include "test/librbd/mock/MockImageState.h"
+#include "librbd/io/AioCompletion.h"
+#include "librbd/io/ImageRequest.h"
+#include "librbd/io/ImageRequestWQ.h"
+#include "librbd/io/ReadResult.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <list>
+
+namespace librbd {
+namespace {
+
+struct MockTestImageCtx : public MockImageCtx {
+  MockTestImageCtx(ImageCtx &image_ctx) : MockImageCtx(image_ctx) {
+  }
+};
+
+} // anonymous namespace
+
+namespace io {
+
+template <>
+struct ImageRequest<librbd::MockTestImageCtx> {
+  typedef std::vector<std::pair<uint64_t,uint64_t> > Extents;
+
+  static std::list<ImageRequest*> s_instances;
+
+  AioCompletion *aio_comp = nullptr;
+  Extents image_extents;
+  bool write_op = false;
+
+  static ImageRequest* create(AioCompletion *aio_comp,
+                              Extents &&image_extents, bool write_op) {
+    assert(!s_instances.empty());
+    ImageRequest *req = s_instances.front();
+    s_instances.pop_front();
+    req->aio_comp = aio_comp;
+    req->image_extents = std::move(image_extents);
+    req->write_op = write_op;
+    return req;
+  }
+
+  static ImageRequest* create_read_request(
+      librbd::MockTestImageCtx &image_ctx, AioCompletion *aio_comp,
+      Extents &&image_extents, ReadResult &&read_result, int op_flags,
+      const ZTracer::Trace &parent_trace) {
+    return create(aio_comp, std::move(image_extents), false);
+  }
+  static ImageRequest* create_write_request(
+      librbd::MockTestImageCtx &image_ctx, AioCompletion *aio_comp,
+      Extents &&image_extents, bufferlist &&bl, int op_flags,
+      const ZTracer::Trace &parent_trace) {
+    return create(aio_comp, std::move(image_extents), true);
+  }
+  static ImageRequest* create_discard_request(
+      librbd::MockTestImageCtx &image_ctx, AioCompletion *aio_comp,
+      uint64_t off, uint64_t len, bool skip_partial_discard,
+      const ZTracer::Trace &parent_trace) {
+    return create(aio_comp, {{off, len}}, true);
+  }
+  static ImageRequest* create_flush_request(
+      librbd::MockTestImageCtx &image_ctx, AioCompletion *aio_comp,
+      const ZTracer::Trace &parent_trace) {
+    return create(aio_comp, {}, true);
+  }
+  static ImageRequest* create_writesame_request(
+      librbd::MockTestImageCtx &image_ctx, AioCompletion *aio_comp,
+      uint64_t off, uint64_t len, bufferlist &&bl, int op_flags,
+      const ZTracer::Trace &parent_trace) {
+    return create(aio_comp, {{off, len}}, true);
+  }
+
+  static void aio_read(librbd::MockTestImageCtx *ictx, AioCompletion *c,
+                       Extents &&image_extents, ReadResult &&read_result,
+                       int op_flags, const ZTracer::Trace &parent_trace) {
+  }
+  static void aio_write(librbd::MockTestImageCtx *ictx, AioCompletion *c,
+                        Extents &&image_extents, bufferlist &&bl,
+                        int op_flags, const ZTracer::Trace &parent_trace) {
+  }
+  static void aio_discard(librbd::MockTestImageCtx *ictx, AioCompletion *c,
+                          uint64_t off, uint64_t len,
+                          bool skip_partial_discard,
+                          const ZTracer::Trace &parent_trace) {
+  }
+  static void aio_flush(librbd::MockTestImageCtx *ictx, AioCompletion *c,
+                        const ZTracer::Trace &parent_trace) {
+  }
+  static void aio_writesame(librbd::MockTestImageCtx *ictx, AioCompletion *c,
+                            uint64_t off, uint64_t len, bufferlist &&bl,
+                            int op_flags,
+                            const ZTracer::Trace &parent_trace) {
+  }
+
+  virtual ~ImageRequest() {
+  }
+
+  bool is_write_op() const {
+    return write_op;
+  }
+  const Extents &get_image_extents() const {
+    return image_extents;
+  }
+
+  MOCK_METHOD0(start_op, void());
+  MOCK_METHOD0(send, void());
+  MOCK_METHOD1(fail, void(int));
+};
+
+std::list<ImageRequest<librbd::MockTestImageCtx> *>
+  ImageRequest<librbd::MockTestImageCtx>::s_instances;
+
+} // namespace io
+
+namespace util {
+
+inline ImageCtx *get_image_ctx(MockTestImageCtx *image_ctx) {
+  return image_ctx->image_ctx;
+}
+
+} // namespace util
+} // namespace librbd
+
+template <>
+struct ThreadPool::PointerWQ<librbd::io::ImageRequest<librbd::MockTestImageCtx> > {
+  typedef librbd::io::ImageRequest<librbd::MockTestImageCtx> ImageRequest;
+  static PointerWQ* s_instance;
+
+  Mutex m_lock;
+
+  PointerWQ(const std::string &name, time_t, int, ThreadPool *)
+    : m_lock(name) {
+    s_instance = this;
+  }
+  virtual ~PointerWQ() {
+  }
+
+  MOCK_METHOD0(drain, void());
+  MOCK_METHOD0(empty, bool());
+  MOCK_METHOD0(signal, void());
+  MOCK_METHOD0(signal_all, void());
+  MOCK_METHOD0(process_finish, void());
+
+  MOCK_METHOD0(front, ImageRequest*());
+  MOCK_METHOD1(requeue, void(ImageRequest*));
+
+  MOCK_METHOD0(dequeue, void*());
+  MOCK_METHOD1(queue, void(ImageRequest*));
+
+  void register_work_queue() {
+  }
+  Mutex &get_pool_lock() {
+    return m_lock;
+  }
+
+  void *invoke_dequeue() {
+    Mutex::Locker locker(m_lock);
+    return _void_dequeue();
+  }
+  void invoke_process(ImageRequest *image_request) {
+    process(image_request);
+  }
+
+  virtual void *_void_dequeue() {
+    return dequeue();
+  }
+  virtual void process(ImageRequest *req) = 0;
+};
+
+ThreadPool::PointerWQ<librbd::io::ImageRequest<librbd::MockTestImageCtx> > *
+  ThreadPool::PointerWQ<librbd::io::ImageRequest<librbd::MockTestImageCtx> >::s_instance = nullptr;
+
+// template definitions
+#include "librbd/io/ImageRequestWQ.cc"
+template class librbd::io::ImageRequestWQ<librbd::MockTestImageCtx>;
+
+namespace librbd {
+namespace io {
+
+using ::testing::_;
+using ::testing::InSequence;
+using ::testing::Return;
+
+struct TestMockIoImageRequestWQ : public TestMockFixture {
+  typedef ImageRequestWQ<librbd::MockTestImageCtx> MockImageRequestWQ;
+  typedef ImageRequest<librbd::MockTestImageCtx> MockImageRequest;
+  typedef ThreadPool::PointerWQ<MockImageRequest> MockPointerWQ;
+
+  std::list<AioCompletion*> aio_comps;
+
+  void TearDown() override {
+    for (auto aio_comp : aio_comps) {
+      aio_comp->release();
+    }
+    TestMockFixture::TearDown();
+  }
+
+  void init_image_ctx(MockTestImageCtx &mock_image_ctx) {
+    // queue all IO
+    mock_image_ctx.non_blocking_aio = true;
+    EXPECT_CALL(*mock_image_ctx.state, is_refresh_required())
+      .WillRepeatedly(Return(false));
+  }
+
+  MockImageRequest *expect_queue(MockPointerWQ &mock_pointer_wq) {
+    auto mock_image_request = new MockImageRequest();
+    MockImageRequest::s_instances.push_back(mock_image_request);
+    EXPECT_CALL(mock_pointer_wq, queue(mock_image_request));
+    return mock_image_request;
+  }
+
+  void expect_dequeue(MockPointerWQ &mock_pointer_wq,
+                      MockImageRequest *mock_image_request) {
+    EXPECT_CALL(mock_pointer_wq, front())
+      .WillOnce(Return(mock_image_request));
+    EXPECT_CALL(mock_pointer_wq, dequeue())
+      .WillOnce(Return(mock_image_request));
+    EXPECT_CALL(*mock_image_request, start_op());
+  }
+
+  void expect_front(MockPointerWQ &mock_pointer_wq,
+                    MockImageRequest *mock_image_request) {
+    EXPECT_CALL(mock_pointer_wq, front())
+      .WillOnce(Return(mock_image_request));
+  }
+
+  void expect_send(MockImageRequest *mock_image_request) {
+    EXPECT_CALL(*mock_image_request, send());
+  }
+
+  AioCompletion *create_aio_comp() {
+    auto aio_comp = new AioCompletion();
+    aio_comps.push_back(aio_comp);
+    return aio_comp;
+  }
+
+  void aio_read(MockImageRequestWQ &mock_image_request_wq, uint64_t off,
+                uint64_t len) {
+    mock_image_request_wq.aio_read(create_aio_comp(), off, len,
+                                   ReadResult(), 0);
+  }
+
+  void aio_write(MockImageRequestWQ &mock_image_request_wq, uint64_t off,
+                 uint64_t len) {
+    bufferlist bl;
+    bl.append_zero(len);
+    mock_image_request_wq.aio_write(create_aio_comp(), off, len,
+                                    std::move(bl), 0);
+  }
+};
+
+TEST_F(TestMockIoImageRequestWQ, NonOverlapping) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(mock_image_ctx);
+
+  MockImageRequestWQ mock_image_request_wq(&mock_image_ctx, "io", 60,
+                                           nullptr);
+  auto &mock_pointer_wq = *MockPointerWQ::s_instance;
+
+  auto mock_write1 = expect_queue(mock_pointer_wq);
+  aio_write(mock_image_request_wq, 0, 4096);
+  auto mock_write2 = expect_queue(mock_pointer_wq);
+  aio_write(mock_image_request_wq, 4096, 4096);
+
+  // both are dispatched at once and may complete dispatch in any order
+  expect_dequeue(mock_pointer_wq, mock_write1);
+  ASSERT_EQ(mock_write1, mock_pointer_wq.invoke_dequeue());
+  expect_dequeue(mock_pointer_wq, mock_write2);
+  ASSERT_EQ(mock_write2, mock_pointer_wq.invoke_dequeue());
+
+  expect_send(mock_write2);
+  mock_pointer_wq.invoke_process(mock_write2);
+  expect_send(mock_write1);
+  mock_pointer_wq.invoke_process(mock_write1);
+}
+
+TEST_F(TestMockIoImageRequestWQ, OverlappingDetained) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(mock_image_ctx);
+
+  MockImageRequestWQ mock_image_request_wq(&mock_image_ctx, "io", 60,
+                                           nullptr);
+  auto &mock_pointer_wq = *MockPointerWQ::s_instance;
+
+  auto mock_write1 = expect_queue(mock_pointer_wq);
+  aio_write(mock_image_request_wq, 0, 8192);
+  auto mock_write2 = expect_queue(mock_pointer_wq);
+  aio_write(mock_image_request_wq, 4096, 8192);
+  auto mock_read = expect_queue(mock_pointer_wq);
+  aio_read(mock_image_request_wq, 65536, 4096);
+
+  expect_dequeue(mock_pointer_wq, mock_write1);
+  ASSERT_EQ(mock_write1, mock_pointer_wq.invoke_dequeue());
+
+  // the overlapping write is detained ...
+  expect_dequeue(mock_pointer_wq, mock_write2);
+  ASSERT_EQ(nullptr, mock_pointer_wq.invoke_dequeue());
+
+  // ... and nothing can overtake it, overlapping or not
+  expect_front(mock_pointer_wq, mock_read);
+  ASSERT_EQ(nullptr, mock_pointer_wq.invoke_dequeue());
+
+  {
+    InSequence seq;
+    expect_send(mock_write1);
+    expect_send(mock_write2);
+    EXPECT_CALL(mock_pointer_wq, process_finish());
+    EXPECT_CALL(mock_pointer_wq, signal_all());
+  }
+  mock_pointer_wq.invoke_process(mock_write1);
+
+  expect_dequeue(mock_pointer_wq, mock_read);
+  ASSERT_EQ(mock_read, mock_pointer_wq.invoke_dequeue());
+  expect_send(mock_read);
+  mock_pointer_wq.invoke_process(mock_read);
+}
+
+TEST_F(TestMockIoImageRequestWQ, DetainedInOrder) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(mock_image_ctx);
+
+  MockImageRequestWQ mock_image_request_wq(&mock_image_ctx, "io", 60,
+                                           nullptr);
+  auto &mock_pointer_wq = *MockPointerWQ::s_instance;
+
+  auto mock_write1 = expect_queue(mock_pointer_wq);
+  aio_write(mock_image_request_wq, 0, 4096);
+  auto mock_write2 = expect_queue(mock_pointer_wq);
+  aio_write(mock_image_request_wq, 8192, 4096);
+  auto mock_write3 = expect_queue(mock_pointer_wq);
+  aio_write(mock_image_request_wq, 0, 12288);
+
+  expect_dequeue(mock_pointer_wq, mock_write1);
+  ASSERT_EQ(mock_write1, mock_pointer_wq.invoke_dequeue());
+  expect_dequeue(mock_pointer_wq, mock_write2);
+  ASSERT_EQ(mock_write2, mock_pointer_wq.invoke_dequeue());
+
+  // overlaps both in-flight writes
+  expect_dequeue(mock_pointer_wq, mock_write3);
+  ASSERT_EQ(nullptr, mock_pointer_wq.invoke_dequeue());
+
+  // released by the first write, detained again by the second
+  expect_send(mock_write1);
+  mock_pointer_wq.invoke_process(mock_write1);
+
+  {
+    InSequence seq;
+    expect_send(mock_write2);
+    expect_send(mock_write3);
+    EXPECT_CALL(mock_pointer_wq, process_finish());
+    EXPECT_CALL(mock_pointer_wq, signal_all());
+  }
+  mock_pointer_wq.invoke_process(mock_write2);
+}
+
+TEST_F(TestMockIoImageRequestWQ, FlushBarrier) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(mock_image_ctx);
+
+  MockImageRequestWQ mock_image_request_wq(&mock_image_ctx, "io", 60,
+                                           nullptr);
+  auto &mock_pointer_wq = *MockPointerWQ::s_instance;
+
+  auto mock_write = expect_queue(mock_pointer_wq);
+  aio_write(mock_image_request_wq, 0, 4096);
+  auto mock_flush = expect_queue(mock_pointer_wq);
+  mock_image_request_wq.aio_flush(create_aio_comp());
+  auto mock_read = expect_queue(mock_pointer_wq);
+  aio_read(mock_image_request_wq, 1 << 20, 4096);
+
+  expect_dequeue(mock_pointer_wq, mock_write);
+  ASSERT_EQ(mock_write, mock_pointer_wq.invoke_dequeue());
+
+  // the flush waits for all IO ahead of it
+  expect_dequeue(mock_pointer_wq, mock_flush);
+  ASSERT_EQ(nullptr, mock_pointer_wq.invoke_dequeue());
+
+  // and IO behind it waits for the flush
+  expect_front(mock_pointer_wq, mock_read);
+  ASSERT_EQ(nullptr, mock_pointer_wq.invoke_dequeue());
+
+  {
+    InSequence seq;
+    expect_send(mock_write);
+    expect_send(mock_flush);
+    EXPECT_CALL(mock_pointer_wq, process_finish());
+    EXPECT_CALL(mock_pointer_wq, signal_all());
+  }
+  mock_pointer_wq.invoke_process(mock_write);
+
+  expect_dequeue(mock_pointer_wq, mock_read);
+  ASSERT_EQ(mock_read, mock_pointer_wq.invoke_dequeue());
+  expect_send(mock_read);
+  mock_pointer_wq.invoke_process(mock_read);
+}
+
+} // namespace io
+} // namespace librbd
@@ -80,6 +80,7 @@ struct MockImageCtx {
       format_string(image_ctx.format_string),
       group_spec(image_ctx.group_spec),
       layout(image_ctx.layout),
+      read_state(image_ctx.read_state),
       io_work_queue(new io::MockImageRequestWQ()),
       op_work_queue(new MockContextWQ()),
       readahead_max_bytes(image_ctx.readahead_max_bytes),
@@ -88,6 +89,8 @@ struct MockImageCtx {
       image_watcher(NULL), object_map(NULL),
       exclusive_lock(NULL), journal(NULL),
       trace_endpoint(image_ctx.trace_endpoint),
+      event_socket(image_ctx.event_socket),
+      non_blocking_aio(image_ctx.non_blocking_aio),
       concurrent_management_ops(image_ctx.concurrent_management_ops),
       blacklist_on_break_lock(image_ctx.blacklist_on_break_lock),
       blacklist_expire_seconds(image_ctx.blacklist_expire_seconds),
@@ -97,13 +100,19 @@ struct MockImageCtx {
       journal_object_flush_interval(image_ctx.journal_object_flush_interval),
       journal_object_flush_bytes(image_ctx.journal_object_flush_bytes),
       journal_object_flush_age(image_ctx.journal_object_flush_age),
+      journal_object_max_in_flight_appends(
+        image_ctx.journal_object_max_in_flight_appends),
       journal_pool(image_ctx.journal_pool),
       journal_max_payload_bytes(image_ctx.journal_max_payload_bytes),
       journal_max_concurrent_object_sets(
           image_ctx.journal_max_concurrent_object_sets),
       mirroring_resync_after_disconnect(
           image_ctx.mirroring_resync_after_disconnect),
-      mirroring_replay_delay(image_ctx.mirroring_replay_delay)
+      mirroring_replay_delay(image_ctx.mirroring_replay_delay),
+      persistent_cache(image_ctx.persistent_cache),
+      persistent_cache_path(image_ctx.persistent_cache_path),
+      persistent_cache_size(image_ctx.persistent_cache_size),
+      persistent_cache_max_destage(image_ctx.persistent_cache_max_destage)
   {
     md_ctx.dup(image_ctx.md_ctx);
     data_ctx.dup(image_ctx.data_ctx);
@@ -141,6 +150,9 @@ struct MockImageCtx {
 
   MOCK_METHOD0(init_layout, void());
 
+  void publish_read_state() {
+  }
+
   MOCK_CONST_METHOD1(get_object_name, std::string(uint64_t));
   MOCK_CONST_METHOD0(get_current_size, uint64_t());
   MOCK_CONST_METHOD1(get_image_size, uint64_t(librados::snap_t));
@@ -191,6 +203,7 @@ struct MockImageCtx {
   MOCK_METHOD0(notify_update, void());
   MOCK_METHOD1(notify_update, void(Context *));
 
+  MOCK_CONST_METHOD0(get_exclusive_lock_policy, exclusive_lock::Policy*());
   MOCK_CONST_METHOD0(get_journal_policy, journal::Policy*());
   MOCK_CONST_METHOD1(set_journal_policy, void(journal::Policy*));
 
@@ -252,6 +265,7 @@ struct MockImageCtx {
   cls::rbd::GroupSpec group_spec;
 
   file_layout_t layout;
+  PublishedState<io::ImageReadState> &read_state;
 
   xlist<operation::ResizeRequest<MockImageCtx>*> resize_reqs;
   xlist<AsyncRequest<MockImageCtx>*> async_requests;
@@ -276,6 +290,9 @@ struct MockImageCtx {
 
   ZTracer::Endpoint trace_endpoint;
 
+  EventSocket &event_socket;
+  bool non_blocking_aio;
+
   int concurrent_management_ops;
   bool blacklist_on_break_lock;
   uint32_t blacklist_expire_seconds;
@@ -285,11 +302,16 @@ struct MockImageCtx {
   int journal_object_flush_interval;
   uint64_t journal_object_flush_bytes;
   double journal_object_flush_age;
+  uint64_t journal_object_max_in_flight_appends;
   std::string journal_pool;
   uint32_t journal_max_payload_bytes;
   int journal_max_concurrent_object_sets;
   bool mirroring_resync_after_disconnect;
   int mirroring_replay_delay;
+  bool persistent_cache;
+  std::string persistent_cache_path;
+  uint64_t persistent_cache_size;
+  int persistent_cache_max_destage;
 };
 
 } // namespace librbd
@@ -36,6 +36,12 @@ struct MockImageCache {
                      int fadvise_flags, Context *on_finish) {
     aio_writesame_mock(off, len, bl, fadvise_flags, on_finish);
   }
+
+  MOCK_METHOD1(init, void(Context *));
+  MOCK_METHOD1(shut_down, void(Context *));
+
+  MOCK_METHOD1(invalidate, void(Context *));
+  MOCK_METHOD1(flush, void(Context *));
 };
 
 } // namespace cache
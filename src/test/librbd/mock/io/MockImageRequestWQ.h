@@ -5,13 +5,26 @@
 #define CEPH_TEST_LIBRBD_MOCK_IO_IMAGE_REQUEST_WQ_H
 
 #include "gmock/gmock.h"
+#include "include/buffer.h"
 
 class Context;
 
 namespace librbd {
 namespace io {
 
+struct AioCompletion;
+
 struct MockImageRequestWQ {
+  MOCK_METHOD5(aio_write_mock, void(AioCompletion *, uint64_t, uint64_t,
+                                    const ceph::bufferlist &, int));
+  void aio_write(AioCompletion *c, uint64_t off, uint64_t len,
+                 ceph::bufferlist &&bl, int op_flags) {
+    aio_write_mock(c, off, len, bl, op_flags);
+  }
+
+  MOCK_METHOD4(aio_discard, void(AioCompletion *, uint64_t, uint64_t, bool));
+  MOCK_METHOD1(aio_flush, void(AioCompletion *));
+
   MOCK_METHOD1(block_writes, void(Context *));
   MOCK_METHOD0(unblock_writes, void());
 
@@ -0,0 +1,124 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "librbd/PublishedState.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace librbd {
+
+class TestPublishedState : public ::testing::Test {
+public:
+  static std::atomic<uint32_t> s_destroyed;
+
+  struct State {
+    uint64_t value;
+    uint64_t check;
+
+    State(uint64_t value) : value(value), check(~value) {
+    }
+    State(State &&rhs) : value(rhs.value), check(rhs.check) {
+      rhs.value = 0;
+      rhs.check = 0;
+    }
+    State(const State &) = delete;
+    ~State() {
+      if (value != 0 || check != 0) {
+        ++s_destroyed;
+      }
+      value = 0;
+      check = 0;
+    }
+  };
+
+  typedef PublishedState<State> PublishedTestState;
+
+  void SetUp() override {
+    s_destroyed = 0;
+  }
+};
+
+std::atomic<uint32_t> TestPublishedState::s_destroyed { 0 };
+
+TEST_F(TestPublishedState, Empty) {
+  PublishedTestState published_state;
+
+  PublishedTestState::Ref ref;
+  published_state.pin(&ref);
+  ASSERT_FALSE(ref);
+}
+
+TEST_F(TestPublishedState, PinCurrent) {
+  PublishedTestState published_state;
+  published_state.publish(State(1));
+
+  PublishedTestState::Ref ref1;
+  published_state.pin(&ref1);
+  ASSERT_TRUE(ref1);
+  ASSERT_EQ(1U, ref1->value);
+
+  published_state.publish(State(2));
+  ASSERT_EQ(1U, ref1->value);
+
+  PublishedTestState::Ref ref2;
+  published_state.pin(&ref2);
+  ASSERT_EQ(2U, ref2->value);
+
+  published_state.pin(&ref1);
+  ASSERT_EQ(2U, ref1->value);
+}
+
+TEST_F(TestPublishedState, RetirePinned) {
+  PublishedTestState published_state;
+  published_state.publish(State(1));
+
+  PublishedTestState::Ref ref;
+  published_state.pin(&ref);
+
+  published_state.publish(State(2));
+  published_state.publish(State(3));
+  published_state.publish(State(4));
+  ASSERT_EQ(0U, s_destroyed);
+  ASSERT_EQ(1U, ref->value);
+
+  ref.reset();
+  published_state.publish(State(5));
+  ASSERT_EQ(4U, s_destroyed);
+}
+
+TEST_F(TestPublishedState, ConcurrentPublish) {
+  PublishedTestState published_state;
+  published_state.publish(State(1));
+
+  std::atomic<bool> stop { false };
+  std::atomic<uint32_t> failures { 0 };
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&published_state, &stop, &failures]() {
+        PublishedTestState::Ref ref;
+        uint64_t last_value = 0;
+        while (!stop) {
+          published_state.pin(&ref);
+          if (ref->check != ~ref->value || ref->value < last_value) {
+            ++failures;
+          }
+          last_value = ref->value;
+          ref.reset();
+        }
+      });
+  }
+
+  for (uint64_t value = 2; value < 10000; ++value) {
+    published_state.publish(State(value));
+  }
+
+  stop = true;
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  ASSERT_EQ(0U, failures);
+}
+
+} // namespace librbd
@@ -937,6 +937,74 @@ TEST_F(TestInternal, WriteFullCopyup) {
   ASSERT_TRUE(bl.contents_equal(read_bl));
 }
 
+TEST_F(TestInternal, SparseCopyup) {
+  REQUIRE_FEATURE(RBD_FEATURE_LAYERING);
+
+  m_image_name = get_temp_image_name();
+  m_image_size = 1 << 14;
+
+  uint64_t features = 0;
+  get_features(&features);
+  int order = 14;
+  ASSERT_EQ(0, m_rbd.create2(m_ioctx, m_image_name.c_str(), m_image_size,
+                             features, &order));
+
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  bufferlist bl1;
+  bl1.append(std::string(4096, '1'));
+  ASSERT_EQ((ssize_t)bl1.length(),
+            ictx->io_work_queue->write(0, bl1.length(), bufferlist{bl1}, 0));
+  bufferlist bl3;
+  bl3.append(std::string(4096, '3'));
+  ASSERT_EQ((ssize_t)bl3.length(),
+            ictx->io_work_queue->write(8192, bl3.length(), bufferlist{bl3},
+                                       0));
+
+  ASSERT_EQ(0, snap_create(*ictx, "snap1"));
+  ASSERT_EQ(0,
+	    ictx->operations->snap_protect(cls::rbd::UserSnapshotNamespace(),
+					   "snap1"));
+
+  std::string clone_name = get_temp_image_name();
+  ASSERT_EQ(0, librbd::clone(m_ioctx, m_image_name.c_str(), "snap1", m_ioctx,
+			     clone_name.c_str(), features, &order, 0, 0));
+
+  librbd::ImageCtx *ictx2;
+  ASSERT_EQ(0, open_image(clone_name, &ictx2));
+  ictx2->sparse_copyup = true;
+
+  // CoW within a zeroed parent extent
+  bufferlist bl2;
+  bl2.append(std::string(4096, '2'));
+  ASSERT_EQ((ssize_t)bl2.length(),
+            ictx2->io_work_queue->write(4096, bl2.length(), bufferlist{bl2},
+                                        0));
+
+  bufferlist expected_bl;
+  expected_bl.append(bl1);
+  expected_bl.append(bl2);
+  expected_bl.append(bl3);
+
+  // the zeroed tail of the parent object is not copied up
+  bufferlist object_bl;
+  ASSERT_EQ((int)expected_bl.length(),
+            m_ioctx.read(ictx2->get_object_name(0), object_bl, 0, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(object_bl));
+
+  expected_bl.append_zero(4096);
+  bufferptr read_ptr(expected_bl.length());
+  bufferlist read_bl;
+  read_bl.push_back(read_ptr);
+
+  librbd::io::ReadResult read_result{&read_bl};
+  ASSERT_EQ((ssize_t)read_bl.length(),
+            ictx2->io_work_queue->read(0, read_bl.length(),
+                                       librbd::io::ReadResult{read_result}, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+}
+
 TEST_F(TestInternal, RemoveById) {
   REQUIRE_FEATURE(RBD_FEATURE_LAYERING);
 
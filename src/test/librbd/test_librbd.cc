@@ -3223,6 +3223,45 @@ TYPED_TEST(DiffIterateTest, DiffIterateDiscard)
   ASSERT_PASSED(this->validate_object_map, image);
 }
 
+TYPED_TEST(DiffIterateTest, DiffIterateUnchangedObjects)
+{
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, this->_rados.ioctx_create(this->m_pool_name.c_str(), ioctx));
+
+  librbd::RBD rbd;
+  librbd::Image image;
+  int order = 0;
+  std::string name = this->get_temp_image_name();
+  uint64_t size = 20 << 20;
+
+  ASSERT_EQ(0, create_image_pp(rbd, ioctx, name.c_str(), size, &order));
+  ASSERT_EQ(0, rbd.open(ioctx, image, name.c_str(), NULL));
+
+  uint64_t object_size = 0;
+  if (this->whole_object) {
+    object_size = 1 << order;
+  }
+
+  char data[256];
+  memset(data, 1, sizeof(data));
+  ceph::bufferlist bl;
+  bl.append(data, sizeof(data));
+  for (uint64_t off = 0; off < size; off += (1 << order)) {
+    ASSERT_EQ(256, image.write(off, 256, bl));
+  }
+  ASSERT_EQ(0, image.snap_create("snap1"));
+
+  uint64_t off = (2 << order) + 512;
+  ASSERT_EQ(256, image.write(off, 256, bl));
+
+  vector<diff_extent> extents;
+  ASSERT_EQ(0, image.diff_iterate2("snap1", 0, size, true, this->whole_object,
+                                   vector_iterate_cb, (void *) &extents));
+  ASSERT_EQ(1u, extents.size());
+  ASSERT_EQ(diff_extent(off, 256, true, object_size), extents[0]);
+  ASSERT_PASSED(this->validate_object_map, image);
+}
+
 TYPED_TEST(DiffIterateTest, DiffIterateStress)
 {
   librados::IoCtx ioctx;
@@ -422,6 +422,115 @@ TEST_F(TestMirroring, EnableImageMirror_WithoutJournaling) {
       RBD_MIRROR_IMAGE_DISABLED);
 }
 
+TEST_F(TestMirroring, EnableImageMirror_SnapshotMode) {
+  ASSERT_EQ(0, m_rbd.mirror_mode_set(m_ioctx, RBD_MIRROR_MODE_IMAGE));
+
+  int order = 20;
+  ASSERT_EQ(0, m_rbd.create2(m_ioctx, image_name.c_str(), 4096,
+                             RBD_FEATURE_EXCLUSIVE_LOCK, &order));
+  librbd::Image image;
+  ASSERT_EQ(0, m_rbd.open(m_ioctx, image, image_name.c_str()));
+
+  ASSERT_EQ(0, image.mirror_image_enable2(RBD_MIRROR_IMAGE_MODE_SNAPSHOT));
+  ASSERT_EQ(-EINVAL, image.mirror_image_enable2(RBD_MIRROR_IMAGE_MODE_JOURNAL));
+
+  librbd::mirror_image_mode_t mode;
+  ASSERT_EQ(0, image.mirror_image_get_mode(&mode));
+  ASSERT_EQ(RBD_MIRROR_IMAGE_MODE_SNAPSHOT, mode);
+
+  librbd::mirror_image_info_t mirror_image;
+  ASSERT_EQ(0, image.mirror_image_get_info(&mirror_image,
+                                           sizeof(mirror_image)));
+  ASSERT_EQ(RBD_MIRROR_IMAGE_ENABLED, mirror_image.state);
+  ASSERT_TRUE(mirror_image.primary);
+
+  ASSERT_EQ(0, image.mirror_image_demote());
+  ASSERT_EQ(0, image.mirror_image_get_info(&mirror_image,
+                                           sizeof(mirror_image)));
+  ASSERT_FALSE(mirror_image.primary);
+
+  ASSERT_EQ(0, image.mirror_image_promote(false));
+  ASSERT_EQ(0, image.mirror_image_get_info(&mirror_image,
+                                           sizeof(mirror_image)));
+  ASSERT_TRUE(mirror_image.primary);
+
+  std::vector<librbd::snap_info_t> snaps;
+  ASSERT_EQ(0, image.snap_list(snaps));
+  ASSERT_EQ(3U, snaps.size());
+
+  ASSERT_EQ(0, image.mirror_image_disable(false));
+  ASSERT_EQ(0, image.mirror_image_get_info(&mirror_image,
+                                           sizeof(mirror_image)));
+  ASSERT_EQ(RBD_MIRROR_IMAGE_DISABLED, mirror_image.state);
+
+  snaps.clear();
+  ASSERT_EQ(0, image.snap_list(snaps));
+  ASSERT_TRUE(snaps.empty());
+
+  ASSERT_EQ(0, image.close());
+  ASSERT_EQ(0, m_rbd.remove(m_ioctx, image_name.c_str()));
+  ASSERT_EQ(0, m_rbd.mirror_mode_set(m_ioctx, RBD_MIRROR_MODE_DISABLED));
+}
+
+TEST_F(TestMirroring, EnableImageMirror_SnapshotModeWithJournaling) {
+  ASSERT_EQ(0, m_rbd.mirror_mode_set(m_ioctx, RBD_MIRROR_MODE_IMAGE));
+
+  int order = 20;
+  ASSERT_EQ(0, m_rbd.create2(m_ioctx, image_name.c_str(), 4096,
+                             RBD_FEATURE_EXCLUSIVE_LOCK |
+                               RBD_FEATURE_JOURNALING, &order));
+  librbd::Image image;
+  ASSERT_EQ(0, m_rbd.open(m_ioctx, image, image_name.c_str()));
+
+  ASSERT_EQ(-EINVAL,
+            image.mirror_image_enable2(RBD_MIRROR_IMAGE_MODE_SNAPSHOT));
+
+  ASSERT_EQ(0, image.close());
+  ASSERT_EQ(0, m_rbd.remove(m_ioctx, image_name.c_str()));
+  ASSERT_EQ(0, m_rbd.mirror_mode_set(m_ioctx, RBD_MIRROR_MODE_DISABLED));
+}
+
+TEST_F(TestMirroring, PromoteImage_SnapshotModeRollback) {
+  ASSERT_EQ(0, m_rbd.mirror_mode_set(m_ioctx, RBD_MIRROR_MODE_IMAGE));
+
+  int order = 20;
+  ASSERT_EQ(0, m_rbd.create2(m_ioctx, image_name.c_str(), 4096,
+                             RBD_FEATURE_EXCLUSIVE_LOCK, &order));
+  librbd::Image image;
+  ASSERT_EQ(0, m_rbd.open(m_ioctx, image, image_name.c_str()));
+  ASSERT_EQ(0, image.mirror_image_enable2(RBD_MIRROR_IMAGE_MODE_SNAPSHOT));
+
+  // a synced mirror snapshot followed by a partially applied sync
+  bufferlist synced_bl;
+  synced_bl.append(std::string(4096, '1'));
+  ASSERT_EQ(4096, image.write(0, 4096, synced_bl));
+  ASSERT_EQ(0, image.snap_create(
+    ".mirror.non_primary.8d9c2ac4-3a0e-4b0d-9f3b-5a6e4c2d1f00"));
+  bufferlist partial_bl;
+  partial_bl.append(std::string(1024, '2'));
+  ASSERT_EQ(1024, image.write(1024, 1024, partial_bl));
+
+  librbd::mirror_image_info_t mirror_image;
+  ASSERT_EQ(0, image.mirror_image_get_info(&mirror_image,
+                                           sizeof(mirror_image)));
+  ASSERT_FALSE(mirror_image.primary);
+
+  ASSERT_EQ(-EBUSY, image.mirror_image_promote(false));
+  ASSERT_EQ(0, image.mirror_image_promote(true));
+  ASSERT_EQ(0, image.mirror_image_get_info(&mirror_image,
+                                           sizeof(mirror_image)));
+  ASSERT_TRUE(mirror_image.primary);
+
+  bufferlist read_bl;
+  ASSERT_EQ(4096, image.read(0, 4096, read_bl));
+  ASSERT_TRUE(synced_bl.contents_equal(read_bl));
+
+  ASSERT_EQ(0, image.mirror_image_disable(false));
+  ASSERT_EQ(0, image.close());
+  ASSERT_EQ(0, m_rbd.remove(m_ioctx, image_name.c_str()));
+  ASSERT_EQ(0, m_rbd.mirror_mode_set(m_ioctx, RBD_MIRROR_MODE_DISABLED));
+}
+
 TEST_F(TestMirroring, CreateImage_In_MirrorModeDisabled) {
   uint64_t features = 0;
   features |= RBD_FEATURE_OBJECT_MAP;
@@ -432,3 +432,74 @@ TEST_F(OSDMapTest, PrimaryAffinity) {
     osdmap.set_primary_affinity(1, 0x10000);
   }
 }
+
+TEST_F(OSDMapTest, IncrementalMapping) {
+  set_up_map();
+  mapping.update(osdmap);
+  ASSERT_EQ(osdmap.get_epoch(), mapping.get_epoch());
+
+  auto check = [&]() {
+    for (auto& p : osdmap.get_pools()) {
+      for (unsigned ps = 0; ps < p.second.get_pg_num(); ++ps) {
+	pg_t pgid(ps, p.first);
+	vector<int> up, acting, up2, acting2;
+	int up_primary, acting_primary, up_primary2, acting_primary2;
+	osdmap.pg_to_up_acting_osds(pgid, &up, &up_primary,
+				    &acting, &acting_primary);
+	mapping.get(pgid, &up2, &up_primary2, &acting2, &acting_primary2);
+	ASSERT_EQ(up, up2);
+	ASSERT_EQ(up_primary, up_primary2);
+	ASSERT_EQ(acting, acting2);
+	ASSERT_EQ(acting_primary, acting_primary2);
+      }
+    }
+  };
+
+  // reweight an osd
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_weight[0] = CEPH_OSD_IN / 2;
+    osdmap.apply_incremental(inc);
+    mapping.note_incremental(osdmap, inc);
+  }
+  mapping.update_incremental(osdmap);
+  ASSERT_EQ(osdmap.get_epoch(), mapping.get_epoch());
+  check();
+
+  // mark it down, and add a pg_temp, over two epochs
+  pg_t pgid = osdmap.raw_pg_to_pg(pg_t(0, 0));
+  {
+    vector<int> acting;
+    osdmap.pg_to_acting_osds(pgid, acting);
+    std::reverse(acting.begin(), acting.end());
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_pg_temp[pgid] = mempool::osdmap::vector<int>(
+      acting.begin(), acting.end());
+    osdmap.apply_incremental(inc);
+    mapping.note_incremental(osdmap, inc);
+  }
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[1] = CEPH_OSD_UP;
+    osdmap.apply_incremental(inc);
+    mapping.note_incremental(osdmap, inc);
+  }
+  mapping.update_incremental(osdmap);
+  check();
+
+  // a gap in the noted incrementals falls back to a full update
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[1] = CEPH_OSD_UP;
+    osdmap.apply_incremental(inc);
+  }
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_weight[0] = CEPH_OSD_IN;
+    osdmap.apply_incremental(inc);
+    mapping.note_incremental(osdmap, inc);
+  }
+  mapping.update_incremental(osdmap);
+  ASSERT_EQ(osdmap.get_epoch(), mapping.get_epoch());
+  check();
+}
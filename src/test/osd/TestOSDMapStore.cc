@@ -0,0 +1,272 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <gtest/gtest.h>
+#include "osd/OSD.h"
+#include "osd/OSDMap.h"
+#include "os/ObjectStore.h"
+#include "compressor/Compressor.h"
+#include "global/global_context.h"
+#include "test/objectstore/store_test_fixture.h"
+
+class OSDMapStoreTest : public StoreTestFixture {
+public:
+  static const epoch_t num_epochs = 10;
+
+  ObjectStore::Sequencer osr;
+  std::map<epoch_t, bufferlist> fulls;
+  std::map<epoch_t, bufferlist> incs;
+
+  OSDMapStoreTest()
+    : StoreTestFixture("memstore"),
+      osr("osdmap_store") {}
+
+  void SetUp() override {
+    StoreTestFixture::SetUp();
+    if (HasFatalFailure())
+      return;
+
+    ObjectStore::Transaction t;
+    t.create_collection(coll_t::meta(), 0);
+    ASSERT_EQ(0, store->apply_transaction(&osr, std::move(t)));
+
+    // build a series of maps the way the monitor does: every incremental
+    // carries the crc of the full map it produces
+    uint64_t features = CEPH_FEATURES_ALL | CEPH_FEATURE_RESERVED;
+    uuid_d fsid;
+    fsid.generate_random();
+    OSDMap osdmap;
+    osdmap.build_simple(g_ceph_context, 1, fsid, 3, 6, 6);
+    ::encode(osdmap, fulls[1], features);
+    for (epoch_t e = 2; e <= num_epochs; ++e) {
+      OSDMap::Incremental inc(e);
+      inc.fsid = fsid;
+      inc.new_flags = osdmap.get_flags() ^ CEPH_OSDMAP_NOOUT;
+      inc.new_weight[e % 3] = e % 2 ? CEPH_OSD_IN : CEPH_OSD_OUT;
+      ASSERT_EQ(0, osdmap.apply_incremental(inc));
+      ::encode(osdmap, fulls[e], features);
+      inc.full_crc = osdmap.get_crc();
+      ::encode(inc, incs[e], features);
+    }
+  }
+
+  /// persist the incrementals and the full maps picked by the current
+  /// osd_map_full_interval (the first one is always persisted)
+  void write_maps(epoch_t first = 1, epoch_t last = num_epochs) {
+    ObjectStore::Transaction t;
+    for (auto& p : fulls) {
+      if (p.first < first || p.first > last) {
+	continue;
+      }
+      if (p.first == 1 ||
+	  OSD::should_store_full_osdmap(g_ceph_context, p.first)) {
+	bufferlist sbl;
+	OSD::encode_stored_osdmap(g_ceph_context, p.second, sbl);
+	t.write(coll_t::meta(), OSD::get_osdmap_pobject_name(p.first), 0,
+		sbl.length(), sbl);
+      }
+    }
+    for (auto& p : incs) {
+      if (p.first < first || p.first > last) {
+	continue;
+      }
+      t.write(coll_t::meta(), OSD::get_inc_osdmap_pobject_name(p.first), 0,
+	      p.second.length(), p.second);
+    }
+    ASSERT_EQ(0, store->apply_transaction(&osr, std::move(t)));
+  }
+
+  void set_conf(const std::string& key, const std::string& val) {
+    g_conf->set_val(key.c_str(), val);
+    g_conf->apply_changes(NULL);
+  }
+
+  void TearDown() override {
+    set_conf("osd_map_full_interval", "1");
+    set_conf("osd_map_compression", "none");
+    StoreTestFixture::TearDown();
+  }
+};
+
+TEST_F(OSDMapStoreTest, dense)
+{
+  write_maps();
+  for (epoch_t e = 1; e <= num_epochs; ++e) {
+    ASSERT_TRUE(store->exists(coll_t::meta(), OSD::get_osdmap_pobject_name(e)));
+    bufferlist bl;
+    ASSERT_EQ(0, OSD::read_stored_osdmap(g_ceph_context, store.get(), e, bl));
+    ASSERT_TRUE(bl.contents_equal(fulls[e]));
+  }
+  bufferlist bl;
+  ASSERT_EQ(-ENOENT, OSD::read_stored_osdmap(g_ceph_context, store.get(),
+					     num_epochs + 1, bl));
+}
+
+TEST_F(OSDMapStoreTest, sparse)
+{
+  set_conf("osd_map_full_interval", "4");
+  write_maps();
+  for (epoch_t e = 1; e <= num_epochs; ++e) {
+    ASSERT_EQ(e == 1 || e % 4 == 0,
+	      store->exists(coll_t::meta(), OSD::get_osdmap_pobject_name(e)));
+    bufferlist bl;
+    ASSERT_EQ(0, OSD::read_stored_osdmap(g_ceph_context, store.get(), e, bl));
+    ASSERT_TRUE(bl.contents_equal(fulls[e])) << "epoch " << e;
+  }
+}
+
+TEST_F(OSDMapStoreTest, sparse_lookup)
+{
+  set_conf("osd_map_full_interval", "4");
+  write_maps();
+
+  // a cached full map short-cuts the walk back to the persisted one
+  std::vector<epoch_t> looked_up;
+  bufferlist bl;
+  ASSERT_EQ(0, OSD::read_stored_osdmap(
+    g_ceph_context, store.get(), 7, bl,
+    [&](epoch_t e, bufferlist& base_bl) {
+      looked_up.push_back(e);
+      if (e == 6) {
+	base_bl = fulls[6];
+	return true;
+      }
+      return false;
+    }));
+  ASSERT_TRUE(bl.contents_equal(fulls[7]));
+  ASSERT_EQ(std::vector<epoch_t>{6}, looked_up);
+}
+
+TEST_F(OSDMapStoreTest, sparse_missing_inc)
+{
+  set_conf("osd_map_full_interval", "4");
+  write_maps();
+
+  ObjectStore::Transaction t;
+  t.remove(coll_t::meta(), OSD::get_inc_osdmap_pobject_name(6));
+  ASSERT_EQ(0, store->apply_transaction(&osr, std::move(t)));
+
+  bufferlist bl;
+  ASSERT_EQ(-ENOENT, OSD::read_stored_osdmap(g_ceph_context, store.get(),
+					     7, bl));
+  ASSERT_EQ(0, OSD::read_stored_osdmap(g_ceph_context, store.get(), 5, bl));
+  ASSERT_TRUE(bl.contents_equal(fulls[5]));
+}
+
+TEST_F(OSDMapStoreTest, sparse_bad_crc)
+{
+  set_conf("osd_map_full_interval", "4");
+  write_maps();
+
+  // an incremental that does not produce the map its crc was taken from
+  bufferlist::iterator p = incs[6].begin();
+  OSDMap::Incremental inc(p);
+  inc.new_weight.clear();
+  bufferlist ibl;
+  ::encode(inc, ibl, CEPH_FEATURES_ALL | CEPH_FEATURE_RESERVED);
+  ObjectStore::Transaction t;
+  t.write(coll_t::meta(), OSD::get_inc_osdmap_pobject_name(6), 0,
+	  ibl.length(), ibl);
+  t.truncate(coll_t::meta(), OSD::get_inc_osdmap_pobject_name(6),
+	     ibl.length());
+  ASSERT_EQ(0, store->apply_transaction(&osr, std::move(t)));
+
+  bufferlist bl;
+  ASSERT_EQ(-EIO, OSD::read_stored_osdmap(g_ceph_context, store.get(), 6, bl));
+}
+
+TEST_F(OSDMapStoreTest, trim_after_interval_change)
+{
+  // the interval is lowered after epoch 7 was written: epochs 5..7 still
+  // depend on the persisted full map of epoch 4
+  set_conf("osd_map_full_interval", "4");
+  write_maps(1, 7);
+  set_conf("osd_map_full_interval", "1");
+  write_maps(8, num_epochs);
+
+  ASSERT_EQ(1u, OSD::get_osdmap_trim_bound(store.get(), 1, 3));
+  ASSERT_EQ(4u, OSD::get_osdmap_trim_bound(store.get(), 1, 7));
+  ASSERT_EQ(9u, OSD::get_osdmap_trim_bound(store.get(), 1, 9));
+  ASSERT_EQ(5u, OSD::get_osdmap_trim_bound(store.get(), 5, 7));
+
+  // trim the way OSD::trim_maps() does; what is left can still be read
+  epoch_t bound = OSD::get_osdmap_trim_bound(store.get(), 1, 7);
+  ObjectStore::Transaction t;
+  for (epoch_t e = 1; e < bound; ++e) {
+    t.remove(coll_t::meta(), OSD::get_osdmap_pobject_name(e));
+    t.remove(coll_t::meta(), OSD::get_inc_osdmap_pobject_name(e));
+  }
+  ASSERT_EQ(0, store->apply_transaction(&osr, std::move(t)));
+
+  for (epoch_t e = bound; e <= num_epochs; ++e) {
+    bufferlist bl;
+    ASSERT_EQ(0, OSD::read_stored_osdmap(g_ceph_context, store.get(), e, bl));
+    ASSERT_TRUE(bl.contents_equal(fulls[e])) << "epoch " << e;
+  }
+}
+
+TEST_F(OSDMapStoreTest, compressed)
+{
+  CompressorRef compressor = Compressor::create(g_ceph_context, "zlib");
+  ASSERT_TRUE(compressor);
+
+  set_conf("osd_map_compression", "zlib");
+  bufferlist sbl;
+  OSD::encode_stored_osdmap(g_ceph_context, fulls[1], sbl);
+  ASSERT_LT(0u, sbl.length());
+  ASSERT_EQ(0xff, (uint8_t)sbl[0]);
+  ASSERT_EQ(compressor->get_type(), (uint8_t)sbl[1]);
+  ASSERT_LT(sbl.length(), fulls[1].length());
+
+  // a plain encoding never starts with the compressed marker
+  ASSERT_NE(0xff, (uint8_t)fulls[1][0]);
+
+  set_conf("osd_map_full_interval", "4");
+  write_maps();
+  for (epoch_t e = 1; e <= num_epochs; ++e) {
+    bufferlist bl;
+    ASSERT_EQ(0, OSD::read_stored_osdmap(g_ceph_context, store.get(), e, bl));
+    ASSERT_TRUE(bl.contents_equal(fulls[e])) << "epoch " << e;
+  }
+}
+
+TEST_F(OSDMapStoreTest, compressed_incompressible)
+{
+  // data that does not shrink is stored as is
+  set_conf("osd_map_compression", "zlib");
+  bufferlist raw;
+  raw.append("\x08", 1);
+  bufferlist sbl;
+  OSD::encode_stored_osdmap(g_ceph_context, raw, sbl);
+  ASSERT_TRUE(sbl.contents_equal(raw));
+}
+
+TEST_F(OSDMapStoreTest, compressed_corrupt)
+{
+  set_conf("osd_map_compression", "zlib");
+  write_maps();
+
+  // truncated after the marker
+  bufferlist bad;
+  ::encode((uint8_t)0xff, bad);
+  ObjectStore::Transaction t;
+  t.write(coll_t::meta(), OSD::get_osdmap_pobject_name(1), 0,
+	  bad.length(), bad);
+  t.truncate(coll_t::meta(), OSD::get_osdmap_pobject_name(1), bad.length());
+  ASSERT_EQ(0, store->apply_transaction(&osr, std::move(t)));
+
+  bufferlist bl;
+  ASSERT_EQ(-EIO, OSD::read_stored_osdmap(g_ceph_context, store.get(), 1, bl));
+
+  // unknown compressor
+  bad.clear();
+  ::encode((uint8_t)0xff, bad);
+  ::encode((uint8_t)0xfe, bad);
+  ::encode(fulls[2], bad);
+  ObjectStore::Transaction t2;
+  t2.write(coll_t::meta(), OSD::get_osdmap_pobject_name(2), 0,
+	   bad.length(), bad);
+  t2.truncate(coll_t::meta(), OSD::get_osdmap_pobject_name(2), bad.length());
+  ASSERT_EQ(0, store->apply_transaction(&osr, std::move(t2)));
+  ASSERT_EQ(-EIO, OSD::read_stored_osdmap(g_ceph_context, store.get(), 2, bl));
+}
@@ -0,0 +1,84 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include "osd/ScrubSleep.h"
+
+TEST(ScrubSleep, disabled)
+{
+  ScrubSleep s;
+  s.note_latency(10, 100);
+  ASSERT_EQ(.5, s.get_sleep(100, .5, 1, 0));
+  ASSERT_EQ(0, s.get_sleep(100, 0, 1, -1));
+}
+
+TEST(ScrubSleep, latency_average)
+{
+  ScrubSleep s;
+  ASSERT_EQ(0, s.get_latency(100));
+
+  // the first sample is taken as is
+  s.note_latency(1, 100);
+  ASSERT_DOUBLE_EQ(1, s.get_latency(100));
+
+  // samples are weighted by the time since the previous one
+  s.note_latency(0, 100);
+  ASSERT_DOUBLE_EQ(1, s.get_latency(100));
+  s.note_latency(0, 101);
+  ASSERT_DOUBLE_EQ(std::exp(-1), s.get_latency(101));
+
+  // and the average decays while idle
+  ASSERT_DOUBLE_EQ(std::exp(-3), s.get_latency(103));
+  ASSERT_DOUBLE_EQ(std::exp(-1), s.get_latency(101));
+
+  // a sample from a clock that went backwards does not count
+  s.note_latency(10, 99);
+  ASSERT_DOUBLE_EQ(std::exp(-1), s.get_latency(99));
+}
+
+TEST(ScrubSleep, backoff_and_recover)
+{
+  ScrubSleep s;
+  double base = .01, max = .1, target = .05;
+
+  s.note_latency(1, 100);
+  ASSERT_DOUBLE_EQ(.01, s.get_sleep(100, base, max, target));
+  ASSERT_DOUBLE_EQ(.02, s.get_sleep(100, base, max, target));
+  ASSERT_DOUBLE_EQ(.04, s.get_sleep(100, base, max, target));
+  ASSERT_DOUBLE_EQ(.08, s.get_sleep(100, base, max, target));
+  ASSERT_DOUBLE_EQ(.1, s.get_sleep(100, base, max, target));
+  ASSERT_DOUBLE_EQ(.1, s.get_sleep(100, base, max, target));
+
+  // clients recover
+  s.note_latency(.001, 110);
+  ASSERT_DOUBLE_EQ(.05, s.get_sleep(110, base, max, target));
+  ASSERT_DOUBLE_EQ(.025, s.get_sleep(110, base, max, target));
+  ASSERT_DOUBLE_EQ(.0125, s.get_sleep(110, base, max, target));
+  ASSERT_DOUBLE_EQ(base, s.get_sleep(110, base, max, target));
+  ASSERT_DOUBLE_EQ(base, s.get_sleep(110, base, max, target));
+}
+
+TEST(ScrubSleep, idle_after_spike)
+{
+  ScrubSleep s;
+  double base = 0, max = 1, target = .05;
+
+  // a load spike drives the sleep to the max ...
+  s.note_latency(2, 100);
+  double sleep = 0;
+  for (int i = 0; i < 20; ++i) {
+    sleep = s.get_sleep(100, base, max, target);
+  }
+  ASSERT_DOUBLE_EQ(max, sleep);
+
+  // ... while the latency stays above target without new samples ...
+  ASSERT_DOUBLE_EQ(max, s.get_sleep(101, base, max, target));
+
+  // ... but once the average decayed below target, without any client op,
+  // the sleep returns to the base
+  for (int i = 0; i < 20; ++i) {
+    sleep = s.get_sleep(110, base, max, target);
+  }
+  ASSERT_EQ(base, sleep);
+}
@@ -0,0 +1,110 @@
+#!/bin/bash
+#
+# Copyright (C) 2017 Red Hat <contact@redhat.com>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+
+source $(dirname $0)/../detect-build-env-vars.sh
+source $CEPH_ROOT/qa/workunits/ceph-helpers.sh
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7133" # git grep '\<7133\>' : there must be only one
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+    CEPH_ARGS+="--osd-max-backfills=1 "
+    CEPH_ARGS+="--osd-backfill-preemptible=true "
+    CEPH_ARGS+="--osd-recovery-sleep=0.5 "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+function wait_for_backfilling() {
+    local pgid=$1
+
+    for i in $(seq 1 60) ; do
+        ceph pg $pgid query | grep -q '"state": ".*backfilling' && return 0
+        sleep 0.5
+    done
+    return 1
+}
+
+#
+# A backfill preempted by a higher priority one queues its preemption
+# event.  Delay that event until the preempted backfill has completed
+# and verify the OSDs ignore it instead of crashing.
+#
+function TEST_backfill_late_preempt() {
+    local dir=$1
+    local delay=10
+
+    run_mon $dir a || return 1
+    run_mgr $dir x || return 1
+    for id in 0 1 2 ; do
+        run_osd $dir $id --osd-debug-backfill-preempt-delay=$delay || return 1
+    done
+
+    ceph osd set require_luminous_osds || return 1
+    ceph osd set-require-min-compat-client luminous || return 1
+
+    for pool in low high ; do
+        ceph osd pool create $pool 1 1 || return 1
+        ceph osd pool set $pool size 1 || return 1
+    done
+    ceph osd pool set high recovery_priority 10 || return 1
+    wait_for_clean || return 1
+
+    local low_pg=$(get_pg low obj0)
+    local high_pg=$(get_pg high obj0)
+    local low_osd=$(get_primary low obj0)
+    local high_osd=$(get_primary high obj0)
+    local target
+    for target in 0 1 2 ; do
+        if [ $target != $low_osd -a $target != $high_osd ] ; then
+            break
+        fi
+    done
+
+    for i in $(seq 0 5) ; do
+        rados -p low put obj$i /etc/group || return 1
+        rados -p high put obj$i /etc/group || return 1
+    done
+
+    ceph osd pg-upmap-items $low_pg $low_osd $target || return 1
+    wait_for_backfilling $low_pg || return 1
+    ceph osd pg-upmap-items $high_pg $high_osd $target || return 1
+
+    # the preemption events fire once the delay expires, well after both
+    # backfills are done
+    wait_for_clean || return 1
+    sleep $((delay + 5))
+    wait_for_clean || return 1
+
+    for id in 0 1 2 ; do
+        kill -0 $(cat $dir/osd.$id.pid) || return 1
+    done
+    grep -q "ignoring stale backfill preemption" $dir/osd.*.log || return 1
+}
+
+main osd-backfill-preempt "$@"
+
+# Local Variables:
+# compile-command: "cd ../.. ; make -j4 && test/osd/osd-backfill-preempt.sh"
+# End:
@@ -0,0 +1,114 @@
+#!/bin/bash
+#
+# Copyright (C) 2017 Red Hat <contact@redhat.com>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+
+source $(dirname $0)/../detect-build-env-vars.sh
+source $CEPH_ROOT/qa/workunits/ceph-helpers.sh
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7134" # git grep '\<7134\>' : there must be only one
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+    CEPH_ARGS+="--osd-recover-dirty-regions=true "
+    # a few chunks per object so that multi-push deltas are covered too
+    CEPH_ARGS+="--osd-recovery-max-chunk=65536 "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+#
+# Modify an object while one of its copies is down and verify that the
+# copy is brought up to date by pushing (or pulling) just the regions
+# that changed.
+#
+function modify_while_down() {
+    local dir=$1
+    local poolname=$2
+    local objname=$3
+    local down=$4
+    local expected=$5
+
+    ceph osd set noout || return 1
+    kill_daemons $dir TERM osd.$down || return 1
+    ceph osd down $down || return 1
+
+    dd if=/dev/urandom of=$dir/chunk bs=4096 count=1 || return 1
+    dd if=$dir/chunk of=$expected bs=4096 seek=300 conv=notrunc || return 1
+    rados --pool $poolname put $objname $dir/chunk --offset $((300 * 4096)) || return 1
+    rados --pool $poolname setomapval $objname key.$down value.$down || return 1
+    rados --pool $poolname rmomapkey $objname key.base || return 1
+    rados --pool $poolname setomapval $objname key.base value.$down || return 1
+
+    activate_osd $dir $down || return 1
+    ceph osd unset noout || return 1
+    wait_for_clean || return 1
+}
+
+function TEST_recovery_delta() {
+    local dir=$1
+    local poolname=rbd
+    local objname=obj
+
+    run_mon $dir a --osd_pool_default_size=2 || return 1
+    run_mgr $dir x || return 1
+    run_osd $dir 0 || return 1
+    run_osd $dir 1 || return 1
+    ceph osd pool set $poolname min_size 1 || return 1
+    wait_for_clean || return 1
+
+    local expected=$dir/expected
+    dd if=/dev/urandom of=$expected bs=4096 count=1024 || return 1
+    rados --pool $poolname put $objname $expected || return 1
+    rados --pool $poolname setomapval $objname key.base value.base || return 1
+
+    local primary=$(get_primary $poolname $objname)
+    local replica=$(get_not_primary $poolname $objname)
+
+    # a delta was computed from the pg log: a line like
+    # calc_dirty_regions 1:...:::obj:head 10'2 -> 12'5 ...
+    local delta="calc_dirty_regions .*:::$objname:head [0-9]*'[0-9]* -> "
+
+    # the primary misses the update and pulls it from the replica
+    modify_while_down $dir $poolname $objname $primary $expected || return 1
+    local pulls=$(grep -c "$delta" $dir/osd.$primary.log)
+    test $pulls -gt 0 || return 1
+
+    # the replica misses the update and gets it pushed by the primary
+    modify_while_down $dir $poolname $objname $replica $expected || return 1
+    test $(grep -c "$delta" $dir/osd.$primary.log) -gt $pulls || return 1
+
+    for id in $primary $replica ; do
+        objectstore_tool $dir $id $objname get-bytes $dir/copy.$id || return 1
+        cmp $expected $dir/copy.$id || return 1
+        [ "$(objectstore_tool $dir $id $objname list-omap | xargs)" = \
+          "key.0 key.1 key.base" ] || return 1
+        objectstore_tool $dir $id $objname get-omap key.base > $dir/value.$id || return 1
+        [ "$(cat $dir/value.$id)" = "value.$replica" ] || return 1
+    done
+}
+
+main osd-recovery-delta "$@"
+
+# Local Variables:
+# compile-command: "cd ../.. ; make -j4 && test/osd/osd-recovery-delta.sh"
+# End:
@@ -1057,6 +1057,56 @@ TEST(pg_missing_t, split_into)
   EXPECT_TRUE(missing.is_missing(oid2));
 }
 
+TEST(object_dirty_regions_t, merge)
+{
+  object_dirty_regions_t r;
+  EXPECT_TRUE(r.is_all());
+  r.start_tracking();
+  r.mark_data(0, 4096);
+  r.mark_omap_key("a");
+
+  object_dirty_regions_t o;
+  o.start_tracking();
+  o.mark_data(4096, 4096);
+  o.mark_data(65536, 100);
+  o.mark_omap_key("b");
+  r.merge(o);
+  EXPECT_FALSE(r.is_all());
+  EXPECT_EQ(2u, r.data.num_intervals());
+  EXPECT_EQ(8192u + 100u, r.data.size());
+  EXPECT_EQ(2u, r.omap_keys.size());
+
+  o.mark_omap_all();
+  r.merge(o);
+  EXPECT_TRUE(r.omap_all);
+  EXPECT_TRUE(r.omap_keys.empty());
+
+  // an untracked update poisons the lot
+  r.merge(object_dirty_regions_t());
+  EXPECT_TRUE(r.is_all());
+  r.merge(o);
+  EXPECT_TRUE(r.is_all());
+}
+
+TEST(object_dirty_regions_t, limit)
+{
+  object_dirty_regions_t r;
+  r.start_tracking();
+  for (unsigned i = 0; i < 10; ++i) {
+    r.mark_data(i * 8192, 4096);
+    r.mark_omap_key(stringify(i));
+  }
+  r.limit(16, 16);
+  EXPECT_EQ(10u, r.data.num_intervals());
+  EXPECT_EQ(10u, r.omap_keys.size());
+  r.limit(4, 4);
+  EXPECT_EQ(1u, r.data.num_intervals());
+  EXPECT_EQ(0u, r.data.range_start());
+  EXPECT_EQ(9u * 8192 + 4096, r.data.range_end());
+  EXPECT_TRUE(r.omap_all);
+  EXPECT_FALSE(r.is_all());
+}
+
 class ObjectContextTest : public ::testing::Test {
 protected:
 
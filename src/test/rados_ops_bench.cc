@@ -0,0 +1,290 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Small object librados benchmark: keeps a fixed number of tiny ops in
+ * flight from each thread against a single client instance and reports
+ * the achieved op rate along with the client CPU time spent per op, i.e.
+ * how many ops a single core can drive through the client side stack.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cassert>
+#include <deque>
+#include <sstream>
+#include <thread>
+#include <sys/resource.h>
+
+#include "include/rados/librados.hpp"
+
+#include "global/global_init.h"
+#include "global/global_context.h"
+
+#include "common/ceph_argparse.h"
+#include "common/debug.h"
+#include "common/errno.h"
+
+#define dout_context g_ceph_context
+#define dout_subsys ceph_subsys_rados
+
+static void usage()
+{
+  derr << "usage: ceph_rados_ops_bench [flags]\n"
+      "	 --pool\n"
+      "	       pool to run the workload against (default rbd)\n"
+      "	 --op\n"
+      "	       write, read or stat (default write)\n"
+      "	 --size\n"
+      "	       object size in bytes (default 16)\n"
+      "	 --objects\n"
+      "	       number of objects per thread (default 128)\n"
+      "	 --ops\n"
+      "	       number of ops issued by each thread (default 100000)\n"
+      "	 --threads\n"
+      "	       number of threads sharing the client (default 1)\n"
+      "	 --depth\n"
+      "	       number of ops in flight per thread (default 16)\n"
+      "	 --no-cleanup\n"
+      "	       keep the objects once done\n" << dendl;
+  generic_client_usage();
+}
+
+enum OpType {
+  OP_WRITE,
+  OP_READ,
+  OP_STAT
+};
+
+struct Config {
+  std::string pool;
+  OpType op;
+  size_t size;
+  int objects;
+  int ops;
+  int threads;
+  int depth;
+  bool cleanup;
+  Config()
+    : pool("rbd"), op(OP_WRITE), size(16), objects(128), ops(100000),
+      threads(1), depth(16), cleanup(true) {}
+};
+
+static std::string object_name(int thread, int i)
+{
+  std::ostringstream oss;
+  oss << "rados_ops_bench." << thread << "." << i;
+  return oss.str();
+}
+
+struct InFlight {
+  librados::AioCompletion *completion;
+  bufferlist bl;
+  uint64_t size;
+  time_t mtime;
+
+  InFlight() : completion(librados::Rados::aio_create_completion()),
+               size(0), mtime(0) {}
+};
+
+static int bench_worker(librados::IoCtx *io_ctx, const Config &cfg,
+                        int thread, OpType op, int ops)
+{
+  bufferlist data;
+  data.append(buffer::create(cfg.size));
+  data.zero();
+
+  std::deque<InFlight*> in_flight;
+  int r = 0;
+  for (int i = 0; i < ops || !in_flight.empty(); ) {
+    if (i < ops && (int)in_flight.size() < cfg.depth) {
+      InFlight *f = new InFlight();
+      std::string oid = object_name(thread, i % cfg.objects);
+      int ret;
+      switch (op) {
+      case OP_WRITE:
+        ret = io_ctx->aio_write_full(oid, f->completion, data);
+        break;
+      case OP_READ:
+        ret = io_ctx->aio_read(oid, f->completion, &f->bl, cfg.size, 0);
+        break;
+      default:
+        ret = io_ctx->aio_stat(oid, f->completion, &f->size, &f->mtime);
+        break;
+      }
+      assert(ret == 0);
+      in_flight.push_back(f);
+      ++i;
+      continue;
+    }
+
+    InFlight *f = in_flight.front();
+    in_flight.pop_front();
+    f->completion->wait_for_complete();
+    int ret = f->completion->get_return_value();
+    if (ret < 0 && r == 0) {
+      r = ret;
+    }
+    f->completion->release();
+    delete f;
+  }
+  return r;
+}
+
+static double cpu_seconds()
+{
+  struct rusage usage;
+  int r = ::getrusage(RUSAGE_SELF, &usage);
+  assert(r == 0);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+}
+
+static int run_workload(librados::IoCtx &io_ctx, const Config &cfg, OpType op,
+                        int ops, const char *what)
+{
+  std::vector<std::thread> workers;
+  std::vector<int> results(cfg.threads, 0);
+  workers.reserve(cfg.threads);
+
+  using namespace std::chrono;
+  double cpu1 = cpu_seconds();
+  auto t1 = high_resolution_clock::now();
+  for (int i = 0; i < cfg.threads; i++) {
+    workers.emplace_back([&io_ctx, &cfg, &results, op, ops, i]() {
+        results[i] = bench_worker(&io_ctx, cfg, i, op, ops);
+      });
+  }
+  for (auto &worker : workers)
+    worker.join();
+  auto t2 = high_resolution_clock::now();
+  double cpu = cpu_seconds() - cpu1;
+
+  for (auto r : results) {
+    if (r < 0) {
+      derr << what << " failed: " << cpp_strerror(r) << dendl;
+      return r;
+    }
+  }
+
+  auto duration = duration_cast<microseconds>(t2 - t1);
+  uint64_t total = (uint64_t)ops * cfg.threads;
+  uint64_t rate = (1000000LL * total) / std::max<int64_t>(duration.count(), 1);
+  dout(0) << what << " " << total << " ops in " << duration.count()
+          << "us, at a rate of " << rate << " ops/s using " << cpu
+          << "s cpu: " << (uint64_t)(total / std::max(cpu, 0.000001))
+          << " ops/s per core, "
+          << (uint64_t)(cpu * 1000000000.0 / std::max<uint64_t>(total, 1))
+          << "ns cpu per op" << dendl;
+  return 0;
+}
+
+int main(int argc, const char *argv[])
+{
+  Config cfg;
+
+  // command-line arguments
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  auto cct = global_init(nullptr, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY, 0);
+
+  std::string val;
+  vector<const char*>::iterator i = args.begin();
+  while (i != args.end()) {
+    if (ceph_argparse_double_dash(args, i))
+      break;
+
+    if (ceph_argparse_witharg(args, i, &val, "--pool", (char*)nullptr)) {
+      cfg.pool = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--op", (char*)nullptr)) {
+      if (val == "write") {
+        cfg.op = OP_WRITE;
+      } else if (val == "read") {
+        cfg.op = OP_READ;
+      } else if (val == "stat") {
+        cfg.op = OP_STAT;
+      } else {
+        derr << "unknown op: " << val << dendl;
+        usage();
+        return 1;
+      }
+    } else if (ceph_argparse_witharg(args, i, &val, "--size", (char*)nullptr)) {
+      cfg.size = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--objects", (char*)nullptr)) {
+      cfg.objects = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--ops", (char*)nullptr)) {
+      cfg.ops = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--threads", (char*)nullptr)) {
+      cfg.threads = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--depth", (char*)nullptr)) {
+      cfg.depth = atoi(val.c_str());
+    } else if (ceph_argparse_flag(args, i, "--no-cleanup", (char*)nullptr)) {
+      cfg.cleanup = false;
+    } else {
+      derr << "Error: can't understand argument: " << *i << "\n" << dendl;
+      usage();
+      return 1;
+    }
+  }
+
+  if (cfg.objects <= 0 || cfg.ops <= 0 || cfg.threads <= 0 || cfg.depth <= 0) {
+    derr << "objects, ops, threads and depth must be positive" << dendl;
+    usage();
+    return 1;
+  }
+
+  common_init_finish(g_ceph_context);
+
+  dout(0) << "pool " << cfg.pool << dendl;
+  dout(0) << "size " << cfg.size << dendl;
+  dout(0) << "objects " << cfg.objects << dendl;
+  dout(0) << "ops " << cfg.ops << dendl;
+  dout(0) << "threads " << cfg.threads << dendl;
+  dout(0) << "depth " << cfg.depth << dendl;
+
+  librados::Rados rados;
+  int r = rados.init_with_context(g_ceph_context);
+  if (r < 0) {
+    derr << "failed to initialize rados: " << cpp_strerror(r) << dendl;
+    return 1;
+  }
+  r = rados.connect();
+  if (r < 0) {
+    derr << "failed to connect: " << cpp_strerror(r) << dendl;
+    return 1;
+  }
+
+  librados::IoCtx io_ctx;
+  r = rados.ioctx_create(cfg.pool.c_str(), io_ctx);
+  if (r < 0) {
+    derr << "failed to open pool " << cfg.pool << ": " << cpp_strerror(r)
+         << dendl;
+    rados.shutdown();
+    return 1;
+  }
+
+  // reads and stats need the objects to exist
+  if (cfg.op != OP_WRITE) {
+    r = run_workload(io_ctx, cfg, OP_WRITE, cfg.objects, "prepare");
+  }
+  if (r == 0) {
+    r = run_workload(io_ctx, cfg, cfg.op, cfg.ops,
+                     cfg.op == OP_WRITE ? "write" :
+                       (cfg.op == OP_READ ? "read" : "stat"));
+  }
+
+  if (cfg.cleanup) {
+    for (int t = 0; t < cfg.threads; t++) {
+      for (int o = 0; o < std::min(cfg.objects, cfg.ops); o++) {
+        io_ctx.remove(object_name(t, o));
+      }
+    }
+  }
+
+  io_ctx.close();
+  rados.shutdown();
+  return r < 0 ? 1 : 0;
+}
@@ -0,0 +1,314 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "test/rbd_mirror/test_mock_fixture.h"
+#include "include/interval_set.h"
+#include "include/rbd/librbd.hpp"
+#include "librbd/ImageCtx.h"
+#include "librbd/ImageState.h"
+#include "librbd/io/AioCompletion.h"
+#include "librbd/io/ImageRequestWQ.h"
+#include "test/librados_test_stub/MockTestMemIoCtxImpl.h"
+#include "test/librbd/mock/MockImageCtx.h"
+#include "tools/rbd_mirror/Threads.h"
+#include "tools/rbd_mirror/image_replayer/SnapshotObjectCopyRequest.h"
+
+namespace librbd {
+namespace {
+
+struct MockTestImageCtx : public librbd::MockImageCtx {
+  MockTestImageCtx(librbd::ImageCtx &image_ctx)
+    : librbd::MockImageCtx(image_ctx) {
+  }
+};
+
+} // anonymous namespace
+} // namespace librbd
+
+// template definitions
+#include "tools/rbd_mirror/image_replayer/SnapshotObjectCopyRequest.cc"
+template class rbd::mirror::image_replayer::SnapshotObjectCopyRequest<librbd::MockTestImageCtx>;
+
+namespace rbd {
+namespace mirror {
+namespace image_replayer {
+
+using ::testing::_;
+using ::testing::DoDefault;
+using ::testing::InSequence;
+using ::testing::Invoke;
+using ::testing::Return;
+using ::testing::WithArg;
+
+class TestMockImageReplayerSnapshotObjectCopyRequest : public TestMockFixture {
+public:
+  typedef SnapshotObjectCopyRequest<librbd::MockTestImageCtx> MockSnapshotObjectCopyRequest;
+
+  void SetUp() override {
+    TestMockFixture::SetUp();
+
+    librbd::RBD rbd;
+    ASSERT_EQ(0, create_image(rbd, m_remote_io_ctx, m_image_name, m_image_size));
+    ASSERT_EQ(0, open_image(m_remote_io_ctx, m_image_name, &m_remote_image_ctx));
+
+    ASSERT_EQ(0, create_image(rbd, m_local_io_ctx, m_image_name, m_image_size));
+    ASSERT_EQ(0, open_image(m_local_io_ctx, m_image_name, &m_local_image_ctx));
+  }
+
+  void write(uint64_t off, uint64_t len) {
+    bufferlist bl;
+    bl.append(std::string(len, '1'));
+    ASSERT_EQ(static_cast<int>(len),
+              m_remote_image_ctx->io_work_queue->write(off, len,
+                                                       std::move(bl), 0));
+  }
+
+  void expect_get_object_name(librbd::MockTestImageCtx &mock_image_ctx) {
+    EXPECT_CALL(mock_image_ctx, get_object_name(0))
+      .WillOnce(Return(mock_image_ctx.image_ctx->get_object_name(0)));
+  }
+
+  void expect_set_snap_read(librados::MockTestMemIoCtxImpl &mock_io_ctx,
+                            uint64_t snap_id) {
+    EXPECT_CALL(mock_io_ctx, set_snap_read(snap_id));
+  }
+
+  void expect_list_snaps(librbd::MockTestImageCtx &mock_image_ctx,
+                         librados::MockTestMemIoCtxImpl &mock_io_ctx, int r) {
+    expect_set_snap_read(mock_io_ctx, CEPH_SNAPDIR);
+    auto &expect = EXPECT_CALL(mock_io_ctx,
+                               list_snaps(mock_image_ctx.image_ctx->get_object_name(0),
+                                          _));
+    if (r < 0) {
+      expect.WillOnce(Return(r));
+    } else {
+      expect.WillOnce(DoDefault());
+    }
+  }
+
+  void expect_read(librados::MockTestMemIoCtxImpl &mock_io_ctx,
+                   uint64_t offset, uint64_t length, int r) {
+    auto &expect = EXPECT_CALL(mock_io_ctx, read(_, length, offset, _));
+    if (r < 0) {
+      expect.WillOnce(Return(r));
+    } else {
+      expect.WillOnce(DoDefault());
+    }
+  }
+
+  void expect_aio_write(librbd::MockTestImageCtx &mock_image_ctx,
+                        uint64_t offset, uint64_t length, int r) {
+    EXPECT_CALL(*mock_image_ctx.io_work_queue,
+                aio_write_mock(_, offset, length, _, _))
+      .WillOnce(WithArg<0>(Invoke([this, &mock_image_ctx, r](librbd::io::AioCompletion *aio_comp) {
+          complete_aio(mock_image_ctx, aio_comp, r);
+        })));
+  }
+
+  void expect_aio_discard(librbd::MockTestImageCtx &mock_image_ctx,
+                          uint64_t offset, uint64_t length, int r) {
+    EXPECT_CALL(*mock_image_ctx.io_work_queue,
+                aio_discard(_, offset, length, false))
+      .WillOnce(WithArg<0>(Invoke([this, &mock_image_ctx, r](librbd::io::AioCompletion *aio_comp) {
+          complete_aio(mock_image_ctx, aio_comp, r);
+        })));
+  }
+
+  void complete_aio(librbd::MockTestImageCtx &mock_image_ctx,
+                    librbd::io::AioCompletion *aio_comp, int r) {
+    m_threads->work_queue->queue(new FunctionContext(
+      [&mock_image_ctx, aio_comp](int r) {
+        aio_comp->get();
+        aio_comp->init_time(mock_image_ctx.image_ctx,
+                            librbd::io::AIO_TYPE_NONE);
+        aio_comp->set_request_count(1);
+        aio_comp->complete_request(r);
+      }), r);
+  }
+
+  MockSnapshotObjectCopyRequest *create_request(
+      librbd::MockTestImageCtx &mock_local_image_ctx,
+      librbd::MockTestImageCtx &mock_remote_image_ctx,
+      librados::snap_t from_snap_id, librados::snap_t to_snap_id,
+      Context *on_finish) {
+    expect_get_object_name(mock_remote_image_ctx);
+    return new MockSnapshotObjectCopyRequest(&mock_local_image_ctx,
+                                             &mock_remote_image_ctx,
+                                             from_snap_id, to_snap_id, 0,
+                                             on_finish);
+  }
+
+  librbd::ImageCtx *m_remote_image_ctx;
+  librbd::ImageCtx *m_local_image_ctx;
+};
+
+TEST_F(TestMockImageReplayerSnapshotObjectCopyRequest, DNE) {
+  librados::snap_t snap_id;
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, "snap", &snap_id));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                0, snap_id, &ctx);
+  librados::MockTestMemIoCtxImpl &mock_remote_io_ctx(get_mock_io_ctx(
+    request->get_remote_io_ctx()));
+
+  InSequence seq;
+  expect_list_snaps(mock_remote_image_ctx, mock_remote_io_ctx, -ENOENT);
+
+  request->send();
+  ASSERT_EQ(0, ctx.wait());
+}
+
+TEST_F(TestMockImageReplayerSnapshotObjectCopyRequest, Write) {
+  write(0, 4096);
+  write(8192, 4096);
+
+  librados::snap_t snap_id;
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, "snap", &snap_id));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                0, snap_id, &ctx);
+  librados::MockTestMemIoCtxImpl &mock_remote_io_ctx(get_mock_io_ctx(
+    request->get_remote_io_ctx()));
+
+  InSequence seq;
+  expect_list_snaps(mock_remote_image_ctx, mock_remote_io_ctx, 0);
+  expect_set_snap_read(mock_remote_io_ctx, snap_id);
+  expect_read(mock_remote_io_ctx, 0, 12288, 0);
+  expect_aio_write(mock_local_image_ctx, 0, 12288, 0);
+
+  request->send();
+  ASSERT_EQ(0, ctx.wait());
+}
+
+TEST_F(TestMockImageReplayerSnapshotObjectCopyRequest, Unchanged) {
+  write(0, 4096);
+
+  librados::snap_t snap_id1;
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, "snap1", &snap_id1));
+  librados::snap_t snap_id2;
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, "snap2", &snap_id2));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                snap_id1, snap_id2, &ctx);
+  librados::MockTestMemIoCtxImpl &mock_remote_io_ctx(get_mock_io_ctx(
+    request->get_remote_io_ctx()));
+
+  InSequence seq;
+  expect_list_snaps(mock_remote_image_ctx, mock_remote_io_ctx, 0);
+
+  request->send();
+  ASSERT_EQ(0, ctx.wait());
+}
+
+TEST_F(TestMockImageReplayerSnapshotObjectCopyRequest, Remove) {
+  write(0, 4096);
+
+  librados::snap_t snap_id1;
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, "snap1", &snap_id1));
+  uint64_t object_size = 1 << m_remote_image_ctx->order;
+  ASSERT_LE(0, m_remote_image_ctx->io_work_queue->discard(0, object_size,
+                                                          false));
+  librados::snap_t snap_id2;
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, "snap2", &snap_id2));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                snap_id1, snap_id2, &ctx);
+  librados::MockTestMemIoCtxImpl &mock_remote_io_ctx(get_mock_io_ctx(
+    request->get_remote_io_ctx()));
+
+  InSequence seq;
+  expect_list_snaps(mock_remote_image_ctx, mock_remote_io_ctx, 0);
+  expect_aio_discard(mock_local_image_ctx, 0, 4096, 0);
+
+  request->send();
+  ASSERT_EQ(0, ctx.wait());
+}
+
+TEST_F(TestMockImageReplayerSnapshotObjectCopyRequest, ListSnapsError) {
+  librados::snap_t snap_id;
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, "snap", &snap_id));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                0, snap_id, &ctx);
+  librados::MockTestMemIoCtxImpl &mock_remote_io_ctx(get_mock_io_ctx(
+    request->get_remote_io_ctx()));
+
+  InSequence seq;
+  expect_list_snaps(mock_remote_image_ctx, mock_remote_io_ctx, -EINVAL);
+
+  request->send();
+  ASSERT_EQ(-EINVAL, ctx.wait());
+}
+
+TEST_F(TestMockImageReplayerSnapshotObjectCopyRequest, ReadError) {
+  write(0, 4096);
+
+  librados::snap_t snap_id;
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, "snap", &snap_id));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                0, snap_id, &ctx);
+  librados::MockTestMemIoCtxImpl &mock_remote_io_ctx(get_mock_io_ctx(
+    request->get_remote_io_ctx()));
+
+  InSequence seq;
+  expect_list_snaps(mock_remote_image_ctx, mock_remote_io_ctx, 0);
+  expect_set_snap_read(mock_remote_io_ctx, snap_id);
+  expect_read(mock_remote_io_ctx, 0, 4096, -EIO);
+
+  request->send();
+  ASSERT_EQ(-EIO, ctx.wait());
+}
+
+TEST_F(TestMockImageReplayerSnapshotObjectCopyRequest, WriteError) {
+  write(0, 4096);
+
+  librados::snap_t snap_id;
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, "snap", &snap_id));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                0, snap_id, &ctx);
+  librados::MockTestMemIoCtxImpl &mock_remote_io_ctx(get_mock_io_ctx(
+    request->get_remote_io_ctx()));
+
+  InSequence seq;
+  expect_list_snaps(mock_remote_image_ctx, mock_remote_io_ctx, 0);
+  expect_set_snap_read(mock_remote_io_ctx, snap_id);
+  expect_read(mock_remote_io_ctx, 0, 4096, 0);
+  expect_aio_write(mock_local_image_ctx, 0, 4096, -EIO);
+
+  request->send();
+  ASSERT_EQ(-EIO, ctx.wait());
+}
+
+} // namespace image_replayer
+} // namespace mirror
+} // namespace rbd
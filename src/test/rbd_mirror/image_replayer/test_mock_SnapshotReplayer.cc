@@ -0,0 +1,595 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "test/rbd_mirror/test_mock_fixture.h"
+#include "include/rbd/librbd.hpp"
+#include "librbd/ImageCtx.h"
+#include "librbd/ImageState.h"
+#include "librbd/Operations.h"
+#include "librbd/mirror/SnapshotUtils.h"
+#include "tools/rbd_mirror/Threads.h"
+#include "tools/rbd_mirror/image_replayer/CloseImageRequest.h"
+#include "tools/rbd_mirror/image_replayer/CreateImageRequest.h"
+#include "tools/rbd_mirror/image_replayer/OpenImageRequest.h"
+#include "tools/rbd_mirror/image_replayer/OpenLocalImageRequest.h"
+#include "tools/rbd_mirror/image_replayer/SnapshotReplayer.h"
+#include "tools/rbd_mirror/image_replayer/SnapshotSyncRequest.h"
+#include "test/librados_test_stub/MockTestMemIoCtxImpl.h"
+#include "test/librbd/mock/MockImageCtx.h"
+#include <boost/scope_exit.hpp>
+
+namespace librbd {
+
+namespace {
+
+struct MockTestImageCtx : public librbd::MockImageCtx {
+  MockTestImageCtx(librbd::ImageCtx &image_ctx)
+    : librbd::MockImageCtx(image_ctx) {
+  }
+};
+
+} // anonymous namespace
+} // namespace librbd
+
+namespace rbd {
+namespace mirror {
+namespace image_replayer {
+
+template<>
+struct CloseImageRequest<librbd::MockTestImageCtx> {
+  static CloseImageRequest* s_instance;
+  librbd::MockTestImageCtx **image_ctx = nullptr;
+  Context *on_finish = nullptr;
+
+  static CloseImageRequest* create(librbd::MockTestImageCtx **image_ctx,
+                                   Context *on_finish) {
+    assert(s_instance != nullptr);
+    s_instance->image_ctx = image_ctx;
+    s_instance->on_finish = on_finish;
+    s_instance->construct(*image_ctx);
+    return s_instance;
+  }
+
+  CloseImageRequest() {
+    assert(s_instance == nullptr);
+    s_instance = this;
+  }
+  ~CloseImageRequest() {
+    s_instance = nullptr;
+  }
+
+  MOCK_METHOD1(construct, void(librbd::MockTestImageCtx *image_ctx));
+  MOCK_METHOD0(send, void());
+};
+
+template<>
+struct CreateImageRequest<librbd::MockTestImageCtx> {
+  static CreateImageRequest* s_instance;
+  std::string *local_image_id = nullptr;
+  Context *on_finish = nullptr;
+
+  static CreateImageRequest* create(librados::IoCtx &local_io_ctx,
+                                    ContextWQ *work_queue,
+                                    const std::string &global_image_id,
+                                    const std::string &remote_mirror_uuid,
+                                    const std::string &local_image_name,
+                                    librbd::MockTestImageCtx *remote_image_ctx,
+                                    std::string *local_image_id,
+                                    Context *on_finish) {
+    assert(s_instance != nullptr);
+    s_instance->local_image_id = local_image_id;
+    s_instance->on_finish = on_finish;
+    return s_instance;
+  }
+
+  CreateImageRequest() {
+    assert(s_instance == nullptr);
+    s_instance = this;
+  }
+  ~CreateImageRequest() {
+    s_instance = nullptr;
+  }
+
+  MOCK_METHOD0(send, void());
+};
+
+template<>
+struct OpenImageRequest<librbd::MockTestImageCtx> {
+  static OpenImageRequest* s_instance;
+  librbd::MockTestImageCtx **image_ctx = nullptr;
+  Context *on_finish = nullptr;
+
+  static OpenImageRequest* create(librados::IoCtx &io_ctx,
+                                  librbd::MockTestImageCtx **image_ctx,
+                                  const std::string &image_id,
+                                  bool read_only, Context *on_finish) {
+    assert(s_instance != nullptr);
+    s_instance->image_ctx = image_ctx;
+    s_instance->on_finish = on_finish;
+    s_instance->construct(io_ctx, image_id);
+    return s_instance;
+  }
+
+  OpenImageRequest() {
+    assert(s_instance == nullptr);
+    s_instance = this;
+  }
+  ~OpenImageRequest() {
+    s_instance = nullptr;
+  }
+
+  MOCK_METHOD2(construct, void(librados::IoCtx &io_ctx,
+                               const std::string &image_id));
+  MOCK_METHOD0(send, void());
+};
+
+template<>
+struct OpenLocalImageRequest<librbd::MockTestImageCtx> {
+  static OpenLocalImageRequest* s_instance;
+  librbd::MockTestImageCtx **image_ctx = nullptr;
+  Context *on_finish = nullptr;
+
+  static OpenLocalImageRequest* create(librados::IoCtx &local_io_ctx,
+                                       librbd::MockTestImageCtx **local_image_ctx,
+                                       const std::string &local_image_id,
+                                       ContextWQ *work_queue,
+                                       Context *on_finish) {
+    assert(s_instance != nullptr);
+    s_instance->image_ctx = local_image_ctx;
+    s_instance->on_finish = on_finish;
+    s_instance->construct(local_io_ctx, local_image_id);
+    return s_instance;
+  }
+
+  OpenLocalImageRequest() {
+    assert(s_instance == nullptr);
+    s_instance = this;
+  }
+  ~OpenLocalImageRequest() {
+    s_instance = nullptr;
+  }
+
+  MOCK_METHOD2(construct, void(librados::IoCtx &io_ctx,
+                               const std::string &image_id));
+  MOCK_METHOD0(send, void());
+};
+
+template<>
+struct SnapshotSyncRequest<librbd::MockTestImageCtx> {
+  static SnapshotSyncRequest* s_instance;
+  std::string *snap_uuid = nullptr;
+  bool *demoted = nullptr;
+  Context *on_finish = nullptr;
+
+  static SnapshotSyncRequest* create(librbd::MockTestImageCtx *local_image_ctx,
+                                     librbd::MockTestImageCtx *remote_image_ctx,
+                                     const std::string &local_mirror_uuid,
+                                     std::string *snap_uuid, bool *demoted,
+                                     Context *on_finish) {
+    assert(s_instance != nullptr);
+    s_instance->snap_uuid = snap_uuid;
+    s_instance->demoted = demoted;
+    s_instance->on_finish = on_finish;
+    return s_instance;
+  }
+
+  SnapshotSyncRequest() {
+    assert(s_instance == nullptr);
+    s_instance = this;
+  }
+  ~SnapshotSyncRequest() {
+    s_instance = nullptr;
+  }
+
+  MOCK_METHOD0(send, void());
+  MOCK_METHOD0(cancel, void());
+};
+
+CloseImageRequest<librbd::MockTestImageCtx>*
+  CloseImageRequest<librbd::MockTestImageCtx>::s_instance = nullptr;
+CreateImageRequest<librbd::MockTestImageCtx>*
+  CreateImageRequest<librbd::MockTestImageCtx>::s_instance = nullptr;
+OpenImageRequest<librbd::MockTestImageCtx>*
+  OpenImageRequest<librbd::MockTestImageCtx>::s_instance = nullptr;
+OpenLocalImageRequest<librbd::MockTestImageCtx>*
+  OpenLocalImageRequest<librbd::MockTestImageCtx>::s_instance = nullptr;
+SnapshotSyncRequest<librbd::MockTestImageCtx>*
+  SnapshotSyncRequest<librbd::MockTestImageCtx>::s_instance = nullptr;
+
+} // namespace image_replayer
+} // namespace mirror
+} // namespace rbd
+
+// template definitions
+#include "tools/rbd_mirror/image_replayer/SnapshotReplayer.cc"
+template class rbd::mirror::image_replayer::SnapshotReplayer<librbd::MockTestImageCtx>;
+
+namespace rbd {
+namespace mirror {
+namespace image_replayer {
+
+using ::testing::_;
+using ::testing::InSequence;
+using ::testing::Invoke;
+using ::testing::StrEq;
+
+class TestMockImageReplayerSnapshotReplayer : public TestMockFixture {
+public:
+  typedef SnapshotReplayer<librbd::MockTestImageCtx> MockSnapshotReplayer;
+  typedef CloseImageRequest<librbd::MockTestImageCtx> MockCloseImageRequest;
+  typedef CreateImageRequest<librbd::MockTestImageCtx> MockCreateImageRequest;
+  typedef OpenImageRequest<librbd::MockTestImageCtx> MockOpenImageRequest;
+  typedef OpenLocalImageRequest<librbd::MockTestImageCtx> MockOpenLocalImageRequest;
+  typedef SnapshotSyncRequest<librbd::MockTestImageCtx> MockSnapshotSyncRequest;
+
+  struct MockListener : public MockSnapshotReplayer::Listener {
+    MOCK_METHOD2(handle_replay_complete, void(int, const std::string &));
+  };
+
+  void SetUp() override {
+    TestMockFixture::SetUp();
+
+    librbd::RBD rbd;
+    ASSERT_EQ(0, create_image(rbd, m_remote_io_ctx, m_image_name, m_image_size));
+    ASSERT_EQ(0, open_image(m_remote_io_ctx, m_image_name, &m_remote_image_ctx));
+
+    ASSERT_EQ(0, create_image(rbd, m_local_io_ctx, m_image_name, m_image_size));
+    ASSERT_EQ(0, open_image(m_local_io_ctx, m_image_name, &m_local_image_ctx));
+  }
+
+  int create_primary_snap() {
+    std::string snap_name = librbd::mirror::snapshot::get_snap_name(
+      librbd::mirror::snapshot::STATE_PRIMARY, "", "uuid1");
+    return create_snap(m_remote_image_ctx, snap_name.c_str(), nullptr);
+  }
+
+  void expect_open_image(MockOpenImageRequest &mock_open_image_request,
+                         const std::string &image_id,
+                         librbd::MockTestImageCtx &mock_image_ctx, int r) {
+    EXPECT_CALL(mock_open_image_request, construct(_, image_id));
+    EXPECT_CALL(mock_open_image_request, send())
+      .WillOnce(Invoke([this, &mock_open_image_request, &mock_image_ctx, r]() {
+          *mock_open_image_request.image_ctx = &mock_image_ctx;
+          m_threads->work_queue->queue(mock_open_image_request.on_finish, r);
+        }));
+  }
+
+  void expect_create_image(MockCreateImageRequest &mock_create_image_request,
+                           const std::string &image_id, int r) {
+    EXPECT_CALL(mock_create_image_request, send())
+      .WillOnce(Invoke([this, &mock_create_image_request, image_id, r]() {
+          *mock_create_image_request.local_image_id = image_id;
+          m_threads->work_queue->queue(mock_create_image_request.on_finish, r);
+        }));
+  }
+
+  void expect_open_local_image(MockOpenLocalImageRequest &mock_open_local_image_request,
+                               const std::string &image_id,
+                               librbd::MockTestImageCtx *mock_image_ctx, int r) {
+    EXPECT_CALL(mock_open_local_image_request, construct(_, image_id));
+    EXPECT_CALL(mock_open_local_image_request, send())
+      .WillOnce(Invoke([this, &mock_open_local_image_request, mock_image_ctx, r]() {
+          *mock_open_local_image_request.image_ctx = mock_image_ctx;
+          m_threads->work_queue->queue(mock_open_local_image_request.on_finish,
+                                       r);
+        }));
+  }
+
+  void expect_close_image(MockCloseImageRequest &mock_close_image_request,
+                          librbd::MockTestImageCtx &mock_image_ctx, int r) {
+    EXPECT_CALL(mock_close_image_request, construct(&mock_image_ctx));
+    EXPECT_CALL(mock_close_image_request, send())
+      .WillOnce(Invoke([this, &mock_close_image_request, r]() {
+          *mock_close_image_request.image_ctx = nullptr;
+          m_threads->work_queue->queue(mock_close_image_request.on_finish, r);
+        }));
+  }
+
+  void expect_sync(MockSnapshotSyncRequest &mock_sync_request,
+                   C_SaferCond *on_send) {
+    EXPECT_CALL(mock_sync_request, send())
+      .WillOnce(Invoke([on_send]() {
+          on_send->complete(0);
+        }));
+  }
+
+  void expect_sync_cancel(MockSnapshotSyncRequest &mock_sync_request) {
+    EXPECT_CALL(mock_sync_request, cancel());
+  }
+
+  void complete_sync(MockSnapshotSyncRequest &mock_sync_request,
+                     const std::string &snap_uuid, bool demoted, int r) {
+    *mock_sync_request.snap_uuid = snap_uuid;
+    *mock_sync_request.demoted = demoted;
+    mock_sync_request.on_finish->complete(r);
+  }
+
+  void expect_replay_complete(MockListener &mock_listener, int r,
+                              const std::string &desc, C_SaferCond *ctx) {
+    EXPECT_CALL(mock_listener, handle_replay_complete(r, StrEq(desc)))
+      .WillOnce(Invoke([ctx](int r, const std::string &desc) {
+          ctx->complete(0);
+        }));
+  }
+
+  MockSnapshotReplayer *create_replayer(const std::string &local_image_id,
+                                        MockListener &mock_listener) {
+    return new MockSnapshotReplayer(m_threads, m_local_io_ctx,
+                                    m_remote_io_ctx, "global image id",
+                                    "local mirror uuid", "remote mirror uuid",
+                                    m_remote_image_ctx->id, local_image_id,
+                                    &mock_listener);
+  }
+
+  librbd::ImageCtx *m_remote_image_ctx;
+  librbd::ImageCtx *m_local_image_ctx;
+};
+
+TEST_F(TestMockImageReplayerSnapshotReplayer, InitShutDown) {
+  ASSERT_EQ(0, create_primary_snap());
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  MockOpenImageRequest mock_open_image_request;
+  MockOpenLocalImageRequest mock_open_local_image_request;
+  MockCloseImageRequest mock_close_image_request;
+  MockSnapshotSyncRequest mock_sync_request;
+  MockListener mock_listener;
+
+  InSequence seq;
+  expect_open_image(mock_open_image_request, m_remote_image_ctx->id,
+                    mock_remote_image_ctx, 0);
+  expect_open_local_image(mock_open_local_image_request, "local image id",
+                          &mock_local_image_ctx, 0);
+  C_SaferCond sync_ctx;
+  expect_sync(mock_sync_request, &sync_ctx);
+
+  MockSnapshotReplayer *replayer = create_replayer("local image id",
+                                                   mock_listener);
+  C_SaferCond init_ctx;
+  replayer->init(&init_ctx);
+  ASSERT_EQ(0, init_ctx.wait());
+  ASSERT_EQ(0, sync_ctx.wait());
+  ASSERT_EQ(m_remote_image_ctx->name, replayer->get_local_image_name());
+
+  complete_sync(mock_sync_request, "uuid2", false, 0);
+  ASSERT_EQ("last synced snapshot uuid2", replayer->get_status_description());
+
+  expect_close_image(mock_close_image_request, mock_local_image_ctx, 0);
+  expect_close_image(mock_close_image_request, mock_remote_image_ctx, 0);
+
+  C_SaferCond shut_down_ctx;
+  replayer->shut_down(&shut_down_ctx);
+  ASSERT_EQ(0, shut_down_ctx.wait());
+  MockSnapshotReplayer::destroy(replayer);
+}
+
+TEST_F(TestMockImageReplayerSnapshotReplayer, CreateLocalImage) {
+  ASSERT_EQ(0, create_primary_snap());
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  MockOpenImageRequest mock_open_image_request;
+  MockCreateImageRequest mock_create_image_request;
+  MockOpenLocalImageRequest mock_open_local_image_request;
+  MockCloseImageRequest mock_close_image_request;
+  MockSnapshotSyncRequest mock_sync_request;
+  MockListener mock_listener;
+
+  InSequence seq;
+  expect_open_image(mock_open_image_request, m_remote_image_ctx->id,
+                    mock_remote_image_ctx, 0);
+  expect_create_image(mock_create_image_request, "local image id", 0);
+  expect_open_local_image(mock_open_local_image_request, "local image id",
+                          &mock_local_image_ctx, 0);
+  C_SaferCond sync_ctx;
+  expect_sync(mock_sync_request, &sync_ctx);
+
+  MockSnapshotReplayer *replayer = create_replayer("", mock_listener);
+  C_SaferCond init_ctx;
+  replayer->init(&init_ctx);
+  ASSERT_EQ(0, init_ctx.wait());
+  ASSERT_EQ(0, sync_ctx.wait());
+  ASSERT_EQ("local image id", replayer->get_local_image_id());
+
+  // the in-flight sync is canceled and completes the shut down
+  expect_sync_cancel(mock_sync_request);
+  expect_close_image(mock_close_image_request, mock_local_image_ctx, 0);
+  expect_close_image(mock_close_image_request, mock_remote_image_ctx, 0);
+
+  C_SaferCond shut_down_ctx;
+  replayer->shut_down(&shut_down_ctx);
+  complete_sync(mock_sync_request, "", false, -ECANCELED);
+  ASSERT_EQ(0, shut_down_ctx.wait());
+  MockSnapshotReplayer::destroy(replayer);
+}
+
+TEST_F(TestMockImageReplayerSnapshotReplayer, RemoteNonPrimary) {
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  MockOpenImageRequest mock_open_image_request;
+  MockCloseImageRequest mock_close_image_request;
+  MockListener mock_listener;
+
+  InSequence seq;
+  expect_open_image(mock_open_image_request, m_remote_image_ctx->id,
+                    mock_remote_image_ctx, 0);
+
+  MockSnapshotReplayer *replayer = create_replayer("local image id",
+                                                   mock_listener);
+  C_SaferCond init_ctx;
+  replayer->init(&init_ctx);
+  ASSERT_EQ(-EREMOTEIO, init_ctx.wait());
+
+  expect_close_image(mock_close_image_request, mock_remote_image_ctx, 0);
+
+  C_SaferCond shut_down_ctx;
+  replayer->shut_down(&shut_down_ctx);
+  ASSERT_EQ(0, shut_down_ctx.wait());
+  MockSnapshotReplayer::destroy(replayer);
+}
+
+TEST_F(TestMockImageReplayerSnapshotReplayer, LocalPrimary) {
+  ASSERT_EQ(0, create_primary_snap());
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  MockOpenImageRequest mock_open_image_request;
+  MockOpenLocalImageRequest mock_open_local_image_request;
+  MockCloseImageRequest mock_close_image_request;
+  MockListener mock_listener;
+
+  InSequence seq;
+  expect_open_image(mock_open_image_request, m_remote_image_ctx->id,
+                    mock_remote_image_ctx, 0);
+  expect_open_local_image(mock_open_local_image_request, "local image id",
+                          nullptr, -EREMOTEIO);
+
+  MockSnapshotReplayer *replayer = create_replayer("local image id",
+                                                   mock_listener);
+  C_SaferCond init_ctx;
+  replayer->init(&init_ctx);
+  ASSERT_EQ(-EREMOTEIO, init_ctx.wait());
+
+  expect_close_image(mock_close_image_request, mock_remote_image_ctx, 0);
+
+  C_SaferCond shut_down_ctx;
+  replayer->shut_down(&shut_down_ctx);
+  ASSERT_EQ(0, shut_down_ctx.wait());
+  MockSnapshotReplayer::destroy(replayer);
+}
+
+TEST_F(TestMockImageReplayerSnapshotReplayer, SyncError) {
+  ASSERT_EQ(0, create_primary_snap());
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  MockOpenImageRequest mock_open_image_request;
+  MockOpenLocalImageRequest mock_open_local_image_request;
+  MockCloseImageRequest mock_close_image_request;
+  MockSnapshotSyncRequest mock_sync_request;
+  MockListener mock_listener;
+
+  InSequence seq;
+  expect_open_image(mock_open_image_request, m_remote_image_ctx->id,
+                    mock_remote_image_ctx, 0);
+  expect_open_local_image(mock_open_local_image_request, "local image id",
+                          &mock_local_image_ctx, 0);
+  C_SaferCond sync_ctx;
+  expect_sync(mock_sync_request, &sync_ctx);
+  C_SaferCond replay_complete_ctx;
+  expect_replay_complete(mock_listener, -EIO,
+                         "failed to sync image: (5) Input/output error",
+                         &replay_complete_ctx);
+
+  MockSnapshotReplayer *replayer = create_replayer("local image id",
+                                                   mock_listener);
+  C_SaferCond init_ctx;
+  replayer->init(&init_ctx);
+  ASSERT_EQ(0, init_ctx.wait());
+  ASSERT_EQ(0, sync_ctx.wait());
+
+  complete_sync(mock_sync_request, "", false, -EIO);
+  ASSERT_EQ(0, replay_complete_ctx.wait());
+
+  expect_close_image(mock_close_image_request, mock_local_image_ctx, 0);
+  expect_close_image(mock_close_image_request, mock_remote_image_ctx, 0);
+
+  C_SaferCond shut_down_ctx;
+  replayer->shut_down(&shut_down_ctx);
+  ASSERT_EQ(0, shut_down_ctx.wait());
+  MockSnapshotReplayer::destroy(replayer);
+}
+
+TEST_F(TestMockImageReplayerSnapshotReplayer, RemoteDemoted) {
+  ASSERT_EQ(0, create_primary_snap());
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  MockOpenImageRequest mock_open_image_request;
+  MockOpenLocalImageRequest mock_open_local_image_request;
+  MockCloseImageRequest mock_close_image_request;
+  MockSnapshotSyncRequest mock_sync_request;
+  MockListener mock_listener;
+
+  InSequence seq;
+  expect_open_image(mock_open_image_request, m_remote_image_ctx->id,
+                    mock_remote_image_ctx, 0);
+  expect_open_local_image(mock_open_local_image_request, "local image id",
+                          &mock_local_image_ctx, 0);
+  C_SaferCond sync_ctx;
+  expect_sync(mock_sync_request, &sync_ctx);
+  C_SaferCond replay_complete_ctx;
+  expect_replay_complete(mock_listener, 0, "remote image demoted",
+                         &replay_complete_ctx);
+
+  MockSnapshotReplayer *replayer = create_replayer("local image id",
+                                                   mock_listener);
+  C_SaferCond init_ctx;
+  replayer->init(&init_ctx);
+  ASSERT_EQ(0, init_ctx.wait());
+  ASSERT_EQ(0, sync_ctx.wait());
+
+  complete_sync(mock_sync_request, "uuid2", true, 0);
+  ASSERT_EQ(0, replay_complete_ctx.wait());
+
+  expect_close_image(mock_close_image_request, mock_local_image_ctx, 0);
+  expect_close_image(mock_close_image_request, mock_remote_image_ctx, 0);
+
+  C_SaferCond shut_down_ctx;
+  replayer->shut_down(&shut_down_ctx);
+  ASSERT_EQ(0, shut_down_ctx.wait());
+  MockSnapshotReplayer::destroy(replayer);
+}
+
+TEST_F(TestMockImageReplayerSnapshotReplayer, SyncInterval) {
+  std::string interval_str;
+  ASSERT_EQ(0, _rados->conf_get("rbd_mirror_snapshot_interval", interval_str));
+  ASSERT_EQ(0, _rados->conf_set("rbd_mirror_snapshot_interval", "1"));
+  BOOST_SCOPE_EXIT( (interval_str) ) {
+    ASSERT_EQ(0, _rados->conf_set("rbd_mirror_snapshot_interval", interval_str.c_str()));
+  } BOOST_SCOPE_EXIT_END;
+
+  ASSERT_EQ(0, create_primary_snap());
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  MockOpenImageRequest mock_open_image_request;
+  MockOpenLocalImageRequest mock_open_local_image_request;
+  MockCloseImageRequest mock_close_image_request;
+  MockSnapshotSyncRequest mock_sync_request;
+  MockListener mock_listener;
+
+  InSequence seq;
+  expect_open_image(mock_open_image_request, m_remote_image_ctx->id,
+                    mock_remote_image_ctx, 0);
+  expect_open_local_image(mock_open_local_image_request, "local image id",
+                          &mock_local_image_ctx, 0);
+  C_SaferCond sync_ctx1;
+  expect_sync(mock_sync_request, &sync_ctx1);
+  C_SaferCond sync_ctx2;
+  expect_sync(mock_sync_request, &sync_ctx2);
+
+  MockSnapshotReplayer *replayer = create_replayer("local image id",
+                                                   mock_listener);
+  C_SaferCond init_ctx;
+  replayer->init(&init_ctx);
+  ASSERT_EQ(0, init_ctx.wait());
+  ASSERT_EQ(0, sync_ctx1.wait());
+
+  // the next sync is started once the snapshot interval elapsed
+  complete_sync(mock_sync_request, "uuid2", false, 0);
+  ASSERT_EQ(0, sync_ctx2.wait());
+  complete_sync(mock_sync_request, "uuid3", false, 0);
+  ASSERT_EQ("last synced snapshot uuid3", replayer->get_status_description());
+
+  expect_close_image(mock_close_image_request, mock_local_image_ctx, 0);
+  expect_close_image(mock_close_image_request, mock_remote_image_ctx, 0);
+
+  C_SaferCond shut_down_ctx;
+  replayer->shut_down(&shut_down_ctx);
+  ASSERT_EQ(0, shut_down_ctx.wait());
+  MockSnapshotReplayer::destroy(replayer);
+}
+
+} // namespace image_replayer
+} // namespace mirror
+} // namespace rbd
@@ -0,0 +1,645 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "test/rbd_mirror/test_mock_fixture.h"
+#include "include/rbd/librbd.hpp"
+#include "include/rbd/object_map_types.h"
+#include "cls/rbd/cls_rbd_client.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/ImageState.h"
+#include "librbd/ObjectMap.h"
+#include "librbd/Operations.h"
+#include "librbd/io/AioCompletion.h"
+#include "librbd/mirror/SnapshotUtils.h"
+#include "test/librados_test_stub/MockTestMemIoCtxImpl.h"
+#include "test/librbd/mock/MockImageCtx.h"
+#include "tools/rbd_mirror/Threads.h"
+#include "tools/rbd_mirror/image_replayer/SnapshotObjectCopyRequest.h"
+#include "tools/rbd_mirror/image_replayer/SnapshotSyncRequest.h"
+#include <boost/scope_exit.hpp>
+
+namespace librbd {
+namespace {
+
+struct MockTestImageCtx : public librbd::MockImageCtx {
+  MockTestImageCtx(librbd::ImageCtx &image_ctx)
+    : librbd::MockImageCtx(image_ctx) {
+  }
+};
+
+} // anonymous namespace
+} // namespace librbd
+
+namespace rbd {
+namespace mirror {
+namespace image_replayer {
+
+template <>
+struct SnapshotObjectCopyRequest<librbd::MockTestImageCtx> {
+  static SnapshotObjectCopyRequest* s_instance;
+  static SnapshotObjectCopyRequest* create(librbd::MockTestImageCtx *local_image_ctx,
+                                           librbd::MockTestImageCtx *remote_image_ctx,
+                                           librados::snap_t from_snap_id,
+                                           librados::snap_t to_snap_id,
+                                           uint64_t object_number,
+                                           Context *on_finish) {
+    assert(s_instance != nullptr);
+    Mutex::Locker locker(s_instance->lock);
+    s_instance->from_snap_id = from_snap_id;
+    s_instance->to_snap_id = to_snap_id;
+    s_instance->object_contexts[object_number] = on_finish;
+    s_instance->cond.Signal();
+    return s_instance;
+  }
+
+  MOCK_METHOD0(send, void());
+
+  Mutex lock;
+  Cond cond;
+
+  librados::snap_t from_snap_id = 0;
+  librados::snap_t to_snap_id = 0;
+  std::map<uint64_t, Context *> object_contexts;
+
+  SnapshotObjectCopyRequest() : lock("lock") {
+    s_instance = this;
+  }
+};
+
+SnapshotObjectCopyRequest<librbd::MockTestImageCtx>* SnapshotObjectCopyRequest<librbd::MockTestImageCtx>::s_instance = nullptr;
+
+} // namespace image_replayer
+} // namespace mirror
+} // namespace rbd
+
+// template definitions
+#include "tools/rbd_mirror/image_replayer/SnapshotSyncRequest.cc"
+template class rbd::mirror::image_replayer::SnapshotSyncRequest<librbd::MockTestImageCtx>;
+
+namespace rbd {
+namespace mirror {
+namespace image_replayer {
+
+using ::testing::_;
+using ::testing::DoAll;
+using ::testing::InSequence;
+using ::testing::Invoke;
+using ::testing::Return;
+using ::testing::StrEq;
+using ::testing::WithArg;
+
+using librbd::mirror::snapshot::STATE_DEMOTED;
+using librbd::mirror::snapshot::STATE_NON_PRIMARY;
+using librbd::mirror::snapshot::STATE_PRIMARY;
+
+class TestMockImageReplayerSnapshotSyncRequest : public TestMockFixture {
+public:
+  typedef SnapshotSyncRequest<librbd::MockTestImageCtx> MockSnapshotSyncRequest;
+  typedef SnapshotObjectCopyRequest<librbd::MockTestImageCtx> MockSnapshotObjectCopyRequest;
+
+  void SetUp() override {
+    TestMockFixture::SetUp();
+
+    librbd::RBD rbd;
+    ASSERT_EQ(0, create_image(rbd, m_remote_io_ctx, m_image_name, m_image_size));
+    ASSERT_EQ(0, open_image(m_remote_io_ctx, m_image_name, &m_remote_image_ctx));
+
+    ASSERT_EQ(0, create_image(rbd, m_local_io_ctx, m_image_name, m_image_size));
+    ASSERT_EQ(0, open_image(m_local_io_ctx, m_image_name, &m_local_image_ctx));
+  }
+
+  using TestFixture::create_snap;
+  int create_snap(librbd::ImageCtx *image_ctx,
+                  librbd::mirror::snapshot::State state,
+                  const std::string &peer_mirror_uuid,
+                  const std::string &snap_uuid,
+                  librados::snap_t *snap_id) {
+    std::string snap_name = librbd::mirror::snapshot::get_snap_name(
+      state, peer_mirror_uuid, snap_uuid);
+    return create_snap(image_ctx, snap_name.c_str(), snap_id);
+  }
+
+  int save_object_map(librbd::ImageCtx *image_ctx, librados::snap_t snap_id,
+                      const BitVector<2> &object_map) {
+    librados::ObjectWriteOperation op;
+    librbd::cls_client::object_map_save(&op, object_map);
+    return image_ctx->md_ctx.operate(
+      librbd::ObjectMap<>::object_map_name(image_ctx->id, snap_id), &op);
+  }
+
+  void expect_is_refresh_required(librbd::MockTestImageCtx &mock_image_ctx,
+                                  bool required) {
+    EXPECT_CALL(*mock_image_ctx.state, is_refresh_required())
+      .WillOnce(Return(required));
+  }
+
+  void expect_refresh(librbd::MockTestImageCtx &mock_image_ctx, int r) {
+    EXPECT_CALL(*mock_image_ctx.state, refresh(_))
+      .WillOnce(CompleteContext(m_threads->work_queue, r));
+  }
+
+  void expect_create_remote_snap(librbd::MockTestImageCtx &mock_image_ctx,
+                                 librados::snap_t *snap_id,
+                                 const BitVector<2> *object_map, int r) {
+    EXPECT_CALL(*mock_image_ctx.operations, snap_create(_, _, _))
+      .WillOnce(Invoke([this, &mock_image_ctx, snap_id, object_map, r](
+                           const cls::rbd::SnapshotNamespace &snap_namespace,
+                           const std::string &snap_name, Context *ctx) {
+          if (r == 0) {
+            // the snapshot is recorded within the image snap info
+            librbd::ImageCtx *image_ctx = mock_image_ctx.image_ctx;
+            ASSERT_EQ(0, create_snap(image_ctx, snap_name.c_str(), snap_id));
+            mock_image_ctx.snap_info = image_ctx->snap_info;
+            if (object_map != nullptr) {
+              ASSERT_EQ(0, save_object_map(image_ctx, *snap_id, *object_map));
+              for (auto &snap_info_pair : mock_image_ctx.snap_info) {
+                snap_info_pair.second.flags = 0;
+              }
+            }
+          }
+          m_threads->work_queue->queue(ctx, r);
+        }));
+  }
+
+  void expect_get_image_size(librbd::MockTestImageCtx &mock_image_ctx,
+                             librados::snap_t snap_id, uint64_t size) {
+    EXPECT_CALL(mock_image_ctx, get_image_size(snap_id))
+      .WillOnce(Return(size));
+  }
+
+  void expect_get_remote_image_size(librbd::MockTestImageCtx &mock_image_ctx,
+                                    uint64_t size) {
+    EXPECT_CALL(mock_image_ctx, get_image_size(_))
+      .WillOnce(Return(size));
+  }
+
+  void expect_get_object_count(librbd::MockTestImageCtx &mock_image_ctx,
+                               uint64_t count) {
+    EXPECT_CALL(mock_image_ctx, get_object_count(_))
+      .WillOnce(Return(count));
+  }
+
+  void expect_test_features(librbd::MockTestImageCtx &mock_image_ctx,
+                            uint64_t features, bool enabled) {
+    EXPECT_CALL(mock_image_ctx, test_features(features, _))
+      .WillOnce(Return(enabled));
+  }
+
+  void expect_resize(librbd::MockTestImageCtx &mock_image_ctx, uint64_t size,
+                     int r) {
+    EXPECT_CALL(*mock_image_ctx.operations, execute_resize(size, true, _, _, 0))
+      .WillOnce(WithArg<3>(CompleteContext(m_threads->work_queue, r)));
+  }
+
+  void expect_aio_discard(librbd::MockTestImageCtx &mock_image_ctx,
+                          uint64_t offset, uint64_t length, int r) {
+    EXPECT_CALL(*mock_image_ctx.io_work_queue,
+                aio_discard(_, offset, length, false))
+      .WillOnce(WithArg<0>(Invoke([this, &mock_image_ctx, r](librbd::io::AioCompletion *aio_comp) {
+          complete_aio(mock_image_ctx, aio_comp, r);
+        })));
+  }
+
+  void expect_aio_flush(librbd::MockTestImageCtx &mock_image_ctx, int r) {
+    EXPECT_CALL(*mock_image_ctx.io_work_queue, aio_flush(_))
+      .WillOnce(Invoke([this, &mock_image_ctx, r](librbd::io::AioCompletion *aio_comp) {
+          complete_aio(mock_image_ctx, aio_comp, r);
+        }));
+  }
+
+  void complete_aio(librbd::MockTestImageCtx &mock_image_ctx,
+                    librbd::io::AioCompletion *aio_comp, int r) {
+    m_threads->work_queue->queue(new FunctionContext(
+      [&mock_image_ctx, aio_comp](int r) {
+        aio_comp->get();
+        aio_comp->init_time(mock_image_ctx.image_ctx,
+                            librbd::io::AIO_TYPE_NONE);
+        aio_comp->set_request_count(1);
+        aio_comp->complete_request(r);
+      }), r);
+  }
+
+  void expect_object_copy_send(MockSnapshotObjectCopyRequest &mock_object_copy_request) {
+    EXPECT_CALL(mock_object_copy_request, send());
+  }
+
+  bool complete_object_copy(MockSnapshotObjectCopyRequest &mock_object_copy_request,
+                            uint64_t object_num, int r) {
+    Mutex::Locker locker(mock_object_copy_request.lock);
+    while (mock_object_copy_request.object_contexts.count(object_num) == 0) {
+      if (mock_object_copy_request.cond.WaitInterval(mock_object_copy_request.lock,
+                                                     utime_t(10, 0)) != 0) {
+        return false;
+      }
+    }
+
+    m_threads->work_queue->queue(
+      mock_object_copy_request.object_contexts[object_num], r);
+    return true;
+  }
+
+  void expect_create_local_snap(librbd::MockTestImageCtx &mock_image_ctx,
+                                librbd::mirror::snapshot::State state,
+                                int r) {
+    EXPECT_CALL(*mock_image_ctx.operations,
+                execute_snap_create(_, _, _, 0, false))
+      .WillOnce(Invoke([this, state, r](
+                           const cls::rbd::SnapshotNamespace &snap_namespace,
+                           const std::string &snap_name, Context *ctx,
+                           uint64_t journal_op_tid, bool skip_object_map) {
+          librbd::mirror::snapshot::MirrorSnapshot mirror_snap;
+          ASSERT_TRUE(librbd::mirror::snapshot::decode_snap_name(
+                        snap_name, &mirror_snap));
+          ASSERT_EQ(state, mirror_snap.state);
+          m_threads->work_queue->queue(ctx, r);
+        }));
+  }
+
+  void expect_remove_local_snap(librbd::MockTestImageCtx &mock_image_ctx,
+                                const std::string &snap_name, int r) {
+    EXPECT_CALL(*mock_image_ctx.operations,
+                execute_snap_remove(_, StrEq(snap_name), _))
+      .WillOnce(WithArg<2>(CompleteContext(m_threads->work_queue, r)));
+  }
+
+  void expect_remove_remote_snap(librbd::MockTestImageCtx &mock_image_ctx,
+                                 const std::string &snap_name, int r) {
+    EXPECT_CALL(*mock_image_ctx.operations,
+                snap_remove(_, StrEq(snap_name), _))
+      .WillOnce(WithArg<2>(CompleteContext(m_threads->work_queue, r)));
+  }
+
+  MockSnapshotSyncRequest *create_request(
+      librbd::MockTestImageCtx &mock_local_image_ctx,
+      librbd::MockTestImageCtx &mock_remote_image_ctx, Context *on_finish) {
+    return new MockSnapshotSyncRequest(&mock_local_image_ctx,
+                                       &mock_remote_image_ctx,
+                                       "local mirror uuid", &m_snap_uuid,
+                                       &m_demoted, on_finish);
+  }
+
+  librbd::ImageCtx *m_remote_image_ctx;
+  librbd::ImageCtx *m_local_image_ctx;
+
+  std::string m_snap_uuid;
+  bool m_demoted = false;
+};
+
+TEST_F(TestMockImageReplayerSnapshotSyncRequest, FullSync) {
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, STATE_PRIMARY, "", "uuid1",
+                           nullptr));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  MockSnapshotObjectCopyRequest mock_object_copy_request;
+
+  librados::snap_t remote_snap_id = CEPH_NOSNAP;
+  InSequence seq;
+  expect_is_refresh_required(mock_remote_image_ctx, false);
+  expect_is_refresh_required(mock_local_image_ctx, false);
+  expect_create_remote_snap(mock_remote_image_ctx, &remote_snap_id, nullptr,
+                            0);
+  expect_get_remote_image_size(mock_remote_image_ctx, m_image_size);
+  expect_get_image_size(mock_local_image_ctx, CEPH_NOSNAP, m_image_size);
+  expect_test_features(mock_remote_image_ctx, RBD_FEATURE_FAST_DIFF, false);
+  expect_get_object_count(mock_remote_image_ctx, 2);
+  expect_object_copy_send(mock_object_copy_request);
+  expect_object_copy_send(mock_object_copy_request);
+  expect_aio_flush(mock_local_image_ctx, 0);
+  expect_create_local_snap(mock_local_image_ctx, STATE_NON_PRIMARY, 0);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                &ctx);
+  request->send();
+
+  ASSERT_TRUE(complete_object_copy(mock_object_copy_request, 0, 0));
+  ASSERT_TRUE(complete_object_copy(mock_object_copy_request, 1, 0));
+  ASSERT_EQ(0, ctx.wait());
+  ASSERT_EQ(0U, mock_object_copy_request.from_snap_id);
+  ASSERT_EQ(remote_snap_id, mock_object_copy_request.to_snap_id);
+  ASSERT_FALSE(m_snap_uuid.empty());
+  ASSERT_FALSE(m_demoted);
+}
+
+TEST_F(TestMockImageReplayerSnapshotSyncRequest, IncrementalSync) {
+  librados::snap_t base_snap_id;
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, STATE_PRIMARY,
+                           "local mirror uuid", "uuid1", &base_snap_id));
+  ASSERT_EQ(0, create_snap(m_local_image_ctx, STATE_NON_PRIMARY, "", "uuid1",
+                           nullptr));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  MockSnapshotObjectCopyRequest mock_object_copy_request;
+
+  librados::snap_t remote_snap_id = CEPH_NOSNAP;
+  InSequence seq;
+  expect_is_refresh_required(mock_remote_image_ctx, true);
+  expect_refresh(mock_remote_image_ctx, 0);
+  expect_is_refresh_required(mock_local_image_ctx, false);
+  expect_create_remote_snap(mock_remote_image_ctx, &remote_snap_id, nullptr,
+                            0);
+  expect_get_remote_image_size(mock_remote_image_ctx, m_image_size * 2);
+  expect_get_image_size(mock_local_image_ctx, CEPH_NOSNAP, m_image_size);
+  expect_resize(mock_local_image_ctx, m_image_size * 2, 0);
+  expect_test_features(mock_remote_image_ctx, RBD_FEATURE_FAST_DIFF, false);
+  expect_get_object_count(mock_remote_image_ctx, 1);
+  expect_object_copy_send(mock_object_copy_request);
+  expect_aio_flush(mock_local_image_ctx, 0);
+  expect_create_local_snap(mock_local_image_ctx, STATE_NON_PRIMARY, 0);
+  expect_remove_local_snap(mock_local_image_ctx,
+                           ".mirror.non_primary.uuid1", 0);
+  expect_remove_remote_snap(mock_remote_image_ctx,
+                            ".mirror.primary.local mirror uuid.uuid1", 0);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                &ctx);
+  request->send();
+
+  ASSERT_TRUE(complete_object_copy(mock_object_copy_request, 0, 0));
+  ASSERT_EQ(0, ctx.wait());
+  ASSERT_EQ(base_snap_id, mock_object_copy_request.from_snap_id);
+  ASSERT_EQ(remote_snap_id, mock_object_copy_request.to_snap_id);
+}
+
+TEST_F(TestMockImageReplayerSnapshotSyncRequest, FastDiffSkipsUnchangedObjects) {
+  librados::snap_t base_snap_id;
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, STATE_PRIMARY,
+                           "local mirror uuid", "uuid1", &base_snap_id));
+  ASSERT_EQ(0, create_snap(m_local_image_ctx, STATE_NON_PRIMARY, "", "uuid1",
+                           nullptr));
+
+  BitVector<2> base_object_map;
+  base_object_map.resize(3);
+  base_object_map[0] = OBJECT_EXISTS;
+  base_object_map[1] = OBJECT_EXISTS;
+  base_object_map[2] = OBJECT_NONEXISTENT;
+  ASSERT_EQ(0, save_object_map(m_remote_image_ctx, base_snap_id,
+                               base_object_map));
+
+  BitVector<2> object_map;
+  object_map.resize(3);
+  object_map[0] = OBJECT_EXISTS_CLEAN;
+  object_map[1] = OBJECT_EXISTS;
+  object_map[2] = OBJECT_NONEXISTENT;
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  MockSnapshotObjectCopyRequest mock_object_copy_request;
+
+  uint64_t image_size = 3 << m_remote_image_ctx->order;
+  librados::snap_t remote_snap_id = CEPH_NOSNAP;
+  InSequence seq;
+  expect_is_refresh_required(mock_remote_image_ctx, false);
+  expect_is_refresh_required(mock_local_image_ctx, false);
+  expect_create_remote_snap(mock_remote_image_ctx, &remote_snap_id,
+                            &object_map, 0);
+  expect_get_remote_image_size(mock_remote_image_ctx, image_size);
+  expect_get_image_size(mock_local_image_ctx, CEPH_NOSNAP, image_size);
+  expect_test_features(mock_remote_image_ctx, RBD_FEATURE_FAST_DIFF, true);
+  expect_get_image_size(mock_remote_image_ctx, base_snap_id, image_size);
+  expect_get_remote_image_size(mock_remote_image_ctx, image_size);
+  expect_get_object_count(mock_remote_image_ctx, 3);
+  expect_object_copy_send(mock_object_copy_request);
+  expect_aio_flush(mock_local_image_ctx, 0);
+  expect_create_local_snap(mock_local_image_ctx, STATE_NON_PRIMARY, 0);
+  expect_remove_local_snap(mock_local_image_ctx,
+                           ".mirror.non_primary.uuid1", 0);
+  expect_remove_remote_snap(mock_remote_image_ctx,
+                            ".mirror.primary.local mirror uuid.uuid1", 0);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                &ctx);
+  request->send();
+
+  ASSERT_TRUE(complete_object_copy(mock_object_copy_request, 1, 0));
+  ASSERT_EQ(0, ctx.wait());
+  ASSERT_EQ(1U, mock_object_copy_request.object_contexts.size());
+}
+
+TEST_F(TestMockImageReplayerSnapshotSyncRequest, DiscardWithoutCommonBase) {
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, STATE_PRIMARY, "", "uuid1",
+                           nullptr));
+  ASSERT_EQ(0, create_snap(m_local_image_ctx, STATE_NON_PRIMARY, "",
+                           "uuid0", nullptr));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  MockSnapshotObjectCopyRequest mock_object_copy_request;
+
+  librados::snap_t remote_snap_id = CEPH_NOSNAP;
+  InSequence seq;
+  expect_is_refresh_required(mock_remote_image_ctx, false);
+  expect_is_refresh_required(mock_local_image_ctx, false);
+  expect_create_remote_snap(mock_remote_image_ctx, &remote_snap_id, nullptr,
+                            0);
+  expect_get_remote_image_size(mock_remote_image_ctx, m_image_size);
+  expect_get_image_size(mock_local_image_ctx, CEPH_NOSNAP, m_image_size);
+  expect_aio_discard(mock_local_image_ctx, 0, m_image_size, 0);
+  expect_test_features(mock_remote_image_ctx, RBD_FEATURE_FAST_DIFF, false);
+  expect_get_object_count(mock_remote_image_ctx, 1);
+  expect_object_copy_send(mock_object_copy_request);
+  expect_aio_flush(mock_local_image_ctx, 0);
+  expect_create_local_snap(mock_local_image_ctx, STATE_NON_PRIMARY, 0);
+  expect_remove_local_snap(mock_local_image_ctx,
+                           ".mirror.non_primary.uuid0", 0);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                &ctx);
+  request->send();
+
+  ASSERT_TRUE(complete_object_copy(mock_object_copy_request, 0, 0));
+  ASSERT_EQ(0, ctx.wait());
+  ASSERT_EQ(0U, mock_object_copy_request.from_snap_id);
+}
+
+TEST_F(TestMockImageReplayerSnapshotSyncRequest, RemoteDemoted) {
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, STATE_PRIMARY,
+                           "local mirror uuid", "uuid1", nullptr));
+  librados::snap_t demote_snap_id;
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, STATE_DEMOTED, "", "uuid2",
+                           &demote_snap_id));
+  ASSERT_EQ(0, create_snap(m_local_image_ctx, STATE_NON_PRIMARY, "", "uuid1",
+                           nullptr));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  MockSnapshotObjectCopyRequest mock_object_copy_request;
+
+  InSequence seq;
+  expect_is_refresh_required(mock_remote_image_ctx, false);
+  expect_is_refresh_required(mock_local_image_ctx, false);
+  expect_get_image_size(mock_remote_image_ctx, demote_snap_id, m_image_size);
+  expect_get_image_size(mock_local_image_ctx, CEPH_NOSNAP, m_image_size);
+  expect_test_features(mock_remote_image_ctx, RBD_FEATURE_FAST_DIFF, false);
+  expect_get_object_count(mock_remote_image_ctx, 1);
+  expect_object_copy_send(mock_object_copy_request);
+  expect_aio_flush(mock_local_image_ctx, 0);
+  expect_create_local_snap(mock_local_image_ctx, STATE_DEMOTED, 0);
+  expect_remove_local_snap(mock_local_image_ctx,
+                           ".mirror.non_primary.uuid1", 0);
+  expect_remove_remote_snap(mock_remote_image_ctx,
+                            ".mirror.primary.local mirror uuid.uuid1", 0);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                &ctx);
+  request->send();
+
+  ASSERT_TRUE(complete_object_copy(mock_object_copy_request, 0, 0));
+  ASSERT_EQ(0, ctx.wait());
+  ASSERT_EQ("uuid2", m_snap_uuid);
+  ASSERT_TRUE(m_demoted);
+}
+
+TEST_F(TestMockImageReplayerSnapshotSyncRequest, RemoteDemotionSynced) {
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, STATE_DEMOTED, "", "uuid1",
+                           nullptr));
+  ASSERT_EQ(0, create_snap(m_local_image_ctx, STATE_DEMOTED, "", "uuid1",
+                           nullptr));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  InSequence seq;
+  expect_is_refresh_required(mock_remote_image_ctx, false);
+  expect_is_refresh_required(mock_local_image_ctx, false);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                &ctx);
+  request->send();
+  ASSERT_EQ(0, ctx.wait());
+  ASSERT_TRUE(m_demoted);
+}
+
+TEST_F(TestMockImageReplayerSnapshotSyncRequest, RemoteNonPrimary) {
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  InSequence seq;
+  expect_is_refresh_required(mock_remote_image_ctx, false);
+  expect_is_refresh_required(mock_local_image_ctx, false);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                &ctx);
+  request->send();
+  ASSERT_EQ(-EREMOTEIO, ctx.wait());
+}
+
+TEST_F(TestMockImageReplayerSnapshotSyncRequest, RefreshError) {
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  InSequence seq;
+  expect_is_refresh_required(mock_remote_image_ctx, true);
+  expect_refresh(mock_remote_image_ctx, -EIO);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                &ctx);
+  request->send();
+  ASSERT_EQ(-EIO, ctx.wait());
+}
+
+TEST_F(TestMockImageReplayerSnapshotSyncRequest, CreateRemoteSnapshotError) {
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, STATE_PRIMARY, "", "uuid1",
+                           nullptr));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  InSequence seq;
+  expect_is_refresh_required(mock_remote_image_ctx, false);
+  expect_is_refresh_required(mock_local_image_ctx, false);
+  expect_create_remote_snap(mock_remote_image_ctx, nullptr, nullptr, -EINVAL);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                &ctx);
+  request->send();
+  ASSERT_EQ(-EINVAL, ctx.wait());
+}
+
+TEST_F(TestMockImageReplayerSnapshotSyncRequest, CopyObjectError) {
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, STATE_PRIMARY, "", "uuid1",
+                           nullptr));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  MockSnapshotObjectCopyRequest mock_object_copy_request;
+
+  librados::snap_t remote_snap_id = CEPH_NOSNAP;
+  InSequence seq;
+  expect_is_refresh_required(mock_remote_image_ctx, false);
+  expect_is_refresh_required(mock_local_image_ctx, false);
+  expect_create_remote_snap(mock_remote_image_ctx, &remote_snap_id, nullptr,
+                            0);
+  expect_get_remote_image_size(mock_remote_image_ctx, m_image_size);
+  expect_get_image_size(mock_local_image_ctx, CEPH_NOSNAP, m_image_size);
+  expect_test_features(mock_remote_image_ctx, RBD_FEATURE_FAST_DIFF, false);
+  expect_get_object_count(mock_remote_image_ctx, 1);
+  expect_object_copy_send(mock_object_copy_request);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                &ctx);
+  request->send();
+
+  ASSERT_TRUE(complete_object_copy(mock_object_copy_request, 0, -EIO));
+  ASSERT_EQ(-EIO, ctx.wait());
+}
+
+TEST_F(TestMockImageReplayerSnapshotSyncRequest, Cancel) {
+  std::string max_ops_str;
+  ASSERT_EQ(0, _rados->conf_get("rbd_concurrent_management_ops", max_ops_str));
+  ASSERT_EQ(0, _rados->conf_set("rbd_concurrent_management_ops", "1"));
+  BOOST_SCOPE_EXIT( (max_ops_str) ) {
+    ASSERT_EQ(0, _rados->conf_set("rbd_concurrent_management_ops", max_ops_str.c_str()));
+  } BOOST_SCOPE_EXIT_END;
+
+  ASSERT_EQ(0, create_snap(m_remote_image_ctx, STATE_PRIMARY, "", "uuid1",
+                           nullptr));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  MockSnapshotObjectCopyRequest mock_object_copy_request;
+
+  librados::snap_t remote_snap_id = CEPH_NOSNAP;
+  InSequence seq;
+  expect_is_refresh_required(mock_remote_image_ctx, false);
+  expect_is_refresh_required(mock_local_image_ctx, false);
+  expect_create_remote_snap(mock_remote_image_ctx, &remote_snap_id, nullptr,
+                            0);
+  expect_get_remote_image_size(mock_remote_image_ctx, m_image_size);
+  expect_get_image_size(mock_local_image_ctx, CEPH_NOSNAP, m_image_size);
+  expect_test_features(mock_remote_image_ctx, RBD_FEATURE_FAST_DIFF, false);
+  expect_get_object_count(mock_remote_image_ctx, 2);
+  expect_object_copy_send(mock_object_copy_request);
+
+  C_SaferCond ctx;
+  auto request = create_request(mock_local_image_ctx, mock_remote_image_ctx,
+                                &ctx);
+  request->send();
+
+  {
+    Mutex::Locker locker(mock_object_copy_request.lock);
+    while (mock_object_copy_request.object_contexts.count(0) == 0) {
+      ASSERT_EQ(0, mock_object_copy_request.cond.WaitInterval(
+        mock_object_copy_request.lock, utime_t(10, 0)));
+    }
+  }
+  request->cancel();
+
+  ASSERT_TRUE(complete_object_copy(mock_object_copy_request, 0, 0));
+  ASSERT_EQ(-ECANCELED, ctx.wait());
+}
+
+} // namespace image_replayer
+} // namespace mirror
+} // namespace rbd
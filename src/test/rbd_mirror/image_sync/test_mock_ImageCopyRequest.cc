@@ -3,8 +3,10 @@
 
 #include "test/rbd_mirror/test_mock_fixture.h"
 #include "include/rbd/librbd.hpp"
+#include "cls/rbd/cls_rbd_client.h"
 #include "librbd/ImageCtx.h"
 #include "librbd/ImageState.h"
+#include "librbd/ObjectMap.h"
 #include "librbd/Operations.h"
 #include "librbd/journal/TypeTraits.h"
 #include "test/journal/mock/MockJournaler.h"
@@ -14,6 +16,7 @@
 #include "tools/rbd_mirror/image_sync/ObjectCopyRequest.h"
 #include "tools/rbd_mirror/Threads.h"
 #include <boost/scope_exit.hpp>
+#include <atomic>
 
 namespace librbd {
 
@@ -84,6 +87,7 @@ namespace mirror {
 namespace image_sync {
 
 using ::testing::_;
+using ::testing::DoAll;
 using ::testing::InSequence;
 using ::testing::Invoke;
 using ::testing::Return;
@@ -121,6 +125,12 @@ public:
       .WillOnce(Return(count)).RetiresOnSaturation();
   }
 
+  void expect_test_features(librbd::MockTestImageCtx &mock_image_ctx,
+                            uint64_t features, bool enabled) {
+    EXPECT_CALL(mock_image_ctx, test_features(features, _))
+      .WillOnce(Return(enabled));
+  }
+
   void expect_update_client(journal::MockJournaler &mock_journaler, int r) {
     EXPECT_CALL(mock_journaler, update_client(_, _))
       .WillOnce(WithArg<1>(CompleteContext(r)));
@@ -150,6 +160,14 @@ public:
     return true;
   }
 
+  int save_object_map(librbd::ImageCtx *image_ctx, librados::snap_t snap_id,
+                      const BitVector<2> &object_map) {
+    librados::ObjectWriteOperation op;
+    librbd::cls_client::object_map_save(&op, object_map);
+    return image_ctx->md_ctx.operate(
+      librbd::ObjectMap<>::object_map_name(image_ctx->id, snap_id), &op);
+  }
+
   MockImageCopyRequest::SnapMap wait_for_snap_map(MockObjectCopyRequest &mock_object_copy_request) {
     Mutex::Locker locker(mock_object_copy_request.lock);
     while (mock_object_copy_request.snap_map == nullptr) {
@@ -238,6 +256,49 @@ TEST_F(TestMockImageSyncImageCopyRequest, SimpleImage) {
   ASSERT_EQ(0, ctx.wait());
 }
 
+TEST_F(TestMockImageSyncImageCopyRequest, ObjectMapSkipsNonExistentObjects) {
+  ASSERT_EQ(0, create_snap("snap1"));
+  m_client_meta.sync_points = {{cls::rbd::UserSnapshotNamespace(),
+				"snap1",
+				boost::none}};
+
+  BitVector<2> object_map;
+  object_map.resize(3);
+  object_map[0] = OBJECT_NONEXISTENT;
+  object_map[1] = OBJECT_EXISTS;
+  object_map[2] = OBJECT_NONEXISTENT;
+  ASSERT_EQ(0, save_object_map(m_remote_image_ctx, m_snap_map.begin()->first,
+                               object_map));
+
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+  journal::MockJournaler mock_journaler;
+  MockObjectCopyRequest mock_object_copy_request;
+
+  expect_get_snap_id(mock_remote_image_ctx);
+
+  InSequence seq;
+  expect_get_object_count(mock_remote_image_ctx, 3);
+  expect_get_object_count(mock_remote_image_ctx, 0);
+  expect_update_client(mock_journaler, 0);
+  expect_test_features(mock_remote_image_ctx, RBD_FEATURE_OBJECT_MAP, true);
+  expect_object_copy_send(mock_object_copy_request);
+  expect_update_client(mock_journaler, 0);
+
+  C_SaferCond ctx;
+  MockImageCopyRequest *request = create_request(mock_remote_image_ctx,
+                                                 mock_local_image_ctx,
+                                                 mock_journaler,
+                                                 m_client_meta.sync_points.front(),
+                                                 &ctx);
+  request->send();
+
+  ASSERT_EQ(m_snap_map, wait_for_snap_map(mock_object_copy_request));
+  ASSERT_TRUE(complete_object_copy(mock_object_copy_request, 1, 0));
+  ASSERT_EQ(0, ctx.wait());
+  ASSERT_EQ(2u, m_client_meta.sync_points.front().object_number.get());
+}
+
 TEST_F(TestMockImageSyncImageCopyRequest, Throttled) {
   ASSERT_EQ(0, create_snap("snap1"));
   m_client_meta.sync_points = {{cls::rbd::UserSnapshotNamespace(),
@@ -270,22 +331,23 @@ TEST_F(TestMockImageSyncImageCopyRequest, Throttled) {
 
   EXPECT_CALL(mock_object_copy_request, send()).Times(object_count);
 
-  boost::optional<uint64_t> expected_object_number(boost::none);
+  // the sync point must never move past an object copy that is still
+  // in-flight
+  std::atomic<uint64_t> completed_objects(0);
+  boost::optional<uint64_t> last_object_number(boost::none);
   EXPECT_CALL(mock_journaler, update_client(_, _))
     .WillRepeatedly(
-        Invoke([&expected_object_number, max_ops, object_count, this]
+        Invoke([&completed_objects, &last_object_number, this]
                (bufferlist data, Context *ctx) {
-          ASSERT_EQ(expected_object_number,
-                    m_client_meta.sync_points.front().object_number);
-          if (!expected_object_number) {
-            expected_object_number = (max_ops - 1);
-          } else {
-            expected_object_number = expected_object_number.get() + max_ops;
-          }
-
-          if (expected_object_number.get() > (object_count - 1)) {
-            expected_object_number = (object_count - 1);
+          boost::optional<uint64_t> object_number =
+            m_client_meta.sync_points.front().object_number;
+          if (object_number) {
+            ASSERT_LT(object_number.get(), completed_objects.load());
+            if (last_object_number) {
+              ASSERT_LE(last_object_number.get(), object_number.get());
+            }
           }
+          last_object_number = object_number;
 
           m_threads->work_queue->queue(ctx, 0);
       }));
@@ -299,19 +361,26 @@ TEST_F(TestMockImageSyncImageCopyRequest, Throttled) {
                                                  &ctx);
   request->send();
 
-  std::function<void()> sleep_fn = [request]() {
+  std::function<void()> sleep_fn = [&completed_objects]() {
+    ++completed_objects;
     sleep(2);
   };
+  std::function<void()> complete_fn = [&completed_objects]() {
+    ++completed_objects;
+  };
 
   ASSERT_EQ(m_snap_map, wait_for_snap_map(mock_object_copy_request));
   for (uint64_t i = 0; i < object_count; ++i) {
     if (i % 10 == 0) {
       ASSERT_TRUE(complete_object_copy(mock_object_copy_request, i, 0, sleep_fn));
     } else {
-      ASSERT_TRUE(complete_object_copy(mock_object_copy_request, i, 0));
+      ASSERT_TRUE(complete_object_copy(mock_object_copy_request, i, 0,
+                                       complete_fn));
     }
   }
   ASSERT_EQ(0, ctx.wait());
+  ASSERT_EQ(object_count - 1,
+            m_client_meta.sync_points.front().object_number.get());
 }
 
 TEST_F(TestMockImageSyncImageCopyRequest, SnapshotSubset) {
@@ -442,6 +511,7 @@ TEST_F(TestMockImageSyncImageCopyRequest, Cancel) {
   expect_get_object_count(mock_remote_image_ctx, 2);
   expect_update_client(mock_journaler, 0);
   expect_object_copy_send(mock_object_copy_request);
+  expect_update_client(mock_journaler, 0);
 
   C_SaferCond ctx;
   MockImageCopyRequest *request = create_request(mock_remote_image_ctx,
@@ -456,6 +526,7 @@ TEST_F(TestMockImageSyncImageCopyRequest, Cancel) {
 
   ASSERT_TRUE(complete_object_copy(mock_object_copy_request, 0, 0));
   ASSERT_EQ(-ECANCELED, ctx.wait());
+  ASSERT_EQ(0u, m_client_meta.sync_points.front().object_number.get());
 }
 
 TEST_F(TestMockImageSyncImageCopyRequest, Cancel_Inflight_Sync) {
@@ -9,6 +9,7 @@
 #include "tools/rbd_mirror/image_replayer/CloseImageRequest.h"
 #include "tools/rbd_mirror/image_replayer/EventPreprocessor.h"
 #include "tools/rbd_mirror/image_replayer/PrepareLocalImageRequest.h"
+#include "tools/rbd_mirror/image_replayer/SnapshotReplayer.h"
 #include "tools/rbd_mirror/ImageSyncThrottler.h"
 #include "test/rbd_mirror/test_mock_fixture.h"
 #include "test/journal/mock/MockJournaler.h"
@@ -251,11 +252,56 @@ struct ReplayStatusFormatter<librbd::MockTestImageCtx> {
   MOCK_METHOD2(get_or_send_update, bool(std::string *description, Context *on_finish));
 };
 
+template<>
+struct SnapshotReplayer<librbd::MockTestImageCtx> {
+  struct Listener {
+    virtual ~Listener() {
+    }
+
+    virtual void handle_replay_complete(int r, const std::string &desc) = 0;
+  };
+
+  static SnapshotReplayer* s_instance;
+
+  static SnapshotReplayer* create(Threads<librbd::ImageCtx> *threads,
+                                  librados::IoCtx &local_io_ctx,
+                                  librados::IoCtx &remote_io_ctx,
+                                  const std::string &global_image_id,
+                                  const std::string &local_mirror_uuid,
+                                  const std::string &remote_mirror_uuid,
+                                  const std::string &remote_image_id,
+                                  const std::string &local_image_id,
+                                  Listener *listener) {
+    assert(s_instance != nullptr);
+    return s_instance;
+  }
+
+  static void destroy(SnapshotReplayer* snapshot_replayer) {
+  }
+
+  SnapshotReplayer() {
+    assert(s_instance == nullptr);
+    s_instance = this;
+  }
+
+  ~SnapshotReplayer() {
+    assert(s_instance == this);
+    s_instance = nullptr;
+  }
+
+  MOCK_METHOD1(init, void(Context *));
+  MOCK_METHOD1(shut_down, void(Context *));
+  MOCK_CONST_METHOD0(get_local_image_id, std::string());
+  MOCK_CONST_METHOD0(get_local_image_name, std::string());
+  MOCK_CONST_METHOD0(get_status_description, std::string());
+};
+
 BootstrapRequest<librbd::MockTestImageCtx>* BootstrapRequest<librbd::MockTestImageCtx>::s_instance = nullptr;
 CloseImageRequest<librbd::MockTestImageCtx>* CloseImageRequest<librbd::MockTestImageCtx>::s_instance = nullptr;
 EventPreprocessor<librbd::MockTestImageCtx>* EventPreprocessor<librbd::MockTestImageCtx>::s_instance = nullptr;
 PrepareLocalImageRequest<librbd::MockTestImageCtx>* PrepareLocalImageRequest<librbd::MockTestImageCtx>::s_instance = nullptr;
 ReplayStatusFormatter<librbd::MockTestImageCtx>* ReplayStatusFormatter<librbd::MockTestImageCtx>::s_instance = nullptr;
+SnapshotReplayer<librbd::MockTestImageCtx>* SnapshotReplayer<librbd::MockTestImageCtx>::s_instance = nullptr;
 
 } // namespace image_replayer
 } // namespace mirror
@@ -4,6 +4,7 @@ import string
 import sys
 import time
 import logging
+from cStringIO import StringIO
 try:
     from itertools import izip_longest as zip_longest
 except ImportError:
@@ -685,6 +686,76 @@ def test_bucket_delete_notempty():
     for _, bucket_name in zone_bucket.items():
         assert c1.get_bucket(bucket_name)
 
+def list_bucket_pages(bucket, page_size, **params):
+    """ list the bucket one page at a time, following NextMarker """
+    names = []
+    marker = ''
+    while True:
+        page = bucket.get_all_keys(marker=marker, max_keys=page_size, **params)
+        names.extend(k.name for k in page)
+        if not page.is_truncated:
+            return names
+        assert(len(page) > 0)
+        marker = page.next_marker or page[-1].name
+
+def test_bucket_listing():
+    zone = realm.master_zonegroup().master_zone
+    conn = get_zone_connection(zone, user.credentials)
+    bucket = conn.create_bucket(gen_bucket_name())
+
+    # names that escape in the index, plus an unfinished multipart upload
+    # whose entries land in the shard of its object and must be skipped
+    objnames = ['obj%d' % i for i in range(40)] + ['_obj', '_obj_', ':', '&']
+    for objname in objnames:
+        bucket.new_key(objname).set_contents_from_string('asdasd')
+    upload = bucket.initiate_multipart_upload('obj7')
+    upload.upload_part_from_file(StringIO('x' * 5), 1)
+
+    # spread the index over enough shards that pages end inside a shard
+    zone.cluster.admin(['bucket', 'reshard', '--bucket', bucket.name,
+                        '--num-shards', '7', '--yes-i-really-mean-it'])
+
+    expected = sorted(objnames)
+    for page_size in [1, 3, 10, 1000]:
+        eq(list_bucket_pages(bucket, page_size), expected)
+        unordered = list_bucket_pages(bucket, page_size, allow_unordered='true')
+        eq(len(unordered), len(expected))
+        eq(sorted(unordered), expected)
+
+    # a delimiter needs the ordered listing
+    try:
+        bucket.get_all_keys(delimiter='/', allow_unordered='true')
+    except boto.exception.S3ResponseError as e:
+        eq(e.status, 400)
+    else:
+        assert False # expected 400 InvalidArgument
+
+    upload.cancel_upload()
+
+def test_multipart_complete_subset():
+    zone = realm.master_zonegroup().master_zone
+    conn = get_zone_connection(zone, user.credentials)
+    bucket = conn.create_bucket(gen_bucket_name())
+
+    # completing with fewer parts than were uploaded can't use the parallel
+    # part reads and goes through the part listing instead
+    part_size = 5 * 1024 * 1024
+    upload = bucket.initiate_multipart_upload('obj')
+    parts = {}
+    for num in [1, 2, 3]:
+        parts[num] = chr(ord('a') + num) * part_size
+        upload.upload_part_from_file(StringIO(parts[num]), num)
+
+    xml = '<CompleteMultipartUpload>'
+    for part in upload.get_all_parts():
+        if part.part_number != 2:
+            xml += '<Part><PartNumber>%d</PartNumber><ETag>%s</ETag></Part>' % \
+                   (part.part_number, part.etag)
+    xml += '</CompleteMultipartUpload>'
+    bucket.complete_multipart_upload('obj', upload.id, xml)
+
+    eq(bucket.get_key('obj').get_contents_as_string(), parts[1] + parts[3])
+
 def test_multi_period_incremental_sync():
     zonegroup = realm.master_zonegroup()
     if len(zonegroup.zones) < 3:
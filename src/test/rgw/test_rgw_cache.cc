@@ -0,0 +1,155 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "common/ceph_argparse.h"
+#include "rgw/rgw_cache.h"
+#include <gtest/gtest.h>
+
+using namespace std;
+
+class ObjectDataCacheTest : public ::testing::Test {
+public:
+  ObjectDataCache cache;
+
+  void SetUp() override {
+    set_conf("rgw_obj_data_cache_size", "1024");
+    set_conf("rgw_obj_data_cache_ttl", "30");
+    cache.set_ctx(g_ceph_context);
+  }
+
+  void TearDown() override {
+    set_conf("rgw_obj_data_cache_size", "0");
+  }
+
+  void set_conf(const string& key, const string& val) {
+    g_conf->set_val(key.c_str(), val);
+    g_conf->apply_changes(NULL);
+  }
+
+  static ObjectDataCacheEntry make_entry(const string& data, const string& etag) {
+    ObjectDataCacheEntry entry;
+    entry.size = data.size();
+    entry.mtime = real_clock::now();
+    entry.etag = etag;
+    entry.attrs[RGW_ATTR_ETAG].append(etag);
+    entry.data.append(data);
+    entry.validated = ceph::coarse_mono_clock::now();
+    return entry;
+  }
+
+  void put(const string& name, ObjectDataCacheEntry entry) {
+    cache.put(name, entry, cache.get_gen());
+  }
+};
+
+TEST_F(ObjectDataCacheTest, get_put_remove)
+{
+  ObjectDataCacheEntry entry;
+  ASSERT_EQ(-ENOENT, cache.get("obj", entry));
+
+  put("obj", make_entry("data", "etag1"));
+  ASSERT_EQ(0, cache.get("obj", entry));
+  ASSERT_EQ("data", entry.data.to_str());
+  ASSERT_EQ("etag1", entry.etag);
+
+  /* as done for a local write or a REMOVE_OBJ_DATA notification */
+  cache.remove("obj");
+  ASSERT_EQ(-ENOENT, cache.get("obj", entry));
+}
+
+TEST_F(ObjectDataCacheTest, invalidation_races_with_read)
+{
+  /* a head read before a write dropped the entry must not be cached */
+  uint64_t gen = cache.get_gen();
+  ObjectDataCacheEntry stale = make_entry("old", "etag1");
+  cache.remove("obj");
+  cache.put("obj", stale, gen);
+  ObjectDataCacheEntry entry;
+  ASSERT_EQ(-ENOENT, cache.get("obj", entry));
+
+  /* any invalidation counts, the cache doesn't track which name was read */
+  gen = cache.get_gen();
+  cache.remove("other");
+  cache.put("obj", stale, gen);
+  ASSERT_EQ(-ENOENT, cache.get("obj", entry));
+
+  put("obj", make_entry("new", "etag2"));
+  ASSERT_EQ(0, cache.get("obj", entry));
+  ASSERT_EQ("new", entry.data.to_str());
+
+  cache.invalidate_all();
+  ASSERT_EQ(-ENOENT, cache.get("obj", entry));
+}
+
+TEST_F(ObjectDataCacheTest, lru_bound)
+{
+  /* each entry charges its data plus its attrs, just over 500 bytes here */
+  string data(500, 'x');
+  put("a", make_entry(data, "etag1"));
+  put("b", make_entry(data, "etag1"));
+  ObjectDataCacheEntry entry;
+  ASSERT_EQ(-ENOENT, cache.get("a", entry));
+  ASSERT_EQ(0, cache.get("b", entry));
+
+  /* larger than the whole cache */
+  put("c", make_entry(string(2048, 'x'), "etag1"));
+  ASSERT_EQ(-ENOENT, cache.get("c", entry));
+  ASSERT_EQ(0, cache.get("b", entry));
+}
+
+TEST_F(ObjectDataCacheTest, ttl_revalidation)
+{
+  ObjectDataCacheEntry orig = make_entry("data", "etag1");
+  put("obj", orig);
+
+  ObjectDataCacheEntry entry;
+  ASSERT_EQ(0, cache.get("obj", entry));
+  ASSERT_FALSE(cache.is_expired(entry));
+  entry.validated -= std::chrono::seconds(31);
+  ASSERT_TRUE(cache.is_expired(entry));
+
+  /* unchanged object: kept, with the fresh attrs and a new ttl */
+  map<string, bufferlist> attrs;
+  attrs[RGW_ATTR_ETAG].append("etag1");
+  attrs["user.rgw.x-amz-meta-foo"].append("bar");
+  ASSERT_TRUE(cache.revalidate("obj", entry, orig.size, orig.mtime, 5, attrs,
+			       cache.get_gen()));
+  ASSERT_EQ(0, cache.get("obj", entry));
+  ASSERT_FALSE(cache.is_expired(entry));
+  ASSERT_EQ(5u, entry.epoch);
+  ASSERT_EQ(1u, entry.attrs.count("user.rgw.x-amz-meta-foo"));
+  ASSERT_EQ("data", entry.data.to_str());
+
+  /* same size and mtime but a new etag: dropped */
+  attrs.clear();
+  attrs[RGW_ATTR_ETAG].append("etag2");
+  ASSERT_FALSE(cache.revalidate("obj", entry, orig.size, orig.mtime, 6, attrs,
+				cache.get_gen()));
+  ASSERT_EQ(-ENOENT, cache.get("obj", entry));
+
+  /* size or mtime changed: dropped */
+  put("obj", orig);
+  attrs.clear();
+  attrs[RGW_ATTR_ETAG].append("etag1");
+  ASSERT_FALSE(cache.revalidate("obj", entry, orig.size + 1, orig.mtime, 6,
+				attrs, cache.get_gen()));
+  ASSERT_EQ(-ENOENT, cache.get("obj", entry));
+  put("obj", orig);
+  ASSERT_FALSE(cache.revalidate("obj", entry, orig.size,
+				orig.mtime + std::chrono::seconds(1), 6, attrs,
+				cache.get_gen()));
+  ASSERT_EQ(-ENOENT, cache.get("obj", entry));
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
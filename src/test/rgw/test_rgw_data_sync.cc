@@ -0,0 +1,139 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include "gtest/gtest.h"
+
+#include "rgw/rgw_data_sync.h"
+#include "rgw/rgw_rest_conn.h"
+
+struct CollectCB : public RGWGetDataCB {
+  std::string out;
+  int handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len) override {
+    out.append(bl.c_str() + bl_ofs, bl_len);
+    return 0;
+  }
+  uint64_t get_extra_data_len() const { return extra_data_len; }
+};
+
+class DataSyncWindow : public ::testing::Test {
+public:
+  ceph::mono_time now = ceph::mono_clock::now();
+
+  void set_conf(const std::string& key, const std::string& val) {
+    g_conf->set_val(key.c_str(), val);
+    g_conf->apply_changes(NULL);
+  }
+
+  void SetUp() override {
+    // steps of one object between 2 and 16
+    set_conf("rgw_data_sync_spawn_window", "8");
+    set_conf("rgw_data_sync_max_spawn_window", "16");
+  }
+
+  void TearDown() override {
+    set_conf("rgw_data_sync_spawn_window", "20");
+    set_conf("rgw_data_sync_max_spawn_window", "128");
+  }
+
+  // one second worth of fetches, a full window of them
+  void period(RGWDataSyncTransfer& transfer, uint64_t bytes, int lat_ms) {
+    now += std::chrono::seconds(1);
+    int window = transfer.get_window();
+    for (int i = 0; i < window; i++) {
+      transfer.fetch_done(bytes / window, std::chrono::milliseconds(lat_ms), 0, now);
+    }
+  }
+};
+
+TEST_F(DataSyncWindow, grow)
+{
+  RGWDataSyncTransfer transfer(g_ceph_context, "grow");
+  ASSERT_EQ(8, transfer.get_window());
+
+  // bandwidth keeps up with the window
+  uint64_t bytes = 1 << 20;
+  for (int i = 1; i <= 8; i++) {
+    period(transfer, bytes, 10);
+    ASSERT_EQ(8 + i, transfer.get_window());
+    bytes = bytes * 3 / 2;
+  }
+  period(transfer, bytes, 10);
+  ASSERT_EQ(16, transfer.get_window());
+
+  // flat bandwidth leaves the window where it is
+  period(transfer, bytes, 10);
+  ASSERT_EQ(16, transfer.get_window());
+}
+
+TEST_F(DataSyncWindow, shrink_on_latency)
+{
+  RGWDataSyncTransfer transfer(g_ceph_context, "shrink_on_latency");
+  period(transfer, 1 << 20, 10);
+  ASSERT_EQ(9, transfer.get_window());
+
+  // same bandwidth, but requests queue up on the way
+  for (int i = 8; i >= 2; i--) {
+    period(transfer, 1 << 20, 30);
+    ASSERT_EQ(i, transfer.get_window());
+  }
+  period(transfer, 1 << 20, 30);
+  ASSERT_EQ(2, transfer.get_window());
+}
+
+TEST_F(DataSyncWindow, shrink_on_bandwidth)
+{
+  RGWDataSyncTransfer transfer(g_ceph_context, "shrink_on_bandwidth");
+  period(transfer, 1 << 20, 10);
+  ASSERT_EQ(9, transfer.get_window());
+
+  period(transfer, 1 << 19, 10);
+  ASSERT_EQ(8, transfer.get_window());
+}
+
+TEST_F(DataSyncWindow, errors)
+{
+  RGWDataSyncTransfer transfer(g_ceph_context, "errors");
+
+  // failed fetches don't end a period
+  now += std::chrono::seconds(1);
+  for (int i = 0; i < 16; i++) {
+    transfer.fetch_done(0, std::chrono::milliseconds(10), -EIO, now);
+  }
+  ASSERT_EQ(8, transfer.get_window());
+}
+
+class FetchHeadRange : public ::testing::Test {
+public:
+  CollectCB data;
+  RGWRESTStreamRWRequest *req = nullptr;
+  RGWFetchHeadRangeCB head_cb{&data, &req};
+
+  void TearDown() override {
+    delete req;
+  }
+
+  void receive(const std::string& status, const std::string& body) {
+    req = new RGWRESTStreamReadRequest(g_ceph_context, "http://localhost/",
+                                       &head_cb, NULL, NULL);
+    std::string header = "HTTP/1.1 " + status + "\r\n";
+    ASSERT_EQ(0, req->receive_header((void *)header.c_str(), header.size()));
+    ASSERT_EQ((int)body.size(), req->receive_data((void *)body.c_str(), body.size()));
+  }
+};
+
+TEST_F(FetchHeadRange, partial)
+{
+  head_cb.set_extra_data_len(5);
+  ASSERT_EQ(5u, data.get_extra_data_len());
+  receive("206 Partial Content", "{...}data");
+  ASSERT_EQ(206, req->get_http_status());
+  ASSERT_EQ("{...}data", data.out);
+}
+
+TEST_F(FetchHeadRange, range_not_satisfiable)
+{
+  // an older gateway asked for a range of an empty object
+  receive("416 Requested Range Not Satisfiable",
+          "<Error><Code>InvalidRange</Code></Error>");
+  ASSERT_EQ(416, req->get_http_status());
+  ASSERT_EQ("", data.out);
+}
@@ -0,0 +1,153 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include "gtest/gtest.h"
+
+#include "rgw/rgw_index_batcher.h"
+
+// records what would go to the osds, batches are answered by the test
+class FakeBatcher : public RGWIndexCompleteBatcher {
+  Mutex sent_lock;
+  std::vector<Sent *> batches;
+
+protected:
+  int send_batch(Sent *sent) override {
+    Mutex::Locker l(sent_lock);
+    batches.push_back(sent);
+    return 0;
+  }
+
+  void send_single(librados::IoCtx& ioctx, const std::string& oid,
+                   const rgw_bucket& bucket, rgw_cls_obj_complete_op& op) override {
+    Mutex::Locker l(sent_lock);
+    singles.push_back(op.key.name);
+  }
+
+  void retry(const rgw_bucket& bucket, rgw_cls_obj_complete_op& op) override {
+    Mutex::Locker l(sent_lock);
+    retried.push_back(op.key.name);
+  }
+
+  int64_t get_pool_id(librados::IoCtx& ioctx) override {
+    return 1;
+  }
+
+public:
+  std::vector<std::string> singles;
+  std::vector<std::string> retried;
+
+  FakeBatcher() : RGWIndexCompleteBatcher(g_ceph_context), sent_lock("FakeBatcher") {}
+
+  size_t num_batches() {
+    Mutex::Locker l(sent_lock);
+    return batches.size();
+  }
+
+  void complete(size_t i, int r) {
+    Sent *sent;
+    {
+      Mutex::Locker l(sent_lock);
+      sent = batches[i];
+    }
+    handle_sent(sent, r);
+  }
+
+  void queue(const std::string& name) {
+    librados::IoCtx ioctx;
+    rgw_bucket bucket;
+    rgw_cls_obj_complete_op op;
+    op.key = cls_rgw_obj_key(name);
+    RGWIndexCompleteBatcher::queue(ioctx, "shard.0", bucket, op);
+  }
+};
+
+class IndexCompleteBatcher : public ::testing::Test {
+public:
+  void set_conf(const std::string& key, const std::string& val) {
+    g_conf->set_val(key.c_str(), val);
+    g_conf->apply_changes(NULL);
+  }
+
+  void SetUp() override {
+    // batches only go out once they are full
+    set_conf("rgw_bucket_index_complete_batch_ms", "100000");
+    set_conf("rgw_bucket_index_complete_batch_max", "2");
+  }
+
+  void TearDown() override {
+    set_conf("rgw_bucket_index_complete_batch_ms", "2");
+    set_conf("rgw_bucket_index_complete_batch_max", "32");
+  }
+};
+
+TEST_F(IndexCompleteBatcher, batch)
+{
+  FakeBatcher batcher;
+  batcher.create("test_idx_batch");
+  batcher.queue("a");
+  batcher.queue("b");
+  batcher.queue("c");
+  // a second op on a key starts a new batch
+  batcher.queue("c");
+  batcher.queue("d");
+  ASSERT_EQ(3u, batcher.num_batches());
+  batcher.complete(0, 0);
+  batcher.complete(1, 0);
+  batcher.complete(2, 0);
+  batcher.stop();
+  EXPECT_TRUE(batcher.singles.empty());
+}
+
+TEST_F(IndexCompleteBatcher, reshard)
+{
+  FakeBatcher batcher;
+  batcher.create("test_idx_batch");
+  batcher.queue("a");
+  batcher.queue("b");
+  batcher.complete(0, -ERR_BUSY_RESHARDING);
+  batcher.stop();
+  EXPECT_EQ(std::vector<std::string>({"a", "b"}), batcher.retried);
+  EXPECT_TRUE(batcher.singles.empty());
+}
+
+TEST_F(IndexCompleteBatcher, fallback_keeps_order)
+{
+  FakeBatcher batcher;
+  batcher.create("test_idx_batch");
+  batcher.queue("a");
+  batcher.queue("b");
+  batcher.queue("c");
+  batcher.queue("d");
+  // still waiting for more ops
+  batcher.queue("e");
+  ASSERT_EQ(2u, batcher.num_batches());
+
+  // the first batch is turned down while the second one is in flight: the
+  // queued op and the ones queued from now on wait for the second batch
+  batcher.complete(0, -EOPNOTSUPP);
+  batcher.queue("f");
+  batcher.complete(1, -EOPNOTSUPP);
+  batcher.queue("g");
+  batcher.stop();
+
+  EXPECT_EQ(2u, batcher.num_batches());
+  EXPECT_EQ(std::vector<std::string>({"a", "b", "c", "d", "e", "f", "g"}),
+            batcher.singles);
+}
+
+TEST_F(IndexCompleteBatcher, fallback_after_success)
+{
+  FakeBatcher batcher;
+  batcher.create("test_idx_batch");
+  batcher.queue("a");
+  batcher.queue("b");
+  batcher.queue("c");
+  batcher.queue("d");
+  batcher.complete(0, -EOPNOTSUPP);
+  batcher.queue("e");
+  // the last batch in flight made it, the held op can go
+  batcher.complete(1, 0);
+  batcher.queue("f");
+  batcher.stop();
+
+  EXPECT_EQ(std::vector<std::string>({"a", "b", "e", "f"}), batcher.singles);
+}
@@ -0,0 +1,267 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Lifecycle expiration of a sharded bucket, run against the zone of a
+ * running cluster.
+ */
+
+#include <iostream>
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "include/stringify.h"
+#include "cls/rgw/cls_rgw_client.h"
+#include "rgw/rgw_common.h"
+#include "rgw/rgw_rados.h"
+#include "rgw/rgw_bucket.h"
+#include "rgw/rgw_lc.h"
+#include <gtest/gtest.h>
+
+using namespace std;
+
+static RGWRados *store;
+
+class LCTest : public ::testing::Test {
+public:
+  static const uint32_t num_shards = 7;
+  static const int num_objs = 50;
+  static const int index = 0;
+
+  RGWLC lc;
+  librados::IoCtx *lc_ctx = store->get_lc_pool_ctx();
+  RGWBucketInfo bucket_info;
+  string bucket_key;
+  string lc_oid;
+
+  void set_conf(const string& key, const string& val) {
+    g_conf->set_val(key.c_str(), val);
+    g_conf->apply_changes(NULL);
+  }
+
+  void SetUp() override {
+    set_conf("rgw_lifecycle_work_time", "00:00-23:59");
+    lc.initialize(g_ceph_context, store);
+    lc_oid = lc_oid_prefix + ".0";
+
+    /* expire everything after a day */
+    RGWLifecycleConfiguration config(g_ceph_context);
+    LCRule rule;
+    string id = "expire", prefix, status = "Enabled";
+    LCExpiration expiration;
+    expiration.set_days("1");
+    rule.set_id(&id);
+    rule.set_prefix(&prefix);
+    rule.set_status(&status);
+    rule.set_expiration(&expiration);
+    ASSERT_EQ(0, config.check_and_add_rule(&rule));
+    map<string, bufferlist> attrs;
+    ::encode(config, attrs[RGW_ATTR_LC]);
+
+    RGWUserInfo owner;
+    owner.user_id = rgw_user("test_rgw_lc");
+    rgw_bucket bucket;
+    bucket.name = "test-rgw-lc-" + stringify(ceph_clock_now().to_nsec());
+    uint32_t shards = num_shards;
+    ASSERT_EQ(0, store->create_bucket(owner, bucket, store->get_zonegroup().get_id(), "", "",
+                                      NULL, attrs, bucket_info, NULL, NULL, real_time(),
+                                      NULL, &shards));
+    bucket_key = bucket.tenant + ":" + bucket.name + ":" + bucket.bucket_id;
+
+    /* half of the objects are two days old */
+    real_time old = real_clock::now() - make_timespan(2 * 24 * 60 * 60);
+    for (int i = 0; i < num_objs; i++) {
+      ASSERT_EQ(0, put_obj("old-" + stringify(i), old));
+      ASSERT_EQ(0, put_obj("new-" + stringify(i), real_time()));
+    }
+
+    pair<string, int> entry(bucket_key, lc_uninitial);
+    ASSERT_EQ(0, cls_rgw_lc_set_entry(*lc_ctx, lc_oid, entry));
+  }
+
+  void TearDown() override {
+    pair<string, int> entry(bucket_key, lc_uninitial);
+    cls_rgw_lc_rm_entry(*lc_ctx, lc_oid, entry);
+    set<string> keys = { bucket_key };
+    lc_ctx->omap_rm_keys(lc_oid + ".progress", keys);
+    rgw_remove_bucket(store, bucket_info.bucket, true);
+    set_conf("rgw_lifecycle_work_time", "00:00-06:00");
+    set_conf("rgw_lc_max_wp_worker", "3");
+    set_conf("rgw_lc_delete_max_aio", "16");
+  }
+
+  int put_obj(const string& name, real_time mtime) {
+    RGWObjectCtx obj_ctx(store);
+    RGWPutObjProcessor_Atomic processor(obj_ctx, bucket_info, bucket_info.bucket, name,
+                                        g_conf->rgw_obj_stripe_size, "lctag", false);
+    int r = processor.prepare(store, NULL);
+    if (r < 0) {
+      return r;
+    }
+    bufferlist bl;
+    bl.append(name);
+    void *handle;
+    rgw_raw_obj obj;
+    bool again;
+    r = processor.handle_data(bl, 0, &handle, &obj, &again);
+    if (r < 0) {
+      return r;
+    }
+    r = processor.throttle_data(handle, obj, bl.length(), false);
+    if (r < 0) {
+      return r;
+    }
+    map<string, bufferlist> attrs;
+    return processor.complete(bl.length(), "etag", NULL, mtime, attrs, real_time());
+  }
+
+  int shard_of(const string& name) {
+    int shard_id;
+    int r = store->get_target_shard_id(bucket_info, name, &shard_id);
+    assert(r == 0);
+    return shard_id;
+  }
+
+  /* the objects left in the bucket index */
+  set<string> list_objs() {
+    set<string> names;
+    for (uint32_t shard = 0; shard < num_shards; shard++) {
+      rgw_obj_index_key marker;
+      bool truncated;
+      do {
+        map<string, rgw_bucket_dir_entry> ent_map;
+        int r = store->cls_bucket_list(bucket_info, shard, marker, "", 1000, false,
+                                       ent_map, &truncated, &marker);
+        assert(r == 0);
+        for (auto& e : ent_map) {
+          names.insert(e.second.key.name);
+        }
+      } while (truncated);
+    }
+    return names;
+  }
+
+  /* what's left once a pass skipped the old objects of @skip_shards */
+  set<string> expected_objs(const set<int>& skip_shards) {
+    set<string> names;
+    for (int i = 0; i < num_objs; i++) {
+      names.insert("new-" + stringify(i));
+      string old = "old-" + stringify(i);
+      if (skip_shards.count(shard_of(old))) {
+        names.insert(old);
+      }
+    }
+    return names;
+  }
+
+  void write_progress(const rgw_lc_bucket_progress& progress) {
+    map<string, bufferlist> vals;
+    ::encode(progress, vals[bucket_key]);
+    ASSERT_EQ(0, lc_ctx->omap_set(lc_oid + ".progress", vals));
+  }
+
+  bool has_progress() {
+    set<string> keys = { bucket_key };
+    map<string, bufferlist> vals;
+    lc_ctx->omap_get_vals_by_keys(lc_oid + ".progress", keys, &vals);
+    return !vals.empty();
+  }
+
+  int entry_status() {
+    map<string, int> entries;
+    int r = cls_rgw_lc_list(*lc_ctx, lc_oid, "", 1000, entries);
+    assert(r == 0);
+    auto iter = entries.find(bucket_key);
+    return iter == entries.end() ? -1 : iter->second;
+  }
+};
+
+TEST_F(LCTest, expire_shards)
+{
+  ASSERT_EQ(0, lc.bucket_lc_process(index, bucket_key));
+  ASSERT_EQ(expected_objs({}), list_objs());
+  ASSERT_FALSE(has_progress());
+}
+
+TEST_F(LCTest, expire_serial)
+{
+  /* one shard at a time, one delete at a time */
+  set_conf("rgw_lc_max_wp_worker", "1");
+  set_conf("rgw_lc_delete_max_aio", "1");
+  ASSERT_EQ(0, lc.bucket_lc_process(index, bucket_key));
+  ASSERT_EQ(expected_objs({}), list_objs());
+  ASSERT_FALSE(has_progress());
+}
+
+TEST_F(LCTest, resume)
+{
+  /* a pass that got through one shard already */
+  int done = shard_of("old-0");
+  rgw_lc_bucket_progress progress;
+  progress.complete.insert(done);
+  write_progress(progress);
+
+  ASSERT_EQ(0, lc.bucket_lc_process(index, bucket_key));
+  ASSERT_EQ(expected_objs({done}), list_objs());
+  ASSERT_FALSE(has_progress());
+}
+
+TEST_F(LCTest, resume_same_day)
+{
+  /* today's pass took the bucket and got interrupted after one shard */
+  cls_rgw_lc_obj_head head;
+  head.start_date = ceph_clock_now().sec();
+  head.marker = bucket_key;
+  ASSERT_EQ(0, cls_rgw_lc_put_head(*lc_ctx, lc_oid, head));
+  int done = shard_of("old-0");
+  rgw_lc_bucket_progress progress;
+  progress.complete.insert(done);
+  write_progress(progress);
+
+  pair<string, int> entry(bucket_key, lc_processing);
+  int result = -ECANCELED;
+  ASSERT_EQ(0, lc.bucket_lc_post(index, 60, entry, result, ""));
+  ASSERT_EQ(lc_uninitial, entry_status());
+  ASSERT_EQ(0, cls_rgw_lc_get_head(*lc_ctx, lc_oid, head));
+  ASSERT_EQ("", head.marker);
+
+  /* the next pass of the day picks it up where it stopped */
+  ASSERT_EQ(0, lc.process(index, 60));
+  ASSERT_EQ(expected_objs({done}), list_objs());
+  ASSERT_EQ(lc_complete, entry_status());
+  ASSERT_FALSE(has_progress());
+}
+
+TEST_F(LCTest, work_time)
+{
+  /* a work time that doesn't include now */
+  struct tm bdt;
+  time_t now = ceph_clock_now().sec();
+  localtime_r(&now, &bdt);
+  char worktime[32];
+  int hour = (bdt.tm_hour + 22) % 24;
+  snprintf(worktime, sizeof(worktime), "%02d:00-%02d:01", hour, hour);
+  set_conf("rgw_lifecycle_work_time", worktime);
+
+  ASSERT_EQ(-ECANCELED, lc.bucket_lc_process(index, bucket_key));
+  ASSERT_EQ(0, lc.process(index, 60));
+  ASSERT_EQ(lc_uninitial, entry_status());
+  ASSERT_EQ(expected_objs({0, 1, 2, 3, 4, 5, 6}), list_objs());
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+  store = RGWStoreManager::get_storage(g_ceph_context, false, false, false, false);
+  if (!store) {
+    cerr << "couldn't init storage provider" << std::endl;
+    return 1;
+  }
+
+  ::testing::InitGoogleTest(&argc, argv);
+  int r = RUN_ALL_TESTS();
+  RGWStoreManager::close_storage(store);
+  return r;
+}
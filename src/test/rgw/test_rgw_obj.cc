@@ -207,6 +207,28 @@ TEST(TestRGWObj, obj_to_raw) {
   }
 }
 
+TEST(TestRGWObj, index_hash_source) {
+  /* plain objects hash by their name, escaped or not */
+  for (auto name : { "myobj", "_myobj", "my.obj.meta"}) {
+    ASSERT_EQ(string(name), rgw_index_hash_source(rgw_obj_key(name)));
+    ASSERT_EQ(string(name), rgw_index_hash_source(rgw_obj_key(name, "inst")));
+  }
+
+  /* multipart entries hash by the object being uploaded */
+  RGWMPObj mp("my.obj", "2~upload");
+  rgw_obj_key meta(mp.get_meta(), string(), RGW_OBJ_NS_MULTIPART);
+  ASSERT_EQ("my.obj", rgw_index_hash_source(meta));
+  rgw_obj_key part(mp.get_part(3), string(), RGW_OBJ_NS_MULTIPART);
+  ASSERT_EQ("my.obj", rgw_index_hash_source(part));
+
+  /* as parsed back from an index key, e.g. a listing marker */
+  rgw_obj_index_key index_key;
+  meta.get_index_key(&index_key);
+  rgw_obj_key parsed;
+  ASSERT_TRUE(rgw_obj_key::parse_raw_oid(index_key.name, &parsed));
+  ASSERT_EQ("my.obj", rgw_index_hash_source(parsed));
+}
+
 TEST(TestRGWObj, old_to_raw) {
   JSONFormatter f(true);
   test_rgw_env env;
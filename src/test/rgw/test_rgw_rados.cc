@@ -0,0 +1,289 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * RGWRados helpers that talk to the OSDs directly, run against the zone
+ * of a running cluster.
+ */
+
+#include <iostream>
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "cls/refcount/cls_refcount_client.h"
+#include "rgw/rgw_common.h"
+#include "rgw/rgw_rados.h"
+#include "rgw/rgw_multi.h"
+#include <gtest/gtest.h>
+
+using namespace std;
+
+static RGWRados *store;
+
+static void init_bucket_info(RGWBucketInfo *info, const string& name)
+{
+  info->bucket.name = name;
+  info->bucket.marker = info->bucket.bucket_id = "test_rgw_rados." + name;
+  info->placement_rule = store->get_zonegroup().default_placement;
+}
+
+static string part_key(int num)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "part.%08d", num);
+  return buf;
+}
+
+class FetchMultipartParts : public ::testing::Test {
+public:
+  RGWBucketInfo bucket_info;
+  string upload_id = "2~fetchtest";
+  string meta_oid;
+  rgw_rados_ref meta_ref;
+
+  void SetUp() override {
+    init_bucket_info(&bucket_info, "fetch_parts");
+    RGWMPObj mp("obj", upload_id);
+    meta_oid = mp.get_meta();
+
+    rgw_obj obj;
+    obj.init_ns(bucket_info.bucket, meta_oid, RGW_OBJ_NS_MULTIPART);
+    obj.set_in_extra_data(true);
+    rgw_raw_obj raw_obj;
+    store->obj_to_raw(bucket_info.placement_rule, obj, &raw_obj);
+    ASSERT_EQ(0, store->get_raw_obj_ref(raw_obj, &meta_ref));
+    meta_ref.ioctx.remove(meta_ref.oid);
+  }
+
+  void TearDown() override {
+    meta_ref.ioctx.remove(meta_ref.oid);
+  }
+
+  void upload_parts(int first, int last) {
+    map<string, bufferlist> vals;
+    for (int i = first; i <= last; ++i) {
+      RGWUploadPartInfo info;
+      info.num = i;
+      info.size = i * 10;
+      ::encode(info, vals[part_key(i)]);
+    }
+    ASSERT_EQ(0, meta_ref.ioctx.omap_set(meta_ref.oid, vals));
+  }
+
+  int fetch(const map<int, string>& req_parts, map<uint32_t, RGWUploadPartInfo>& parts) {
+    return fetch_multipart_parts(store, bucket_info, g_ceph_context, upload_id, meta_oid,
+                                 req_parts, parts);
+  }
+
+  static map<int, string> req(int first, int last) {
+    map<int, string> parts;
+    for (int i = first; i <= last; ++i) {
+      parts[i] = "etag";
+    }
+    return parts;
+  }
+};
+
+TEST_F(FetchMultipartParts, match)
+{
+  /* spans several pages */
+  upload_parts(1, 2500);
+  map<uint32_t, RGWUploadPartInfo> parts;
+  ASSERT_EQ(0, fetch(req(1, 2500), parts));
+  ASSERT_EQ(2500u, parts.size());
+  for (auto& p : parts) {
+    ASSERT_EQ(p.first, p.second.num);
+    ASSERT_EQ(p.first * 10, p.second.size);
+  }
+}
+
+TEST_F(FetchMultipartParts, mismatch)
+{
+  upload_parts(1, 5);
+  map<uint32_t, RGWUploadPartInfo> parts;
+
+  /* a part that was skipped */
+  map<int, string> r = req(1, 5);
+  r.erase(3);
+  ASSERT_EQ(-EAGAIN, fetch(r, parts));
+  ASSERT_TRUE(parts.empty());
+
+  /* parts uploaded beyond the requested ones */
+  ASSERT_EQ(-EAGAIN, fetch(req(1, 4), parts));
+  ASSERT_TRUE(parts.empty());
+
+  /* a part that was never uploaded */
+  ASSERT_EQ(-EAGAIN, fetch(req(1, 6), parts));
+  ASSERT_TRUE(parts.empty());
+
+  /* the fallback walk sees every uploaded part */
+  int next_marker;
+  bool truncated;
+  ASSERT_EQ(0, list_multipart_parts(store, bucket_info, g_ceph_context, upload_id, meta_oid,
+                                    1000, 0, parts, &next_marker, &truncated));
+  ASSERT_EQ(5u, parts.size());
+  ASSERT_FALSE(truncated);
+}
+
+TEST_F(FetchMultipartParts, fallback_cases)
+{
+  upload_parts(1, 3);
+  map<uint32_t, RGWUploadPartInfo> parts;
+
+  /* legacy upload ids aren't sorted by part number */
+  string v2_id = upload_id;
+  upload_id = "fetchtest";
+  ASSERT_EQ(-EAGAIN, fetch(req(1, 3), parts));
+  upload_id = v2_id;
+
+  /* an undecodable part info is an error, not a mismatch */
+  map<string, bufferlist> vals;
+  vals[part_key(2)].append("garbage");
+  ASSERT_EQ(0, meta_ref.ioctx.omap_set(meta_ref.oid, vals));
+  ASSERT_EQ(-EIO, fetch(req(1, 3), parts));
+}
+
+class CopyObjTail : public ::testing::Test {
+public:
+  static const uint64_t head_size = 4096;
+  static const uint64_t stripe_size = 8192;
+  static const uint64_t obj_size = head_size + 4 * stripe_size + 100;
+
+  RGWBucketInfo bucket_info;
+  RGWObjManifest src;
+  RGWObjManifest dest;
+
+  void SetUp() override {
+    init_bucket_info(&bucket_info, "copy_tail");
+    rgw_obj head(bucket_info.bucket, "obj");
+
+    src.set_trivial_rule(head_size, stripe_size);
+    src.set_head(bucket_info.placement_rule, head, head_size);
+    src.set_tail_placement(bucket_info.placement_rule, bucket_info.bucket);
+    src.set_prefix(".test_rgw_rados_");
+    src.set_obj_size(obj_size);
+
+    dest = src;
+    dest.prepend_tail_prefix("copy_");
+  }
+
+  void TearDown() override {
+    for (auto m : { &src, &dest }) {
+      for (auto iter = m->obj_begin(); iter != m->obj_end(); ++iter) {
+        store->delete_raw_obj(iter.get_location().get_raw_obj(store));
+      }
+    }
+  }
+
+  static string stripe_data(uint64_t ofs) {
+    return string(16, 'a' + (ofs / stripe_size) % 26);
+  }
+
+  /* the tail objects of src, with their source refcount */
+  void write_src_tail() {
+    for (auto iter = src.obj_begin(); iter != src.obj_end(); ++iter) {
+      if (iter.get_ofs() < head_size) {
+        continue;
+      }
+      rgw_rados_ref ref;
+      ASSERT_EQ(0, store->get_raw_obj_ref(iter.get_location().get_raw_obj(store), &ref));
+      librados::ObjectWriteOperation op;
+      bufferlist bl;
+      bl.append(stripe_data(iter.get_ofs()));
+      op.write_full(bl);
+      cls_refcount_get(op, "srctag");
+      ASSERT_EQ(0, ref.ioctx.operate(ref.oid, &op));
+    }
+  }
+
+  int num_tail_objs() {
+    int n = 0;
+    for (auto iter = src.obj_begin(); iter != src.obj_end(); ++iter) {
+      if (iter.get_ofs() >= head_size) {
+        ++n;
+      }
+    }
+    return n;
+  }
+};
+
+TEST_F(CopyObjTail, copy)
+{
+  write_src_tail();
+  ASSERT_EQ(5, num_tail_objs());
+
+  vector<rgw_raw_obj> copied;
+  ASSERT_EQ(0, store->copy_obj_tail(src, dest, "desttag", &copied));
+  ASSERT_EQ(5u, copied.size());
+
+  auto siter = src.obj_begin();
+  for (auto iter = dest.obj_begin(); iter != dest.obj_end(); ++iter, ++siter) {
+    rgw_raw_obj dest_loc = iter.get_location().get_raw_obj(store);
+    rgw_raw_obj src_loc = siter.get_location().get_raw_obj(store);
+    if (iter.get_ofs() < head_size) {
+      continue;
+    }
+    ASSERT_NE(src_loc.oid, dest_loc.oid);
+
+    rgw_rados_ref ref;
+    ASSERT_EQ(0, store->get_raw_obj_ref(dest_loc, &ref));
+    bufferlist bl;
+    ASSERT_EQ(16, ref.ioctx.read(ref.oid, bl, 0, 0));
+    ASSERT_EQ(stripe_data(iter.get_ofs()), bl.to_str());
+
+    /* the copy is referenced by the new object only */
+    list<string> refs;
+    ASSERT_EQ(0, cls_refcount_read(ref.ioctx, ref.oid, &refs));
+    ASSERT_EQ(list<string>{"desttag"}, refs);
+
+    /* and the source keeps its own reference */
+    rgw_rados_ref sref;
+    ASSERT_EQ(0, store->get_raw_obj_ref(src_loc, &sref));
+    refs.clear();
+    ASSERT_EQ(0, cls_refcount_read(sref.ioctx, sref.oid, &refs));
+    ASSERT_EQ(list<string>{"srctag"}, refs);
+  }
+}
+
+TEST_F(CopyObjTail, cleanup_on_error)
+{
+  write_src_tail();
+
+  /* lose a tail object in the middle of the source */
+  auto iter = src.obj_find(head_size + 2 * stripe_size);
+  ASSERT_EQ(0, store->delete_raw_obj(iter.get_location().get_raw_obj(store)));
+
+  /* whatever the concurrency, nothing is left behind */
+  string orig_max_aio = std::to_string(g_conf->rgw_copy_obj_max_aio);
+  for (auto max_aio : { "1", "16" }) {
+    g_conf->set_val("rgw_copy_obj_max_aio", max_aio);
+    vector<rgw_raw_obj> copied;
+    ASSERT_EQ(-ENOENT, store->copy_obj_tail(src, dest, "desttag", &copied));
+    ASSERT_TRUE(copied.empty());
+
+    for (auto diter = dest.obj_begin(); diter != dest.obj_end(); ++diter) {
+      rgw_rados_ref ref;
+      ASSERT_EQ(0, store->get_raw_obj_ref(diter.get_location().get_raw_obj(store), &ref));
+      uint64_t size;
+      ASSERT_EQ(-ENOENT, ref.ioctx.stat(ref.oid, &size, NULL));
+    }
+  }
+  g_conf->set_val("rgw_copy_obj_max_aio", orig_max_aio);
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+  store = RGWStoreManager::get_storage(g_ceph_context, false, false, false, false);
+  if (!store) {
+    cerr << "couldn't init storage provider" << std::endl;
+    return 1;
+  }
+
+  ::testing::InitGoogleTest(&argc, argv);
+  int r = RUN_ALL_TESTS();
+  RGWStoreManager::close_storage(store);
+  return r;
+}
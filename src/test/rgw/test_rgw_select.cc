@@ -0,0 +1,269 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include "gtest/gtest.h"
+
+#include "rgw/rgw_select.h"
+
+struct CollectCB : public RGWGetDataCB {
+  std::string out;
+  int handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len) override {
+    out.append(bl.c_str() + bl_ofs, bl_len);
+    return 0;
+  }
+};
+
+// run the query over the input, fed in chunks of chunk_size bytes
+static std::string select(const std::string& sql, const std::string& input,
+                          const RGWSelectFormat& in_fmt,
+                          const RGWSelectFormat& out_fmt,
+                          size_t chunk_size = 7)
+{
+  RGWSelectQuery query;
+  std::string err;
+  EXPECT_EQ(0, query.parse(sql, &err)) << err;
+
+  CollectCB cb;
+  RGWGetObj_Select filter(g_ceph_context, query, in_fmt, out_fmt, &cb);
+  size_t ofs = 0;
+  for (; ofs < input.size(); ofs += chunk_size) {
+    bufferlist bl;
+    bl.append(input.substr(ofs, chunk_size));
+    int r = filter.handle_data(bl, 0, bl.length());
+    if (r == -ECANCELED && filter.done()) {
+      // LIMIT reached, the read stops here
+      ofs = std::min(ofs + chunk_size, input.size());
+      break;
+    }
+    EXPECT_EQ(0, r);
+  }
+  EXPECT_EQ(0, filter.flush());
+  EXPECT_EQ(ofs, filter.get_bytes_scanned());
+  EXPECT_EQ(cb.out.size(), filter.get_bytes_returned());
+  return cb.out;
+}
+
+static const std::string csv_input =
+  "name,age,city\n"
+  "alice,31,paris\n"
+  "bob,7,\"new york, ny\"\n"
+  "carol,45,berlin\r\n"
+  "dave,120,paris"; // no trailing delimiter
+
+TEST(Select, Parse)
+{
+  RGWSelectQuery query;
+  std::string err;
+  ASSERT_EQ(0, query.parse("select * from s3object", &err));
+  ASSERT_TRUE(query.selects_all());
+  ASSERT_EQ(-1, query.get_limit());
+
+  RGWSelectQuery query2;
+  ASSERT_EQ(0, query2.parse("SELECT s._1, s.\"my col\" FROM S3Object s "
+                            "WHERE NOT (s._2 > 3 OR s._1 LIKE 'a%') LIMIT 5",
+                            &err));
+  ASSERT_FALSE(query2.selects_all());
+  ASSERT_EQ(2u, query2.get_projection().size());
+  ASSERT_EQ(0, query2.get_projection()[0].index);
+  ASSERT_EQ("my col", query2.get_projection()[1].value);
+  ASSERT_EQ(5, query2.get_limit());
+
+  const char *bad[] = {
+    "",
+    "SELECT",
+    "SELECT * FROM",
+    "SELECT * FROM table",
+    "SELECT * FROM S3Object WHERE",
+    "SELECT * FROM S3Object WHERE _1 =",
+    "SELECT * FROM S3Object WHERE _1 LIKE _2",
+    "SELECT * FROM S3Object WHERE (_1 = 'a'",
+    "SELECT * FROM S3Object WHERE _1 = 'a",
+    "SELECT * FROM S3Object LIMIT x",
+    "SELECT * FROM S3Object s garbage",
+  };
+  for (auto sql : bad) {
+    RGWSelectQuery q;
+    ASSERT_EQ(-EINVAL, q.parse(sql, &err)) << sql;
+    ASSERT_FALSE(err.empty());
+  }
+}
+
+TEST(Select, CSVWhere)
+{
+  RGWSelectFormat in_fmt;
+  in_fmt.header_info = RGWSelectFormat::HEADER_USE;
+  RGWSelectFormat out_fmt;
+
+  // numbers compare as numbers: "7" < "31" although '7' > '3'
+  ASSERT_EQ("alice,31,paris\nbob,7,\"new york, ny\"\n",
+            select("SELECT * FROM S3Object WHERE age < 40", csv_input,
+                   in_fmt, out_fmt));
+  ASSERT_EQ("bob,7,\"new york, ny\"\n",
+            select("SELECT * FROM S3Object WHERE age < 40 AND name <> 'alice'",
+                   csv_input, in_fmt, out_fmt));
+  ASSERT_EQ("carol\ndave\n",
+            select("SELECT s.name FROM S3Object s WHERE s.age >= 45",
+                   csv_input, in_fmt, out_fmt));
+  ASSERT_EQ("alice,paris\ndave,paris\n",
+            select("SELECT _1, _3 FROM S3Object WHERE city LIKE 'pa%'",
+                   csv_input, in_fmt, out_fmt));
+  ASSERT_EQ("bob\n",
+            select("SELECT name FROM S3Object WHERE city LIKE '%york%'",
+                   csv_input, in_fmt, out_fmt, 1));
+  ASSERT_EQ("alice\n",
+            select("SELECT name FROM S3Object LIMIT 1", csv_input,
+                   in_fmt, out_fmt));
+  // no such column: NULL, and comparisons with NULL are false
+  ASSERT_EQ("",
+            select("SELECT name FROM S3Object WHERE zip = '1'", csv_input,
+                   in_fmt, out_fmt));
+  ASSERT_EQ("alice\nbob\ncarol\ndave\n",
+            select("SELECT name FROM S3Object WHERE zip IS NULL", csv_input,
+                   in_fmt, out_fmt));
+}
+
+TEST(Select, CSVNoHeader)
+{
+  RGWSelectFormat in_fmt;
+  in_fmt.field_delim = '|';
+  RGWSelectFormat out_fmt;
+  out_fmt.type = RGWSelectFormat::JSON;
+
+  ASSERT_EQ("{\"_2\":\"b\"}\n{\"_2\":\"e\\\"f\"}\n",
+            select("SELECT _2 FROM S3Object", "a|b|c\nd|e\"f\n",
+                   in_fmt, out_fmt));
+
+  in_fmt.header_info = RGWSelectFormat::HEADER_IGNORE;
+  ASSERT_EQ("{\"_1\":\"d\",\"_2\":\"e\\\"f\"}\n",
+            select("SELECT * FROM S3Object", "a|b|c\nd|e\"f\n",
+                   in_fmt, out_fmt));
+}
+
+TEST(Select, JSONLines)
+{
+  RGWSelectFormat in_fmt;
+  in_fmt.type = RGWSelectFormat::JSON;
+  RGWSelectFormat out_fmt;
+  out_fmt.type = RGWSelectFormat::JSON;
+
+  const std::string input =
+    "{\"user\":{\"name\":\"alice\"},\"status\":200,\"bytes\":1024}\n"
+    "\n"
+    "{\"user\":{\"name\":\"bob\"},\"status\":404}\n"
+    "{\"user\":{\"name\":\"carol\"},\"status\":500,\"bytes\":10}\n";
+
+  ASSERT_EQ("{\"user\":{\"name\":\"bob\"},\"status\":404}\n",
+            select("SELECT * FROM S3Object WHERE status = 404", input,
+                   in_fmt, out_fmt));
+  ASSERT_EQ("{\"name\":\"alice\",\"bytes\":\"1024\"}\n"
+            "{\"name\":\"carol\",\"bytes\":\"10\"}\n",
+            select("SELECT s.user.name, s.bytes FROM S3Object s "
+                   "WHERE s.bytes IS NOT NULL", input, in_fmt, out_fmt));
+
+  out_fmt.type = RGWSelectFormat::CSV;
+  ASSERT_EQ("bob\n",
+            select("SELECT s.user.name FROM S3Object s "
+                   "WHERE s.status >= 400 AND s.status < 500",
+                   input, in_fmt, out_fmt));
+
+  // a broken record fails the request
+  RGWSelectQuery query;
+  std::string err;
+  ASSERT_EQ(0, query.parse("SELECT * FROM S3Object", &err));
+  CollectCB cb;
+  RGWGetObj_Select filter(g_ceph_context, query, in_fmt, out_fmt, &cb);
+  bufferlist bl;
+  bl.append("{\"a\":1}\n{\"a\":\n");
+  ASSERT_EQ(-EINVAL, filter.handle_data(bl, 0, bl.length()));
+}
+
+TEST(Select, CSVQuotedDelimiters)
+{
+  RGWSelectFormat in_fmt;
+  RGWSelectFormat out_fmt;
+  out_fmt.type = RGWSelectFormat::JSON;
+
+  // record delimiters and escaped quotes inside quoted fields
+  const std::string input =
+    "1,\"two\nlines\",x\n"
+    "2,\"say \"\"hi\"\"\nthen,\nleave\",y\n"
+    "3,a\"b,z\n";
+  const std::string expected =
+    "{\"_1\":\"1\",\"_2\":\"two\\nlines\"}\n"
+    "{\"_1\":\"2\",\"_2\":\"say \\\"hi\\\"\\nthen,\\nleave\"}\n"
+    "{\"_1\":\"3\",\"_2\":\"a\\\"b\"}\n";
+  for (size_t chunk_size : { 1, 2, 3, 5, 64 }) {
+    ASSERT_EQ(expected,
+              select("SELECT _1, _2 FROM S3Object", input, in_fmt, out_fmt,
+                     chunk_size)) << chunk_size;
+  }
+}
+
+TEST(Select, Limit)
+{
+  RGWSelectFormat in_fmt;
+  RGWSelectFormat out_fmt;
+
+  std::string input;
+  for (int i = 0; i < 100; ++i) {
+    input += std::to_string(i) + "\n";
+  }
+
+  RGWSelectQuery query;
+  std::string err;
+  ASSERT_EQ(0, query.parse("SELECT * FROM S3Object WHERE _1 > 9 LIMIT 2", &err));
+  CollectCB cb;
+  RGWGetObj_Select filter(g_ceph_context, query, in_fmt, out_fmt, &cb);
+  bufferlist bl;
+  bl.append(input.substr(0, 30));
+  ASSERT_EQ(-ECANCELED, filter.handle_data(bl, 0, bl.length()));
+  ASSERT_TRUE(filter.done());
+  ASSERT_EQ("10\n11\n", cb.out);
+  // anything that still comes in is dropped
+  ASSERT_EQ(-ECANCELED, filter.handle_data(bl, 0, bl.length()));
+  ASSERT_EQ(0, filter.flush());
+  ASSERT_EQ(30u, filter.get_bytes_scanned());
+  ASSERT_EQ("10\n11\n", cb.out);
+
+  RGWSelectQuery query0;
+  ASSERT_EQ(0, query0.parse("SELECT * FROM S3Object LIMIT 0", &err));
+  RGWGetObj_Select filter0(g_ceph_context, query0, in_fmt, out_fmt, &cb);
+  ASSERT_TRUE(filter0.done());
+  ASSERT_EQ(-ECANCELED, filter0.handle_data(bl, 0, bl.length()));
+  ASSERT_EQ(0u, filter0.get_bytes_scanned());
+}
+
+TEST(Select, MaxRecordSize)
+{
+  g_ceph_context->_conf->set_val("rgw_select_max_record_size", "16");
+  RGWSelectFormat in_fmt;
+  RGWSelectFormat out_fmt;
+  RGWSelectQuery query;
+  std::string err;
+  ASSERT_EQ(0, query.parse("SELECT * FROM S3Object", &err));
+
+  // a record that fits
+  ASSERT_EQ("0123456789abcdef\n",
+            select("SELECT * FROM S3Object", "0123456789abcdef\n", in_fmt,
+                   out_fmt, 5));
+
+  // a long record within one chunk
+  {
+    CollectCB cb;
+    RGWGetObj_Select filter(g_ceph_context, query, in_fmt, out_fmt, &cb);
+    bufferlist bl;
+    bl.append("a\n0123456789abcdefg\n");
+    ASSERT_EQ(-ERR_OVER_MAX_RECORD_SIZE, filter.handle_data(bl, 0, bl.length()));
+  }
+
+  // a record that never ends is not buffered past the limit, a quoted
+  // record delimiter doesn't end it
+  {
+    CollectCB cb;
+    RGWGetObj_Select filter(g_ceph_context, query, in_fmt, out_fmt, &cb);
+    bufferlist bl;
+    bl.append("\"0123\n4567");
+    ASSERT_EQ(0, filter.handle_data(bl, 0, bl.length()));
+    ASSERT_EQ(-ERR_OVER_MAX_RECORD_SIZE, filter.handle_data(bl, 0, bl.length()));
+  }
+  g_ceph_context->_conf->set_val("rgw_select_max_record_size", "1048576");
+}
@@ -0,0 +1,140 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include "gtest/gtest.h"
+
+#include "rgw/rgw_yield.h"
+
+#include <thread>
+
+namespace {
+
+// completes a callback from another thread, like a librados completion
+void complete_later(rgw_yield_cb_t cb, int r)
+{
+  std::thread([cb, r] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      cb(r);
+    }).detach();
+}
+
+} // anonymous namespace
+
+TEST(RGWYield, NullYieldBlocks)
+{
+  // without a coroutine the caller's thread blocks until the completion
+  std::thread::id caller = std::this_thread::get_id();
+  bool issued = false;
+  int r = rgw_yield_call(optional_yield(), [&] (rgw_yield_cb_t cb) {
+      EXPECT_EQ(caller, std::this_thread::get_id());
+      issued = true;
+      complete_later(cb, 7);
+      return 0;
+    });
+  EXPECT_TRUE(issued);
+  EXPECT_EQ(7, r);
+}
+
+TEST(RGWYield, NullYieldIssueError)
+{
+  int r = rgw_yield_call(optional_yield(), [] (rgw_yield_cb_t cb) {
+      return -EINVAL;
+    });
+  EXPECT_EQ(-EINVAL, r);
+}
+
+TEST(RGWYield, NullYieldWaiter)
+{
+  RGWYieldWaiter waiter;
+  std::thread t([&waiter] { waiter.notify(); });
+  waiter.wait(optional_yield());
+  t.join();
+
+  // a notify() with nobody waiting is not lost
+  waiter.notify();
+  waiter.wait(optional_yield());
+}
+
+#ifdef WITH_RADOSGW_BEAST_FRONTEND
+
+TEST(RGWYield, CompletionResumesCoroutine)
+{
+  boost::asio::io_service service;
+  bool resumed = false;
+  boost::asio::spawn(service, [&] (boost::asio::yield_context yc) {
+      optional_yield y(service, yc);
+      int r = rgw_yield_call(y, [] (rgw_yield_cb_t cb) {
+          complete_later(cb, 0);
+          return 0;
+        });
+      EXPECT_EQ(0, r);
+      resumed = true;
+    });
+  // run() returns once the coroutine finished; the pending op keeps the
+  // service from running out of work before that
+  service.run();
+  EXPECT_TRUE(resumed);
+}
+
+TEST(RGWYield, CoroutineDoesNotBlockThread)
+{
+  // both coroutines suspend on a single thread; the second one completes
+  // the first's op, which could not happen if the first blocked the thread
+  boost::asio::io_service service;
+  rgw_yield_cb_t pending;
+  int first = 1;
+  boost::asio::spawn(service, [&] (boost::asio::yield_context yc) {
+      optional_yield y(service, yc);
+      first = rgw_yield_call(y, [&] (rgw_yield_cb_t cb) {
+          pending = cb;
+          return 0;
+        });
+    });
+  boost::asio::spawn(service, [&] (boost::asio::yield_context yc) {
+      ASSERT_TRUE(pending);
+      pending(0);
+      pending = nullptr;
+    });
+  service.run();
+  EXPECT_EQ(0, first);
+}
+
+TEST(RGWYield, ResultPropagates)
+{
+  boost::asio::io_service service;
+  int completed = 0, issue_failed = 0;
+  boost::asio::spawn(service, [&] (boost::asio::yield_context yc) {
+      optional_yield y(service, yc);
+      completed = rgw_yield_call(y, [] (rgw_yield_cb_t cb) {
+          complete_later(cb, -EIO);
+          return 0;
+        });
+      issue_failed = rgw_yield_call(y, [] (rgw_yield_cb_t cb) {
+          return -ENOENT;
+        });
+    });
+  service.run();
+  EXPECT_EQ(-EIO, completed);
+  EXPECT_EQ(-ENOENT, issue_failed);
+}
+
+TEST(RGWYield, WaiterResumesCoroutine)
+{
+  boost::asio::io_service service;
+  RGWYieldWaiter waiter;
+  bool resumed = false;
+  std::thread t;
+  boost::asio::spawn(service, [&] (boost::asio::yield_context yc) {
+      optional_yield y(service, yc);
+      t = std::thread([&waiter] {
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          waiter.notify();
+        });
+      waiter.wait(y);
+      resumed = true;
+    });
+  service.run();
+  t.join();
+  EXPECT_TRUE(resumed);
+}
+
+#endif // WITH_RADOSGW_BEAST_FRONTEND
@@ -704,7 +704,10 @@ int set_osdmap(ObjectStore *store, epoch_t e, bufferlist& bl, bool force,
     }
   }
   const ghobject_t full_oid = OSD::get_osdmap_pobject_name(e);
-  if (!store->exists(coll_t::meta(), full_oid)) {
+  // with osd_map_full_interval > 1 only some full maps are persisted, the
+  // others are rebuilt from the incremental of the same epoch
+  if (!store->exists(coll_t::meta(), full_oid) &&
+      !store->exists(coll_t::meta(), OSD::get_inc_osdmap_pobject_name(e))) {
     cerr << "osdmap (" << full_oid << ") does not exist." << std::endl;
     if (!force) {
       return -ENOENT;
@@ -713,9 +716,11 @@ int set_osdmap(ObjectStore *store, epoch_t e, bufferlist& bl, bool force,
   }
   if (dry_run)
     return 0;
+  bufferlist sbl;
+  OSD::encode_stored_osdmap(g_ceph_context, bl, sbl);
   ObjectStore::Transaction t;
-  t.write(coll_t::meta(), full_oid, 0, bl.length(), bl);
-  t.truncate(coll_t::meta(), full_oid, bl.length());
+  t.write(coll_t::meta(), full_oid, 0, sbl.length(), sbl);
+  t.truncate(coll_t::meta(), full_oid, sbl.length());
   int ret = store->apply_transaction(&osr, std::move(t));
   if (ret) {
     cerr << "Failed to set osdmap (" << full_oid << "): " << ret << std::endl;
@@ -727,8 +732,7 @@ int set_osdmap(ObjectStore *store, epoch_t e, bufferlist& bl, bool force,
 
 int get_osdmap(ObjectStore *store, epoch_t e, OSDMap &osdmap, bufferlist& bl)
 {
-  bool found = store->read(
-      coll_t::meta(), OSD::get_osdmap_pobject_name(e), 0, 0, bl) >= 0;
+  bool found = OSD::read_stored_osdmap(g_ceph_context, store, e, bl) >= 0;
   if (!found) {
     cerr << "Can't find OSDMap for pg epoch " << e << std::endl;
     return -ENOENT;
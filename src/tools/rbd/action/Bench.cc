@@ -6,6 +6,7 @@
 #include "tools/rbd/Utils.h"
 #include "common/errno.h"
 #include "common/strtol.h"
+#include "include/stringify.h"
 #include "common/Cond.h"
 #include "common/Mutex.h"
 #include <iostream>
@@ -33,6 +34,7 @@ enum io_type_t {
 struct IOType {};
 struct Size {};
 struct IOPattern {};
+struct DispatchThreads {};
 
 void validate(boost::any& v, const std::vector<std::string>& values,
               Size *target_type, int) {
@@ -60,6 +62,31 @@ void validate(boost::any& v, const std::vector<std::string>& values,
   }
 }
 
+void validate(boost::any& v, const std::vector<std::string>& values,
+              DispatchThreads *target_type, int) {
+  po::validators::check_first_occurrence(v);
+  const std::string &s = po::validators::get_single_string(values);
+
+  std::vector<uint32_t> dispatch_threads;
+  std::string::size_type pos = 0;
+  while (pos <= s.size()) {
+    std::string::size_type end = s.find(',', pos);
+    if (end == std::string::npos) {
+      end = s.size();
+    }
+
+    std::string parse_error;
+    int threads = strict_strtol(s.substr(pos, end - pos).c_str(), 10,
+                                &parse_error);
+    if (!parse_error.empty() || threads <= 0) {
+      throw po::validation_error(po::validation_error::invalid_option_value);
+    }
+    dispatch_threads.push_back(threads);
+    pos = end + 1;
+  }
+  v = boost::any(dispatch_threads);
+}
+
 io_type_t get_io_type(string io_type_string) {
   if (io_type_string == "read")
     return IO_TYPE_READ;
@@ -186,7 +213,7 @@ void rbd_bencher_completion(void *vc, void *pc)
 
 int do_bench(librbd::Image& image, io_type_t io_type,
 		   uint64_t io_size, uint64_t io_threads,
-		   uint64_t io_bytes, bool random)
+		   uint64_t io_bytes, bool random, double *ops_per_sec = nullptr)
 {
   uint64_t size = 0;
   image.size(&size);
@@ -306,6 +333,55 @@ int do_bench(librbd::Image& image, io_type_t io_type,
   printf("elapsed: %5d  ops: %8d  ops/sec: %8.2lf  bytes/sec: %8.2lf\n",
          (int)elapsed, ios, (double)ios / elapsed, (double)off / elapsed);
 
+  if (ops_per_sec != nullptr) {
+    *ops_per_sec = (double)ios / elapsed;
+  }
+  return 0;
+}
+
+int do_bench_dispatch_threads(librados::Rados &rados, librados::IoCtx &io_ctx,
+                              const std::string &image_name,
+                              librbd::Image& image,
+                              io_type_t io_type, uint64_t io_size,
+                              uint64_t io_threads, uint64_t io_bytes,
+                              bool random,
+                              const std::vector<uint32_t> &dispatch_threads)
+{
+  std::vector<double> results;
+  for (auto threads : dispatch_threads) {
+    int r = rados.conf_set("rbd_io_threads", stringify(threads).c_str());
+    if (r < 0) {
+      std::cerr << "rbd: failed to set IO dispatch threads: "
+                << cpp_strerror(r) << std::endl;
+      return r;
+    }
+
+    // the dispatch pool is picked when the image is opened
+    r = image.close();
+    if (r == 0) {
+      r = utils::open_image(io_ctx, image_name, false, &image);
+    }
+    if (r < 0) {
+      std::cerr << "rbd: failed to reopen image: " << cpp_strerror(r)
+                << std::endl;
+      return r;
+    }
+
+    std::cout << "dispatch_threads " << threads << std::endl;
+    double ops_per_sec = 0;
+    r = do_bench(image, io_type, io_size, io_threads, io_bytes, random,
+                 &ops_per_sec);
+    if (r < 0) {
+      return r;
+    }
+    results.push_back(ops_per_sec);
+  }
+
+  printf("DISPATCH THREADS   OPS/SEC   SCALING\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    printf("%16u  %8.2lf  %8.2lf\n", dispatch_threads[i], results[i],
+           results[0] > 0 ? results[i] / results[0] : 0);
+  }
   return 0;
 }
 
@@ -317,7 +393,9 @@ void add_bench_common_options(po::options_description *positional,
     ("io-size", po::value<Size>(), "IO size (in B/K/M/G/T) [default: 4K]")
     ("io-threads", po::value<uint32_t>(), "ios in flight [default: 16]")
     ("io-total", po::value<Size>(), "total size for IO (in B/K/M/G/T) [default: 1G]")
-    ("io-pattern", po::value<IOPattern>(), "IO pattern (rand or seq) [default: seq]");
+    ("io-pattern", po::value<IOPattern>(), "IO pattern (rand or seq) [default: seq]")
+    ("dispatch-threads", po::value<DispatchThreads>(),
+     "comma-separated librbd IO dispatch thread counts to compare (e.g. 1,2,4)");
 }
 
 void get_arguments_for_write(po::options_description *positional,
@@ -394,8 +472,15 @@ int bench_execute(const po::variables_map &vm, io_type_t bench_io_type) {
     return r;
   }
 
-  r = do_bench(image, bench_io_type, bench_io_size, bench_io_threads,
-		     bench_bytes, bench_random);
+  if (vm.count("dispatch-threads")) {
+    r = do_bench_dispatch_threads(
+      rados, io_ctx, image_name, image, bench_io_type, bench_io_size,
+      bench_io_threads, bench_bytes, bench_random,
+      vm["dispatch-threads"].as<std::vector<uint32_t> >());
+  } else {
+    r = do_bench(image, bench_io_type, bench_io_size, bench_io_threads,
+		 bench_bytes, bench_random);
+  }
   if (r < 0) {
     std::cerr << "bench failed: " << cpp_strerror(r) << std::endl;
     return r;
@@ -10,6 +10,7 @@
 #include "common/Throttle.h"
 #include "include/encoding.h"
 #include <iostream>
+#include <iomanip>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <boost/program_options.hpp>
@@ -27,10 +28,34 @@ struct ExportDiffContext {
   utils::ProgressContext pc;
   OrderedThrottle throttle;
 
+  // statistics of the extents written to the diff
+  bool no_progress;
+  utime_t start;
+  uint64_t data_extents = 0;
+  uint64_t data_bytes = 0;
+  uint64_t zero_extents = 0;
+
   ExportDiffContext(librbd::Image *i, int f, uint64_t t, int max_ops,
                     bool no_progress, int eformat) :
     image(i), fd(f), export_format(eformat), totalsize(t), pc("Exporting image", no_progress),
-    throttle(max_ops, true) {
+    throttle(max_ops, true), no_progress(no_progress),
+    start(ceph_clock_now()) {
+  }
+
+  void print_summary() const {
+    if (no_progress) {
+      return;
+    }
+
+    double elapsed = (ceph_clock_now() - start);
+    std::cerr << "Exported " << data_extents << " data extents ("
+              << prettybyte_t(data_bytes) << ") and " << zero_extents
+              << " zero extents in " << std::fixed << std::setprecision(2)
+              << elapsed << " seconds";
+    if (elapsed > 0) {
+      std::cerr << " (" << prettybyte_t(static_cast<uint64_t>(data_bytes / elapsed)) << "/s)";
+    }
+    std::cerr << std::endl;
   }
 };
 
@@ -83,6 +108,12 @@ protected:
       if (r == 0 && m_exists) {
         r = m_read_data.write_fd(m_export_diff_context->fd);
       }
+      if (r == 0 && m_exists) {
+        ++m_export_diff_context->data_extents;
+        m_export_diff_context->data_bytes += m_length;
+      } else if (r == 0) {
+        ++m_export_diff_context->zero_extents;
+      }
     }
     m_export_diff_context->throttle.end_op(r);
   }
@@ -198,10 +229,12 @@ int do_export_diff_fd(librbd::Image& image, const char *fromsnapname,
   }
 
 out:
-  if (r < 0)
+  if (r < 0) {
     edc.pc.fail();
-  else
+  } else {
     edc.pc.finish();
+    edc.print_summary();
+  }
 
   return r;
 }
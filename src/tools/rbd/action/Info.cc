@@ -117,8 +117,17 @@ static int do_show_info(librados::IoCtx &io_ctx, librbd::Image& image,
       return r;
   }
 
-  if (features & RBD_FEATURE_JOURNALING) {
-    r = image.mirror_image_get_info(&mirror_image, sizeof(mirror_image));
+  // snapshot mirrored images do not require journaling
+  r = image.mirror_image_get_info(&mirror_image, sizeof(mirror_image));
+  if (r < 0 && (features & RBD_FEATURE_JOURNALING) != 0) {
+    return r;
+  } else if (r < 0) {
+    mirror_image.state = RBD_MIRROR_IMAGE_DISABLED;
+  }
+
+  librbd::mirror_image_mode_t mirror_mode = RBD_MIRROR_IMAGE_MODE_JOURNAL;
+  if (mirror_image.state != RBD_MIRROR_IMAGE_DISABLED) {
+    r = image.mirror_image_get_mode(&mirror_mode);
     if (r < 0) {
       return r;
     }
@@ -257,12 +266,16 @@ static int do_show_info(librados::IoCtx &io_ctx, librbd::Image& image,
     }
   }
 
-  if (features & RBD_FEATURE_JOURNALING) {
+  if ((features & RBD_FEATURE_JOURNALING) != 0 ||
+      mirror_image.state != RBD_MIRROR_IMAGE_DISABLED) {
+    std::string mirror_mode_desc =
+      (mirror_mode == RBD_MIRROR_IMAGE_MODE_SNAPSHOT ? "snapshot" : "journal");
     if (f) {
       f->open_object_section("mirroring");
       f->dump_string("state",
           utils::mirror_image_state(mirror_image.state));
       if (mirror_image.state != RBD_MIRROR_IMAGE_DISABLED) {
+        f->dump_string("mode", mirror_mode_desc);
         f->dump_string("global_id", mirror_image.global_id);
         f->dump_bool("primary", mirror_image.primary);
       }
@@ -271,7 +284,8 @@ static int do_show_info(librados::IoCtx &io_ctx, librbd::Image& image,
       std::cout << "\tmirroring state: "
                 << utils::mirror_image_state(mirror_image.state) << std::endl;
       if (mirror_image.state != RBD_MIRROR_IMAGE_DISABLED) {
-        std::cout << "\tmirroring global id: " << mirror_image.global_id
+        std::cout << "\tmirroring mode: " << mirror_mode_desc << std::endl
+                  << "\tmirroring global id: " << mirror_image.global_id
                   << std::endl
                   << "\tmirroring primary: "
                   << (mirror_image.primary ? "true" : "false") <<std::endl;
@@ -37,6 +37,13 @@ void get_arguments(po::options_description *positional,
   at::add_image_spec_options(positional, options, at::ARGUMENT_MODIFIER_NONE);
 }
 
+void get_arguments_enable(po::options_description *positional,
+                          po::options_description *options) {
+  at::add_image_spec_options(positional, options, at::ARGUMENT_MODIFIER_NONE);
+  positional->add_options()
+    ("mode", "mirror image mode [journal or snapshot]");
+}
+
 void get_arguments_disable(po::options_description *positional,
                            po::options_description *options) {
   options->add_options()
@@ -57,6 +64,18 @@ int execute_enable_disable(const po::variables_map &vm, bool enable,
     return r;
   }
 
+  librbd::mirror_image_mode_t mode = RBD_MIRROR_IMAGE_MODE_JOURNAL;
+  if (enable) {
+    std::string mode_str = utils::get_positional_argument(vm, arg_index);
+    if (mode_str == "snapshot") {
+      mode = RBD_MIRROR_IMAGE_MODE_SNAPSHOT;
+    } else if (!mode_str.empty() && mode_str != "journal") {
+      std::cerr << "rbd: must specify 'journal' or 'snapshot' mode."
+                << std::endl;
+      return -EINVAL;
+    }
+  }
+
   librados::Rados rados;
   librados::IoCtx io_ctx;
   librbd::Image image;
@@ -66,7 +85,8 @@ int execute_enable_disable(const po::variables_map &vm, bool enable,
     return r;
   }
 
-  r = enable ? image.mirror_image_enable() : image.mirror_image_disable(force);
+  r = enable ? image.mirror_image_enable2(mode) :
+               image.mirror_image_disable(force);
   if (r < 0) {
     return r;
   }
@@ -255,7 +275,7 @@ int execute_status(const po::variables_map &vm) {
 Shell::Action action_enable(
   {"mirror", "image", "enable"}, {},
   "Enable RBD mirroring for an image.", "",
-  &get_arguments, &execute_enable);
+  &get_arguments_enable, &execute_enable);
 Shell::Action action_disable(
   {"mirror", "image", "disable"}, {},
   "Disable RBD mirroring for an image.", "",
@@ -283,7 +283,8 @@ ImageReplayer<I>::ImageReplayer(Threads<librbd::ImageCtx> *threads,
 	 global_image_id),
   m_progress_cxt(this),
   m_journal_listener(new JournalListener(this)),
-  m_remote_listener(this)
+  m_remote_listener(this),
+  m_snapshot_replayer_listener(this)
 {
   // Register asok commands using a temporary "remote_pool_name/global_image_id"
   // name.  When the image name becomes known on start the asok commands will be
@@ -315,6 +316,7 @@ ImageReplayer<I>::~ImageReplayer()
   assert(m_on_start_finish == nullptr);
   assert(m_on_stop_finish == nullptr);
   assert(m_bootstrap_request == nullptr);
+  assert(m_snapshot_replayer == nullptr);
   assert(m_in_flight_status_updates == 0);
 
   delete m_journal_listener;
@@ -446,6 +448,56 @@ void ImageReplayer<I>::bootstrap() {
 
   // TODO bootstrap will need to support multiple remote images
   m_remote_image = *m_remote_images.begin();
+  get_remote_mirror_image();
+}
+
+template <typename I>
+void ImageReplayer<I>::get_remote_mirror_image() {
+  dout(20) << dendl;
+
+  librados::ObjectReadOperation op;
+  librbd::cls_client::mirror_image_get_start(&op, m_remote_image.image_id);
+
+  m_remote_mirror_image_bl.clear();
+  librados::AioCompletion *aio_comp = create_rados_callback<
+    ImageReplayer<I>, &ImageReplayer<I>::handle_get_remote_mirror_image>(this);
+  int r = m_remote_image.io_ctx.aio_operate(RBD_MIRRORING, aio_comp, &op,
+                                            &m_remote_mirror_image_bl);
+  assert(r == 0);
+  aio_comp->release();
+}
+
+template <typename I>
+void ImageReplayer<I>::handle_get_remote_mirror_image(int r) {
+  dout(20) << "r=" << r << dendl;
+
+  cls::rbd::MirrorImage mirror_image;
+  if (r == 0) {
+    bufferlist::iterator iter = m_remote_mirror_image_bl.begin();
+    r = librbd::cls_client::mirror_image_get_finish(&iter, &mirror_image);
+  }
+
+  if (r < 0 && r != -ENOENT) {
+    derr << "failed to retrieve remote mirror image: " << cpp_strerror(r)
+         << dendl;
+    on_start_fail(r, "error retrieving remote mirror image");
+    return;
+  } else if (on_start_interrupted()) {
+    return;
+  }
+
+  // bootstrapping the journal handles remote images that are not mirrored
+  if (r == 0 && mirror_image.mode == cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT) {
+    start_snapshot_replay();
+    return;
+  }
+
+  bootstrap_journal();
+}
+
+template <typename I>
+void ImageReplayer<I>::bootstrap_journal() {
+  dout(20) << dendl;
 
   CephContext *cct = static_cast<CephContext *>(m_local->cct());
   journal::Settings settings;
@@ -562,6 +614,82 @@ void ImageReplayer<I>::handle_bootstrap(int r) {
   init_remote_journaler();
 }
 
+template <typename I>
+void ImageReplayer<I>::start_snapshot_replay() {
+  dout(20) << dendl;
+
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_snapshot_replayer == nullptr);
+    m_snapshot_replayer = image_replayer::SnapshotReplayer<I>::create(
+      m_threads, m_local_ioctx, m_remote_image.io_ctx, m_global_image_id,
+      m_local_mirror_uuid, m_remote_image.mirror_uuid,
+      m_remote_image.image_id, m_local_image_id,
+      &m_snapshot_replayer_listener);
+  }
+
+  update_mirror_image_status(false, boost::none);
+  reschedule_update_status_task(10);
+
+  Context *ctx = create_context_callback<
+    ImageReplayer, &ImageReplayer<I>::handle_start_snapshot_replay>(this);
+  m_snapshot_replayer->init(ctx);
+}
+
+template <typename I>
+void ImageReplayer<I>::handle_start_snapshot_replay(int r) {
+  dout(20) << "r=" << r << dendl;
+
+  if (r == -EREMOTEIO) {
+    m_local_image_tag_owner = "";
+    dout(5) << "remote image is non-primary or local image is primary" << dendl;
+    on_start_fail(0, "remote image is non-primary or local image is primary");
+    return;
+  } else if (r < 0) {
+    on_start_fail(r, "error starting snapshot replay");
+    return;
+  } else if (on_start_interrupted()) {
+    return;
+  }
+
+  Context *on_finish(nullptr);
+  {
+    Mutex::Locker locker(m_lock);
+    m_local_image_id = m_snapshot_replayer->get_local_image_id();
+
+    std::string name = m_local_ioctx.get_pool_name() + "/" +
+                       m_snapshot_replayer->get_local_image_name();
+    if (m_name != name) {
+      m_name = name;
+      if (m_asok_hook) {
+	// Re-register asok commands using the new name.
+	delete m_asok_hook;
+	m_asok_hook = nullptr;
+      }
+    }
+    if (!m_asok_hook) {
+      dout(20) << "registered asok hook: " << m_name << dendl;
+      m_asok_hook = new ImageReplayerAdminSocketHook<I>(g_ceph_context, m_name,
+                                                        this);
+    }
+
+    assert(m_state == STATE_STARTING);
+    m_state = STATE_REPLAYING;
+    std::swap(m_on_start_finish, on_finish);
+  }
+
+  update_mirror_image_status(true, boost::none);
+  reschedule_update_status_task(30);
+
+  dout(20) << "start succeeded" << dendl;
+  if (on_finish != nullptr) {
+    dout(20) << "on finish complete, r=" << r << dendl;
+    on_finish->complete(r);
+  }
+
+  on_replay_interrupted();
+}
+
 template <typename I>
 void ImageReplayer<I>::init_remote_journaler() {
   dout(20) << dendl;
@@ -838,7 +966,7 @@ void ImageReplayer<I>::flush(Context *on_finish)
 
   {
     Mutex::Locker locker(m_lock);
-    if (m_state == STATE_REPLAYING) {
+    if (m_state == STATE_REPLAYING && m_snapshot_replayer == nullptr) {
       Context *ctx = new FunctionContext(
         [on_finish](int r) {
           if (on_finish != nullptr) {
@@ -1283,13 +1411,20 @@ void ImageReplayer<I>::send_mirror_status_update(const OptionalState &opt_state)
   int last_r;
   bool bootstrapping;
   bool stopping_replay;
+  std::string snapshot_replay_desc;
+  bool snapshot_replay = false;
   {
     Mutex::Locker locker(m_lock);
     state = m_state;
     state_desc = m_state_desc;
     last_r = m_last_r;
     bootstrapping = (m_bootstrap_request != nullptr);
-    stopping_replay = (m_local_image_ctx != nullptr);
+    stopping_replay = (m_local_image_ctx != nullptr ||
+                       m_snapshot_replayer != nullptr);
+    if (m_snapshot_replayer != nullptr) {
+      snapshot_replay = true;
+      snapshot_replay_desc = m_snapshot_replayer->get_status_description();
+    }
   }
 
   if (opt_state) {
@@ -1303,6 +1438,9 @@ void ImageReplayer<I>::send_mirror_status_update(const OptionalState &opt_state)
     if (bootstrapping) {
       status.state = cls::rbd::MIRROR_IMAGE_STATUS_STATE_SYNCING;
       status.description = state_desc.empty() ? "syncing" : state_desc;
+    } else if (snapshot_replay) {
+      status.state = cls::rbd::MIRROR_IMAGE_STATUS_STATE_SYNCING;
+      status.description = snapshot_replay_desc;
     } else {
       status.state = cls::rbd::MIRROR_IMAGE_STATUS_STATE_STARTING_REPLAY;
       status.description = "starting replay";
@@ -1311,7 +1449,9 @@ void ImageReplayer<I>::send_mirror_status_update(const OptionalState &opt_state)
   case STATE_REPLAYING:
   case STATE_REPLAY_FLUSHING:
     status.state = cls::rbd::MIRROR_IMAGE_STATUS_STATE_REPLAYING;
-    {
+    if (snapshot_replay) {
+      status.description = "replaying, " + snapshot_replay_desc;
+    } else {
       Context *on_req_finish = new FunctionContext(
         [this](int r) {
           dout(20) << "replay status ready: r=" << r << dendl;
@@ -1465,6 +1605,21 @@ void ImageReplayer<I>::shut_down(int r) {
       request->send();
     });
   }
+  if (m_snapshot_replayer != nullptr) {
+    ctx = new FunctionContext([this, ctx](int r) {
+        image_replayer::SnapshotReplayer<I> *snapshot_replayer;
+        {
+          Mutex::Locker locker(m_lock);
+          snapshot_replayer = m_snapshot_replayer;
+          m_snapshot_replayer = nullptr;
+        }
+        image_replayer::SnapshotReplayer<I>::destroy(snapshot_replayer);
+        ctx->complete(0);
+      });
+    ctx = new FunctionContext([this, ctx](int r) {
+        m_snapshot_replayer->shut_down(ctx);
+      });
+  }
   if (m_remote_journaler != nullptr) {
     ctx = new FunctionContext([this, ctx](int r) {
         delete m_remote_journaler;
@@ -18,6 +18,7 @@
 #include "ImageDeleter.h"
 #include "ProgressContext.h"
 #include "types.h"
+#include "tools/rbd_mirror/image_replayer/SnapshotReplayer.h"
 
 #include <boost/noncopyable.hpp>
 #include <boost/optional.hpp>
@@ -147,6 +148,14 @@ protected:
    * PREPARE_LOCAL_IMAGE  * * * * * * * * * * * * * * * * * *
    *    |                                                   *
    *    v                                           (error) *
+   * GET_REMOTE_MIRROR_IMAGE  * * * * * * * * * * * * * * * *
+   *    |                                                   *
+   *    | (snapshot mode)                           (error) *
+   *    |\-----> START_SNAPSHOT_REPLAY  * * * * * * * * * * *
+   *    |           |                                       *
+   *    |           v                                       *
+   *    |       <replaying>                                 *
+   *    v (journal mode)                            (error) *
    * BOOTSTRAP_IMAGE  * * * * * * * * * * * * * * * * * * * *
    *    |                                                   *
    *    v                                           (error) *
@@ -330,6 +339,8 @@ private:
   bool m_update_status_requested = false;
   Context *m_on_update_status_finish = nullptr;
 
+  bufferlist m_remote_mirror_image_bl;
+
   librbd::journal::MirrorPeerClientMeta m_client_meta;
 
   ReplayEntry m_replay_entry;
@@ -349,6 +360,20 @@ private:
     void handle_update(::journal::JournalMetadata *) override;
   } m_remote_listener;
 
+  struct SnapshotReplayerListener
+    : public image_replayer::SnapshotReplayer<ImageCtxT>::Listener {
+    ImageReplayer *replayer;
+
+    SnapshotReplayerListener(ImageReplayer *replayer) : replayer(replayer) {
+    }
+
+    void handle_replay_complete(int r, const std::string &desc) override {
+      replayer->stop(nullptr, false, r, desc);
+    }
+  } m_snapshot_replayer_listener;
+
+  image_replayer::SnapshotReplayer<ImageCtxT> *m_snapshot_replayer = nullptr;
+
   struct C_ReplayCommitted : public Context {
     ImageReplayer *replayer;
     ReplayEntry replay_entry;
@@ -394,8 +419,16 @@ private:
   void handle_prepare_local_image(int r);
 
   void bootstrap();
+
+  void get_remote_mirror_image();
+  void handle_get_remote_mirror_image(int r);
+
+  void bootstrap_journal();
   void handle_bootstrap(int r);
 
+  void start_snapshot_replay();
+  void handle_start_snapshot_replay(int r);
+
   void init_remote_journaler();
   void handle_init_remote_journaler(int r);
 
@@ -8,6 +8,7 @@
 #include "librbd/ImageCtx.h"
 #include "librbd/Journal.h"
 #include "librbd/Utils.h"
+#include "librbd/mirror/SnapshotUtils.h"
 #include <type_traits>
 
 #define dout_context g_ceph_context
@@ -58,7 +59,12 @@ void IsPrimaryRequest<I>::handle_get_mirror_state(int r) {
     bufferlist::iterator iter = m_out_bl.begin();
     r = librbd::cls_client::mirror_image_get_finish(&iter, &mirror_image);
     if (r == 0) {
-      if (mirror_image.state == cls::rbd::MIRROR_IMAGE_STATE_ENABLED) {
+      if (mirror_image.state == cls::rbd::MIRROR_IMAGE_STATE_ENABLED &&
+          mirror_image.mode == cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT) {
+        RWLock::RLocker snap_locker(m_image_ctx->snap_lock);
+        *m_primary = (librbd::mirror::snapshot::get_promotion_state(
+                        m_image_ctx) == librbd::mirror::PROMOTION_STATE_PRIMARY);
+      } else if (mirror_image.state == cls::rbd::MIRROR_IMAGE_STATE_ENABLED) {
         send_is_tag_owner();
         return;
       } else if (mirror_image.state == cls::rbd::MIRROR_IMAGE_STATE_DISABLING) {
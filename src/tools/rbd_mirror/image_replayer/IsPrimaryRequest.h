@@ -37,7 +37,7 @@ private:
    *    |                     *
    *    v                     *
    * IS_TAG_OWNER * * * * * * * (error)
-   *    |                     *
+   *    | (journal mode only) *
    *    v                     *
    * <finish> < * * * * * * * *
    *
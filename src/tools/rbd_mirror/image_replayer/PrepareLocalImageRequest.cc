@@ -111,6 +111,14 @@ void PrepareLocalImageRequest<I>::handle_get_mirror_state(int r) {
   // delete a partially formed image
   // (e.g. MIRROR_IMAGE_STATE_CREATING/DELETING)
 
+  if (mirror_image.mode == cls::rbd::MIRROR_IMAGE_MODE_SNAPSHOT) {
+    // snapshot mode images do not have a journal -- the local image will
+    // be verified to be non-primary when it is opened
+    m_tag_owner->clear();
+    finish(0);
+    return;
+  }
+
   get_tag_owner();
 }
 
@@ -55,6 +55,9 @@ private:
    *    v
    * GET_MIRROR_STATE
    *    |
+   *    v (skip if snapshot mode)
+   * GET_TAG_OWNER
+   *    |
    *    v
    * <finish>
 
@@ -0,0 +1,221 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "SnapshotObjectCopyRequest.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "librados/snap_set_diff.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/Utils.h"
+#include "librbd/io/AioCompletion.h"
+#include "librbd/io/ImageRequestWQ.h"
+#include "osdc/Striper.h"
+
+#define dout_context g_ceph_context
+#define dout_subsys ceph_subsys_rbd_mirror
+#undef dout_prefix
+#define dout_prefix *_dout << "rbd::mirror::image_replayer::SnapshotObjectCopyRequest: " \
+                           << this << " " << __func__
+
+namespace rbd {
+namespace mirror {
+namespace image_replayer {
+
+using librbd::util::create_context_callback;
+using librbd::util::create_rados_callback;
+
+template <typename I>
+SnapshotObjectCopyRequest<I>::SnapshotObjectCopyRequest(
+    I *local_image_ctx, I *remote_image_ctx, librados::snap_t from_snap_id,
+    librados::snap_t to_snap_id, uint64_t object_number, Context *on_finish)
+  : m_local_image_ctx(local_image_ctx), m_remote_image_ctx(remote_image_ctx),
+    m_from_snap_id(from_snap_id), m_to_snap_id(to_snap_id),
+    m_object_number(object_number), m_on_finish(on_finish) {
+  m_remote_io_ctx.dup(m_remote_image_ctx->data_ctx);
+  m_remote_oid = m_remote_image_ctx->get_object_name(object_number);
+
+  dout(20) << ": remote_oid=" << m_remote_oid << ", "
+           << "from_snap_id=" << m_from_snap_id << ", "
+           << "to_snap_id=" << m_to_snap_id << dendl;
+}
+
+template <typename I>
+void SnapshotObjectCopyRequest<I>::send() {
+  send_list_snaps();
+}
+
+template <typename I>
+void SnapshotObjectCopyRequest<I>::send_list_snaps() {
+  dout(20) << dendl;
+
+  librados::ObjectReadOperation op;
+  op.list_snaps(&m_snap_set, &m_snap_ret);
+
+  // snapshots must be listed via the head revision
+  m_remote_io_ctx.snap_set_read(CEPH_SNAPDIR);
+
+  librados::AioCompletion *comp = create_rados_callback<
+    SnapshotObjectCopyRequest<I>,
+    &SnapshotObjectCopyRequest<I>::handle_list_snaps>(this);
+  int r = m_remote_io_ctx.aio_operate(m_remote_oid, comp, &op, nullptr);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void SnapshotObjectCopyRequest<I>::handle_list_snaps(int r) {
+  if (r == 0 && m_snap_ret < 0) {
+    r = m_snap_ret;
+  }
+
+  dout(20) << ": r=" << r << dendl;
+
+  if (r == -ENOENT) {
+    // the object never existed within the remote image
+    finish(0);
+    return;
+  } else if (r < 0) {
+    derr << ": failed to list snaps: " << cpp_strerror(r) << dendl;
+    finish(r);
+    return;
+  }
+
+  interval_set<uint64_t> diff;
+  uint64_t end_size;
+  bool end_exists;
+  librados::snap_t clone_end_snap_id;
+  calc_snap_set_diff(m_remote_image_ctx->cct, m_snap_set, m_from_snap_id,
+                     m_to_snap_id, &diff, &end_size, &end_exists,
+                     &clone_end_snap_id);
+
+  // changes past the end of the object are holes
+  if (end_exists && end_size > 0) {
+    interval_set<uint64_t> object_extent;
+    object_extent.insert(0, end_size);
+    m_read_extents.intersection_of(diff, object_extent);
+  }
+  m_zero_extents = diff;
+  m_zero_extents.subtract(m_read_extents);
+
+  dout(20) << ": read_extents=" << m_read_extents << ", "
+           << "zero_extents=" << m_zero_extents << dendl;
+
+  send_read_object();
+}
+
+template <typename I>
+void SnapshotObjectCopyRequest<I>::send_read_object() {
+  if (m_read_extents.empty()) {
+    send_write_image();
+    return;
+  }
+
+  dout(20) << dendl;
+
+  librados::ObjectReadOperation op;
+  for (auto it = m_read_extents.begin(); it != m_read_extents.end(); ++it) {
+    op.read(it.get_start(), it.get_len(), &m_read_bls[it.get_start()],
+            nullptr);
+  }
+
+  m_remote_io_ctx.snap_set_read(m_to_snap_id);
+
+  librados::AioCompletion *comp = create_rados_callback<
+    SnapshotObjectCopyRequest<I>,
+    &SnapshotObjectCopyRequest<I>::handle_read_object>(this);
+  int r = m_remote_io_ctx.aio_operate(m_remote_oid, comp, &op, nullptr);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void SnapshotObjectCopyRequest<I>::handle_read_object(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0) {
+    derr << ": failed to read remote object: " << cpp_strerror(r) << dendl;
+    finish(r);
+    return;
+  }
+
+  send_write_image();
+}
+
+template <typename I>
+void SnapshotObjectCopyRequest<I>::send_write_image() {
+  if (m_read_extents.empty() && m_zero_extents.empty()) {
+    finish(0);
+    return;
+  }
+
+  dout(20) << dendl;
+
+  // the local image shares the striping of the remote image
+  CephContext *cct = m_local_image_ctx->cct;
+  Context *ctx = create_context_callback<
+    SnapshotObjectCopyRequest<I>,
+    &SnapshotObjectCopyRequest<I>::handle_write_image>(this);
+  C_Gather *gather_ctx = new C_Gather(cct, ctx);
+
+  for (auto it = m_read_extents.begin(); it != m_read_extents.end(); ++it) {
+    bufferlist &bl = m_read_bls[it.get_start()];
+    if (bl.length() < it.get_len()) {
+      bl.append_zero(it.get_len() - bl.length());
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t> > image_extents;
+    Striper::extent_to_file(cct, &m_remote_image_ctx->layout, m_object_number,
+                            it.get_start(), it.get_len(), image_extents);
+
+    uint64_t buffer_offset = 0;
+    for (auto &image_extent : image_extents) {
+      bufferlist sub_bl;
+      sub_bl.substr_of(bl, buffer_offset, image_extent.second);
+      buffer_offset += image_extent.second;
+
+      auto comp = librbd::io::AioCompletion::create(gather_ctx->new_sub());
+      m_local_image_ctx->io_work_queue->aio_write(
+        comp, image_extent.first, image_extent.second, std::move(sub_bl),
+        LIBRADOS_OP_FLAG_FADVISE_DONTNEED);
+    }
+  }
+
+  for (auto it = m_zero_extents.begin(); it != m_zero_extents.end(); ++it) {
+    std::vector<std::pair<uint64_t, uint64_t> > image_extents;
+    Striper::extent_to_file(cct, &m_remote_image_ctx->layout, m_object_number,
+                            it.get_start(), it.get_len(), image_extents);
+
+    for (auto &image_extent : image_extents) {
+      auto comp = librbd::io::AioCompletion::create(gather_ctx->new_sub());
+      m_local_image_ctx->io_work_queue->aio_discard(
+        comp, image_extent.first, image_extent.second, false);
+    }
+  }
+
+  gather_ctx->activate();
+}
+
+template <typename I>
+void SnapshotObjectCopyRequest<I>::handle_write_image(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0) {
+    derr << ": failed to write local image: " << cpp_strerror(r) << dendl;
+  }
+
+  finish(r);
+}
+
+template <typename I>
+void SnapshotObjectCopyRequest<I>::finish(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  m_on_finish->complete(r);
+  delete this;
+}
+
+} // namespace image_replayer
+} // namespace mirror
+} // namespace rbd
+
+template class rbd::mirror::image_replayer::SnapshotObjectCopyRequest<librbd::ImageCtx>;
@@ -0,0 +1,108 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef RBD_MIRROR_IMAGE_REPLAYER_SNAPSHOT_OBJECT_COPY_REQUEST_H
+#define RBD_MIRROR_IMAGE_REPLAYER_SNAPSHOT_OBJECT_COPY_REQUEST_H
+
+#include "include/int_types.h"
+#include "include/interval_set.h"
+#include "include/rados/librados.hpp"
+#include <map>
+#include <string>
+
+class Context;
+namespace librbd { struct ImageCtx; }
+
+namespace rbd {
+namespace mirror {
+namespace image_replayer {
+
+/**
+ * Copies the extents of a remote object that changed between two remote
+ * snapshots into the matching image extents of the local image.
+ */
+template <typename ImageCtxT = librbd::ImageCtx>
+class SnapshotObjectCopyRequest {
+public:
+  static SnapshotObjectCopyRequest* create(ImageCtxT *local_image_ctx,
+                                           ImageCtxT *remote_image_ctx,
+                                           librados::snap_t from_snap_id,
+                                           librados::snap_t to_snap_id,
+                                           uint64_t object_number,
+                                           Context *on_finish) {
+    return new SnapshotObjectCopyRequest(local_image_ctx, remote_image_ctx,
+                                         from_snap_id, to_snap_id,
+                                         object_number, on_finish);
+  }
+
+  SnapshotObjectCopyRequest(ImageCtxT *local_image_ctx,
+                            ImageCtxT *remote_image_ctx,
+                            librados::snap_t from_snap_id,
+                            librados::snap_t to_snap_id,
+                            uint64_t object_number, Context *on_finish);
+
+  void send();
+
+  // testing support
+  inline librados::IoCtx &get_remote_io_ctx() {
+    return m_remote_io_ctx;
+  }
+
+private:
+  /**
+   * @verbatim
+   *
+   * <start>
+   *    |
+   *    v
+   * LIST_SNAPS
+   *    |
+   *    v
+   * READ_OBJECT (skip if no data to copy)
+   *    |
+   *    v
+   * WRITE_IMAGE (skip if unchanged)
+   *    |
+   *    v
+   * <finish>
+   *
+   * @endverbatim
+   */
+
+  ImageCtxT *m_local_image_ctx;
+  ImageCtxT *m_remote_image_ctx;
+  librados::snap_t m_from_snap_id;
+  librados::snap_t m_to_snap_id;
+  uint64_t m_object_number;
+  Context *m_on_finish;
+
+  librados::IoCtx m_remote_io_ctx;
+  std::string m_remote_oid;
+
+  librados::snap_set_t m_snap_set;
+  int m_snap_ret = 0;
+
+  interval_set<uint64_t> m_read_extents;
+  interval_set<uint64_t> m_zero_extents;
+  std::map<uint64_t, bufferlist> m_read_bls;
+
+  void send_list_snaps();
+  void handle_list_snaps(int r);
+
+  void send_read_object();
+  void handle_read_object(int r);
+
+  void send_write_image();
+  void handle_write_image(int r);
+
+  void finish(int r);
+
+};
+
+} // namespace image_replayer
+} // namespace mirror
+} // namespace rbd
+
+extern template class rbd::mirror::image_replayer::SnapshotObjectCopyRequest<librbd::ImageCtx>;
+
+#endif // RBD_MIRROR_IMAGE_REPLAYER_SNAPSHOT_OBJECT_COPY_REQUEST_H
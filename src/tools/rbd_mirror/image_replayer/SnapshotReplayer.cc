@@ -0,0 +1,431 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "tools/rbd_mirror/image_replayer/SnapshotReplayer.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "common/Timer.h"
+#include "common/WorkQueue.h"
+#include "global/global_context.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/Utils.h"
+#include "librbd/mirror/SnapshotUtils.h"
+#include "tools/rbd_mirror/Threads.h"
+#include "tools/rbd_mirror/image_replayer/CloseImageRequest.h"
+#include "tools/rbd_mirror/image_replayer/CreateImageRequest.h"
+#include "tools/rbd_mirror/image_replayer/OpenImageRequest.h"
+#include "tools/rbd_mirror/image_replayer/OpenLocalImageRequest.h"
+#include "tools/rbd_mirror/image_replayer/SnapshotSyncRequest.h"
+
+#define dout_context g_ceph_context
+#define dout_subsys ceph_subsys_rbd_mirror
+#undef dout_prefix
+#define dout_prefix *_dout << "rbd::mirror::image_replayer::" \
+                           << "SnapshotReplayer: " << this << " " \
+                           << __func__ << ": "
+
+namespace rbd {
+namespace mirror {
+namespace image_replayer {
+
+using librbd::mirror::snapshot::get_promotion_state;
+using librbd::util::create_context_callback;
+
+template <typename I>
+SnapshotReplayer<I>::SnapshotReplayer(Threads<librbd::ImageCtx> *threads,
+                                      librados::IoCtx &local_io_ctx,
+                                      librados::IoCtx &remote_io_ctx,
+                                      const std::string &global_image_id,
+                                      const std::string &local_mirror_uuid,
+                                      const std::string &remote_mirror_uuid,
+                                      const std::string &remote_image_id,
+                                      const std::string &local_image_id,
+                                      Listener *listener)
+  : m_threads(threads), m_local_io_ctx(local_io_ctx),
+    m_remote_io_ctx(remote_io_ctx), m_global_image_id(global_image_id),
+    m_local_mirror_uuid(local_mirror_uuid),
+    m_remote_mirror_uuid(remote_mirror_uuid),
+    m_remote_image_id(remote_image_id), m_local_image_id(local_image_id),
+    m_listener(listener),
+    m_lock("rbd::mirror::image_replayer::SnapshotReplayer " +
+           global_image_id) {
+}
+
+template <typename I>
+SnapshotReplayer<I>::~SnapshotReplayer() {
+  assert(m_sync_request == nullptr);
+  assert(m_sync_timer_ctx == nullptr);
+  assert(m_remote_image_ctx == nullptr);
+  assert(m_local_image_ctx == nullptr);
+}
+
+template <typename I>
+void SnapshotReplayer<I>::init(Context *on_finish) {
+  dout(20) << dendl;
+
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_on_init_finish == nullptr);
+    m_on_init_finish = on_finish;
+    m_status = "opening images";
+  }
+  open_remote_image();
+}
+
+template <typename I>
+void SnapshotReplayer<I>::shut_down(Context *on_finish) {
+  dout(20) << dendl;
+
+  {
+    Mutex::Locker timer_locker(m_threads->timer_lock);
+    Mutex::Locker locker(m_lock);
+    assert(m_on_shut_down_finish == nullptr);
+    m_stopping = true;
+    m_on_shut_down_finish = on_finish;
+
+    if (m_sync_timer_ctx != nullptr) {
+      m_threads->timer->cancel_event(m_sync_timer_ctx);
+      m_sync_timer_ctx = nullptr;
+      m_sync_queued = false;
+    }
+
+    // an in-flight sync will close the images once it completes
+    if (m_sync_request != nullptr) {
+      m_sync_request->cancel();
+      return;
+    } else if (m_sync_queued) {
+      return;
+    }
+  }
+
+  close_local_image();
+}
+
+template <typename I>
+std::string SnapshotReplayer<I>::get_local_image_id() const {
+  Mutex::Locker locker(m_lock);
+  return m_local_image_id;
+}
+
+template <typename I>
+std::string SnapshotReplayer<I>::get_local_image_name() const {
+  Mutex::Locker locker(m_lock);
+  return m_local_image_name;
+}
+
+template <typename I>
+std::string SnapshotReplayer<I>::get_status_description() const {
+  Mutex::Locker locker(m_lock);
+  return m_status;
+}
+
+template <typename I>
+void SnapshotReplayer<I>::open_remote_image() {
+  dout(20) << dendl;
+
+  Context *ctx = create_context_callback<
+    SnapshotReplayer<I>, &SnapshotReplayer<I>::handle_open_remote_image>(this);
+  auto req = OpenImageRequest<I>::create(
+    m_remote_io_ctx, &m_remote_image_ctx, m_remote_image_id, false, ctx);
+  req->send();
+}
+
+template <typename I>
+void SnapshotReplayer<I>::handle_open_remote_image(int r) {
+  dout(20) << "r=" << r << dendl;
+
+  if (r < 0) {
+    derr << "failed to open remote image " << m_remote_image_id << ": "
+         << cpp_strerror(r) << dendl;
+    finish_init(r);
+    return;
+  }
+
+  {
+    RWLock::RLocker snap_locker(m_remote_image_ctx->snap_lock);
+    if (get_promotion_state(m_remote_image_ctx) ==
+          librbd::mirror::PROMOTION_STATE_NON_PRIMARY) {
+      dout(10) << "remote image is non-primary" << dendl;
+      finish_init(-EREMOTEIO);
+      return;
+    }
+  }
+
+  {
+    Mutex::Locker locker(m_lock);
+    m_local_image_name = m_remote_image_ctx->name;
+  }
+
+  create_local_image();
+}
+
+template <typename I>
+void SnapshotReplayer<I>::create_local_image() {
+  if (!get_local_image_id().empty()) {
+    open_local_image();
+    return;
+  }
+
+  dout(20) << dendl;
+  set_status("creating local image");
+
+  Context *ctx = create_context_callback<
+    SnapshotReplayer<I>, &SnapshotReplayer<I>::handle_create_local_image>(this);
+  auto req = CreateImageRequest<I>::create(
+    m_local_io_ctx, m_threads->work_queue, m_global_image_id,
+    m_remote_mirror_uuid, m_remote_image_ctx->name, m_remote_image_ctx,
+    &m_created_image_id, ctx);
+  req->send();
+}
+
+template <typename I>
+void SnapshotReplayer<I>::handle_create_local_image(int r) {
+  dout(20) << "r=" << r << dendl;
+
+  if (r < 0) {
+    derr << "failed to create local image: " << cpp_strerror(r) << dendl;
+    finish_init(r);
+    return;
+  }
+
+  {
+    Mutex::Locker locker(m_lock);
+    m_local_image_id = m_created_image_id;
+  }
+
+  open_local_image();
+}
+
+template <typename I>
+void SnapshotReplayer<I>::open_local_image() {
+  dout(20) << dendl;
+
+  // the local image is opened with the exclusive lock held so that
+  // no clients can modify the image while it is being synced
+  Context *ctx = create_context_callback<
+    SnapshotReplayer<I>, &SnapshotReplayer<I>::handle_open_local_image>(this);
+  auto req = OpenLocalImageRequest<I>::create(
+    m_local_io_ctx, &m_local_image_ctx, get_local_image_id(),
+    m_threads->work_queue, ctx);
+  req->send();
+}
+
+template <typename I>
+void SnapshotReplayer<I>::handle_open_local_image(int r) {
+  dout(20) << "r=" << r << dendl;
+
+  if (r == -EREMOTEIO) {
+    dout(10) << "local image is primary" << dendl;
+    finish_init(r);
+    return;
+  } else if (r < 0) {
+    derr << "failed to open local image " << get_local_image_id() << ": "
+         << cpp_strerror(r) << dendl;
+    finish_init(r);
+    return;
+  }
+
+  finish_init(0);
+}
+
+template <typename I>
+void SnapshotReplayer<I>::finish_init(int r) {
+  dout(20) << "r=" << r << dendl;
+
+  Context *on_init_finish = nullptr;
+  {
+    Mutex::Locker locker(m_lock);
+    std::swap(on_init_finish, m_on_init_finish);
+    if (r == 0) {
+      // shut down will wait for the first sync to start
+      m_status = "idle";
+      m_sync_queued = true;
+    }
+  }
+  m_threads->work_queue->queue(on_init_finish, r);
+
+  if (r == 0) {
+    sync();
+  }
+}
+
+template <typename I>
+void SnapshotReplayer<I>::sync() {
+  SnapshotSyncRequest<I> *req = nullptr;
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_sync_queued);
+    assert(m_sync_request == nullptr);
+    m_sync_queued = false;
+    if (!m_stopping) {
+      dout(20) << dendl;
+
+      m_status = "syncing";
+      Context *ctx = create_context_callback<
+        SnapshotReplayer<I>, &SnapshotReplayer<I>::handle_sync>(this);
+      m_sync_request = req = SnapshotSyncRequest<I>::create(
+        m_local_image_ctx, m_remote_image_ctx, m_local_mirror_uuid,
+        &m_sync_snap_uuid, &m_demoted, ctx);
+    }
+  }
+
+  if (req == nullptr) {
+    close_local_image();
+    return;
+  }
+  req->send();
+}
+
+template <typename I>
+void SnapshotReplayer<I>::handle_sync(int r) {
+  dout(20) << "r=" << r << dendl;
+
+  bool stopping;
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_sync_request != nullptr);
+    m_sync_request = nullptr;
+
+    stopping = m_stopping;
+    if (stopping) {
+      // shut down is waiting for the sync to complete
+    } else if (r == 0 && !m_demoted) {
+      m_status = "last synced snapshot " + m_sync_snap_uuid;
+      m_sync_queued = true;
+    } else {
+      std::string desc;
+      if (r == -EREMOTEIO) {
+        r = 0;
+        desc = "remote image is non-primary";
+      } else if (r < 0) {
+        derr << "failed to sync image: " << cpp_strerror(r) << dendl;
+        desc = "failed to sync image: " + cpp_strerror(r);
+        m_status = "idle";
+      } else {
+        desc = "remote image demoted";
+      }
+
+      // the listener will shut down the replayer
+      Listener *listener = m_listener;
+      m_threads->work_queue->queue(new FunctionContext(
+        [listener, r, desc](int _r) {
+          listener->handle_replay_complete(r, desc);
+        }), 0);
+      return;
+    }
+  }
+
+  if (stopping) {
+    close_local_image();
+    return;
+  }
+  schedule_sync();
+}
+
+template <typename I>
+void SnapshotReplayer<I>::schedule_sync() {
+  CephContext *cct = reinterpret_cast<CephContext *>(m_local_io_ctx.cct());
+
+  Mutex::Locker timer_locker(m_threads->timer_lock);
+  Mutex::Locker locker(m_lock);
+  assert(m_sync_queued);
+  if (m_stopping) {
+    // shut down is waiting for the queued sync to close the images
+    m_threads->work_queue->queue(new FunctionContext([this](int r) {
+        sync();
+      }), 0);
+    return;
+  }
+
+  dout(20) << dendl;
+
+  assert(m_sync_timer_ctx == nullptr);
+  m_sync_timer_ctx = new FunctionContext([this](int r) {
+      handle_sync_timer();
+    });
+  m_threads->timer->add_event_after(cct->_conf->rbd_mirror_snapshot_interval,
+                                    m_sync_timer_ctx);
+}
+
+template <typename I>
+void SnapshotReplayer<I>::handle_sync_timer() {
+  dout(20) << dendl;
+
+  assert(m_threads->timer_lock.is_locked());
+  Mutex::Locker locker(m_lock);
+  m_sync_timer_ctx = nullptr;
+
+  // the sync must not be started under the timer lock
+  m_threads->work_queue->queue(new FunctionContext([this](int r) {
+      sync();
+    }), 0);
+}
+
+template <typename I>
+void SnapshotReplayer<I>::close_local_image() {
+  if (m_local_image_ctx == nullptr) {
+    close_remote_image();
+    return;
+  }
+
+  dout(20) << dendl;
+
+  Context *ctx = create_context_callback<
+    SnapshotReplayer<I>, &SnapshotReplayer<I>::handle_close_local_image>(this);
+  auto req = CloseImageRequest<I>::create(&m_local_image_ctx, ctx);
+  req->send();
+}
+
+template <typename I>
+void SnapshotReplayer<I>::handle_close_local_image(int r) {
+  dout(20) << "r=" << r << dendl;
+
+  if (r < 0) {
+    derr << "failed to close local image: " << cpp_strerror(r) << dendl;
+  }
+
+  close_remote_image();
+}
+
+template <typename I>
+void SnapshotReplayer<I>::close_remote_image() {
+  if (m_remote_image_ctx == nullptr) {
+    handle_close_remote_image(0);
+    return;
+  }
+
+  dout(20) << dendl;
+
+  Context *ctx = create_context_callback<
+    SnapshotReplayer<I>, &SnapshotReplayer<I>::handle_close_remote_image>(this);
+  auto req = CloseImageRequest<I>::create(&m_remote_image_ctx, ctx);
+  req->send();
+}
+
+template <typename I>
+void SnapshotReplayer<I>::handle_close_remote_image(int r) {
+  dout(20) << "r=" << r << dendl;
+
+  if (r < 0) {
+    derr << "failed to close remote image: " << cpp_strerror(r) << dendl;
+  }
+
+  Context *on_finish = nullptr;
+  {
+    Mutex::Locker locker(m_lock);
+    std::swap(on_finish, m_on_shut_down_finish);
+  }
+  m_threads->work_queue->queue(on_finish, 0);
+}
+
+template <typename I>
+void SnapshotReplayer<I>::set_status(const std::string &status) {
+  Mutex::Locker locker(m_lock);
+  m_status = status;
+}
+
+} // namespace image_replayer
+} // namespace mirror
+} // namespace rbd
+
+template class rbd::mirror::image_replayer::SnapshotReplayer<librbd::ImageCtx>;
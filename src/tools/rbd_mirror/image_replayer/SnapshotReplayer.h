@@ -0,0 +1,177 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef RBD_MIRROR_IMAGE_REPLAYER_SNAPSHOT_REPLAYER_H
+#define RBD_MIRROR_IMAGE_REPLAYER_SNAPSHOT_REPLAYER_H
+
+#include "include/int_types.h"
+#include "include/rados/librados.hpp"
+#include "common/Mutex.h"
+#include <string>
+
+class Context;
+namespace librbd { class ImageCtx; }
+
+namespace rbd {
+namespace mirror {
+
+template <typename> struct Threads;
+
+namespace image_replayer {
+
+template <typename> class SnapshotSyncRequest;
+
+/**
+ * Replays an image mirrored in snapshot mode by periodically creating a
+ * mirror snapshot on the primary (remote) image and copying the objects
+ * that changed since the last synced mirror snapshot into the local image.
+ */
+template <typename ImageCtxT = librbd::ImageCtx>
+class SnapshotReplayer {
+public:
+  struct Listener {
+    virtual ~Listener() {
+    }
+
+    /// invoked once replay stopped due to an error or a remote demotion
+    virtual void handle_replay_complete(int r, const std::string &desc) = 0;
+  };
+
+  static SnapshotReplayer *create(Threads<librbd::ImageCtx> *threads,
+                                  librados::IoCtx &local_io_ctx,
+                                  librados::IoCtx &remote_io_ctx,
+                                  const std::string &global_image_id,
+                                  const std::string &local_mirror_uuid,
+                                  const std::string &remote_mirror_uuid,
+                                  const std::string &remote_image_id,
+                                  const std::string &local_image_id,
+                                  Listener *listener) {
+    return new SnapshotReplayer(threads, local_io_ctx, remote_io_ctx,
+                                global_image_id, local_mirror_uuid,
+                                remote_mirror_uuid, remote_image_id,
+                                local_image_id, listener);
+  }
+  static void destroy(SnapshotReplayer *snapshot_replayer) {
+    delete snapshot_replayer;
+  }
+
+  SnapshotReplayer(Threads<librbd::ImageCtx> *threads,
+                   librados::IoCtx &local_io_ctx,
+                   librados::IoCtx &remote_io_ctx,
+                   const std::string &global_image_id,
+                   const std::string &local_mirror_uuid,
+                   const std::string &remote_mirror_uuid,
+                   const std::string &remote_image_id,
+                   const std::string &local_image_id,
+                   Listener *listener);
+  ~SnapshotReplayer();
+
+  SnapshotReplayer(const SnapshotReplayer&) = delete;
+  SnapshotReplayer &operator=(const SnapshotReplayer&) = delete;
+
+  /**
+   * Open the remote and local images (creating the local image if needed).
+   * Fails with -EREMOTEIO if the remote image is not primary or the local
+   * image is primary.
+   */
+  void init(Context *on_finish);
+  void shut_down(Context *on_finish);
+
+  std::string get_local_image_id() const;
+  std::string get_local_image_name() const;
+  std::string get_status_description() const;
+
+private:
+  /**
+   * @verbatim
+   *
+   * <init>
+   *    |
+   *    v
+   * OPEN_REMOTE_IMAGE  * * * * * * * * * * *
+   *    |                                   *
+   *    v                                   *
+   * CREATE_LOCAL_IMAGE (skip if exists)  * *
+   *    |                                   *
+   *    v                                   *
+   * OPEN_LOCAL_IMAGE * * * * * * * * * * * *
+   *    |                                   * (error)
+   *    v                                   v
+   * SYNC <-----------------------\      <wait for shut down>
+   *    |                         |         |
+   *    v (idle)                  |         |
+   * WAIT (snapshot interval) ----/         |
+   *    .                                   |
+   *    . (shut down / demoted / error)     |
+   *    v                                   |
+   * CLOSE_LOCAL_IMAGE <--------------------/
+   *    |
+   *    v
+   * CLOSE_REMOTE_IMAGE
+   *    |
+   *    v
+   * <finish>
+   *
+   * @endverbatim
+   */
+
+  Threads<librbd::ImageCtx> *m_threads;
+  librados::IoCtx &m_local_io_ctx;
+  librados::IoCtx &m_remote_io_ctx;
+  std::string m_global_image_id;
+  std::string m_local_mirror_uuid;
+  std::string m_remote_mirror_uuid;
+  std::string m_remote_image_id;
+  std::string m_local_image_id;
+  Listener *m_listener;
+
+  mutable Mutex m_lock;
+  bool m_stopping = false;
+  Context *m_on_init_finish = nullptr;
+  Context *m_on_shut_down_finish = nullptr;
+  std::string m_local_image_name;
+  std::string m_status;
+  std::string m_created_image_id;
+
+  ImageCtxT *m_remote_image_ctx = nullptr;
+  ImageCtxT *m_local_image_ctx = nullptr;
+
+  SnapshotSyncRequest<ImageCtxT> *m_sync_request = nullptr;
+  bool m_sync_queued = false;
+  Context *m_sync_timer_ctx = nullptr;
+  std::string m_sync_snap_uuid;
+  bool m_demoted = false;
+
+  void open_remote_image();
+  void handle_open_remote_image(int r);
+
+  void create_local_image();
+  void handle_create_local_image(int r);
+
+  void open_local_image();
+  void handle_open_local_image(int r);
+
+  void finish_init(int r);
+
+  void sync();
+  void handle_sync(int r);
+  void schedule_sync();
+  void handle_sync_timer();
+
+  void close_local_image();
+  void handle_close_local_image(int r);
+
+  void close_remote_image();
+  void handle_close_remote_image(int r);
+
+  void set_status(const std::string &status);
+
+};
+
+} // namespace image_replayer
+} // namespace mirror
+} // namespace rbd
+
+extern template class rbd::mirror::image_replayer::SnapshotReplayer<librbd::ImageCtx>;
+
+#endif // RBD_MIRROR_IMAGE_REPLAYER_SNAPSHOT_REPLAYER_H
@@ -0,0 +1,666 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "SnapshotSyncRequest.h"
+#include "SnapshotObjectCopyRequest.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "cls/rbd/cls_rbd_client.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/ImageState.h"
+#include "librbd/ObjectMap.h"
+#include "librbd/Operations.h"
+#include "librbd/Utils.h"
+#include "librbd/io/AioCompletion.h"
+#include "librbd/io/ImageRequestWQ.h"
+#include "osdc/Striper.h"
+#include <algorithm>
+
+#define dout_context g_ceph_context
+#define dout_subsys ceph_subsys_rbd_mirror
+#undef dout_prefix
+#define dout_prefix *_dout << "rbd::mirror::image_replayer::SnapshotSyncRequest: " \
+                           << this << " " << __func__
+
+namespace rbd {
+namespace mirror {
+namespace image_replayer {
+
+using librbd::mirror::snapshot::get_snap_name;
+using librbd::mirror::snapshot::list_snaps;
+using librbd::util::create_context_callback;
+using librbd::util::create_rados_callback;
+using librbd::util::unique_lock_name;
+
+template <typename I>
+SnapshotSyncRequest<I>::SnapshotSyncRequest(
+    I *local_image_ctx, I *remote_image_ctx,
+    const std::string &local_mirror_uuid, std::string *snap_uuid,
+    bool *demoted, Context *on_finish)
+  : m_local_image_ctx(local_image_ctx), m_remote_image_ctx(remote_image_ctx),
+    m_local_mirror_uuid(local_mirror_uuid), m_snap_uuid(snap_uuid),
+    m_demoted(demoted), m_on_finish(on_finish),
+    m_local_state(librbd::mirror::snapshot::STATE_NON_PRIMARY),
+    m_lock(unique_lock_name("SnapshotSyncRequest::m_lock", this)) {
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::send() {
+  *m_demoted = false;
+  refresh_remote_image();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::cancel() {
+  Mutex::Locker locker(m_lock);
+
+  dout(20) << dendl;
+  m_canceled = true;
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::refresh_remote_image() {
+  if (!m_remote_image_ctx->state->is_refresh_required()) {
+    refresh_local_image();
+    return;
+  }
+
+  dout(20) << dendl;
+
+  Context *ctx = create_context_callback<
+    SnapshotSyncRequest<I>,
+    &SnapshotSyncRequest<I>::handle_refresh_remote_image>(this);
+  m_remote_image_ctx->state->refresh(ctx);
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::handle_refresh_remote_image(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0) {
+    derr << ": failed to refresh remote image: " << cpp_strerror(r) << dendl;
+    finish(r);
+    return;
+  }
+
+  refresh_local_image();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::refresh_local_image() {
+  if (!m_local_image_ctx->state->is_refresh_required()) {
+    handle_refresh_local_image(0);
+    return;
+  }
+
+  dout(20) << dendl;
+
+  Context *ctx = create_context_callback<
+    SnapshotSyncRequest<I>,
+    &SnapshotSyncRequest<I>::handle_refresh_local_image>(this);
+  m_local_image_ctx->state->refresh(ctx);
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::handle_refresh_local_image(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0) {
+    derr << ": failed to refresh local image: " << cpp_strerror(r) << dendl;
+    finish(r);
+    return;
+  }
+
+  {
+    RWLock::RLocker snap_locker(m_remote_image_ctx->snap_lock);
+    list_snaps(m_remote_image_ctx, &m_remote_snaps);
+  }
+  {
+    RWLock::RLocker snap_locker(m_local_image_ctx->snap_lock);
+    list_snaps(m_local_image_ctx, &m_local_snaps);
+  }
+
+  if (m_remote_snaps.empty() ||
+      m_remote_snaps.back().state ==
+        librbd::mirror::snapshot::STATE_NON_PRIMARY) {
+    dout(10) << ": remote image is non-primary" << dendl;
+    finish(-EREMOTEIO);
+    return;
+  }
+
+  // the most recent local mirror snapshot that still exists on the remote
+  // image is the base for the incremental sync
+  const MirrorSnapshot *local_base_snap = nullptr;
+  for (auto local_it = m_local_snaps.rbegin();
+       local_it != m_local_snaps.rend() && local_base_snap == nullptr;
+       ++local_it) {
+    for (auto &remote_snap : m_remote_snaps) {
+      if (remote_snap.snap_uuid == local_it->snap_uuid) {
+        local_base_snap = &(*local_it);
+        m_from_snap_id = remote_snap.snap_id;
+        break;
+      }
+    }
+  }
+
+  // without a common base, any data left behind by a previous sync
+  // must be discarded prior to a full sync
+  m_discard_all = (local_base_snap == nullptr && !m_local_snaps.empty());
+
+  if (m_remote_snaps.back().state ==
+        librbd::mirror::snapshot::STATE_DEMOTED) {
+    m_remote_snap = m_remote_snaps.back();
+    if (local_base_snap != nullptr &&
+        local_base_snap->snap_uuid == m_remote_snap.snap_uuid) {
+      dout(10) << ": remote image demotion already synced" << dendl;
+      *m_demoted = true;
+      finish(0);
+      return;
+    }
+
+    m_local_state = librbd::mirror::snapshot::STATE_DEMOTED;
+    resize_local_image();
+    return;
+  }
+
+  create_remote_snapshot();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::create_remote_snapshot() {
+  m_remote_snap.state = librbd::mirror::snapshot::STATE_PRIMARY;
+  m_remote_snap.peer_mirror_uuid = m_local_mirror_uuid;
+  m_remote_snap.snap_uuid = librbd::mirror::snapshot::generate_snap_uuid();
+  m_remote_snap.snap_name = get_snap_name(m_remote_snap.state,
+                                          m_remote_snap.peer_mirror_uuid,
+                                          m_remote_snap.snap_uuid);
+
+  dout(20) << ": snap_name=" << m_remote_snap.snap_name << dendl;
+
+  Context *ctx = create_context_callback<
+    SnapshotSyncRequest<I>,
+    &SnapshotSyncRequest<I>::handle_create_remote_snapshot>(this);
+  m_remote_image_ctx->operations->snap_create(
+    cls::rbd::UserSnapshotNamespace(), m_remote_snap.snap_name.c_str(), ctx);
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::handle_create_remote_snapshot(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0) {
+    derr << ": failed to create remote mirror snapshot: " << cpp_strerror(r)
+         << dendl;
+    finish(r);
+    return;
+  }
+
+  // the snapshot id is only known once the snapshot was created
+  {
+    RWLock::RLocker snap_locker(m_remote_image_ctx->snap_lock);
+    list_snaps(m_remote_image_ctx, &m_remote_snaps);
+  }
+  auto it = std::find_if(m_remote_snaps.begin(), m_remote_snaps.end(),
+                         [this](const MirrorSnapshot &snap) {
+                           return snap.snap_uuid == m_remote_snap.snap_uuid;
+                         });
+  if (it == m_remote_snaps.end()) {
+    derr << ": failed to locate remote mirror snapshot "
+         << m_remote_snap.snap_name << dendl;
+    finish(-ENOENT);
+    return;
+  }
+  m_remote_snap.snap_id = it->snap_id;
+
+  resize_local_image();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::resize_local_image() {
+  dout(10) << ": syncing snapshot " << m_remote_snap.snap_name << " from "
+           << "snap_id=" << m_from_snap_id << dendl;
+  *m_snap_uuid = m_remote_snap.snap_uuid;
+
+  uint64_t local_size;
+  {
+    RWLock::RLocker snap_locker(m_remote_image_ctx->snap_lock);
+    m_image_size = m_remote_image_ctx->get_image_size(m_remote_snap.snap_id);
+  }
+  {
+    RWLock::RLocker snap_locker(m_local_image_ctx->snap_lock);
+    local_size = m_local_image_ctx->get_image_size(CEPH_NOSNAP);
+  }
+
+  if (local_size == m_image_size) {
+    discard_local_image();
+    return;
+  }
+
+  dout(20) << ": resizing local image from " << local_size << " to "
+           << m_image_size << dendl;
+
+  Context *ctx = create_context_callback<
+    SnapshotSyncRequest<I>,
+    &SnapshotSyncRequest<I>::handle_resize_local_image>(this);
+  RWLock::RLocker owner_locker(m_local_image_ctx->owner_lock);
+  m_local_image_ctx->operations->execute_resize(m_image_size, true,
+                                                m_prog_ctx, ctx, 0);
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::handle_resize_local_image(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0) {
+    derr << ": failed to resize local image: " << cpp_strerror(r) << dendl;
+    finish(r);
+    return;
+  }
+
+  discard_local_image();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::discard_local_image() {
+  if (!m_discard_all || m_image_size == 0) {
+    load_object_maps();
+    return;
+  }
+
+  dout(20) << dendl;
+
+  Context *ctx = create_context_callback<
+    SnapshotSyncRequest<I>,
+    &SnapshotSyncRequest<I>::handle_discard_local_image>(this);
+  auto comp = librbd::io::AioCompletion::create(ctx);
+  m_local_image_ctx->io_work_queue->aio_discard(comp, 0, m_image_size, false);
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::handle_discard_local_image(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0) {
+    derr << ": failed to discard local image: " << cpp_strerror(r) << dendl;
+    finish(r);
+    return;
+  }
+
+  load_object_maps();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::load_object_maps() {
+  m_object_map_snap_ids.clear();
+  m_prev_object_map.clear();
+  m_object_changed.clear();
+  m_use_object_map = false;
+
+  {
+    RWLock::RLocker snap_locker(m_remote_image_ctx->snap_lock);
+    if (!m_remote_image_ctx->test_features(RBD_FEATURE_FAST_DIFF,
+                                           m_remote_image_ctx->snap_lock)) {
+      copy_objects();
+      return;
+    }
+
+    // the fast-diff state of every snapshot between the base and the new
+    // mirror snapshot must be valid in order to skip unchanged objects --
+    // a full sync only needs the objects within the new mirror snapshot
+    for (auto &snap_info_pair : m_remote_image_ctx->snap_info) {
+      if (snap_info_pair.first > m_remote_snap.snap_id ||
+          (m_from_snap_id == 0 ?
+             snap_info_pair.first != m_remote_snap.snap_id :
+             snap_info_pair.first < m_from_snap_id)) {
+        continue;
+      }
+      if ((snap_info_pair.second.flags & RBD_FLAG_FAST_DIFF_INVALID) != 0) {
+        dout(10) << ": fast-diff invalid for snap_id="
+                 << snap_info_pair.first << dendl;
+        copy_objects();
+        return;
+      }
+      m_object_map_snap_ids.push_back(snap_info_pair.first);
+    }
+  }
+
+  m_use_object_map = true;
+  load_object_map();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::load_object_map() {
+  if (m_object_map_snap_ids.empty()) {
+    copy_objects();
+    return;
+  }
+
+  librados::snap_t snap_id = m_object_map_snap_ids.front();
+  std::string oid(librbd::ObjectMap<>::object_map_name(
+    m_remote_image_ctx->id, snap_id));
+  dout(20) << ": oid=" << oid << dendl;
+
+  librados::ObjectReadOperation op;
+  librbd::cls_client::object_map_load_start(&op);
+
+  m_out_bl.clear();
+  librados::AioCompletion *comp = create_rados_callback<
+    SnapshotSyncRequest<I>,
+    &SnapshotSyncRequest<I>::handle_load_object_map>(this);
+  int r = m_remote_image_ctx->md_ctx.aio_operate(oid, comp, &op, &m_out_bl);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::handle_load_object_map(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  librados::snap_t snap_id = m_object_map_snap_ids.front();
+  m_object_map_snap_ids.erase(m_object_map_snap_ids.begin());
+
+  BitVector<2> object_map;
+  if (r == 0) {
+    bufferlist::iterator it = m_out_bl.begin();
+    r = librbd::cls_client::object_map_load_finish(&it, &object_map);
+  }
+
+  uint64_t num_objs = 0;
+  if (r == 0) {
+    RWLock::RLocker snap_locker(m_remote_image_ctx->snap_lock);
+    num_objs = Striper::get_num_objects(
+      m_remote_image_ctx->layout, m_remote_image_ctx->get_image_size(snap_id));
+    if (object_map.size() < num_objs) {
+      r = -EINVAL;
+    }
+  }
+
+  if (r < 0) {
+    // fall back to listing every object
+    dout(5) << ": failed to load object map for snap_id=" << snap_id << ": "
+            << cpp_strerror(r) << dendl;
+    m_use_object_map = false;
+    m_object_map_snap_ids.clear();
+    copy_objects();
+    return;
+  }
+  object_map.resize(num_objs);
+
+  // the base snapshot only provides the initial state of the objects
+  if (snap_id == m_from_snap_id) {
+    m_prev_object_map = object_map;
+    load_object_map();
+    return;
+  }
+
+  if (m_object_changed.size() < object_map.size()) {
+    m_object_changed.resize(object_map.size(), false);
+  }
+
+  uint64_t overlap = std::min(object_map.size(), m_prev_object_map.size());
+  for (uint64_t i = 0; i < overlap; ++i) {
+    if (object_map[i] == OBJECT_NONEXISTENT) {
+      if (m_prev_object_map[i] != OBJECT_NONEXISTENT) {
+        m_object_changed[i] = true;
+      }
+    } else if (object_map[i] == OBJECT_EXISTS ||
+               (m_prev_object_map[i] != object_map[i] &&
+                !(m_prev_object_map[i] == OBJECT_EXISTS &&
+                  object_map[i] == OBJECT_EXISTS_CLEAN))) {
+      m_object_changed[i] = true;
+    }
+  }
+  for (uint64_t i = overlap; i < object_map.size(); ++i) {
+    if (object_map[i] != OBJECT_NONEXISTENT) {
+      m_object_changed[i] = true;
+    }
+  }
+
+  m_prev_object_map = object_map;
+  load_object_map();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::copy_objects() {
+  CephContext *cct = m_local_image_ctx->cct;
+
+  m_object_no = 0;
+  {
+    RWLock::RLocker snap_locker(m_remote_image_ctx->snap_lock);
+    m_end_object_no = m_remote_image_ctx->get_object_count(
+      m_remote_snap.snap_id);
+  }
+
+  dout(20) << ": end_object=" << m_end_object_no << ", "
+           << "use_object_map=" << m_use_object_map << dendl;
+
+  bool complete;
+  int r;
+  {
+    Mutex::Locker locker(m_lock);
+    for (int i = 0; i < cct->_conf->rbd_concurrent_management_ops; ++i) {
+      copy_next_object();
+      if (m_ret_val < 0 && m_current_ops == 0) {
+        break;
+      }
+    }
+    complete = (m_current_ops == 0);
+    r = m_ret_val;
+  }
+
+  if (complete) {
+    handle_copy_objects(r);
+  }
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::copy_next_object() {
+  assert(m_lock.is_locked());
+
+  if (m_canceled && m_ret_val == 0) {
+    dout(10) << ": sync canceled" << dendl;
+    m_ret_val = -ECANCELED;
+  }
+
+  // objects that did not change since the base snapshot have nothing
+  // to copy
+  while (m_use_object_map && m_object_no < m_end_object_no &&
+         (m_object_no >= m_object_changed.size() ||
+          !m_object_changed[m_object_no])) {
+    ++m_object_no;
+  }
+
+  if (m_ret_val < 0 || m_object_no >= m_end_object_no) {
+    return;
+  }
+
+  uint64_t object_no = m_object_no++;
+  ++m_current_ops;
+
+  Context *ctx = new FunctionContext([this, object_no](int r) {
+      handle_copy_object(object_no, r);
+    });
+  auto req = SnapshotObjectCopyRequest<I>::create(
+    m_local_image_ctx, m_remote_image_ctx, m_from_snap_id,
+    m_remote_snap.snap_id, object_no, ctx);
+  req->send();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::handle_copy_object(uint64_t object_no, int r) {
+  dout(20) << ": object_num=" << object_no << ", r=" << r << dendl;
+
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_current_ops > 0);
+    --m_current_ops;
+
+    if (r < 0) {
+      derr << ": object copy failed: " << cpp_strerror(r) << dendl;
+      if (m_ret_val == 0) {
+        m_ret_val = r;
+      }
+    }
+
+    copy_next_object();
+    if (m_current_ops > 0) {
+      return;
+    }
+    r = m_ret_val;
+  }
+
+  handle_copy_objects(r);
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::handle_copy_objects(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0) {
+    finish(r);
+    return;
+  }
+
+  flush_local_image();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::flush_local_image() {
+  dout(20) << dendl;
+
+  Context *ctx = create_context_callback<
+    SnapshotSyncRequest<I>,
+    &SnapshotSyncRequest<I>::handle_flush_local_image>(this);
+  auto comp = librbd::io::AioCompletion::create(ctx);
+  m_local_image_ctx->io_work_queue->aio_flush(comp);
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::handle_flush_local_image(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0) {
+    derr << ": failed to flush local image: " << cpp_strerror(r) << dendl;
+    finish(r);
+    return;
+  }
+
+  create_local_snapshot();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::create_local_snapshot() {
+  std::string snap_name = get_snap_name(m_local_state, "",
+                                        m_remote_snap.snap_uuid);
+  dout(20) << ": snap_name=" << snap_name << dendl;
+
+  Context *ctx = create_context_callback<
+    SnapshotSyncRequest<I>,
+    &SnapshotSyncRequest<I>::handle_create_local_snapshot>(this);
+  RWLock::RLocker owner_locker(m_local_image_ctx->owner_lock);
+  m_local_image_ctx->operations->execute_snap_create(
+    cls::rbd::UserSnapshotNamespace(), snap_name, ctx, 0, false);
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::handle_create_local_snapshot(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0) {
+    derr << ": failed to create local mirror snapshot: " << cpp_strerror(r)
+         << dendl;
+    finish(r);
+    return;
+  }
+
+  // all pre-existing local mirror snapshots are superseded by the new one
+  m_prune_snaps = m_local_snaps;
+  remove_local_snapshot();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::remove_local_snapshot() {
+  if (m_prune_snaps.empty()) {
+    // only remove the remote mirror snapshots created for this peer
+    for (auto &snap : m_remote_snaps) {
+      if (snap.snap_uuid == m_remote_snap.snap_uuid) {
+        break;
+      } else if (snap.peer_mirror_uuid == m_local_mirror_uuid) {
+        m_prune_snaps.push_back(snap);
+      }
+    }
+    remove_remote_snapshot();
+    return;
+  }
+
+  auto &snap_name = m_prune_snaps.front().snap_name;
+  dout(20) << ": snap_name=" << snap_name << dendl;
+
+  Context *ctx = create_context_callback<
+    SnapshotSyncRequest<I>,
+    &SnapshotSyncRequest<I>::handle_remove_local_snapshot>(this);
+  RWLock::RLocker owner_locker(m_local_image_ctx->owner_lock);
+  m_local_image_ctx->operations->execute_snap_remove(
+    cls::rbd::UserSnapshotNamespace(), snap_name, ctx);
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::handle_remove_local_snapshot(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0 && r != -ENOENT) {
+    // a stale snapshot will be pruned after the next sync
+    derr << ": failed to remove local mirror snapshot "
+         << m_prune_snaps.front().snap_name << ": " << cpp_strerror(r)
+         << dendl;
+  }
+
+  m_prune_snaps.erase(m_prune_snaps.begin());
+  remove_local_snapshot();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::remove_remote_snapshot() {
+  if (m_prune_snaps.empty()) {
+    *m_demoted = (m_local_state == librbd::mirror::snapshot::STATE_DEMOTED);
+    finish(0);
+    return;
+  }
+
+  auto &snap_name = m_prune_snaps.front().snap_name;
+  dout(20) << ": snap_name=" << snap_name << dendl;
+
+  Context *ctx = create_context_callback<
+    SnapshotSyncRequest<I>,
+    &SnapshotSyncRequest<I>::handle_remove_remote_snapshot>(this);
+  m_remote_image_ctx->operations->snap_remove(
+    cls::rbd::UserSnapshotNamespace(), snap_name.c_str(), ctx);
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::handle_remove_remote_snapshot(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0 && r != -ENOENT) {
+    derr << ": failed to remove remote mirror snapshot "
+         << m_prune_snaps.front().snap_name << ": " << cpp_strerror(r)
+         << dendl;
+  }
+
+  m_prune_snaps.erase(m_prune_snaps.begin());
+  remove_remote_snapshot();
+}
+
+template <typename I>
+void SnapshotSyncRequest<I>::finish(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  m_on_finish->complete(r);
+  delete this;
+}
+
+} // namespace image_replayer
+} // namespace mirror
+} // namespace rbd
+
+template class rbd::mirror::image_replayer::SnapshotSyncRequest<librbd::ImageCtx>;
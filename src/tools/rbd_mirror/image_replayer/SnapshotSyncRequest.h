@@ -0,0 +1,183 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef RBD_MIRROR_IMAGE_REPLAYER_SNAPSHOT_SYNC_REQUEST_H
+#define RBD_MIRROR_IMAGE_REPLAYER_SNAPSHOT_SYNC_REQUEST_H
+
+#include "include/int_types.h"
+#include "include/buffer.h"
+#include "include/rados/librados.hpp"
+#include "common/Mutex.h"
+#include "common/bit_vector.hpp"
+#include "librbd/internal.h"
+#include "librbd/mirror/SnapshotUtils.h"
+#include <string>
+#include <vector>
+
+class Context;
+namespace librbd { struct ImageCtx; }
+
+namespace rbd {
+namespace mirror {
+namespace image_replayer {
+
+/**
+ * Syncs the local image with the primary (remote) image: creates a mirror
+ * snapshot on the remote image (unless the remote image was demoted),
+ * copies the objects that changed since the last synced mirror snapshot
+ * and records the new state within a local mirror snapshot.
+ */
+template <typename ImageCtxT = librbd::ImageCtx>
+class SnapshotSyncRequest {
+public:
+  static SnapshotSyncRequest* create(ImageCtxT *local_image_ctx,
+                                     ImageCtxT *remote_image_ctx,
+                                     const std::string &local_mirror_uuid,
+                                     std::string *snap_uuid, bool *demoted,
+                                     Context *on_finish) {
+    return new SnapshotSyncRequest(local_image_ctx, remote_image_ctx,
+                                   local_mirror_uuid, snap_uuid, demoted,
+                                   on_finish);
+  }
+
+  SnapshotSyncRequest(ImageCtxT *local_image_ctx, ImageCtxT *remote_image_ctx,
+                      const std::string &local_mirror_uuid,
+                      std::string *snap_uuid, bool *demoted,
+                      Context *on_finish);
+
+  void send();
+  void cancel();
+
+private:
+  /**
+   * @verbatim
+   *
+   * <start>
+   *    |
+   *    v
+   * REFRESH_REMOTE_IMAGE (skip if not required)
+   *    |
+   *    v
+   * REFRESH_LOCAL_IMAGE (skip if not required)
+   *    |
+   *    v (remote demotion already synced)
+   * CREATE_REMOTE_SNAPSHOT * * * * * * * * * * *
+   *    |   (skip if remote demoted)             *
+   *    v                                        *
+   * RESIZE_LOCAL_IMAGE (skip if same size)      *
+   *    |                                        *
+   *    v                                        *
+   * DISCARD_LOCAL_IMAGE (skip if common base)   *
+   *    |                                        *
+   *    v                                        *
+   * LOAD_OBJECT_MAP <----\                      *
+   *    |                 | (repeat for each     *
+   *    |                 |  snapshot, skip      *
+   *    |                 |  without fast-diff)  *
+   *    |-----------------/                      *
+   *    v                                        *
+   * COPY_OBJECTS                                *
+   *    |                                        *
+   *    v                                        *
+   * FLUSH_LOCAL_IMAGE                           *
+   *    |                                        *
+   *    v                                        *
+   * CREATE_LOCAL_SNAPSHOT                       *
+   *    |                                        *
+   *    v                                        *
+   * REMOVE_LOCAL_SNAPSHOT <----\                *
+   *    |                       | (repeat for    *
+   *    |                       |  each older    *
+   *    |                       |  snapshot)     *
+   *    |-----------------------/                *
+   *    v                                        *
+   * REMOVE_REMOTE_SNAPSHOT <---\                *
+   *    |                       |                *
+   *    |-----------------------/                *
+   *    v                                        *
+   * <finish> < * * * * * * * * * * * * * * * * *
+   *
+   * @endverbatim
+   */
+
+  typedef librbd::mirror::snapshot::MirrorSnapshot MirrorSnapshot;
+  typedef librbd::mirror::snapshot::MirrorSnapshots MirrorSnapshots;
+
+  ImageCtxT *m_local_image_ctx;
+  ImageCtxT *m_remote_image_ctx;
+  std::string m_local_mirror_uuid;
+  std::string *m_snap_uuid;
+  bool *m_demoted;
+  Context *m_on_finish;
+
+  MirrorSnapshots m_local_snaps;
+  MirrorSnapshots m_remote_snaps;
+  MirrorSnapshot m_remote_snap;
+  librbd::mirror::snapshot::State m_local_state;
+  librados::snap_t m_from_snap_id = 0;
+  bool m_discard_all = false;
+  uint64_t m_image_size = 0;
+  librbd::NoOpProgressContext m_prog_ctx;
+
+  std::vector<librados::snap_t> m_object_map_snap_ids;
+  bufferlist m_out_bl;
+  BitVector<2> m_prev_object_map;
+  bool m_use_object_map = false;
+  std::vector<bool> m_object_changed;
+
+  Mutex m_lock;
+  bool m_canceled = false;
+  int m_ret_val = 0;
+  uint64_t m_object_no = 0;
+  uint64_t m_end_object_no = 0;
+  int m_current_ops = 0;
+
+  MirrorSnapshots m_prune_snaps;
+
+  void refresh_remote_image();
+  void handle_refresh_remote_image(int r);
+
+  void refresh_local_image();
+  void handle_refresh_local_image(int r);
+
+  void create_remote_snapshot();
+  void handle_create_remote_snapshot(int r);
+
+  void resize_local_image();
+  void handle_resize_local_image(int r);
+
+  void discard_local_image();
+  void handle_discard_local_image(int r);
+
+  void load_object_maps();
+  void load_object_map();
+  void handle_load_object_map(int r);
+
+  void copy_objects();
+  void copy_next_object();
+  void handle_copy_object(uint64_t object_no, int r);
+  void handle_copy_objects(int r);
+
+  void flush_local_image();
+  void handle_flush_local_image(int r);
+
+  void create_local_snapshot();
+  void handle_create_local_snapshot(int r);
+
+  void remove_local_snapshot();
+  void handle_remove_local_snapshot(int r);
+
+  void remove_remote_snapshot();
+  void handle_remove_remote_snapshot(int r);
+
+  void finish(int r);
+
+};
+
+} // namespace image_replayer
+} // namespace mirror
+} // namespace rbd
+
+extern template class rbd::mirror::image_replayer::SnapshotSyncRequest<librbd::ImageCtx>;
+
+#endif // RBD_MIRROR_IMAGE_REPLAYER_SNAPSHOT_SYNC_REQUEST_H
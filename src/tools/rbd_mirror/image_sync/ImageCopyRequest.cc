@@ -6,7 +6,9 @@
 #include "include/stringify.h"
 #include "common/errno.h"
 #include "common/Timer.h"
+#include "cls/rbd/cls_rbd_client.h"
 #include "journal/Journaler.h"
+#include "librbd/ObjectMap.h"
 #include "librbd/Utils.h"
 #include "tools/rbd_mirror/ProgressContext.h"
 
@@ -21,6 +23,7 @@ namespace mirror {
 namespace image_sync {
 
 using librbd::util::create_context_callback;
+using librbd::util::create_rados_callback;
 using librbd::util::unique_lock_name;
 
 template <typename I>
@@ -77,7 +80,7 @@ void ImageCopyRequest<I>::send_update_max_object_count() {
   }
 
   if (max_objects <= m_client_meta->sync_object_count) {
-    send_object_copies();
+    send_load_object_maps();
     return;
   }
 
@@ -121,7 +124,97 @@ void ImageCopyRequest<I>::handle_update_max_object_count(int r) {
   // update provided meta structure to reflect reality
   m_client_meta->sync_object_count = m_client_meta_copy.sync_object_count;
 
-  send_object_copies();
+  send_load_object_maps();
+}
+
+template <typename I>
+void ImageCopyRequest<I>::send_load_object_maps() {
+  m_object_map_snap_ids.clear();
+  {
+    RWLock::RLocker snap_locker(m_remote_image_ctx->snap_lock);
+    if (!m_remote_image_ctx->test_features(RBD_FEATURE_OBJECT_MAP,
+                                           m_remote_image_ctx->snap_lock)) {
+      send_object_copies();
+      return;
+    }
+
+    // the object maps of all synced snapshots must be valid in order to
+    // skip objects that do not exist in any of them
+    for (auto &snap_map_pair : m_snap_map) {
+      auto snap_info_it = m_remote_image_ctx->snap_info.find(
+        snap_map_pair.first);
+      if (snap_info_it == m_remote_image_ctx->snap_info.end() ||
+          (snap_info_it->second.flags & RBD_FLAG_OBJECT_MAP_INVALID) != 0) {
+        dout(10) << ": object map invalid for snap_id=" << snap_map_pair.first
+                 << dendl;
+        send_object_copies();
+        return;
+      }
+      m_object_map_snap_ids.push_back(snap_map_pair.first);
+    }
+  }
+
+  update_progress("LOAD_OBJECT_MAP");
+
+  m_use_object_map = true;
+  m_object_may_exist.clear();
+  send_load_object_map();
+}
+
+template <typename I>
+void ImageCopyRequest<I>::send_load_object_map() {
+  if (m_object_map_snap_ids.empty()) {
+    send_object_copies();
+    return;
+  }
+
+  librados::snap_t snap_id = m_object_map_snap_ids.back();
+  std::string oid(librbd::ObjectMap<>::object_map_name(
+    m_remote_image_ctx->id, snap_id));
+  dout(20) << ": oid=" << oid << dendl;
+
+  librados::ObjectReadOperation op;
+  librbd::cls_client::object_map_load_start(&op);
+
+  m_out_bl.clear();
+  librados::AioCompletion *comp = create_rados_callback<
+    ImageCopyRequest<I>, &ImageCopyRequest<I>::handle_load_object_map>(this);
+  int r = m_remote_image_ctx->md_ctx.aio_operate(oid, comp, &op, &m_out_bl);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void ImageCopyRequest<I>::handle_load_object_map(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  BitVector<2> object_map;
+  if (r == 0) {
+    bufferlist::iterator it = m_out_bl.begin();
+    r = librbd::cls_client::object_map_load_finish(&it, &object_map);
+  }
+
+  if (r < 0) {
+    // fall back to listing every object
+    dout(5) << ": failed to load object map: " << cpp_strerror(r) << dendl;
+    m_use_object_map = false;
+    m_object_may_exist.clear();
+    m_object_map_snap_ids.clear();
+    send_object_copies();
+    return;
+  }
+
+  if (m_object_may_exist.size() < object_map.size()) {
+    m_object_may_exist.resize(object_map.size(), false);
+  }
+  for (uint64_t object_no = 0; object_no < object_map.size(); ++object_no) {
+    if (object_map[object_no] != OBJECT_NONEXISTENT) {
+      m_object_may_exist[object_no] = true;
+    }
+  }
+
+  m_object_map_snap_ids.pop_back();
+  send_load_object_map();
 }
 
 template <typename I>
@@ -179,6 +272,14 @@ void ImageCopyRequest<I>::send_next_object_copy() {
     m_ret_val = -ECANCELED;
   }
 
+  // objects that do not exist within any synced snapshot have nothing
+  // to copy
+  while (m_use_object_map && m_object_no < m_end_object_no &&
+         (m_object_no >= m_object_may_exist.size() ||
+          !m_object_may_exist[m_object_no])) {
+    ++m_object_no;
+  }
+
   if (m_ret_val < 0 || m_object_no >= m_end_object_no) {
     return;
   }
@@ -188,17 +289,19 @@ void ImageCopyRequest<I>::send_next_object_copy() {
   dout(20) << ": object_num=" << ono << dendl;
 
   ++m_current_ops;
+  m_in_flight_objects.insert(ono);
 
-  Context *ctx = create_context_callback<
-    ImageCopyRequest<I>, &ImageCopyRequest<I>::handle_object_copy>(this);
+  Context *ctx = new FunctionContext([this, ono](int r) {
+      handle_object_copy(ono, r);
+    });
   ObjectCopyRequest<I> *req = ObjectCopyRequest<I>::create(
     m_local_image_ctx, m_remote_image_ctx, &m_snap_map, ono, ctx);
   req->send();
 }
 
 template <typename I>
-void ImageCopyRequest<I>::handle_object_copy(int r) {
-  dout(20) << ": r=" << r << dendl;
+void ImageCopyRequest<I>::handle_object_copy(uint64_t object_no, int r) {
+  dout(20) << ": object_num=" << object_no << ", r=" << r << dendl;
 
   int percent;
   bool complete;
@@ -214,6 +317,9 @@ void ImageCopyRequest<I>::handle_object_copy(int r) {
       if (m_ret_val == 0) {
         m_ret_val = r;
       }
+    } else {
+      // failed objects are kept to prevent checkpointing past them
+      m_in_flight_objects.erase(object_no);
     }
 
     send_next_object_copy();
@@ -253,16 +359,24 @@ void ImageCopyRequest<I>::send_update_sync_point() {
     return;
   }
 
-  if (m_sync_point->object_number &&
-      (m_object_no-1) == m_sync_point->object_number.get()) {
+  // only objects below the oldest in-flight object copy are complete
+  uint64_t sync_object_no = get_sync_object_number();
+  if (sync_object_no == 0 ||
+      (m_sync_point->object_number &&
+       (sync_object_no - 1) == m_sync_point->object_number.get())) {
     // update sync point did not progress since last sync
+    assert(m_timer_lock->is_locked());
+    m_update_sync_ctx = new FunctionContext([this](int r) {
+        this->send_update_sync_point();
+      });
+    m_timer->add_event_after(m_update_sync_point_interval, m_update_sync_ctx);
     return;
   }
 
   m_updating_sync_point = true;
 
   m_client_meta_copy = *m_client_meta;
-  m_sync_point->object_number = m_object_no - 1;
+  m_sync_point->object_number = sync_object_no - 1;
 
   CephContext *cct = m_local_image_ctx->cct;
   ldout(cct, 20) << ": sync_point=" << *m_sync_point << dendl;
@@ -315,7 +429,13 @@ void ImageCopyRequest<I>::handle_update_sync_point(int r) {
 
 template <typename I>
 void ImageCopyRequest<I>::send_flush_sync_point() {
-  if (m_ret_val < 0) {
+  // record the progress even if the copy failed or was canceled so that
+  // the next sync can resume from it
+  uint64_t sync_object_no = get_sync_object_number();
+  if (m_ret_val < 0 &&
+      (sync_object_no == 0 ||
+       (m_sync_point->object_number &&
+        (sync_object_no - 1) == m_sync_point->object_number.get()))) {
     finish(m_ret_val);
     return;
   }
@@ -323,8 +443,8 @@ void ImageCopyRequest<I>::send_flush_sync_point() {
   update_progress("FLUSH_SYNC_POINT");
 
   m_client_meta_copy = *m_client_meta;
-  if (m_object_no > 0) {
-    m_sync_point->object_number = m_object_no - 1;
+  if (sync_object_no > 0) {
+    m_sync_point->object_number = sync_object_no - 1;
   } else {
     m_sync_point->object_number = boost::none;
   }
@@ -350,11 +470,11 @@ void ImageCopyRequest<I>::handle_flush_sync_point(int r) {
 
     derr << ": failed to update client data: " << cpp_strerror(r)
          << dendl;
-    finish(r);
+    finish(m_ret_val < 0 ? m_ret_val : r);
     return;
   }
 
-  finish(0);
+  finish(m_ret_val);
 }
 
 template <typename I>
@@ -404,6 +524,14 @@ int ImageCopyRequest<I>::compute_snap_map() {
   return 0;
 }
 
+template <typename I>
+uint64_t ImageCopyRequest<I>::get_sync_object_number() const {
+  if (m_in_flight_objects.empty()) {
+    return m_object_no;
+  }
+  return *m_in_flight_objects.begin();
+}
+
 template <typename I>
 void ImageCopyRequest<I>::update_progress(const std::string &description,
 					  bool flush) {
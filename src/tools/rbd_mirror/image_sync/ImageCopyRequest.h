@@ -11,6 +11,7 @@
 #include "librbd/journal/TypeTraits.h"
 #include "tools/rbd_mirror/BaseRequest.h"
 #include <map>
+#include <set>
 #include <vector>
 
 class Context;
@@ -67,6 +68,11 @@ private:
    *    v
    * UPDATE_MAX_OBJECT_COUNT
    *    |
+   *    |   . . . . . . .
+   *    |   .           .  (for each remote snapshot, skip
+   *    v   v           .   if object map is disabled)
+   * LOAD_OBJECT_MAP  . .
+   *    |
    *    |   . . . . .
    *    |   .       .  (parallel execution of
    *    v   v       .   multiple objects at once)
@@ -92,12 +98,20 @@ private:
 
   SnapMap m_snap_map;
 
+  std::vector<librados::snap_t> m_object_map_snap_ids;
+  bufferlist m_out_bl;
+
+  // objects that might exist within any of the synced remote snapshots
+  bool m_use_object_map = false;
+  std::vector<bool> m_object_may_exist;
+
   Mutex m_lock;
   bool m_canceled = false;
 
   uint64_t m_object_no = 0;
   uint64_t m_end_object_no;
   uint64_t m_current_ops = 0;
+  std::set<uint64_t> m_in_flight_objects;
   int m_ret_val = 0;
 
   bool m_updating_sync_point;
@@ -109,9 +123,13 @@ private:
   void send_update_max_object_count();
   void handle_update_max_object_count(int r);
 
+  void send_load_object_maps();
+  void send_load_object_map();
+  void handle_load_object_map(int r);
+
   void send_object_copies();
   void send_next_object_copy();
-  void handle_object_copy(int r);
+  void handle_object_copy(uint64_t object_no, int r);
 
   void send_update_sync_point();
   void handle_update_sync_point(int r);
@@ -120,6 +138,7 @@ private:
   void handle_flush_sync_point(int r);
 
   int compute_snap_map();
+  uint64_t get_sync_object_number() const;
 
   void update_progress(const std::string &description, bool flush = true);
 };
@@ -285,8 +285,8 @@ int update_osdmap(ObjectStore& fs, OSDSuperblock& sb, MonitorDBStore& ms)
     {
       const auto oid = OSD::get_osdmap_pobject_name(e);
       bufferlist bl;
-      int nread = fs.read(coll_t::meta(), oid, 0, 0, bl);
-      if (nread <= 0) {
+      int r = OSD::read_stored_osdmap(g_ceph_context, &fs, e, bl);
+      if (r < 0 || bl.length() == 0) {
         cerr << "missing " << oid << std::endl;
         return -EINVAL;
       }